@@ -323,6 +323,53 @@ LIBVLC_API void libvlc_event_detach( libvlc_event_manager_t *p_event_manager,
                                          libvlc_callback_t f_callback,
                                          void *p_user_data );
 
+/**
+ * Callback function notification of several events at once
+ * \param p_events the events, oldest first
+ * \param i_count the number of events
+ * \param p_data user provided data
+ */
+typedef void ( *libvlc_batch_callback_t )( const struct libvlc_event_t *p_events,
+                                           unsigned i_count, void *p_data );
+
+/**
+ * Register for event notifications in batches.
+ *
+ * Unlike with libvlc_event_attach(), the callback is not called by the
+ * thread sending the events, but by a thread of the event manager. It gets
+ * all the events of the type sent since its previous call at once. Of the
+ * libvlc_MediaPlayerTimeChanged and libvlc_MediaPlayerPositionChanged
+ * events, only the latest ones are kept.
+ *
+ * \param p_event_manager the event manager to which you want to attach to
+ * \param i_event_type the desired event to which we want to listen
+ * \param f_callback the function to call with the events
+ * \param user_data user provided data to carry with the events
+ * \return 0 on success, ENOMEM on error
+ * \version LibVLC 2.2.3 or later
+ */
+LIBVLC_API int libvlc_event_attach_batch( libvlc_event_manager_t *p_event_manager,
+                                          libvlc_event_type_t i_event_type,
+                                          libvlc_batch_callback_t f_callback,
+                                          void *user_data );
+
+/**
+ * Unregister an event notification in batches.
+ *
+ * The callback is not called anymore when this function returns, unless
+ * this function is called by the callback itself.
+ *
+ * \param p_event_manager the event manager
+ * \param i_event_type the desired event to which we want to unregister
+ * \param f_callback the function to call with the events
+ * \param p_user_data user provided data to carry with the events
+ * \version LibVLC 2.2.3 or later
+ */
+LIBVLC_API void libvlc_event_detach_batch( libvlc_event_manager_t *p_event_manager,
+                                           libvlc_event_type_t i_event_type,
+                                           libvlc_batch_callback_t f_callback,
+                                           void *p_user_data );
+
 /**
  * Get an event's type name.
  *
@@ -147,6 +147,77 @@ typedef struct libvlc_media_stats_t
     int         i_sent_bytes;
     float       f_send_bitrate;
 } libvlc_media_stats_t;
+
+/**
+ * Number of buckets of libvlc_media_histogram_t
+ */
+#define LIBVLC_MEDIA_HISTOGRAM_BUCKETS 24
+
+/**
+ * Histogram of durations, in microseconds
+ *
+ * Bucket 0 counts the null values, bucket n the values from 2^(n-1) to
+ * 2^n - 1, and the last bucket every larger value.
+ */
+typedef struct libvlc_media_histogram_t
+{
+    uint64_t    i_count;    /**< number of values */
+    uint64_t    i_sum;      /**< sum of the values */
+    uint64_t    pi_buckets[LIBVLC_MEDIA_HISTOGRAM_BUCKETS];
+} libvlc_media_histogram_t;
+
+/**
+ * Snapshot of the statistics of a media being played
+ *
+ * The statistics are only gathered if the instance was created with the
+ * "--stats" option (the default). The bitrates are in bytes per microsecond.
+ */
+typedef struct libvlc_media_stats_snapshot_t
+{
+    /* Input */
+    uint64_t    i_read_bytes;
+    float       f_input_bitrate;
+
+    /* Demux */
+    uint64_t    i_demux_read_bytes;
+    float       f_demux_bitrate;
+    uint64_t    i_demux_corrupted;
+    uint64_t    i_demux_discontinuity;
+
+    /* Decoders */
+    uint64_t    i_decoded_video;
+    uint64_t    i_decoded_audio;
+    libvlc_media_histogram_t decode_video_time; /**< per picture */
+    libvlc_media_histogram_t decode_audio_time; /**< per audio block */
+
+    /* Video output */
+    uint64_t    i_displayed_pictures;
+    uint64_t    i_late_pictures;  /**< displayed, but late */
+    uint64_t    i_lost_pictures;
+
+    /* Audio output */
+    uint64_t    i_played_abuffers;
+    uint64_t    i_lost_abuffers;
+    libvlc_media_histogram_t aout_drift; /**< absolute drift per block */
+
+    /* Stream output */
+    uint64_t    i_sent_packets;
+    uint64_t    i_sent_bytes;
+    float       f_send_bitrate;
+} libvlc_media_stats_snapshot_t;
+
+/**
+ * Statistics of the asynchronous media parsing of an instance
+ */
+typedef struct libvlc_media_parse_stats_t
+{
+    unsigned    i_pending;   /**< media waiting to be parsed */
+    unsigned    i_running;   /**< media being parsed */
+    uint64_t    i_done;      /**< parsed media, including timed out ones */
+    uint64_t    i_timeouts;  /**< media whose parsing timed out */
+    uint64_t    i_cancelled; /**< media released before being parsed */
+    float       f_rate;      /**< parsed media per second, recently */
+} libvlc_media_parse_stats_t;
 /** @}*/
 
 typedef struct libvlc_media_track_info_t
@@ -446,6 +517,21 @@ LIBVLC_API libvlc_state_t libvlc_media_get_state(
 LIBVLC_API int libvlc_media_get_stats( libvlc_media_t *p_md,
                                            libvlc_media_stats_t *p_stats );
 
+/**
+ * Get a snapshot of the statistics about the media, including the decoding
+ * time and audio drift histograms.
+ *
+ * The statistics are updated once per second while the media is played.
+ *
+ * \param p_md media descriptor object
+ * \param p_stats structure that contains the statistics (out)
+ * \return 0 on success, -1 on error
+ * \version LibVLC 2.2.3 or later
+ */
+LIBVLC_API int
+libvlc_media_get_stats_snapshot( libvlc_media_t *p_md,
+                                 libvlc_media_stats_snapshot_t *p_stats );
+
 /* The following method uses libvlc_media_list_t, however, media_list usage is optionnal
  * and this is here for convenience */
 #define VLC_FORWARD_DECLARE_OBJECT(a) struct a
@@ -515,6 +601,34 @@ libvlc_media_parse( libvlc_media_t *p_md );
 LIBVLC_API void
 libvlc_media_parse_async( libvlc_media_t *p_md );
 
+/**
+ * Parse a media before the others.
+ *
+ * This is the same as libvlc_media_parse_async(), but the media is parsed
+ * before the others waiting, for instance because it is being shown.
+ * If the media is waiting already, it is moved ahead of the others.
+ *
+ * \see libvlc_media_parse_async
+ *
+ * \param p_md media descriptor object
+ */
+LIBVLC_API void
+libvlc_media_parse_prioritize( libvlc_media_t *p_md );
+
+/**
+ * Get the statistics of the asynchronous media parsing.
+ *
+ * The number of media parsed at the same time and the timeout are set with
+ * the "preparse-threads" and "preparse-timeout" options.
+ *
+ * \param p_instance the libvlc instance
+ * \param p_stats structure that contains the statistics (out)
+ * \return 0 on success, -1 on error
+ */
+LIBVLC_API int
+libvlc_media_parse_get_stats( libvlc_instance_t *p_instance,
+                              libvlc_media_parse_stats_t *p_stats );
+
 /**
  * Get Parsed status for media descriptor object.
  *
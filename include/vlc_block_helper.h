@@ -444,9 +444,23 @@ static inline int block_PeekOffsetBytes( block_bytestream_t *p_bytestream,
     return VLC_SUCCESS;
 }
 
-static inline int block_FindStartcodeFromOffset(
+/**
+ * Start code search function: returns the first start code entirely within
+ * [p, end), or NULL.
+ */
+typedef const uint8_t *(*block_startcode_helper_t)( const uint8_t *p,
+                                                    const uint8_t *end );
+
+/**
+ * Finds a start code in the bytestream, like block_FindStartcodeFromOffset().
+ *
+ * \param p_startcode_helper optional faster search of the start code within
+ * a block, the start codes straddling blocks being matched byte per byte
+ */
+static inline int block_FindStartcodeFromOffsetHelper(
     block_bytestream_t *p_bytestream, size_t *pi_offset,
-    const uint8_t *p_startcode, int i_startcode_length )
+    const uint8_t *p_startcode, int i_startcode_length,
+    block_startcode_helper_t p_startcode_helper )
 {
     block_t *p_block, *p_block_backup = 0;
     int i_size = 0;
@@ -478,6 +492,22 @@ static inline int block_FindStartcodeFromOffset(
     {
         for( i_offset = i_size; i_offset < p_block->i_buffer; i_offset++ )
         {
+            if( p_startcode_helper != NULL && !i_match &&
+                p_block->i_buffer - i_offset >= (size_t)i_startcode_length )
+            {
+                const uint8_t *p_start = &p_block->p_buffer[i_offset];
+                const uint8_t *p_res =
+                    p_startcode_helper( p_start,
+                                        &p_block->p_buffer[p_block->i_buffer] );
+                if( p_res != NULL )
+                {
+                    *pi_offset += i_offset + (p_res - p_start);
+                    return VLC_SUCCESS;
+                }
+                /* Only the end of the block may start a match */
+                i_offset = p_block->i_buffer - (i_startcode_length - 1);
+            }
+
             if( p_block->p_buffer[i_offset] == p_startcode[i_match] )
             {
                 if( !i_match )
@@ -514,4 +544,19 @@ static inline int block_FindStartcodeFromOffset(
     return VLC_EGENERIC;
 }
 
+/**
+ * Finds a start code in the bytestream.
+ *
+ * \param pi_offset offset to search from, and offset of the start code on
+ * success
+ */
+static inline int block_FindStartcodeFromOffset(
+    block_bytestream_t *p_bytestream, size_t *pi_offset,
+    const uint8_t *p_startcode, int i_startcode_length )
+{
+    return block_FindStartcodeFromOffsetHelper( p_bytestream, pi_offset,
+                                                p_startcode,
+                                                i_startcode_length, NULL );
+}
+
 #endif /* VLC_BLOCK_HELPER_H */
@@ -250,6 +250,33 @@ VLC_API int filter_Blend( filter_t *, picture_t *p_dst, int i_dst_x, int i_dst_y
  */
 VLC_API void filter_DeleteBlend( filter_t * );
 
+/**
+ * Slice callback of filter_RunSlices().
+ *
+ * It processes the lines [i_start, i_end) of the visible area, counted in
+ * lines of the first plane. Other planes are processed in proportion.
+ * i_slice is the index of the slice, lower than filter_GetSliceCount(): no
+ * two concurrent callbacks get the same index, so it can select per slice
+ * scratch buffers.
+ */
+typedef void (*filter_slice_cb)( filter_t *, void *p_opaque, unsigned i_slice,
+                                 unsigned i_start, unsigned i_end );
+
+/**
+ * It returns the number of slices filter_RunSlices() uses for i_lines
+ * lines. It does not change during the lifetime of the filter.
+ */
+VLC_API unsigned filter_GetSliceCount( filter_t *, unsigned i_lines );
+
+/**
+ * It splits i_lines lines in slices processed concurrently by worker
+ * threads, and returns once all the slices are done.
+ *
+ * The slice callback must only write to the lines it is given. Small
+ * pictures, or --filter-threads=1, are processed by the calling thread.
+ */
+VLC_API void filter_RunSlices( filter_t *, unsigned i_lines, filter_slice_cb, void *p_opaque );
+
 /**
  * Create a picture_t *(*)( filter_t *, picture_t * ) compatible wrapper
  * using a void (*)( filter_t *, picture_t *, picture_t * ) function
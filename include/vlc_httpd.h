@@ -102,6 +102,8 @@ typedef struct httpd_message_t
     int64_t i_body_offset;
     int     i_body;
     uint8_t *p_body;
+    /* body sent after p_body without copy, released by the server */
+    block_t *p_body_block;
 
 } httpd_message_t;
 
@@ -301,17 +301,47 @@ typedef enum input_item_meta_request_option_t
     META_REQUEST_OPTION_NONE          = 0x00,
     META_REQUEST_OPTION_SCOPE_LOCAL   = 0x01,
     META_REQUEST_OPTION_SCOPE_NETWORK = 0x02,
-    META_REQUEST_OPTION_SCOPE_ANY     = 0x03
+    META_REQUEST_OPTION_SCOPE_ANY     = 0x03,
+    META_REQUEST_OPTION_PRIORITY      = 0x04 /**< ahead of the other items */
 } input_item_meta_request_option_t;
 
+/**
+ * Meta data extraction (preparsing) statistics
+ */
+typedef struct input_preparser_stats_t
+{
+    unsigned i_pending;   /**< requests waiting for a worker */
+    unsigned i_running;   /**< requests being processed */
+    uint64_t i_done;      /**< completed requests, including timed out ones */
+    uint64_t i_timeouts;  /**< requests that were interrupted by the timeout */
+    uint64_t i_cancelled; /**< requests dropped before completion */
+    float    f_rate;      /**< completed requests per second, recently */
+} input_preparser_stats_t;
+
 VLC_API int libvlc_MetaRequest(libvlc_int_t *, input_item_t *,
                                input_item_meta_request_option_t );
+VLC_API int libvlc_MetaRequestStats(libvlc_int_t *,
+                                    input_preparser_stats_t * );
 VLC_API int libvlc_ArtRequest(libvlc_int_t *, input_item_t *,
                               input_item_meta_request_option_t );
 
 /******************
  * Input stats
  ******************/
+#define INPUT_HISTOGRAM_BUCKETS 24
+
+/**
+ * Histogram of durations, in microseconds: bucket 0 counts the null and
+ * negative values, bucket n the values from 2^(n-1) to 2^n - 1, and the last
+ * bucket every larger value.
+ */
+typedef struct input_histogram_t
+{
+    uint64_t i_count;
+    uint64_t i_sum;
+    uint64_t pi_buckets[INPUT_HISTOGRAM_BUCKETS];
+} input_histogram_t;
+
 struct input_stats_t
 {
     vlc_mutex_t         lock;
@@ -333,9 +363,12 @@ struct input_stats_t
     /* Decoders */
     int64_t i_decoded_audio;
     int64_t i_decoded_video;
+    input_histogram_t decode_audio_time; /**< per audio block */
+    input_histogram_t decode_video_time; /**< per picture */
 
     /* Vout */
     int64_t i_displayed_pictures;
+    int64_t i_late_pictures;
     int64_t i_lost_pictures;
 
     /* Sout */
@@ -346,6 +379,7 @@ struct input_stats_t
     /* Aout */
     int64_t i_played_abuffers;
     int64_t i_lost_abuffers;
+    input_histogram_t aout_drift; /**< absolute playback drift */
 };
 
 #endif
@@ -0,0 +1,100 @@
+/*****************************************************************************
+ * vlc_threadpool.h: shared worker threads
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_THREADPOOL_H
+# define VLC_THREADPOOL_H 1
+
+/**
+ * \file
+ * This file defines a pool of worker threads running short tasks.
+ *
+ * Each worker owns a queue of tasks. Tasks submitted from a worker go to its
+ * own queue and idle workers steal from the others, so that a task splitting
+ * its work into subtasks keeps the workers busy with little contention.
+ * Tasks submitted from other threads go to shared queues, by priority.
+ */
+
+typedef struct vlc_threadpool vlc_threadpool_t;
+typedef struct vlc_taskgroup vlc_taskgroup_t;
+
+enum vlc_task_priority
+{
+    VLC_TASK_PRIORITY_LOW, /**< background work, run when nothing else is */
+    VLC_TASK_PRIORITY_NORMAL,
+    VLC_TASK_PRIORITY_HIGH, /**< latency sensitive, run before anything else */
+};
+
+/**
+ * Creates a thread pool.
+ *
+ * Workers are started on demand, up to the given maximum.
+ * @param max_workers maximum number of threads, or zero for the number of
+ *                    CPUs available to the process
+ * @return the pool, or NULL on error
+ */
+VLC_API vlc_threadpool_t *vlc_threadpool_create(unsigned max_workers) VLC_USED;
+
+/**
+ * Destroys a thread pool. Pending tasks are run first.
+ * @warning This must not be called from one of the pool tasks.
+ */
+VLC_API void vlc_threadpool_destroy(vlc_threadpool_t *);
+
+/**
+ * @return the maximum number of workers of a pool
+ */
+VLC_API unsigned vlc_threadpool_size(const vlc_threadpool_t *) VLC_USED;
+
+/**
+ * Queues a task for asynchronous execution.
+ * @param priority one of the vlc_task_priority values
+ * @return 0 on success, a system error code otherwise.
+ */
+VLC_API int vlc_threadpool_submit(vlc_threadpool_t *, int priority,
+                                  void (*func)(void *), void *data);
+
+/**
+ * Creates a group of tasks that can be waited for together.
+ * @param priority priority of the tasks of the group
+ */
+VLC_API vlc_taskgroup_t *vlc_taskgroup_create(vlc_threadpool_t *,
+                                              int priority) VLC_USED;
+
+/**
+ * Queues a task within a group.
+ * @return 0 on success, a system error code otherwise.
+ */
+VLC_API int vlc_taskgroup_submit(vlc_taskgroup_t *, void (*func)(void *),
+                                 void *data);
+
+/**
+ * Waits for all the tasks queued within a group to complete.
+ *
+ * If called from a worker of the same pool, the calling thread runs pending
+ * tasks while it waits, so that nested groups cannot starve the pool.
+ */
+VLC_API void vlc_taskgroup_wait(vlc_taskgroup_t *);
+
+/**
+ * Waits for and destroys a group.
+ */
+VLC_API void vlc_taskgroup_destroy(vlc_taskgroup_t *);
+
+#endif
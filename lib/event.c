@@ -33,31 +33,148 @@
 #include "event_internal.h"
 #include <assert.h>
 #include <errno.h>
+#include <vlc_atomic.h>
+
+/* The listeners of an event type are an immutable snapshot, replaced as a
+ * whole by attach and detach, so that the senders read it without locks.
+ * The replaced snapshots are retired, and freed once the senders that could
+ * read them are done: when nobody sends, or after the wait of detach. */
+typedef struct libvlc_event_listeners_t
+{
+    unsigned version;
+    int count;
+    struct libvlc_event_listeners_t * retired; /* next one, object_lock */
+    libvlc_event_listener_t items[];
+} libvlc_event_listeners_t;
 
 typedef struct libvlc_event_listeners_group_t
 {
     libvlc_event_type_t event_type;
-    vlc_array_t listeners;
-    bool b_sublistener_removed;
+    atomic_uintptr_t listeners; /* snapshot, NULL without listeners */
+    unsigned version; /* of the next snapshot, object_lock */
 } libvlc_event_listeners_group_t;
 
+/* Event managers sending from the calling thread, innermost first */
+typedef struct libvlc_event_frame_t
+{
+    libvlc_event_manager_t * p_em;
+    unsigned phase;
+    struct libvlc_event_frame_t * prev;
+} libvlc_event_frame_t;
+
+static vlc_threadvar_t sending_key;
+static vlc_mutex_t sending_lock = VLC_STATIC_MUTEX;
+static uintptr_t sending_refs = 0;
+
 /*
  * Private functions
  */
 
+static libvlc_event_listeners_t *
+group_listeners( libvlc_event_listeners_group_t * group )
+{
+    return (libvlc_event_listeners_t *)atomic_load( &group->listeners );
+}
+
 static bool
-group_contains_listener( libvlc_event_listeners_group_t * group,
-                         libvlc_event_listener_t * searched_listener )
+snapshot_contains_listener( libvlc_event_listeners_t * snapshot,
+                            libvlc_event_listener_t * searched_listener )
 {
-    int i;
-    for( i = 0; i < vlc_array_count(&group->listeners); i++ )
+    if( snapshot == NULL )
+        return false;
+    for( int i = 0; i < snapshot->count; i++ )
     {
-        if( listeners_are_equal(searched_listener, vlc_array_item_at_index(&group->listeners, i)) )
+        if( listeners_are_equal(searched_listener, &snapshot->items[i]) )
             return true;
     }
     return false;
 }
 
+static libvlc_event_listeners_group_t *
+find_group( libvlc_event_manager_t * p_em, libvlc_event_type_t event_type )
+{
+    for( int i = 0; i < vlc_array_count(&p_em->listeners_groups); i++ )
+    {
+        libvlc_event_listeners_group_t * group =
+            vlc_array_item_at_index(&p_em->listeners_groups, i);
+        if( group->event_type == event_type )
+            return group;
+    }
+    return NULL;
+}
+
+/* object_lock must be held.
+ * Waits for the senders that started before the call, other than the
+ * calling thread and the threads waiting here: these check the current
+ * listeners before each callback. The senders that start during the wait
+ * count in the other phase, so that they cannot delay it. */
+static void wait_senders( libvlc_event_manager_t * p_em )
+{
+    unsigned depth[2] = { 0, 0 };
+
+    for( libvlc_event_frame_t * frame = vlc_threadvar_get( sending_key );
+         frame != NULL; frame = frame->prev )
+        if( frame->p_em == p_em )
+            depth[frame->phase]++;
+
+    p_em->waiting_depth[0] += depth[0];
+    p_em->waiting_depth[1] += depth[1];
+    atomic_fetch_add( &p_em->waiters, 1 );
+    vlc_cond_broadcast( &p_em->idle );
+
+    /* One wait at a time: the phase of the senders being waited for must
+     * not change */
+    while( p_em->b_waiting )
+        vlc_cond_wait( &p_em->idle, &p_em->object_lock );
+    p_em->b_waiting = true;
+
+    /* Both phases in turn: a sender may count in a phase just after it
+     * was waited for, having read it before the switch */
+    for( int i = 0; i < 2; i++ )
+    {
+        unsigned phase = atomic_load( &p_em->phase );
+
+        atomic_store( &p_em->phase, !phase );
+        while( atomic_load( &p_em->readers[phase] )
+                > p_em->waiting_depth[phase] )
+            vlc_cond_wait( &p_em->idle, &p_em->object_lock );
+    }
+
+    p_em->b_waiting = false;
+    p_em->waiting_depth[0] -= depth[0];
+    p_em->waiting_depth[1] -= depth[1];
+    atomic_fetch_sub( &p_em->waiters, 1 );
+    vlc_cond_broadcast( &p_em->idle );
+}
+
+static void free_listeners( libvlc_event_listeners_t * retired )
+{
+    while( retired != NULL )
+    {
+        libvlc_event_listeners_t * next = retired->retired;
+        free( retired );
+        retired = next;
+    }
+}
+
+/* object_lock must be held */
+static void publish_listeners( libvlc_event_manager_t * p_em,
+                               libvlc_event_listeners_group_t * group,
+                               libvlc_event_listeners_t * snapshot )
+{
+    libvlc_event_listeners_t * old = group_listeners( group );
+
+    if( snapshot != NULL )
+        snapshot->version = group->version++;
+    /* Before switching the phase of the senders, or checking for them */
+    atomic_store( &group->listeners, (uintptr_t)snapshot );
+    if( old != NULL )
+    {
+        old->retired = p_em->retired;
+        p_em->retired = old;
+    }
+}
+
 /*
  * Internal libvlc functions
  */
@@ -79,7 +196,17 @@ libvlc_event_manager_new( void * p_obj, libvlc_instance_t * p_libvlc_inst )
         return NULL;
     }
 
-    p_em->p_obj = p_obj;
+    vlc_mutex_lock( &sending_lock );
+    if( sending_refs == 0 && vlc_threadvar_create( &sending_key, NULL ) )
+    {
+        vlc_mutex_unlock( &sending_lock );
+        free( p_em );
+        libvlc_printerr( "Not enough memory" );
+        return NULL;
+    }
+    sending_refs++;
+    vlc_mutex_unlock( &sending_lock );
+
     p_em->p_obj = p_obj;
     p_em->async_event_queue = NULL;
     p_em->p_libvlc_instance = p_libvlc_inst;
@@ -87,7 +214,14 @@ libvlc_event_manager_new( void * p_obj, libvlc_instance_t * p_libvlc_inst )
     libvlc_retain( p_libvlc_inst );
     vlc_array_init( &p_em->listeners_groups );
     vlc_mutex_init( &p_em->object_lock );
-    vlc_mutex_init_recursive( &p_em->event_sending_lock );
+    vlc_cond_init( &p_em->idle );
+    atomic_init( &p_em->readers[0], 0 );
+    atomic_init( &p_em->readers[1], 0 );
+    atomic_init( &p_em->phase, 0 );
+    atomic_init( &p_em->waiters, 0 );
+    p_em->waiting_depth[0] = p_em->waiting_depth[1] = 0;
+    p_em->b_waiting = false;
+    p_em->retired = NULL;
     return p_em;
 }
 
@@ -99,26 +233,29 @@ libvlc_event_manager_new( void * p_obj, libvlc_instance_t * p_libvlc_inst )
 void libvlc_event_manager_release( libvlc_event_manager_t * p_em )
 {
     libvlc_event_listeners_group_t * p_lg;
-    int i,j ;
+    int i;
 
     libvlc_event_async_fini(p_em);
 
-    vlc_mutex_destroy( &p_em->event_sending_lock );
+    vlc_cond_destroy( &p_em->idle );
     vlc_mutex_destroy( &p_em->object_lock );
 
     for( i = 0; i < vlc_array_count(&p_em->listeners_groups); i++)
     {
         p_lg = vlc_array_item_at_index( &p_em->listeners_groups, i );
-
-        for( j = 0; j < vlc_array_count(&p_lg->listeners); j++)
-            free( vlc_array_item_at_index( &p_lg->listeners, j ) );
-
-        vlc_array_clear( &p_lg->listeners );
+        free( group_listeners( p_lg ) );
         free( p_lg );
     }
     vlc_array_clear( &p_em->listeners_groups );
+    free_listeners( p_em->retired );
     libvlc_release( p_em->p_libvlc_instance );
     free( p_em );
+
+    vlc_mutex_lock( &sending_lock );
+    assert( sending_refs > 0 );
+    if( --sending_refs == 0 )
+        vlc_threadvar_delete( &sending_key );
+    vlc_mutex_unlock( &sending_lock );
 }
 
 /**************************************************************************
@@ -133,7 +270,8 @@ void libvlc_event_manager_register_event_type(
     libvlc_event_listeners_group_t * listeners_group;
     listeners_group = xmalloc(sizeof(libvlc_event_listeners_group_t));
     listeners_group->event_type = event_type;
-    vlc_array_init( &listeners_group->listeners );
+    atomic_init( &listeners_group->listeners, (uintptr_t)NULL );
+    listeners_group->version = 0;
 
     vlc_mutex_lock( &p_em->object_lock );
     vlc_array_append( &p_em->listeners_groups, listeners_group );
@@ -148,66 +286,62 @@ void libvlc_event_manager_register_event_type(
 void libvlc_event_send( libvlc_event_manager_t * p_em,
                         libvlc_event_t * p_event )
 {
-    libvlc_event_listeners_group_t * listeners_group = NULL;
-    libvlc_event_listener_t * listener_cached;
-    libvlc_event_listener_t * listener;
-    libvlc_event_listener_t * array_listeners_cached = NULL;
-    int i, i_cached_listeners = 0;
+    libvlc_event_listeners_group_t * listeners_group;
+    libvlc_event_listeners_t * snapshot;
+    libvlc_event_listener_t listeners_stack[8];
+    libvlc_event_listener_t * array_listeners_cached = listeners_stack;
+    int i_cached_listeners = 0;
+    unsigned version = 0;
+
+    /* The event types are all registered when the object is created: the
+     * group can be found, and the events nobody listens to (like the time
+     * changes of most media players) dropped, without any lock. */
+    listeners_group = find_group( p_em, p_event->type );
+    if( !listeners_group
+     || atomic_load_explicit( &listeners_group->listeners,
+                              memory_order_relaxed ) == 0 )
+        return;
 
     /* Fill event with the sending object now */
     p_event->p_obj = p_em->p_obj;
 
-    vlc_mutex_lock( &p_em->event_sending_lock );
-    vlc_mutex_lock( &p_em->object_lock );
-    for( i = 0; i < vlc_array_count(&p_em->listeners_groups); i++)
+    /* Once counted as a sender, the snapshots are not freed under us */
+    libvlc_event_frame_t frame = { p_em, atomic_load( &p_em->phase ),
+                                   vlc_threadvar_get( sending_key ) };
+    atomic_fetch_add( &p_em->readers[frame.phase], 1 );
+
+    /* Cache a copy of the listeners, as the callbacks may replace them */
+    snapshot = group_listeners( listeners_group );
+    if( snapshot != NULL )
     {
-        listeners_group = vlc_array_item_at_index(&p_em->listeners_groups, i);
-        if( listeners_group->event_type == p_event->type )
+        version = snapshot->version;
+        i_cached_listeners = snapshot->count;
+        if( i_cached_listeners > (int)ARRAY_SIZE(listeners_stack) )
         {
-            if( vlc_array_count( &listeners_group->listeners ) <= 0 )
-                break;
-
-            /* Cache a copy of the listener to avoid locking issues,
-             * and allow that edition of listeners during callbacks will garantee immediate effect. */
-            i_cached_listeners = vlc_array_count(&listeners_group->listeners);
             array_listeners_cached = malloc(sizeof(libvlc_event_listener_t)*(i_cached_listeners));
             if( !array_listeners_cached )
             {
-                vlc_mutex_unlock( &p_em->object_lock );
-                vlc_mutex_unlock( &p_em->event_sending_lock );
                 fprintf(stderr, "Can't alloc memory in libvlc_event_send" );
-                return;
-            }
-
-            listener_cached = array_listeners_cached;
-            for( i = 0; i < vlc_array_count(&listeners_group->listeners); i++)
-            {
-                listener = vlc_array_item_at_index(&listeners_group->listeners, i);
-                memcpy( listener_cached, listener, sizeof(libvlc_event_listener_t) );
-                listener_cached++;
+                array_listeners_cached = listeners_stack;
+                i_cached_listeners = 0;
             }
-            break;
         }
+        memcpy( array_listeners_cached, snapshot->items,
+                i_cached_listeners * sizeof(libvlc_event_listener_t) );
     }
 
-    if( !listeners_group )
+    vlc_threadvar_set( sending_key, &frame );
+    for( int i = 0; i < i_cached_listeners; i++ )
     {
-        free( array_listeners_cached );
-        vlc_mutex_unlock( &p_em->object_lock );
-        vlc_mutex_unlock( &p_em->event_sending_lock );
-        return;
-    }
+        libvlc_event_listener_t * listener_cached = &array_listeners_cached[i];
 
-    /* Track item removed from *this* thread, with a simple flag. Indeed
-     * event_sending_lock is a recursive lock. This has the advantage of
-     * allowing to remove an event listener from within a callback */
-    listeners_group->b_sublistener_removed = false;
+        /* The listeners removed by the callbacks, or by the threads
+         * waiting for this one, take effect immediately */
+        snapshot = group_listeners( listeners_group );
+        if( (snapshot == NULL || snapshot->version != version)
+         && !snapshot_contains_listener( snapshot, listener_cached ) )
+            continue;
 
-    vlc_mutex_unlock( &p_em->object_lock );
-
-    listener_cached = array_listeners_cached;
-    for( i = 0; i < i_cached_listeners; i++ )
-    {
         if(listener_cached->is_asynchronous)
         {
             /* The listener wants not to block the emitter during event callback */
@@ -216,28 +350,22 @@ void libvlc_event_send( libvlc_event_manager_t * p_em,
         else
         {
             /* The listener wants to block the emitter during event callback */
-
             listener_cached->pf_callback( p_event, listener_cached->p_user_data );
-            listener_cached++;
-
-            if( listeners_group->b_sublistener_removed )
-            {
-                /* If a callback was removed, this gets called */
-                bool valid_listener;
-                vlc_mutex_lock( &p_em->object_lock );
-                valid_listener = group_contains_listener( listeners_group, listener_cached );
-                vlc_mutex_unlock( &p_em->object_lock );
-                if( !valid_listener )
-                {
-                    listener_cached++;
-                    continue;
-                }
-            }
         }
     }
-    vlc_mutex_unlock( &p_em->event_sending_lock );
+    vlc_threadvar_set( sending_key, frame.prev );
+
+    /* The waiting threads either see this one gone, or are seen here */
+    atomic_fetch_sub( &p_em->readers[frame.phase], 1 );
+    if( atomic_load( &p_em->waiters ) > 0 )
+    {
+        vlc_mutex_lock( &p_em->object_lock );
+        vlc_cond_broadcast( &p_em->idle );
+        vlc_mutex_unlock( &p_em->object_lock );
+    }
 
-    free( array_listeners_cached );
+    if( array_listeners_cached != listeners_stack )
+        free( array_listeners_cached );
 }
 
 /*
@@ -343,40 +471,66 @@ const char * libvlc_event_type_name( int event_type )
 static
 int event_attach( libvlc_event_manager_t * p_event_manager,
                   libvlc_event_type_t event_type,
-                  libvlc_callback_t pf_callback, void *p_user_data,
+                  libvlc_callback_t pf_callback,
+                  libvlc_batch_callback_t pf_batch, void *p_user_data,
                   bool is_asynchronous )
 {
     libvlc_event_listeners_group_t * listeners_group;
-    libvlc_event_listener_t * listener;
-    int i;
+    libvlc_event_listeners_t * old, * snapshot;
+    int count;
+
+    vlc_mutex_lock( &p_event_manager->object_lock );
+    listeners_group = find_group( p_event_manager, event_type );
+    if( listeners_group == NULL )
+    {
+        vlc_mutex_unlock( &p_event_manager->object_lock );
+        fprintf( stderr, "This object event manager doesn't know about '%s' events",
+                 libvlc_event_type_name(event_type) );
+        assert(0);
+        return -1;
+    }
 
-    listener = malloc(sizeof(libvlc_event_listener_t));
-    if( unlikely(listener == NULL) )
+    /* The queue of the asynchronous listeners is created before the senders
+     * can see them, so that they dispatch without the lock */
+    if( is_asynchronous && libvlc_event_async_init( p_event_manager ) )
+    {
+        vlc_mutex_unlock( &p_event_manager->object_lock );
         return ENOMEM;
+    }
 
-    listener->event_type = event_type;
-    listener->p_user_data = p_user_data;
-    listener->pf_callback = pf_callback;
-    listener->is_asynchronous = is_asynchronous;
+    old = group_listeners( listeners_group );
+    count = (old != NULL) ? old->count : 0;
+    snapshot = malloc( sizeof(*snapshot) + (count + 1) * sizeof(snapshot->items[0]) );
+    if( unlikely(snapshot == NULL) )
+    {
+        vlc_mutex_unlock( &p_event_manager->object_lock );
+        return ENOMEM;
+    }
 
-    vlc_mutex_lock( &p_event_manager->object_lock );
-    for( i = 0; i < vlc_array_count(&p_event_manager->listeners_groups); i++ )
+    if( count > 0 )
+        memcpy( snapshot->items, old->items, count * sizeof(old->items[0]) );
+    snapshot->items[count].event_type = event_type;
+    snapshot->items[count].p_user_data = p_user_data;
+    snapshot->items[count].pf_callback = pf_callback;
+    snapshot->items[count].pf_batch = pf_batch;
+    snapshot->items[count].is_asynchronous = is_asynchronous;
+    snapshot->count = count + 1;
+
+    publish_listeners( p_event_manager, listeners_group, snapshot );
+
+    /* The senders are not waited for: unlike detach, attach makes no
+     * promise about the sends in progress, and their callbacks may well
+     * wait for this thread. The retired snapshots are freed if no sender
+     * can read them, otherwise by the next detach. A sender not seen here
+     * counts after the new snapshot was published, so reads only that. */
+    if( atomic_load( &p_event_manager->readers[0] ) == 0
+     && atomic_load( &p_event_manager->readers[1] ) == 0 )
     {
-        listeners_group = vlc_array_item_at_index(&p_event_manager->listeners_groups, i);
-        if( listeners_group->event_type == listener->event_type )
-        {
-            vlc_array_append( &listeners_group->listeners, listener );
-            vlc_mutex_unlock( &p_event_manager->object_lock );
-            return 0;
-        }
+        free_listeners( p_event_manager->retired );
+        p_event_manager->retired = NULL;
     }
     vlc_mutex_unlock( &p_event_manager->object_lock );
-
-    free(listener);
-    fprintf( stderr, "This object event manager doesn't know about '%s' events",
-             libvlc_event_type_name(event_type) );
-    assert(0);
-    return -1;
+    return 0;
 }
 
 /**************************************************************************
@@ -389,8 +543,8 @@ int libvlc_event_attach( libvlc_event_manager_t * p_event_manager,
                          libvlc_callback_t pf_callback,
                          void *p_user_data )
 {
-    return event_attach(p_event_manager, event_type, pf_callback, p_user_data,
-                        false /* synchronous */);
+    return event_attach(p_event_manager, event_type, pf_callback, NULL,
+                        p_user_data, false /* synchronous */);
 }
 
 /**************************************************************************
@@ -403,60 +557,82 @@ void libvlc_event_attach_async( libvlc_event_manager_t * p_event_manager,
                          libvlc_callback_t pf_callback,
                          void *p_user_data )
 {
-    event_attach(p_event_manager, event_type, pf_callback, p_user_data,
+    event_attach(p_event_manager, event_type, pf_callback, NULL, p_user_data,
                  true /* asynchronous */);
 }
 
 /**************************************************************************
- *       libvlc_event_detach (public) :
+ *       libvlc_event_attach_batch (public) :
+ *
+ * Add a callback for events, delivered in batches.
+ **************************************************************************/
+int libvlc_event_attach_batch( libvlc_event_manager_t * p_event_manager,
+                               libvlc_event_type_t event_type,
+                               libvlc_batch_callback_t pf_batch,
+                               void *p_user_data )
+{
+    return event_attach(p_event_manager, event_type, NULL, pf_batch,
+                        p_user_data, true /* asynchronous */);
+}
+
+/**************************************************************************
+ *       event_detach (internal) :
  *
  * Remove a callback for an event.
  **************************************************************************/
-void libvlc_event_detach( libvlc_event_manager_t *p_event_manager,
-                                     libvlc_event_type_t event_type,
-                                     libvlc_callback_t pf_callback,
-                                     void *p_user_data )
+static
+void event_detach( libvlc_event_manager_t *p_event_manager,
+                   libvlc_event_type_t event_type,
+                   libvlc_callback_t pf_callback,
+                   libvlc_batch_callback_t pf_batch, void *p_user_data )
 {
     libvlc_event_listeners_group_t * listeners_group;
-    libvlc_event_listener_t * listener;
-    int i, j;
+    libvlc_event_listeners_t * old, * snapshot = NULL;
+    int j;
     bool found = false;
 
-    vlc_mutex_lock( &p_event_manager->event_sending_lock );
     vlc_mutex_lock( &p_event_manager->object_lock );
-    for( i = 0; i < vlc_array_count(&p_event_manager->listeners_groups); i++)
+    listeners_group = find_group( p_event_manager, event_type );
+    old = (listeners_group != NULL) ? group_listeners( listeners_group ) : NULL;
+    for( j = 0; old != NULL && j < old->count; j++ )
     {
-        listeners_group = vlc_array_item_at_index(&p_event_manager->listeners_groups, i);
-        if( listeners_group->event_type == event_type )
+        libvlc_event_listener_t * listener = &old->items[j];
+        if( listener->pf_callback == pf_callback &&
+            listener->pf_batch == pf_batch &&
+            listener->p_user_data == p_user_data )
         {
-            for( j = 0; j < vlc_array_count(&listeners_group->listeners); j++)
-            {
-                listener = vlc_array_item_at_index(&listeners_group->listeners, j);
-                if( listener->event_type == event_type &&
-                    listener->pf_callback == pf_callback &&
-                    listener->p_user_data == p_user_data )
-                {
-                    /* that's our listener */
-
-                    /* Mark this group as edited so that libvlc_event_send
-                     * will recheck what listener to call */
-                    listeners_group->b_sublistener_removed = true;
-
-                    free( listener );
-                    vlc_array_remove( &listeners_group->listeners, j );
-                    found = true;
-                    break;
-                }
-            }
+            /* that's our listener */
+            found = true;
+            break;
         }
     }
+
+    if( found )
+    {
+        if( old->count > 1 )
+        {
+            snapshot = xmalloc( sizeof(*snapshot)
+                                + (old->count - 1) * sizeof(old->items[0]) );
+            memcpy( snapshot->items, old->items, j * sizeof(old->items[0]) );
+            memcpy( snapshot->items + j, old->items + j + 1,
+                    (old->count - j - 1) * sizeof(old->items[0]) );
+            snapshot->count = old->count - 1;
+        }
+        publish_listeners( p_event_manager, listeners_group, snapshot );
+
+        /* Only the snapshots retired so far are covered by the wait */
+        libvlc_event_listeners_t * retired = p_event_manager->retired;
+        p_event_manager->retired = NULL;
+        wait_senders( p_event_manager );
+        free_listeners( retired );
+    }
     vlc_mutex_unlock( &p_event_manager->object_lock );
-    vlc_mutex_unlock( &p_event_manager->event_sending_lock );
 
     /* Now make sure any pending async event won't get fired after that point */
     libvlc_event_listener_t listener_to_remove;
     listener_to_remove.event_type  = event_type;
     listener_to_remove.pf_callback = pf_callback;
+    listener_to_remove.pf_batch = pf_batch;
     listener_to_remove.p_user_data = p_user_data;
     listener_to_remove.is_asynchronous = true;
 
@@ -464,3 +640,29 @@ void libvlc_event_detach( libvlc_event_manager_t *p_event_manager,
 
     assert(found);
 }
+
+/**************************************************************************
+ *       libvlc_event_detach (public) :
+ *
+ * Remove a callback for an event.
+ **************************************************************************/
+void libvlc_event_detach( libvlc_event_manager_t *p_event_manager,
+                                     libvlc_event_type_t event_type,
+                                     libvlc_callback_t pf_callback,
+                                     void *p_user_data )
+{
+    event_detach(p_event_manager, event_type, pf_callback, NULL, p_user_data);
+}
+
+/**************************************************************************
+ *       libvlc_event_detach_batch (public) :
+ *
+ * Remove a callback for events delivered in batches.
+ **************************************************************************/
+void libvlc_event_detach_batch( libvlc_event_manager_t *p_event_manager,
+                                libvlc_event_type_t event_type,
+                                libvlc_batch_callback_t pf_batch,
+                                void *p_user_data )
+{
+    event_detach(p_event_manager, event_type, NULL, pf_batch, p_user_data);
+}
@@ -32,6 +32,30 @@
 
 #include "libvlc_internal.h"
 #include "event_internal.h"
+#include <vlc_atomic.h>
+
+/*
+ * Asynchronous listeners get their events from a thread of the event
+ * manager. The senders put the events in a lock-free ring (a bounded
+ * multiple producers, single consumer queue), or when the ring is full, in
+ * a list guarded by the queue lock.
+ *
+ * The thread moves all the queued events to a batch at once, drops the
+ * time and position events that are followed by newer ones in the batch,
+ * and calls the listeners.
+ */
+
+#define QUEUE_SIZE 256 /* power of two */
+
+struct queue_entry {
+    libvlc_event_listener_t listener;
+    libvlc_event_t event;
+};
+
+struct queue_slot {
+    atomic_uint seq; /* position + 1 when filled, position + QUEUE_SIZE when free */
+    struct queue_entry entry;
+};
 
 struct queue_elmt {
     libvlc_event_listener_t listener;
@@ -39,12 +63,35 @@ struct queue_elmt {
     struct queue_elmt * next;
 };
 
+struct queue_removal {
+    libvlc_event_listener_t listener;
+    struct queue_removal * next;
+    bool done;
+};
+
 struct libvlc_event_async_queue {
+    struct queue_slot slots[QUEUE_SIZE];
+    atomic_uint head; /* next position to fill */
+    unsigned tail; /* next position to read, by the thread */
+
+    /* Events that did not fit, with the lock held */
     struct queue_elmt *first_elmt, *last_elmt;
+    atomic_bool overflow;
+
+    /* Events being delivered, by the thread */
+    struct queue_entry batch[QUEUE_SIZE];
+    unsigned batch_count, batch_next;
+    libvlc_event_t events[QUEUE_SIZE];
+
+    /* Listeners being removed, with the lock held */
+    struct queue_removal *removals;
+    atomic_bool removal_pending;
+
     vlc_mutex_t lock;
     vlc_cond_t signal;
+    atomic_bool sleeping;
+    atomic_bool dead;
     vlc_thread_t thread;
-    bool is_idle;
     vlc_cond_t signal_idle;
     vlc_threadvar_t is_asynch_dispatch_thread_var;
 };
@@ -71,11 +118,72 @@ static inline bool current_thread_is_asynch_thread(libvlc_event_manager_t * p_em
             != NULL;
 }
 
+static inline void cancel_entry(struct queue_entry * entry)
+{
+    entry->listener.pf_callback = NULL;
+    entry->listener.pf_batch = NULL;
+}
+
+/* Any thread */
+static bool ring_push(struct libvlc_event_async_queue * q,
+                      libvlc_event_listener_t * listener, libvlc_event_t * event)
+{
+    unsigned pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    struct queue_slot * slot;
+
+    for (;;)
+    {
+        slot = &q->slots[pos % QUEUE_SIZE];
+
+        int diff = atomic_load_explicit(&slot->seq, memory_order_acquire) - pos;
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak(&q->head, &pos, pos + 1))
+                break;
+        }
+        else if (diff < 0)
+            return false; /* full */
+        else
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    }
+
+    slot->entry.listener = *listener;
+    slot->entry.event = *event;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    return true;
+}
+
+/* Thread only */
+static bool ring_ready(struct libvlc_event_async_queue * q)
+{
+    struct queue_slot * slot = &q->slots[q->tail % QUEUE_SIZE];
+    return atomic_load_explicit(&slot->seq, memory_order_acquire) == q->tail + 1;
+}
+
+/* Thread only */
+static unsigned ring_pop_batch(struct libvlc_event_async_queue * q)
+{
+    unsigned n = 0;
+
+    while (n < QUEUE_SIZE && ring_ready(q))
+    {
+        struct queue_slot * slot = &q->slots[q->tail % QUEUE_SIZE];
+
+        q->batch[n++] = slot->entry;
+        atomic_store_explicit(&slot->seq, q->tail + QUEUE_SIZE,
+                              memory_order_release);
+        q->tail++;
+    }
+    return n;
+}
+
 /* Lock must be held */
 static void push(libvlc_event_manager_t * p_em,
                  libvlc_event_listener_t * listener, libvlc_event_t * event)
 {
     struct queue_elmt * elmt = malloc(sizeof(struct queue_elmt));
+    if (unlikely(elmt == NULL))
+        return;
     elmt->listener = *listener;
     elmt->event = *event;
     elmt->next = NULL;
@@ -98,22 +206,28 @@ static inline void queue_unlock(libvlc_event_manager_t * p_em)
     vlc_mutex_unlock(&queue(p_em)->lock);
 }
 
-/* Lock must be held */
-static bool pop(libvlc_event_manager_t * p_em,
-                libvlc_event_listener_t * listener, libvlc_event_t * event)
+/* Thread only, lock must be held */
+static unsigned pop_batch(libvlc_event_manager_t * p_em)
 {
-    if(!queue(p_em)->first_elmt)
-        return false; /* No first_elmt */
+    struct libvlc_event_async_queue * q = queue(p_em);
+    unsigned n = 0;
 
-    struct queue_elmt * elmt = queue(p_em)->first_elmt;
-    *listener = elmt->listener;
-    *event = elmt->event;
-
-    queue(p_em)->first_elmt = elmt->next;
-    if( !elmt->next ) queue(p_em)->last_elmt=NULL;
+    while (n < QUEUE_SIZE && q->first_elmt)
+    {
+        struct queue_elmt * elmt = q->first_elmt;
 
-    free(elmt);
-    return true;
+        q->batch[n].listener = elmt->listener;
+        q->batch[n].event = elmt->event;
+        n++;
+        q->first_elmt = elmt->next;
+        free(elmt);
+    }
+    if (!q->first_elmt)
+    {
+        q->last_elmt = NULL;
+        atomic_store(&q->overflow, false);
+    }
+    return n;
 }
 
 /* Lock must be held */
@@ -140,6 +254,113 @@ static void pop_listener(libvlc_event_manager_t * p_em, libvlc_event_listener_t
     queue(p_em)->last_elmt=prev;
 }
 
+/* Thread only, lock must be held */
+static void forget_listener(libvlc_event_manager_t * p_em, libvlc_event_listener_t * listener)
+{
+    struct libvlc_event_async_queue * q = queue(p_em);
+
+    for (unsigned i = q->batch_next; i < q->batch_count; i++)
+        if (listeners_are_equal(&q->batch[i].listener, listener))
+            cancel_entry(&q->batch[i]);
+
+    /* The filled slots belong to this thread until they are read */
+    for (unsigned pos = q->tail; pos - q->tail < QUEUE_SIZE; pos++)
+    {
+        struct queue_slot * slot = &q->slots[pos % QUEUE_SIZE];
+
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1)
+            break;
+        if (listeners_are_equal(&slot->entry.listener, listener))
+            cancel_entry(&slot->entry);
+    }
+
+    pop_listener(p_em, listener);
+}
+
+/* Thread only */
+static void process_removals(libvlc_event_manager_t * p_em)
+{
+    struct libvlc_event_async_queue * q = queue(p_em);
+
+    if (!atomic_load(&q->removal_pending))
+        return;
+
+    queue_lock(p_em);
+    for (struct queue_removal * r = q->removals; r != NULL; r = r->next)
+    {
+        forget_listener(p_em, &r->listener);
+        r->done = true;
+    }
+    q->removals = NULL;
+    atomic_store(&q->removal_pending, false);
+    vlc_cond_broadcast(&q->signal_idle);
+    queue_unlock(p_em);
+}
+
+static bool is_coalescable(libvlc_event_type_t type)
+{
+    return type == libvlc_MediaPlayerTimeChanged
+        || type == libvlc_MediaPlayerPositionChanged;
+}
+
+/* Only keeps the latest time and position events of each listener */
+static void coalesce(struct libvlc_event_async_queue * q, unsigned n)
+{
+    unsigned latest[QUEUE_SIZE];
+    unsigned count = 0;
+
+    for (unsigned i = n; i-- > 0;)
+    {
+        struct queue_entry * entry = &q->batch[i];
+        unsigned k;
+
+        if (!is_coalescable(entry->event.type))
+            continue;
+        for (k = 0; k < count; k++)
+            if (listeners_are_equal(&q->batch[latest[k]].listener,
+                                    &entry->listener))
+                break;
+        if (k < count)
+            cancel_entry(entry);
+        else
+            latest[count++] = i;
+    }
+}
+
+/* Thread only */
+static void deliver_batch(libvlc_event_manager_t * p_em, unsigned n)
+{
+    struct libvlc_event_async_queue * q = queue(p_em);
+
+    coalesce(q, n);
+    q->batch_count = n;
+    for (q->batch_next = 0; q->batch_next < n;)
+    {
+        struct queue_entry * entry = &q->batch[q->batch_next++];
+
+        if (entry->listener.pf_batch != NULL)
+        {
+            /* All the events of the listener at once */
+            libvlc_event_listener_t listener = entry->listener;
+            unsigned count = 0;
+
+            q->events[count++] = entry->event;
+            for (unsigned i = q->batch_next; i < n; i++)
+                if (listeners_are_equal(&q->batch[i].listener, &listener))
+                {
+                    q->events[count++] = q->batch[i].event;
+                    cancel_entry(&q->batch[i]);
+                }
+            listener.pf_batch(q->events, count, listener.p_user_data); // This might edit the queue
+        }
+        else if (entry->listener.pf_callback != NULL)
+            entry->listener.pf_callback(&entry->event, entry->listener.p_user_data); // This might edit the queue
+
+        process_removals(p_em);
+    }
+    q->batch_count = 0;
+}
+
 /**************************************************************************
  *       libvlc_event_async_fini (internal) :
  *
@@ -156,12 +377,11 @@ libvlc_event_async_fini(libvlc_event_manager_t * p_em)
         abort();
     }
 
-    vlc_thread_t thread = queue(p_em)->thread;
-    if(thread)
-    {
-        vlc_cancel(thread);
-        vlc_join(thread, NULL);
-    }
+    queue_lock(p_em);
+    atomic_store(&queue(p_em)->dead, true);
+    vlc_cond_signal(&queue(p_em)->signal);
+    queue_unlock(p_em);
+    vlc_join(queue(p_em)->thread, NULL);
 
     vlc_mutex_destroy(&queue(p_em)->lock);
     vlc_cond_destroy(&queue(p_em)->signal);
@@ -179,30 +399,50 @@ libvlc_event_async_fini(libvlc_event_manager_t * p_em)
 }
 
 /**************************************************************************
- *       libvlc_event_async_init (private) :
+ *       libvlc_event_async_init (internal) :
  *
- * Destroy what might have been created by.
+ * Create the queue and its thread, when the first asynchronous listener is
+ * attached, with the object lock held.
  **************************************************************************/
-static void
+int
 libvlc_event_async_init(libvlc_event_manager_t * p_em)
 {
-    p_em->async_event_queue = calloc(1, sizeof(struct libvlc_event_async_queue));
+    if (is_queue_initialized(p_em))
+        return 0;
 
-    int error = vlc_threadvar_create(&queue(p_em)->is_asynch_dispatch_thread_var, NULL);
-    assert(!error);
+    struct libvlc_event_async_queue * q = calloc(1, sizeof(*q));
+    if (unlikely(q == NULL))
+        return -1;
 
-    vlc_mutex_init(&queue(p_em)->lock);
-    vlc_cond_init(&queue(p_em)->signal);
-    vlc_cond_init(&queue(p_em)->signal_idle);
+    if (vlc_threadvar_create(&q->is_asynch_dispatch_thread_var, NULL))
+    {
+        free(q);
+        return -1;
+    }
 
-    error = vlc_clone (&queue(p_em)->thread, event_async_loop, p_em, VLC_THREAD_PRIORITY_LOW);
-    if(error)
+    for (unsigned i = 0; i < QUEUE_SIZE; i++)
+        atomic_init(&q->slots[i].seq, i);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->overflow, false);
+    atomic_init(&q->removal_pending, false);
+    atomic_init(&q->sleeping, false);
+    atomic_init(&q->dead, false);
+    vlc_mutex_init(&q->lock);
+    vlc_cond_init(&q->signal);
+    vlc_cond_init(&q->signal_idle);
+
+    p_em->async_event_queue = q; /* before the thread uses it */
+    if (vlc_clone (&q->thread, event_async_loop, p_em, VLC_THREAD_PRIORITY_LOW))
     {
-        free(p_em->async_event_queue);
         p_em->async_event_queue = NULL;
-        return;
+        vlc_mutex_destroy(&q->lock);
+        vlc_cond_destroy(&q->signal);
+        vlc_cond_destroy(&q->signal_idle);
+        vlc_threadvar_delete(&q->is_asynch_dispatch_thread_var);
+        free(q);
+        return -1;
     }
-
+    return 0;
 }
 
 /**************************************************************************
@@ -216,12 +456,21 @@ libvlc_event_async_ensure_listener_removal(libvlc_event_manager_t * p_em, libvlc
     if(!is_queue_initialized(p_em)) return;
 
     queue_lock(p_em);
-    pop_listener(p_em, listener);
-
-    // Wait for the asynch_loop to have processed all events.
-    if(!current_thread_is_asynch_thread(p_em))
+    if(current_thread_is_asynch_thread(p_em))
+        forget_listener(p_em, listener);
+    else
     {
-        while(!queue(p_em)->is_idle)
+        // Wait for the thread to be done with the listener.
+        struct queue_removal removal = {
+            .listener = *listener,
+            .next = queue(p_em)->removals,
+            .done = false,
+        };
+
+        queue(p_em)->removals = &removal;
+        atomic_store(&queue(p_em)->removal_pending, true);
+        vlc_cond_signal(&queue(p_em)->signal);
+        while(!removal.done)
             vlc_cond_wait(&queue(p_em)->signal_idle, &queue(p_em)->lock);
     }
     queue_unlock(p_em);
@@ -235,15 +484,30 @@ libvlc_event_async_ensure_listener_removal(libvlc_event_manager_t * p_em, libvlc
 void
 libvlc_event_async_dispatch(libvlc_event_manager_t * p_em, libvlc_event_listener_t * listener, libvlc_event_t * event)
 {
-    // We do a lazy init here, to prevent constructing the thread when not needed.
-    vlc_mutex_lock(&p_em->object_lock);
-    if(!queue(p_em))
-        libvlc_event_async_init(p_em);
-    vlc_mutex_unlock(&p_em->object_lock);
+    /* The queue was created when the listener was attached, and published
+     * to the senders along with it. */
+    struct libvlc_event_async_queue * q = queue(p_em);
+    assert(q != NULL);
+
+    /* Once an event went to the list, the next ones do too until the thread
+     * takes them, so that the events of a sender stay in order. */
+    if (!atomic_load(&q->overflow) && ring_push(q, listener, event))
+    {
+        /* Pairs with the fence of the thread going to sleep */
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!atomic_load_explicit(&q->sleeping, memory_order_relaxed))
+            return;
+
+        queue_lock(p_em);
+        vlc_cond_signal(&q->signal);
+        queue_unlock(p_em);
+        return;
+    }
 
     queue_lock(p_em);
     push(p_em, listener, event);
-    vlc_cond_signal(&queue(p_em)->signal);
+    atomic_store(&q->overflow, true);
+    vlc_cond_signal(&q->signal);
     queue_unlock(p_em);
 }
 
@@ -255,33 +519,37 @@ libvlc_event_async_dispatch(libvlc_event_manager_t * p_em, libvlc_event_listener
 static void * event_async_loop(void * arg)
 {
     libvlc_event_manager_t * p_em = arg;
-    libvlc_event_listener_t listener;
-    libvlc_event_t event;
+    struct libvlc_event_async_queue * q = queue(p_em);
 
-    vlc_threadvar_set(queue(p_em)->is_asynch_dispatch_thread_var, p_em);
+    vlc_threadvar_set(q->is_asynch_dispatch_thread_var, p_em);
 
-    queue_lock(p_em);
-    while (true) {
-        int has_listener = pop(p_em, &listener, &event);
+    while (!atomic_load(&q->dead)) {
+        process_removals(p_em);
 
-        if (has_listener)
+        /* The ring first: the list has the newer events */
+        unsigned n = ring_pop_batch(q);
+        if (n == 0 && atomic_load(&q->overflow))
         {
-            queue_unlock(p_em);
-            listener.pf_callback(&event, listener.p_user_data); // This might edit the queue
             queue_lock(p_em);
+            n = pop_batch(p_em);
+            queue_unlock(p_em);
         }
-        else
-        {
-            queue(p_em)->is_idle = true;
-
-            mutex_cleanup_push(&queue(p_em)->lock);
-            vlc_cond_broadcast(&queue(p_em)->signal_idle); // We'll be idle
-            vlc_cond_wait(&queue(p_em)->signal, &queue(p_em)->lock);
-            vlc_cleanup_pop();
 
-            queue(p_em)->is_idle = false;
+        if (n > 0)
+        {
+            deliver_batch(p_em, n);
+            continue;
         }
+
+        queue_lock(p_em);
+        atomic_store_explicit(&q->sleeping, true, memory_order_relaxed);
+        /* Pairs with the fence of the senders */
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!ring_ready(q) && !atomic_load(&q->overflow)
+         && !atomic_load(&q->removal_pending) && !atomic_load(&q->dead))
+            vlc_cond_wait(&q->signal, &q->lock);
+        atomic_store_explicit(&q->sleeping, false, memory_order_relaxed);
+        queue_unlock(p_em);
     }
-    queue_unlock(p_em);
     return NULL;
 }
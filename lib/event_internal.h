@@ -34,6 +34,7 @@
 #include <vlc/libvlc_events.h>
 
 #include <vlc_common.h>
+#include <vlc_atomic.h>
 
 
 /*
@@ -81,6 +82,7 @@ typedef struct libvlc_event_listener_t
     libvlc_event_type_t event_type;
     void *              p_user_data;
     libvlc_callback_t   pf_callback;
+    libvlc_batch_callback_t pf_batch; /* instead of pf_callback */
     bool                is_asynchronous;
 } libvlc_event_listener_t;
 
@@ -90,7 +92,17 @@ typedef struct libvlc_event_manager_t
     struct libvlc_instance_t * p_libvlc_instance;
     vlc_array_t listeners_groups;
     vlc_mutex_t object_lock;
-    vlc_mutex_t event_sending_lock;
+
+    /* Threads sending events, counted in the phase they started in, so
+     * that detach waits for the senders that started before */
+    atomic_uint readers[2];
+    atomic_uint phase;
+    atomic_uint waiters; /* threads in detach, waiting */
+    unsigned waiting_depth[2]; /* their sends, object_lock */
+    bool b_waiting; /* object_lock */
+    vlc_cond_t idle; /* senders left, with object_lock */
+    struct libvlc_event_listeners_t * retired; /* replaced, object_lock */
+
     struct libvlc_event_async_queue * async_event_queue;
 } libvlc_event_sender_t;
 
@@ -101,11 +113,13 @@ listeners_are_equal( libvlc_event_listener_t * listener1,
 {
     return listener1->event_type  == listener2->event_type &&
     listener1->pf_callback == listener2->pf_callback &&
+    listener1->pf_batch == listener2->pf_batch &&
     listener1->p_user_data == listener2->p_user_data &&
     listener1->is_asynchronous == listener2->is_asynchronous;
 }
 
 /* event_async.c */
+int libvlc_event_async_init(libvlc_event_manager_t * p_em);
 void libvlc_event_async_fini(libvlc_event_manager_t * p_em);
 void libvlc_event_async_dispatch(libvlc_event_manager_t * p_em, libvlc_event_listener_t * listener, libvlc_event_t * event);
 void libvlc_event_async_ensure_listener_removal(libvlc_event_manager_t * p_em, libvlc_event_listener_t * listener);
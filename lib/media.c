@@ -608,6 +608,63 @@ int libvlc_media_get_stats( libvlc_media_t *p_md,
     return true;
 }
 
+static void media_histogram_copy( libvlc_media_histogram_t *p_dst,
+                                  const input_histogram_t *p_src )
+{
+    static_assert( LIBVLC_MEDIA_HISTOGRAM_BUCKETS == INPUT_HISTOGRAM_BUCKETS,
+                   "Mismatched histogram sizes" );
+    p_dst->i_count = p_src->i_count;
+    p_dst->i_sum = p_src->i_sum;
+    memcpy( p_dst->pi_buckets, p_src->pi_buckets,
+            sizeof( p_dst->pi_buckets ) );
+}
+
+int libvlc_media_get_stats_snapshot( libvlc_media_t *p_md,
+                                     libvlc_media_stats_snapshot_t *p_stats )
+{
+    assert( p_md );
+
+    input_item_t *p_item = p_md->p_input_item;
+    vlc_mutex_lock( &p_item->lock );
+    input_stats_t *p_itm_stats = p_item->p_stats;
+    vlc_mutex_unlock( &p_item->lock );
+    if( p_itm_stats == NULL )
+    {
+        libvlc_printerr( "Statistics are not available" );
+        return -1;
+    }
+
+    vlc_mutex_lock( &p_itm_stats->lock );
+    p_stats->i_read_bytes = p_itm_stats->i_read_bytes;
+    p_stats->f_input_bitrate = p_itm_stats->f_input_bitrate;
+
+    p_stats->i_demux_read_bytes = p_itm_stats->i_demux_read_bytes;
+    p_stats->f_demux_bitrate = p_itm_stats->f_demux_bitrate;
+    p_stats->i_demux_corrupted = p_itm_stats->i_demux_corrupted;
+    p_stats->i_demux_discontinuity = p_itm_stats->i_demux_discontinuity;
+
+    p_stats->i_decoded_video = p_itm_stats->i_decoded_video;
+    p_stats->i_decoded_audio = p_itm_stats->i_decoded_audio;
+    media_histogram_copy( &p_stats->decode_video_time,
+                          &p_itm_stats->decode_video_time );
+    media_histogram_copy( &p_stats->decode_audio_time,
+                          &p_itm_stats->decode_audio_time );
+
+    p_stats->i_displayed_pictures = p_itm_stats->i_displayed_pictures;
+    p_stats->i_late_pictures = p_itm_stats->i_late_pictures;
+    p_stats->i_lost_pictures = p_itm_stats->i_lost_pictures;
+
+    p_stats->i_played_abuffers = p_itm_stats->i_played_abuffers;
+    p_stats->i_lost_abuffers = p_itm_stats->i_lost_abuffers;
+    media_histogram_copy( &p_stats->aout_drift, &p_itm_stats->aout_drift );
+
+    p_stats->i_sent_packets = p_itm_stats->i_sent_packets;
+    p_stats->i_sent_bytes = p_itm_stats->i_sent_bytes;
+    p_stats->f_send_bitrate = p_itm_stats->f_send_bitrate;
+    vlc_mutex_unlock( &p_itm_stats->lock );
+    return 0;
+}
+
 /**************************************************************************
  * event_manager
  **************************************************************************/
@@ -689,6 +746,52 @@ libvlc_media_parse_async(libvlc_media_t *media)
         media_parse(media);
 }
 
+/**************************************************************************
+ * Parse the media before the others, and do not wait.
+ **************************************************************************/
+void
+libvlc_media_parse_prioritize(libvlc_media_t *media)
+{
+    libvlc_int_t *libvlc = media->p_libvlc_instance->p_libvlc_int;
+    bool needed, parsed;
+
+    vlc_mutex_lock(&media->parsed_lock);
+    needed = !media->has_asked_preparse;
+    parsed = media->is_parsed;
+    media->has_asked_preparse = true;
+    vlc_mutex_unlock(&media->parsed_lock);
+
+    if (needed)
+        libvlc_ArtRequest(libvlc, media->p_input_item,
+                          META_REQUEST_OPTION_NONE);
+    if (!parsed)
+        libvlc_MetaRequest(libvlc, media->p_input_item,
+                           META_REQUEST_OPTION_PRIORITY);
+}
+
+/**************************************************************************
+ * Get statistics of the asynchronous parsing.
+ **************************************************************************/
+int
+libvlc_media_parse_get_stats(libvlc_instance_t *instance,
+                             libvlc_media_parse_stats_t *stats)
+{
+    input_preparser_stats_t s;
+
+    if (libvlc_MetaRequestStats(instance->p_libvlc_int, &s))
+    {
+        libvlc_printerr("Media parsing is not available");
+        return -1;
+    }
+    stats->i_pending = s.i_pending;
+    stats->i_running = s.i_running;
+    stats->i_done = s.i_done;
+    stats->i_timeouts = s.i_timeouts;
+    stats->i_cancelled = s.i_cancelled;
+    stats->f_rate = s.f_rate;
+    return 0;
+}
+
 /**************************************************************************
  * Get parsed status for media object.
  **************************************************************************/
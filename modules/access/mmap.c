@@ -0,0 +1,322 @@
+/*****************************************************************************
+ * mmap.c: memory-mapped file input
+ *****************************************************************************
+ * Copyright © 2007-2008 Rémi Denis-Courmont
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <vlc_common.h>
+#include <vlc_plugin.h>
+#include <vlc_access.h>
+#include <vlc_input.h>
+#include <vlc_dialog.h>
+#include <vlc_fs.h>
+
+#define FILE_MMAP_TEXT N_("Use file memory mapping")
+#define FILE_MMAP_LONGTEXT N_( \
+    "Try to use memory mapping to read local files and block devices. " \
+    "This avoids copying the data when playing high bitrate files." )
+
+#define FILE_MMAP_WINDOW_TEXT N_("Memory mapping window (KiB)")
+#define FILE_MMAP_WINDOW_LONGTEXT N_( \
+    "Size of the file areas mapped at once. It is scaled up with the " \
+    "playback rate." )
+
+static int Open (vlc_object_t *);
+static void Close (vlc_object_t *);
+
+vlc_module_begin ()
+    set_shortname (N_("MMap"))
+    set_description (N_("Memory-mapped file input"))
+    set_category (CAT_INPUT)
+    set_subcategory (SUBCAT_INPUT_ACCESS)
+    set_capability ("access", 52)
+    add_shortcut ("file")
+    set_callbacks (Open, Close)
+
+    add_bool ("file-mmap", false,
+              FILE_MMAP_TEXT, FILE_MMAP_LONGTEXT, true)
+    add_integer ("file-mmap-window", 8192,
+                 FILE_MMAP_WINDOW_TEXT, FILE_MMAP_WINDOW_LONGTEXT, true)
+        change_integer_range (256, 262144)
+vlc_module_end ()
+
+/* Largest playback rate taken into account for the mapping window */
+#define MMAP_MAX_RATE 8
+
+static block_t *Block (access_t *);
+static int Seek (access_t *, uint64_t);
+static int Control (access_t *, int, va_list);
+
+struct access_sys_t
+{
+    size_t page_size;
+    size_t window;    /* base mapping size, in bytes */
+    uint64_t size;    /* file size */
+    uint64_t advised; /* end of the range advised to the kernel */
+    int fd;
+};
+
+/**
+ * Gets the size of a regular file or block device. The st_size of block
+ * devices is zero: their size is their end offset.
+ */
+static int GetSize (int fd, uint64_t *size)
+{
+    struct stat st;
+
+    if (fstat (fd, &st))
+        return -1;
+    if (S_ISBLK (st.st_mode))
+    {
+        off_t end = lseek (fd, 0, SEEK_END);
+        if (end == -1)
+            return -1;
+        *size = end;
+    }
+    else
+        *size = st.st_size;
+    return 0;
+}
+
+static int Open (vlc_object_t *p_this)
+{
+    access_t *p_access = (access_t *)p_this;
+    const char *path = p_access->psz_filepath;
+
+    if (!var_InheritBool (p_this, "file-mmap") || path == NULL)
+        return VLC_EGENERIC;
+
+    int fd = vlc_open (path, O_RDONLY | O_NOCTTY);
+    if (fd == -1)
+        return VLC_EGENERIC; /* let the file access report the error */
+
+    /* mmap() is only safe on regular files and block devices */
+    struct stat st;
+    uint64_t size;
+    if (fstat (fd, &st) || !(S_ISREG (st.st_mode) || S_ISBLK (st.st_mode))
+     || GetSize (fd, &size) || size == 0)
+    {
+        msg_Dbg (p_this, "not a regular file, not using mmap");
+        goto error;
+    }
+
+    /* Check that mmap() works on this file system */
+    void *addr = mmap (NULL, 1, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        msg_Dbg (p_this, "cannot map file: %s", vlc_strerror_c(errno));
+        goto error;
+    }
+    munmap (addr, 1);
+
+    access_sys_t *p_sys = malloc (sizeof (*p_sys));
+    if (unlikely(p_sys == NULL))
+        goto error;
+
+    p_sys->page_size = sysconf (_SC_PAGE_SIZE);
+    p_sys->window = var_InheritInteger (p_this, "file-mmap-window") * 1024;
+    /* Map whole pages only */
+    p_sys->window = (p_sys->window + p_sys->page_size - 1)
+                  & ~(p_sys->page_size - 1);
+    p_sys->size = size;
+    p_sys->advised = 0;
+    p_sys->fd = fd;
+
+    access_InitFields (p_access);
+    p_access->pf_read = NULL;
+    p_access->pf_block = Block;
+    p_access->pf_seek = Seek;
+    p_access->pf_control = Control;
+    p_access->p_sys = p_sys;
+
+#ifdef HAVE_POSIX_FADVISE
+    /* The data is read through the mapping in order */
+    posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    msg_Dbg (p_this, "mapping file `%s' by windows of %zu bytes", path,
+             p_sys->window);
+    return VLC_SUCCESS;
+
+error:
+    close (fd);
+    return VLC_EGENERIC;
+}
+
+static void Close (vlc_object_t *p_this)
+{
+    access_t *p_access = (access_t *)p_this;
+    access_sys_t *p_sys = p_access->p_sys;
+
+    close (p_sys->fd);
+    free (p_sys);
+}
+
+/**
+ * Returns the mapping window for the current playback rate, so that the
+ * read ahead covers about the same duration whatever the speed.
+ */
+static size_t GetWindow (access_t *p_access)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    float rate = 1.f;
+
+    if (p_access->p_input != NULL)
+        rate = var_GetFloat (p_access->p_input, "rate");
+    if (!(rate > 1.f))
+        return p_sys->window;
+    if (rate > MMAP_MAX_RATE)
+        rate = MMAP_MAX_RATE;
+    return (size_t)(p_sys->window * rate) & ~(p_sys->page_size - 1);
+}
+
+static block_t *Block (access_t *p_access)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    uint64_t pos = p_access->info.i_pos;
+
+    /* Check if the file size changed */
+    if (pos >= p_sys->size)
+    {
+        uint64_t size;
+
+        if (GetSize (p_sys->fd, &size) == 0)
+            p_sys->size = size;
+        if (pos >= p_sys->size)
+        {
+            p_access->info.b_eof = true;
+            return NULL;
+        }
+    }
+
+    const uintptr_t page_mask = p_sys->page_size - 1;
+    const size_t window = GetWindow (p_access);
+    /* Start the mapping on a page boundary */
+    uint64_t outer_offset = pos & ~(uint64_t)page_mask;
+    /* Skip useless bytes at the beginning of the first page */
+    size_t inner_offset = pos & page_mask;
+    /* Map no more bytes than remain */
+    size_t length = window;
+    if (outer_offset + length > p_sys->size)
+        length = p_sys->size - outer_offset;
+
+    assert (outer_offset <= pos && pos < p_sys->size && length > 0);
+
+    /* PROT_WRITE with MAP_PRIVATE lets the block be modified in place;
+     * pages are only copied if they are actually written to. */
+    void *addr = mmap (NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE,
+                       p_sys->fd, outer_offset);
+    if (addr == MAP_FAILED)
+    {
+        msg_Err (p_access, "memory mapping failed: %s",
+                 vlc_strerror_c(errno));
+        dialog_Fatal (p_access, _("File reading failed"), "%s",
+                      _("VLC could not read the file."));
+        p_access->info.b_eof = true;
+        return NULL;
+    }
+#ifdef HAVE_POSIX_MADVISE
+    posix_madvise (addr, length, POSIX_MADV_SEQUENTIAL);
+    posix_madvise (addr, length, POSIX_MADV_WILLNEED);
+#endif
+
+    /* Read the next window ahead while this one is demuxed */
+    uint64_t next = outer_offset + length;
+    if (next < p_sys->size && p_sys->advised < next + window)
+    {
+        uint64_t start = __MAX(next, p_sys->advised);
+#ifdef HAVE_POSIX_FADVISE
+        posix_fadvise (p_sys->fd, start, next + window - start,
+                       POSIX_FADV_WILLNEED);
+#endif
+        p_sys->advised = next + window;
+    }
+
+    block_t *block = block_mmap_Alloc (addr, length);
+    if (block == NULL)
+    {
+        p_access->info.b_eof = true;
+        return NULL;
+    }
+
+    block->p_buffer += inner_offset;
+    block->i_buffer -= inner_offset;
+
+    p_access->info.i_pos += block->i_buffer;
+    return block;
+}
+
+static int Seek (access_t *p_access, uint64_t pos)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+
+    p_access->info.i_pos = pos;
+    p_access->info.b_eof = false;
+    /* Restart read ahead from the new position */
+    p_sys->advised = 0;
+    return VLC_SUCCESS;
+}
+
+static int Control (access_t *p_access, int query, va_list args)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+
+    switch (query)
+    {
+        case ACCESS_CAN_SEEK:
+        case ACCESS_CAN_FASTSEEK:
+        case ACCESS_CAN_PAUSE:
+        case ACCESS_CAN_CONTROL_PACE:
+            *va_arg (args, bool *) = true;
+            break;
+
+        case ACCESS_GET_SIZE:
+        {
+            uint64_t size;
+
+            if (GetSize (p_sys->fd, &size) == 0)
+                p_sys->size = size;
+            *va_arg (args, uint64_t *) = p_sys->size;
+            break;
+        }
+
+        case ACCESS_GET_PTS_DELAY:
+            *va_arg (args, int64_t *) = INT64_C(1000) *
+                var_InheritInteger (p_access, "file-caching");
+            break;
+
+        case ACCESS_SET_PAUSE_STATE:
+            /* Nothing to do */
+            break;
+
+        default:
+            return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
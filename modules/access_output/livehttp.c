@@ -35,6 +35,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
+#include <assert.h>
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
@@ -43,6 +44,8 @@
 #include <vlc_fs.h>
 #include <vlc_strings.h>
 #include <vlc_charset.h>
+#include <vlc_httpd.h>
+#include <vlc_atomic.h>
 
 #include <gcrypt.h>
 #include <vlc_gcrypt.h>
@@ -105,6 +108,14 @@ static void Close( vlc_object_t * );
 #define INTITIAL_SEG_TEXT N_("Number of first segment")
 #define INITIAL_SEG_LONGTEXT N_("The number of the first segment generated")
 
+#define HTTPPATH_TEXT N_("HTTP path")
+#define HTTPPATH_LONGTEXT N_("Serve the index and the segments from memory "\
+                             "with the built-in HTTP server, under this path")
+
+#define PERSIST_TEXT N_("Write segments to disk")
+#define PERSIST_LONGTEXT N_("Write segments to disk. Can be disabled when "\
+                            "they are served by the built-in HTTP server.")
+
 vlc_module_begin ()
     set_description( N_("HTTP Live streaming output") )
     set_shortname( N_("LiveHTTP" ))
@@ -135,6 +146,10 @@ vlc_module_begin ()
                 KEYFILE_TEXT, KEYFILE_LONGTEXT, true )
     add_loadfile( SOUT_CFG_PREFIX "key-loadfile", NULL,
                 KEYLOADFILE_TEXT, KEYLOADFILE_LONGTEXT, true )
+    add_string( SOUT_CFG_PREFIX "http-path", NULL,
+                HTTPPATH_TEXT, HTTPPATH_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "persist", true,
+              PERSIST_TEXT, PERSIST_LONGTEXT, true )
     set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -156,6 +171,8 @@ static const char *const ppsz_sout_options[] = {
     "key-loadfile",
     "generate-iv",
     "initial-segment-number",
+    "http-path",
+    "persist",
     NULL
 };
 
@@ -163,8 +180,20 @@ static ssize_t Write( sout_access_out_t *, block_t * );
 static int Seek ( sout_access_out_t *, off_t  );
 static int Control( sout_access_out_t *, int, va_list );
 
+/* Content of a published segment, shared with the HTTP clients sending it */
+typedef struct
+{
+    atomic_uint refs;
+    block_t *p_block;
+} segment_data_t;
+
 typedef struct output_segment
 {
+    struct output_segment *p_next; /* in the worker queue */
+    block_t *p_data; /* segment content, encrypted once processed */
+    segment_data_t *p_shared; /* content once published */
+    httpd_url_t *p_url;
+    bool b_last;
     char *psz_filename;
     char *psz_uri;
     char *psz_key_uri;
@@ -174,9 +203,18 @@ typedef struct output_segment
     uint8_t aes_ivs[16];
 } output_segment_t;
 
+/* Segments of the index window, oldest first */
+typedef struct
+{
+    output_segment_t **pp_segments;
+    unsigned i_first;
+    unsigned i_count;
+    unsigned i_size; /* power of 2 */
+} segment_ring_t;
+
 struct sout_access_out_sys_t
 {
-    char *psz_cursegPath;
+    output_segment_t *p_current; /* segment being muxed */
     char *psz_indexPath;
     char *psz_indexUrl;
     char *psz_keyfile;
@@ -184,12 +222,13 @@ struct sout_access_out_sys_t
     mtime_t i_opendts;
     mtime_t i_dts_offset;
     mtime_t  i_seglenm;
-    uint32_t i_segment;
+    uint32_t i_segment_opened; /* last segment opened by the muxer */
+    uint32_t i_segment; /* last segment processed by the worker */
     size_t  i_seglen;
     float   f_seglen;
     block_t *block_buffer;
     block_t **last_block_buffer;
-    int i_handle;
+    block_t **last_segment_block;
     unsigned i_numsegs;
     unsigned i_initial_segment;
     bool b_delsegs;
@@ -198,19 +237,37 @@ struct sout_access_out_sys_t
     bool b_caching;
     bool b_generate_iv;
     bool b_segment_has_data;
+    bool b_persist;
     uint8_t aes_ivs[16];
     gcry_cipher_hd_t aes_ctx;
     char *key_uri;
-    uint8_t stuffing_bytes[16];
-    ssize_t stuffing_size;
-    vlc_array_t *segments_t;
+    segment_ring_t segments;
+
+    /* Closed segments are encrypted, written and published by a worker
+     * thread, so that segment boundaries never stall the muxer */
+    vlc_thread_t thread;
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    output_segment_t *p_pending;
+    output_segment_t **pp_pending_last;
+    bool b_closing;
+
+    /* In-memory segments served by the built-in HTTP server */
+    httpd_host_t *p_httpd_host;
+    httpd_url_t *p_index_url;
+    char *psz_httpPath;
+    vlc_mutex_t index_lock;
+    char *psz_index; /* current playlist, protected by index_lock */
 };
 
 static int LoadCryptFile( sout_access_out_t *p_access);
 static int CryptSetup( sout_access_out_t *p_access, char *keyfile );
 static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer );
 static ssize_t writeSegment( sout_access_out_t *p_access );
-static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys );
+static int openNextSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys );
+static void *Thread( void * );
+static int IndexCallback( httpd_callback_sys_t *, httpd_client_t *,
+                          httpd_message_t *, const httpd_message_t * );
 /*****************************************************************************
  * Open: open the file
  *****************************************************************************/
@@ -246,9 +303,11 @@ static int Open( vlc_object_t *p_this )
     p_sys->b_generate_iv = var_GetBool( p_access, SOUT_CFG_PREFIX "generate-iv") ;
     p_sys->b_segment_has_data = false;
 
-    p_sys->segments_t = vlc_array_new();
+    p_sys->segments.pp_segments = NULL;
+    p_sys->segments.i_first = 0;
+    p_sys->segments.i_count = 0;
+    p_sys->segments.i_size = 0;
 
-    p_sys->stuffing_size = 0;
     p_sys->i_opendts = VLC_TS_INVALID;
     p_sys->i_dts_offset  = 0;
 
@@ -292,15 +351,95 @@ static int Open( vlc_object_t *p_this )
         return VLC_EGENERIC;
     }
 
-    p_sys->i_handle = -1;
+    p_sys->p_current = NULL;
     p_sys->i_segment = p_sys->i_initial_segment > 0 ? p_sys->i_initial_segment -1 : 0;
-    p_sys->psz_cursegPath = NULL;
+    p_sys->i_segment_opened = p_sys->i_segment;
+
+    p_sys->psz_httpPath = var_GetNonEmptyString( p_access, SOUT_CFG_PREFIX "http-path" );
+    p_sys->b_persist = var_GetBool( p_access, SOUT_CFG_PREFIX "persist" ) ||
+                       !p_sys->psz_httpPath;
+    p_sys->p_httpd_host = NULL;
+    p_sys->p_index_url = NULL;
+    p_sys->psz_index = NULL;
+    vlc_mutex_init( &p_sys->index_lock );
+
+    if( p_sys->psz_httpPath )
+    {
+        /* Strip the trailing slash, segment names are appended to the path */
+        size_t i_len = strlen( p_sys->psz_httpPath );
+        if( p_sys->psz_httpPath[i_len - 1] == '/' )
+            p_sys->psz_httpPath[i_len - 1] = '\0';
+
+        const char *psz_name = "index.m3u8";
+        if( p_sys->psz_indexPath )
+        {
+            const char *psz_sep = strrchr( p_sys->psz_indexPath, DIR_SEP_CHAR );
+            psz_name = psz_sep ? psz_sep + 1 : p_sys->psz_indexPath;
+        }
+
+        char *psz_url;
+        p_sys->p_httpd_host = vlc_http_HostNew( VLC_OBJECT(p_access) );
+        if( p_sys->p_httpd_host == NULL ||
+            asprintf( &psz_url, "%s/%s", p_sys->psz_httpPath, psz_name ) < 0 )
+            goto error;
+
+        p_sys->p_index_url = httpd_UrlNew( p_sys->p_httpd_host, psz_url,
+                                           NULL, NULL );
+        if( p_sys->p_index_url == NULL )
+        {
+            msg_Err( p_access, "cannot serve index at %s", psz_url );
+            free( psz_url );
+            goto error;
+        }
+        msg_Dbg( p_access, "serving index at %s", psz_url );
+        free( psz_url );
+
+        httpd_UrlCatch( p_sys->p_index_url, HTTPD_MSG_GET, IndexCallback,
+                        (httpd_callback_sys_t *)p_sys );
+        httpd_UrlCatch( p_sys->p_index_url, HTTPD_MSG_HEAD, IndexCallback,
+                        (httpd_callback_sys_t *)p_sys );
+
+        if( p_sys->i_numsegs == 0 )
+            msg_Warn( p_access, "no segment limit, memory usage will grow "
+                      "with the stream duration" );
+    }
+
+    vlc_mutex_init( &p_sys->lock );
+    vlc_cond_init( &p_sys->wait );
+    p_sys->p_pending = NULL;
+    p_sys->pp_pending_last = &p_sys->p_pending;
+    p_sys->b_closing = false;
+
+    if( vlc_clone( &p_sys->thread, Thread, p_access, VLC_THREAD_PRIORITY_LOW ) )
+    {
+        vlc_cond_destroy( &p_sys->wait );
+        vlc_mutex_destroy( &p_sys->lock );
+        goto error;
+    }
 
     p_access->pf_write = Write;
     p_access->pf_seek  = Seek;
     p_access->pf_control = Control;
 
     return VLC_SUCCESS;
+
+error:
+    if( p_sys->p_index_url )
+        httpd_UrlDelete( p_sys->p_index_url );
+    if( p_sys->p_httpd_host )
+        httpd_HostDelete( p_sys->p_httpd_host );
+    vlc_mutex_destroy( &p_sys->index_lock );
+    if( p_sys->key_uri )
+    {
+        gcry_cipher_close( p_sys->aes_ctx );
+        free( p_sys->key_uri );
+    }
+    free( p_sys->psz_httpPath );
+    free( p_sys->psz_keyfile );
+    free( p_sys->psz_indexUrl );
+    free( p_sys->psz_indexPath );
+    free( p_sys );
+    return VLC_EGENERIC;
 }
 
 /************************************************************************
@@ -503,12 +642,95 @@ static char *formatSegmentPath( char *psz_path, uint32_t i_seg, bool b_sanitize
     return psz_result;
 }
 
+/************************************************************************
+ * Segment ring
+ ************************************************************************/
+static output_segment_t *ringAt( const segment_ring_t *ring, unsigned i )
+{
+    assert( i < ring->i_count );
+    return ring->pp_segments[( ring->i_first + i ) & ( ring->i_size - 1 )];
+}
+
+static int ringAppend( segment_ring_t *ring, output_segment_t *segment )
+{
+    if( ring->i_count == ring->i_size )
+    {
+        unsigned i_size = ring->i_size ? 2 * ring->i_size : 16;
+        output_segment_t **pp_segments = malloc( i_size * sizeof( *pp_segments ) );
+        if( unlikely( !pp_segments ) )
+            return VLC_ENOMEM;
+
+        for( unsigned i = 0; i < ring->i_count; i++ )
+            pp_segments[i] = ringAt( ring, i );
+        free( ring->pp_segments );
+        ring->pp_segments = pp_segments;
+        ring->i_first = 0;
+        ring->i_size = i_size;
+    }
+    ring->pp_segments[( ring->i_first + ring->i_count++ ) & ( ring->i_size - 1 )] = segment;
+    return VLC_SUCCESS;
+}
+
+static output_segment_t *ringShift( segment_ring_t *ring )
+{
+    output_segment_t *segment = ringAt( ring, 0 );
+
+    ring->i_first = ( ring->i_first + 1 ) & ( ring->i_size - 1 );
+    ring->i_count--;
+    return segment;
+}
+
+/************************************************************************
+ * Shared segment data: each HTTP answer gets a block referencing it
+ ************************************************************************/
+typedef struct
+{
+    block_t self;
+    segment_data_t *p_data;
+} segment_ref_t;
+
+static void segmentDataRelease( segment_data_t *p_data )
+{
+    if( atomic_fetch_sub( &p_data->refs, 1 ) == 1 )
+    {
+        block_Release( p_data->p_block );
+        free( p_data );
+    }
+}
+
+static void segmentRefRelease( block_t *p_block )
+{
+    segment_ref_t *p_ref = (segment_ref_t *)p_block;
+
+    segmentDataRelease( p_ref->p_data );
+    free( p_ref );
+}
+
+static block_t *segmentDataRef( segment_data_t *p_data )
+{
+    segment_ref_t *p_ref = malloc( sizeof( *p_ref ) );
+    if( unlikely( !p_ref ) )
+        return NULL;
+
+    block_Init( &p_ref->self, p_data->p_block->p_buffer,
+                p_data->p_block->i_buffer );
+    p_ref->self.pf_release = segmentRefRelease;
+    p_ref->p_data = p_data;
+    atomic_fetch_add( &p_data->refs, 1 );
+    return &p_ref->self;
+}
+
 static void destroySegment( output_segment_t *segment )
 {
     free( segment->psz_filename );
     free( segment->psz_duration );
     free( segment->psz_uri );
     free( segment->psz_key_uri );
+    if( segment->p_url )
+        httpd_UrlDelete( segment->p_url );
+    block_ChainRelease( segment->p_data );
+    if( segment->p_shared )
+        segmentDataRelease( segment->p_shared );
     free( segment );
 }
 
@@ -519,15 +741,15 @@ static void destroySegment( output_segment_t *segment )
 static uint32_t segmentAmountNeeded( sout_access_out_sys_t *p_sys )
 {
     float duration = .0f;
-    for( unsigned index = 1; (int)index <= vlc_array_count( p_sys->segments_t ); index++ )
+    for( unsigned index = 1; index <= p_sys->segments.i_count; index++ )
     {
-        output_segment_t* segment = vlc_array_item_at_index( p_sys->segments_t, vlc_array_count( p_sys->segments_t ) - index );
+        output_segment_t* segment = ringAt( &p_sys->segments, p_sys->segments.i_count - index );
         duration += segment->f_seglength;
 
         if( duration >= (float)( 3 * p_sys->i_seglen ) )
             return __MAX(index, p_sys->i_numsegs);
     }
-    return vlc_array_count( p_sys->segments_t )-1;
+    return p_sys->segments.i_count-1;
 
 }
 
@@ -546,14 +768,152 @@ static bool isFirstItemRemovable( sout_access_out_sys_t *p_sys, uint32_t i_first
      */
     for( unsigned int index = 0; index < i_index_offset; index++ )
     {
-        output_segment_t *segment = vlc_array_item_at_index( p_sys->segments_t, p_sys->i_segment - i_firstseg + index );
+        output_segment_t *segment = ringAt( &p_sys->segments, p_sys->i_segment - i_firstseg + index );
         duration += segment->f_seglength;
     }
-    output_segment_t *first = vlc_array_item_at_index( p_sys->segments_t, 0 );
+    output_segment_t *first = ringAt( &p_sys->segments, 0 );
 
     return duration >= (first->f_seglength + (float)(p_sys->i_numsegs * p_sys->i_seglen));
 }
 
+/************************************************************************
+ * indexAppend: Append formatted text to the index being built
+ ************************************************************************/
+static int indexAppend( char **ppsz_index, size_t *pi_len, const char *psz_fmt, ... )
+{
+    va_list args;
+    char *psz_text;
+
+    va_start( args, psz_fmt );
+    int i_text = vasprintf( &psz_text, psz_fmt, args );
+    va_end( args );
+    if ( i_text < 0 )
+        return -1;
+
+    char *psz_index = realloc( *ppsz_index, *pi_len + i_text + 1 );
+    if ( unlikely( !psz_index ) )
+    {
+        free( psz_text );
+        return -1;
+    }
+    memcpy( psz_index + *pi_len, psz_text, i_text + 1 );
+    free( psz_text );
+
+    *ppsz_index = psz_index;
+    *pi_len += i_text;
+    return 0;
+}
+
+/************************************************************************
+ * formatIndex: Create the m3u8 index of the current segments
+ ************************************************************************/
+static char *formatIndex( sout_access_out_sys_t *p_sys, uint32_t i_firstseg,
+                          unsigned i_index_offset, bool b_isend )
+{
+    char *psz_index = NULL;
+    size_t i_len = 0;
+    char *psz_current_uri = NULL;
+
+    if ( indexAppend( &psz_index, &i_len, "#EXTM3U\n#EXT-X-TARGETDURATION:%zu\n#EXT-X-VERSION:3\n#EXT-X-ALLOW-CACHE:%s"
+                      "%s\n#EXT-X-MEDIA-SEQUENCE:%"PRIu32"\n", p_sys->i_seglen,
+                      p_sys->b_caching ? "YES" : "NO",
+                      p_sys->i_numsegs > 0 ? "" : b_isend ? "\n#EXT-X-PLAYLIST-TYPE:VOD" : "\n#EXT-X-PLAYLIST-TYPE:EVENT",
+                      i_firstseg ) < 0 )
+        goto error;
+
+    for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
+    {
+        //scale to i_index_offset..numsegs + i_index_offset
+        uint32_t index = i - i_firstseg + i_index_offset;
+
+        output_segment_t *segment = ringAt( &p_sys->segments, index );
+        if( p_sys->key_uri && segment->psz_key_uri &&
+            ( !psz_current_uri ||  strcmp( psz_current_uri, segment->psz_key_uri ) )
+          )
+        {
+            int ret = 0;
+            free( psz_current_uri );
+            psz_current_uri = strdup( segment->psz_key_uri );
+            if( p_sys->b_generate_iv )
+            {
+                unsigned long long iv_hi = segment->aes_ivs[0];
+                unsigned long long iv_lo = segment->aes_ivs[8];
+                for( unsigned short i = 1; i < 8; i++ )
+                {
+                    iv_hi <<= 8;
+                    iv_hi |= segment->aes_ivs[i] & 0xff;
+                    iv_lo <<= 8;
+                    iv_lo |= segment->aes_ivs[8+i] & 0xff;
+                }
+                ret = indexAppend( &psz_index, &i_len, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
+                                   segment->psz_key_uri, iv_hi, iv_lo );
+
+            } else {
+                ret = indexAppend( &psz_index, &i_len, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
+            }
+            if( ret < 0 )
+                goto error;
+        }
+
+        if ( indexAppend( &psz_index, &i_len, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri ) < 0 )
+            goto error;
+    }
+    free( psz_current_uri );
+
+    if ( b_isend && indexAppend( &psz_index, &i_len, STR_ENDLIST ) < 0 )
+    {
+        free( psz_index );
+        return NULL;
+    }
+    return psz_index;
+
+error:
+    free( psz_current_uri );
+    free( psz_index );
+    return NULL;
+}
+
+/************************************************************************
+ * writeIndexFile: Replace the index file
+ ************************************************************************/
+static void writeIndexFile( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, const char *psz_index )
+{
+    int val;
+    FILE *fp;
+    char *psz_idxTmp;
+    if ( asprintf( &psz_idxTmp, "%s.tmp", p_sys->psz_indexPath ) < 0)
+        return;
+
+    fp = vlc_fopen( psz_idxTmp, "wt");
+    if ( !fp )
+    {
+        msg_Err( p_access, "cannot open index file `%s'", psz_idxTmp );
+        free( psz_idxTmp );
+        return;
+    }
+
+    val = fputs( psz_index, fp );
+    if ( fclose( fp ) || val < 0 )
+    {
+        vlc_unlink( psz_idxTmp );
+        msg_Err( p_access, "cannot write index file `%s'", psz_idxTmp );
+        free( psz_idxTmp );
+        return;
+    }
+
+    val = vlc_rename ( psz_idxTmp, p_sys->psz_indexPath);
+
+    if ( val < 0 )
+    {
+        vlc_unlink( psz_idxTmp );
+        msg_Err( p_access, "Error moving LiveHttp index file" );
+    }
+    else
+        msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
+
+    free( psz_idxTmp );
+}
+
 /************************************************************************
  * updateIndexAndDel: If necessary, update index file & delete old segments
  ************************************************************************/
@@ -572,125 +932,41 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
     {
         unsigned numsegs = segmentAmountNeeded( p_sys );
         i_firstseg = ( p_sys->i_segment - numsegs ) + 1;
-        i_index_offset = vlc_array_count( p_sys->segments_t ) - numsegs;
+        i_index_offset = p_sys->segments.i_count - numsegs;
     }
 
     // First update index
-    if ( p_sys->psz_indexPath )
+    if ( p_sys->psz_indexPath || p_sys->p_httpd_host )
     {
-        int val;
-        FILE *fp;
-        char *psz_idxTmp;
-        if ( asprintf( &psz_idxTmp, "%s.tmp", p_sys->psz_indexPath ) < 0)
+        char *psz_index = formatIndex( p_sys, i_firstseg, i_index_offset, b_isend );
+        if ( !psz_index )
             return -1;
 
-        fp = vlc_fopen( psz_idxTmp, "wt");
-        if ( !fp )
-        {
-            msg_Err( p_access, "cannot open index file `%s'", psz_idxTmp );
-            free( psz_idxTmp );
-            return -1;
-        }
+        if ( p_sys->psz_indexPath )
+            writeIndexFile( p_access, p_sys, psz_index );
 
-        if ( fprintf( fp, "#EXTM3U\n#EXT-X-TARGETDURATION:%zu\n#EXT-X-VERSION:3\n#EXT-X-ALLOW-CACHE:%s"
-                          "%s\n#EXT-X-MEDIA-SEQUENCE:%"PRIu32"\n", p_sys->i_seglen,
-                          p_sys->b_caching ? "YES" : "NO",
-                          p_sys->i_numsegs > 0 ? "" : b_isend ? "\n#EXT-X-PLAYLIST-TYPE:VOD" : "\n#EXT-X-PLAYLIST-TYPE:EVENT",
-                          i_firstseg ) < 0 )
+        if ( p_sys->p_httpd_host )
         {
-            free( psz_idxTmp );
-            fclose( fp );
-            return -1;
-        }
-        char *psz_current_uri=NULL;
-
-
-        for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
-        {
-            //scale to i_index_offset..numsegs + i_index_offset
-            uint32_t index = i - i_firstseg + i_index_offset;
-
-            output_segment_t *segment = (output_segment_t *)vlc_array_item_at_index( p_sys->segments_t, index );
-            if( p_sys->key_uri &&
-                ( !psz_current_uri ||  strcmp( psz_current_uri, segment->psz_key_uri ) )
-              )
-            {
-                int ret = 0;
-                free( psz_current_uri );
-                psz_current_uri = strdup( segment->psz_key_uri );
-                if( p_sys->b_generate_iv )
-                {
-                    unsigned long long iv_hi = segment->aes_ivs[0];
-                    unsigned long long iv_lo = segment->aes_ivs[8];
-                    for( unsigned short i = 1; i < 8; i++ )
-                    {
-                        iv_hi <<= 8;
-                        iv_hi |= segment->aes_ivs[i] & 0xff;
-                        iv_lo <<= 8;
-                        iv_lo |= segment->aes_ivs[8+i] & 0xff;
-                    }
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
-                                   segment->psz_key_uri, iv_hi, iv_lo );
-
-                } else {
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
-                }
-                if( ret < 0 )
-                {
-                    free( psz_current_uri );
-                    free( psz_idxTmp );
-                    fclose( fp );
-                    return -1;
-                }
-            }
-
-            val = fprintf( fp, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri);
-            if ( val < 0 )
-            {
-                free( psz_current_uri );
-                free( psz_idxTmp );
-                fclose( fp );
-                return -1;
-            }
-        }
-        free( psz_current_uri );
-
-        if ( b_isend )
-        {
-            if ( fputs ( STR_ENDLIST, fp ) < 0)
-            {
-                free( psz_idxTmp );
-                fclose( fp ) ;
-                return -1;
-            }
-
-        }
-        fclose( fp );
-
-        val = vlc_rename ( psz_idxTmp, p_sys->psz_indexPath);
-
-        if ( val < 0 )
-        {
-            vlc_unlink( psz_idxTmp );
-            msg_Err( p_access, "Error moving LiveHttp index file" );
+            vlc_mutex_lock( &p_sys->index_lock );
+            free( p_sys->psz_index );
+            p_sys->psz_index = psz_index;
+            vlc_mutex_unlock( &p_sys->index_lock );
         }
         else
-            msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
-
-        free( psz_idxTmp );
+            free( psz_index );
     }
 
     // Then take care of deletion
     // Try to follow pantos draft 11 section 6.2.2
-    while( p_sys->b_delsegs && p_sys->i_numsegs &&
+    // Segments served from memory are dropped even if the files are kept
+    while( ( p_sys->b_delsegs || p_sys->p_httpd_host ) && p_sys->i_numsegs &&
            isFirstItemRemovable( p_sys, i_firstseg, i_index_offset )
          )
     {
-         output_segment_t *segment = vlc_array_item_at_index( p_sys->segments_t, 0 );
+         output_segment_t *segment = ringShift( &p_sys->segments );
          msg_Dbg( p_access, "Removing segment number %d", segment->i_segment_number );
-         vlc_array_remove( p_sys->segments_t, 0 );
 
-         if ( segment->psz_filename )
+         if ( p_sys->b_delsegs && segment->psz_filename )
          {
              vlc_unlink( segment->psz_filename );
          }
@@ -704,51 +980,305 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
 }
 
 /*****************************************************************************
- * closeCurrentSegment: Close the segment file
+ * answerHeaders: Fill the headers of an HTTP answer served from memory
  *****************************************************************************/
-static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
+static void answerHeaders( httpd_message_t *answer, const char *psz_mime,
+                           size_t i_data )
 {
-    if ( p_sys->i_handle >= 0 )
-    {
-        output_segment_t *segment = (output_segment_t *)vlc_array_item_at_index( p_sys->segments_t, vlc_array_count( p_sys->segments_t ) - 1 );
+    answer->i_proto  = HTTPD_PROTO_HTTP;
+    answer->i_version= 1;
+    answer->i_type   = HTTPD_MSG_ANSWER;
+    answer->i_status = 200;
 
-        if( p_sys->key_uri )
-        {
-            size_t pad = 16 - p_sys->stuffing_size;
-            memset(&p_sys->stuffing_bytes[p_sys->stuffing_size], pad, pad);
-            gcry_error_t err = gcry_cipher_encrypt( p_sys->aes_ctx, p_sys->stuffing_bytes, 16, NULL, 0 );
-
-            if( err ) {
-               msg_Err( p_access, "Couldn't encrypt 16 bytes: %s", gpg_strerror(err) );
-            } else {
-            int ret = write( p_sys->i_handle, p_sys->stuffing_bytes, 16 );
-            if( ret != 16 )
-                msg_Err( p_access, "Couldn't write 16 bytes" );
-            }
-            p_sys->stuffing_size = 0;
-        }
+    httpd_MsgAdd( answer, "Content-Type", "%s", psz_mime );
+    httpd_MsgAdd( answer, "Content-Length", "%zu", i_data );
+}
 
+/*****************************************************************************
+ * IndexCallback: Serve the current index
+ *****************************************************************************/
+static int IndexCallback( httpd_callback_sys_t *p_cbsys, httpd_client_t *cl,
+                          httpd_message_t *answer, const httpd_message_t *query )
+{
+    sout_access_out_sys_t *p_sys = (sout_access_out_sys_t *)p_cbsys;
+    (void) cl;
 
-        close( p_sys->i_handle );
-        p_sys->i_handle = -1;
+    if( !answer || !query )
+        return VLC_SUCCESS;
 
-        if( ! ( us_asprintf( &segment->psz_duration, "%.2f", p_sys->f_seglen ) ) )
+    vlc_mutex_lock( &p_sys->index_lock );
+    if( !p_sys->psz_index )
+    {
+        /* No segment yet */
+        vlc_mutex_unlock( &p_sys->index_lock );
+        return VLC_EGENERIC;
+    }
+    /* The index is small and replaced at every segment, copy it */
+    size_t i_index = strlen( p_sys->psz_index );
+    if( query->i_type != HTTPD_MSG_HEAD )
+    {
+        answer->p_body = malloc( i_index );
+        if( unlikely( !answer->p_body ) )
         {
-            msg_Err( p_access, "Couldn't set duration on closed segment");
-            return;
+            vlc_mutex_unlock( &p_sys->index_lock );
+            return VLC_ENOMEM;
         }
-        segment->f_seglength = p_sys->f_seglen;
+        memcpy( answer->p_body, p_sys->psz_index, i_index );
+        answer->i_body = i_index;
+    }
+    vlc_mutex_unlock( &p_sys->index_lock );
+    answerHeaders( answer, "application/vnd.apple.mpegurl", i_index );
+
+    httpd_MsgAdd( answer, "Cache-Control", "no-cache" );
+    return VLC_SUCCESS;
+}
+
+/*****************************************************************************
+ * SegmentCallback: Serve a segment from memory
+ *****************************************************************************/
+static int SegmentCallback( httpd_callback_sys_t *p_cbsys, httpd_client_t *cl,
+                            httpd_message_t *answer, const httpd_message_t *query )
+{
+    output_segment_t *segment = (output_segment_t *)p_cbsys;
+    (void) cl;
+
+    if( !answer || !query )
+        return VLC_SUCCESS;
+
+    /* The data is not modified once the segment is published, and the
+     * server sends it from the shared buffer: the answer only holds a
+     * reference, which keeps the data alive after the segment expired */
+    if( query->i_type != HTTPD_MSG_HEAD )
+    {
+        answer->p_body_block = segmentDataRef( segment->p_shared );
+        if( unlikely( !answer->p_body_block ) )
+            return VLC_ENOMEM;
+    }
+    answerHeaders( answer, "video/MP2T", segment->p_shared->p_block->i_buffer );
+    return VLC_SUCCESS;
+}
 
-        segment->i_segment_number = p_sys->i_segment;
+/*****************************************************************************
+ * publishSegment: Serve the segment with the built-in HTTP server
+ *****************************************************************************/
+static void publishSegment( sout_access_out_t *p_access, output_segment_t *segment )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    const char *psz_name = strrchr( segment->psz_uri, '/' );
+    char *psz_url;
 
-        if ( p_sys->psz_cursegPath )
+    psz_name = psz_name ? psz_name + 1 : segment->psz_uri;
+    if ( asprintf( &psz_url, "%s/%s", p_sys->psz_httpPath, psz_name ) < 0 )
+        return;
+
+    segment->p_shared = malloc( sizeof( *segment->p_shared ) );
+    if ( unlikely( !segment->p_shared ) )
+    {
+        free( psz_url );
+        return;
+    }
+    atomic_init( &segment->p_shared->refs, 1 );
+    segment->p_shared->p_block = segment->p_data;
+    segment->p_data = NULL;
+
+    segment->p_url = httpd_UrlNew( p_sys->p_httpd_host, psz_url, NULL, NULL );
+    if ( segment->p_url )
+    {
+        httpd_UrlCatch( segment->p_url, HTTPD_MSG_GET, SegmentCallback,
+                        (httpd_callback_sys_t *)segment );
+        httpd_UrlCatch( segment->p_url, HTTPD_MSG_HEAD, SegmentCallback,
+                        (httpd_callback_sys_t *)segment );
+    }
+    else
+        msg_Err( p_access, "cannot serve segment at %s", psz_url );
+    free( psz_url );
+}
+
+/*****************************************************************************
+ * encryptSegment: Encrypt the whole segment, with PKCS#7 padding
+ *****************************************************************************/
+static int encryptSegment( sout_access_out_t *p_access, output_segment_t *segment )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( p_sys->psz_keyfile )
+    {
+        LoadCryptFile( p_access );
+    }
+
+    if( !p_sys->key_uri )
+        return VLC_SUCCESS;
+
+    segment->psz_key_uri = strdup( p_sys->key_uri );
+    if( CryptKey( p_access, segment->i_segment_number ) != VLC_SUCCESS )
+        return VLC_EGENERIC;
+    if( p_sys->b_generate_iv )
+        memcpy( segment->aes_ivs, p_sys->aes_ivs, sizeof(uint8_t)*16 );
+
+    size_t original = segment->p_data->i_buffer;
+    size_t pad = 16 - ( original & 15 );
+    block_t *output = block_Realloc( segment->p_data, 0, original + pad );
+    segment->p_data = output;
+    if( unlikely( !output ) )
+        return VLC_ENOMEM;
+    memset( &output->p_buffer[original], pad, pad );
+
+    gcry_error_t err = gcry_cipher_encrypt( p_sys->aes_ctx,
+                        output->p_buffer, output->i_buffer, NULL, 0 );
+    if( err )
+    {
+        msg_Err( p_access, "Encryption failure: %s ", gpg_strerror(err) );
+        return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+/*****************************************************************************
+ * writeSegmentFile: Write the segment to disk
+ *****************************************************************************/
+static int writeSegmentFile( sout_access_out_t *p_access, output_segment_t *segment )
+{
+    int fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
+                         O_TRUNC, 0666 );
+    if ( fd == -1 )
+    {
+        msg_Err( p_access, "cannot open `%s' (%s)", segment->psz_filename,
+                 vlc_strerror_c(errno) );
+        return VLC_EGENERIC;
+    }
+
+    for( block_t *output = segment->p_data; output; output = output->p_next )
+    {
+        const uint8_t *p_buffer = output->p_buffer;
+        size_t i_buffer = output->i_buffer;
+
+        while( i_buffer > 0 )
         {
-            msg_Dbg( p_access, "LiveHttpSegmentComplete: %s (%"PRIu32")" , p_sys->psz_cursegPath, p_sys->i_segment );
-            free( p_sys->psz_cursegPath );
-            p_sys->psz_cursegPath = 0;
-            updateIndexAndDel( p_access, p_sys, b_isend );
+            ssize_t val = write( fd, p_buffer, i_buffer );
+            if ( val == -1 )
+            {
+                if ( errno == EINTR )
+                    continue;
+                msg_Err( p_access, "cannot write `%s' (%s)",
+                         segment->psz_filename, vlc_strerror_c(errno) );
+                close( fd );
+                vlc_unlink( segment->psz_filename );
+                return VLC_EGENERIC;
+            }
+            p_buffer += val;
+            i_buffer -= val;
         }
     }
+
+    close( fd );
+    return VLC_SUCCESS;
+}
+
+/*****************************************************************************
+ * processSegment: Encrypt, write and publish a closed segment
+ *****************************************************************************/
+static void processSegment( sout_access_out_t *p_access, output_segment_t *segment )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( !segment->p_data )
+        segment->p_data = block_Alloc( 0 );
+
+    /* Encryption and serving want the segment in one piece */
+    if( segment->p_data &&
+        ( p_sys->key_uri || p_sys->psz_keyfile || p_sys->p_httpd_host ) )
+        segment->p_data = block_ChainGather( segment->p_data );
+
+    if( !segment->p_data || encryptSegment( p_access, segment ) != VLC_SUCCESS )
+    {
+        msg_Err( p_access, "Dropping data of segment %"PRIu32, segment->i_segment_number );
+        block_ChainRelease( segment->p_data );
+        segment->p_data = NULL;
+    }
+
+    if( !p_sys->b_persist || !segment->p_data ||
+        writeSegmentFile( p_access, segment ) != VLC_SUCCESS )
+        FREENULL( segment->psz_filename );
+
+    if( p_sys->p_httpd_host && segment->p_data )
+        publishSegment( p_access, segment );
+    if( !segment->p_url )
+    {
+        block_ChainRelease( segment->p_data );
+        segment->p_data = NULL;
+    }
+
+    if( ringAppend( &p_sys->segments, segment ) )
+    {
+        destroySegment( segment );
+        return;
+    }
+    p_sys->i_segment = segment->i_segment_number;
+
+    msg_Dbg( p_access, "LiveHttpSegmentComplete: %s (%"PRIu32")",
+             segment->psz_uri, segment->i_segment_number );
+    updateIndexAndDel( p_access, p_sys, segment->b_last );
+}
+
+/*****************************************************************************
+ * Thread: Process the closed segments
+ *****************************************************************************/
+static void *Thread( void *data )
+{
+    sout_access_out_t *p_access = data;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    vlc_mutex_lock( &p_sys->lock );
+    for( ;; )
+    {
+        while( !p_sys->p_pending && !p_sys->b_closing )
+            vlc_cond_wait( &p_sys->wait, &p_sys->lock );
+
+        output_segment_t *segment = p_sys->p_pending;
+        if( !segment )
+            break; /* closing and nothing left to do */
+
+        p_sys->p_pending = segment->p_next;
+        if( !p_sys->p_pending )
+            p_sys->pp_pending_last = &p_sys->p_pending;
+        segment->p_next = NULL;
+        vlc_mutex_unlock( &p_sys->lock );
+
+        processSegment( p_access, segment );
+
+        vlc_mutex_lock( &p_sys->lock );
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+    return NULL;
+}
+
+/*****************************************************************************
+ * closeCurrentSegment: Hand the segment over to the worker thread
+ *****************************************************************************/
+static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
+{
+    output_segment_t *segment = p_sys->p_current;
+
+    if ( !segment )
+        return;
+    p_sys->p_current = NULL;
+
+    if( us_asprintf( &segment->psz_duration, "%.2f", p_sys->f_seglen ) == -1 )
+    {
+        msg_Err( p_access, "Couldn't set duration on closed segment");
+        /* Reuse the number, segments must be contiguous */
+        p_sys->i_segment_opened--;
+        destroySegment( segment );
+        return;
+    }
+    segment->f_seglength = p_sys->f_seglen;
+    segment->b_last = b_isend;
+
+    vlc_mutex_lock( &p_sys->lock );
+    *p_sys->pp_pending_last = segment;
+    p_sys->pp_pending_last = &segment->p_next;
+    vlc_cond_signal( &p_sys->wait );
+    vlc_mutex_unlock( &p_sys->lock );
 }
 
 /*****************************************************************************
@@ -774,7 +1304,7 @@ static void Close( vlc_object_t * p_this )
         {
             closeCurrentSegment( p_access, p_sys, false );
             p_sys->i_dts_offset = 0;
-            if( unlikely(openNextFile( p_access, p_sys ) < 0 ) )
+            if( unlikely(openNextSegment( p_access, p_sys ) < 0 ) )
             {
                 block_ChainRelease( output_block );
                 output_block = NULL;
@@ -800,16 +1330,24 @@ static void Close( vlc_object_t * p_this )
 
     closeCurrentSegment( p_access, p_sys, true );
 
+    /* Let the worker thread finish the pending segments */
+    vlc_mutex_lock( &p_sys->lock );
+    p_sys->b_closing = true;
+    vlc_cond_signal( &p_sys->wait );
+    vlc_mutex_unlock( &p_sys->lock );
+    vlc_join( p_sys->thread, NULL );
+    vlc_cond_destroy( &p_sys->wait );
+    vlc_mutex_destroy( &p_sys->lock );
+
     if( p_sys->key_uri )
     {
         gcry_cipher_close( p_sys->aes_ctx );
         free( p_sys->key_uri );
     }
 
-    while( vlc_array_count( p_sys->segments_t ) > 0 )
+    while( p_sys->segments.i_count > 0 )
     {
-        output_segment_t *segment = vlc_array_item_at_index( p_sys->segments_t, 0 );
-        vlc_array_remove( p_sys->segments_t, 0 );
+        output_segment_t *segment = ringShift( &p_sys->segments );
         if( p_sys->b_delsegs && p_sys->i_numsegs && segment->psz_filename )
         {
             msg_Dbg( p_access, "Removing segment number %d name %s", segment->i_segment_number, segment->psz_filename );
@@ -818,8 +1356,17 @@ static void Close( vlc_object_t * p_this )
 
         destroySegment( segment );
     }
-    vlc_array_destroy( p_sys->segments_t );
+    free( p_sys->segments.pp_segments );
+
+    if( p_sys->p_index_url )
+        httpd_UrlDelete( p_sys->p_index_url );
+    if( p_sys->p_httpd_host )
+        httpd_HostDelete( p_sys->p_httpd_host );
+    vlc_mutex_destroy( &p_sys->index_lock );
+    free( p_sys->psz_index );
+    free( p_sys->psz_httpPath );
 
+    free( p_sys->psz_keyfile );
     free( p_sys->psz_indexUrl );
     free( p_sys->psz_indexPath );
     free( p_sys );
@@ -848,13 +1395,11 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
 }
 
 /*****************************************************************************
- * openNextFile: Open the segment file
+ * openNextSegment: Start the next segment
  *****************************************************************************/
-static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys )
+static int openNextSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys )
 {
-    int fd;
-
-    uint32_t i_newseg = p_sys->i_segment + 1;
+    uint32_t i_newseg = p_sys->i_segment_opened + 1;
 
     /* Create segment and fill it info that we can (everything excluding duration */
     output_segment_t *segment = (output_segment_t*)calloc(1, sizeof(output_segment_t));
@@ -866,44 +1411,22 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
     char *psz_idxFormat = p_sys->psz_indexUrl ? p_sys->psz_indexUrl : p_access->psz_path;
     segment->psz_uri = formatSegmentPath( psz_idxFormat , i_newseg, false );
 
-    if ( unlikely( !segment->psz_filename ) )
+    if ( unlikely( !segment->psz_filename || !segment->psz_uri ) )
     {
         msg_Err( p_access, "Format segmentpath failed");
         destroySegment( segment );
         return -1;
     }
 
-    fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
-                     O_TRUNC, 0666 );
-    if ( fd == -1 )
-    {
-        msg_Err( p_access, "cannot open `%s' (%s)", segment->psz_filename,
-                 vlc_strerror_c(errno) );
-        destroySegment( segment );
-        return -1;
-    }
-
-    vlc_array_append( p_sys->segments_t, segment);
-
-    if( p_sys->psz_keyfile )
-    {
-        LoadCryptFile( p_access );
-    }
+    /* Encryption and file writing are done by the worker thread
+     * once the segment is complete */
+    msg_Dbg( p_access, "Started livehttp segment: %s (%"PRIu32")" , segment->psz_filename, i_newseg );
 
-    if( p_sys->key_uri )
-    {
-        segment->psz_key_uri = strdup( p_sys->key_uri );
-        CryptKey( p_access, i_newseg );
-        if( p_sys->b_generate_iv )
-            memcpy( segment->aes_ivs, p_sys->aes_ivs, sizeof(uint8_t)*16 );
-    }
-    msg_Dbg( p_access, "Successfully opened livehttp file: %s (%"PRIu32")" , segment->psz_filename, i_newseg );
-
-    p_sys->psz_cursegPath = strdup(segment->psz_filename);
-    p_sys->i_handle = fd;
-    p_sys->i_segment = i_newseg;
+    p_sys->p_current = segment;
+    p_sys->last_segment_block = &segment->p_data;
+    p_sys->i_segment_opened = i_newseg;
     p_sys->b_segment_has_data = false;
-    return fd;
+    return VLC_SUCCESS;
 }
 /*****************************************************************************
  * CheckSegmentChange: Check if segment needs to be closed and new opened
@@ -925,14 +1448,14 @@ static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer )
         msg_Dbg( p_access, "dts offset %"PRId64, p_sys->i_dts_offset );
     }
 
-    if( p_sys->i_handle > 0 && p_sys->b_segment_has_data &&
+    if( p_sys->p_current && p_sys->b_segment_has_data &&
        (( p_buffer->i_length + p_buffer->i_dts - p_sys->i_opendts +
           p_sys->i_dts_offset ) >= p_sys->i_seglenm ) )
     {
         closeCurrentSegment( p_access, p_sys, false );
     }
 
-    if ( unlikely( p_sys->i_handle < 0 ) )
+    if ( unlikely( !p_sys->p_current ) )
     {
         p_sys->i_dts_offset = 0;
         p_sys->i_opendts = output ? output->i_dts : p_buffer->i_dts;
@@ -941,12 +1464,15 @@ static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer )
             ( p_buffer->i_dts < p_sys->i_opendts ) )
             p_sys->i_opendts = p_buffer->i_dts;
 
-        if ( openNextFile( p_access, p_sys ) < 0 )
+        if ( openNextSegment( p_access, p_sys ) < 0 )
            return VLC_EGENERIC;
     }
     return VLC_SUCCESS;
 }
 
+/*****************************************************************************
+ * writeSegment: Move the buffered blocks to the current segment
+ *****************************************************************************/
 static ssize_t writeSegment( sout_access_out_t *p_access )
 {
     sout_access_out_sys_t *p_sys = p_access->p_sys;
@@ -954,64 +1480,24 @@ static ssize_t writeSegment( sout_access_out_t *p_access )
     p_sys->block_buffer = NULL;
     p_sys->last_block_buffer = &p_sys->block_buffer;
     ssize_t i_write=0;
-    bool crypted = false;
-    while( output )
-    {
-        if( p_sys->key_uri && !crypted )
-        {
-            if( p_sys->stuffing_size )
-            {
-                output = block_Realloc( output, p_sys->stuffing_size, output->i_buffer );
-                if( unlikely(!output ) )
-                    return VLC_ENOMEM;
-                memcpy( output->p_buffer, p_sys->stuffing_bytes, p_sys->stuffing_size );
-                p_sys->stuffing_size = 0;
-            }
-            size_t original = output->i_buffer;
-            size_t padded = (output->i_buffer + 15 ) & ~15;
-            size_t pad = padded - original;
-            if( pad )
-            {
-                p_sys->stuffing_size = 16-pad;
-                output->i_buffer -= p_sys->stuffing_size;
-                memcpy(p_sys->stuffing_bytes, &output->p_buffer[output->i_buffer], p_sys->stuffing_size);
-            }
-
-            gcry_error_t err = gcry_cipher_encrypt( p_sys->aes_ctx,
-                                output->p_buffer, output->i_buffer, NULL, 0 );
-            if( err )
-            {
-                msg_Err( p_access, "Encryption failure: %s ", gpg_strerror(err) );
-                return -1;
-            }
-            crypted=true;
 
-        }
-        ssize_t val = write( p_sys->i_handle, output->p_buffer, output->i_buffer );
-        if ( val == -1 )
-        {
-           if ( errno == EINTR )
-              continue;
-           return -1;
-        }
+    if( !output )
+        return 0;
+    if( unlikely( !p_sys->p_current ) )
+    {
+        block_ChainRelease( output );
+        return -1;
+    }
 
+    /* The data is only queued here, the worker thread encrypts and writes
+     * it once the segment is complete */
+    block_ChainLastAppend( &p_sys->last_segment_block, output );
+    for( ; output; output = output->p_next )
+    {
         p_sys->f_seglen =
             (float)(output->i_length +
                     output->i_dts - p_sys->i_opendts + p_sys->i_dts_offset) / CLOCK_FREQ;
-
-        if ( (size_t)val >= output->i_buffer )
-        {
-           block_t *p_next = output->p_next;
-           block_Release (output);
-           output = p_next;
-           crypted=false;
-        }
-        else
-        {
-           output->p_buffer += val;
-           output->i_buffer -= val;
-        }
-        i_write += val;
+        i_write += output->i_buffer;
     }
     return i_write;
 }
@@ -35,6 +35,8 @@
 #include <vlc_block.h>
 #include <assert.h>
 
+#include "../kernels.h"
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -54,7 +56,9 @@ vlc_module_end ()
  *****************************************************************************/
 struct filter_sys_t
 {
-    void (*pf_dowork)(filter_t *, block_t *, block_t * );
+    unsigned i_input;
+    unsigned i_output;
+    float    matrix[6 * AUDIO_KERNELS_MAX_CHANNELS];
 };
 
 /*****************************************************************************
@@ -111,215 +115,125 @@ static bool IsSupported( const audio_format_t *p_input, const audio_format_t *p_
 
 static block_t *Filter( filter_t *, block_t * );
 
-static void DoWork_7_x_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        float ctr = p_src[6] * 0.7071f;
-        *p_dest++ = ctr + p_src[0] + p_src[2] / 4 + p_src[4] / 4;
-        *p_dest++ = ctr + p_src[1] + p_src[3] / 4 + p_src[5] / 4;
-
-        p_src += 7;
+/* The mixes are matrices: M(o, c) is the weight of the input channel c in
+ * the output channel o. The LFE input, if any, is the last column, and is
+ * dropped unless both sides have it. */
+#define M(o, c) m[(o) * ic + (c)]
 
-        if( p_filter->fmt_in.audio.i_physical_channels & AOUT_CHAN_LFE ) p_src++;
-    }
+static void Matrix_7_x_to_2_0( float *m, unsigned ic )
+{
+    M(0, 6) = M(1, 6) = 0.7071f;
+    M(0, 0) = M(1, 1) = 1.f;
+    M(0, 2) = M(1, 3) = 0.25f;
+    M(0, 4) = M(1, 5) = 0.25f;
 }
 
-static void DoWork_6_1_to_2_0( filter_t *p_filter, block_t *p_in_buf,
-                               block_t *p_out_buf )
+static void Matrix_6_1_to_2_0( float *m, unsigned ic )
 {
-    VLC_UNUSED(p_filter);
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        float ctr = (p_src[2] + p_src[5]) * 0.7071f;
-        *p_dest++ = p_src[0] + p_src[3] + ctr;
-        *p_dest++ = p_src[1] + p_src[4] + ctr;
-
-        p_src += 6;
-
-        /* We always have LFE here */
-        p_src++;
-    }
+    M(0, 2) = M(1, 2) = 0.7071f;
+    M(0, 5) = M(1, 5) = 0.7071f;
+    M(0, 0) = M(1, 1) = 1.f;
+    M(0, 3) = M(1, 4) = 1.f;
 }
 
-static void DoWork_5_x_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = p_src[0] + 0.7071f * (p_src[4] + p_src[2]);
-        *p_dest++ = p_src[1] + 0.7071f * (p_src[4] + p_src[3]);
-
-        p_src += 5;
-
-        if( p_filter->fmt_in.audio.i_physical_channels & AOUT_CHAN_LFE ) p_src++;
-    }
+static void Matrix_5_x_to_2_0( float *m, unsigned ic )
+{
+    M(0, 0) = M(1, 1) = 1.f;
+    M(0, 4) = M(1, 4) = 0.7071f;
+    M(0, 2) = M(1, 3) = 0.7071f;
 }
 
-static void DoWork_4_0_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    VLC_UNUSED(p_filter);
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = p_src[2] + p_src[3] + 0.5f * p_src[0];
-        *p_dest++ = p_src[2] + p_src[3] + 0.5f * p_src[1];
-        p_src += 4;
-    }
+static void Matrix_4_0_to_2_0( float *m, unsigned ic )
+{
+    M(0, 2) = M(1, 2) = 1.f;
+    M(0, 3) = M(1, 3) = 1.f;
+    M(0, 0) = M(1, 1) = 0.5f;
 }
 
-static void DoWork_3_x_to_2_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = p_src[2] + 0.5f * p_src[0];
-        *p_dest++ = p_src[2] + 0.5f * p_src[1];
-
-        p_src += 3;
-
-        if( p_filter->fmt_in.audio.i_physical_channels & AOUT_CHAN_LFE ) p_src++;
-    }
+static void Matrix_3_x_to_2_0( float *m, unsigned ic )
+{
+    M(0, 2) = M(1, 2) = 1.f;
+    M(0, 0) = M(1, 1) = 0.5f;
 }
 
-static void DoWork_7_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = p_src[6] + p_src[0] / 4 + p_src[1] / 4 + p_src[2] / 8 + p_src[3] / 8 + p_src[4] / 8 + p_src[5] / 8;
-
-        p_src += 7;
-
-        if( p_filter->fmt_in.audio.i_physical_channels & AOUT_CHAN_LFE ) p_src++;
-    }
+static void Matrix_7_x_to_1_0( float *m, unsigned ic )
+{
+    M(0, 6) = 1.f;
+    M(0, 0) = M(0, 1) = 0.25f;
+    M(0, 2) = M(0, 3) = M(0, 4) = M(0, 5) = 0.125f;
 }
 
-static void DoWork_5_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = 0.7071f * (p_src[0] + p_src[1]) + p_src[4]
-                     + 0.5f * (p_src[2] + p_src[3]);
-
-        p_src += 5;
-
-        if( p_filter->fmt_in.audio.i_physical_channels & AOUT_CHAN_LFE ) p_src++;
-    }
+static void Matrix_6_1_to_1_0( float *m, unsigned ic )
+{
+    M(0, 5) = 1.f;
+    M(0, 0) = M(0, 1) = 0.25f;
+    M(0, 2) = M(0, 3) = M(0, 4) = 0.125f;
 }
 
-static void DoWork_4_0_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    VLC_UNUSED(p_filter);
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = p_src[2] + p_src[3] + p_src[0] / 4 + p_src[1] / 4;
-        p_src += 4;
-    }
+static void Matrix_5_x_to_1_0( float *m, unsigned ic )
+{
+    M(0, 4) = 1.f;
+    M(0, 0) = M(0, 1) = 0.7071f;
+    M(0, 2) = M(0, 3) = 0.5f;
 }
 
-static void DoWork_3_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = p_src[2] + p_src[0] / 4 + p_src[1] / 4;
-
-        p_src += 3;
-
-        if( p_filter->fmt_in.audio.i_physical_channels & AOUT_CHAN_LFE ) p_src++;
-    }
+static void Matrix_4_0_to_1_0( float *m, unsigned ic )
+{
+    M(0, 2) = M(0, 3) = 1.f;
+    M(0, 0) = M(0, 1) = 0.25f;
 }
 
-static void DoWork_2_x_to_1_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    VLC_UNUSED(p_filter);
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = p_src[0] / 2 + p_src[1] / 2;
-
-        p_src += 2;
-    }
+static void Matrix_3_x_to_1_0( float *m, unsigned ic )
+{
+    M(0, 2) = 1.f;
+    M(0, 0) = M(0, 1) = 0.25f;
 }
 
-static void DoWork_7_x_to_4_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = p_src[6] + 0.5f * p_src[0] + p_src[2] / 6;
-        *p_dest++ = p_src[6] + 0.5f * p_src[1] + p_src[3] / 6;
-        *p_dest++ = p_src[2] / 6 +  p_src[4];
-        *p_dest++ = p_src[3] / 6 +  p_src[5];
-
-        p_src += 7;
-
-        if( p_filter->fmt_in.audio.i_physical_channels & AOUT_CHAN_LFE ) p_src++;
-    }
+static void Matrix_2_x_to_1_0( float *m, unsigned ic )
+{
+    M(0, 0) = M(0, 1) = 0.5f;
 }
 
-static void DoWork_5_x_to_4_0( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        float ctr = p_src[4] * 0.7071f;
-        *p_dest++ = p_src[0] + ctr;
-        *p_dest++ = p_src[1] + ctr;
-        *p_dest++ = p_src[2];
-        *p_dest++ = p_src[3];
-
-        p_src += 5;
-
-        if( p_filter->fmt_in.audio.i_physical_channels & AOUT_CHAN_LFE ) p_src++;
-    }
+static void Matrix_7_x_to_4_0( float *m, unsigned ic )
+{
+    M(0, 6) = M(1, 6) = 1.f;
+    M(0, 0) = M(1, 1) = 0.5f;
+    M(0, 2) = M(1, 3) = 1.f / 6;
+    M(2, 2) = M(3, 3) = 1.f / 6;
+    M(2, 4) = M(3, 5) = 1.f;
 }
 
-static void DoWork_7_x_to_5_x( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = p_src[0];
-        *p_dest++ = p_src[1];
-        *p_dest++ = (p_src[2] + p_src[4]) * 0.5f;
-        *p_dest++ = (p_src[3] + p_src[5]) * 0.5f;
-        *p_dest++ = p_src[6];
-
-        p_src += 7;
-
-        if( p_filter->fmt_in.audio.i_physical_channels & AOUT_CHAN_LFE &&
-            p_filter->fmt_out.audio.i_physical_channels & AOUT_CHAN_LFE )
-            *p_dest++ = *p_src++;
-        else if( p_filter->fmt_in.audio.i_physical_channels & AOUT_CHAN_LFE ) p_src++;
-    }
+static void Matrix_6_1_to_4_0( float *m, unsigned ic )
+{
+    M(0, 0) = M(1, 1) = 1.f;
+    M(0, 5) = M(1, 5) = 0.7071f;
+    M(2, 2) = M(3, 3) = 0.5f;
+    M(2, 4) = M(3, 4) = 0.5f;
 }
 
-static void DoWork_6_1_to_5_x( filter_t * p_filter,  block_t * p_in_buf, block_t * p_out_buf ) {
-    VLC_UNUSED(p_filter);
-    float *p_dest = (float *)p_out_buf->p_buffer;
-    const float *p_src = (const float *)p_in_buf->p_buffer;
-    for( int i = p_in_buf->i_nb_samples; i--; )
-    {
-        *p_dest++ = p_src[0];
-        *p_dest++ = p_src[1];
-        *p_dest++ = (p_src[2] + p_src[4]) * 0.5f;
-        *p_dest++ = (p_src[3] + p_src[4]) * 0.5f;
-        *p_dest++ = p_src[5];
-
-        p_src += 6;
+static void Matrix_5_x_to_4_0( float *m, unsigned ic )
+{
+    M(0, 0) = M(1, 1) = 1.f;
+    M(0, 4) = M(1, 4) = 0.7071f;
+    M(2, 2) = M(3, 3) = 1.f;
+}
 
-        /* We always have LFE here */
-        *p_dest++ = *p_src++;
-    }
+static void Matrix_7_x_to_5_x( float *m, unsigned ic )
+{
+    M(0, 0) = M(1, 1) = 1.f;
+    M(2, 2) = M(3, 3) = 0.5f;
+    M(2, 4) = M(3, 5) = 0.5f;
+    M(4, 6) = 1.f;
 }
 
+static void Matrix_6_1_to_5_x( float *m, unsigned ic )
+{
+    M(0, 0) = M(1, 1) = 1.f;
+    M(2, 2) = M(3, 3) = 0.5f;
+    M(2, 4) = M(3, 4) = 0.5f;
+    M(4, 5) = 1.f;
+}
+#undef M
 
 /*****************************************************************************
  * OpenFilter:
@@ -356,48 +270,69 @@ static int OpenFilter( vlc_object_t *p_this )
     const bool b_input_3_0 = !b_input_7_0 && !b_input_5_0 && !b_input_4_center_rear &&
                              (i_input_physical & ~AOUT_CHAN_LFE) == AOUT_CHANS_3_0;
 
+    void (*pf_matrix)( float *, unsigned ) = NULL;
+
     if( p_filter->fmt_out.audio.i_physical_channels == AOUT_CHANS_2_0 )
     {
         if( b_input_7_0 )
-            p_filter->p_sys->pf_dowork = DoWork_7_x_to_2_0;
+            pf_matrix = Matrix_7_x_to_2_0;
         else if( b_input_6_1 )
-            p_filter->p_sys->pf_dowork = DoWork_6_1_to_2_0;
+            pf_matrix = Matrix_6_1_to_2_0;
         else if( b_input_5_0 )
-            p_filter->p_sys->pf_dowork = DoWork_5_x_to_2_0;
+            pf_matrix = Matrix_5_x_to_2_0;
         else if( b_input_4_center_rear )
-            p_filter->p_sys->pf_dowork = DoWork_4_0_to_2_0;
+            pf_matrix = Matrix_4_0_to_2_0;
         else if( b_input_3_0 )
-            p_filter->p_sys->pf_dowork = DoWork_3_x_to_2_0;
+            pf_matrix = Matrix_3_x_to_2_0;
     }
     else if( p_filter->fmt_out.audio.i_physical_channels == AOUT_CHAN_CENTER )
     {
         if( b_input_7_0 )
-            p_filter->p_sys->pf_dowork = DoWork_7_x_to_1_0;
+            pf_matrix = Matrix_7_x_to_1_0;
+        else if( b_input_6_1 )
+            pf_matrix = Matrix_6_1_to_1_0;
         else if( b_input_5_0 )
-            p_filter->p_sys->pf_dowork = DoWork_5_x_to_1_0;
+            pf_matrix = Matrix_5_x_to_1_0;
         else if( b_input_4_center_rear )
-            p_filter->p_sys->pf_dowork = DoWork_4_0_to_1_0;
+            pf_matrix = Matrix_4_0_to_1_0;
         else if( b_input_3_0 )
-            p_filter->p_sys->pf_dowork = DoWork_3_x_to_1_0;
+            pf_matrix = Matrix_3_x_to_1_0;
         else
-            p_filter->p_sys->pf_dowork = DoWork_2_x_to_1_0;
+            pf_matrix = Matrix_2_x_to_1_0;
     }
     else if(p_filter->fmt_out.audio.i_physical_channels == AOUT_CHANS_4_0)
     {
         if( b_input_7_0 )
-            p_filter->p_sys->pf_dowork = DoWork_7_x_to_4_0;
+            pf_matrix = Matrix_7_x_to_4_0;
+        else if( b_input_6_1 )
+            pf_matrix = Matrix_6_1_to_4_0;
         else
-            p_filter->p_sys->pf_dowork = DoWork_5_x_to_4_0;
+            pf_matrix = Matrix_5_x_to_4_0;
     }
     else
     {
         assert( b_input_7_0 || b_input_6_1 );
         if( b_input_7_0 )
-            p_filter->p_sys->pf_dowork = DoWork_7_x_to_5_x;
+            pf_matrix = Matrix_7_x_to_5_x;
         else
-            p_filter->p_sys->pf_dowork = DoWork_6_1_to_5_x;
+            pf_matrix = Matrix_6_1_to_5_x;
     }
 
+    p_sys = p_filter->p_sys;
+    p_sys->i_input = aout_FormatNbChannels( &p_filter->fmt_in.audio );
+    p_sys->i_output = aout_FormatNbChannels( &p_filter->fmt_out.audio );
+    assert( p_sys->i_input <= AUDIO_KERNELS_MAX_CHANNELS );
+    assert( p_sys->i_output <= 6 );
+
+    memset( p_sys->matrix, 0, sizeof(p_sys->matrix) );
+    if( pf_matrix != NULL )
+        pf_matrix( p_sys->matrix, p_sys->i_input );
+
+    /* The LFE is the last channel of both sides */
+    if( (i_input_physical & AOUT_CHAN_LFE) &&
+        (p_filter->fmt_out.audio.i_physical_channels & AOUT_CHAN_LFE) )
+        p_sys->matrix[p_sys->i_output * p_sys->i_input - 1] = 1.f;
+
     return VLC_SUCCESS;
 }
 
@@ -438,12 +373,11 @@ static block_t *Filter( filter_t *p_filter, block_t *p_block )
     p_out->i_pts = p_block->i_pts;
     p_out->i_length = p_block->i_length;
 
-    int i_input_nb = aout_FormatNbChannels( &p_filter->fmt_in.audio );
-    int i_output_nb = aout_FormatNbChannels( &p_filter->fmt_out.audio );
-    p_out->i_nb_samples = p_block->i_nb_samples;
-    p_out->i_buffer = p_block->i_buffer * i_output_nb / i_input_nb;
+    p_out->i_buffer = p_block->i_buffer * p_sys->i_output / p_sys->i_input;
 
-    p_sys->pf_dowork( p_filter, p_block, p_out );
+    audio_DownmixFl32( (float *)p_out->p_buffer,
+                       (const float *)p_block->p_buffer, p_block->i_nb_samples,
+                       p_sys->i_input, p_sys->i_output, p_sys->matrix );
 
     block_Release( p_block );
 
@@ -40,6 +40,8 @@
 #include <vlc_block.h>
 #include <vlc_filter.h>
 
+#include "../kernels.h"
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -173,21 +175,8 @@ static block_t *S16toFl32(filter_t *filter, block_t *bsrc)
         goto out;
 
     block_CopyProperties(bdst, bsrc);
-    int16_t *src = (int16_t *)bsrc->p_buffer;
-    float   *dst = (float *)bdst->p_buffer;
-    for (size_t i = bsrc->i_buffer / 2; i--;)
-#if 0
-        /* Slow version */
-        *dst++ = (float)*src++ / 32768.f;
-#else
-    {   /* This is Walken's trick based on IEEE float format. On my PIII
-         * this takes 16 seconds to perform one billion conversions, instead
-         * of 19 seconds for the above division. */
-        union { float f; int32_t i; } u;
-        u.i = *src++ + 0x43c00000;
-        *dst++ = u.f - 384.0;
-    }
-#endif
+    audio_S16toFl32((float *)bdst->p_buffer, (int16_t *)bsrc->p_buffer,
+                    bsrc->i_buffer / 2);
 out:
     block_Release(bsrc);
     VLC_UNUSED(filter);
@@ -253,46 +242,16 @@ static block_t *Fl32toU8(filter_t *filter, block_t *b)
 static block_t *Fl32toS16(filter_t *filter, block_t *b)
 {
     VLC_UNUSED(filter);
-    float   *src = (float *)b->p_buffer;
-    int16_t *dst = (int16_t *)src;
-    for (int i = b->i_buffer / 4; i--;) {
-#if 0
-        /* Slow version. */
-        if (*src >= 1.0) *dst = 32767;
-        else if (*src < -1.0) *dst = -32768;
-        else *dst = lroundf(*src * 32768.f);
-        src++; dst++;
-#else
-        /* This is Walken's trick based on IEEE float format. */
-        union { float f; int32_t i; } u;
-        u.f = *src++ + 384.0;
-        if (u.i > 0x43c07fff)
-            *dst++ = 32767;
-        else if (u.i < 0x43bf8000)
-            *dst++ = -32768;
-        else
-            *dst++ = u.i - 0x43c00000;
-#endif
-    }
+    audio_Fl32toS16((int16_t *)b->p_buffer, (float *)b->p_buffer,
+                    b->i_buffer / 4);
     b->i_buffer /= 2;
     return b;
 }
 
 static block_t *Fl32toS32(filter_t *filter, block_t *b)
 {
-    float   *src = (float *)b->p_buffer;
-    int32_t *dst = (int32_t *)src;
-    for (size_t i = b->i_buffer / 4; i--;)
-    {
-        float s = *(src++) * 2147483648.f;
-        if (s >= 2147483647.f)
-            *(dst++) = 2147483647;
-        else
-        if (s <= -2147483648.f)
-            *(dst++) = -2147483648;
-        else
-            *(dst++) = lroundf(s);
-    }
+    audio_Fl32toS32((int32_t *)b->p_buffer, (float *)b->p_buffer,
+                    b->i_buffer / 4);
     VLC_UNUSED(filter);
     return b;
 }
@@ -343,10 +302,8 @@ static block_t *S32toS16(filter_t *filter, block_t *b)
 static block_t *S32toFl32(filter_t *filter, block_t *b)
 {
     VLC_UNUSED(filter);
-    int32_t *src = (int32_t*)b->p_buffer;
-    float   *dst = (float *)src;
-    for (int i = b->i_buffer / 4; i--;)
-        *dst++ = (float)(*src++) / 2147483648.f;
+    audio_S32toFl32((float *)b->p_buffer, (int32_t *)b->p_buffer,
+                    b->i_buffer / 4);
     return b;
 }
 
@@ -0,0 +1,760 @@
+/*****************************************************************************
+ * kernels.h: vectorized audio sample kernels
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_AUDIO_KERNELS_H
+#define VLC_AUDIO_KERNELS_H 1
+
+/*
+ * Sample format conversions, gains and downmixes shared by the audio
+ * converters and volume modules. Each kernel has a C version and, on x86,
+ * SSE2 and AVX2 versions selected at run time. The integer results of the
+ * SSE2 and AVX2 versions are the same as the C ones.
+ *
+ * The conversions that do not enlarge the samples can work in place.
+ */
+
+#include <math.h>
+#include <vlc_cpu.h>
+
+#define AUDIO_KERNELS_MAX_CHANNELS 9
+
+/*** C ***/
+static inline void C_S16toFl32(float *dst, const int16_t *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = src[i] * (1.f / 32768.f);
+}
+
+static inline void C_Fl32toS16(int16_t *dst, const float *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        /* This is Walken's trick based on IEEE float format. */
+        union { float f; int32_t i; } u;
+        u.f = src[i] + 384.0;
+        if (u.i > 0x43c07fff)
+            dst[i] = 32767;
+        else if (u.i < 0x43bf8000)
+            dst[i] = -32768;
+        else
+            dst[i] = u.i - 0x43c00000;
+    }
+}
+
+static inline void C_S32toFl32(float *dst, const int32_t *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = (float)src[i] / 2147483648.f;
+}
+
+static inline void C_Fl32toS32(int32_t *dst, const float *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        float s = src[i] * 2147483648.f;
+        if (s >= 2147483647.f)
+            dst[i] = 2147483647;
+        else
+        if (s <= -2147483648.f)
+            dst[i] = -2147483648;
+        else
+            dst[i] = lroundf(s);
+    }
+}
+
+static inline void C_GainFl32(float *p, size_t n, float gain)
+{
+    for (size_t i = 0; i < n; i++)
+        p[i] *= gain;
+}
+
+/* The gain is in 1/256 units */
+static inline void C_GainS16(int16_t *p, size_t n, int16_t gain)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        int_fast32_t s = (p[i] * (int_fast32_t)gain) >> 8;
+        if (s > INT16_MAX)
+            s = INT16_MAX;
+        else
+        if (s < INT16_MIN)
+            s = INT16_MIN;
+        p[i] = s;
+    }
+}
+
+static inline float C_DotFl32(const float *a, const float *b, size_t n)
+{
+    float sum = 0.f;
+    for (size_t i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+/* matrix[o * in_channels + i] is the weight of the input channel i in the
+ * output channel o */
+static inline void C_DownmixFl32(float *dst, const float *src, size_t n,
+                                 unsigned in_channels, unsigned out_channels,
+                                 const float *matrix)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        for (unsigned o = 0; o < out_channels; o++)
+        {
+            float s = 0.f;
+            for (unsigned c = 0; c < in_channels; c++)
+                s += matrix[o * in_channels + c] * src[c];
+            *(dst++) = s;
+        }
+        src += in_channels;
+    }
+}
+
+/* Filter of interleaved samples with coefficients interpolated between two
+ * phases: out[c] is the sum of (coef[k] + frac * delta[k]) * src[k] for all
+ * k = c modulo channels. The coefficients are repeated for each channel. */
+static inline void C_FirFl32(float *out, const float *src, const float *coef,
+                             const float *delta, float frac, size_t n,
+                             unsigned channels)
+{
+    for (unsigned c = 0; c < channels; c++)
+        out[c] = 0.f;
+    for (size_t i = 0; i < n; i += channels)
+        for (unsigned c = 0; c < channels; c++)
+            out[c] += (coef[i + c] + frac * delta[i + c]) * src[i + c];
+}
+
+/* Least common multiple of the channels and the vector size, so that each
+ * lane of a vector always adds up the same channel */
+static inline unsigned audio_FirPeriod(unsigned channels, unsigned lanes)
+{
+    unsigned a = channels, b = lanes;
+
+    while (b != 0)
+    {
+        unsigned r = a % b;
+        a = b;
+        b = r;
+    }
+    return channels * (lanes / a);
+}
+
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (VLC_GCC_VERSION(4, 9) || defined(__clang__))
+# define AUDIO_KERNELS_SIMD 1
+# include <immintrin.h>
+
+# define AUDIO_SSE2 __attribute__ ((__target__ ("sse2")))
+# define AUDIO_AVX2 __attribute__ ((__target__ ("avx2")))
+
+/*** SSE2 ***/
+AUDIO_SSE2
+static inline void SSE2_S16toFl32(float *dst, const int16_t *src, size_t n)
+{
+    const __m128 scale = _mm_set1_ps(1.f / 32768.f);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&src[i]);
+        /* Sign extension: the samples in the high halves, shifted down */
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(&dst[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    C_S16toFl32(&dst[i], &src[i], n - i);
+}
+
+AUDIO_SSE2
+static inline void SSE2_Fl32toS16(int16_t *dst, const float *src, size_t n)
+{
+    const __m128 scale = _mm_set1_ps(32768.f);
+    const __m128 max = _mm_set1_ps(32767.f);
+    const __m128 min = _mm_set1_ps(-32768.f);
+    size_t i = 0;
+
+    /* The samples are rounded to the nearest even like Walken's trick, and
+     * clipped before the conversion so that it cannot overflow */
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(&src[i]), scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(&src[i + 4]), scale);
+        a = _mm_max_ps(_mm_min_ps(a, max), min);
+        b = _mm_max_ps(_mm_min_ps(b, max), min);
+        _mm_storeu_si128((__m128i *)&dst[i],
+                         _mm_packs_epi32(_mm_cvtps_epi32(a),
+                                         _mm_cvtps_epi32(b)));
+    }
+    C_Fl32toS16(&dst[i], &src[i], n - i);
+}
+
+AUDIO_SSE2
+static inline void SSE2_S32toFl32(float *dst, const int32_t *src, size_t n)
+{
+    const __m128 scale = _mm_set1_ps(1.f / 2147483648.f);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&src[i]);
+        _mm_storeu_ps(&dst[i], _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    C_S32toFl32(&dst[i], &src[i], n - i);
+}
+
+/* Rounds half away from zero like lroundf(), and saturates */
+AUDIO_SSE2
+static inline __m128i SSE2_RoundS32(__m128 s)
+{
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128i r = _mm_cvtps_epi32(s); /* to the nearest even */
+    __m128 d = _mm_sub_ps(s, _mm_cvtepi32_ps(r));
+    __m128 up = _mm_and_ps(_mm_cmpeq_ps(d, half), _mm_cmpgt_ps(s, zero));
+    __m128 down = _mm_and_ps(_mm_cmpeq_ps(d, _mm_sub_ps(zero, half)),
+                             _mm_cmplt_ps(s, zero));
+
+    r = _mm_sub_epi32(r, _mm_castps_si128(up));
+    r = _mm_add_epi32(r, _mm_castps_si128(down));
+    /* The conversion gives INT32_MIN on overflow: fix the positive side */
+    __m128i big = _mm_castps_si128(_mm_cmpge_ps(s,
+                                               _mm_set1_ps(2147483648.f)));
+    return _mm_or_si128(_mm_andnot_si128(big, r),
+                        _mm_and_si128(big, _mm_set1_epi32(INT32_MAX)));
+}
+
+AUDIO_SSE2
+static inline void SSE2_Fl32toS32(int32_t *dst, const float *src, size_t n)
+{
+    const __m128 scale = _mm_set1_ps(2147483648.f);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 s = _mm_mul_ps(_mm_loadu_ps(&src[i]), scale);
+        _mm_storeu_si128((__m128i *)&dst[i], SSE2_RoundS32(s));
+    }
+    C_Fl32toS32(&dst[i], &src[i], n - i);
+}
+
+AUDIO_SSE2
+static inline void SSE2_GainFl32(float *p, size_t n, float gain)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm_storeu_ps(&p[i], _mm_mul_ps(_mm_loadu_ps(&p[i]), g));
+        _mm_storeu_ps(&p[i + 4], _mm_mul_ps(_mm_loadu_ps(&p[i + 4]), g));
+    }
+    C_GainFl32(&p[i], n - i, gain);
+}
+
+AUDIO_SSE2
+static inline void SSE2_GainS16(int16_t *p, size_t n, int16_t gain)
+{
+    const __m128i g = _mm_set1_epi16(gain);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&p[i]);
+        __m128i l = _mm_mullo_epi16(v, g), h = _mm_mulhi_epi16(v, g);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(l, h), 8);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(l, h), 8);
+        _mm_storeu_si128((__m128i *)&p[i], _mm_packs_epi32(lo, hi));
+    }
+    C_GainS16(&p[i], n - i, gain);
+}
+
+/* The partial sums are not added in the same order as the C version */
+AUDIO_SSE2
+static inline float SSE2_DotFl32(const float *a, const float *b, size_t n)
+{
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(&a[i]),
+                                       _mm_loadu_ps(&b[i])));
+        s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(&a[i + 4]),
+                                       _mm_loadu_ps(&b[i + 4])));
+    }
+    s0 = _mm_add_ps(s0, s1);
+    s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+    s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+    return _mm_cvtss_f32(s0) + C_DotFl32(&a[i], &b[i], n - i);
+}
+
+/* Four frames at a time: each input channel is gathered in a vector, so
+ * that the matrix is applied with vertical operations only */
+AUDIO_SSE2
+static inline void SSE2_DownmixFl32(float *dst, const float *src, size_t n,
+                                    unsigned in_channels,
+                                    unsigned out_channels,
+                                    const float *matrix)
+{
+    const unsigned ic = in_channels;
+    size_t i = 0;
+
+    if (out_channels <= 2 && ic <= AUDIO_KERNELS_MAX_CHANNELS)
+        for (; i + 4 <= n; i += 4)
+        {
+            const float *s = &src[i * ic];
+            __m128 l = _mm_setzero_ps(), r = _mm_setzero_ps();
+
+            for (unsigned c = 0; c < ic; c++)
+            {
+                __m128 v = _mm_setr_ps(s[c], s[c + ic], s[c + 2 * ic],
+                                       s[c + 3 * ic]);
+                l = _mm_add_ps(l, _mm_mul_ps(v, _mm_set1_ps(matrix[c])));
+                if (out_channels == 2)
+                    r = _mm_add_ps(r, _mm_mul_ps(v,
+                                            _mm_set1_ps(matrix[ic + c])));
+            }
+
+            if (out_channels == 1)
+                _mm_storeu_ps(&dst[i], l);
+            else
+            {
+                _mm_storeu_ps(&dst[2 * i], _mm_unpacklo_ps(l, r));
+                _mm_storeu_ps(&dst[2 * i + 4], _mm_unpackhi_ps(l, r));
+            }
+        }
+    C_DownmixFl32(&dst[i * out_channels], &src[i * ic], n - i, ic,
+                  out_channels, matrix);
+}
+
+/* With 1, 2 or 4 channels, each lane always adds up the same channel.
+ * Otherwise, the vectors are added up every "period" samples, the least
+ * common multiple of the channels and the vector size. */
+AUDIO_SSE2
+static inline void SSE2_FirFl32(float *out, const float *src,
+                                const float *coef, const float *delta,
+                                float frac, size_t n, unsigned channels)
+{
+    if (channels > AUDIO_KERNELS_MAX_CHANNELS)
+    {
+        C_FirFl32(out, src, coef, delta, frac, n, channels);
+        return;
+    }
+
+    const unsigned period = audio_FirPeriod(channels, 4);
+    const __m128 f = _mm_set1_ps(frac);
+    size_t i = 0;
+
+    if (period == 4)
+    {
+        __m128 acc = _mm_setzero_ps();
+
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128 c = _mm_add_ps(_mm_loadu_ps(&coef[i]),
+                                  _mm_mul_ps(f, _mm_loadu_ps(&delta[i])));
+            acc = _mm_add_ps(acc, _mm_mul_ps(c, _mm_loadu_ps(&src[i])));
+        }
+        if (channels < 4)
+            acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        if (channels < 2)
+            acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+
+        float sum[4];
+        _mm_storeu_ps(sum, acc);
+        for (unsigned c = 0; c < channels; c++)
+            out[c] = sum[c];
+    }
+    else
+    {
+        float sum[4 * AUDIO_KERNELS_MAX_CHANNELS];
+        const size_t end = n - n % period;
+
+        for (unsigned a = 0; a < period; a += 4)
+        {
+            __m128 acc = _mm_setzero_ps();
+
+            for (size_t k = a; k < end; k += period)
+            {
+                __m128 c = _mm_add_ps(_mm_loadu_ps(&coef[k]),
+                                      _mm_mul_ps(f, _mm_loadu_ps(&delta[k])));
+                acc = _mm_add_ps(acc, _mm_mul_ps(c, _mm_loadu_ps(&src[k])));
+            }
+            _mm_storeu_ps(&sum[a], acc);
+        }
+        i = end;
+
+        for (unsigned c = 0; c < channels; c++)
+            out[c] = sum[c];
+        for (unsigned k = channels; k < period; k += channels)
+            for (unsigned c = 0; c < channels; c++)
+                out[c] += sum[k + c];
+    }
+
+    if (i < n)
+    {
+        float tail[AUDIO_KERNELS_MAX_CHANNELS];
+
+        C_FirFl32(tail, &src[i], &coef[i], &delta[i], frac, n - i, channels);
+        for (unsigned c = 0; c < channels; c++)
+            out[c] += tail[c];
+    }
+}
+
+/*** AVX2 ***/
+AUDIO_AVX2
+static inline void AVX2_S16toFl32(float *dst, const int16_t *src, size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(1.f / 32768.f);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i a = _mm256_cvtepi16_epi32(
+                        _mm_loadu_si128((const __m128i *)&src[i]));
+        __m256i b = _mm256_cvtepi16_epi32(
+                        _mm_loadu_si128((const __m128i *)&src[i + 8]));
+        _mm256_storeu_ps(&dst[i], _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+        _mm256_storeu_ps(&dst[i + 8],
+                         _mm256_mul_ps(_mm256_cvtepi32_ps(b), scale));
+    }
+    SSE2_S16toFl32(&dst[i], &src[i], n - i);
+}
+
+AUDIO_AVX2
+static inline void AVX2_Fl32toS16(int16_t *dst, const float *src, size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(32768.f);
+    const __m256 max = _mm256_set1_ps(32767.f);
+    const __m256 min = _mm256_set1_ps(-32768.f);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(&src[i]), scale);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(&src[i + 8]), scale);
+        a = _mm256_max_ps(_mm256_min_ps(a, max), min);
+        b = _mm256_max_ps(_mm256_min_ps(b, max), min);
+        /* The packing works within 128-bits lanes */
+        __m256i v = _mm256_packs_epi32(_mm256_cvtps_epi32(a),
+                                       _mm256_cvtps_epi32(b));
+        _mm256_storeu_si256((__m256i *)&dst[i],
+                            _mm256_permute4x64_epi64(v, 0xD8));
+    }
+    SSE2_Fl32toS16(&dst[i], &src[i], n - i);
+}
+
+AUDIO_AVX2
+static inline void AVX2_S32toFl32(float *dst, const int32_t *src, size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(1.f / 2147483648.f);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&src[i]);
+        _mm256_storeu_ps(&dst[i], _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    SSE2_S32toFl32(&dst[i], &src[i], n - i);
+}
+
+AUDIO_AVX2
+static inline void AVX2_Fl32toS32(int32_t *dst, const float *src, size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(2147483648.f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 mhalf = _mm256_set1_ps(-0.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 limit = _mm256_set1_ps(2147483648.f);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 s = _mm256_mul_ps(_mm256_loadu_ps(&src[i]), scale);
+        __m256i r = _mm256_cvtps_epi32(s);
+        __m256 d = _mm256_sub_ps(s, _mm256_cvtepi32_ps(r));
+        __m256 up = _mm256_and_ps(_mm256_cmp_ps(d, half, _CMP_EQ_OQ),
+                                  _mm256_cmp_ps(s, zero, _CMP_GT_OQ));
+        __m256 down = _mm256_and_ps(_mm256_cmp_ps(d, mhalf, _CMP_EQ_OQ),
+                                    _mm256_cmp_ps(s, zero, _CMP_LT_OQ));
+
+        r = _mm256_sub_epi32(r, _mm256_castps_si256(up));
+        r = _mm256_add_epi32(r, _mm256_castps_si256(down));
+        r = _mm256_blendv_epi8(r, _mm256_set1_epi32(INT32_MAX),
+                    _mm256_castps_si256(_mm256_cmp_ps(s, limit, _CMP_GE_OQ)));
+        _mm256_storeu_si256((__m256i *)&dst[i], r);
+    }
+    SSE2_Fl32toS32(&dst[i], &src[i], n - i);
+}
+
+AUDIO_AVX2
+static inline void AVX2_GainFl32(float *p, size_t n, float gain)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm256_storeu_ps(&p[i], _mm256_mul_ps(_mm256_loadu_ps(&p[i]), g));
+        _mm256_storeu_ps(&p[i + 8],
+                         _mm256_mul_ps(_mm256_loadu_ps(&p[i + 8]), g));
+    }
+    SSE2_GainFl32(&p[i], n - i, gain);
+}
+
+AUDIO_AVX2
+static inline void AVX2_GainS16(int16_t *p, size_t n, int16_t gain)
+{
+    const __m256i g = _mm256_set1_epi16(gain);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&p[i]);
+        __m256i l = _mm256_mullo_epi16(v, g), h = _mm256_mulhi_epi16(v, g);
+        /* Unpacking and packing within lanes keeps the order */
+        __m256i lo = _mm256_srai_epi32(_mm256_unpacklo_epi16(l, h), 8);
+        __m256i hi = _mm256_srai_epi32(_mm256_unpackhi_epi16(l, h), 8);
+        _mm256_storeu_si256((__m256i *)&p[i], _mm256_packs_epi32(lo, hi));
+    }
+    SSE2_GainS16(&p[i], n - i, gain);
+}
+
+AUDIO_AVX2
+static inline float AVX2_DotFl32(const float *a, const float *b, size_t n)
+{
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(&a[i]),
+                                             _mm256_loadu_ps(&b[i])));
+        s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(&a[i + 8]),
+                                             _mm256_loadu_ps(&b[i + 8])));
+    }
+    s0 = _mm256_add_ps(s0, s1);
+
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(s0),
+                          _mm256_extractf128_ps(s0, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s) + SSE2_DotFl32(&a[i], &b[i], n - i);
+}
+
+/* Eight frames at a time, the input channels are gathered */
+AUDIO_AVX2
+static inline void AVX2_DownmixFl32(float *dst, const float *src, size_t n,
+                                    unsigned in_channels,
+                                    unsigned out_channels,
+                                    const float *matrix)
+{
+    const unsigned ic = in_channels;
+    const __m256i index = _mm256_mullo_epi32(_mm256_set1_epi32(ic),
+                                    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    size_t i = 0;
+
+    if (out_channels <= 2 && ic <= AUDIO_KERNELS_MAX_CHANNELS)
+        for (; i + 8 <= n; i += 8)
+        {
+            const float *s = &src[i * ic];
+            __m256 l = _mm256_setzero_ps(), r = _mm256_setzero_ps();
+
+            for (unsigned c = 0; c < ic; c++)
+            {
+                __m256 v = _mm256_i32gather_ps(&s[c], index, 4);
+                l = _mm256_add_ps(l, _mm256_mul_ps(v,
+                                            _mm256_set1_ps(matrix[c])));
+                if (out_channels == 2)
+                    r = _mm256_add_ps(r, _mm256_mul_ps(v,
+                                            _mm256_set1_ps(matrix[ic + c])));
+            }
+
+            if (out_channels == 1)
+                _mm256_storeu_ps(&dst[i], l);
+            else
+            {
+                __m256 a = _mm256_unpacklo_ps(l, r); /* frames 0, 1, 4, 5 */
+                __m256 b = _mm256_unpackhi_ps(l, r); /* frames 2, 3, 6, 7 */
+                _mm256_storeu_ps(&dst[2 * i],
+                                 _mm256_permute2f128_ps(a, b, 0x20));
+                _mm256_storeu_ps(&dst[2 * i + 8],
+                                 _mm256_permute2f128_ps(a, b, 0x31));
+            }
+        }
+    SSE2_DownmixFl32(&dst[i * out_channels], &src[i * ic], n - i, ic,
+                     out_channels, matrix);
+}
+
+AUDIO_AVX2
+static inline void AVX2_FirFl32(float *out, const float *src,
+                                const float *coef, const float *delta,
+                                float frac, size_t n, unsigned channels)
+{
+    if (channels > AUDIO_KERNELS_MAX_CHANNELS)
+    {
+        C_FirFl32(out, src, coef, delta, frac, n, channels);
+        return;
+    }
+
+    const unsigned period = audio_FirPeriod(channels, 8);
+    const __m256 f = _mm256_set1_ps(frac);
+    size_t i = 0;
+
+    if (period == 8)
+    {
+        __m256 acc = _mm256_setzero_ps();
+
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 c = _mm256_add_ps(_mm256_loadu_ps(&coef[i]),
+                            _mm256_mul_ps(f, _mm256_loadu_ps(&delta[i])));
+            acc = _mm256_add_ps(acc,
+                            _mm256_mul_ps(c, _mm256_loadu_ps(&src[i])));
+        }
+
+        float sum[8];
+        if (channels < 8)
+        {
+            __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc),
+                                  _mm256_extractf128_ps(acc, 1));
+            if (channels < 4)
+                s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+            if (channels < 2)
+                s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+            _mm_storeu_ps(sum, s);
+        }
+        else
+            _mm256_storeu_ps(sum, acc);
+        for (unsigned c = 0; c < channels; c++)
+            out[c] = sum[c];
+    }
+    else
+    {
+        float sum[8 * AUDIO_KERNELS_MAX_CHANNELS];
+        const size_t end = n - n % period;
+
+        for (unsigned a = 0; a < period; a += 8)
+        {
+            __m256 acc = _mm256_setzero_ps();
+
+            for (size_t k = a; k < end; k += period)
+            {
+                __m256 c = _mm256_add_ps(_mm256_loadu_ps(&coef[k]),
+                            _mm256_mul_ps(f, _mm256_loadu_ps(&delta[k])));
+                acc = _mm256_add_ps(acc,
+                            _mm256_mul_ps(c, _mm256_loadu_ps(&src[k])));
+            }
+            _mm256_storeu_ps(&sum[a], acc);
+        }
+        i = end;
+
+        for (unsigned c = 0; c < channels; c++)
+            out[c] = sum[c];
+        for (unsigned k = channels; k < period; k += channels)
+            for (unsigned c = 0; c < channels; c++)
+                out[c] += sum[k + c];
+    }
+
+    if (i < n)
+    {
+        float tail[AUDIO_KERNELS_MAX_CHANNELS];
+
+        C_FirFl32(tail, &src[i], &coef[i], &delta[i], frac, n - i, channels);
+        for (unsigned c = 0; c < channels; c++)
+            out[c] += tail[c];
+    }
+}
+#endif /* AUDIO_KERNELS_SIMD */
+
+/*** Run-time selection ***/
+#ifdef AUDIO_KERNELS_SIMD
+# define AUDIO_DISPATCH(func, ...) \
+    do { \
+        if (vlc_CPU_AVX2()) \
+            AVX2_##func(__VA_ARGS__); \
+        else if (vlc_CPU_SSE2()) \
+            SSE2_##func(__VA_ARGS__); \
+        else \
+            C_##func(__VA_ARGS__); \
+    } while (0)
+#else
+# define AUDIO_DISPATCH(func, ...) C_##func(__VA_ARGS__)
+#endif
+
+static inline void audio_S16toFl32(float *dst, const int16_t *src, size_t n)
+{
+    AUDIO_DISPATCH(S16toFl32, dst, src, n);
+}
+
+static inline void audio_Fl32toS16(int16_t *dst, const float *src, size_t n)
+{
+    AUDIO_DISPATCH(Fl32toS16, dst, src, n);
+}
+
+static inline void audio_S32toFl32(float *dst, const int32_t *src, size_t n)
+{
+    AUDIO_DISPATCH(S32toFl32, dst, src, n);
+}
+
+static inline void audio_Fl32toS32(int32_t *dst, const float *src, size_t n)
+{
+    AUDIO_DISPATCH(Fl32toS32, dst, src, n);
+}
+
+static inline void audio_GainFl32(float *p, size_t n, float gain)
+{
+    AUDIO_DISPATCH(GainFl32, p, n, gain);
+}
+
+static inline void audio_GainS16(int16_t *p, size_t n, int16_t gain)
+{
+    AUDIO_DISPATCH(GainS16, p, n, gain);
+}
+
+static inline float audio_DotFl32(const float *a, const float *b, size_t n)
+{
+#ifdef AUDIO_KERNELS_SIMD
+    if (vlc_CPU_AVX2())
+        return AVX2_DotFl32(a, b, n);
+    if (vlc_CPU_SSE2())
+        return SSE2_DotFl32(a, b, n);
+#endif
+    return C_DotFl32(a, b, n);
+}
+
+static inline void audio_DownmixFl32(float *dst, const float *src, size_t n,
+                                     unsigned in_channels,
+                                     unsigned out_channels,
+                                     const float *matrix)
+{
+    AUDIO_DISPATCH(DownmixFl32, dst, src, n, in_channels, out_channels,
+                   matrix);
+}
+
+static inline void audio_FirFl32(float *out, const float *src,
+                                 const float *coef, const float *delta,
+                                 float frac, size_t n, unsigned channels)
+{
+    AUDIO_DISPATCH(FirFl32, out, src, coef, delta, frac, n, channels);
+}
+
+#endif
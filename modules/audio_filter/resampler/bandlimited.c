@@ -31,6 +31,12 @@
  * It uses a Kaiser-windowed sinc-function low-pass filter and the width of the
  * filter is 13 samples.
  *
+ * By default, the filter is evaluated once per phase in a bank of
+ * coefficients (polyphase filter), and each output frame is the product of
+ * the input history with the coefficients of its phase. The bank only
+ * depends on the cut-off frequency, so small changes of the rate (clock drift
+ * compensation) neither rebuild it nor reset the history.
+ *
  *****************************************************************************/
 
 #ifdef HAVE_CONFIG_H
@@ -44,8 +50,13 @@
 #include <vlc_block.h>
 
 #include <assert.h>
+#include <math.h>
 
 #include "bandlimited.h"
+#include "../kernels.h"
+
+/* Phases of the polyphase bank: the same resolution as the filter table */
+#define POLYPHASE_PHASES Npc
 
 /*****************************************************************************
  * Local prototypes
@@ -55,6 +66,7 @@
 static int  OpenFilter ( vlc_object_t * );
 static void CloseFilter( vlc_object_t * );
 static block_t *Resample( filter_t *, block_t * );
+static block_t *ResamplePolyphase( filter_t *, block_t * );
 
 static void ResampleFloat( filter_t *p_filter,
                            block_t **pp_out_buf,  size_t *pi_out,
@@ -78,16 +90,32 @@ struct filter_sys_t
     bool b_first;
 
     date_t end_date;
+
+    /* Polyphase filter */
+    float *p_bank;           /* coefficients and deltas to the next phase */
+    double d_bank_scale;     /* time scale of the filter (1 if upsampling) */
+    unsigned i_taps;         /* coefficients per phase and channel */
+    unsigned i_left;         /* taps up to the current input frame */
+
+    float *p_hist;                     /* input frames not yet consumed */
+    size_t i_hist, i_hist_max;
+    double d_pos;              /* position of the next output in p_hist */
 };
 
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
+#define POLYPHASE_TEXT N_("Polyphase filter bank")
+#define POLYPHASE_LONGTEXT N_("Precompute the filter coefficients of each " \
+    "phase. This is much faster, and follows rate changes smoothly.")
+
 vlc_module_begin ()
     set_category( CAT_AUDIO )
     set_subcategory( SUBCAT_AUDIO_MISC )
     set_description( N_("Audio filter for band-limited interpolation resampling") )
     set_capability( "audio converter", 20 )
+    add_bool( "bandlimited-polyphase", true, POLYPHASE_TEXT,
+              POLYPHASE_LONGTEXT, true )
     set_callbacks( OpenFilter, CloseFilter )
 
     add_submodule()
@@ -310,7 +338,18 @@ static int OpenFilter( vlc_object_t *p_this )
 
     p_sys->i_old_wing = 0;
     p_sys->b_first = true;
-    p_filter->pf_audio_filter = Resample;
+
+    p_sys->p_bank = NULL;
+    p_sys->d_bank_scale = 0.;
+    p_sys->i_taps = p_sys->i_left = 0;
+    p_sys->p_hist = NULL;
+    p_sys->i_hist = p_sys->i_hist_max = 0;
+    p_sys->d_pos = 0.;
+
+    if( var_InheritBool( p_filter, "bandlimited-polyphase" ) )
+        p_filter->pf_audio_filter = ResamplePolyphase;
+    else
+        p_filter->pf_audio_filter = Resample;
 
     msg_Dbg( p_this, "%4.4s/%iKHz/%i->%4.4s/%iKHz/%i",
              (char *)&p_filter->fmt_in.i_codec,
@@ -333,9 +372,209 @@ static void CloseFilter( vlc_object_t *p_this )
 {
     filter_t *p_filter = (filter_t *)p_this;
     free( p_filter->p_sys->p_buf );
+    free( p_filter->p_sys->p_bank );
+    free( p_filter->p_sys->p_hist );
     free( p_filter->p_sys );
 }
 
+/*****************************************************************************
+ * Polyphase filter
+ *****************************************************************************/
+
+/* Filter response at t input frames from its center, for a cut-off frequency
+ * scaled by d_scale. The gain is scaled as well, so that it stays 1. */
+static float FilterResponse( double t, double d_scale )
+{
+    double d_index = fabs( t ) * d_scale * Npc;
+    if( d_index >= SMALL_FILTER_NWING - 1 )
+        return 0.f;
+
+    unsigned i = d_index;
+    return ( SMALL_FILTER_FLOAT_IMP[i] +
+             ( d_index - i ) * SMALL_FILTER_FLOAT_IMPD[i] ) * d_scale;
+}
+
+/* The output frame at position n + phase is the product of the input frames
+ * n + 1 - i_left to n + i_taps - i_left with the coefficients of the phase.
+ * Coefficients are repeated for each channel, and the number of taps is
+ * padded so that vectors always cover the same channels. */
+static int BuildBank( filter_sys_t *p_sys, double d_scale, unsigned i_channels )
+{
+    const unsigned i_wing = ceil( (double)SMALL_FILTER_NWING / Npc / d_scale );
+    const unsigned i_align = audio_FirPeriod( i_channels, 8 ) / i_channels;
+    const unsigned i_taps = ( 2 * i_wing + i_align - 1 ) / i_align * i_align;
+    const unsigned i_left = i_taps - i_wing;
+    const size_t i_size = (size_t)i_taps * i_channels;
+
+    float *p_bank = malloc( 2 * POLYPHASE_PHASES * i_size * sizeof(float) );
+    if( unlikely(p_bank == NULL) )
+        return VLC_ENOMEM;
+
+    float next[i_taps];
+    for( unsigned j = 0; j < i_taps; j++ )
+        next[j] = FilterResponse( (double)i_left - 1 - j, d_scale );
+
+    for( unsigned p = 0; p < POLYPHASE_PHASES; p++ )
+    {
+        float *p_coef = p_bank + 2 * p * i_size, *p_delta = p_coef + i_size;
+        const double d_phase = (double)(p + 1) / POLYPHASE_PHASES;
+
+        for( unsigned j = 0; j < i_taps; j++ )
+        {
+            float f_coef = next[j];
+
+            next[j] = FilterResponse( d_phase + i_left - 1 - j, d_scale );
+            for( unsigned c = 0; c < i_channels; c++ )
+            {
+                p_coef[j * i_channels + c] = f_coef;
+                p_delta[j * i_channels + c] = next[j] - f_coef;
+            }
+        }
+    }
+
+    /* Keep the history aligned on the first tap if the filter got longer */
+    if( i_left > p_sys->i_left && p_sys->i_hist > 0 )
+    {
+        size_t i_more = i_left - p_sys->i_left;
+        float *p_hist = realloc( p_sys->p_hist, ( p_sys->i_hist + i_more )
+                                 * i_channels * sizeof(float) );
+        if( unlikely(p_hist == NULL) )
+        {
+            free( p_bank );
+            return VLC_ENOMEM;
+        }
+        memmove( p_hist + i_more * i_channels, p_hist,
+                 p_sys->i_hist * i_channels * sizeof(float) );
+        memset( p_hist, 0, i_more * i_channels * sizeof(float) );
+        p_sys->p_hist = p_hist;
+        p_sys->i_hist += i_more;
+        p_sys->i_hist_max = p_sys->i_hist;
+        p_sys->d_pos += i_more;
+    }
+
+    free( p_sys->p_bank );
+    p_sys->p_bank = p_bank;
+    p_sys->d_bank_scale = d_scale;
+    p_sys->i_taps = i_taps;
+    p_sys->i_left = i_left;
+    return VLC_SUCCESS;
+}
+
+static block_t *ResamplePolyphase( filter_t *p_filter, block_t *p_in_buf )
+{
+    if( !p_in_buf || !p_in_buf->i_nb_samples )
+    {
+        if( p_in_buf )
+            block_Release( p_in_buf );
+        return NULL;
+    }
+
+    filter_sys_t *p_sys = p_filter->p_sys;
+    const unsigned i_in_rate = p_filter->fmt_in.audio.i_rate;
+    const unsigned i_out_rate = p_filter->fmt_out.audio.i_rate;
+    const unsigned i_channels = aout_FormatNbChannels( &p_filter->fmt_in.audio );
+    const bool b_reset = (p_in_buf->i_flags & BLOCK_FLAG_DISCONTINUITY)
+                      || p_sys->b_first;
+
+    /* Narrow the filter when downsampling. Rate changes within 1% (clock
+     * drift compensation) keep the current bank. */
+    double d_scale = __MIN( 1., (double)i_out_rate / i_in_rate );
+    if( p_sys->p_bank == NULL || d_scale < p_sys->d_bank_scale * 0.99
+     || d_scale > p_sys->d_bank_scale * 1.01 )
+    {
+        if( d_scale > 0.99 )
+            d_scale = 1.;
+        if( BuildBank( p_sys, d_scale, i_channels ) )
+        {
+            block_Release( p_in_buf );
+            return NULL;
+        }
+    }
+
+    if( b_reset )
+    {
+        /* Start with silence before the first input frame */
+        p_sys->i_hist = 0;
+        p_sys->d_pos = p_sys->i_left - 1;
+        date_Init( &p_sys->end_date, i_out_rate, 1 );
+        date_Set( &p_sys->end_date, p_in_buf->i_pts );
+        p_sys->b_first = false;
+    }
+
+    /* Append the input to the history */
+    const size_t i_lead = b_reset ? p_sys->i_left - 1 : 0;
+    const size_t i_hist = p_sys->i_hist + i_lead + p_in_buf->i_nb_samples;
+    if( i_hist > p_sys->i_hist_max )
+    {
+        float *p_hist = realloc( p_sys->p_hist,
+                                 i_hist * i_channels * sizeof(float) );
+        if( unlikely(p_hist == NULL) )
+        {
+            block_Release( p_in_buf );
+            return NULL;
+        }
+        p_sys->p_hist = p_hist;
+        p_sys->i_hist_max = i_hist;
+    }
+    memset( p_sys->p_hist + p_sys->i_hist * i_channels, 0,
+            i_lead * i_channels * sizeof(float) );
+    memcpy( p_sys->p_hist + ( p_sys->i_hist + i_lead ) * i_channels,
+            p_in_buf->p_buffer, p_in_buf->i_nb_samples * i_channels
+                                * sizeof(float) );
+    p_sys->i_hist = i_hist;
+    block_Release( p_in_buf );
+
+    /* Output frames need i_taps - i_left frames after their position */
+    const double d_step = (double)i_in_rate / i_out_rate;
+    const double d_end = (double)p_sys->i_hist - p_sys->i_taps
+                       + p_sys->i_left;
+    size_t i_out_max = 0;
+    if( p_sys->d_pos < d_end )
+        i_out_max = ceil( ( d_end - p_sys->d_pos ) / d_step ) + 1;
+
+    block_t *p_out_buf = block_Alloc( i_out_max * i_channels * sizeof(float) );
+    if( unlikely(p_out_buf == NULL) )
+        return NULL;
+    if( b_reset )
+        p_out_buf->i_flags |= BLOCK_FLAG_DISCONTINUITY;
+
+    const size_t i_size = (size_t)p_sys->i_taps * i_channels;
+    float *p_out = (float *)p_out_buf->p_buffer;
+    double d_pos = p_sys->d_pos;
+    size_t i_out = 0;
+
+    for( ; d_pos < d_end && i_out < i_out_max; i_out++ )
+    {
+        const size_t i_frame = d_pos;
+        const float f_phase = ( d_pos - i_frame ) * POLYPHASE_PHASES;
+        const unsigned i_phase = __MIN( (unsigned)f_phase,
+                                        POLYPHASE_PHASES - 1 );
+        const float *p_coef = p_sys->p_bank + 2 * i_phase * i_size;
+
+        audio_FirFl32( p_out, p_sys->p_hist + ( i_frame + 1 - p_sys->i_left )
+                                              * i_channels,
+                       p_coef, p_coef + i_size, f_phase - i_phase, i_size,
+                       i_channels );
+        p_out += i_channels;
+        d_pos += d_step;
+    }
+
+    /* Forget the frames no output frame will need any more */
+    size_t i_drop = __MIN( (size_t)d_pos + 1 - p_sys->i_left, p_sys->i_hist );
+    memmove( p_sys->p_hist, p_sys->p_hist + i_drop * i_channels,
+             ( p_sys->i_hist - i_drop ) * i_channels * sizeof(float) );
+    p_sys->i_hist -= i_drop;
+    p_sys->d_pos = d_pos - i_drop;
+
+    p_out_buf->i_nb_samples = i_out;
+    p_out_buf->i_buffer = i_out * i_channels * sizeof(float);
+    p_out_buf->i_dts =
+    p_out_buf->i_pts = date_Get( &p_sys->end_date );
+    p_out_buf->i_length = date_Increment( &p_sys->end_date, i_out )
+                        - p_out_buf->i_pts;
+    return p_out_buf;
+}
+
 static void FilterFloatUP( const float Imp[], const float ImpD[], uint16_t Nwing, float *p_in,
                             float *p_out, uint32_t ui_remainder,
                             uint32_t ui_output_rate, int16_t Inc, int i_nb_channels )
@@ -35,6 +35,9 @@
 
 #include <string.h> /* for memset */
 #include <limits.h> /* form INT_MIN */
+#include <math.h>
+
+#include "kernels.h"
 
 /*****************************************************************************
  * Module descriptor
@@ -43,6 +46,14 @@ static int  Open( vlc_object_t * );
 static void Close( vlc_object_t * );
 static block_t *DoWork( filter_t *, block_t * );
 
+enum { SEARCH_AUTO, SEARCH_DIRECT, SEARCH_FFT };
+static const int search_mode_values[] = {
+    SEARCH_AUTO, SEARCH_DIRECT, SEARCH_FFT,
+};
+static const char *const search_mode_texts[] = {
+    N_("Automatic"), N_("Direct"), N_("FFT"),
+};
+
 vlc_module_begin ()
     set_description( N_("Audio tempo scaler synched with rate") )
     set_shortname( N_("Scaletempo") )
@@ -56,6 +67,11 @@ vlc_module_begin ()
         N_("Overlap Length"), N_("Percentage of stride to overlap"), true )
     add_integer_with_range( "scaletempo-search", 14, 0, 200,
         N_("Search Length"), N_("Length in milliseconds to search for best overlap position"), true )
+    add_integer( "scaletempo-search-mode", SEARCH_AUTO,
+        N_("Search Method"), N_("Cross correlation method used to search for the best overlap position: dot products at each position, or FFT, which is faster with long overlaps and searches"), true )
+        change_integer_list( search_mode_values, search_mode_texts )
+    add_bool( "scaletempo-wsola", false,
+        N_("WSOLA Quality Mode"), N_("Normalize the correlation by the energy at each position, and cross-fade with a raised cosine. This sounds better on transients, at some CPU cost"), true )
 
     set_callbacks( Open, Close )
 vlc_module_end ()
@@ -70,6 +86,8 @@ vlc_module_end ()
  * Scaletempo smooths the overlap further by searching within the input buffer
  * for the best overlap position.  Scaletempo uses a statistical cross correlation
  * (roughly a dot-product).  Scaletempo consumes most of its CPU cycles here.
+ * With long overlaps and searches, the correlations at all positions are
+ * computed at once with FFTs, one per pair of channels.
  *
  * NOTE:
  * sample: a single audio sample for one channel
@@ -110,44 +128,230 @@ struct filter_sys_t
     unsigned  frames_search;
     void     *buf_pre_corr;
     void     *table_window;
+    float    *buf_corr;
     unsigned(*best_overlap_offset)( filter_t *p_filter );
+    int       search_mode;
+    bool      b_wsola;
+    /* FFT correlation */
+    unsigned  fft_size;
+    float    *fft_buf;
+    float    *fft_twiddle;
+    unsigned *fft_bitrev;
 };
 
 /*****************************************************************************
  * best_overlap_offset: calculate best offset for overlap
  *****************************************************************************/
-static unsigned best_overlap_offset_float( filter_t *p_filter )
+static void compute_pre_corr( filter_sys_t *p )
 {
-    filter_sys_t *p = p_filter->p_sys;
-    float *pw, *po, *ppc, *search_start;
+    float *pw  = p->table_window;
+    float *po  = (float *)p->buf_overlap + p->samples_per_frame;
+    float *ppc = p->buf_pre_corr;
+    for( unsigned i = p->samples_per_frame; i < p->samples_overlap; i++ ) {
+      *ppc++ = *pw++ * *po++;
+    }
+}
+
+static unsigned pick_best_offset( filter_sys_t *p )
+{
+    const float *corr = p->buf_corr;
     float best_corr = INT_MIN;
     unsigned best_off = 0;
-    unsigned i, off;
 
-    pw  = p->table_window;
-    po  = p->buf_overlap;
-    po += p->samples_per_frame;
-    ppc = p->buf_pre_corr;
-    for( i = p->samples_per_frame; i < p->samples_overlap; i++ ) {
-      *ppc++ = *pw++ * *po++;
+    if( p->b_wsola )
+    {   /* Energy of the input at each position, updated frame by frame */
+        const unsigned samples_corr = p->samples_overlap - p->samples_per_frame;
+        const float *ps = (float *)p->buf_queue + p->samples_per_frame;
+        double energy = 0.;
+        for( unsigned i = 0; i < samples_corr; i++ )
+            energy += ps[i] * ps[i];
+
+        for( unsigned off = 0; off < p->frames_search; off++ ) {
+          float c = corr[off] / sqrt( __MAX( energy, 0. ) + 1e-9 );
+          if( c > best_corr ) {
+            best_corr = c;
+            best_off  = off;
+          }
+          for( unsigned j = 0; j < p->samples_per_frame; j++ ) {
+            energy += ps[samples_corr + j] * ps[samples_corr + j]
+                    - ps[j] * ps[j];
+          }
+          ps += p->samples_per_frame;
+        }
+    }
+    else
+    {
+        for( unsigned off = 0; off < p->frames_search; off++ ) {
+          if( corr[off] > best_corr ) {
+            best_corr = corr[off];
+            best_off  = off;
+          }
+        }
     }
 
-    search_start = (float *)p->buf_queue + p->samples_per_frame;
-    for( off = 0; off < p->frames_search; off++ ) {
-      float corr = 0;
-      float *ps = search_start;
-      ppc = p->buf_pre_corr;
-      for( i = p->samples_per_frame; i < p->samples_overlap; i++ ) {
-        corr += *ppc++ * *ps++;
-      }
-      if( corr > best_corr ) {
-        best_corr = corr;
-        best_off  = off;
-      }
+    return best_off * p->bytes_per_frame;
+}
+
+static unsigned best_overlap_offset_float( filter_t *p_filter )
+{
+    filter_sys_t *p = p_filter->p_sys;
+    const unsigned samples_corr = p->samples_overlap - p->samples_per_frame;
+    float *search_start = (float *)p->buf_queue + p->samples_per_frame;
+
+    compute_pre_corr( p );
+    for( unsigned off = 0; off < p->frames_search; off++ ) {
+      p->buf_corr[off] = audio_DotFl32( p->buf_pre_corr, search_start,
+                                        samples_corr );
       search_start += p->samples_per_frame;
     }
 
-    return best_off * p->bytes_per_frame;
+    return pick_best_offset( p );
+}
+
+/*****************************************************************************
+ * fft: in place radix-2 complex FFT, real and imaginary parts apart
+ *****************************************************************************/
+static int fft_init( filter_sys_t *p, unsigned frames )
+{
+    unsigned n = 4;
+    while( n < frames )
+        n <<= 1;
+
+    p->fft_size    = n;
+    p->fft_buf     = malloc( 6 * n * sizeof(float) );
+    p->fft_twiddle = malloc( 2 * n * sizeof(float) );
+    p->fft_bitrev  = malloc( n * sizeof(unsigned) );
+    if( !p->fft_buf || !p->fft_twiddle || !p->fft_bitrev )
+        return VLC_ENOMEM;
+
+    /* The twiddles of the butterflies of size 2h are at [h, 2h) */
+    for( unsigned h = 1; h < n; h <<= 1 )
+        for( unsigned k = 0; k < h; k++ )
+        {
+            p->fft_twiddle[h + k]     =  cos( M_PI * k / h );
+            p->fft_twiddle[n + h + k] = -sin( M_PI * k / h );
+        }
+    for( unsigned i = 0; i < n; i++ )
+    {
+        unsigned r = 0;
+        for( unsigned b = 1; b < n; b <<= 1 )
+            r = (r << 1) | !!(i & b);
+        p->fft_bitrev[i] = r;
+    }
+    return VLC_SUCCESS;
+}
+
+static void fft_butterflies( float *restrict ar, float *restrict ai,
+                             float *restrict br, float *restrict bi,
+                             const float *restrict wr,
+                             const float *restrict wi, unsigned h )
+{
+    for( unsigned k = 0; k < h; k++ )
+    {
+        float tr = br[k] * wr[k] - bi[k] * wi[k];
+        float ti = br[k] * wi[k] + bi[k] * wr[k];
+        br[k] = ar[k] - tr; bi[k] = ai[k] - ti;
+        ar[k] += tr;        ai[k] += ti;
+    }
+}
+
+/* The inverse transform (without the 1/n scale) is the transform with the
+ * real and imaginary parts swapped. */
+static void fft( const filter_sys_t *p, float *re, float *im )
+{
+    const unsigned n = p->fft_size;
+
+    for( unsigned i = 0; i < n; i++ )
+    {
+        unsigned j = p->fft_bitrev[i];
+        if( i < j )
+        {
+            float r = re[i], m = im[i];
+            re[i] = re[j]; im[i] = im[j];
+            re[j] = r;     im[j] = m;
+        }
+    }
+
+    /* The first two passes have trivial twiddles (1 and -i) */
+    for( unsigned i = 0; i + 4 <= n; i += 4 )
+    {
+        float *r = re + i, *m = im + i;
+        float r0 = r[0] + r[1], m0 = m[0] + m[1];
+        float r1 = r[0] - r[1], m1 = m[0] - m[1];
+        float r2 = r[2] + r[3], m2 = m[2] + m[3];
+        float r3 = r[2] - r[3], m3 = m[2] - m[3];
+
+        r[0] = r0 + r2; m[0] = m0 + m2;
+        r[2] = r0 - r2; m[2] = m0 - m2;
+        r[1] = r1 + m3; m[1] = m1 - r3;
+        r[3] = r1 - m3; m[3] = m1 + r3;
+    }
+
+    for( unsigned h = 4; h < n; h <<= 1 )
+    {
+        const float *wr = p->fft_twiddle + h, *wi = p->fft_twiddle + n + h;
+
+        for( unsigned i = 0; i < n; i += 2 * h )
+            fft_butterflies( re + i, im + i, re + i + h, im + i + h,
+                             wr, wi, h );
+    }
+}
+
+/* Channels c and c + 1 are the real and imaginary parts of one transform,
+ * and are separated with the symmetries of real signal spectrums. */
+static void fft_load( const filter_sys_t *p, float *re, float *im,
+                      const float *src, unsigned frames, unsigned c )
+{
+    const unsigned ch = p->samples_per_frame;
+    const unsigned n = p->fft_size;
+
+    for( unsigned f = 0; f < frames; f++ )
+        re[f] = src[f * ch + c];
+    if( c + 1 < ch )
+        for( unsigned f = 0; f < frames; f++ )
+            im[f] = src[f * ch + c + 1];
+    else
+        memset( im, 0, frames * sizeof(float) );
+    memset( re + frames, 0, (n - frames) * sizeof(float) );
+    memset( im + frames, 0, (n - frames) * sizeof(float) );
+    fft( p, re, im );
+}
+
+static unsigned best_overlap_offset_fft( filter_t *p_filter )
+{
+    filter_sys_t *p = p_filter->p_sys;
+    const unsigned ch = p->samples_per_frame;
+    const unsigned n = p->fft_size;
+    const unsigned frames_corr = p->samples_overlap / ch - 1;
+    float *ar = p->fft_buf, *ai = ar + n, *br = ai + n, *bi = br + n;
+    float *sr = bi + n, *si = sr + n;
+
+    compute_pre_corr( p );
+    memset( sr, 0, 2 * n * sizeof(float) );
+
+    for( unsigned c = 0; c < ch; c += 2 )
+    {
+        fft_load( p, ar, ai, p->buf_pre_corr, frames_corr, c );
+        fft_load( p, br, bi, (float *)p->buf_queue + ch,
+                  p->frames_search + frames_corr - 1, c );
+
+        /* S += conj(A) * B for both channels, four times over */
+        for( unsigned k = 0; k < n; k++ )
+        {
+            unsigned nk = (n - k) & (n - 1);
+            float a1r = ar[k] + ar[nk], a1i = ai[k] - ai[nk];
+            float a2r = ai[k] + ai[nk], a2i = ar[nk] - ar[k];
+            float b1r = br[k] + br[nk], b1i = bi[k] - bi[nk];
+            float b2r = bi[k] + bi[nk], b2i = br[nk] - br[k];
+
+            sr[k] += a1r * b1r + a1i * b1i + a2r * b2r + a2i * b2i;
+            si[k] += a1r * b1i - a1i * b1r + a2r * b2i - a2i * b2r;
+        }
+    }
+    fft( p, si, sr ); /* inverse: the correlations are in the real parts */
+
+    memcpy( p->buf_corr, sr, p->frames_search * sizeof(float) );
+    return pick_best_offset( p );
 }
 
 /*****************************************************************************
@@ -310,7 +514,8 @@ static int reinit_buffers( filter_t *p_filter )
         float t = (float)frames_overlap;
         for( i = 0; i<frames_overlap; i++ )
         {
-            float v = i / t;
+            float v = p->b_wsola ? ( 1.f - cosf( M_PI * i / t ) ) / 2.f
+                                 : i / t;
             for( j = 0; j < p->samples_per_frame; j++ )
                 *pb++ = v;
         }
@@ -328,7 +533,8 @@ static int reinit_buffers( filter_t *p_filter )
         unsigned bytes_pre_corr = ( p->samples_overlap - p->samples_per_frame ) * 4; /* sizeof (int32|float) */
         p->buf_pre_corr = malloc( bytes_pre_corr );
         p->table_window = malloc( bytes_pre_corr );
-        if( ! p->buf_pre_corr || ! p->table_window )
+        p->buf_corr     = malloc( p->frames_search * sizeof(float) );
+        if( ! p->buf_pre_corr || ! p->table_window || ! p->buf_corr )
             return VLC_ENOMEM;
         float *pw = p->table_window;
         for( i = 1; i<frames_overlap; i++ )
@@ -337,7 +543,32 @@ static int reinit_buffers( filter_t *p_filter )
             for( j = 0; j < p->samples_per_frame; j++ )
                 *pw++ = v;
         }
-        p->best_overlap_offset = best_overlap_offset_float;
+
+        /* The FFT costs about 5 n log2(n) operations per transform, and
+         * there are two transforms per pair of channels plus one. */
+        unsigned frames_fft = p->frames_search + frames_overlap - 2;
+        unsigned n = 4, log2n = 2;
+        while( n < frames_fft ) {
+            n <<= 1;
+            log2n++;
+        }
+        uint64_t cost_direct = (uint64_t)p->frames_search
+                             * ( p->samples_overlap - p->samples_per_frame );
+        uint64_t cost_fft = 5 * (uint64_t)n * log2n
+                          * ( 2 * ( ( p->samples_per_frame + 1 ) / 2 ) + 1 );
+#ifdef AUDIO_KERNELS_SIMD
+        cost_fft *= 2; /* the dot products are vectorized, the FFT is not */
+#endif
+
+        if( p->search_mode == SEARCH_FFT ||
+            ( p->search_mode == SEARCH_AUTO && cost_fft < cost_direct ) )
+        {
+            if( fft_init( p, frames_fft ) )
+                return VLC_ENOMEM;
+            p->best_overlap_offset = best_overlap_offset_fft;
+        }
+        else
+            p->best_overlap_offset = best_overlap_offset_float;
     }
 
     unsigned new_size = ( p->frames_search + frames_stride + frames_overlap ) * p->bytes_per_frame;
@@ -367,15 +598,16 @@ static int reinit_buffers( filter_t *p_filter )
     p->frames_stride_scaled = p->bytes_stride_scaled / p->bytes_per_frame;
 
     msg_Dbg( VLC_OBJECT(p_filter),
-             "%.3f scale, %.3f stride_in, %i stride_out, %i standing, %i overlap, %i search, %i queue, %s mode",
+             "%.3f scale, %.3f stride_in, %i stride_out, %i standing, %i overlap, %i search (%s), %i queue, %s mode%s",
              p->scale,
              p->frames_stride_scaled,
              (int)( p->bytes_stride / p->bytes_per_frame ),
              (int)( p->bytes_standing / p->bytes_per_frame ),
              (int)( p->bytes_overlap / p->bytes_per_frame ),
              p->frames_search,
+             p->best_overlap_offset == best_overlap_offset_fft ? "fft" : "direct",
              (int)( p->bytes_queue_max / p->bytes_per_frame ),
-             "fl32");
+             "fl32", p->b_wsola ? ", wsola" : "" );
 
     return VLC_SUCCESS;
 }
@@ -407,6 +639,8 @@ static int Open( vlc_object_t *p_this )
     p_sys->ms_stride       = var_InheritInteger( p_this, "scaletempo-stride" );
     p_sys->percent_overlap = var_InheritFloat( p_this, "scaletempo-overlap" );
     p_sys->ms_search       = var_InheritInteger( p_this, "scaletempo-search" );
+    p_sys->search_mode     = var_InheritInteger( p_this, "scaletempo-search-mode" );
+    p_sys->b_wsola         = var_InheritBool( p_this, "scaletempo-wsola" );
 
     msg_Dbg( p_this, "params: %i stride, %.3f overlap, %i search",
              p_sys->ms_stride, p_sys->percent_overlap, p_sys->ms_search );
@@ -416,6 +650,10 @@ static int Open( vlc_object_t *p_this )
     p_sys->table_blend    = NULL;
     p_sys->buf_pre_corr   = NULL;
     p_sys->table_window   = NULL;
+    p_sys->buf_corr       = NULL;
+    p_sys->fft_buf        = NULL;
+    p_sys->fft_twiddle    = NULL;
+    p_sys->fft_bitrev     = NULL;
     p_sys->bytes_overlap  = 0;
     p_sys->bytes_queued   = 0;
     p_sys->bytes_to_slide = 0;
@@ -442,6 +680,10 @@ static void Close( vlc_object_t *p_this )
     free( p_sys->table_blend );
     free( p_sys->buf_pre_corr );
     free( p_sys->table_window );
+    free( p_sys->buf_corr );
+    free( p_sys->fft_buf );
+    free( p_sys->fft_twiddle );
+    free( p_sys->fft_bitrev );
     free( p_sys );
 }
 
@@ -30,6 +30,8 @@
 #include <vlc_aout.h>
 #include <vlc_aout_volume.h>
 
+#include "../audio_filter/kernels.h"
+
 static int Activate (vlc_object_t *);
 
 vlc_module_begin ()
@@ -69,6 +71,12 @@ static void FilterS16N (audio_volume_t *vol, block_t *block, float volume)
     if (mult == (1 << 8))
         return;
 
+    if (mult <= INT16_MAX)
+    {
+        audio_GainS16 (p, block->i_buffer / sizeof (*p), mult);
+        return;
+    }
+
     for (size_t n = block->i_buffer / sizeof (*p); n > 0; n--)
     {
         int_fast32_t s = (*p * (int_fast32_t)mult) >> 8;
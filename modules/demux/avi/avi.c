@@ -42,9 +42,12 @@
 #include <vlc_codecs.h>
 #include <vlc_charset.h>
 #include <vlc_memory.h>
+#include <vlc_atomic.h>
+#include <vlc_fs.h>
 
 #include "libavi.h"
 #include "../rawdv.h"
+#include "../index_cache.h"
 
 /*****************************************************************************
  * Module descriptor
@@ -57,18 +60,25 @@
     "Recreate a index for the AVI file. Use this if your AVI file is damaged "\
     "or incomplete (not seekable)." )
 
+#define INDEX_CACHE_TEXT N_("Cache generated index")
+#define INDEX_CACHE_LONGTEXT N_( \
+    "Store the index recreated for damaged AVI files in the user cache " \
+    "directory, so that it does not need to be rebuilt the next time the " \
+    "same file is opened." )
+
 #define BI_RAWRGB 0x00
 #define BI_RGBBITFIELDS 0x03
 
 static int  Open ( vlc_object_t * );
 static void Close( vlc_object_t * );
 
-static const int pi_index[] = {0,1,2,3};
+static const int pi_index[] = {0,1,2,3,4};
 
 static const char *const ppsz_indexes[] = { N_("Ask for action"),
                                             N_("Always fix"),
                                             N_("Never fix"),
-                                            N_("Fix when necessary")};
+                                            N_("Fix when necessary"),
+                                            N_("Fix in background")};
 
 vlc_module_begin ()
     set_shortname( "AVI" )
@@ -82,6 +92,8 @@ vlc_module_begin ()
     add_integer( "avi-index", 0,
               INDEX_TEXT, INDEX_LONGTEXT, false )
         change_integer_list( pi_index, ppsz_indexes )
+    add_bool( "avi-index-cache", true,
+              INDEX_CACHE_TEXT, INDEX_CACHE_LONGTEXT, true )
 
     set_callbacks( Open, Close )
 vlc_module_end ()
@@ -136,6 +148,33 @@ static void avi_index_Init( avi_index_t * );
 static void avi_index_Clean( avi_index_t * );
 static void avi_index_Append( avi_index_t *, off_t *, avi_entry_t * );
 
+/* Index built by a low priority thread, on its own stream, while the demuxer
+ * is already playing. The entries found so far are published regularly and
+ * merged into the tracks index by the demuxer when seeking. */
+typedef struct
+{
+    vlc_thread_t    thread;
+    stream_t        *s;
+    unsigned int    i_track;
+
+    off_t           i_movi_pos;
+    off_t           i_movi_end;
+    off_t           i_riffx_pos;
+
+    /* owned by the thread */
+    avi_index_t     *idx;
+    off_t           i_last_pos;
+    unsigned int    i_scanned;
+
+    /* entries published by the thread, not merged yet */
+    vlc_mutex_t     lock;
+    avi_index_t     *pending;
+
+    bool            b_complete;
+    atomic_bool     b_stop;
+    atomic_bool     b_done;
+} avi_index_builder_t;
+
 typedef struct
 {
     bool            b_activated;
@@ -194,6 +233,9 @@ struct demux_sys_t
 
     unsigned int       i_attachment;
     input_attachment_t **attachment;
+
+    /* background index creation */
+    avi_index_builder_t *p_builder;
 };
 
 static inline off_t __EVEN( off_t i )
@@ -216,13 +258,23 @@ static int AVI_StreamBytesSet ( demux_t *,
 vlc_fourcc_t AVI_FourccGetCodec( unsigned int i_cat, vlc_fourcc_t );
 static int   AVI_GetKeyFlag    ( vlc_fourcc_t , uint8_t * );
 
-static int AVI_PacketGetHeader( demux_t *, avi_packet_t *p_pk );
-static int AVI_PacketNext     ( demux_t * );
+typedef bool (*avi_scan_continue_t)( void *, stream_t * );
+
+static int AVI_PacketGetHeader( stream_t *, avi_packet_t *p_pk );
+static int AVI_PacketNext     ( stream_t * );
 static int AVI_PacketRead     ( demux_t *, avi_packet_t *, block_t **);
-static int AVI_PacketSearch   ( demux_t * );
+static int AVI_PacketSearch   ( stream_t *, unsigned int i_track,
+                                avi_scan_continue_t, void * );
+static bool AVI_DemuxAlive    ( void *, stream_t * );
 
 static void AVI_IndexLoad    ( demux_t * );
-static void AVI_IndexCreate  ( demux_t * );
+static bool AVI_IndexCreate  ( demux_t * );
+
+static int  AVI_IndexCacheLoad ( demux_t *, bool b_probe );
+static void AVI_IndexCacheStore( demux_t * );
+
+static int  AVI_IndexBuilderStart ( demux_t * );
+static bool AVI_IndexBuilderFinish( demux_t *, bool b_abort );
 
 static void AVI_ExtractSubtitle( demux_t *, unsigned int i_stream, avi_chunk_list_t *, avi_chunk_STRING_t * );
 
@@ -688,7 +740,9 @@ static int Open( vlc_object_t * p_this )
 aviindex:
         if( p_sys->b_fastseekable )
         {
-            AVI_IndexCreate( p_demux );
+            if( AVI_IndexCacheLoad( p_demux, false ) &&
+                AVI_IndexCreate( p_demux ) )
+                AVI_IndexCacheStore( p_demux );
         }
         else
         {
@@ -722,13 +776,19 @@ aviindex:
 
         msg_Warn( p_demux, "broken or missing index, 'seek' will be "
                            "approximative or will exhibit strange behavior" );
-        if( (i_do_index == 0 || i_do_index == 3) && !b_index )
+        if( (i_do_index == 0 || i_do_index >= 3) && !b_index )
         {
-            if( !p_sys->b_fastseekable ) {
+            if( !p_sys->b_fastseekable ||
+                !AVI_IndexCacheLoad( p_demux, true ) ) {
                 b_index = true;
                 goto aviindex;
             }
-            if( i_do_index == 0 )
+            if( i_do_index == 4 )
+            {
+                if( AVI_IndexBuilderStart( p_demux ) )
+                    msg_Warn( p_demux, "cannot create index in background" );
+            }
+            else if( i_do_index == 0 )
             {
                 switch( dialog_Question( p_demux, _("Broken or missing AVI Index") ,
                    _( "Because this AVI file index is broken or missing, "
@@ -809,6 +869,8 @@ aviindex:
     return VLC_SUCCESS;
 
 error:
+    AVI_IndexBuilderFinish( p_demux, true );
+
     for( unsigned i = 0; i < p_sys->i_attachment; i++)
         vlc_input_attachment_Delete(p_sys->attachment[i]);
     free(p_sys->attachment);
@@ -829,6 +891,8 @@ static void Close ( vlc_object_t * p_this )
     demux_t *    p_demux = (demux_t *)p_this;
     demux_sys_t *p_sys = p_demux->p_sys  ;
 
+    AVI_IndexBuilderFinish( p_demux, true );
+
     for( unsigned int i = 0; i < p_sys->i_track; i++ )
     {
         if( p_sys->track[i] )
@@ -1092,7 +1156,7 @@ static int Demux_Seekable( demux_t *p_demux )
             if( p_sys->b_seekable && p_sys->i_movi_lastchunk_pos >= p_sys->i_movi_begin + 12 )
             {
                 stream_Seek( p_demux->s, p_sys->i_movi_lastchunk_pos );
-                if( AVI_PacketNext( p_demux ) )
+                if( AVI_PacketNext( p_demux->s ) )
                 {
                     return( AVI_TrackStopFinishedStreams( p_demux ) ? 0 : 1 );
                 }
@@ -1106,7 +1170,7 @@ static int Demux_Seekable( demux_t *p_demux )
             {
                 avi_packet_t avi_pk;
 
-                if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+                if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
                 {
                     msg_Warn( p_demux,
                              "cannot get packet header, track disabled" );
@@ -1115,7 +1179,7 @@ static int Demux_Seekable( demux_t *p_demux )
                 if( avi_pk.i_stream >= p_sys->i_track ||
                     ( avi_pk.i_cat != AUDIO_ES && avi_pk.i_cat != VIDEO_ES ) )
                 {
-                    if( AVI_PacketNext( p_demux ) )
+                    if( AVI_PacketNext( p_demux->s ) )
                     {
                         msg_Warn( p_demux,
                                   "cannot skip packet, track disabled" );
@@ -1157,7 +1221,7 @@ static int Demux_Seekable( demux_t *p_demux )
                     }
                     else
                     {
-                        if( AVI_PacketNext( p_demux ) )
+                        if( AVI_PacketNext( p_demux->s ) )
                         {
                             msg_Warn( p_demux,
                                       "cannot skip packet, track disabled" );
@@ -1337,7 +1401,7 @@ static int Demux_UnSeekable( demux_t *p_demux )
 
         avi_packet_t    avi_pk;
 
-        if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+        if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
         {
             return( 0 );
         }
@@ -1354,17 +1418,18 @@ static int Demux_UnSeekable( demux_t *p_demux )
                 case AVIFOURCC_JUNK:
                 case AVIFOURCC_LIST:
                 case AVIFOURCC_RIFF:
-                    return( !AVI_PacketNext( p_demux ) ? 1 : 0 );
+                    return( !AVI_PacketNext( p_demux->s ) ? 1 : 0 );
                 case AVIFOURCC_idx1:
                     if( p_sys->b_odml )
                     {
-                        return( !AVI_PacketNext( p_demux ) ? 1 : 0 );
+                        return( !AVI_PacketNext( p_demux->s ) ? 1 : 0 );
                     }
                     return( 0 );    /* eof */
                 default:
                     msg_Warn( p_demux,
                               "seems to have lost position, resync" );
-                    if( AVI_PacketSearch( p_demux ) )
+                    if( AVI_PacketSearch( p_demux->s, p_sys->i_track,
+                                          AVI_DemuxAlive, p_demux ) )
                     {
                         msg_Err( p_demux, "resync failed" );
                         return( -1 );
@@ -1399,7 +1464,7 @@ static int Demux_UnSeekable( demux_t *p_demux )
             }
             else
             {
-                if( AVI_PacketNext( p_demux ) )
+                if( AVI_PacketNext( p_demux->s ) )
                 {
                     return( 0 );
                 }
@@ -1439,6 +1504,11 @@ static int Seek( demux_t *p_demux, mtime_t i_date, int i_percent )
     {
         int64_t i_pos_backup = stream_Tell( p_demux->s );
 
+        /* Use the part of the index created in background so far */
+        if( AVI_IndexBuilderFinish( p_demux, false ) )
+            p_sys->i_length = __MAX( p_sys->i_length,
+                                     AVI_MovieGetLength( p_demux ) );
+
         /* Check and lazy load indexes if it was not done (not fastseekable) */
         if ( !p_sys->b_indexloaded && ( p_sys->i_avih_flags & AVIF_HASINDEX ) )
         {
@@ -1761,7 +1831,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
     if( p_sys->i_movi_lastchunk_pos >= p_sys->i_movi_begin + 12 )
     {
         stream_Seek( p_demux->s, p_sys->i_movi_lastchunk_pos );
-        if( AVI_PacketNext( p_demux ) )
+        if( AVI_PacketNext( p_demux->s ) )
         {
             return VLC_EGENERIC;
         }
@@ -1775,7 +1845,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
     {
         if( !vlc_object_alive (p_demux) ) return VLC_EGENERIC;
 
-        if( AVI_PacketGetHeader( p_demux, &avi_pk ) )
+        if( AVI_PacketGetHeader( p_demux->s, &avi_pk ) )
         {
             msg_Warn( p_demux, "cannot get packet header" );
             return VLC_EGENERIC;
@@ -1783,7 +1853,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
         if( avi_pk.i_stream >= p_sys->i_track ||
             ( avi_pk.i_cat != AUDIO_ES && avi_pk.i_cat != VIDEO_ES ) )
         {
-            if( AVI_PacketNext( p_demux ) )
+            if( AVI_PacketNext( p_demux->s ) )
             {
                 return VLC_EGENERIC;
             }
@@ -1818,7 +1888,7 @@ static int AVI_StreamChunkFind( demux_t *p_demux, unsigned int i_stream )
                 return VLC_SUCCESS;
             }
 
-            if( AVI_PacketNext( p_demux ) )
+            if( AVI_PacketNext( p_demux->s ) )
             {
                 return VLC_EGENERIC;
             }
@@ -2116,17 +2186,17 @@ static void AVI_ParseStreamHeader( vlc_fourcc_t i_id,
 /****************************************************************************
  *
  ****************************************************************************/
-static int AVI_PacketGetHeader( demux_t *p_demux, avi_packet_t *p_pk )
+static int AVI_PacketGetHeader( stream_t *s, avi_packet_t *p_pk )
 {
     const uint8_t *p_peek;
 
-    if( stream_Peek( p_demux->s, &p_peek, 16 ) < 16 )
+    if( stream_Peek( s, &p_peek, 16 ) < 16 )
     {
         return VLC_EGENERIC;
     }
     p_pk->i_fourcc  = VLC_FOURCC( p_peek[0], p_peek[1], p_peek[2], p_peek[3] );
     p_pk->i_size    = GetDWLE( p_peek + 4 );
-    p_pk->i_pos     = stream_Tell( p_demux->s );
+    p_pk->i_pos     = stream_Tell( s );
     if( p_pk->i_fourcc == AVIFOURCC_LIST || p_pk->i_fourcc == AVIFOURCC_RIFF )
     {
         p_pk->i_type = VLC_FOURCC( p_peek[8],  p_peek[9],
@@ -2143,12 +2213,12 @@ static int AVI_PacketGetHeader( demux_t *p_demux, avi_packet_t *p_pk )
     return VLC_SUCCESS;
 }
 
-static int AVI_PacketNext( demux_t *p_demux )
+static int AVI_PacketNext( stream_t *s )
 {
     avi_packet_t    avi_ck;
     int             i_skip = 0;
 
-    if( AVI_PacketGetHeader( p_demux, &avi_ck ) )
+    if( AVI_PacketGetHeader( s, &avi_ck ) )
     {
         return VLC_EGENERIC;
     }
@@ -2168,7 +2238,7 @@ static int AVI_PacketNext( demux_t *p_demux )
         i_skip = __EVEN( avi_ck.i_size ) + 8;
     }
 
-    if( stream_Read( p_demux->s, NULL, i_skip ) != i_skip )
+    if( stream_Read( s, NULL, i_skip ) != i_skip )
     {
         return VLC_EGENERIC;
     }
@@ -2198,20 +2268,26 @@ static int AVI_PacketRead( demux_t   *p_demux,
     return VLC_SUCCESS;
 }
 
-static int AVI_PacketSearch( demux_t *p_demux )
+static bool AVI_DemuxAlive( void *p_data, stream_t *s )
+{
+    VLC_UNUSED( s );
+    return vlc_object_alive( (demux_t *)p_data );
+}
+
+static int AVI_PacketSearch( stream_t *s, unsigned int i_track,
+                             avi_scan_continue_t pf_continue, void *p_data )
 {
-    demux_sys_t     *p_sys = p_demux->p_sys;
     avi_packet_t    avi_pk;
     int             i_count = 0;
 
     for( ;; )
     {
-        if( stream_Read( p_demux->s, NULL, 1 ) != 1 )
+        if( stream_Read( s, NULL, 1 ) != 1 )
         {
             return VLC_EGENERIC;
         }
-        AVI_PacketGetHeader( p_demux, &avi_pk );
-        if( avi_pk.i_stream < p_sys->i_track &&
+        AVI_PacketGetHeader( s, &avi_pk );
+        if( avi_pk.i_stream < i_track &&
             ( avi_pk.i_cat == AUDIO_ES || avi_pk.i_cat == VIDEO_ES ) )
         {
             return VLC_SUCCESS;
@@ -2231,11 +2307,11 @@ static int AVI_PacketSearch( demux_t *p_demux )
          * this code is called only on broken files). */
         if( !(++i_count % 1024) )
         {
-            if( !vlc_object_alive (p_demux) ) return VLC_EGENERIC;
+            if( !pf_continue( p_data, s ) ) return VLC_EGENERIC;
 
             msleep( 10000 );
             if( !(i_count % (1024 * 10)) )
-                msg_Warn( p_demux, "trying to resync..." );
+                msg_Warn( s, "trying to resync..." );
         }
     }
 }
@@ -2263,11 +2339,16 @@ static void avi_index_Append( avi_index_t *p_index, off_t *pi_last_pos,
     /* add the entry */
     if( p_index->i_size >= p_index->i_max )
     {
-        p_index->i_max += 16384;
+        /* grow geometrically, files without index can have millions of
+         * chunks */
+        p_index->i_max = __MAX( 16384, p_index->i_max * 2 );
         p_index->p_entry = realloc_or_free( p_index->p_entry,
                                             p_index->i_max * sizeof( *p_index->p_entry ) );
         if( !p_index->p_entry )
+        {
+            p_index->i_size = p_index->i_max = 0;
             return;
+        }
     }
     /* calculate cumulate length */
     if( p_index->i_size > 0 )
@@ -2528,66 +2609,22 @@ static void AVI_IndexLoad( demux_t *p_demux )
     }
 }
 
-static void AVI_IndexCreate( demux_t *p_demux )
+/* Walk LIST-movi from the current position of s and append every chunk of a
+ * known track to p_index[]. Returns false if the scan was interrupted before
+ * reaching the end of the movi list. */
+static bool AVI_IndexScan( demux_sys_t *p_sys, stream_t *s,
+                           off_t i_movi_end, off_t i_riffx_pos,
+                           avi_index_t p_index[], off_t *pi_last_pos,
+                           avi_scan_continue_t pf_continue, void *p_data )
 {
-    demux_sys_t *p_sys = p_demux->p_sys;
-
-    avi_chunk_list_t *p_riff;
-    avi_chunk_list_t *p_movi;
-
-    unsigned int i_stream;
-    off_t i_movi_end;
-
-    mtime_t i_dialog_update;
-    dialog_progress_bar_t *p_dialog = NULL;
-
-    p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0);
-    p_movi = AVI_ChunkFind( p_riff, AVIFOURCC_movi, 0);
-
-    if( !p_movi )
-    {
-        msg_Err( p_demux, "cannot find p_movi" );
-        return;
-    }
-
-    for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
-        avi_index_Init( &p_sys->track[i_stream]->idx );
-
-    i_movi_end = __MIN( (off_t)(p_movi->i_chunk_pos + p_movi->i_chunk_size),
-                        stream_Size( p_demux->s ) );
-
-    stream_Seek( p_demux->s, p_movi->i_chunk_pos + 12 );
-    msg_Warn( p_demux, "creating index from LIST-movi, will take time !" );
-
-
-    /* Only show dialog if AVI is > 10MB */
-    i_dialog_update = mdate();
-    if( stream_Size( p_demux->s ) > 10000000 )
-        p_dialog = dialog_ProgressCreate( p_demux, _("Fixing AVI Index..."),
-                                       NULL, _("Cancel") );
-
     for( ;; )
     {
         avi_packet_t pk;
 
-        if( !vlc_object_alive (p_demux) )
-            break;
-
-        /* Don't update/check dialog too often */
-        if( p_dialog && mdate() - i_dialog_update > 100000 )
-        {
-            if( dialog_ProgressCancelled( p_dialog ) )
-                break;
-
-            double f_current = stream_Tell( p_demux->s );
-            double f_size    = stream_Size( p_demux->s );
-            double f_pos     = f_current / f_size;
-            dialog_ProgressSet( p_dialog, NULL, f_pos );
+        if( !pf_continue( p_data, s ) )
+            return false;
 
-            i_dialog_update = mdate();
-        }
-
-        if( AVI_PacketGetHeader( p_demux, &pk ) )
+        if( AVI_PacketGetHeader( s, &pk ) )
             break;
 
         if( pk.i_stream < p_sys->i_track &&
@@ -2601,28 +2638,24 @@ static void AVI_IndexCreate( demux_t *p_demux )
             index.i_pos     = pk.i_pos;
             index.i_length  = pk.i_size;
             index.i_lengthtotal = pk.i_size;
-            avi_index_Append( &tk->idx, &p_sys->i_movi_lastchunk_pos, &index );
+            avi_index_Append( &p_index[pk.i_stream], pi_last_pos, &index );
         }
         else
         {
             switch( pk.i_fourcc )
             {
             case AVIFOURCC_idx1:
-                if( p_sys->b_odml )
+                if( p_sys->b_odml && i_riffx_pos > 0 )
                 {
-                    avi_chunk_list_t *p_sysx;
-                    p_sysx = AVI_ChunkFind( &p_sys->ck_root,
-                                            AVIFOURCC_RIFF, 1 );
-
-                    msg_Dbg( p_demux, "looking for new RIFF chunk" );
-                    if( stream_Seek( p_demux->s, p_sysx->i_chunk_pos + 24 ) )
-                        goto print_stat;
+                    msg_Dbg( s, "looking for new RIFF chunk" );
+                    if( stream_Seek( s, i_riffx_pos + 24 ) )
+                        return true;
                     break;
                 }
-                goto print_stat;
+                return true;
 
             case AVIFOURCC_RIFF:
-                    msg_Dbg( p_demux, "new RIFF chunk found" );
+                    msg_Dbg( s, "new RIFF chunk found" );
                     break;
 
             case AVIFOURCC_rec:
@@ -2630,31 +2663,559 @@ static void AVI_IndexCreate( demux_t *p_demux )
                 break;
 
             default:
-                msg_Warn( p_demux, "need resync, probably broken avi" );
-                if( AVI_PacketSearch( p_demux ) )
+                msg_Warn( s, "need resync, probably broken avi" );
+                if( AVI_PacketSearch( s, p_sys->i_track, pf_continue, p_data ) )
                 {
-                    msg_Warn( p_demux, "lost sync, abord index creation" );
-                    goto print_stat;
+                    msg_Warn( s, "lost sync, abord index creation" );
+                    return true;
                 }
             }
         }
 
         if( ( !p_sys->b_odml && pk.i_pos + pk.i_size >= i_movi_end ) ||
-            AVI_PacketNext( p_demux ) )
+            AVI_PacketNext( s ) )
         {
             break;
         }
     }
+    return true;
+}
+
+static int AVI_IndexMoviBounds( demux_t *p_demux, off_t *pi_movi_pos,
+                                off_t *pi_movi_end, off_t *pi_riffx_pos )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    avi_chunk_list_t *p_riff = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 0);
+    avi_chunk_list_t *p_movi = AVI_ChunkFind( p_riff, AVIFOURCC_movi, 0);
+    if( !p_movi )
+    {
+        msg_Err( p_demux, "cannot find p_movi" );
+        return VLC_EGENERIC;
+    }
+
+    avi_chunk_list_t *p_riffx = AVI_ChunkFind( &p_sys->ck_root, AVIFOURCC_RIFF, 1 );
+
+    *pi_movi_pos  = p_movi->i_chunk_pos;
+    *pi_movi_end  = __MIN( (off_t)(p_movi->i_chunk_pos + p_movi->i_chunk_size),
+                           stream_Size( p_demux->s ) );
+    *pi_riffx_pos = p_riffx ? (off_t)p_riffx->i_chunk_pos : 0;
+    return VLC_SUCCESS;
+}
+
+typedef struct
+{
+    demux_t               *p_demux;
+    dialog_progress_bar_t *p_dialog;
+    mtime_t               i_dialog_update;
+} avi_index_create_t;
+
+static bool AVI_IndexCreateContinue( void *p_data, stream_t *s )
+{
+    avi_index_create_t *p_ctx = p_data;
+
+    if( !vlc_object_alive( p_ctx->p_demux ) )
+        return false;
+
+    /* Don't update/check dialog too often */
+    if( p_ctx->p_dialog && mdate() - p_ctx->i_dialog_update > 100000 )
+    {
+        if( dialog_ProgressCancelled( p_ctx->p_dialog ) )
+            return false;
+
+        double f_current = stream_Tell( s );
+        double f_size    = stream_Size( s );
+        double f_pos     = f_current / f_size;
+        dialog_ProgressSet( p_ctx->p_dialog, NULL, f_pos );
+
+        p_ctx->i_dialog_update = mdate();
+    }
+    return true;
+}
+
+static bool AVI_IndexCreate( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
 
-print_stat:
-    if( p_dialog != NULL )
-        dialog_ProgressDestroy( p_dialog );
+    unsigned int i_stream;
+    off_t i_movi_pos, i_movi_end, i_riffx_pos;
+
+    if( AVI_IndexMoviBounds( p_demux, &i_movi_pos, &i_movi_end, &i_riffx_pos ) )
+        return false;
+
+    avi_index_t p_index[p_sys->i_track];
+    for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
+        avi_index_Init( &p_index[i_stream] );
+
+    stream_Seek( p_demux->s, i_movi_pos + 12 );
+    msg_Warn( p_demux, "creating index from LIST-movi, will take time !" );
+
+    avi_index_create_t ctx = {
+        .p_demux = p_demux,
+        .p_dialog = NULL,
+        .i_dialog_update = mdate(),
+    };
+
+    /* Only show dialog if AVI is > 10MB */
+    if( stream_Size( p_demux->s ) > 10000000 )
+        ctx.p_dialog = dialog_ProgressCreate( p_demux, _("Fixing AVI Index..."),
+                                              NULL, _("Cancel") );
+
+    bool b_complete = AVI_IndexScan( p_sys, p_demux->s, i_movi_end, i_riffx_pos,
+                                     p_index, &p_sys->i_movi_lastchunk_pos,
+                                     AVI_IndexCreateContinue, &ctx );
+
+    if( ctx.p_dialog != NULL )
+        dialog_ProgressDestroy( ctx.p_dialog );
 
     for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
     {
+        avi_index_Clean( &p_sys->track[i_stream]->idx );
+        p_sys->track[i_stream]->idx = p_index[i_stream];
+
         msg_Dbg( p_demux, "stream[%d] creating %d index entries",
                 i_stream, p_sys->track[i_stream]->idx.i_size );
     }
+    return b_complete;
+}
+
+/****************************************************************************
+ * Index cache: indexes recreated from LIST-movi are stored with the shared
+ * demuxer index cache helpers, and validated with the file size and
+ * modification time. Entries are delta coded with variable length integers,
+ * which typically takes 3 to 4 bytes per chunk.
+ ****************************************************************************/
+#define AVI_INDEX_CACHE_MAGIC   "VLCAVIDX"
+#define AVI_INDEX_CACHE_VERSION 1
+
+static char *AVI_IndexCachePath( demux_t *p_demux, struct stat *p_stat )
+{
+    return index_cache_Path( p_demux, "avi-index-cache", "avi-index", p_stat );
+}
+
+static void AVI_IndexCacheWrite64( FILE *f, uint64_t i_value )
+{
+    uint8_t p_buf[8];
+    SetQWLE( p_buf, i_value );
+    fwrite( p_buf, 1, 8, f );
+}
+
+static int AVI_IndexCacheRead64( FILE *f, uint64_t *pi_value )
+{
+    uint8_t p_buf[8];
+    if( fread( p_buf, 1, 8, f ) != 8 )
+        return VLC_EGENERIC;
+    *pi_value = GetQWLE( p_buf );
+    return VLC_SUCCESS;
+}
+
+/* Reads the cache header and checks it matches the opened file and tracks */
+static int AVI_IndexCacheReadHeader( demux_t *p_demux, FILE *f,
+                                     const struct stat *p_stat,
+                                     uint64_t *pi_last_pos )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    char psz_magic[8];
+    uint64_t i_version, i_size, i_mtime, i_tracks;
+
+    if( fread( psz_magic, 1, 8, f ) != 8 ||
+        memcmp( psz_magic, AVI_INDEX_CACHE_MAGIC, 8 ) ||
+        index_cache_ReadVar( f, &i_version ) ||
+        i_version != AVI_INDEX_CACHE_VERSION ||
+        AVI_IndexCacheRead64( f, &i_size ) ||
+        AVI_IndexCacheRead64( f, &i_mtime ) ||
+        AVI_IndexCacheRead64( f, pi_last_pos ) ||
+        index_cache_ReadVar( f, &i_tracks ) )
+        return VLC_EGENERIC;
+
+    if( i_size != (uint64_t)p_stat->st_size ||
+        (int64_t)i_mtime != (int64_t)p_stat->st_mtime ||
+        i_tracks != p_sys->i_track )
+        return VLC_EGENERIC;
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        uint64_t i_cat, i_codec;
+        if( index_cache_ReadVar( f, &i_cat ) ||
+            index_cache_ReadVar( f, &i_codec ) ||
+            i_cat != p_sys->track[i]->i_cat ||
+            i_codec != p_sys->track[i]->i_codec )
+            return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+/* Loads the cached index into the tracks. With b_probe, only checks that a
+ * valid cache exists for this file. */
+static int AVI_IndexCacheLoad( demux_t *p_demux, bool b_probe )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    struct stat st;
+
+    char *psz_path = AVI_IndexCachePath( p_demux, &st );
+    if( !psz_path )
+        return VLC_EGENERIC;
+
+    FILE *f = vlc_fopen( psz_path, "rb" );
+    free( psz_path );
+    if( !f )
+        return VLC_EGENERIC;
+
+    uint64_t i_last_pos;
+    if( AVI_IndexCacheReadHeader( p_demux, f, &st, &i_last_pos ) )
+    {
+        fclose( f );
+        return VLC_EGENERIC;
+    }
+    if( b_probe )
+    {
+        fclose( f );
+        return VLC_SUCCESS;
+    }
+
+    avi_index_t p_index[p_sys->i_track];
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+        avi_index_Init( &p_index[i] );
+
+    off_t i_dummy = 0;
+    unsigned i_stream;
+    for( i_stream = 0; i_stream < p_sys->i_track; i_stream++ )
+    {
+        avi_index_t *p_idx = &p_index[i_stream];
+        uint64_t i_count;
+
+        if( index_cache_ReadVar( f, &i_count ) ||
+            i_count > (uint64_t)st.st_size / 8 )
+            break;
+        if( i_count > 0 )
+        {
+            p_idx->p_entry = malloc( i_count * sizeof( *p_idx->p_entry ) );
+            if( !p_idx->p_entry )
+                break;
+            p_idx->i_max = i_count;
+        }
+
+        avi_entry_t index = { .i_id = 0, .i_pos = 0, .i_length = 0 };
+        uint64_t i;
+        for( i = 0; i < i_count; i++ )
+        {
+            uint64_t i_flags, i_length;
+            int64_t i_delta;
+
+            if( index_cache_ReadVar( f, &i_flags ) )
+                break;
+            if( i_flags & 1 )
+            {
+                uint8_t p_id[4];
+                if( fread( p_id, 1, 4, f ) != 4 )
+                    break;
+                index.i_id = GetDWLE( p_id );
+            }
+            if( index_cache_ReadSigned( f, &i_delta ) ||
+                index_cache_ReadVar( f, &i_length ) )
+                break;
+
+            /* positions are relative to the end of the previous chunk */
+            off_t i_next = index.i_pos + __EVEN( index.i_length ) + 8;
+            index.i_flags  = i_flags >> 1;
+            index.i_pos    = i_next + i_delta;
+            index.i_length = i_length;
+            index.i_lengthtotal = i_length;
+            avi_index_Append( p_idx, &i_dummy, &index );
+        }
+        if( i < i_count )
+            break;
+    }
+    fclose( f );
+
+    if( i_stream < p_sys->i_track )
+    {
+        msg_Warn( p_demux, "corrupted AVI index cache" );
+        for( unsigned i = 0; i < p_sys->i_track; i++ )
+            avi_index_Clean( &p_index[i] );
+        return VLC_EGENERIC;
+    }
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        avi_index_Clean( &p_sys->track[i]->idx );
+        p_sys->track[i]->idx = p_index[i];
+        msg_Dbg( p_demux, "stream[%u] loaded %u cached index entries",
+                 i, p_index[i].i_size );
+    }
+    p_sys->i_movi_lastchunk_pos = i_last_pos;
+    return VLC_SUCCESS;
+}
+
+static void AVI_IndexCacheStore( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    struct stat st;
+
+    char *psz_path = AVI_IndexCachePath( p_demux, &st );
+    if( !psz_path )
+        return;
+
+    char *psz_tmp;
+    FILE *f = index_cache_Create( psz_path, &psz_tmp );
+    if( !f )
+    {
+        msg_Dbg( p_demux, "cannot write AVI index cache %s", psz_path );
+        free( psz_path );
+        return;
+    }
+
+    fwrite( AVI_INDEX_CACHE_MAGIC, 1, 8, f );
+    index_cache_WriteVar( f, AVI_INDEX_CACHE_VERSION );
+    AVI_IndexCacheWrite64( f, st.st_size );
+    AVI_IndexCacheWrite64( f, st.st_mtime );
+    AVI_IndexCacheWrite64( f, p_sys->i_movi_lastchunk_pos );
+    index_cache_WriteVar( f, p_sys->i_track );
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        index_cache_WriteVar( f, p_sys->track[i]->i_cat );
+        index_cache_WriteVar( f, p_sys->track[i]->i_codec );
+    }
+
+    for( unsigned i = 0; i < p_sys->i_track; i++ )
+    {
+        const avi_index_t *p_idx = &p_sys->track[i]->idx;
+        avi_entry_t prev = { .i_id = 0, .i_pos = 0, .i_length = 0 };
+
+        index_cache_WriteVar( f, p_idx->i_size );
+        for( unsigned j = 0; j < p_idx->i_size; j++ )
+        {
+            const avi_entry_t *p_entry = &p_idx->p_entry[j];
+            const bool b_id = j == 0 || p_entry->i_id != prev.i_id;
+            const int64_t i_delta = p_entry->i_pos -
+                                    ( prev.i_pos + __EVEN( prev.i_length ) + 8 );
+
+            index_cache_WriteVar( f, ((uint64_t)p_entry->i_flags << 1) | b_id );
+            if( b_id )
+            {
+                uint8_t p_id[4];
+                SetDWLE( p_id, p_entry->i_id );
+                fwrite( p_id, 1, 4, f );
+            }
+            index_cache_WriteSigned( f, i_delta );
+            index_cache_WriteVar( f, p_entry->i_length );
+            prev = *p_entry;
+        }
+    }
+
+    if( index_cache_Commit( f, psz_tmp, psz_path ) )
+        msg_Warn( p_demux, "cannot write AVI index cache %s", psz_path );
+    else
+        msg_Dbg( p_demux, "AVI index cached to %s", psz_path );
+    free( psz_path );
+}
+
+/****************************************************************************
+ * Background index creation
+ ****************************************************************************/
+#define AVI_INDEX_PUBLISH_STEP 4096 /* chunks scanned between publications */
+
+/* Moves the entries scanned since the last call to the pending index */
+static void AVI_IndexBuilderPublish( avi_index_builder_t *p_builder )
+{
+    vlc_mutex_lock( &p_builder->lock );
+    for( unsigned i = 0; i < p_builder->i_track; i++ )
+    {
+        avi_index_t *p_idx = &p_builder->idx[i];
+        avi_index_t *p_pending = &p_builder->pending[i];
+
+        if( p_idx->i_size == 0 )
+            continue;
+        if( p_pending->i_size == 0 )
+        {
+            avi_index_t tmp = *p_pending;
+
+            *p_pending = *p_idx;
+            *p_idx = tmp;
+            continue;
+        }
+        if( p_pending->i_size + p_idx->i_size > p_pending->i_max )
+        {
+            unsigned i_max = __MAX( 2 * p_pending->i_max,
+                                    p_pending->i_size + p_idx->i_size );
+            avi_entry_t *p_entry = realloc( p_pending->p_entry,
+                                            i_max * sizeof( *p_entry ) );
+            if( unlikely(p_entry == NULL) )
+                continue; /* keep them for the next publication */
+            p_pending->p_entry = p_entry;
+            p_pending->i_max = i_max;
+        }
+        memcpy( &p_pending->p_entry[p_pending->i_size], p_idx->p_entry,
+                p_idx->i_size * sizeof( *p_idx->p_entry ) );
+        p_pending->i_size += p_idx->i_size;
+        p_idx->i_size = 0;
+    }
+    vlc_mutex_unlock( &p_builder->lock );
+}
+
+static bool AVI_IndexBuilderContinue( void *p_data, stream_t *s )
+{
+    avi_index_builder_t *p_builder = p_data;
+    VLC_UNUSED( s );
+
+    if( ++p_builder->i_scanned % AVI_INDEX_PUBLISH_STEP == 0 )
+        AVI_IndexBuilderPublish( p_builder );
+    return !atomic_load( &p_builder->b_stop );
+}
+
+static void *AVI_IndexBuilderThread( void *p_data )
+{
+    demux_t *p_demux = p_data;
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_index_builder_t *p_builder = p_sys->p_builder;
+    int canc = vlc_savecancel();
+
+    if( !stream_Seek( p_builder->s, p_builder->i_movi_pos + 12 ) )
+        p_builder->b_complete =
+            AVI_IndexScan( p_sys, p_builder->s,
+                           p_builder->i_movi_end, p_builder->i_riffx_pos,
+                           p_builder->idx, &p_builder->i_last_pos,
+                           AVI_IndexBuilderContinue, p_builder );
+    AVI_IndexBuilderPublish( p_builder );
+
+    atomic_store( &p_builder->b_done, true );
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+static void AVI_IndexBuilderDelete( avi_index_builder_t *p_builder )
+{
+    if( p_builder->idx )
+        for( unsigned i = 0; i < p_builder->i_track; i++ )
+            avi_index_Clean( &p_builder->idx[i] );
+    if( p_builder->pending )
+        for( unsigned i = 0; i < p_builder->i_track; i++ )
+            avi_index_Clean( &p_builder->pending[i] );
+    free( p_builder->idx );
+    free( p_builder->pending );
+    vlc_mutex_destroy( &p_builder->lock );
+    free( p_builder );
+}
+
+static int AVI_IndexBuilderStart( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_sys->p_builder || !p_demux->psz_access || !p_demux->psz_location )
+        return VLC_EGENERIC;
+
+    avi_index_builder_t *p_builder = calloc( 1, sizeof( *p_builder ) );
+    if( !p_builder )
+        return VLC_ENOMEM;
+
+    vlc_mutex_init( &p_builder->lock );
+    p_builder->i_track = p_sys->i_track;
+    p_builder->idx = calloc( p_sys->i_track, sizeof( *p_builder->idx ) );
+    p_builder->pending = calloc( p_sys->i_track, sizeof( *p_builder->pending ) );
+    if( !p_builder->idx || !p_builder->pending ||
+        AVI_IndexMoviBounds( p_demux, &p_builder->i_movi_pos,
+                             &p_builder->i_movi_end, &p_builder->i_riffx_pos ) )
+        goto error;
+
+    char *psz_url;
+    if( asprintf( &psz_url, "%s://%s", p_demux->psz_access,
+                  p_demux->psz_location ) == -1 )
+        goto error;
+    p_builder->s = stream_UrlNew( p_demux, psz_url );
+    free( psz_url );
+    if( !p_builder->s )
+        goto error;
+
+    atomic_init( &p_builder->b_stop, false );
+    atomic_init( &p_builder->b_done, false );
+
+    p_sys->p_builder = p_builder;
+    if( vlc_clone( &p_builder->thread, AVI_IndexBuilderThread, p_demux,
+                   VLC_THREAD_PRIORITY_LOW ) )
+    {
+        p_sys->p_builder = NULL;
+        stream_Delete( p_builder->s );
+        goto error;
+    }
+    msg_Dbg( p_demux, "creating index in background" );
+    return VLC_SUCCESS;
+
+error:
+    AVI_IndexBuilderDelete( p_builder );
+    return VLC_EGENERIC;
+}
+
+/* Appends the entries published by the thread to the tracks index. The
+ * entries already covered by a track index (loaded from the file, or found
+ * by the demuxer while playing) are skipped. Returns true if the tracks
+ * index changed. */
+static bool AVI_IndexBuilderMerge( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_index_builder_t *p_builder = p_sys->p_builder;
+    avi_index_t pending[p_builder->i_track];
+    bool b_changed = false;
+
+    vlc_mutex_lock( &p_builder->lock );
+    for( unsigned i = 0; i < p_builder->i_track; i++ )
+    {
+        pending[i] = p_builder->pending[i];
+        avi_index_Init( &p_builder->pending[i] );
+    }
+    vlc_mutex_unlock( &p_builder->lock );
+
+    for( unsigned i = 0; i < p_builder->i_track; i++ )
+    {
+        avi_index_t *p_idx = &p_sys->track[i]->idx;
+
+        for( unsigned j = 0; j < pending[i].i_size; j++ )
+        {
+            if( p_idx->i_size > 0 &&
+                pending[i].p_entry[j].i_pos <= p_idx->p_entry[p_idx->i_size - 1].i_pos )
+                continue;
+            avi_index_Append( p_idx, &p_sys->i_movi_lastchunk_pos,
+                              &pending[i].p_entry[j] );
+            b_changed = true;
+        }
+        avi_index_Clean( &pending[i] );
+    }
+    return b_changed;
+}
+
+/* Merges the entries indexed in background so far. Once the thread is done,
+ * or with b_abort, the builder is destroyed. Returns true if the tracks
+ * index changed. */
+static bool AVI_IndexBuilderFinish( demux_t *p_demux, bool b_abort )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    avi_index_builder_t *p_builder = p_sys->p_builder;
+    bool b_changed = false;
+
+    if( !p_builder )
+        return false;
+    if( !b_abort )
+    {
+        if( !atomic_load( &p_builder->b_done ) )
+            return AVI_IndexBuilderMerge( p_demux );
+    }
+    else
+        atomic_store( &p_builder->b_stop, true );
+
+    vlc_join( p_builder->thread, NULL );
+    stream_Delete( p_builder->s );
+
+    if( !b_abort )
+        b_changed = AVI_IndexBuilderMerge( p_demux );
+    p_sys->p_builder = NULL;
+
+    if( p_builder->b_complete && !b_abort )
+    {
+        msg_Dbg( p_demux, "background index creation done" );
+        AVI_IndexCacheStore( p_demux );
+    }
+
+    AVI_IndexBuilderDelete( p_builder );
+    return b_changed;
 }
 
 /* */
@@ -0,0 +1,168 @@
+/*****************************************************************************
+ * index_cache.h: on-disk cache of demuxer indexes
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_DEMUX_INDEX_CACHE_H
+#define VLC_DEMUX_INDEX_CACHE_H
+
+/* Indexes recreated by scanning a file are stored in a subdirectory of the
+ * user cache directory, in a file named after the MD5 hash of the file path.
+ * The callers validate the content with the file size and modification
+ * time. Numbers are stored as LEB128 variable length integers. */
+
+#include <vlc_fs.h>
+#include <vlc_md5.h>
+#include <vlc_configuration.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/**
+ * Returns the path of the cache file of the demuxed file, and gets its
+ * status, or NULL if psz_option is false or the input is not a local file.
+ */
+static inline char *index_cache_Path( demux_t *p_demux, const char *psz_option,
+                                      const char *psz_subdir,
+                                      struct stat *p_stat )
+{
+    if( !var_InheritBool( p_demux, psz_option ) ||
+        p_demux->psz_file == NULL ||
+        vlc_stat( p_demux->psz_file, p_stat ) )
+        return NULL;
+
+    char *psz_dir = config_GetUserDir( VLC_CACHE_DIR );
+    if( !psz_dir )
+        return NULL;
+
+    struct md5_s md5;
+    InitMD5( &md5 );
+    AddMD5( &md5, p_demux->psz_file, strlen( p_demux->psz_file ) );
+    EndMD5( &md5 );
+
+    char psz_hash[33];
+    for( int i = 0; i < 16; i++ )
+        sprintf( &psz_hash[2*i], "%02" PRIx8, md5.buf[i] );
+
+    char *psz_path;
+    if( asprintf( &psz_path, "%s" DIR_SEP "%s" DIR_SEP "%s.idx",
+                  psz_dir, psz_subdir, psz_hash ) == -1 )
+        psz_path = NULL;
+    free( psz_dir );
+    return psz_path;
+}
+
+/**
+ * Creates the cache directories and opens a temporary file next to psz_path.
+ * The file is moved into place by index_cache_Commit().
+ */
+static inline FILE *index_cache_Create( const char *psz_path, char **ppsz_tmp )
+{
+    char *psz_dir = strdup( psz_path );
+    if( !psz_dir )
+        return NULL;
+
+    char *psz_sep = strrchr( psz_dir, DIR_SEP_CHAR );
+    *psz_sep = '\0';
+    char *psz_parent = strrchr( psz_dir, DIR_SEP_CHAR );
+    if( psz_parent )
+    {
+        *psz_parent = '\0';
+        vlc_mkdir( psz_dir, 0700 );
+        *psz_parent = DIR_SEP_CHAR;
+    }
+    vlc_mkdir( psz_dir, 0700 );
+    free( psz_dir );
+
+    if( asprintf( ppsz_tmp, "%s.tmp", psz_path ) == -1 )
+        return NULL;
+
+    FILE *f = vlc_fopen( *ppsz_tmp, "wb" );
+    if( !f )
+    {
+        free( *ppsz_tmp );
+        *ppsz_tmp = NULL;
+    }
+    return f;
+}
+
+/**
+ * Closes the temporary file and replaces the cache file with it.
+ * @return VLC_SUCCESS, or VLC_EGENERIC if writing failed.
+ */
+static inline int index_cache_Commit( FILE *f, char *psz_tmp,
+                                      const char *psz_path )
+{
+    bool b_error = ferror( f );
+    int i_ret = VLC_SUCCESS;
+
+    if( fclose( f ) || b_error || vlc_rename( psz_tmp, psz_path ) )
+    {
+        vlc_unlink( psz_tmp );
+        i_ret = VLC_EGENERIC;
+    }
+    free( psz_tmp );
+    return i_ret;
+}
+
+static inline void index_cache_WriteVar( FILE *f, uint64_t i_value )
+{
+    while( i_value >= 0x80 )
+    {
+        putc( (i_value & 0x7f) | 0x80, f );
+        i_value >>= 7;
+    }
+    putc( i_value, f );
+}
+
+static inline int index_cache_ReadVar( FILE *f, uint64_t *pi_value )
+{
+    uint64_t i_value = 0;
+    for( unsigned i_shift = 0; i_shift < 64; i_shift += 7 )
+    {
+        int c = getc( f );
+        if( c == EOF )
+            return VLC_EGENERIC;
+        i_value |= (uint64_t)(c & 0x7f) << i_shift;
+        if( !(c & 0x80) )
+        {
+            *pi_value = i_value;
+            return VLC_SUCCESS;
+        }
+    }
+    return VLC_EGENERIC;
+}
+
+/* Signed values are zigzag coded */
+static inline void index_cache_WriteSigned( FILE *f, int64_t i_value )
+{
+    index_cache_WriteVar( f, ((uint64_t)i_value << 1) ^ (i_value >> 63) );
+}
+
+static inline int index_cache_ReadSigned( FILE *f, int64_t *pi_value )
+{
+    uint64_t i_value;
+    if( index_cache_ReadVar( f, &i_value ) )
+        return VLC_EGENERIC;
+    *pi_value = (int64_t)( (i_value >> 1) ^ -(i_value & 1) );
+    return VLC_SUCCESS;
+}
+
+#endif
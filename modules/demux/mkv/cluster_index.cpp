@@ -0,0 +1,388 @@
+/*****************************************************************************
+ * cluster_index.cpp : matroska demuxer
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "cluster_index.hpp"
+
+#include <vlc_stream.h>
+
+#include "../index_cache.h"
+
+#define MKV_ID_SEGMENT        0x18538067
+#define MKV_ID_CLUSTER        0x1F43B675
+#define MKV_ID_TIMECODE       0xE7
+#define MKV_ID_SILENTTRACKS   0x5854
+#define MKV_ID_POSITION       0xA7
+#define MKV_ID_PREVSIZE       0xAB
+#define MKV_ID_SIMPLEBLOCK    0xA3
+#define MKV_ID_BLOCKGROUP     0xA0
+#define MKV_ID_ENCRYPTEDBLOCK 0xAF
+#define MKV_ID_VOID           0xEC
+#define MKV_ID_CRC32          0xBF
+
+/*****************************************************************************
+ * Raw EBML reading
+ *****************************************************************************/
+/* Reads an EBML variable size integer. Element IDs keep their length marker.
+ * Returns the number of bytes read, or -1. */
+static int ReadVint( stream_t *s, uint64_t *pi_value, bool b_id,
+                     bool *pb_unknown = NULL )
+{
+    const uint8_t *p_peek;
+    if( stream_Peek( s, &p_peek, 1 ) < 1 )
+        return -1;
+
+    int i_len;
+    for( i_len = 1; i_len <= 8; i_len++ )
+        if( p_peek[0] & (0x80 >> (i_len - 1)) )
+            break;
+    if( i_len > (b_id ? 4 : 8) )
+        return -1;
+    if( stream_Peek( s, &p_peek, i_len ) < i_len )
+        return -1;
+
+    const uint8_t i_mask = 0xff >> i_len;
+    uint64_t i_value = b_id ? p_peek[0] : p_peek[0] & i_mask;
+    bool b_unknown = (p_peek[0] & i_mask) == i_mask;
+    for( int i = 1; i < i_len; i++ )
+    {
+        i_value = (i_value << 8) | p_peek[i];
+        b_unknown = b_unknown && p_peek[i] == 0xff;
+    }
+    if( stream_Read( s, NULL, i_len ) != i_len )
+        return -1;
+
+    *pi_value = i_value;
+    if( pb_unknown )
+        *pb_unknown = b_unknown;
+    return i_len;
+}
+
+static bool IsClusterChild( uint64_t i_id )
+{
+    switch( i_id )
+    {
+        case MKV_ID_TIMECODE:
+        case MKV_ID_SILENTTRACKS:
+        case MKV_ID_POSITION:
+        case MKV_ID_PREVSIZE:
+        case MKV_ID_SIMPLEBLOCK:
+        case MKV_ID_BLOCKGROUP:
+        case MKV_ID_ENCRYPTEDBLOCK:
+        case MKV_ID_VOID:
+        case MKV_ID_CRC32:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*****************************************************************************
+ * cluster_indexer_c
+ *****************************************************************************/
+cluster_indexer_c::cluster_indexer_c( demux_t *p_demux_, int64_t i_start_pos_,
+                                      int64_t i_end_pos_, uint64_t i_timescale_ )
+    :p_demux( p_demux_ )
+    ,s( NULL )
+    ,i_start_pos( i_start_pos_ )
+    ,i_end_pos( i_end_pos_ )
+    ,i_timescale( i_timescale_ )
+    ,is_running( false )
+    ,b_abort( false )
+    ,b_done( false )
+    ,b_complete( false )
+{
+    vlc_mutex_init( &lock );
+}
+
+cluster_indexer_c::~cluster_indexer_c()
+{
+    if( is_running )
+    {
+        vlc_mutex_lock( &lock );
+        b_abort = true;
+        vlc_mutex_unlock( &lock );
+        vlc_join( thread, NULL );
+    }
+    if( s )
+        stream_Delete( s );
+    vlc_mutex_destroy( &lock );
+}
+
+bool cluster_indexer_c::Start()
+{
+    if( is_running || !p_demux->psz_access || !p_demux->psz_location )
+        return false;
+
+    char *psz_url;
+    if( asprintf( &psz_url, "%s://%s", p_demux->psz_access,
+                  p_demux->psz_location ) == -1 )
+        return false;
+    s = stream_UrlNew( p_demux, psz_url );
+    free( psz_url );
+    if( !s )
+        return false;
+
+    is_running = !vlc_clone( &thread, Thread, this, VLC_THREAD_PRIORITY_LOW );
+    if( is_running )
+        msg_Dbg( p_demux, "indexing clusters in background" );
+    return is_running;
+}
+
+bool cluster_indexer_c::IsDone()
+{
+    vlc_mutex_locker l( &lock );
+    return b_done;
+}
+
+bool cluster_indexer_c::IsComplete()
+{
+    vlc_mutex_locker l( &lock );
+    return b_done && b_complete;
+}
+
+bool cluster_indexer_c::Aborted()
+{
+    vlc_mutex_locker l( &lock );
+    return b_abort;
+}
+
+void *cluster_indexer_c::Thread( void *data )
+{
+    cluster_indexer_c *p_this = static_cast<cluster_indexer_c *>( data );
+    int canc = vlc_savecancel();
+
+    p_this->Scan();
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+void cluster_indexer_c::Scan()
+{
+    int64_t i_pos = i_start_pos;
+    bool b_end = false;
+
+    while( !Aborted() )
+    {
+        if( i_end_pos >= 0 && i_pos >= i_end_pos )
+        {
+            b_end = true;
+            break;
+        }
+        if( stream_Tell( s ) != (uint64_t)i_pos && stream_Seek( s, i_pos ) )
+            break;
+
+        uint64_t i_id, i_size;
+        bool b_unknown;
+        if( ReadVint( s, &i_id, true ) < 0 )
+        {
+            /* end of file, the segment size is unknown or wrong */
+            b_end = stream_Tell( s ) >= (uint64_t)stream_Size( s );
+            break;
+        }
+        if( ReadVint( s, &i_size, false, &b_unknown ) < 0 )
+            break;
+        const int64_t i_data = stream_Tell( s );
+
+        if( i_id == MKV_ID_CLUSTER )
+        {
+            i_pos = ScanCluster( i_pos, i_data, b_unknown ? -1 : i_data + i_size );
+            if( i_pos < 0 )
+                break;
+        }
+        else if( i_id == MKV_ID_SEGMENT )
+        {
+            /* next segment */
+            b_end = true;
+            break;
+        }
+        else if( b_unknown )
+            break;
+        else
+            i_pos = i_data + i_size;
+    }
+
+    msg_Dbg( p_demux, "indexed %zu clusters%s", clusters.size(),
+             b_end ? "" : " (incomplete)" );
+
+    vlc_mutex_locker l( &lock );
+    b_complete = b_end;
+    b_done = true;
+}
+
+/* Records the cluster timecode and returns the position of the next
+ * element, or -1 on error. */
+int64_t cluster_indexer_c::ScanCluster( int64_t i_cluster_pos, int64_t i_data_pos,
+                                        int64_t i_cluster_end )
+{
+    int64_t i_child = i_data_pos;
+    bool b_timecode = false;
+
+    for( ;; )
+    {
+        /* the timecode is all we need from a cluster of known size */
+        if( i_cluster_end >= 0 && ( b_timecode || i_child >= i_cluster_end ) )
+            return i_cluster_end;
+
+        if( stream_Tell( s ) != (uint64_t)i_child && stream_Seek( s, i_child ) )
+            return -1;
+
+        uint64_t i_id, i_size;
+        bool b_unknown;
+        if( ReadVint( s, &i_id, true ) < 0 )
+            return i_cluster_end >= 0 ? -1 : i_child;
+        if( ReadVint( s, &i_size, false, &b_unknown ) < 0 )
+            return -1;
+
+        if( i_cluster_end < 0 && !IsClusterChild( i_id ) )
+            return i_child; /* end of a cluster of unknown size */
+        if( b_unknown )
+            return -1;
+
+        const int64_t i_data = stream_Tell( s );
+        if( i_id == MKV_ID_TIMECODE && !b_timecode && i_size <= 8 )
+        {
+            const uint8_t *p_peek;
+            if( stream_Peek( s, &p_peek, i_size ) < (int)i_size )
+                return -1;
+
+            uint64_t i_timecode = 0;
+            for( uint64_t i = 0; i < i_size; i++ )
+                i_timecode = (i_timecode << 8) | p_peek[i];
+
+            mkv_cluster_t cluster;
+            cluster.i_position = i_cluster_pos;
+            cluster.i_time = i_timecode * i_timescale / 1000;
+            clusters.push_back( cluster );
+            b_timecode = true;
+        }
+        i_child = i_data + i_size;
+    }
+}
+
+/*****************************************************************************
+ * Cache
+ *****************************************************************************/
+#define CLUSTER_CACHE_MAGIC   "VLCMKVCX"
+#define CLUSTER_CACHE_VERSION 2
+
+static char *CachePath( demux_t *p_demux, struct stat *p_stat )
+{
+    return index_cache_Path( p_demux, "mkv-index-cache", "mkv-index", p_stat );
+}
+
+bool ClusterIndexCacheLoad( demux_t *p_demux, int64_t i_start_pos,
+                            uint64_t i_timescale,
+                            std::vector<mkv_cluster_t> & clusters )
+{
+    struct stat st;
+    char *psz_path = CachePath( p_demux, &st );
+    if( !psz_path )
+        return false;
+
+    FILE *f = vlc_fopen( psz_path, "rb" );
+    free( psz_path );
+    if( !f )
+        return false;
+
+    char psz_magic[8];
+    uint64_t i_version, i_size, i_mtime, i_pos, i_scale, i_count;
+    bool b_ok = fread( psz_magic, 1, 8, f ) == 8 &&
+                !memcmp( psz_magic, CLUSTER_CACHE_MAGIC, 8 ) &&
+                !index_cache_ReadVar( f, &i_version ) &&
+                i_version == CLUSTER_CACHE_VERSION &&
+                !index_cache_ReadVar( f, &i_size ) &&
+                i_size == (uint64_t)st.st_size &&
+                !index_cache_ReadVar( f, &i_mtime ) &&
+                (int64_t)i_mtime == (int64_t)st.st_mtime &&
+                !index_cache_ReadVar( f, &i_pos ) &&
+                i_pos == (uint64_t)i_start_pos &&
+                !index_cache_ReadVar( f, &i_scale ) && i_scale == i_timescale &&
+                !index_cache_ReadVar( f, &i_count ) && i_count <= i_size;
+
+    if( b_ok )
+    {
+        mkv_cluster_t cluster;
+        cluster.i_position = i_start_pos;
+        cluster.i_time = 0;
+
+        clusters.clear();
+        clusters.reserve( i_count );
+        for( uint64_t i = 0; i < i_count; i++ )
+        {
+            uint64_t i_pos_delta;
+            int64_t i_time_delta;
+            if( index_cache_ReadVar( f, &i_pos_delta ) ||
+                index_cache_ReadSigned( f, &i_time_delta ) )
+            {
+                b_ok = false;
+                break;
+            }
+            cluster.i_position += i_pos_delta;
+            cluster.i_time += i_time_delta;
+            clusters.push_back( cluster );
+        }
+    }
+    fclose( f );
+
+    if( b_ok )
+        msg_Dbg( p_demux, "loaded %zu cached clusters", clusters.size() );
+    else
+        clusters.clear();
+    return b_ok;
+}
+
+void ClusterIndexCacheStore( demux_t *p_demux, int64_t i_start_pos,
+                             uint64_t i_timescale,
+                             const std::vector<mkv_cluster_t> & clusters )
+{
+    struct stat st;
+    char *psz_path = CachePath( p_demux, &st );
+    if( !psz_path )
+        return;
+
+    char *psz_tmp;
+    FILE *f = index_cache_Create( psz_path, &psz_tmp );
+    if( f )
+    {
+        fwrite( CLUSTER_CACHE_MAGIC, 1, 8, f );
+        index_cache_WriteVar( f, CLUSTER_CACHE_VERSION );
+        index_cache_WriteVar( f, st.st_size );
+        index_cache_WriteVar( f, st.st_mtime );
+        index_cache_WriteVar( f, i_start_pos );
+        index_cache_WriteVar( f, i_timescale );
+        index_cache_WriteVar( f, clusters.size() );
+
+        int64_t i_pos = i_start_pos;
+        mtime_t i_time = 0;
+        for( size_t i = 0; i < clusters.size(); i++ )
+        {
+            index_cache_WriteVar( f, clusters[i].i_position - i_pos );
+            index_cache_WriteSigned( f, clusters[i].i_time - i_time );
+            i_pos = clusters[i].i_position;
+            i_time = clusters[i].i_time;
+        }
+
+        if( !index_cache_Commit( f, psz_tmp, psz_path ) )
+            msg_Dbg( p_demux, "cluster index cached to %s", psz_path );
+    }
+    free( psz_path );
+}
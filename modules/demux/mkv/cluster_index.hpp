@@ -0,0 +1,87 @@
+/*****************************************************************************
+ * cluster_index.hpp : matroska demuxer
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_MKV_CLUSTER_INDEX_HPP_
+#define VLC_MKV_CLUSTER_INDEX_HPP_
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+
+#include <vector>
+
+struct mkv_cluster_t
+{
+    int64_t i_position;
+    mtime_t i_time;
+};
+
+/* Scans the clusters of a segment in a low priority thread, on its own
+ * stream, reading only the EBML headers and the cluster timecodes. */
+class cluster_indexer_c
+{
+public:
+    cluster_indexer_c( demux_t *, int64_t i_start_pos, int64_t i_end_pos,
+                       uint64_t i_timescale );
+    ~cluster_indexer_c();
+
+    bool Start();
+    bool IsDone();
+    bool IsComplete();
+
+    /* only valid once IsDone() */
+    std::vector<mkv_cluster_t> clusters;
+
+private:
+    static void *Thread( void * );
+    void Scan();
+    int64_t ScanCluster( int64_t i_cluster_pos, int64_t i_data_pos,
+                         int64_t i_cluster_end );
+    bool Aborted();
+
+    demux_t      *p_demux;
+    stream_t     *s;
+
+    int64_t      i_start_pos;
+    int64_t      i_end_pos;
+    uint64_t     i_timescale;
+
+    bool         is_running;
+    vlc_thread_t thread;
+
+    vlc_mutex_t  lock;
+    bool         b_abort;
+    bool         b_done;
+    bool         b_complete;
+};
+
+/* Cluster indexes are cached in the user cache directory, keyed by the file
+ * path and segment position, and validated with the file size and
+ * modification time. */
+bool ClusterIndexCacheLoad( demux_t *, int64_t i_start_pos, uint64_t i_timescale,
+                            std::vector<mkv_cluster_t> & );
+void ClusterIndexCacheStore( demux_t *, int64_t i_start_pos, uint64_t i_timescale,
+                             const std::vector<mkv_cluster_t> & );
+
+#endif
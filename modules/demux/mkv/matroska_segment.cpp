@@ -50,8 +50,10 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
     ,p_prev_segment_uid(NULL)
     ,p_next_segment_uid(NULL)
     ,b_cues(false)
+    ,b_clusters_indexed(false)
     ,i_index(0)
     ,i_index_max(1024)
+    ,p_indexer(NULL)
     ,psz_muxing_application(NULL)
     ,psz_writing_application(NULL)
     ,psz_segment_filename(NULL)
@@ -68,6 +70,13 @@ matroska_segment_c::matroska_segment_c( demux_sys_t & demuxer, EbmlStream & estr
 
 matroska_segment_c::~matroska_segment_c()
 {
+    if( p_indexer )
+    {
+        /* keep the index if it was completed meanwhile */
+        UpdateClusterIndex();
+        delete p_indexer;
+    }
+
     for( size_t i_track = 0; i_track < tracks.size(); i_track++ )
     {
         delete tracks[i_track]->p_compression_data;
@@ -586,24 +595,87 @@ void matroska_segment_c::InformationCreate( )
  *****************************************************************************/
 
 void matroska_segment_c::IndexAppendCluster( KaxCluster *cluster )
+{
+    IndexAppend( cluster->GetElementPosition(),
+                 cluster->GlobalTimecode() / (mtime_t) 1000 );
+}
+
+void matroska_segment_c::IndexAppend( int64_t i_position, mtime_t i_time )
 {
 #define idx p_indexes[i_index]
     idx.i_track       = -1;
     idx.i_block_number= -1;
-    idx.i_position    = cluster->GetElementPosition();
-    idx.i_time        = cluster->GlobalTimecode()/ (mtime_t) 1000;
+    idx.i_position    = i_position;
+    idx.i_time        = i_time;
     idx.b_key         = true;
 
     i_index++;
     if( i_index >= i_index_max )
     {
-        i_index_max += 1024;
+        i_index_max *= 2;
         p_indexes = (mkv_index_t*)xrealloc( p_indexes,
                                         sizeof( mkv_index_t ) * i_index_max );
     }
 #undef idx
 }
 
+void matroska_segment_c::SetClusterIndex( const std::vector<mkv_cluster_t> & clusters )
+{
+    /* replaces the clusters indexed while playing */
+    i_index = 0;
+    for( size_t i = 0; i < clusters.size(); i++ )
+        IndexAppend( clusters[i].i_position, clusters[i].i_time );
+    b_clusters_indexed = true;
+}
+
+/* Makes seeking in segments without cues precise: the cluster index is
+ * loaded from the cache, or built in background if enabled. */
+void matroska_segment_c::IndexClusters()
+{
+    if( b_cues || b_clusters_indexed || p_indexer )
+        return;
+
+    /* only the segments of the main stream are indexed */
+    if( sys.streams.empty() || &es != sys.streams[0]->p_estream )
+        return;
+
+    std::vector<mkv_cluster_t> clusters;
+    if( ClusterIndexCacheLoad( &sys.demuxer, i_start_pos, i_timescale, clusters ) )
+    {
+        SetClusterIndex( clusters );
+        return;
+    }
+
+    if( !var_InheritBool( &sys.demuxer, "mkv-index-clusters" ) )
+        return;
+
+    int64_t i_end_pos = segment->IsFiniteSize() ? (int64_t)segment->GetEndPosition() : -1;
+    p_indexer = new cluster_indexer_c( &sys.demuxer, i_start_pos, i_end_pos,
+                                       i_timescale );
+    if( !p_indexer->Start() )
+    {
+        delete p_indexer;
+        p_indexer = NULL;
+    }
+}
+
+/* Adopts the cluster index built in background once done */
+bool matroska_segment_c::UpdateClusterIndex()
+{
+    if( !p_indexer || !p_indexer->IsDone() )
+        return false;
+
+    if( p_indexer->IsComplete() )
+    {
+        SetClusterIndex( p_indexer->clusters );
+        ClusterIndexCacheStore( &sys.demuxer, i_start_pos, i_timescale,
+                                p_indexer->clusters );
+    }
+    delete p_indexer;
+    p_indexer = NULL;
+    return b_clusters_indexed;
+}
+
 bool matroska_segment_c::PreloadFamily( const matroska_segment_c & of_segment )
 {
     if ( b_preloaded )
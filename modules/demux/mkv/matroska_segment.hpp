@@ -26,6 +26,7 @@
 #define _MATROSKA_SEGMENT_HPP_
 
 #include "mkv.hpp"
+#include "cluster_index.hpp"
 
 class EbmlParser;
 
@@ -107,9 +108,11 @@ public:
     KaxNextUID              *p_next_segment_uid;
 
     bool                    b_cues;
+    bool                    b_clusters_indexed; /* all clusters are in p_indexes */
     int                     i_index;
     int                     i_index_max;
     mkv_index_t             *p_indexes;
+    cluster_indexer_c       *p_indexer;
 
     /* info */
     char                    *psz_muxing_application;
@@ -143,6 +146,8 @@ public:
                              const KaxBlock *, const KaxSimpleBlock * );
 
     bool Select( mtime_t i_start_time );
+    void IndexClusters();
+    bool UpdateClusterIndex();
     void UnSelect();
 
     static bool CompareSegmentUIDs( const matroska_segment_c * item_a, const matroska_segment_c * item_b );
@@ -161,6 +166,8 @@ private:
     void ParseCluster( bool b_update_start_time = true );
     SimpleTag * ParseSimpleTags( KaxTagSimple *tag, int level = 50 );
     void IndexAppendCluster( KaxCluster *cluster );
+    void IndexAppend( int64_t i_position, mtime_t i_time );
+    void SetClusterIndex( const std::vector<mkv_cluster_t> & clusters );
     int32_t TrackInit( mkv_track_t * p_tk );
     void ComputeTrackPriority();
 };
@@ -66,6 +66,16 @@ vlc_module_begin ()
             N_("Seek based on percent not time"),
             N_("Seek based on percent not time."), true );
 
+    add_bool( "mkv-index-clusters", false,
+            N_("Index clusters in background"),
+            N_("Build an index of the clusters of files without cues in "
+               "background, so that seeking becomes precise."), true );
+
+    add_bool( "mkv-index-cache", true,
+            N_("Cache cluster index"),
+            N_("Store the cluster index of files without cues in the user "
+               "cache directory, to seek precisely when opened again."), true );
+
     add_bool( "mkv-use-dummy", false,
             N_("Dummy Elements"),
             N_("Read and discard unknown EBML elements (not good for broken files)."), true );
@@ -452,11 +462,14 @@ static void Seek( demux_t *p_demux, mtime_t i_date, double f_percent, virtual_ch
         return;
     }
 
+    p_segment->UpdateClusterIndex();
+    const bool b_indexed = p_segment->b_cues || p_segment->b_clusters_indexed;
+
     /* seek without index or without date */
-    if( f_percent >= 0 && (var_InheritBool( p_demux, "mkv-seek-percent" ) || !p_segment->b_cues || i_date < 0 ))
+    if( f_percent >= 0 && (var_InheritBool( p_demux, "mkv-seek-percent" ) || !b_indexed || i_date < 0 ))
     {
         i_date = int64_t( f_percent * p_sys->f_duration * 1000.0 );
-        if( !p_segment->b_cues )
+        if( !b_indexed )
         {
             int64_t i_pos = int64_t( f_percent * stream_Size( p_demux->s ) );
 
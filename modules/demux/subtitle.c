@@ -56,6 +56,10 @@ static void Close( vlc_object_t *p_this );
     N_("Force the subtiles format. Selecting \"auto\" means autodetection and should always work.")
 #define SUB_DESCRIPTION_LONGTEXT \
     N_("Override the default track description.")
+#define SUB_STREAMING_LONGTEXT \
+    N_("Subtitle files larger than this size (in MiB) are parsed " \
+    "progressively during the playback, with an index for seeking, " \
+    "instead of being loaded at once. 0 disables this.")
 
 static const char *const ppsz_sub_type[] =
 {
@@ -82,6 +86,9 @@ vlc_module_begin ()
         change_string_list( ppsz_sub_type, ppsz_sub_type )
     add_string( "sub-description", NULL, N_("Subtitle description"),
                 SUB_DESCRIPTION_LONGTEXT, true )
+    add_integer( "sub-streaming-threshold", 16,
+                 N_("Subtitle streaming threshold"),
+                 SUB_STREAMING_LONGTEXT, true )
     set_callbacks( Open, Close )
 
     add_shortcut( "subtitle" )
@@ -115,24 +122,70 @@ enum
     SUB_TYPE_VTT
 };
 
+/* In streaming mode, the lines are read on demand, and only the last
+ * TEXT_LINES ones are kept (the parsers go back one line at most) */
+#define TEXT_LINES 4
+
 typedef struct
 {
     int     i_line_count;
     int     i_line;
     char    **line;
+
+    stream_t *s;        /* streaming mode */
+    int64_t  *offset;   /* stream offset of each line */
 } text_t;
 
 static int  TextLoad( text_t *, stream_t *s );
+static int  TextOpen( text_t *, stream_t *s );
 static void TextUnload( text_t * );
+static bool TextEOF( text_t * );
+static int64_t TextTell( text_t * );
+static void TextSeek( text_t *, int64_t );
 
 typedef struct
 {
     int64_t i_start;
     int64_t i_stop;
+    int64_t i_offset;   /* in the stream, in streaming mode */
 
     char    *psz_text;
 } subtitle_t;
 
+/* States of the JSS and MPSub parsers */
+typedef struct
+{
+    bool b_inited;
+
+    int i_comment;
+    int i_time_resolution;
+    int i_time_shift;
+} sub_jss_t;
+
+typedef struct
+{
+    bool  b_inited;
+
+    float f_total;
+    float f_factor;
+} sub_mpsub_t;
+
+/* In streaming mode, only SUB_WINDOW subtitles are parsed ahead, and the
+ * parser state is saved every SUB_INDEX_STEP subtitles, to resume parsing
+ * from there when seeking */
+#define SUB_WINDOW     256
+#define SUB_INDEX_STEP 64
+
+typedef struct
+{
+    int64_t i_start;    /* of the subtitle */
+    int64_t i_offset;   /* in the stream */
+    int     i_idx;
+
+    int64_t     i_microsecperframe;
+    sub_jss_t   jss;
+    sub_mpsub_t mpsub;
+} sub_index_t;
 
 struct demux_sys_t
 {
@@ -141,7 +194,6 @@ struct demux_sys_t
     es_out_id_t *es;
 
     int64_t     i_next_demux_date;
-    int64_t     i_microsecperframe;
 
     char        *psz_header;
     int         i_subtitle;
@@ -150,22 +202,19 @@ struct demux_sys_t
 
     int64_t     i_length;
 
-    /* */
-    struct
-    {
-        bool b_inited;
+    /* Streaming mode */
+    bool        b_streaming;
+    bool        b_eof;
+    int         (*pf_read)( demux_t *, subtitle_t*, int );
+    int         i_next_idx;     /* of the next subtitle to parse */
+    int         i_index;
+    int         i_index_max;
+    sub_index_t *index;
 
-        int i_comment;
-        int i_time_resolution;
-        int i_time_shift;
-    } jss;
-    struct
-    {
-        bool  b_inited;
-
-        float f_total;
-        float f_factor;
-    } mpsub;
+    /* Parser state, saved in the index points */
+    int64_t     i_microsecperframe;
+    sub_jss_t   jss;
+    sub_mpsub_t mpsub;
 };
 
 static int  ParseMicroDvd   ( demux_t *, subtitle_t *, int );
@@ -223,6 +272,10 @@ static int Demux( demux_t * );
 static int Control( demux_t *, int, va_list );
 
 static void Fix( demux_t * );
+static int  Refill( demux_t * );
+static const subtitle_t *PeekSubtitle( demux_t * );
+static int  StreamSetTime( demux_t *, int64_t );
+static int  StreamSetPosition( demux_t *, double );
 static char * get_language_from_filename( const char * );
 
 /*****************************************************************************
@@ -255,6 +308,14 @@ static int Open ( vlc_object_t *p_this )
     p_sys->i_subtitles        = 0;
     p_sys->subtitle           = NULL;
     p_sys->i_microsecperframe = 40000;
+    p_sys->es                 = NULL;
+    p_sys->i_length           = 0;
+    p_sys->b_streaming        = false;
+    p_sys->b_eof              = false;
+    p_sys->i_next_idx         = 0;
+    p_sys->i_index            = 0;
+    p_sys->i_index_max        = 0;
+    p_sys->index              = NULL;
 
     p_sys->jss.b_inited       = false;
     p_sys->mpsub.b_inited     = false;
@@ -491,46 +552,71 @@ static int Open ( vlc_object_t *p_this )
         }
     }
 
-    msg_Dbg( p_demux, "loading all subtitles..." );
+    /* Stream the large files, if they can be seeked */
+    bool b_seekable = false;
+    int64_t i_threshold = var_InheritInteger( p_demux,
+                                              "sub-streaming-threshold" );
 
-    /* Load the whole file */
-    TextLoad( &p_sys->txt, p_demux->s );
+    stream_Control( p_demux->s, STREAM_CAN_SEEK, &b_seekable );
+    if( i_threshold > 0 && b_seekable &&
+        stream_Size( p_demux->s ) >= ( i_threshold << 20 ) )
+    {
+        msg_Dbg( p_demux, "streaming the subtitles..." );
 
-    /* Parse it */
-    for( i_max = 0;; )
+        p_sys->b_streaming = true;
+        p_sys->pf_read = pf_read;
+        if( TextOpen( &p_sys->txt, p_demux->s ) )
+        {
+            free( p_sys );
+            return VLC_ENOMEM;
+        }
+        Refill( p_demux );
+
+        msg_Dbg( p_demux, "parsed %d subtitles ahead", p_sys->i_subtitles );
+    }
+    else
     {
-        if( p_sys->i_subtitles >= i_max )
+        msg_Dbg( p_demux, "loading all subtitles..." );
+
+        /* Load the whole file */
+        TextLoad( &p_sys->txt, p_demux->s );
+
+        /* Parse it */
+        for( i_max = 0;; )
         {
-            i_max += 500;
-            if( !( p_sys->subtitle = realloc_or_free( p_sys->subtitle,
-                                              sizeof(subtitle_t) * i_max ) ) )
+            if( p_sys->i_subtitles >= i_max )
             {
-                TextUnload( &p_sys->txt );
-                free( p_sys );
-                return VLC_ENOMEM;
+                i_max += 500;
+                if( !( p_sys->subtitle = realloc_or_free( p_sys->subtitle,
+                                                  sizeof(subtitle_t) * i_max ) ) )
+                {
+                    TextUnload( &p_sys->txt );
+                    free( p_sys );
+                    return VLC_ENOMEM;
+                }
             }
-        }
 
-        if( pf_read( p_demux, &p_sys->subtitle[p_sys->i_subtitles],
-                     p_sys->i_subtitles ) )
-            break;
+            if( pf_read( p_demux, &p_sys->subtitle[p_sys->i_subtitles],
+                         p_sys->i_subtitles ) )
+                break;
 
-        p_sys->i_subtitles++;
-    }
-    /* Unload */
-    TextUnload( &p_sys->txt );
+            p_sys->i_subtitles++;
+        }
+        /* Unload */
+        TextUnload( &p_sys->txt );
 
-    msg_Dbg(p_demux, "loaded %d subtitles", p_sys->i_subtitles );
+        msg_Dbg(p_demux, "loaded %d subtitles", p_sys->i_subtitles );
 
-    /* Fix subtitle (order and time) *** */
-    p_sys->i_subtitle = 0;
-    p_sys->i_length = 0;
-    if( p_sys->i_subtitles > 0 )
-    {
-        p_sys->i_length = p_sys->subtitle[p_sys->i_subtitles-1].i_stop;
-        /* +1 to avoid 0 */
-        if( p_sys->i_length <= 0 )
-            p_sys->i_length = p_sys->subtitle[p_sys->i_subtitles-1].i_start+1;
+        /* Fix subtitle (order and time) *** */
+        p_sys->i_subtitle = 0;
+        p_sys->i_length = 0;
+        if( p_sys->i_subtitles > 0 )
+        {
+            p_sys->i_length = p_sys->subtitle[p_sys->i_subtitles-1].i_stop;
+            /* +1 to avoid 0 */
+            if( p_sys->i_length <= 0 )
+                p_sys->i_length = p_sys->subtitle[p_sys->i_subtitles-1].i_start+1;
+        }
     }
 
     /* *** add subtitle ES *** */
@@ -585,6 +671,9 @@ static void Close( vlc_object_t *p_this )
         free( p_sys->subtitle[i].psz_text );
     free( p_sys->subtitle );
     free( p_sys->psz_header );
+    free( p_sys->index );
+    if( p_sys->b_streaming )
+        TextUnload( &p_sys->txt );
 
     free( p_sys );
 }
@@ -606,16 +695,22 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
             return VLC_SUCCESS;
 
         case DEMUX_GET_TIME:
+        {
+            const subtitle_t *p_subtitle = PeekSubtitle( p_demux );
+
             pi64 = (int64_t*)va_arg( args, int64_t * );
-            if( p_sys->i_subtitle < p_sys->i_subtitles )
+            if( p_subtitle != NULL )
             {
-                *pi64 = p_sys->subtitle[p_sys->i_subtitle].i_start;
+                *pi64 = p_subtitle->i_start;
                 return VLC_SUCCESS;
             }
             return VLC_EGENERIC;
+        }
 
         case DEMUX_SET_TIME:
             i64 = (int64_t)va_arg( args, int64_t );
+            if( p_sys->b_streaming )
+                return StreamSetTime( p_demux, i64 );
             p_sys->i_subtitle = 0;
             while( p_sys->i_subtitle < p_sys->i_subtitles )
             {
@@ -635,7 +730,19 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         case DEMUX_GET_POSITION:
             pf = (double*)va_arg( args, double * );
-            if( p_sys->i_subtitle >= p_sys->i_subtitles )
+            if( p_sys->b_streaming )
+            {   /* The length is not known: the offset of the next subtitle,
+                 * as expected by StreamSetPosition() */
+                const subtitle_t *p_subtitle = PeekSubtitle( p_demux );
+                int64_t i_size = stream_Size( p_demux->s );
+
+                if( p_subtitle == NULL )
+                    *pf = 1.0;
+                else
+                    *pf = i_size > 0 ? (double)p_subtitle->i_offset / i_size
+                                     : 0.0;
+            }
+            else if( p_sys->i_subtitle >= p_sys->i_subtitles )
             {
                 *pf = 1.0;
             }
@@ -652,6 +759,8 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 
         case DEMUX_SET_POSITION:
             f = (double)va_arg( args, double );
+            if( p_sys->b_streaming )
+                return StreamSetPosition( p_demux, f );
             i64 = f * p_sys->i_length;
 
             p_sys->i_subtitle = 0;
@@ -686,26 +795,35 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
 /*****************************************************************************
  * Demux: Send subtitle to decoder
  *****************************************************************************/
+static const subtitle_t *PeekSubtitle( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_sys->i_subtitle >= p_sys->i_subtitles &&
+        ( !p_sys->b_streaming || Refill( p_demux ) <= 0 ) )
+        return NULL;
+    return &p_sys->subtitle[p_sys->i_subtitle];
+}
+
 static int Demux( demux_t *p_demux )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
+    const subtitle_t *p_subtitle;
     int64_t i_maxdate;
 
-    if( p_sys->i_subtitle >= p_sys->i_subtitles )
+    if( ( p_subtitle = PeekSubtitle( p_demux ) ) == NULL )
         return 0;
 
     i_maxdate = p_sys->i_next_demux_date - var_GetTime( p_demux->p_parent, "spu-delay" );;
-    if( i_maxdate <= 0 && p_sys->i_subtitle < p_sys->i_subtitles )
+    if( i_maxdate <= 0 )
     {
         /* Should not happen */
-        i_maxdate = p_sys->subtitle[p_sys->i_subtitle].i_start + 1;
+        i_maxdate = p_subtitle->i_start + 1;
     }
 
-    while( p_sys->i_subtitle < p_sys->i_subtitles &&
-           p_sys->subtitle[p_sys->i_subtitle].i_start < i_maxdate )
+    while( ( p_subtitle = PeekSubtitle( p_demux ) ) != NULL &&
+           p_subtitle->i_start < i_maxdate )
     {
-        const subtitle_t *p_subtitle = &p_sys->subtitle[p_sys->i_subtitle];
-
         block_t *p_block;
         int i_len = strlen( p_subtitle->psz_text ) + 1;
 
@@ -775,6 +893,169 @@ static void Fix( demux_t *p_demux )
     } while( !b_done );
 }
 
+/*****************************************************************************
+ * Streaming mode
+ *****************************************************************************/
+/* Parses the next subtitle, and saves the parser state in the index every
+ * SUB_INDEX_STEP subtitles */
+static int ParseNext( demux_t *p_demux, subtitle_t *p_subtitle )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    sub_index_t point = {
+        .i_offset = TextTell( &p_sys->txt ),
+        .i_idx = p_sys->i_next_idx,
+        .i_microsecperframe = p_sys->i_microsecperframe,
+        .jss = p_sys->jss,
+        .mpsub = p_sys->mpsub,
+    };
+
+    if( p_sys->pf_read( p_demux, p_subtitle, p_sys->i_next_idx ) )
+    {
+        p_sys->b_eof = true;
+        return VLC_EGENERIC;
+    }
+    p_sys->i_next_idx++;
+    p_subtitle->i_offset = point.i_offset;
+
+    /* The length is the one of the subtitles parsed so far */
+    p_sys->i_length = __MAX( p_sys->i_length, p_subtitle->i_start + 1 );
+    p_sys->i_length = __MAX( p_sys->i_length, p_subtitle->i_stop );
+
+    if( point.i_idx % SUB_INDEX_STEP != 0 ||
+        ( p_sys->i_index > 0 &&
+          p_sys->index[p_sys->i_index - 1].i_idx >= point.i_idx ) )
+        return VLC_SUCCESS; /* not an index point, or already indexed */
+
+    if( p_sys->i_index >= p_sys->i_index_max )
+    {
+        int i_max = 2 * p_sys->i_index_max + 64;
+        sub_index_t *p_index = realloc( p_sys->index,
+                                        i_max * sizeof( *p_index ) );
+        if( unlikely(p_index == NULL) )
+            return VLC_SUCCESS;
+        p_sys->index = p_index;
+        p_sys->i_index_max = i_max;
+    }
+    point.i_start = p_subtitle->i_start;
+    p_sys->index[p_sys->i_index++] = point;
+    return VLC_SUCCESS;
+}
+
+static void FlushWindow( demux_sys_t *p_sys )
+{
+    for( int i = 0; i < p_sys->i_subtitles; i++ )
+        free( p_sys->subtitle[i].psz_text );
+    p_sys->i_subtitle = 0;
+    p_sys->i_subtitles = 0;
+}
+
+/* Parses the next SUB_WINDOW subtitles once the previous ones are sent, and
+ * returns the number of subtitles left to send */
+static int Refill( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    if( p_sys->i_subtitle < p_sys->i_subtitles )
+        return p_sys->i_subtitles - p_sys->i_subtitle;
+
+    FlushWindow( p_sys );
+    if( p_sys->subtitle == NULL )
+    {
+        p_sys->subtitle = malloc( SUB_WINDOW * sizeof( subtitle_t ) );
+        if( unlikely(p_sys->subtitle == NULL) )
+            return 0;
+    }
+
+    while( !p_sys->b_eof && p_sys->i_subtitles < SUB_WINDOW &&
+           ParseNext( p_demux, &p_sys->subtitle[p_sys->i_subtitles] )
+               == VLC_SUCCESS )
+        p_sys->i_subtitles++;
+
+    if( p_sys->i_type == SUB_TYPE_SSA1 ||
+        p_sys->i_type == SUB_TYPE_SSA2_4 ||
+        p_sys->i_type == SUB_TYPE_ASS )
+        Fix( p_demux );
+
+    return p_sys->i_subtitles;
+}
+
+/* Restarts the parsing from an index point */
+static void SeekIndex( demux_t *p_demux, const sub_index_t *p_point )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+
+    FlushWindow( p_sys );
+    TextSeek( &p_sys->txt, p_point->i_offset );
+    p_sys->b_eof = false;
+    p_sys->i_next_idx = p_point->i_idx;
+    p_sys->i_microsecperframe = p_point->i_microsecperframe;
+    p_sys->jss = p_point->jss;
+    p_sys->mpsub = p_point->mpsub;
+}
+
+static int StreamSetTime( demux_t *p_demux, int64_t i_time )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const subtitle_t *p_subtitle;
+    int i_point = 0;
+
+    if( p_sys->i_index == 0 )
+        return VLC_EGENERIC;
+
+    /* Take the index point before the last one that starts before the
+     * time, for the earlier subtitles that may still be displayed */
+    for( int i = 0; i < p_sys->i_index; i++ )
+        if( p_sys->index[i].i_start <= i_time )
+            i_point = i;
+    if( i_point > 0 )
+        i_point--;
+
+    /* Go on from the current subtitle if it lies between the point and the
+     * time, the index only covers what has been parsed anyway */
+    p_subtitle = PeekSubtitle( p_demux );
+    int i_idx = p_sys->i_next_idx - ( p_sys->i_subtitles - p_sys->i_subtitle );
+    if( p_subtitle == NULL || p_subtitle->i_start > i_time ||
+        i_idx < p_sys->index[i_point].i_idx )
+        SeekIndex( p_demux, &p_sys->index[i_point] );
+
+    while( ( p_subtitle = PeekSubtitle( p_demux ) ) != NULL )
+    {
+        if( p_subtitle->i_start > i_time )
+            break;
+        if( p_subtitle->i_stop > p_subtitle->i_start &&
+            p_subtitle->i_stop > i_time )
+            break;
+
+        p_sys->i_subtitle++;
+    }
+    return p_subtitle != NULL ? VLC_SUCCESS : VLC_EGENERIC;
+}
+
+/* Seeks to the first subtitle after the byte position */
+static int StreamSetPosition( demux_t *p_demux, double f )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    int64_t i_offset = f * stream_Size( p_demux->s );
+    int i_point = 0;
+
+    if( p_sys->i_index == 0 )
+        return VLC_EGENERIC;
+
+    for( int i = 0; i < p_sys->i_index; i++ )
+        if( p_sys->index[i].i_offset <= i_offset )
+            i_point = i;
+    SeekIndex( p_demux, &p_sys->index[i_point] );
+
+    while( !p_sys->b_eof && TextTell( &p_sys->txt ) < i_offset )
+    {
+        subtitle_t subtitle;
+
+        if( ParseNext( p_demux, &subtitle ) == VLC_SUCCESS )
+            free( subtitle.psz_text );
+    }
+    return PeekSubtitle( p_demux ) != NULL ? VLC_SUCCESS : VLC_EGENERIC;
+}
+
 static int TextLoad( text_t *txt, stream_t *s )
 {
     int   i_line_max;
@@ -783,6 +1064,8 @@ static int TextLoad( text_t *txt, stream_t *s )
     i_line_max          = 500;
     txt->i_line_count   = 0;
     txt->i_line         = 0;
+    txt->s              = NULL;
+    txt->offset         = NULL;
     txt->line           = calloc( i_line_max, sizeof( char * ) );
     if( !txt->line )
         return VLC_ENOMEM;
@@ -813,15 +1096,34 @@ static int TextLoad( text_t *txt, stream_t *s )
 
     return VLC_SUCCESS;
 }
+/* Streaming mode: the lines are read on demand */
+static int TextOpen( text_t *txt, stream_t *s )
+{
+    txt->i_line_count = 0;
+    txt->i_line       = 0;
+    txt->s            = s;
+    txt->line         = calloc( TEXT_LINES, sizeof( char * ) );
+    txt->offset       = calloc( TEXT_LINES, sizeof( int64_t ) );
+    if( !txt->line || !txt->offset )
+    {
+        free( txt->line );
+        free( txt->offset );
+        return VLC_ENOMEM;
+    }
+    return VLC_SUCCESS;
+}
 static void TextUnload( text_t *txt )
 {
-    int i;
+    int i, i_count = txt->i_line_count;
 
-    for( i = 0; i < txt->i_line_count; i++ )
+    if( txt->s != NULL )
+        i_count = __MIN( i_count, TEXT_LINES );
+    for( i = 0; i < i_count; i++ )
     {
         free( txt->line[i] );
     }
     free( txt->line );
+    free( txt->offset );
     txt->i_line       = 0;
     txt->i_line_count = 0;
 }
@@ -829,15 +1131,57 @@ static void TextUnload( text_t *txt )
 static char *TextGetLine( text_t *txt )
 {
     if( txt->i_line >= txt->i_line_count )
-        return( NULL );
+    {
+        if( txt->s == NULL )
+            return( NULL );
 
+        int i_slot = txt->i_line_count % TEXT_LINES;
+        int64_t i_offset = stream_Tell( txt->s );
+        char *psz = stream_ReadLine( txt->s );
+        if( psz == NULL )
+            return( NULL );
+
+        free( txt->line[i_slot] );
+        txt->line[i_slot] = psz;
+        txt->offset[i_slot] = i_offset;
+        txt->i_line_count++;
+    }
+
+    if( txt->s != NULL )
+        return txt->line[txt->i_line++ % TEXT_LINES];
     return txt->line[txt->i_line++];
 }
 static void TextPreviousLine( text_t *txt )
 {
-    if( txt->i_line > 0 )
+    if( txt->i_line > 0 &&
+        ( txt->s == NULL || txt->i_line_count - txt->i_line < TEXT_LINES ) )
         txt->i_line--;
 }
+static bool TextEOF( text_t *txt )
+{
+    const uint8_t *p_peek;
+
+    return txt->i_line >= txt->i_line_count &&
+           ( txt->s == NULL || stream_Peek( txt->s, &p_peek, 1 ) < 1 );
+}
+/* Streaming mode: offset of the next line */
+static int64_t TextTell( text_t *txt )
+{
+    if( txt->i_line < txt->i_line_count )
+        return txt->offset[txt->i_line % TEXT_LINES];
+    return stream_Tell( txt->s );
+}
+static void TextSeek( text_t *txt, int64_t i_offset )
+{
+    for( int i = 0; i < TEXT_LINES; i++ )
+    {
+        free( txt->line[i] );
+        txt->line[i] = NULL;
+    }
+    txt->i_line       = 0;
+    txt->i_line_count = 0;
+    stream_Seek( txt->s, i_offset );
+}
 
 /*****************************************************************************
  * Specific Subtitle function
@@ -1155,6 +1499,10 @@ static int  ParseSSA( demux_t *p_demux, subtitle_t *p_subtitle,
         }
         free( psz_text );
 
+        /* The header is only used to create the ES (streaming mode) */
+        if( p_sys->es != NULL )
+            continue;
+
         /* All the other stuff we add to the header field */
         if( header_len == 0 && p_sys->psz_header )
             header_len = strlen( p_sys->psz_header );
@@ -1506,7 +1854,7 @@ static int ParseAQT( demux_t *p_demux, subtitle_t *p_subtitle, int i_idx )
                  return VLC_ENOMEM;
             strcat( psz_text, s );
             strcat( psz_text, "\n" );
-            if( txt->i_line == txt->i_line_count )
+            if( TextEOF( txt ) )
                 break;
         }
     }
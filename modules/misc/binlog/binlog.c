@@ -0,0 +1,466 @@
+/*****************************************************************************
+ * binlog.c: binary log records
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "binlog.h"
+
+enum
+{
+    LENGTH_NONE,
+    LENGTH_HH,
+    LENGTH_H,
+    LENGTH_L,
+    LENGTH_LL,
+    LENGTH_J,
+    LENGTH_Z,
+    LENGTH_T,
+    LENGTH_LONG_DOUBLE,
+};
+
+/* printf() conversion specification */
+struct spec
+{
+    size_t prefix;       /**< length of the flags and of the width */
+    size_t precision;    /**< length of the precision, with the dot */
+    bool width_arg;      /**< width passed as an argument */
+    bool precision_arg;  /**< precision passed as an argument */
+    int prec;            /**< literal precision, or -1 */
+    int length;          /**< LENGTH_* modifier */
+    char conv;           /**< conversion specifier */
+};
+
+/**
+ * Parses a conversion specification, after its percent sign.
+ * Positional arguments and wide characters are not supported.
+ * @return the end of the specification, or NULL if not supported
+ */
+static const char *ParseSpec(const char *p, struct spec *s)
+{
+    const char *start = p;
+
+    while (*p != '\0' && strchr("-+ #0'", *p) != NULL)
+        p++;
+    s->width_arg = *p == '*';
+    if (s->width_arg)
+        p++;
+    else
+        while (*p >= '0' && *p <= '9')
+            p++;
+    s->prefix = p - start;
+
+    s->prec = -1;
+    s->precision_arg = false;
+    s->precision = 0;
+    if (*p == '.')
+    {
+        const char *dot = p++;
+
+        if (*p == '*')
+        {
+            s->precision_arg = true;
+            p++;
+        }
+        else
+            for (s->prec = 0; *p >= '0' && *p <= '9'; p++)
+                s->prec = s->prec * 10 + (*p - '0');
+        s->precision = p - dot;
+    }
+
+    switch (*p)
+    {
+        case 'h':
+            s->length = (p[1] == 'h') ? LENGTH_HH : LENGTH_H;
+            p += (p[1] == 'h') ? 2 : 1;
+            break;
+        case 'l':
+            s->length = (p[1] == 'l') ? LENGTH_LL : LENGTH_L;
+            p += (p[1] == 'l') ? 2 : 1;
+            break;
+        case 'q':
+            s->length = LENGTH_LL;
+            p++;
+            break;
+        case 'j':
+            s->length = LENGTH_J;
+            p++;
+            break;
+        case 'z':
+            s->length = LENGTH_Z;
+            p++;
+            break;
+        case 't':
+            s->length = LENGTH_T;
+            p++;
+            break;
+        case 'L':
+            s->length = LENGTH_LONG_DOUBLE;
+            p++;
+            break;
+        default:
+            s->length = LENGTH_NONE;
+    }
+
+    s->conv = *p;
+    switch (s->conv)
+    {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            if (s->length == LENGTH_LONG_DOUBLE)
+                return NULL;
+            break;
+        case 'e': case 'E': case 'f': case 'F':
+        case 'g': case 'G': case 'a': case 'A':
+            if (s->length != LENGTH_NONE && s->length != LENGTH_L
+             && s->length != LENGTH_LONG_DOUBLE)
+                return NULL;
+            break;
+        case 'c': case 's': case 'p':
+            if (s->length != LENGTH_NONE)
+                return NULL;
+            break;
+        case '%':
+            if (p != start)
+                return NULL;
+            break;
+        default:
+            return NULL;
+    }
+    return p + 1;
+}
+
+static int64_t GetInt(const struct spec *s, va_list *ap)
+{
+    if (s->conv == 'd' || s->conv == 'i')
+        switch (s->length)
+        {
+            case LENGTH_HH: return (signed char)va_arg(*ap, int);
+            case LENGTH_H:  return (short)va_arg(*ap, int);
+            case LENGTH_L:  return va_arg(*ap, long);
+            case LENGTH_LL: return va_arg(*ap, long long);
+            case LENGTH_J:  return va_arg(*ap, intmax_t);
+            case LENGTH_Z:  return (ptrdiff_t)va_arg(*ap, size_t);
+            case LENGTH_T:  return va_arg(*ap, ptrdiff_t);
+            default:        return va_arg(*ap, int);
+        }
+
+    if (s->conv == 'c')
+        return va_arg(*ap, int);
+
+    switch (s->length)
+    {
+        case LENGTH_HH: return (unsigned char)va_arg(*ap, unsigned);
+        case LENGTH_H:  return (unsigned short)va_arg(*ap, unsigned);
+        case LENGTH_L:  return va_arg(*ap, unsigned long);
+        case LENGTH_LL: return va_arg(*ap, unsigned long long);
+        case LENGTH_J:  return va_arg(*ap, uintmax_t);
+        case LENGTH_Z:  return va_arg(*ap, size_t);
+        case LENGTH_T:  return (size_t)va_arg(*ap, ptrdiff_t);
+        default:        return va_arg(*ap, unsigned);
+    }
+}
+
+/**
+ * Walks the arguments of a format, and stores them if buf is not NULL.
+ * @return the size of the arguments, or -1 if the format is not supported
+ */
+static long WalkArgs(uint8_t *buf, const char *format, va_list *ap)
+{
+    long size = 0;
+
+#define PUT(tag, ptr, len) \
+    do { \
+        if (buf != NULL) \
+        { \
+            buf[size] = tag; \
+            memcpy(buf + size + 1, ptr, len); \
+        } \
+        size += 1 + (len); \
+    } while (0)
+
+    for (const char *p = strchr(format, '%'); p != NULL; p = strchr(p, '%'))
+    {
+        struct spec s;
+        int prec;
+
+        p = ParseSpec(p + 1, &s);
+        if (p == NULL)
+            return -1;
+        if (s.conv == '%')
+            continue;
+
+        if (s.width_arg)
+        {
+            int64_t width = va_arg(*ap, int);
+            PUT(BINLOG_ARG_INT, &width, 8);
+        }
+        prec = s.prec;
+        if (s.precision_arg)
+        {
+            int64_t val = va_arg(*ap, int);
+            PUT(BINLOG_ARG_INT, &val, 8);
+            prec = val;
+        }
+
+        switch (s.conv)
+        {
+            case 's':
+            {
+                const char *str = va_arg(*ap, const char *);
+                uint32_t len = BINLOG_NULL;
+
+                if (str != NULL)
+                    len = (prec >= 0) ? strnlen(str, prec) : strlen(str);
+                if (buf != NULL)
+                {
+                    buf[size] = BINLOG_ARG_STRING;
+                    memcpy(buf + size + 1, &len, 4);
+                    if (str != NULL)
+                        memcpy(buf + size + 5, str, len);
+                }
+                size += 5 + ((str != NULL) ? len : 0);
+                break;
+            }
+            case 'p':
+            {
+                uint64_t ptr = (uintptr_t)va_arg(*ap, void *);
+                PUT(BINLOG_ARG_PTR, &ptr, 8);
+                break;
+            }
+            case 'e': case 'E': case 'f': case 'F':
+            case 'g': case 'G': case 'a': case 'A':
+            {
+                double val = (s.length == LENGTH_LONG_DOUBLE)
+                           ? va_arg(*ap, long double) : va_arg(*ap, double);
+                PUT(BINLOG_ARG_DOUBLE, &val, 8);
+                break;
+            }
+            default:
+            {
+                int64_t val = GetInt(&s, ap);
+                PUT(BINLOG_ARG_INT, &val, 8);
+            }
+        }
+    }
+#undef PUT
+    return size;
+}
+
+long binlog_ArgsSize(const char *format, va_list ap)
+{
+    va_list aq;
+    long size;
+
+    va_copy(aq, ap);
+    size = WalkArgs(NULL, format, &aq);
+    va_end(aq);
+    return size;
+}
+
+void binlog_StoreArgs(uint8_t *buf, const char *format, va_list ap)
+{
+    va_list aq;
+
+    va_copy(aq, ap);
+    WalkArgs(buf, format, &aq);
+    va_end(aq);
+}
+
+/* Reads the next stored argument */
+static const uint8_t *GetArg(const uint8_t *args, const uint8_t *end,
+                             char tag, void *val)
+{
+    if (end - args < 9 || args[0] != tag)
+        return NULL;
+    memcpy(val, args + 1, 8);
+    return args + 9;
+}
+
+int binlog_Print(FILE *stream, const char *format,
+                 const uint8_t *args, size_t size)
+{
+    const uint8_t *end = args + size;
+    const char *p = format;
+
+    for (;;)
+    {
+        const char *pct = strchr(p, '%');
+        struct spec s;
+
+        if (pct == NULL)
+        {
+            fputs(p, stream);
+            break;
+        }
+        fwrite(p, 1, pct - p, stream);
+
+        p = ParseSpec(pct + 1, &s);
+        if (p == NULL)
+            return -1;
+        if (s.conv == '%')
+        {
+            putc('%', stream);
+            continue;
+        }
+
+        /* Same flags, width and precision, with the stored type */
+        char spec[64];
+        int stars[2], nstars = 0;
+        int64_t val;
+
+        if (s.prefix + s.precision > sizeof (spec) - 8)
+            return -1;
+        spec[0] = '%';
+        memcpy(spec + 1, pct + 1, s.prefix + s.precision);
+
+        size_t len = 1 + s.prefix + s.precision;
+        if (s.width_arg)
+        {
+            args = GetArg(args, end, BINLOG_ARG_INT, &val);
+            if (args == NULL)
+                return -1;
+            stars[nstars++] = val;
+        }
+        if (s.precision_arg)
+        {
+            args = GetArg(args, end, BINLOG_ARG_INT, &val);
+            if (args == NULL)
+                return -1;
+            stars[nstars++] = val;
+        }
+
+#define PRINT(v) \
+    (nstars == 0 ? fprintf(stream, spec, v) \
+   : nstars == 1 ? fprintf(stream, spec, stars[0], v) \
+                 : fprintf(stream, spec, stars[0], stars[1], v))
+
+        switch (s.conv)
+        {
+            case 's':
+            {
+                uint32_t slen;
+
+                if (end - args < 5 || args[0] != BINLOG_ARG_STRING)
+                    return -1;
+                memcpy(&slen, args + 1, 4);
+                args += 5;
+
+                const char *str = (const char *)args;
+                if (slen == BINLOG_NULL)
+                {
+                    str = "(null)";
+                    slen = 6;
+                }
+                else if ((size_t)(end - args) < slen)
+                    return -1;
+                else
+                    args += slen;
+
+                /* The string is stored truncated: the precision is its length */
+                if (s.precision_arg)
+                    nstars--;
+                len -= s.precision;
+                memcpy(spec + len, ".*s", 4);
+                stars[nstars++] = slen;
+                if (nstars == 1)
+                    fprintf(stream, spec, stars[0], str);
+                else
+                    fprintf(stream, spec, stars[0], stars[1], str);
+                break;
+            }
+            case 'p':
+            {
+                uint64_t ptr;
+
+                args = GetArg(args, end, BINLOG_ARG_PTR, &ptr);
+                if (args == NULL)
+                    return -1;
+                memcpy(spec + len, "p", 2);
+                PRINT((void *)(uintptr_t)ptr);
+                break;
+            }
+            case 'e': case 'E': case 'f': case 'F':
+            case 'g': case 'G': case 'a': case 'A':
+            {
+                double d;
+
+                args = GetArg(args, end, BINLOG_ARG_DOUBLE, &d);
+                if (args == NULL)
+                    return -1;
+                spec[len] = s.conv;
+                spec[len + 1] = '\0';
+                PRINT(d);
+                break;
+            }
+            case 'c':
+                args = GetArg(args, end, BINLOG_ARG_INT, &val);
+                if (args == NULL)
+                    return -1;
+                memcpy(spec + len, "c", 2);
+                PRINT((int)val);
+                break;
+            case 'd': case 'i':
+                args = GetArg(args, end, BINLOG_ARG_INT, &val);
+                if (args == NULL)
+                    return -1;
+                spec[len] = spec[len + 1] = 'l';
+                spec[len + 2] = s.conv;
+                spec[len + 3] = '\0';
+                PRINT((long long)val);
+                break;
+            default:
+                args = GetArg(args, end, BINLOG_ARG_INT, &val);
+                if (args == NULL)
+                    return -1;
+                spec[len] = spec[len + 1] = 'l';
+                spec[len + 2] = s.conv;
+                spec[len + 3] = '\0';
+                PRINT((unsigned long long)val);
+        }
+#undef PRINT
+    }
+    return 0;
+}
+
+const uint8_t *binlog_Strings(const struct binlog_record *rec,
+                              const char *strings[4])
+{
+    const char *str = (const char *)(rec + 1);
+    size_t size = sizeof (*rec) + rec->args_size;
+
+    if (rec->kind != BINLOG_MESSAGE || size > rec->size)
+        return NULL;
+    for (unsigned i = 0; i < 4; i++)
+    {
+        size += rec->lengths[i] + 1;
+        if (size > rec->size || str[rec->lengths[i]] != '\0')
+            return NULL;
+        strings[i] = str;
+        str += rec->lengths[i] + 1;
+    }
+    return (const uint8_t *)str;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file binlog.h
+ * @brief Binary log records
+ */
+/*****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_BINLOG_H
+#define VLC_BINLOG_H 1
+
+/*
+ * A binary log message keeps the printf() format string of the message and
+ * its arguments as they were passed, instead of the formatted text: the
+ * emitting thread only copies them, and the text is only made when the log
+ * is read, if ever.
+ *
+ * A log file is a sequence of sessions. A session starts with BINLOG_MAGIC
+ * and a BINLOG_START record, followed by any number of records. Each record
+ * starts with a struct binlog_record, in the byte order of the writer, and
+ * its size is a multiple of 8 bytes. A message record is followed by:
+ *  - the module, the object type, the header and the format strings, each
+ *    with a nul terminator,
+ *  - the arguments, each made of a type byte (BINLOG_ARG_*) and of a value:
+ *    64-bits integers and pointers, doubles, or strings as a 32-bits length
+ *    and the characters without terminator (BINLOG_NULL for NULL),
+ *  - padding.
+ * Everything is stored unaligned.
+ *
+ * This file and binlog.c only depend on the standard C library, so that they
+ * can be built into the reading tools as is.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define BINLOG_MAGIC      "VLCBLOG\n"
+#define BINLOG_VERSION    1
+#define BINLOG_BYTE_ORDER 0x01020304
+
+/* Record kinds */
+#define BINLOG_START    1 /**< session start, see binlog_start */
+#define BINLOG_MESSAGE  2 /**< log message */
+#define BINLOG_DROPPED  3 /**< count of the messages a thread dropped */
+#define BINLOG_PADDING  4 /**< nothing, only in memory */
+
+/* Argument types */
+#define BINLOG_ARG_INT    'i'
+#define BINLOG_ARG_DOUBLE 'd'
+#define BINLOG_ARG_PTR    'p'
+#define BINLOG_ARG_STRING 's'
+
+#define BINLOG_NULL UINT32_MAX
+
+struct binlog_record
+{
+    uint32_t size;       /**< of the whole record, in bytes */
+    uint8_t  kind;       /**< BINLOG_* record kind */
+    uint8_t  type;       /**< VLC_MSG_* message type */
+    uint16_t reserved;
+    uint32_t thread;     /**< number of the emitting thread */
+    uint32_t args_size;  /**< arguments size, in bytes */
+    int64_t  date;       /**< monotonic clock, in microseconds */
+    uint64_t object;     /**< object ID, or count of dropped messages */
+    uint16_t lengths[4]; /**< module, object type, header and format */
+};
+
+/* Payload of BINLOG_START records */
+struct binlog_start
+{
+    uint32_t version;    /**< BINLOG_VERSION */
+    uint32_t byte_order; /**< BINLOG_BYTE_ORDER */
+    int64_t  time;       /**< wall clock at the record date, in microseconds
+                              since the Epoch */
+};
+
+#define BINLOG_ALIGN(size) (((size) + 7) & ~(size_t)7)
+
+/**
+ * Computes the size of the arguments of a message.
+ *
+ * @return the size in bytes, or -1 if the format is not supported (the
+ * message should then be formatted and stored with the "%s" format)
+ */
+long binlog_ArgsSize(const char *format, va_list ap);
+
+/**
+ * Stores the arguments of a message, as many bytes as binlog_ArgsSize()
+ * returned for the same format and arguments.
+ */
+void binlog_StoreArgs(uint8_t *buf, const char *format, va_list ap);
+
+/**
+ * Prints a message from its format and its stored arguments.
+ *
+ * @return 0 on success, -1 if the arguments do not match the format
+ */
+int binlog_Print(FILE *stream, const char *format,
+                 const uint8_t *args, size_t size);
+
+/**
+ * Gets the strings of a message record.
+ *
+ * @param strings the module, object type, header and format, on return
+ * @return the arguments, or NULL if the record is malformed
+ */
+const uint8_t *binlog_Strings(const struct binlog_record *rec,
+                              const char *strings[4]);
+
+#endif
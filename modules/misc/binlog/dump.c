@@ -0,0 +1,216 @@
+/*****************************************************************************
+ * dump.c: binary log reader
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Prints the binary logs of the logger module (--logmode=binary) as text.
+ * Usage: vlc-logdump [-v verbosity] [-t thread] [file...] */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "binlog.h"
+
+#define MAX_RECORD (16 << 20)
+
+static const char type_names[4][9] = { "", " error", " warning", " debug" };
+
+static int verbosity = 2;
+static long thread = -1;
+
+struct session
+{
+    int64_t date; /**< monotonic date of the start */
+    int64_t time; /**< wall clock of the start */
+};
+
+static void PrintDate(const struct session *s, int64_t date)
+{
+    int64_t us = s->time + (date - s->date);
+    time_t sec = us / 1000000;
+    struct tm tm;
+    char buf[32];
+
+    if (localtime_r(&sec, &tm) == NULL
+     || strftime(buf, sizeof (buf), "%Y-%m-%d %H:%M:%S", &tm) == 0)
+        strcpy(buf, "?");
+    printf("%s.%06u ", buf, (unsigned)(us % 1000000));
+}
+
+static int PrintRecord(const struct session *s, const struct binlog_record *rec)
+{
+    if (thread >= 0 && rec->thread != thread)
+        return 0;
+
+    switch (rec->kind)
+    {
+        case BINLOG_MESSAGE:
+        {
+            const char *strings[4];
+            const uint8_t *args = binlog_Strings(rec, strings);
+
+            if (args == NULL || rec->type > 3)
+                return -1;
+            if (verbosity < rec->type - 1)
+                return 0;
+            PrintDate(s, rec->date);
+            printf("[%"PRIu32"] [%0*"PRIx64"] ", rec->thread,
+                   (int)(2 * sizeof (void *)), rec->object);
+            if (strings[2][0] != '\0')
+                printf("[%s] ", strings[2]);
+            printf("%s %s%s: ", strings[0], strings[1], type_names[rec->type]);
+            if (binlog_Print(stdout, strings[3], args, rec->args_size))
+                fputs("(malformed arguments)", stdout);
+            putchar('\n');
+            break;
+        }
+        case BINLOG_DROPPED:
+            PrintDate(s, rec->date);
+            printf("[%"PRIu32"] -- %"PRIu64" messages dropped --\n",
+                   rec->thread, rec->object);
+            break;
+    }
+    return 0;
+}
+
+static int Dump(FILE *stream, const char *name)
+{
+    struct session session = { 0, 0 };
+    struct binlog_record *rec = malloc(MAX_RECORD);
+    bool started = false;
+    int ret = -1;
+
+    if (rec == NULL)
+        return -1;
+
+    for (;;)
+    {
+        size_t len = fread(rec, 1, 8, stream);
+        if (len == 0)
+        {
+            ret = 0;
+            break;
+        }
+        if (len < 8)
+            goto truncated;
+
+        if (!memcmp(rec, BINLOG_MAGIC, 8))
+        {
+            struct binlog_start start;
+
+            if (fread(rec, 1, sizeof (*rec), stream) != sizeof (*rec)
+             || fread(&start, 1, sizeof (start), stream) != sizeof (start))
+                goto truncated;
+            if (start.byte_order != BINLOG_BYTE_ORDER)
+            {
+                fprintf(stderr, "%s: unsupported byte order\n", name);
+                break;
+            }
+            if (start.version != BINLOG_VERSION)
+            {
+                fprintf(stderr, "%s: unsupported version %"PRIu32"\n", name,
+                        start.version);
+                break;
+            }
+            if (rec->kind != BINLOG_START
+             || rec->size != sizeof (*rec) + sizeof (start))
+                goto malformed;
+            session.date = rec->date;
+            session.time = start.time;
+            started = true;
+            continue;
+        }
+
+        if (!started || rec->size < sizeof (*rec) || rec->size % 8
+         || rec->size > MAX_RECORD)
+            goto malformed;
+        if (fread((char *)rec + 8, 1, rec->size - 8, stream) != rec->size - 8)
+            goto truncated;
+        if (PrintRecord(&session, rec))
+            goto malformed;
+    }
+    free(rec);
+    return ret;
+
+truncated:
+    /* The last messages of a crashed process */
+    fprintf(stderr, "%s: truncated record\n", name);
+    free(rec);
+    return 0;
+malformed:
+    fprintf(stderr, "%s: malformed record\n", name);
+    free(rec);
+    return -1;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-v verbosity] [-t thread] [file...]\n"
+            "Prints VLC binary logs as text.\n"
+            "  -v verbosity  0: errors and information, 1: and warnings,\n"
+            "                2: and debug messages (default)\n"
+            "  -t thread     only the messages of this thread number\n",
+            name);
+}
+
+int main(int argc, char *argv[])
+{
+    int c, ret = 0;
+
+    while ((c = getopt(argc, argv, "hv:t:")) != -1)
+        switch (c)
+        {
+            case 'v':
+                verbosity = atoi(optarg);
+                break;
+            case 't':
+                thread = strtol(optarg, NULL, 0);
+                break;
+            default:
+                Usage(argv[0]);
+                return c != 'h';
+        }
+
+    if (optind == argc)
+        return Dump(stdin, "stdin") ? 1 : 0;
+
+    for (int i = optind; i < argc; i++)
+    {
+        FILE *stream = fopen(argv[i], "rb");
+
+        if (stream == NULL)
+        {
+            perror(argv[i]);
+            ret = 1;
+            continue;
+        }
+        if (Dump(stream, argv[i]))
+            ret = 1;
+        fclose(stream);
+    }
+    return ret;
+}
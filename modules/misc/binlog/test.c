@@ -0,0 +1,125 @@
+/*****************************************************************************
+ * test.c: binary log records test
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "binlog.h"
+
+static unsigned count;
+
+/* Stores the arguments, prints them back, and compares with vsnprintf() */
+static void Check(const char *format, ...)
+{
+    va_list ap;
+    char expected[512], *text;
+    size_t textlen;
+
+    va_start(ap, format);
+    vsnprintf(expected, sizeof (expected), format, ap);
+    va_end(ap);
+
+    va_start(ap, format);
+    long size = binlog_ArgsSize(format, ap);
+    assert(size >= 0);
+    uint8_t *args = malloc(size + 1);
+    assert(args != NULL);
+    binlog_StoreArgs(args, format, ap);
+    va_end(ap);
+
+    FILE *stream = open_memstream(&text, &textlen);
+    assert(stream != NULL);
+    assert(binlog_Print(stream, format, args, size) == 0);
+    fclose(stream);
+    if (strcmp(text, expected))
+    {
+        fprintf(stderr, "format \"%s\": got \"%s\", expected \"%s\"\n",
+                format, text, expected);
+        abort();
+    }
+
+    /* Missing arguments */
+    if (size > 0)
+    {
+        stream = fopen("/dev/null", "w");
+        assert(binlog_Print(stream, format, args, size - 1) == -1);
+        fclose(stream);
+    }
+    free(text);
+    free(args);
+    count++;
+}
+
+static void Unsupported(const char *format, ...)
+{
+    va_list ap;
+
+    va_start(ap, format);
+    assert(binlog_ArgsSize(format, ap) == -1);
+    va_end(ap);
+}
+
+int main(void)
+{
+    char fourcc[4] = { 'h', '2', '6', '4' }; /* not terminated */
+
+    Check("no arguments");
+    Check("100%% sure");
+    Check("%d %i %u %x %X %o", -42, 42, 42u, 0xbeefu, 0xbeefu, 8u);
+    Check("%hhd %hhu %hd %hu", -1, 255, -1, 65535);
+    Check("%ld %lu %lld %llx", -123456789L, 123456789UL,
+          -1234567890123LL, 0xdeadbeefcafeULL);
+    Check("%"PRId64" %"PRIu64" %"PRIx32" %"PRIdMAX, INT64_MIN, UINT64_MAX,
+          UINT32_C(0xcafe), INTMAX_MAX);
+    Check("%zu %zd %td %jd", (size_t)12345, (ssize_t)-1, (ptrdiff_t)-7,
+          (intmax_t)-99);
+    Check("%5d|%-5d|%05d|%+d|% d|%#x|%.3d", 1, 2, 3, 4, 5, 6u, 7);
+    Check("%*d|%-*d|%.*d|%*.*d", 6, 1, 6, 2, 4, 3, 8, 4, 5);
+    Check("%f %.2f %e %g %10.3E %a %G", 3.25, 2.0 / 3, 1e300, 1e-5,
+          -6.02e23, 0.5, 1e10);
+    Check("%Lf %Lg", 1.5L, 3e100L);
+    Check("%s and %s", "this", "that");
+    Check("%.4s codec, %.*s", fourcc, 3, "abcdef");
+    Check("%-10s|%10s|%*s|%-*.*s|", "left", "right", 7, "star", 6, 2, "xyz");
+    Check("%s", (const char *)NULL);
+    Check("%c%c%c", 'v', 'l', 'c');
+    Check("%p %p", (void *)0x1234, (void *)NULL);
+    Check("unicode: %s", "\xc3\xa9t\xc3\xa9");
+    Check("%d%%", 50);
+
+    Unsupported("%1$s", "positional");
+    Unsupported("%ls", L"wide");
+    Unsupported("%n", &count);
+    Unsupported("trailing %");
+
+    printf("%u formats checked\n", count);
+    return 0;
+}
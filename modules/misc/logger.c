@@ -34,10 +34,14 @@
 #include <vlc_interface.h>
 #include <vlc_fs.h>
 #include <vlc_charset.h>
+#include <vlc_atomic.h>
 
 #include <stdarg.h>
 #include <assert.h>
 #include <errno.h>
+#include <sys/time.h>
+
+#include "binlog/binlog.h"
 
 #ifdef __ANDROID__
 # include <android/log.h>
@@ -45,6 +49,10 @@
 
 #define LOG_FILE_TEXT "vlc-log.txt"
 #define LOG_FILE_HTML "vlc-log.html"
+#define LOG_FILE_BINARY "vlc-log.bin"
+
+/* Longest time between two writes of the asynchronous messages */
+#define LOG_PERIOD (CLOCK_FREQ / 10)
 
 #define TEXT_HEADER "\xEF\xBB\xBF-- logger module started --\n"
 #define TEXT_FOOTER "-- logger module stopped --\n"
@@ -73,11 +81,46 @@
 /*****************************************************************************
  * intf_sys_t: description and status of log interface
  *****************************************************************************/
+
+/*
+ * With asynchronous logging, each thread copies the format string and the
+ * arguments of its messages in its own ring, without locks nor formatting,
+ * and the logger thread writes them, formatted or not, mostly in date order.
+ * When a ring is full, messages are dropped and counted.
+ */
+typedef struct log_ring_t log_ring_t;
+
+struct log_ring_t
+{
+    log_ring_t *next;        /**< in the rings of the logger */
+    log_ring_t *all_next;    /**< in the rings of all the loggers */
+    uint32_t id;             /**< thread number */
+    size_t size;             /**< power of two */
+    uint8_t *data;
+    atomic_size_t head;      /**< written by the thread */
+    atomic_size_t tail;      /**< written by the logger thread */
+    atomic_uint dropped;     /**< written by the thread */
+    unsigned reported;       /**< dropped messages already written */
+    atomic_bool exited;      /**< the thread is gone */
+};
+
 struct intf_sys_t
 {
     FILE *p_file;
     const char *footer;
     char *ident;
+    int verbosity;
+
+    /* Asynchronous logging */
+    void (*write)( intf_thread_t *, const struct binlog_record * );
+    vlc_threadvar_t ring_key;
+    size_t ring_size;
+    uint32_t ring_count;
+    log_ring_t *rings;       /**< with lock */
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    bool stop;
+    vlc_thread_t thread;
 };
 
 /*****************************************************************************
@@ -88,6 +131,12 @@ static void Close   ( vlc_object_t * );
 
 static void TextPrint(void *, int, const vlc_log_t *, const char *, va_list);
 static void HtmlPrint(void *, int, const vlc_log_t *, const char *, va_list);
+static void AsyncPrint(void *, int, const vlc_log_t *, const char *, va_list);
+static void TextWrite( intf_thread_t *, const struct binlog_record * );
+static void HtmlWrite( intf_thread_t *, const struct binlog_record * );
+static void BinaryWrite( intf_thread_t *, const struct binlog_record * );
+static int  AsyncStart( intf_thread_t * );
+static void AsyncStop( intf_thread_t * );
 #ifdef HAVE_SYSLOG_H
 static void SyslogPrint(void *, int, const vlc_log_t *, const char *, va_list);
 #endif
@@ -98,7 +147,7 @@ static void AndroidPrint(void *, int, const vlc_log_t *, const char *, va_list);
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
-static const char *const mode_list[] = { "text", "html"
+static const char *const mode_list[] = { "text", "html", "binary"
 #ifdef HAVE_SYSLOG_H
 ,"syslog"
 #endif
@@ -106,7 +155,7 @@ static const char *const mode_list[] = { "text", "html"
 ,"android"
 #endif
 };
-static const char *const mode_list_text[] = { N_("Text"), "HTML"
+static const char *const mode_list_text[] = { N_("Text"), "HTML", N_("Binary")
 #ifdef HAVE_SYSLOG_H
 , "syslog"
 #endif
@@ -116,7 +165,17 @@ static const char *const mode_list_text[] = { N_("Text"), "HTML"
 };
 
 #define LOGMODE_TEXT N_("Log format")
-#define LOGMODE_LONGTEXT N_("Specify the logging format.")
+#define LOGMODE_LONGTEXT N_("Specify the logging format. Binary logs " \
+  "are written asynchronously, and can be read with vlc-logdump.")
+
+#define LOGASYNC_TEXT N_("Asynchronous logging")
+#define LOGASYNC_LONGTEXT N_("The messages are copied by the threads that " \
+  "emit them, and formatted and written by a background thread. Messages " \
+  "are dropped when a thread emits them faster than they are written.")
+
+#define LOGBUFFER_TEXT N_("Log buffer per thread (KiB)")
+#define LOGBUFFER_LONGTEXT N_("Size of the buffer of the messages of each " \
+  "thread, with asynchronous logging.")
 
 #ifdef HAVE_SYSLOG_H
 #define SYSLOG_IDENT_TEXT N_("Syslog ident")
@@ -176,6 +235,9 @@ vlc_module_begin ()
 #endif
     add_integer( "log-verbose", -1, LOGVERBOSE_TEXT, LOGVERBOSE_LONGTEXT,
            false )
+    add_bool( "log-async", false, LOGASYNC_TEXT, LOGASYNC_LONGTEXT, true )
+    add_integer_with_range( "log-buffer", 64, 4, 16384, LOGBUFFER_TEXT,
+                            LOGBUFFER_LONGTEXT, true )
     
     add_obsolete_string( "rrd-file" )
 
@@ -200,10 +262,15 @@ static int Open( vlc_object_t *p_this )
         return VLC_ENOMEM;
 
     p_sys->p_file = NULL;
+    p_sys->write = NULL;
     vlc_log_cb cb = TextPrint;
     const char *filename = LOG_FILE_TEXT, *header = TEXT_HEADER;
     p_sys->footer = TEXT_FOOTER;
 
+    p_sys->verbosity = var_InheritInteger( p_intf, "log-verbose" );
+    if( p_sys->verbosity == -1 )
+        p_sys->verbosity = var_InheritInteger( p_intf, "verbose" );
+
     char *mode = var_InheritString( p_intf, "logmode" );
     if( mode != NULL )
     {
@@ -214,6 +281,13 @@ static int Open( vlc_object_t *p_this )
             header = HTML_HEADER;
             cb = HtmlPrint;
         }
+        else if( !strcmp( mode, "binary" ) )
+        {
+            p_sys->footer = NULL;
+            filename = LOG_FILE_BINARY;
+            header = NULL;
+            p_sys->write = BinaryWrite;
+        }
 #ifdef HAVE_SYSLOG_H
         else if( !strcmp( mode, "syslog" ) )
             cb = SyslogPrint;
@@ -300,9 +374,12 @@ static int Open( vlc_object_t *p_this )
         else
             filename = psz_file;
 
+        if( p_sys->write == NULL && var_InheritBool( p_intf, "log-async" ) )
+            p_sys->write = (cb == HtmlPrint) ? HtmlWrite : TextWrite;
+
         /* Open the log file and remove any buffering for the stream */
         msg_Dbg( p_intf, "opening logfile `%s'", filename );
-        p_sys->p_file = vlc_fopen( filename, "at" );
+        p_sys->p_file = vlc_fopen( filename, header ? "at" : "ab" );
         if( p_sys->p_file == NULL )
         {
             msg_Err( p_intf, "error opening logfile `%s': %s", filename,
@@ -312,8 +389,22 @@ static int Open( vlc_object_t *p_this )
             return VLC_EGENERIC;
         }
         free( psz_file );
-        setvbuf( p_sys->p_file, NULL, _IONBF, 0 );
-        fputs( header, p_sys->p_file );
+        /* The logger thread flushes the asynchronous messages itself */
+        if( p_sys->write == NULL )
+            setvbuf( p_sys->p_file, NULL, _IONBF, 0 );
+        if( header != NULL )
+            fputs( header, p_sys->p_file );
+
+        if( p_sys->write != NULL )
+        {
+            if( AsyncStart( p_intf ) )
+            {
+                fclose( p_sys->p_file );
+                free( p_sys );
+                return VLC_ENOMEM;
+            }
+            cb = AsyncPrint;
+        }
     }
 
     vlc_LogSet( p_intf->p_libvlc, cb, p_intf );
@@ -330,6 +421,8 @@ static void Close( vlc_object_t *p_this )
 
     /* Flush the queue and unsubscribe from the message queue */
     vlc_LogSet( p_intf->p_libvlc, NULL, NULL );
+    if( p_sys->write != NULL )
+        AsyncStop( p_intf );
 
     /* Close the log file */
 #ifdef HAVE_SYSLOG_H
@@ -342,7 +435,8 @@ static void Close( vlc_object_t *p_this )
 #endif
     if( p_sys->p_file )
     {
-        fputs( p_sys->footer, p_sys->p_file );
+        if( p_sys->footer != NULL )
+            fputs( p_sys->footer, p_sys->p_file );
         fclose( p_sys->p_file );
     }
 
@@ -352,10 +446,7 @@ static void Close( vlc_object_t *p_this )
 
 static bool IgnoreMessage( intf_thread_t *p_intf, int type )
 {
-    /* TODO: cache value... */
-    int verbosity = var_InheritInteger( p_intf, "log-verbose" );
-    if (verbosity == -1)
-        verbosity = var_InheritInteger( p_intf, "verbose" );
+    int verbosity = p_intf->p_sys->verbosity;
 
     return verbosity < 0 || verbosity < (type - VLC_MSG_ERR);
 }
@@ -461,3 +552,437 @@ static void HtmlPrint( void *opaque, int type, const vlc_log_t *item,
     funlockfile( stream );
     vlc_restorecancel( canc );
 }
+
+/*
+ * Asynchronous logging
+ */
+
+/* All the rings, so that the threads exiting after the logger is gone do
+ * not touch the rings it freed */
+static vlc_mutex_t rings_lock = VLC_STATIC_MUTEX;
+static log_ring_t *all_rings = NULL;
+
+/* Thread exit */
+static void RingExit( void *data )
+{
+    log_ring_t *ring = data;
+
+    vlc_mutex_lock( &rings_lock );
+    for( log_ring_t *r = all_rings; r != NULL; r = r->all_next )
+        if( r == ring )
+        {
+            atomic_store( &ring->exited, true );
+            break;
+        }
+    vlc_mutex_unlock( &rings_lock );
+}
+
+static log_ring_t *RingNew( intf_thread_t *p_intf )
+{
+    intf_sys_t *p_sys = p_intf->p_sys;
+    size_t offset = BINLOG_ALIGN( sizeof( log_ring_t ) );
+    log_ring_t *ring = malloc( offset + p_sys->ring_size );
+
+    if( unlikely(ring == NULL) )
+        return NULL;
+    ring->size = p_sys->ring_size;
+    ring->data = (uint8_t *)ring + offset;
+    atomic_init( &ring->head, 0 );
+    atomic_init( &ring->tail, 0 );
+    atomic_init( &ring->dropped, 0 );
+    ring->reported = 0;
+    atomic_init( &ring->exited, false );
+
+    vlc_mutex_lock( &rings_lock );
+    ring->all_next = all_rings;
+    all_rings = ring;
+    vlc_mutex_unlock( &rings_lock );
+
+    vlc_mutex_lock( &p_sys->lock );
+    ring->id = p_sys->ring_count++;
+    ring->next = p_sys->rings;
+    p_sys->rings = ring;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    vlc_threadvar_set( p_sys->ring_key, ring );
+    return ring;
+}
+
+/* Logger thread, with rings_lock held */
+static void RingForget( log_ring_t *ring )
+{
+    for( log_ring_t **pp = &all_rings; *pp != NULL; pp = &(*pp)->all_next )
+        if( *pp == ring )
+        {
+            *pp = ring->all_next;
+            break;
+        }
+}
+
+/* Emitting thread: reserves a contiguous record of the given size */
+static uint8_t *RingReserve( log_ring_t *ring, size_t size, size_t *used )
+{
+    size_t head = atomic_load_explicit( &ring->head, memory_order_relaxed );
+    size_t tail = atomic_load_explicit( &ring->tail, memory_order_acquire );
+    size_t offset = head & (ring->size - 1);
+    size_t padding = 0;
+
+    if( ring->size - offset < size )
+        padding = ring->size - offset; /* wrap around */
+    if( ring->size - (head - tail) < padding + size )
+        return NULL;
+
+    if( padding > 0 )
+    {
+        struct binlog_record *rec = (void *)(ring->data + offset);
+
+        rec->size = padding;
+        rec->kind = BINLOG_PADDING;
+        offset = 0;
+    }
+    *used = padding + size;
+    return ring->data + offset;
+}
+
+/* Logger thread: next record of a ring, or NULL */
+static struct binlog_record *RingPeek( log_ring_t *ring )
+{
+    for( ;; )
+    {
+        size_t tail = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+        size_t head = atomic_load_explicit( &ring->head, memory_order_acquire );
+        struct binlog_record *rec;
+
+        if( tail == head )
+            return NULL;
+        rec = (void *)(ring->data + (tail & (ring->size - 1)));
+        if( rec->kind != BINLOG_PADDING )
+            return rec;
+        atomic_store_explicit( &ring->tail, tail + rec->size,
+                               memory_order_release );
+    }
+}
+
+static void RingPop( log_ring_t *ring, const struct binlog_record *rec )
+{
+    size_t tail = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+
+    atomic_store_explicit( &ring->tail, tail + rec->size,
+                           memory_order_release );
+}
+
+/* Emitting thread: copies a message to the ring */
+static void Store( intf_thread_t *p_intf, log_ring_t *ring, int type,
+                   const vlc_log_t *item, const char *fmt, long args_size,
+                   va_list ap )
+{
+    intf_sys_t *p_sys = p_intf->p_sys;
+    const char *strings[4] = {
+        item->psz_module, item->psz_object_type,
+        item->psz_header ? item->psz_header : "", fmt,
+    };
+    size_t lengths[4];
+    size_t size = sizeof( struct binlog_record ) + args_size;
+
+    for( unsigned i = 0; i < 4; i++ )
+    {
+        lengths[i] = strnlen( strings[i], UINT16_MAX );
+        size += lengths[i] + 1;
+    }
+    size = BINLOG_ALIGN( size );
+
+    size_t used;
+    uint8_t *p = NULL;
+    if( size <= ring->size / 4 )
+        p = RingReserve( ring, size, &used );
+    if( p == NULL )
+    {
+        atomic_fetch_add_explicit( &ring->dropped, 1, memory_order_relaxed );
+        return;
+    }
+
+    struct binlog_record *rec = (void *)p;
+    rec->size = size;
+    rec->kind = BINLOG_MESSAGE;
+    rec->type = type;
+    rec->reserved = 0;
+    rec->thread = ring->id;
+    rec->args_size = args_size;
+    rec->date = mdate();
+    rec->object = item->i_object_id;
+    p += sizeof( *rec );
+    for( unsigned i = 0; i < 4; i++ )
+    {
+        rec->lengths[i] = lengths[i];
+        memcpy( p, strings[i], lengths[i] );
+        p[lengths[i]] = '\0';
+        p += lengths[i] + 1;
+    }
+    binlog_StoreArgs( p, fmt, ap );
+
+    size_t head = atomic_load_explicit( &ring->head, memory_order_relaxed );
+    atomic_store_explicit( &ring->head, head + used, memory_order_release );
+
+    /* Errors are written at once, others once the ring is half full, or
+     * after LOG_PERIOD at most. */
+    size_t tail = atomic_load_explicit( &ring->tail, memory_order_relaxed );
+    if( type == VLC_MSG_ERR || head + used - tail > ring->size / 2 )
+        vlc_cond_signal( &p_sys->wait );
+}
+
+static void StoreText( intf_thread_t *p_intf, log_ring_t *ring, int type,
+                       const vlc_log_t *item, const char *fmt, ... )
+{
+    va_list ap;
+
+    va_start( ap, fmt );
+    Store( p_intf, ring, type, item, fmt, binlog_ArgsSize( fmt, ap ), ap );
+    va_end( ap );
+}
+
+static void AsyncPrint( void *opaque, int type, const vlc_log_t *item,
+                        const char *fmt, va_list ap )
+{
+    intf_thread_t *p_intf = opaque;
+    intf_sys_t *p_sys = p_intf->p_sys;
+
+    if( IgnoreMessage( p_intf, type ) )
+        return;
+
+    log_ring_t *ring = vlc_threadvar_get( p_sys->ring_key );
+    if( ring == NULL )
+    {
+        ring = RingNew( p_intf );
+        if( unlikely(ring == NULL) )
+            return;
+    }
+
+    long args_size = binlog_ArgsSize( fmt, ap );
+    if( args_size >= 0 )
+        Store( p_intf, ring, type, item, fmt, args_size, ap );
+    else
+    {
+        /* Positional arguments, wide characters... */
+        char *str;
+
+        if( vasprintf( &str, fmt, ap ) == -1 )
+            return;
+        StoreText( p_intf, ring, type, item, "%s", str );
+        free( str );
+    }
+}
+
+static void TextWrite( intf_thread_t *p_intf, const struct binlog_record *rec )
+{
+    FILE *stream = p_intf->p_sys->p_file;
+    const char *strings[4];
+    const uint8_t *args;
+
+    if( rec->kind == BINLOG_DROPPED )
+    {
+        fprintf( stream, "-- %"PRIu64" messages dropped --\n", rec->object );
+        return;
+    }
+    args = binlog_Strings( rec, strings );
+    fprintf( stream, "%s%s: ", strings[0], ppsz_type[rec->type] );
+    binlog_Print( stream, strings[3], args, rec->args_size );
+    putc_unlocked( '\n', stream );
+}
+
+static void HtmlWrite( intf_thread_t *p_intf, const struct binlog_record *rec )
+{
+    static const unsigned color[4] = {
+        0xffffff, 0xff6666, 0xffff66, 0xaaaaaa,
+    };
+
+    FILE *stream = p_intf->p_sys->p_file;
+    const char *strings[4];
+    const uint8_t *args;
+
+    if( rec->kind == BINLOG_DROPPED )
+    {
+        fprintf( stream, "<strong>-- %"PRIu64" messages dropped --</strong>\n",
+                 rec->object );
+        return;
+    }
+    args = binlog_Strings( rec, strings );
+    fprintf( stream, "%s%s: <span style=\"color: #%06x\">",
+             strings[0], ppsz_type[rec->type], color[rec->type] );
+    /* FIXME: encode special ASCII characters */
+    binlog_Print( stream, strings[3], args, rec->args_size );
+    fputs( "</span>\n", stream );
+}
+
+static void BinaryWrite( intf_thread_t *p_intf, const struct binlog_record *rec )
+{
+    fwrite( rec, 1, rec->size, p_intf->p_sys->p_file );
+}
+
+/* Logger thread: writes the messages of all the threads */
+static void Drain( intf_thread_t *p_intf )
+{
+    intf_sys_t *p_sys = p_intf->p_sys;
+    log_ring_t *first;
+
+    /* New rings are added in front, and only this thread removes rings */
+    vlc_mutex_lock( &p_sys->lock );
+    first = p_sys->rings;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    for( log_ring_t *ring = first; ring != NULL; ring = ring->next )
+    {
+        unsigned dropped = atomic_load_explicit( &ring->dropped,
+                                                 memory_order_relaxed );
+        if( dropped != ring->reported )
+        {
+            struct binlog_record rec = {
+                .size = sizeof( rec ), .kind = BINLOG_DROPPED,
+                .thread = ring->id, .date = mdate(),
+                .object = dropped - ring->reported,
+            };
+
+            p_sys->write( p_intf, &rec );
+            ring->reported = dropped;
+        }
+    }
+
+    /* Oldest message first */
+    for( ;; )
+    {
+        log_ring_t *oldest = NULL;
+        struct binlog_record *rec = NULL;
+
+        for( log_ring_t *ring = first; ring != NULL; ring = ring->next )
+        {
+            struct binlog_record *r = RingPeek( ring );
+
+            if( r != NULL && (rec == NULL || r->date < rec->date) )
+            {
+                oldest = ring;
+                rec = r;
+            }
+        }
+        if( rec == NULL )
+            break;
+        p_sys->write( p_intf, rec );
+        RingPop( oldest, rec );
+    }
+    fflush( p_sys->p_file );
+
+    /* Rings of the threads that exited */
+    vlc_mutex_lock( &rings_lock );
+    vlc_mutex_lock( &p_sys->lock );
+    for( log_ring_t **pp = &p_sys->rings; *pp != NULL; )
+    {
+        log_ring_t *ring = *pp;
+
+        if( atomic_load( &ring->exited ) && RingPeek( ring ) == NULL
+         && atomic_load( &ring->dropped ) == ring->reported )
+        {
+            *pp = ring->next;
+            RingForget( ring );
+            free( ring );
+        }
+        else
+            pp = &ring->next;
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+    vlc_mutex_unlock( &rings_lock );
+}
+
+static void *Thread( void *data )
+{
+    intf_thread_t *p_intf = data;
+    intf_sys_t *p_sys = p_intf->p_sys;
+    bool stop;
+
+    do
+    {
+        vlc_mutex_lock( &p_sys->lock );
+        if( !p_sys->stop )
+            vlc_cond_timedwait( &p_sys->wait, &p_sys->lock,
+                                mdate() + LOG_PERIOD );
+        stop = p_sys->stop;
+        vlc_mutex_unlock( &p_sys->lock );
+
+        Drain( p_intf );
+    }
+    while( !stop );
+    return NULL;
+}
+
+static int AsyncStart( intf_thread_t *p_intf )
+{
+    intf_sys_t *p_sys = p_intf->p_sys;
+    size_t size = var_InheritInteger( p_intf, "log-buffer" ) << 10;
+
+    /* Power of two */
+    p_sys->ring_size = 4096;
+    while( p_sys->ring_size < size && p_sys->ring_size < (16 << 20) )
+        p_sys->ring_size <<= 1;
+    p_sys->ring_count = 0;
+    p_sys->rings = NULL;
+    p_sys->stop = false;
+
+    if( vlc_threadvar_create( &p_sys->ring_key, RingExit ) )
+        return VLC_EGENERIC;
+    vlc_mutex_init( &p_sys->lock );
+    vlc_cond_init( &p_sys->wait );
+
+    if( p_sys->write == BinaryWrite )
+    {
+        struct
+        {
+            struct binlog_record rec;
+            struct binlog_start start;
+        } session;
+        struct timeval tv;
+
+        memset( &session, 0, sizeof( session ) );
+        session.rec.size = sizeof( session );
+        session.rec.kind = BINLOG_START;
+        session.rec.date = mdate();
+        gettimeofday( &tv, NULL );
+        session.start.version = BINLOG_VERSION;
+        session.start.byte_order = BINLOG_BYTE_ORDER;
+        session.start.time = tv.tv_sec * INT64_C(1000000) + tv.tv_usec;
+        fwrite( BINLOG_MAGIC, 1, 8, p_sys->p_file );
+        fwrite( &session, 1, sizeof( session ), p_sys->p_file );
+    }
+
+    if( vlc_clone( &p_sys->thread, Thread, p_intf, VLC_THREAD_PRIORITY_LOW ) )
+    {
+        vlc_cond_destroy( &p_sys->wait );
+        vlc_mutex_destroy( &p_sys->lock );
+        vlc_threadvar_delete( &p_sys->ring_key );
+        return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+/* Once no more messages are emitted */
+static void AsyncStop( intf_thread_t *p_intf )
+{
+    intf_sys_t *p_sys = p_intf->p_sys;
+
+    vlc_mutex_lock( &p_sys->lock );
+    p_sys->stop = true;
+    vlc_cond_signal( &p_sys->wait );
+    vlc_mutex_unlock( &p_sys->lock );
+    vlc_join( p_sys->thread, NULL );
+
+    vlc_mutex_lock( &rings_lock );
+    vlc_threadvar_delete( &p_sys->ring_key );
+    while( p_sys->rings != NULL )
+    {
+        log_ring_t *ring = p_sys->rings;
+
+        p_sys->rings = ring->next;
+        RingForget( ring );
+        free( ring );
+    }
+    vlc_mutex_unlock( &rings_lock );
+
+    vlc_cond_destroy( &p_sys->wait );
+    vlc_mutex_destroy( &p_sys->lock );
+}
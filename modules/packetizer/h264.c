@@ -42,6 +42,7 @@
 #include <vlc_bits.h>
 #include "../codec/cc.h"
 #include "packetizer_helper.h"
+#include "startcode_helper.h"
 
 /*****************************************************************************
  * Module descriptor
@@ -82,6 +83,12 @@ typedef struct
     int i_delta_pic_order_cnt1;
 } slice_t;
 
+typedef struct
+{
+    const uint8_t *p_data; /* NAL unit without start code */
+    size_t         i_data;
+} nal_t;
+
 #define SPS_MAX (32)
 #define PPS_MAX (256)
 struct decoder_sys_t
@@ -89,9 +96,14 @@ struct decoder_sys_t
     /* */
     packetizer_t packetizer;
 
-    /* */
+    /* NAL units of the current access unit, within the input blocks
+     * retained by the packetizer until the access unit is output */
     bool    b_slice;
-    block_t *p_frame;
+    nal_t   *p_frame;
+    int     i_frame;
+    int     i_frame_max;
+    size_t  i_frame_size; /* with the 4 bytes start codes */
+    bool    b_frame_aud;
     bool    b_frame_sps;
     bool    b_frame_pps;
 
@@ -146,25 +158,28 @@ enum nal_unit_type_e
     /* ref_idc == 0 for 6,9,10,11,12 */
 };
 
-#define BLOCK_FLAG_PRIVATE_AUD (1 << BLOCK_FLAG_PRIVATE_SHIFT)
-
 static block_t *Packetize( decoder_t *, block_t ** );
 static block_t *PacketizeAVC1( decoder_t *, block_t ** );
 static block_t *GetCc( decoder_t *p_dec, bool pb_present[4] );
 
 static void PacketizeReset( void *p_private, bool b_broken );
-static block_t *PacketizeParse( void *p_private, bool *pb_ts_used, block_t * );
+static block_t *PacketizeParseInPlace( void *p_private, bool *pb_ts_used,
+                                       const uint8_t *p, size_t i_size,
+                                       mtime_t i_pts, mtime_t i_dts );
 static int PacketizeValidate( void *p_private, block_t * );
 
-static block_t *ParseNALBlock( decoder_t *, bool *pb_ts_used, block_t * );
+static block_t *ParseNAL( decoder_t *, bool *pb_ts_used,
+                          const uint8_t *p_nal, size_t i_nal,
+                          mtime_t i_frag_pts, mtime_t i_frag_dts );
 static block_t *CreateAnnexbNAL( decoder_t *, const uint8_t *p, int );
 
 static block_t *OutputPicture( decoder_t *p_dec );
-static void PutSPS( decoder_t *p_dec, block_t *p_frag );
-static void PutPPS( decoder_t *p_dec, block_t *p_frag );
+static void PutSPS( decoder_t *p_dec, const uint8_t *p_nal, size_t i_nal );
+static void PutPPS( decoder_t *p_dec, const uint8_t *p_nal, size_t i_nal );
 static void ParseSlice( decoder_t *p_dec, bool *pb_new_picture, slice_t *p_slice,
-                        int i_nal_ref_idc, int i_nal_type, const block_t *p_frag );
-static void ParseSei( decoder_t *, block_t * );
+                        int i_nal_ref_idc, int i_nal_type,
+                        const uint8_t *p_nal, size_t i_nal );
+static void ParseSei( decoder_t *, const uint8_t *p_nal, size_t i_nal );
 
 
 static const uint8_t p_h264_startcode[3] = { 0x00, 0x00, 0x01 };
@@ -194,11 +209,17 @@ static int Open( vlc_object_t *p_this )
 
     packetizer_Init( &p_sys->packetizer,
                      p_h264_startcode, sizeof(p_h264_startcode),
-                     p_h264_startcode, 1, 5,
-                     PacketizeReset, PacketizeParse, PacketizeValidate, p_dec );
+                     startcode_FindAnnexB,
+                     NULL, 0, 4,
+                     PacketizeReset, NULL, PacketizeValidate, p_dec );
+    packetizer_SetInPlace( &p_sys->packetizer, PacketizeParseInPlace );
 
     p_sys->b_slice = false;
     p_sys->p_frame = NULL;
+    p_sys->i_frame = 0;
+    p_sys->i_frame_max = 0;
+    p_sys->i_frame_size = 0;
+    p_sys->b_frame_aud = false;
     p_sys->b_frame_sps = false;
     p_sys->b_frame_pps = false;
 
@@ -253,10 +274,9 @@ static int Open( vlc_object_t *p_this )
             {
                 return VLC_EGENERIC;
             }
-            block_t *p_sps = CreateAnnexbNAL( p_dec, p, i_length );
-            if( !p_sps )
-                return VLC_EGENERIC;
-            ParseNALBlock( p_dec, &b_dummy, p_sps );
+            if( i_length > 0 )
+                ParseNAL( p_dec, &b_dummy, p, i_length,
+                          VLC_TS_INVALID, VLC_TS_INVALID );
             p += i_length;
         }
         /* Read PPS */
@@ -269,10 +289,9 @@ static int Open( vlc_object_t *p_this )
             {
                 return VLC_EGENERIC;
             }
-            block_t *p_pps = CreateAnnexbNAL( p_dec, p, i_length );
-            if( !p_pps )
-                return VLC_EGENERIC;
-            ParseNALBlock( p_dec, &b_dummy, p_pps );
+            if( i_length > 0 )
+                ParseNAL( p_dec, &b_dummy, p, i_length,
+                          VLC_TS_INVALID, VLC_TS_INVALID );
             p += i_length;
         }
         msg_Dbg( p_dec, "avcC length size=%d, sps=%d, pps=%d",
@@ -365,8 +384,7 @@ static void Close( vlc_object_t *p_this )
     decoder_sys_t *p_sys = p_dec->p_sys;
     int i;
 
-    if( p_sys->p_frame )
-        block_ChainRelease( p_sys->p_frame );
+    free( p_sys->p_frame );
     for( i = 0; i < SPS_MAX; i++ )
     {
         if( p_sys->pp_sps[i] )
@@ -391,7 +409,7 @@ static void Close( vlc_object_t *p_this )
 /****************************************************************************
  * Packetize: the whole thing
  * Search for the startcodes 3 or more bytes
- * Feed ParseNALBlock ALWAYS with 4 byte startcode prepended NALs
+ * The NALs are parsed in place, and only copied to the output access unit
  ****************************************************************************/
 static block_t *Packetize( decoder_t *p_dec, block_t **pp_block )
 {
@@ -442,21 +460,16 @@ static block_t *PacketizeAVC1( decoder_t *p_dec, block_t **pp_block )
             break;
         }
 
-        block_t *p_part = CreateAnnexbNAL( p_dec, p, i_size );
-        if( !p_part )
-            break;
-
-        p_part->i_dts = p_block->i_dts;
-        p_part->i_pts = p_block->i_pts;
-
         /* Parse the NAL */
-        if( ( p_pic = ParseNALBlock( p_dec, &b_dummy, p_part ) ) )
+        if( ( p_pic = ParseNAL( p_dec, &b_dummy, p, i_size,
+                                p_block->i_pts, p_block->i_dts ) ) )
         {
             block_ChainAppend( &p_ret, p_pic );
         }
         p += i_size;
     }
-    block_Release( p_block );
+    /* The NALs of the next access unit may be in this block */
+    packetizer_Retain( &p_sys->packetizer, p_block );
 
     return p_ret;
 }
@@ -490,6 +503,41 @@ static block_t *GetCc( decoder_t *p_dec, bool pb_present[4] )
 /****************************************************************************
  * Helpers
  ****************************************************************************/
+static void DropFrame( decoder_sys_t *p_sys )
+{
+    p_sys->i_frame = 0;
+    p_sys->i_frame_size = 0;
+    p_sys->b_frame_aud = false;
+    packetizer_ReleaseRetained( &p_sys->packetizer );
+}
+
+static void AppendNAL( decoder_sys_t *p_sys, const uint8_t *p_nal, size_t i_nal )
+{
+    if( p_sys->i_frame >= p_sys->i_frame_max )
+    {
+        int i_max = 2 * p_sys->i_frame_max + 16;
+        nal_t *p_frame = realloc( p_sys->p_frame, i_max * sizeof(*p_frame) );
+        if( !p_frame )
+            return;
+        p_sys->p_frame = p_frame;
+        p_sys->i_frame_max = i_max;
+    }
+    p_sys->p_frame[p_sys->i_frame].p_data = p_nal;
+    p_sys->p_frame[p_sys->i_frame].i_data = i_nal;
+    p_sys->i_frame++;
+    p_sys->i_frame_size += 4 + i_nal;
+}
+
+static uint8_t *CopyNAL( uint8_t *p_dst, const nal_t *p_nal )
+{
+    p_dst[0] = 0x00;
+    p_dst[1] = 0x00;
+    p_dst[2] = 0x00;
+    p_dst[3] = 0x01;
+    memcpy( &p_dst[4], p_nal->p_data, p_nal->i_data );
+    return &p_dst[4 + p_nal->i_data];
+}
+
 static void PacketizeReset( void *p_private, bool b_broken )
 {
     decoder_t *p_dec = p_private;
@@ -497,9 +545,7 @@ static void PacketizeReset( void *p_private, bool b_broken )
 
     if( b_broken )
     {
-        if( p_sys->p_frame )
-            block_ChainRelease( p_sys->p_frame );
-        p_sys->p_frame = NULL;
+        DropFrame( p_sys );
         p_sys->b_frame_sps = false;
         p_sys->b_frame_pps = false;
         p_sys->slice.i_frame_type = 0;
@@ -508,15 +554,18 @@ static void PacketizeReset( void *p_private, bool b_broken )
     p_sys->i_frame_pts = VLC_TS_INVALID;
     p_sys->i_frame_dts = VLC_TS_INVALID;
 }
-static block_t *PacketizeParse( void *p_private, bool *pb_ts_used, block_t *p_block )
+static block_t *PacketizeParseInPlace( void *p_private, bool *pb_ts_used,
+                                       const uint8_t *p, size_t i_size,
+                                       mtime_t i_pts, mtime_t i_dts )
 {
     decoder_t *p_dec = p_private;
 
     /* Remove trailing 0 bytes */
-    while( p_block->i_buffer > 5 && p_block->p_buffer[p_block->i_buffer-1] == 0x00 )
-        p_block->i_buffer--;
+    while( i_size > 4 && p[i_size-1] == 0x00 )
+        i_size--;
 
-    return ParseNALBlock( p_dec, pb_ts_used, p_block );
+    /* Skip the 3 bytes startcode */
+    return ParseNAL( p_dec, pb_ts_used, &p[3], i_size - 3, i_pts, i_dts );
 }
 static int PacketizeValidate( void *p_private, block_t *p_au )
 {
@@ -545,31 +594,50 @@ static block_t *CreateAnnexbNAL( decoder_t *p_dec, const uint8_t *p, int i_size
     return p_nal;
 }
 
-static void CreateDecodedNAL( uint8_t **pp_ret, int *pi_ret,
-                              const uint8_t *src, int i_src )
+/* Removes the emulation prevention bytes of the first i_dst bytes of the
+ * payload, as only the headers are parsed */
+static size_t DecodeNAL( uint8_t *p_dst, size_t i_dst,
+                         const uint8_t *src, size_t i_src )
 {
     const uint8_t *end = &src[i_src];
-    uint8_t *dst = malloc( i_src );
+    uint8_t *dst = p_dst;
+    uint8_t *dst_end = &p_dst[i_dst];
 
-    *pp_ret = dst;
-
-    if( dst )
+    while( src < end && dst < dst_end )
     {
-        while( src < end )
+        if( end - src > 3 && src[0] == 0x00 && src[1] == 0x00 &&
+            src[2] == 0x03 )
         {
-            if( src < end - 3 && src[0] == 0x00 && src[1] == 0x00 &&
-                src[2] == 0x03 )
-            {
-                *dst++ = 0x00;
-                *dst++ = 0x00;
+            *dst++ = 0x00;
+            if( dst == dst_end )
+                break;
+            *dst++ = 0x00;
 
-                src += 3;
-                continue;
-            }
-            *dst++ = *src++;
+            src += 3;
+            continue;
         }
+        *dst++ = *src++;
+    }
+    return dst - p_dst;
+}
+
+#define NAL_DECODE_BUFFER 256
+
+/* Removes the emulation prevention bytes of the whole payload, in p_buf
+ * when it fits, or in an allocated buffer */
+static uint8_t *DecodeWholeNAL( uint8_t p_buf[NAL_DECODE_BUFFER], size_t *pi_dec,
+                                const uint8_t *p_nal, size_t i_nal )
+{
+    uint8_t *p_dec = p_buf;
+
+    if( i_nal - 1 > NAL_DECODE_BUFFER )
+    {
+        p_dec = malloc( i_nal - 1 );
+        if( !p_dec )
+            return NULL;
     }
-    *pi_ret = dst - *pp_ret;
+    *pi_dec = DecodeNAL( p_dec, i_nal - 1, &p_nal[1], i_nal - 1 );
+    return p_dec;
 }
 
 static inline int bs_read_ue( bs_t *s )
@@ -591,27 +659,27 @@ static inline int bs_read_se( bs_t *s )
 }
 
 /*****************************************************************************
- * ParseNALBlock: parses annexB type NALs
- * All p_frag blocks are required to start with 0 0 0 1 4-byte startcode
+ * ParseNAL: parses a NAL without its startcode
+ * p_nal must remain valid until the access unit is output (see DropFrame)
  *****************************************************************************/
-static block_t *ParseNALBlock( decoder_t *p_dec, bool *pb_ts_used, block_t *p_frag )
+static block_t *ParseNAL( decoder_t *p_dec, bool *pb_ts_used,
+                          const uint8_t *p_nal, size_t i_nal,
+                          mtime_t i_frag_pts, mtime_t i_frag_dts )
 {
     decoder_sys_t *p_sys = p_dec->p_sys;
     block_t *p_pic = NULL;
+    bool b_append = true;
 
-    const int i_nal_ref_idc = (p_frag->p_buffer[4] >> 5)&0x03;
-    const int i_nal_type = p_frag->p_buffer[4]&0x1f;
-    const mtime_t i_frag_dts = p_frag->i_dts;
-    const mtime_t i_frag_pts = p_frag->i_pts;
+    const int i_nal_ref_idc = (p_nal[0] >> 5)&0x03;
+    const int i_nal_type = p_nal[0]&0x1f;
 
     if( p_sys->b_slice && ( !p_sys->b_sps || !p_sys->b_pps ) )
     {
-        block_ChainRelease( p_sys->p_frame );
+        DropFrame( p_sys );
         msg_Warn( p_dec, "waiting for SPS/PPS" );
 
         /* Reset context */
         p_sys->slice.i_frame_type = 0;
-        p_sys->p_frame = NULL;
         p_sys->b_frame_sps = false;
         p_sys->b_frame_pps = false;
         p_sys->b_slice = false;
@@ -629,7 +697,8 @@ static block_t *ParseNALBlock( decoder_t *p_dec, bool *pb_ts_used, block_t *p_fr
         slice_t slice;
         bool  b_new_picture;
 
-        ParseSlice( p_dec, &b_new_picture, &slice, i_nal_ref_idc, i_nal_type, p_frag );
+        ParseSlice( p_dec, &b_new_picture, &slice, i_nal_ref_idc, i_nal_type,
+                    p_nal, i_nal );
 
         /* */
         if( b_new_picture && p_sys->b_slice )
@@ -645,10 +714,10 @@ static block_t *ParseNALBlock( decoder_t *p_dec, bool *pb_ts_used, block_t *p_fr
             p_pic = OutputPicture( p_dec );
         p_sys->b_frame_sps = true;
 
-        PutSPS( p_dec, p_frag );
+        PutSPS( p_dec, p_nal, i_nal );
 
         /* Do not append the SPS because we will insert it on keyframes */
-        p_frag = NULL;
+        b_append = false;
     }
     else if( i_nal_type == NAL_PPS )
     {
@@ -656,10 +725,10 @@ static block_t *ParseNALBlock( decoder_t *p_dec, bool *pb_ts_used, block_t *p_fr
             p_pic = OutputPicture( p_dec );
         p_sys->b_frame_pps = true;
 
-        PutPPS( p_dec, p_frag );
+        PutPPS( p_dec, p_nal, i_nal );
 
         /* Do not append the PPS because we will insert it on keyframes */
-        p_frag = NULL;
+        b_append = false;
     }
     else if( i_nal_type == NAL_AU_DELIMITER ||
              i_nal_type == NAL_SEI ||
@@ -671,25 +740,20 @@ static block_t *ParseNALBlock( decoder_t *p_dec, bool *pb_ts_used, block_t *p_fr
         /* Parse SEI for CC support */
         if( i_nal_type == NAL_SEI )
         {
-            ParseSei( p_dec, p_frag );
+            ParseSei( p_dec, p_nal, i_nal );
         }
         else if( i_nal_type == NAL_AU_DELIMITER )
         {
-            if( p_sys->p_frame && (p_sys->p_frame->i_flags & BLOCK_FLAG_PRIVATE_AUD) )
-            {
-                block_Release( p_frag );
-                p_frag = NULL;
-            }
-            else
-            {
-                p_frag->i_flags |= BLOCK_FLAG_PRIVATE_AUD;
-            }
+            if( p_sys->b_frame_aud )
+                b_append = false;
+            else if( p_sys->i_frame == 0 )
+                p_sys->b_frame_aud = true;
         }
     }
 
-    /* Append the block */
-    if( p_frag )
-        block_ChainAppend( &p_sys->p_frame, p_frag );
+    /* Append the NAL */
+    if( b_append )
+        AppendNAL( p_sys, p_nal, i_nal );
 
     *pb_ts_used = false;
     if( p_sys->i_frame_dts <= VLC_TS_INVALID &&
@@ -724,80 +788,102 @@ static block_t *OutputPicture( decoder_t *p_dec )
     const bool b_sps_pps_i = p_sys->slice.i_frame_type == BLOCK_FLAG_TYPE_I &&
                              p_sys->b_sps &&
                              p_sys->b_pps;
-    if( b_sps_pps_i || p_sys->b_frame_sps || p_sys->b_frame_pps )
+    const bool b_put_sps = b_sps_pps_i || p_sys->b_frame_sps;
+    const bool b_put_pps = b_sps_pps_i || p_sys->b_frame_pps;
+    size_t i_size = p_sys->i_frame_size;
+    bool b_params = false;
+
+    for( int i = 0; i < SPS_MAX && b_put_sps; i++ )
+    {
+        if( p_sys->pp_sps[i] )
+        {
+            i_size += p_sys->pp_sps[i]->i_buffer;
+            b_params = true;
+        }
+    }
+    for( int i = 0; i < PPS_MAX && b_put_pps; i++ )
     {
-        block_t *p_head = NULL;
-        if( p_sys->p_frame->i_flags & BLOCK_FLAG_PRIVATE_AUD )
+        if( p_sys->pp_pps[i] )
         {
-            p_head = p_sys->p_frame;
-            p_sys->p_frame = p_sys->p_frame->p_next;
+            i_size += p_sys->pp_pps[i]->i_buffer;
+            b_params = true;
         }
+    }
+    if( b_sps_pps_i && b_params )
+        p_sys->b_header = true;
+
+    /* This is the only copy of the NALs */
+    p_pic = block_Alloc( i_size );
+    if( p_pic )
+    {
+        uint8_t *p = p_pic->p_buffer;
+        int i = 0;
 
-        block_t *p_list = NULL;
-        for( int i = 0; i < SPS_MAX && (b_sps_pps_i || p_sys->b_frame_sps); i++ )
+        /* The SPS and PPS go after the access unit delimiter */
+        if( p_sys->b_frame_aud )
+            p = CopyNAL( p, &p_sys->p_frame[i++] );
+        for( int j = 0; j < SPS_MAX && b_put_sps; j++ )
         {
-            if( p_sys->pp_sps[i] )
-                block_ChainAppend( &p_list, block_Duplicate( p_sys->pp_sps[i] ) );
+            if( p_sys->pp_sps[j] )
+            {
+                memcpy( p, p_sys->pp_sps[j]->p_buffer, p_sys->pp_sps[j]->i_buffer );
+                p += p_sys->pp_sps[j]->i_buffer;
+            }
         }
-        for( int i = 0; i < PPS_MAX && (b_sps_pps_i || p_sys->b_frame_pps); i++ )
+        for( int j = 0; j < PPS_MAX && b_put_pps; j++ )
         {
-            if( p_sys->pp_pps[i] )
-                block_ChainAppend( &p_list, block_Duplicate( p_sys->pp_pps[i] ) );
+            if( p_sys->pp_pps[j] )
+            {
+                memcpy( p, p_sys->pp_pps[j]->p_buffer, p_sys->pp_pps[j]->i_buffer );
+                p += p_sys->pp_pps[j]->i_buffer;
+            }
         }
-        if( b_sps_pps_i && p_list )
-            p_sys->b_header = true;
-
-        if( p_head )
-            p_head->p_next = p_list;
-        else
-            p_head = p_list;
-        block_ChainAppend( &p_head, p_sys->p_frame );
-
-        p_pic = block_ChainGather( p_head );
+        for( ; i < p_sys->i_frame; i++ )
+            p = CopyNAL( p, &p_sys->p_frame[i] );
+
+        p_pic->i_dts = p_sys->i_frame_dts;
+        p_pic->i_pts = p_sys->i_frame_pts;
+        p_pic->i_length = 0;    /* FIXME */
+        p_pic->i_flags |= p_sys->slice.i_frame_type;
+        if( !p_sys->b_header )
+            p_pic->i_flags |= BLOCK_FLAG_PREROLL;
     }
-    else
-    {
-        p_pic = block_ChainGather( p_sys->p_frame );
-    }
-    p_pic->i_dts = p_sys->i_frame_dts;
-    p_pic->i_pts = p_sys->i_frame_pts;
-    p_pic->i_length = 0;    /* FIXME */
-    p_pic->i_flags |= p_sys->slice.i_frame_type;
-    p_pic->i_flags &= ~BLOCK_FLAG_PRIVATE_AUD;
+
+    /* CC */
+    p_sys->i_cc_pts = p_sys->i_frame_pts;
+    p_sys->i_cc_dts = p_sys->i_frame_dts;
+    p_sys->i_cc_flags = p_sys->slice.i_frame_type;
     if( !p_sys->b_header )
-        p_pic->i_flags |= BLOCK_FLAG_PREROLL;
+        p_sys->i_cc_flags |= BLOCK_FLAG_PREROLL;
 
+    p_sys->cc = p_sys->cc_next;
+    cc_Flush( &p_sys->cc_next );
+
+    DropFrame( p_sys );
     p_sys->slice.i_frame_type = 0;
-    p_sys->p_frame = NULL;
     p_sys->i_frame_dts = VLC_TS_INVALID;
     p_sys->i_frame_pts = VLC_TS_INVALID;
     p_sys->b_frame_sps = false;
     p_sys->b_frame_pps = false;
     p_sys->b_slice = false;
 
-    /* CC */
-    p_sys->i_cc_pts = p_pic->i_pts;
-    p_sys->i_cc_dts = p_pic->i_dts;
-    p_sys->i_cc_flags = p_pic->i_flags;
-
-    p_sys->cc = p_sys->cc_next;
-    cc_Flush( &p_sys->cc_next );
-
     return p_pic;
 }
 
-static void PutSPS( decoder_t *p_dec, block_t *p_frag )
+static void PutSPS( decoder_t *p_dec, const uint8_t *p_nal, size_t i_nal )
 {
     decoder_sys_t *p_sys = p_dec->p_sys;
 
-    uint8_t *pb_dec = NULL;
-    int     i_dec = 0;
+    uint8_t p_buf[NAL_DECODE_BUFFER];
+    uint8_t *pb_dec;
+    size_t  i_dec;
     bs_t s;
     int i_tmp;
     int i_sps_id;
 
-    CreateDecodedNAL( &pb_dec, &i_dec, &p_frag->p_buffer[5],
-                     p_frag->i_buffer - 5 );
+    pb_dec = DecodeWholeNAL( p_buf, &i_dec, p_nal, i_nal );
+    if( !pb_dec )
+        return;
 
     bs_init( &s, pb_dec, i_dec );
     int i_profile_idc = bs_read( &s, 8 );
@@ -810,8 +896,8 @@ static void PutSPS( decoder_t *p_dec, block_t *p_frag )
     if( i_sps_id >= SPS_MAX || i_sps_id < 0 )
     {
         msg_Warn( p_dec, "invalid SPS (sps_id=%d)", i_sps_id );
-        free( pb_dec );
-        block_Release( p_frag );
+        if( pb_dec != p_buf )
+            free( pb_dec );
         return;
     }
 
@@ -973,7 +1059,13 @@ static void PutSPS( decoder_t *p_dec, block_t *p_frag )
         }
     }
 
-    free( pb_dec );
+    if( pb_dec != p_buf )
+        free( pb_dec );
+
+    /* Keep a copy, the NAL is within an input block */
+    block_t *p_sps = CreateAnnexbNAL( p_dec, p_nal, i_nal );
+    if( !p_sps )
+        return;
 
     /* We have a new SPS */
     if( !p_sys->b_sps )
@@ -982,29 +1074,32 @@ static void PutSPS( decoder_t *p_dec, block_t *p_frag )
 
     if( p_sys->pp_sps[i_sps_id] )
         block_Release( p_sys->pp_sps[i_sps_id] );
-    p_sys->pp_sps[i_sps_id] = p_frag;
+    p_sys->pp_sps[i_sps_id] = p_sps;
 }
 
-static void PutPPS( decoder_t *p_dec, block_t *p_frag )
+static void PutPPS( decoder_t *p_dec, const uint8_t *p_nal, size_t i_nal )
 {
     decoder_sys_t *p_sys = p_dec->p_sys;
     bs_t s;
     int i_pps_id;
     int i_sps_id;
 
-    bs_init( &s, &p_frag->p_buffer[5], p_frag->i_buffer - 5 );
+    bs_init( &s, &p_nal[1], i_nal - 1 );
     i_pps_id = bs_read_ue( &s ); // pps id
     i_sps_id = bs_read_ue( &s ); // sps id
     if( i_pps_id >= PPS_MAX || i_sps_id >= SPS_MAX )
     {
         msg_Warn( p_dec, "invalid PPS (pps_id=%d sps_id=%d)", i_pps_id, i_sps_id );
-        block_Release( p_frag );
         return;
     }
     bs_skip( &s, 1 ); // entropy coding mode flag
     p_sys->i_pic_order_present_flag = bs_read( &s, 1 );
     /* TODO */
 
+    block_t *p_pps = CreateAnnexbNAL( p_dec, p_nal, i_nal );
+    if( !p_pps )
+        return;
+
     /* We have a new PPS */
     if( !p_sys->b_pps )
         msg_Dbg( p_dec, "found NAL_PPS (pps_id=%d sps_id=%d)", i_pps_id, i_sps_id );
@@ -1012,22 +1107,22 @@ static void PutPPS( decoder_t *p_dec, block_t *p_frag )
 
     if( p_sys->pp_pps[i_pps_id] )
         block_Release( p_sys->pp_pps[i_pps_id] );
-    p_sys->pp_pps[i_pps_id] = p_frag;
+    p_sys->pp_pps[i_pps_id] = p_pps;
 }
 
 static void ParseSlice( decoder_t *p_dec, bool *pb_new_picture, slice_t *p_slice,
-                        int i_nal_ref_idc, int i_nal_type, const block_t *p_frag )
+                        int i_nal_ref_idc, int i_nal_type,
+                        const uint8_t *p_nal, size_t i_nal )
 {
     decoder_sys_t *p_sys = p_dec->p_sys;
-    uint8_t *pb_dec;
-    int i_dec;
+    uint8_t pb_dec[60];
+    size_t i_dec;
     int i_slice_type;
     slice_t slice;
     bs_t s;
 
     /* do not convert the whole frame */
-    CreateDecodedNAL( &pb_dec, &i_dec, &p_frag->p_buffer[5],
-                     __MIN( p_frag->i_buffer - 5, 60 ) );
+    i_dec = DecodeNAL( pb_dec, sizeof(pb_dec), &p_nal[1], i_nal - 1 );
     bs_init( &s, pb_dec, i_dec );
 
     /* first_mb_in_slice */
@@ -1094,7 +1189,6 @@ static void ParseSlice( decoder_t *p_dec, bool *pb_new_picture, slice_t *p_slice
         if( p_sys->i_pic_order_present_flag && !slice.i_field_pic_flag )
             slice.i_delta_pic_order_cnt1 = bs_read_se( &s );
     }
-    free( pb_dec );
 
     /* Detection of the first VCL NAL unit of a primary coded picture
      * (cf. 7.4.1.2.4) */
@@ -1125,16 +1219,18 @@ static void ParseSlice( decoder_t *p_dec, bool *pb_new_picture, slice_t *p_slice
     *p_slice = slice;
 }
 
-static void ParseSei( decoder_t *p_dec, block_t *p_frag )
+static void ParseSei( decoder_t *p_dec, const uint8_t *p_nal, size_t i_nal )
 {
     decoder_sys_t *p_sys = p_dec->p_sys;
+    uint8_t p_buf[NAL_DECODE_BUFFER];
     uint8_t *pb_dec;
-    int i_dec;
+    size_t i_size_dec;
 
     /* */
-    CreateDecodedNAL( &pb_dec, &i_dec, &p_frag->p_buffer[5], p_frag->i_buffer - 5 );
+    pb_dec = DecodeWholeNAL( p_buf, &i_size_dec, p_nal, i_nal );
     if( !pb_dec )
         return;
+    const int i_dec = i_size_dec;
 
     /* The +1 is for rbsp trailing bits */
     for( int i_used = 0; i_used+1 < i_dec; )
@@ -1203,6 +1299,7 @@ static void ParseSei( decoder_t *p_dec, block_t *p_frag )
         i_used += i_size;
     }
 
-    free( pb_dec );
+    if( pb_dec != p_buf )
+        free( pb_dec );
 }
 
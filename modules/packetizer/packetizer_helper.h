@@ -39,6 +39,9 @@ enum
 typedef void (*packetizer_reset_t)( void *p_private, bool b_broken );
 typedef block_t *(*packetizer_parse_t)( void *p_private, bool *pb_ts_used, block_t * );
 typedef int (*packetizer_validate_t)( void *p_private, block_t * );
+typedef block_t *(*packetizer_parse_inplace_t)( void *p_private, bool *pb_ts_used,
+                                                const uint8_t *p, size_t i_size,
+                                                mtime_t i_pts, mtime_t i_dts );
 
 typedef struct
 {
@@ -49,6 +52,7 @@ typedef struct
 
     int i_startcode;
     const uint8_t *p_startcode;
+    block_startcode_helper_t pf_startcode_helper;
 
     int i_au_prepend;
     const uint8_t *p_au_prepend;
@@ -60,10 +64,16 @@ typedef struct
     packetizer_parse_t    pf_parse;
     packetizer_validate_t pf_validate;
 
+    /* In place parsing, see packetizer_SetInPlace() */
+    packetizer_parse_inplace_t pf_parse_inplace;
+    block_t  *p_retained;
+    block_t **pp_retained_last;
+
 } packetizer_t;
 
 static inline void packetizer_Init( packetizer_t *p_pack,
                                     const uint8_t *p_startcode, int i_startcode,
+                                    block_startcode_helper_t pf_startcode_helper,
                                     const uint8_t *p_au_prepend, int i_au_prepend,
                                     unsigned i_au_min_size,
                                     packetizer_reset_t pf_reset,
@@ -82,15 +92,154 @@ static inline void packetizer_Init( packetizer_t *p_pack,
 
     p_pack->i_startcode = i_startcode;
     p_pack->p_startcode = p_startcode;
+    p_pack->pf_startcode_helper = pf_startcode_helper;
     p_pack->pf_reset = pf_reset;
     p_pack->pf_parse = pf_parse;
     p_pack->pf_validate = pf_validate;
     p_pack->p_private = p_private;
+
+    p_pack->pf_parse_inplace = NULL;
+    p_pack->p_retained = NULL;
+    p_pack->pp_retained_last = &p_pack->p_retained;
+}
+
+/**
+ * Parses the units where they are instead of copying each one to a new
+ * block: pf_parse_inplace replaces pf_parse, and gets a pointer to the
+ * start code of the unit, which remains valid until
+ * packetizer_ReleaseRetained(). The units spanning several input blocks
+ * are still copied, except for zero bytes at their end (the first byte of
+ * a 4 bytes start code) which are left out. Nothing is prepended.
+ *
+ * The parser must release the retained blocks when it drops or outputs
+ * what it kept, and forget all the units on a broken reset.
+ */
+static inline void packetizer_SetInPlace( packetizer_t *p_pack,
+                                          packetizer_parse_inplace_t pf_parse_inplace )
+{
+    p_pack->pf_parse_inplace = pf_parse_inplace;
+}
+
+/**
+ * Keeps a block until packetizer_ReleaseRetained().
+ */
+static inline void packetizer_Retain( packetizer_t *p_pack, block_t *p_block )
+{
+    p_block->p_next = NULL;
+    block_ChainLastAppend( &p_pack->pp_retained_last, p_block );
+}
+
+static inline void packetizer_ReleaseRetained( packetizer_t *p_pack )
+{
+    block_ChainRelease( p_pack->p_retained );
+    p_pack->p_retained = NULL;
+    p_pack->pp_retained_last = &p_pack->p_retained;
 }
 
 static inline void packetizer_Clean( packetizer_t *p_pack )
 {
     block_BytestreamRelease( &p_pack->bytestream );
+    packetizer_ReleaseRetained( p_pack );
+}
+
+/* Flushes the read data, as block_BytestreamFlush(), but the blocks are
+ * retained when parsing in place */
+static inline void packetizer_Flush( packetizer_t *p_pack )
+{
+    block_bytestream_t *p_bytestream = &p_pack->bytestream;
+
+    if( p_pack->pf_parse_inplace == NULL )
+    {
+        block_BytestreamFlush( p_bytestream );
+        return;
+    }
+
+    block_t *block = p_bytestream->p_chain;
+
+    while( block != p_bytestream->p_block )
+    {
+        block_t *p_next = block->p_next;
+
+        packetizer_Retain( p_pack, block );
+        block = p_next;
+    }
+
+    while( block != NULL && block->i_buffer == p_bytestream->i_offset )
+    {
+        block_t *p_next = block->p_next;
+
+        packetizer_Retain( p_pack, block );
+        block = p_next;
+        p_bytestream->i_offset = 0;
+    }
+
+    p_bytestream->p_chain = p_bytestream->p_block = block;
+}
+
+/* Checks that the i_tail bytes after p_block are zeros */
+static inline bool packetizer_IsZeroTail( const block_t *p_block, size_t i_tail )
+{
+    for( p_block = p_block->p_next; p_block != NULL && i_tail > 0;
+         p_block = p_block->p_next )
+    {
+        const size_t i_copy = __MIN( i_tail, p_block->i_buffer );
+
+        for( size_t i = 0; i < i_copy; i++ )
+            if( p_block->p_buffer[i] != 0x00 )
+                return false;
+        i_tail -= i_copy;
+    }
+    return i_tail == 0;
+}
+
+/* Parses the i_offset bytes at the read pointer in place */
+static inline block_t *packetizer_ParseInPlace( packetizer_t *p_pack,
+                                                bool *pb_ts_used )
+{
+    block_bytestream_t *p_bytestream = &p_pack->bytestream;
+    const block_t *p_block = p_bytestream->p_block;
+    const size_t i_size = p_pack->i_offset;
+    const size_t i_avail = p_block->i_buffer - p_bytestream->i_offset;
+    size_t i_parse = i_size;
+    block_t *p_copy = NULL;
+    block_t *p_pic = NULL;
+    const uint8_t *p;
+
+    *pb_ts_used = false;
+    p_pack->i_offset = 0;
+
+    if( i_size < p_pack->i_au_min_size )
+        goto skip;
+
+    if( i_avail >= i_size )
+    {
+        p = &p_block->p_buffer[p_bytestream->i_offset];
+    }
+    else if( i_avail >= p_pack->i_au_min_size &&
+             packetizer_IsZeroTail( p_block, i_size - i_avail ) )
+    {
+        p = &p_block->p_buffer[p_bytestream->i_offset];
+        i_parse = i_avail;
+    }
+    else
+    {
+        /* The unit spans several blocks */
+        p_copy = block_Alloc( i_size );
+        if( !p_copy )
+            goto skip;
+        block_PeekBytes( p_bytestream, p_copy->p_buffer, i_size );
+        p = p_copy->p_buffer;
+    }
+
+    p_pic = p_pack->pf_parse_inplace( p_pack->p_private, pb_ts_used, p, i_parse,
+                                      p_block->i_pts, p_block->i_dts );
+
+    /* After parsing, as the parser may release what was retained before */
+    if( p_copy )
+        packetizer_Retain( p_pack, p_copy );
+skip:
+    block_SkipBytes( p_bytestream, i_size );
+    return p_pic;
 }
 
 static inline block_t *packetizer_Packetize( packetizer_t *p_pack, block_t **pp_block )
@@ -108,6 +257,8 @@ static inline block_t *packetizer_Packetize( packetizer_t *p_pack, block_t **pp_
             p_pack->i_offset = 0;
         }
         p_pack->pf_reset( p_pack->p_private, b_broken );
+        if( b_broken )
+            packetizer_ReleaseRetained( p_pack );
 
         block_Release( *pp_block );
         return NULL;
@@ -124,15 +275,16 @@ static inline block_t *packetizer_Packetize( packetizer_t *p_pack, block_t **pp_
         {
         case STATE_NOSYNC:
             /* Find a startcode */
-            if( !block_FindStartcodeFromOffset( &p_pack->bytestream, &p_pack->i_offset,
-                                                p_pack->p_startcode, p_pack->i_startcode ) )
+            if( !block_FindStartcodeFromOffsetHelper( &p_pack->bytestream, &p_pack->i_offset,
+                                                      p_pack->p_startcode, p_pack->i_startcode,
+                                                      p_pack->pf_startcode_helper ) )
                 p_pack->i_state = STATE_NEXT_SYNC;
 
             if( p_pack->i_offset )
             {
                 block_SkipBytes( &p_pack->bytestream, p_pack->i_offset );
                 p_pack->i_offset = 0;
-                block_BytestreamFlush( &p_pack->bytestream );
+                packetizer_Flush( p_pack );
             }
 
             if( p_pack->i_state != STATE_NEXT_SYNC )
@@ -142,8 +294,9 @@ static inline block_t *packetizer_Packetize( packetizer_t *p_pack, block_t **pp_
 
         case STATE_NEXT_SYNC:
             /* Find the next startcode */
-            if( block_FindStartcodeFromOffset( &p_pack->bytestream, &p_pack->i_offset,
-                                               p_pack->p_startcode, p_pack->i_startcode ) )
+            if( block_FindStartcodeFromOffsetHelper( &p_pack->bytestream, &p_pack->i_offset,
+                                                     p_pack->p_startcode, p_pack->i_startcode,
+                                                     p_pack->pf_startcode_helper ) )
             {
                 if( !p_pack->b_flushing || !p_pack->bytestream.p_chain )
                     return NULL; /* Need more data */
@@ -158,36 +311,42 @@ static inline block_t *packetizer_Packetize( packetizer_t *p_pack, block_t **pp_
                     return NULL;
             }
 
-            block_BytestreamFlush( &p_pack->bytestream );
+            packetizer_Flush( p_pack );
 
             /* Get the new fragment and set the pts/dts */
             block_t *p_block_bytestream = p_pack->bytestream.p_block;
 
-            p_pic = block_Alloc( p_pack->i_offset + p_pack->i_au_prepend );
-            p_pic->i_pts = p_block_bytestream->i_pts;
-            p_pic->i_dts = p_block_bytestream->i_dts;
-
-            block_GetBytes( &p_pack->bytestream, &p_pic->p_buffer[p_pack->i_au_prepend],
-                            p_pic->i_buffer - p_pack->i_au_prepend );
-            if( p_pack->i_au_prepend > 0 )
-                memcpy( p_pic->p_buffer, p_pack->p_au_prepend, p_pack->i_au_prepend );
-
-            p_pack->i_offset = 0;
-
-            /* Parse the NAL */
-            if( p_pic->i_buffer < p_pack->i_au_min_size )
+            if( p_pack->pf_parse_inplace )
             {
-                block_Release( p_pic );
-                p_pic = NULL;
+                p_pic = packetizer_ParseInPlace( p_pack, &b_used_ts );
             }
             else
             {
-                p_pic = p_pack->pf_parse( p_pack->p_private, &b_used_ts, p_pic );
-                if( b_used_ts )
+                p_pic = block_Alloc( p_pack->i_offset + p_pack->i_au_prepend );
+                p_pic->i_pts = p_block_bytestream->i_pts;
+                p_pic->i_dts = p_block_bytestream->i_dts;
+
+                block_GetBytes( &p_pack->bytestream, &p_pic->p_buffer[p_pack->i_au_prepend],
+                                p_pic->i_buffer - p_pack->i_au_prepend );
+                if( p_pack->i_au_prepend > 0 )
+                    memcpy( p_pic->p_buffer, p_pack->p_au_prepend, p_pack->i_au_prepend );
+
+                p_pack->i_offset = 0;
+
+                /* Parse the NAL */
+                b_used_ts = false;
+                if( p_pic->i_buffer < p_pack->i_au_min_size )
                 {
-                    p_block_bytestream->i_dts = VLC_TS_INVALID;
-                    p_block_bytestream->i_pts = VLC_TS_INVALID;
+                    block_Release( p_pic );
+                    p_pic = NULL;
                 }
+                else
+                    p_pic = p_pack->pf_parse( p_pack->p_private, &b_used_ts, p_pic );
+            }
+            if( b_used_ts )
+            {
+                p_block_bytestream->i_dts = VLC_TS_INVALID;
+                p_block_bytestream->i_pts = VLC_TS_INVALID;
             }
 
             if( !p_pic )
@@ -203,6 +362,7 @@ static inline block_t *packetizer_Packetize( packetizer_t *p_pack, block_t **pp_
             }
 
             /* So p_block doesn't get re-added several times */
+            packetizer_Flush( p_pack );
             *pp_block = block_BytestreamPop( &p_pack->bytestream );
 
             p_pack->i_state = STATE_NOSYNC;
@@ -231,6 +391,13 @@ static inline void packetizer_Header( packetizer_t *p_pack,
     block_BytestreamEmpty( &p_pack->bytestream );
     p_pack->i_offset = 0;
     p_pack->b_flushing = false;
+
+    if( p_pack->pf_parse_inplace )
+    {
+        /* Forget the units of the header, but not their parsed values */
+        p_pack->pf_reset( p_pack->p_private, true );
+        packetizer_ReleaseRetained( p_pack );
+    }
 }
 
 #endif
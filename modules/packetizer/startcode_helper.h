@@ -0,0 +1,164 @@
+/*****************************************************************************
+ * startcode_helper.h: vectorized 00 00 01 start code search
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_STARTCODE_HELPER_H
+#define VLC_STARTCODE_HELPER_H 1
+
+/*
+ * Search of the 00 00 01 start code prefix of the MPEG video, H.264, HEVC
+ * and VC-1 elementary streams, as a block_startcode_helper_t for
+ * block_FindStartcodeFromOffsetHelper(). Each function returns the first
+ * start code that lies entirely in [p, end), or NULL.
+ *
+ * The vector versions compare 16 or 32 candidate positions at once, with
+ * the bytes at offsets 0, 1 and 2 of each candidate loaded unaligned.
+ * The C version skips the words without two zero bytes.
+ */
+
+#include <string.h>
+#include <vlc_cpu.h>
+
+static inline const uint8_t *startcode_FindAnnexB_Bytes( const uint8_t *p,
+                                                         const uint8_t *end )
+{
+    for( ; p + 3 <= end; p++ )
+        if( p[0] == 0 && p[1] == 0 && p[2] == 1 )
+            return p;
+    return NULL;
+}
+
+/*** C ***/
+static inline const uint8_t *startcode_FindAnnexB_C( const uint8_t *p,
+                                                     const uint8_t *end )
+{
+    /* A start code at p..p+7 has a zero byte at p+1..p+8 */
+    for( ; end - p >= 11; p += 8 )
+    {
+        uint64_t x;
+
+        memcpy( &x, p + 1, 8 );
+        /* Non-zero if x has a zero byte (Alan Mycroft's trick) */
+        if( ( x - UINT64_C(0x0101010101010101) ) & ~x
+              & UINT64_C(0x8080808080808080) )
+        {
+            const uint8_t *r = startcode_FindAnnexB_Bytes( p, p + 10 );
+            if( r != NULL )
+                return r;
+        }
+    }
+    return startcode_FindAnnexB_Bytes( p, end );
+}
+
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (VLC_GCC_VERSION(4, 9) || defined(__clang__))
+# define STARTCODE_HELPER_SIMD 1
+# include <immintrin.h>
+
+/*** SSE2 ***/
+__attribute__ ((__target__ ("sse2")))
+static inline const uint8_t *startcode_FindAnnexB_SSE2( const uint8_t *p,
+                                                        const uint8_t *end )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8( 1 );
+
+    for( ; end - p >= 18; p += 16 )
+    {
+        __m128i a = _mm_loadu_si128( (const __m128i *)p );
+        __m128i b = _mm_loadu_si128( (const __m128i *)(p + 1) );
+        __m128i c = _mm_loadu_si128( (const __m128i *)(p + 2) );
+        __m128i m = _mm_and_si128( _mm_and_si128( _mm_cmpeq_epi8( a, zero ),
+                                                  _mm_cmpeq_epi8( b, zero ) ),
+                                   _mm_cmpeq_epi8( c, one ) );
+        unsigned mask = _mm_movemask_epi8( m );
+
+        if( mask )
+            return p + ctz( mask );
+    }
+    return startcode_FindAnnexB_Bytes( p, end );
+}
+
+/*** AVX2 ***/
+__attribute__ ((__target__ ("avx2")))
+static inline const uint8_t *startcode_FindAnnexB_AVX2( const uint8_t *p,
+                                                        const uint8_t *end )
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8( 1 );
+
+    for( ; end - p >= 34; p += 32 )
+    {
+        __m256i a = _mm256_loadu_si256( (const __m256i *)p );
+        __m256i b = _mm256_loadu_si256( (const __m256i *)(p + 1) );
+        __m256i c = _mm256_loadu_si256( (const __m256i *)(p + 2) );
+        __m256i m = _mm256_and_si256(
+                        _mm256_and_si256( _mm256_cmpeq_epi8( a, zero ),
+                                          _mm256_cmpeq_epi8( b, zero ) ),
+                        _mm256_cmpeq_epi8( c, one ) );
+        unsigned mask = _mm256_movemask_epi8( m );
+
+        if( mask )
+            return p + ctz( mask );
+    }
+    return startcode_FindAnnexB_SSE2( p, end );
+}
+
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+# define STARTCODE_HELPER_SIMD 1
+# include <arm_neon.h>
+
+/*** NEON ***/
+static inline const uint8_t *startcode_FindAnnexB_NEON( const uint8_t *p,
+                                                        const uint8_t *end )
+{
+    const uint8x16_t zero = vdupq_n_u8( 0 );
+    const uint8x16_t one = vdupq_n_u8( 1 );
+
+    for( ; end - p >= 18; p += 16 )
+    {
+        uint8x16_t m = vandq_u8( vandq_u8( vceqq_u8( vld1q_u8( p ), zero ),
+                                           vceqq_u8( vld1q_u8( p + 1 ), zero ) ),
+                                 vceqq_u8( vld1q_u8( p + 2 ), one ) );
+        uint64x2_t w = vreinterpretq_u64_u8( m );
+
+        if( vgetq_lane_u64( w, 0 ) | vgetq_lane_u64( w, 1 ) )
+            return startcode_FindAnnexB_Bytes( p, p + 18 );
+    }
+    return startcode_FindAnnexB_Bytes( p, end );
+}
+#endif
+
+static inline const uint8_t *startcode_FindAnnexB( const uint8_t *p,
+                                                   const uint8_t *end )
+{
+#ifdef STARTCODE_HELPER_SIMD
+# if defined(__i386__) || defined(__x86_64__)
+    if( vlc_CPU_AVX2() )
+        return startcode_FindAnnexB_AVX2( p, end );
+    if( vlc_CPU_SSE2() )
+        return startcode_FindAnnexB_SSE2( p, end );
+# else
+    return startcode_FindAnnexB_NEON( p, end );
+# endif
+#endif
+    return startcode_FindAnnexB_C( p, end );
+}
+
+#endif /* VLC_STARTCODE_HELPER_H */
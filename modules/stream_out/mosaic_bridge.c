@@ -381,6 +381,8 @@ static sout_stream_id_sys_t * Add( sout_stream_t *p_stream, es_format_t *p_fmt )
     p_es->p_picture = NULL;
     p_es->pp_last = &p_es->p_picture;
     p_es->b_empty = false;
+    p_es->i_shown = p_es->i_dropped = 0;
+    p_es->i_latency = p_es->i_latency_max = 0;
 
     vlc_global_unlock( VLC_MOSAIC_MUTEX );
 
@@ -454,6 +456,10 @@ static int Del( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
     p_bridge = GetBridge( p_stream );
     p_es = p_sys->p_es;
 
+    msg_Dbg( p_stream, "mosaic bridge id=%s: %u pictures shown, %u dropped, "
+             "maximum latency %"PRId64" us", p_es->psz_id, p_es->i_shown,
+             p_es->i_dropped, p_es->i_latency_max );
+
     p_es->b_empty = true;
     while ( p_es->p_picture )
     {
@@ -139,6 +139,11 @@
     "Default caching value for outbound RTP streams. This " \
     "value should be set in milliseconds." )
 
+#define SEND_THREADS_TEXT N_("Sender threads")
+#define SEND_THREADS_LONGTEXT N_( \
+    "Number of threads sending the RTP packets of each elementary stream. " \
+    "The destinations (e.g. the RTSP clients) are shared among them." )
+
 #define PROTO_TEXT N_("Transport protocol")
 #define PROTO_LONGTEXT N_( \
     "This selects which transport protocol to use for RTP." )
@@ -230,6 +235,8 @@ vlc_module_begin ()
               RTCP_MUX_TEXT, RTCP_MUX_LONGTEXT, false )
     add_integer( SOUT_CFG_PREFIX "caching", DEFAULT_PTS_DELAY / 1000,
                  CACHING_TEXT, CACHING_LONGTEXT, true )
+    add_integer_with_range( SOUT_CFG_PREFIX "send-threads", 1, 1, 16,
+                            SEND_THREADS_TEXT, SEND_THREADS_LONGTEXT, true )
 
 #ifdef HAVE_SRTP
     add_string( SOUT_CFG_PREFIX "key", "",
@@ -266,7 +273,7 @@ vlc_module_end ()
 static const char *const ppsz_sout_options[] = {
     "dst", "name", "cat", "port", "port-audio", "port-video", "*sdp", "ttl",
     "mux", "sap", "description", "url", "email", "phone",
-    "proto", "rtcp-mux", "caching",
+    "proto", "rtcp-mux", "caching", "send-threads",
 #ifdef HAVE_SRTP
     "key", "salt",
 #endif
@@ -284,6 +291,7 @@ static int               MuxSend( sout_stream_t *, sout_stream_id_sys_t *,
 
 static sout_access_out_t *GrabberCreate( sout_stream_t *p_sout );
 static void* ThreadSend( void * );
+static void* ThreadShard( void * );
 static void *rtp_listen_thread( void * );
 
 static void SDPHandleUrl( sout_stream_t *, const char * );
@@ -345,11 +353,12 @@ struct sout_stream_sys_t
     sout_stream_id_sys_t **es;
 };
 
-typedef struct rtp_sink_t
+typedef struct rtp_shard_t
 {
-    int rtp_fd;
-    rtcp_sender_t *rtcp;
-} rtp_sink_t;
+    sout_stream_id_sys_t *id;
+    vlc_thread_t thread;
+    unsigned     index;
+} rtp_shard_t;
 
 struct sout_stream_id_sys_t
 {
@@ -380,6 +389,17 @@ struct sout_stream_id_sys_t
     int               sinkc;
     rtp_sink_t       *sinkv;
     rtsp_stream_id_t *rtsp_id;
+    /* Sender threads: the sink i is served by the shard (i % shardc),
+     * the shard 0 being ThreadSend() */
+    unsigned          shardc;
+    rtp_shard_t      *shardv;
+    vlc_mutex_t       lock_shard;
+    vlc_cond_t        wait_batch;
+    vlc_cond_t        wait_done;
+    unsigned          batch_seq;
+    unsigned          batch_pending;
+    block_t         **batchv;
+    unsigned          batchc;
     struct {
         int          *fd;
         vlc_thread_t  thread;
@@ -976,6 +996,13 @@ static sout_stream_id_sys_t *Add( sout_stream_t *p_stream, es_format_t *p_fmt )
     id->sinkc = 0;
     id->sinkv = NULL;
     id->rtsp_id = NULL;
+    id->shardc = 1;
+    id->shardv = NULL;
+    vlc_mutex_init( &id->lock_shard );
+    vlc_cond_init( &id->wait_batch );
+    vlc_cond_init( &id->wait_done );
+    id->batch_seq = 0;
+    id->batch_pending = 0;
     id->p_fifo = NULL;
     id->listen.fd = NULL;
 
@@ -1181,6 +1208,28 @@ static sout_stream_id_sys_t *Add( sout_stream_t *p_stream, es_format_t *p_fmt )
         id->rtsp_id = RtspAddId( p_sys->rtsp, id, GetDWBE( id->ssrc ),
                                  id->rtp_fmt.clock_rate, mcast_fd );
 
+    unsigned shardc = var_GetInteger( p_stream, SOUT_CFG_PREFIX "send-threads" );
+    if( shardc > 1 )
+    {
+        id->shardv = malloc( (shardc - 1) * sizeof( *id->shardv ) );
+        if( unlikely(id->shardv == NULL) )
+            shardc = 1;
+    }
+    for( unsigned i = 1; i < shardc; i++ )
+    {
+        rtp_shard_t *shard = &id->shardv[i - 1];
+
+        shard->id = id;
+        shard->index = i;
+        if( vlc_clone( &shard->thread, ThreadShard, shard,
+                       VLC_THREAD_PRIORITY_HIGHEST ) )
+        {
+            msg_Warn( p_stream, "cannot start sender thread %u", i );
+            break;
+        }
+        id->shardc++;
+    }
+
     id->p_fifo = block_FifoNew();
     if( unlikely(id->p_fifo == NULL) )
         goto error;
@@ -1230,6 +1279,12 @@ static int Del( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
         vlc_join( id->thread, NULL );
         block_FifoRelease( id->p_fifo );
     }
+    for( unsigned i = 1; i < id->shardc; i++ )
+    {
+        vlc_cancel( id->shardv[i - 1].thread );
+        vlc_join( id->shardv[i - 1].thread, NULL );
+    }
+    free( id->shardv );
 
     free( id->rtp_fmt.fmtp );
 
@@ -1253,6 +1308,9 @@ static int Del( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
 #endif
 
     vlc_mutex_destroy( &id->lock_sink );
+    vlc_cond_destroy( &id->wait_done );
+    vlc_cond_destroy( &id->wait_batch );
+    vlc_mutex_destroy( &id->lock_shard );
 
     /* Update SDP (sap/file) */
     if( p_sys->b_export_sap ) SapSetup( p_stream );
@@ -1392,15 +1450,76 @@ static int  HttpCallback( httpd_file_sys_t *p_args,
 /****************************************************************************
  * RTP send
  ****************************************************************************/
-static void* ThreadSend( void *data )
+#ifdef HAVE_SRTP
+static block_t *Encrypt( sout_stream_id_sys_t *id, block_t *out )
+{   /* FIXME: this is awfully inefficient */
+    size_t len = out->i_buffer;
+    out = block_Realloc( out, 0, len + 10 );
+    out->i_buffer = len;
+
+    int canc = vlc_savecancel ();
+    int val = srtp_send( id->srtp, out->p_buffer, &len, len + 10 );
+    vlc_restorecancel (canc);
+    if( val )
+    {
+        msg_Dbg( id->p_stream, "SRTP sending error: %s",
+                 vlc_strerror_c(val) );
+        block_Release( out );
+        return NULL;
+    }
+    out->i_buffer = len;
+    return out;
+}
+#endif
+
+static void SendShard( sout_stream_id_sys_t *id, unsigned shard )
 {
-#ifdef _WIN32
-# define ENOBUFS      WSAENOBUFS
-# define EAGAIN       WSAEWOULDBLOCK
-# define EWOULDBLOCK  WSAEWOULDBLOCK
+    for( int i = shard; i < id->sinkc; i += id->shardc )
+    {
+        rtp_sink_t *sink = &id->sinkv[i];
+
+#ifdef HAVE_SRTP
+        if( !id->srtp ) /* FIXME: SRTCP support */
 #endif
+            for( unsigned j = 0; j < id->batchc; j++ )
+                SendRTCP( sink->rtcp, id->batchv[j] );
+
+        if( rtp_sink_Send( sink, id->batchv, id->batchc ) )
+            sink->dead = true; /* Broken connection */
+    }
+}
+
+/* Sends the packets to every sink, with lock_sink held */
+static void SendBatch( sout_stream_id_sys_t *id, block_t **pktv,
+                       unsigned pktc )
+{
+    id->batchv = pktv;
+    id->batchc = pktc;
+    if( id->shardc > 1 )
+    {
+        vlc_mutex_lock( &id->lock_shard );
+        id->batch_seq++;
+        id->batch_pending = id->shardc - 1;
+        vlc_cond_broadcast( &id->wait_batch );
+        vlc_mutex_unlock( &id->lock_shard );
+    }
+
+    SendShard( id, 0 );
+
+    if( id->shardc > 1 )
+    {
+        vlc_mutex_lock( &id->lock_shard );
+        while( id->batch_pending > 0 )
+            vlc_cond_wait( &id->wait_done, &id->lock_shard );
+        vlc_mutex_unlock( &id->lock_shard );
+    }
+}
+
+static void* ThreadSend( void *data )
+{
     sout_stream_id_sys_t *id = data;
     unsigned i_caching = id->i_caching;
+    block_t *pktv[RTP_BATCH_MAX];
 
     for (;;)
     {
@@ -1409,24 +1528,7 @@ static void* ThreadSend( void *data )
 
 #ifdef HAVE_SRTP
         if( id->srtp )
-        {   /* FIXME: this is awfully inefficient */
-            size_t len = out->i_buffer;
-            out = block_Realloc( out, 0, len + 10 );
-            out->i_buffer = len;
-
-            int canc = vlc_savecancel ();
-            int val = srtp_send( id->srtp, out->p_buffer, &len, len + 10 );
-            vlc_restorecancel (canc);
-            if( val )
-            {
-                msg_Dbg( id->p_stream, "SRTP sending error: %s",
-                         vlc_strerror_c(val) );
-                block_Release( out );
-                out = NULL;
-            }
-            else
-                out->i_buffer = len;
-        }
+            out = Encrypt( id, out );
         if (out)
             mwait (out->i_dts + i_caching);
         vlc_cleanup_pop ();
@@ -1437,38 +1539,40 @@ static void* ThreadSend( void *data )
         vlc_cleanup_pop ();
 #endif
 
-        ssize_t len = out->i_buffer;
         int canc = vlc_savecancel ();
+        unsigned pktc = 0;
+        mtime_t now = mdate ();
+
+        /* Send the packets that are already due along with this one */
+        pktv[pktc++] = out;
+        while( pktc < RTP_BATCH_MAX && block_FifoCount( id->p_fifo ) > 0
+            && block_FifoShow( id->p_fifo )->i_dts + i_caching <= now )
+        {
+            out = block_FifoGet( id->p_fifo );
+#ifdef HAVE_SRTP
+            if( id->srtp )
+                out = Encrypt( id, out );
+            if( out == NULL )
+                continue;
+#endif
+            pktv[pktc++] = out;
+        }
 
         vlc_mutex_lock( &id->lock_sink );
+        SendBatch( id, pktv, pktc );
+
         unsigned deadc = 0; /* How many dead sockets? */
         int deadv[id->sinkc]; /* Dead sockets list */
 
         for( int i = 0; i < id->sinkc; i++ )
-        {
-#ifdef HAVE_SRTP
-            if( !id->srtp ) /* FIXME: SRTCP support */
-#endif
-                SendRTCP( id->sinkv[i].rtcp, out );
-
-            if( send( id->sinkv[i].rtp_fd, out->p_buffer, len, 0 ) == -1
-             && net_errno != EAGAIN && net_errno != EWOULDBLOCK
-             && net_errno != ENOBUFS && net_errno != ENOMEM )
-            {
-                int type;
-                getsockopt( id->sinkv[i].rtp_fd, SOL_SOCKET, SO_TYPE,
-                            &type, &(socklen_t){ sizeof(type) });
-                if( type == SOCK_DGRAM )
-                    /* ICMP soft error: ignore and retry */
-                    send( id->sinkv[i].rtp_fd, out->p_buffer, len, 0 );
-                else
-                    /* Broken connection */
-                    deadv[deadc++] = id->sinkv[i].rtp_fd;
-            }
-        }
-        id->i_seq_sent_next = ntohs(((uint16_t *) out->p_buffer)[1]) + 1;
+            if( id->sinkv[i].dead )
+                deadv[deadc++] = id->sinkv[i].rtp_fd;
+        id->i_seq_sent_next =
+            ntohs(((uint16_t *) pktv[pktc - 1]->p_buffer)[1]) + 1;
         vlc_mutex_unlock( &id->lock_sink );
-        block_Release( out );
+
+        for( unsigned i = 0; i < pktc; i++ )
+            block_Release( pktv[i] );
 
         for( unsigned i = 0; i < deadc; i++ )
         {
@@ -1480,6 +1584,36 @@ static void* ThreadSend( void *data )
     return NULL;
 }
 
+/* This thread sends the packets of each batch to a share of the sinks. The
+ * batch and the sinks are owned by ThreadSend() until it is done. */
+static void* ThreadShard( void *data )
+{
+    rtp_shard_t *shard = data;
+    sout_stream_id_sys_t *id = shard->id;
+    unsigned seq = 0;
+
+    for (;;)
+    {
+        vlc_mutex_lock( &id->lock_shard );
+        mutex_cleanup_push( &id->lock_shard );
+        while( id->batch_seq == seq )
+            vlc_cond_wait( &id->wait_batch, &id->lock_shard );
+        vlc_cleanup_pop ();
+        seq = id->batch_seq;
+        vlc_mutex_unlock( &id->lock_shard );
+
+        int canc = vlc_savecancel ();
+        SendShard( id, shard->index );
+
+        vlc_mutex_lock( &id->lock_shard );
+        if( --id->batch_pending == 0 )
+            vlc_cond_signal( &id->wait_done );
+        vlc_mutex_unlock( &id->lock_shard );
+        vlc_restorecancel (canc);
+    }
+    return NULL;
+}
+
 
 /* This thread dequeues incoming connections (DCCP streaming) */
 static void *rtp_listen_thread( void *data )
@@ -1504,7 +1638,7 @@ static void *rtp_listen_thread( void *data )
 
 int rtp_add_sink( sout_stream_id_sys_t *id, int fd, bool rtcp_mux, uint16_t *seq )
 {
-    rtp_sink_t sink = { fd, NULL };
+    rtp_sink_t sink = { .rtp_fd = fd };
     sink.rtcp = OpenRTCP( VLC_OBJECT( id->p_stream ), fd, IPPROTO_UDP,
                           rtcp_mux );
     if( sink.rtcp == NULL )
@@ -1520,7 +1654,7 @@ int rtp_add_sink( sout_stream_id_sys_t *id, int fd, bool rtcp_mux, uint16_t *seq
 
 void rtp_del_sink( sout_stream_id_sys_t *id, int fd )
 {
-    rtp_sink_t sink = { fd, NULL };
+    rtp_sink_t sink = { .rtp_fd = fd };
 
     /* NOTE: must be safe to use if fd is not included */
     vlc_mutex_lock( &id->lock_sink );
@@ -1535,6 +1669,7 @@ void rtp_del_sink( sout_stream_id_sys_t *id, int fd )
     }
     vlc_mutex_unlock( &id->lock_sink );
 
+    rtp_sink_Clean( &sink );
     CloseRTCP( sink.rtcp );
     net_Close( sink.rtp_fd );
 }
@@ -69,6 +69,24 @@ rtcp_sender_t *OpenRTCP (vlc_object_t *obj, int rtp_fd, int proto,
 void CloseRTCP (rtcp_sender_t *rtcp);
 void SendRTCP (rtcp_sender_t *restrict rtcp, const block_t *rtp);
 
+/* RTP sinks */
+#define RTP_BATCH_MAX   32  /* packets sent per system call */
+#define RTP_BACKLOG_MAX 256 /* packets queued per sink */
+
+typedef struct rtp_sink_t
+{
+    int rtp_fd;
+    rtcp_sender_t *rtcp;
+    /* Packets that the socket could not take yet, oldest first */
+    block_t *backlog;
+    block_t *backlog_tail;
+    unsigned backlog_count;
+    bool dead;
+} rtp_sink_t;
+
+int rtp_sink_Send( rtp_sink_t *sink, block_t *const *pktv, unsigned pktc );
+void rtp_sink_Clean( rtp_sink_t *sink );
+
 typedef int (*pf_rtp_packetizer_t)( sout_stream_id_sys_t *, block_t * );
 
 typedef struct rtp_format_t
@@ -0,0 +1,199 @@
+/*****************************************************************************
+ * rtpsend.c: RTP packets transmission to a sink
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_network.h>
+#include <vlc_sout.h>
+
+#include "rtp.h"
+
+#include <errno.h>
+#include <assert.h>
+
+#ifdef _WIN32
+# define ENOBUFS      WSAENOBUFS
+# define EAGAIN       WSAEWOULDBLOCK
+# define EWOULDBLOCK  WSAEWOULDBLOCK
+#endif
+
+/**
+ * Sends up to RTP_BATCH_MAX packets, in a single system call if possible.
+ * @return the number of packets sent, or -1 if the first one failed.
+ */
+static int SendPackets( int fd, block_t *const *pktv, unsigned pktc )
+{
+    assert( pktc > 0 && pktc <= RTP_BATCH_MAX );
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgv[RTP_BATCH_MAX];
+    struct iovec iov[RTP_BATCH_MAX];
+
+    for( unsigned i = 0; i < pktc; i++ )
+    {
+        iov[i].iov_base = pktv[i]->p_buffer;
+        iov[i].iov_len = pktv[i]->i_buffer;
+        memset( &msgv[i], 0, sizeof( msgv[i] ) );
+        msgv[i].msg_hdr.msg_iov = &iov[i];
+        msgv[i].msg_hdr.msg_iovlen = 1;
+    }
+    return sendmmsg( fd, msgv, pktc, 0 );
+#else
+    for( unsigned i = 0; i < pktc; i++ )
+        if( send( fd, pktv[i]->p_buffer, pktv[i]->i_buffer, 0 ) == -1 )
+            return i ? (int)i : -1;
+    return pktc;
+#endif
+}
+
+/**
+ * Handles a failed transmission of the packet p.
+ * @return 0 if the socket is full, 1 if the packet was sent or dropped,
+ * -1 if the connection is broken.
+ */
+static int SendError( int fd, const block_t *p )
+{
+    if( net_errno == EAGAIN || net_errno == EWOULDBLOCK )
+        return 0;
+    if( net_errno == ENOBUFS || net_errno == ENOMEM )
+        return 1;
+
+    int type;
+    getsockopt( fd, SOL_SOCKET, SO_TYPE, &type,
+                &(socklen_t){ sizeof(type) });
+    if( type != SOCK_DGRAM )
+        return -1; /* Broken connection */
+
+    /* ICMP soft error: ignore and retry */
+    send( fd, p->p_buffer, p->i_buffer, 0 );
+    return 1;
+}
+
+/**
+ * Sends the packets of the backlog that the socket can take.
+ * @return the number of packets left, or -1 if the connection is broken.
+ */
+static int FlushBacklog( rtp_sink_t *sink )
+{
+    while( sink->backlog != NULL )
+    {
+        block_t *pktv[RTP_BATCH_MAX];
+        unsigned pktc = 0;
+
+        for( block_t *p = sink->backlog; p != NULL && pktc < RTP_BATCH_MAX;
+             p = p->p_next )
+            pktv[pktc++] = p;
+
+        int val = SendPackets( sink->rtp_fd, pktv, pktc );
+        if( val < 0 )
+        {
+            val = SendError( sink->rtp_fd, pktv[0] );
+            if( val <= 0 )
+                return val ? -1 : (int)sink->backlog_count;
+        }
+
+        for( int i = 0; i < val; i++ )
+        {
+            block_t *p = sink->backlog;
+
+            sink->backlog = p->p_next;
+            block_Release( p );
+        }
+        sink->backlog_count -= val;
+        if( (unsigned)val < pktc )
+            break; /* The socket is full */
+    }
+    return sink->backlog_count;
+}
+
+static void QueuePacket( rtp_sink_t *sink, const block_t *p )
+{
+    block_t *copy = block_Alloc( p->i_buffer );
+    if( unlikely(copy == NULL) )
+        return;
+    memcpy( copy->p_buffer, p->p_buffer, p->i_buffer );
+
+    if( sink->backlog_count >= RTP_BACKLOG_MAX )
+    {   /* Drop the oldest packet, it would be late anyway */
+        block_t *old = sink->backlog;
+
+        sink->backlog = old->p_next;
+        block_Release( old );
+        sink->backlog_count--;
+    }
+
+    if( sink->backlog == NULL )
+        sink->backlog = copy;
+    else
+        sink->backlog_tail->p_next = copy;
+    sink->backlog_tail = copy;
+    sink->backlog_count++;
+}
+
+/**
+ * Sends packets to a sink, after the ones queued by the previous calls.
+ * The packets are sent in batches of RTP_BATCH_MAX with sendmmsg() where
+ * available. The packets that do not fit in the socket buffer are copied
+ * into the sink backlog, so that a slow sink neither loses them nor
+ * delays the other sinks. The backlog keeps the RTP_BACKLOG_MAX most
+ * recent packets.
+ * @param pktv packets (not released)
+ * @param pktc number of packets, 0 only flushes the backlog
+ * @return VLC_SUCCESS, or VLC_EGENERIC if the connection is broken.
+ */
+int rtp_sink_Send( rtp_sink_t *sink, block_t *const *pktv, unsigned pktc )
+{
+    unsigned done = 0;
+    int val = FlushBacklog( sink );
+
+    if( val < 0 )
+        return VLC_EGENERIC;
+
+    while( val == 0 && done < pktc )
+    {
+        unsigned count = __MIN(pktc - done, RTP_BATCH_MAX);
+
+        val = SendPackets( sink->rtp_fd, pktv + done, count );
+        if( val < 0 )
+        {
+            val = SendError( sink->rtp_fd, pktv[done] );
+            if( val < 0 )
+                return VLC_EGENERIC;
+            if( val == 0 )
+                break;
+        }
+        done += val;
+        val = 0;
+    }
+
+    while( done < pktc )
+        QueuePacket( sink, pktv[done++] );
+    return VLC_SUCCESS;
+}
+
+void rtp_sink_Clean( rtp_sink_t *sink )
+{
+    block_ChainRelease( sink->backlog );
+    sink->backlog = NULL;
+    sink->backlog_count = 0;
+}
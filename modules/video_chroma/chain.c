@@ -172,28 +172,79 @@ static int BuildTransformChain( filter_t *p_filter )
     return VLC_EGENERIC;
 }
 
+/* Estimated number of bytes of a picture */
+static uint64_t PictureBytes( const video_format_t *p_fmt )
+{
+    const vlc_chroma_description_t *p_dsc =
+        vlc_fourcc_GetChromaDescription( p_fmt->i_chroma );
+    if( !p_dsc )
+        return UINT64_MAX / 4;
+
+    uint64_t i_bytes = 0;
+    for( unsigned i = 0; i < p_dsc->plane_count; i++ )
+        i_bytes += (uint64_t)p_fmt->i_visible_width * p_dsc->p[i].w.num / p_dsc->p[i].w.den
+                 * p_fmt->i_visible_height * p_dsc->p[i].h.num / p_dsc->p[i].h.den
+                 * p_dsc->pixel_size;
+    return i_bytes;
+}
+
 static int BuildChromaResize( filter_t *p_filter )
 {
-    es_format_t fmt_mid;
-    int i_ret;
+    const vlc_fourcc_t i_in = p_filter->fmt_in.video.i_chroma;
+    es_format_t fmt_mid[3];
+    uint64_t pi_cost[3];
+    int pi_order[3];
+    unsigned i_plans = 0;
 
     /* Lets try resizing and then doing the chroma conversion */
-    msg_Dbg( p_filter, "Trying to build resize+chroma" );
-    EsFormatMergeSize( &fmt_mid, &p_filter->fmt_in, &p_filter->fmt_out );
-    i_ret = CreateChain( p_filter, &fmt_mid, NULL );
-    es_format_Clean( &fmt_mid );
-    if( i_ret == VLC_SUCCESS )
-        return VLC_SUCCESS;
+    EsFormatMergeSize( &fmt_mid[i_plans++], &p_filter->fmt_in, &p_filter->fmt_out );
 
     /* Lets try it the other way arround (chroma and then resize) */
-    msg_Dbg( p_filter, "Trying to build chroma+resize" );
-    EsFormatMergeSize( &fmt_mid, &p_filter->fmt_out, &p_filter->fmt_in );
-    i_ret = CreateChain( p_filter, &fmt_mid, NULL );
-    es_format_Clean( &fmt_mid );
-    if( i_ret == VLC_SUCCESS )
-        return VLC_SUCCESS;
+    EsFormatMergeSize( &fmt_mid[i_plans++], &p_filter->fmt_out, &p_filter->fmt_in );
 
-    return VLC_EGENERIC;
+    /* Converting to I420 first lets the second filter scale and convert to
+     * the output chroma in one pass, without an intermediate picture at the
+     * output size */
+    if( i_in != VLC_CODEC_I420 && i_in != VLC_CODEC_NV12
+     && p_filter->fmt_out.video.i_chroma != VLC_CODEC_I420 )
+    {
+        es_format_Copy( &fmt_mid[i_plans], &p_filter->fmt_in );
+        fmt_mid[i_plans].i_codec        =
+        fmt_mid[i_plans].video.i_chroma = VLC_CODEC_I420;
+        fmt_mid[i_plans].video.i_rmask  = 0;
+        fmt_mid[i_plans].video.i_gmask  = 0;
+        fmt_mid[i_plans].video.i_bmask  = 0;
+        i_plans++;
+    }
+
+    /* Try the plans touching the fewer bytes first: the intermediate picture
+     * is written by the first filter and read by the second one */
+    for( unsigned i = 0; i < i_plans; i++ )
+    {
+        pi_cost[i] = 2 * PictureBytes( &fmt_mid[i].video );
+        pi_order[i] = i;
+        for( unsigned j = i; j > 0 && pi_cost[pi_order[j - 1]] > pi_cost[i]; j-- )
+        {
+            pi_order[j] = pi_order[j - 1];
+            pi_order[j - 1] = i;
+        }
+    }
+
+    int i_ret = VLC_EGENERIC;
+    for( unsigned i = 0; i < i_plans && i_ret != VLC_SUCCESS; i++ )
+    {
+        const video_format_t *p_mid = &fmt_mid[pi_order[i]].video;
+
+        msg_Dbg( p_filter, "Trying to build chroma+resize through %4.4s %ux%u "
+                 "(%"PRIu64" bytes)", (const char *)&p_mid->i_chroma,
+                 p_mid->i_visible_width, p_mid->i_visible_height,
+                 pi_cost[pi_order[i]] );
+        i_ret = CreateChain( p_filter, &fmt_mid[pi_order[i]], NULL );
+    }
+
+    for( unsigned i = 0; i < i_plans; i++ )
+        es_format_Clean( &fmt_mid[i] );
+    return i_ret;
 }
 
 static int BuildChromaChain( filter_t *p_filter )
@@ -1,5 +1,5 @@
 /*****************************************************************************
- * copy.c: Fast YV12/NV12 copy
+ * copy.c: Fast YV12/NV12/P010 copy
  *****************************************************************************
  * Copyright (C) 2010 Laurent Aimar
  * $Id$
@@ -28,34 +28,83 @@
 #include <vlc_common.h>
 #include <vlc_picture.h>
 #include <vlc_cpu.h>
+#include <vlc_threadpool.h>
 #include <assert.h>
 
 #include "copy.h"
 
+/* Pictures larger than 1080p are copied by horizontal tiles, in parallel */
+#define COPY_MAX_TILES   4
+#define COPY_TILE_PIXELS (1920 * 1088)
+
+#ifdef COPY_TEST
+/* Restricts the code paths used, to compare them */
+static unsigned copy_cpu_mask = ~0u;
+# define CopyCPU() (vlc_CPU() & copy_cpu_mask)
+#else
+# define CopyCPU() vlc_CPU()
+#endif
+
 int CopyInitCache(copy_cache_t *cache, unsigned width)
 {
+    cache->tiles = COPY_MAX_TILES;
+    cache->pool  = NULL;
 #ifdef CAN_COMPILE_SSE2
-    cache->size = __MAX((width + 0x0f) & ~ 0x0f, 4096);
-    cache->buffer = vlc_memalign(16, cache->size);
+    /* One buffer per tile, each large enough for a line of 16-bits samples */
+    cache->size = __MAX((2 * width + 0x1f) & ~ 0x1f, 16384);
+    cache->buffer = vlc_memalign(32, cache->size * COPY_MAX_TILES);
     if (!cache->buffer)
         return VLC_EGENERIC;
 #else
-    (void) cache; (void) width;
+    (void) width;
 #endif
     return VLC_SUCCESS;
 }
 
 void CopyCleanCache(copy_cache_t *cache)
 {
+    if (cache->pool != NULL)
+        vlc_threadpool_destroy(cache->pool);
+    cache->pool = NULL;
 #ifdef CAN_COMPILE_SSE2
     vlc_free(cache->buffer);
     cache->buffer = NULL;
     cache->size   = 0;
-#else
-    (void) cache;
 #endif
 }
 
+enum {
+    COPY_PLANE,   /* bytes */
+    COPY_PLANE16, /* 16-bits samples, shifted right */
+    COPY_SPLIT,   /* interleaved 8-bits U/V samples to two planes */
+    COPY_SPLIT16, /* interleaved 16-bits U/V samples to two planes, shifted */
+};
+
+typedef struct {
+    int           type;
+    uint8_t       *dst[2];
+    size_t        dst_pitch[2];
+    const uint8_t *src;
+    size_t        src_pitch;
+    unsigned      width;  /* in samples per destination line */
+    unsigned      height;
+    unsigned      shift;
+} copy_plane_t;
+
+/* Number of bytes of a source line */
+static unsigned SourceWidth(const copy_plane_t *p)
+{
+    switch (p->type) {
+        case COPY_PLANE:
+            return p->width;
+        case COPY_PLANE16:
+        case COPY_SPLIT:
+            return 2 * p->width;
+        default:
+            return 4 * p->width;
+    }
+}
+
 #ifdef CAN_COMPILE_SSE2
 /* Copy 64 bytes from srcp to dstp loading data with the SSE>=2 instruction
  * load and storing data with the SSE>=2 instruction store.
@@ -254,98 +303,367 @@ static void SSE_SplitUV(uint8_t *dstu, size_t dstu_pitch,
     }
 }
 
-static void SSE_CopyPlane(uint8_t *dst, size_t dst_pitch,
-                          const uint8_t *src, size_t src_pitch,
-                          uint8_t *cache, size_t cache_size,
-                          unsigned width, unsigned height, unsigned cpu)
+#if VLC_GCC_VERSION(4, 9) || defined(__clang__)
+/* The 16-bits and AVX2 routines use intrinsics, with per function targets */
+# define COPY_SIMD 1
+# include <immintrin.h>
+
+# define COPY_SSE2 __attribute__ ((__target__ ("sse2")))
+# define COPY_AVX2 __attribute__ ((__target__ ("avx2")))
+
+/* The 16-bits samples are biased to signed values, so that they can be
+ * packed with saturation whatever their range */
+COPY_SSE2
+static void SSE2_CopyPlane16(uint8_t *dst, size_t dst_pitch,
+                             const uint8_t *src, size_t src_pitch,
+                             unsigned width, unsigned height, unsigned shift)
 {
-    const unsigned w16 = (width+15) & ~15;
-    const unsigned hstep = cache_size / w16;
-    assert(hstep > 0);
+    const __m128i count = _mm_cvtsi32_si128(shift);
 
-    for (unsigned y = 0; y < height; y += hstep) {
-        const unsigned hblock =  __MIN(hstep, height - y);
+    for (unsigned y = 0; y < height; y++) {
+        const uint16_t *in = (const uint16_t *)src;
+        uint16_t *out = (uint16_t *)dst;
+        unsigned x = 0;
 
-        /* Copy a bunch of line into our cache */
-        CopyFromUswc(cache, w16,
-                     src, src_pitch,
-                     width, hblock, cpu);
+        for (; x + 7 < width; x += 8) {
+            __m128i v = _mm_load_si128((const __m128i *)&in[x]);
+            _mm_storeu_si128((__m128i *)&out[x], _mm_srl_epi16(v, count));
+        }
+        for (; x < width; x++)
+            out[x] = in[x] >> shift;
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
 
-        /* Copy from our cache to the destination */
-        Copy2d(dst, dst_pitch,
-               cache, w16,
-               width, hblock);
+COPY_SSE2
+static void SSE2_SplitUV16(uint8_t *dstu, size_t dstu_pitch,
+                           uint8_t *dstv, size_t dstv_pitch,
+                           const uint8_t *src, size_t src_pitch,
+                           unsigned width, unsigned height, unsigned shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m128i bias = _mm_set1_epi32(0x80008000);
 
-        /* */
-        src += src_pitch * hblock;
-        dst += dst_pitch * hblock;
+    for (unsigned y = 0; y < height; y++) {
+        const uint16_t *in = (const uint16_t *)src;
+        uint16_t *u = (uint16_t *)dstu;
+        uint16_t *v = (uint16_t *)dstv;
+        unsigned x = 0;
+
+        for (; x + 7 < width; x += 8) {
+            __m128i a = _mm_load_si128((const __m128i *)&in[2*x]);
+            __m128i b = _mm_load_si128((const __m128i *)&in[2*x+8]);
+            a = _mm_xor_si128(_mm_srl_epi16(a, count), bias);
+            b = _mm_xor_si128(_mm_srl_epi16(b, count), bias);
+
+            __m128i ua = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+            __m128i ub = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+            __m128i va = _mm_srai_epi32(a, 16);
+            __m128i vb = _mm_srai_epi32(b, 16);
+
+            _mm_storeu_si128((__m128i *)&u[x],
+                             _mm_xor_si128(_mm_packs_epi32(ua, ub), bias));
+            _mm_storeu_si128((__m128i *)&v[x],
+                             _mm_xor_si128(_mm_packs_epi32(va, vb), bias));
+        }
+        for (; x < width; x++) {
+            u[x] = in[2*x+0] >> shift;
+            v[x] = in[2*x+1] >> shift;
+        }
+        src  += src_pitch;
+        dstu += dstu_pitch;
+        dstv += dstv_pitch;
     }
-    asm volatile ("mfence");
 }
 
-static void SSE_SplitPlanes(uint8_t *dstu, size_t dstu_pitch,
-                            uint8_t *dstv, size_t dstv_pitch,
-                            const uint8_t *src, size_t src_pitch,
-                            uint8_t *cache, size_t cache_size,
-                            unsigned width, unsigned height, unsigned cpu)
+/* Same as CopyFromUswc() with 32 bytes streaming loads */
+COPY_AVX2
+static void AVX2_CopyFromUswc(uint8_t *dst, size_t dst_pitch,
+                              const uint8_t *src, size_t src_pitch,
+                              unsigned width, unsigned height)
 {
-    const unsigned w2_16 = (2*width+15) & ~15;
-    const unsigned hstep = cache_size / w2_16;
+    assert(((intptr_t)dst & 0x1f) == 0 && (dst_pitch & 0x1f) == 0);
+
+    _mm_mfence();
+
+    for (unsigned y = 0; y < height; y++) {
+        const unsigned unaligned = __MIN((-(uintptr_t)src) & 0x1f, width);
+        unsigned x = 0;
+
+        for (; x < unaligned; x++)
+            dst[x] = src[x];
+
+        if (!unaligned) {
+            for (; x+127 < width; x += 128) {
+                const __m256i *in = (const __m256i *)&src[x];
+                __m256i *out = (__m256i *)&dst[x];
+                __m256i a = _mm256_stream_load_si256(in + 0);
+                __m256i b = _mm256_stream_load_si256(in + 1);
+                __m256i c = _mm256_stream_load_si256(in + 2);
+                __m256i d = _mm256_stream_load_si256(in + 3);
+                _mm256_store_si256(out + 0, a);
+                _mm256_store_si256(out + 1, b);
+                _mm256_store_si256(out + 2, c);
+                _mm256_store_si256(out + 3, d);
+            }
+        } else {
+            for (; x+127 < width; x += 128) {
+                const __m256i *in = (const __m256i *)&src[x];
+                __m256i *out = (__m256i *)&dst[x];
+                __m256i a = _mm256_stream_load_si256(in + 0);
+                __m256i b = _mm256_stream_load_si256(in + 1);
+                __m256i c = _mm256_stream_load_si256(in + 2);
+                __m256i d = _mm256_stream_load_si256(in + 3);
+                _mm256_storeu_si256(out + 0, a);
+                _mm256_storeu_si256(out + 1, b);
+                _mm256_storeu_si256(out + 2, c);
+                _mm256_storeu_si256(out + 3, d);
+            }
+        }
+
+        for (; x < width; x++)
+            dst[x] = src[x];
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+COPY_AVX2
+static void AVX2_Copy2d(uint8_t *dst, size_t dst_pitch,
+                        const uint8_t *src, size_t src_pitch,
+                        unsigned width, unsigned height)
+{
+    assert(((intptr_t)src & 0x1f) == 0 && (src_pitch & 0x1f) == 0);
+
+    for (unsigned y = 0; y < height; y++) {
+        const __m256i *in = (const __m256i *)src;
+        unsigned x = 0;
+
+        if (((intptr_t)dst & 0x1f) == 0) {
+            for (; x+127 < width; x += 128, in += 4) {
+                __m256i *out = (__m256i *)&dst[x];
+                _mm256_stream_si256(out + 0, _mm256_load_si256(in + 0));
+                _mm256_stream_si256(out + 1, _mm256_load_si256(in + 1));
+                _mm256_stream_si256(out + 2, _mm256_load_si256(in + 2));
+                _mm256_stream_si256(out + 3, _mm256_load_si256(in + 3));
+            }
+        } else {
+            for (; x+127 < width; x += 128, in += 4) {
+                __m256i *out = (__m256i *)&dst[x];
+                _mm256_storeu_si256(out + 0, _mm256_load_si256(in + 0));
+                _mm256_storeu_si256(out + 1, _mm256_load_si256(in + 1));
+                _mm256_storeu_si256(out + 2, _mm256_load_si256(in + 2));
+                _mm256_storeu_si256(out + 3, _mm256_load_si256(in + 3));
+            }
+        }
+
+        for (; x < width; x++)
+            dst[x] = src[x];
+
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+    _mm_sfence();
+}
+
+COPY_AVX2
+static void AVX2_SplitUV(uint8_t *dstu, size_t dstu_pitch,
+                         uint8_t *dstv, size_t dstv_pitch,
+                         const uint8_t *src, size_t src_pitch,
+                         unsigned width, unsigned height)
+{
+    const __m256i shuffle = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14,
+                                             1, 3, 5, 7, 9, 11, 13, 15,
+                                             0, 2, 4, 6, 8, 10, 12, 14,
+                                             1, 3, 5, 7, 9, 11, 13, 15);
+
+    for (unsigned y = 0; y < height; y++) {
+        unsigned x = 0;
+
+        for (; x + 31 < width; x += 32) {
+            __m256i a = _mm256_load_si256((const __m256i *)&src[2*x]);
+            __m256i b = _mm256_load_si256((const __m256i *)&src[2*x+32]);
+            /* U and V halves in each lane, then in each register */
+            a = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(a, shuffle), 0xd8);
+            b = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(b, shuffle), 0xd8);
+            _mm256_storeu_si256((__m256i *)&dstu[x],
+                                _mm256_permute2x128_si256(a, b, 0x20));
+            _mm256_storeu_si256((__m256i *)&dstv[x],
+                                _mm256_permute2x128_si256(a, b, 0x31));
+        }
+        for (; x < width; x++) {
+            dstu[x] = src[2*x+0];
+            dstv[x] = src[2*x+1];
+        }
+        src  += src_pitch;
+        dstu += dstu_pitch;
+        dstv += dstv_pitch;
+    }
+}
+
+COPY_AVX2
+static void AVX2_CopyPlane16(uint8_t *dst, size_t dst_pitch,
+                             const uint8_t *src, size_t src_pitch,
+                             unsigned width, unsigned height, unsigned shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    for (unsigned y = 0; y < height; y++) {
+        const uint16_t *in = (const uint16_t *)src;
+        uint16_t *out = (uint16_t *)dst;
+        unsigned x = 0;
+
+        for (; x + 15 < width; x += 16) {
+            __m256i v = _mm256_load_si256((const __m256i *)&in[x]);
+            _mm256_storeu_si256((__m256i *)&out[x], _mm256_srl_epi16(v, count));
+        }
+        for (; x < width; x++)
+            out[x] = in[x] >> shift;
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+COPY_AVX2
+static void AVX2_SplitUV16(uint8_t *dstu, size_t dstu_pitch,
+                           uint8_t *dstv, size_t dstv_pitch,
+                           const uint8_t *src, size_t src_pitch,
+                           unsigned width, unsigned height, unsigned shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m256i bias = _mm256_set1_epi32(0x80008000);
+
+    for (unsigned y = 0; y < height; y++) {
+        const uint16_t *in = (const uint16_t *)src;
+        uint16_t *u = (uint16_t *)dstu;
+        uint16_t *v = (uint16_t *)dstv;
+        unsigned x = 0;
+
+        for (; x + 15 < width; x += 16) {
+            __m256i a = _mm256_load_si256((const __m256i *)&in[2*x]);
+            __m256i b = _mm256_load_si256((const __m256i *)&in[2*x+16]);
+            a = _mm256_xor_si256(_mm256_srl_epi16(a, count), bias);
+            b = _mm256_xor_si256(_mm256_srl_epi16(b, count), bias);
+
+            __m256i ua = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+            __m256i ub = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+            __m256i va = _mm256_srai_epi32(a, 16);
+            __m256i vb = _mm256_srai_epi32(b, 16);
+
+            /* Packing works per lane, restore the order of the samples */
+            __m256i uu = _mm256_permute4x64_epi64(_mm256_packs_epi32(ua, ub), 0xd8);
+            __m256i vv = _mm256_permute4x64_epi64(_mm256_packs_epi32(va, vb), 0xd8);
+            _mm256_storeu_si256((__m256i *)&u[x], _mm256_xor_si256(uu, bias));
+            _mm256_storeu_si256((__m256i *)&v[x], _mm256_xor_si256(vv, bias));
+        }
+        for (; x < width; x++) {
+            u[x] = in[2*x+0] >> shift;
+            v[x] = in[2*x+1] >> shift;
+        }
+        src  += src_pitch;
+        dstu += dstu_pitch;
+        dstv += dstv_pitch;
+    }
+}
+#endif /* COPY_SIMD */
+
+static void CopyPlane16(uint8_t *, size_t, const uint8_t *, size_t,
+                        unsigned, unsigned, unsigned);
+static void SplitPlanes16(uint8_t *, size_t, uint8_t *, size_t,
+                          const uint8_t *, size_t,
+                          unsigned, unsigned, unsigned);
+
+/* Copies lines from the source to a cache first, then from the cache to the
+ * destination, converting them on the way */
+static void SSE_CopyRows(const copy_plane_t *p, uint8_t *const dst[2],
+                         const uint8_t *src, unsigned height,
+                         uint8_t *cache, size_t cache_size, unsigned cpu)
+{
+    const unsigned width = SourceWidth(p);
+    const unsigned pitch = (width + 31) & ~31;
+    const unsigned hstep = cache_size / pitch;
     assert(hstep > 0);
+#ifdef COPY_SIMD
+    const bool avx2 = (cpu & VLC_CPU_AVX2) != 0;
+#endif
 
     for (unsigned y = 0; y < height; y += hstep) {
         const unsigned hblock =  __MIN(hstep, height - y);
+        uint8_t *dst0 = dst[0] + y * p->dst_pitch[0];
+        uint8_t *dst1 = dst[1] != NULL ? dst[1] + y * p->dst_pitch[1] : NULL;
 
         /* Copy a bunch of line into our cache */
-        CopyFromUswc(cache, w2_16, src, src_pitch,
-                     2*width, hblock, cpu);
+#ifdef COPY_SIMD
+        if (avx2)
+            AVX2_CopyFromUswc(cache, pitch, src, p->src_pitch,
+                              width, hblock);
+        else
+#endif
+            CopyFromUswc(cache, pitch, src, p->src_pitch,
+                         width, hblock, cpu);
 
         /* Copy from our cache to the destination */
-        SSE_SplitUV(dstu, dstu_pitch, dstv, dstv_pitch,
-                    cache, w2_16, width, hblock, cpu);
+        switch (p->type) {
+        case COPY_PLANE:
+#ifdef COPY_SIMD
+            if (avx2)
+                AVX2_Copy2d(dst0, p->dst_pitch[0], cache, pitch,
+                            p->width, hblock);
+            else
+#endif
+                Copy2d(dst0, p->dst_pitch[0], cache, pitch,
+                       p->width, hblock);
+            break;
+        case COPY_SPLIT:
+#ifdef COPY_SIMD
+            if (avx2)
+                AVX2_SplitUV(dst0, p->dst_pitch[0], dst1, p->dst_pitch[1],
+                             cache, pitch, p->width, hblock);
+            else
+#endif
+                SSE_SplitUV(dst0, p->dst_pitch[0], dst1, p->dst_pitch[1],
+                            cache, pitch, p->width, hblock, cpu);
+            break;
+        case COPY_PLANE16:
+#ifdef COPY_SIMD
+            if (avx2)
+                AVX2_CopyPlane16(dst0, p->dst_pitch[0], cache, pitch,
+                                 p->width, hblock, p->shift);
+            else
+                SSE2_CopyPlane16(dst0, p->dst_pitch[0], cache, pitch,
+                                 p->width, hblock, p->shift);
+#else
+            CopyPlane16(dst0, p->dst_pitch[0], cache, pitch,
+                        p->width, hblock, p->shift);
+#endif
+            break;
+        case COPY_SPLIT16:
+#ifdef COPY_SIMD
+            if (avx2)
+                AVX2_SplitUV16(dst0, p->dst_pitch[0], dst1, p->dst_pitch[1],
+                               cache, pitch, p->width, hblock, p->shift);
+            else
+                SSE2_SplitUV16(dst0, p->dst_pitch[0], dst1, p->dst_pitch[1],
+                               cache, pitch, p->width, hblock, p->shift);
+#else
+            SplitPlanes16(dst0, p->dst_pitch[0], dst1, p->dst_pitch[1],
+                          cache, pitch, p->width, hblock, p->shift);
+#endif
+            break;
+        }
 
         /* */
-        src  += src_pitch  * hblock;
-        dstu += dstu_pitch * hblock;
-        dstv += dstv_pitch * hblock;
+        src += p->src_pitch * hblock;
     }
     asm volatile ("mfence");
 }
 
-static void SSE_CopyFromNv12(picture_t *dst,
-                             uint8_t *src[2], size_t src_pitch[2],
-                             unsigned width, unsigned height,
-                             copy_cache_t *cache, unsigned cpu)
-{
-    SSE_CopyPlane(dst->p[0].p_pixels, dst->p[0].i_pitch,
-                  src[0], src_pitch[0],
-                  cache->buffer, cache->size,
-                  width, height, cpu);
-    SSE_SplitPlanes(dst->p[2].p_pixels, dst->p[2].i_pitch,
-                    dst->p[1].p_pixels, dst->p[1].i_pitch,
-                    src[1], src_pitch[1],
-                    cache->buffer, cache->size,
-                    (width+1)/2, (height+1)/2, cpu);
-    asm volatile ("emms");
-}
-
-static void SSE_CopyFromYv12(picture_t *dst,
-                             uint8_t *src[3], size_t src_pitch[3],
-                             unsigned width, unsigned height,
-                             copy_cache_t *cache, unsigned cpu)
-{
-    for (unsigned n = 0; n < 3; n++) {
-        const unsigned d = n > 0 ? 2 : 1;
-        SSE_CopyPlane(dst->p[n].p_pixels, dst->p[n].i_pitch,
-                      src[n], src_pitch[n],
-                      cache->buffer, cache->size,
-                      (width+d-1)/d, (height+d-1)/d, cpu);
-    }
-    asm volatile ("emms");
-}
 #undef COPY64
 #endif /* CAN_COMPILE_SSE2 */
 
+
 static void CopyPlane(uint8_t *dst, size_t dst_pitch,
                       const uint8_t *src, size_t src_pitch,
                       unsigned width, unsigned height)
@@ -373,45 +691,375 @@ static void SplitPlanes(uint8_t *dstu, size_t dstu_pitch,
     }
 }
 
-void CopyFromNv12(picture_t *dst, uint8_t *src[2], size_t src_pitch[2],
-                  unsigned width, unsigned height,
-                  copy_cache_t *cache)
+static void CopyPlane16(uint8_t *dst, size_t dst_pitch,
+                        const uint8_t *src, size_t src_pitch,
+                        unsigned width, unsigned height, unsigned shift)
+{
+    for (unsigned y = 0; y < height; y++) {
+        const uint16_t *in = (const uint16_t *)src;
+        uint16_t *out = (uint16_t *)dst;
+
+        for (unsigned x = 0; x < width; x++)
+            out[x] = in[x] >> shift;
+        src += src_pitch;
+        dst += dst_pitch;
+    }
+}
+
+static void SplitPlanes16(uint8_t *dstu, size_t dstu_pitch,
+                          uint8_t *dstv, size_t dstv_pitch,
+                          const uint8_t *src, size_t src_pitch,
+                          unsigned width, unsigned height, unsigned shift)
 {
+    for (unsigned y = 0; y < height; y++) {
+        const uint16_t *in = (const uint16_t *)src;
+        uint16_t *u = (uint16_t *)dstu;
+        uint16_t *v = (uint16_t *)dstv;
+
+        for (unsigned x = 0; x < width; x++) {
+            u[x] = in[2*x+0] >> shift;
+            v[x] = in[2*x+1] >> shift;
+        }
+        src  += src_pitch;
+        dstu += dstu_pitch;
+        dstv += dstv_pitch;
+    }
+}
+
+static void CopyRows(const copy_plane_t *p, unsigned y, unsigned height,
+                     uint8_t *cache, size_t cache_size, unsigned cpu)
+{
+    uint8_t *dst[2] = {
+        p->dst[0] + y * p->dst_pitch[0],
+        p->dst[1] != NULL ? p->dst[1] + y * p->dst_pitch[1] : NULL,
+    };
+    const uint8_t *src = p->src + y * p->src_pitch;
+
+#ifdef CAN_COMPILE_SSE2
+    if (cpu & VLC_CPU_SSE2)
+        return SSE_CopyRows(p, dst, src, height, cache, cache_size, cpu);
+#else
+    (void) cache; (void) cache_size; (void) cpu;
+#endif
+
+    switch (p->type) {
+        case COPY_PLANE:
+            CopyPlane(dst[0], p->dst_pitch[0], src, p->src_pitch,
+                      p->width, height);
+            break;
+        case COPY_SPLIT:
+            SplitPlanes(dst[0], p->dst_pitch[0], dst[1], p->dst_pitch[1],
+                        src, p->src_pitch, p->width, height);
+            break;
+        case COPY_PLANE16:
+            CopyPlane16(dst[0], p->dst_pitch[0], src, p->src_pitch,
+                        p->width, height, p->shift);
+            break;
+        case COPY_SPLIT16:
+            SplitPlanes16(dst[0], p->dst_pitch[0], dst[1], p->dst_pitch[1],
+                          src, p->src_pitch, p->width, height, p->shift);
+            break;
+    }
+}
+
+typedef struct {
+    const copy_plane_t *planes;
+    unsigned           count;
+    unsigned           index, tiles;
+    uint8_t            *cache;
+    size_t             cache_size;
+    unsigned           cpu;
+} copy_tile_t;
+
+/* Copies the same horizontal band of all the planes */
+static void CopyTile(void *data)
+{
+    const copy_tile_t *tile = data;
+
+    for (unsigned i = 0; i < tile->count; i++) {
+        const copy_plane_t *p = &tile->planes[i];
+        const unsigned start = p->height * tile->index / tile->tiles;
+        const unsigned end = p->height * (tile->index + 1) / tile->tiles;
+
+        if (end > start)
+            CopyRows(p, start, end - start,
+                     tile->cache, tile->cache_size, tile->cpu);
+    }
+#ifdef CAN_COMPILE_SSE2
+    if (tile->cpu & VLC_CPU_SSE2)
+        asm volatile ("emms");
+#endif
+}
+
+static void Copy(const copy_plane_t *planes, unsigned count,
+                 unsigned width, unsigned height, copy_cache_t *cache)
+{
+    const unsigned cpu = CopyCPU();
+    unsigned tiles = 1;
+
+    /* A single thread cannot saturate the memory bandwidth with 4K pictures,
+     * the cost of waking up workers is negligible in front of their copy */
+    if ((uint64_t)width * height > COPY_TILE_PIXELS && cache->tiles > 1) {
+        if (cache->pool == NULL)
+            cache->pool = vlc_threadpool_create(COPY_MAX_TILES - 1);
+        if (cache->pool != NULL)
+            tiles = __MIN(cache->tiles, COPY_MAX_TILES);
+    }
+
+    copy_tile_t tile[COPY_MAX_TILES];
+    for (unsigned i = 0; i < tiles; i++) {
+        tile[i].planes = planes;
+        tile[i].count  = count;
+        tile[i].index  = i;
+        tile[i].tiles  = tiles;
 #ifdef CAN_COMPILE_SSE2
-    unsigned cpu = vlc_CPU();
-    if (vlc_CPU_SSE2())
-        return SSE_CopyFromNv12(dst, src, src_pitch, width, height,
-                                cache, cpu);
+        tile[i].cache      = cache->buffer + i * cache->size;
+        tile[i].cache_size = cache->size;
 #else
-    (void) cache;
+        tile[i].cache      = NULL;
+        tile[i].cache_size = 0;
 #endif
+        tile[i].cpu    = cpu;
+    }
+
+    vlc_taskgroup_t *group = NULL;
+    unsigned queued = 1;
+    if (tiles > 1)
+        group = vlc_taskgroup_create(cache->pool, VLC_TASK_PRIORITY_HIGH);
+    if (group != NULL)
+        while (queued < tiles
+            && vlc_taskgroup_submit(group, CopyTile, &tile[queued]) == 0)
+            queued++;
+
+    /* The calling thread copies the first tile, and those not queued */
+    CopyTile(&tile[0]);
+    for (unsigned i = queued; i < tiles; i++)
+        CopyTile(&tile[i]);
+
+    if (group != NULL)
+        vlc_taskgroup_destroy(group);
+}
+
+void CopyFromNv12(picture_t *dst, uint8_t *src[2], size_t src_pitch[2],
+                  unsigned width, unsigned height,
+                  copy_cache_t *cache)
+{
+    const copy_plane_t planes[2] = {
+        { COPY_PLANE, { dst->p[0].p_pixels, NULL }, { dst->p[0].i_pitch, 0 },
+          src[0], src_pitch[0], width, height, 0 },
+        { COPY_SPLIT, { dst->p[2].p_pixels, dst->p[1].p_pixels },
+          { dst->p[2].i_pitch, dst->p[1].i_pitch },
+          src[1], src_pitch[1], (width+1)/2, (height+1)/2, 0 },
+    };
 
-    CopyPlane(dst->p[0].p_pixels, dst->p[0].i_pitch,
-              src[0], src_pitch[0],
-              width, height);
-    SplitPlanes(dst->p[2].p_pixels, dst->p[2].i_pitch,
-                dst->p[1].p_pixels, dst->p[1].i_pitch,
-                src[1], src_pitch[1],
-                width/2, height/2);
+    Copy(planes, 2, width, height, cache);
 }
 
 void CopyFromYv12(picture_t *dst, uint8_t *src[3], size_t src_pitch[3],
                   unsigned width, unsigned height,
                   copy_cache_t *cache)
 {
+    copy_plane_t planes[3];
+
+    for (unsigned n = 0; n < 3; n++) {
+        const unsigned d = n > 0 ? 2 : 1;
+
+        planes[n] = (copy_plane_t) {
+            COPY_PLANE, { dst->p[n].p_pixels, NULL }, { dst->p[n].i_pitch, 0 },
+            src[n], src_pitch[n], (width+d-1)/d, (height+d-1)/d, 0
+        };
+    }
+    Copy(planes, 3, width, height, cache);
+}
+
+static void CopyFromP01x(picture_t *dst, uint8_t *src[2], size_t src_pitch[2],
+                         unsigned width, unsigned height, unsigned shift,
+                         copy_cache_t *cache)
+{
+    const copy_plane_t planes[2] = {
+        { shift ? COPY_PLANE16 : COPY_PLANE,
+          { dst->p[0].p_pixels, NULL }, { dst->p[0].i_pitch, 0 },
+          src[0], src_pitch[0], shift ? width : 2 * width, height, shift },
+        { COPY_SPLIT16, { dst->p[1].p_pixels, dst->p[2].p_pixels },
+          { dst->p[1].i_pitch, dst->p[2].i_pitch },
+          src[1], src_pitch[1], (width+1)/2, (height+1)/2, shift },
+    };
+
+    Copy(planes, 2, width, height, cache);
+}
+
+void CopyFromP010(picture_t *dst, uint8_t *src[2], size_t src_pitch[2],
+                  unsigned width, unsigned height,
+                  copy_cache_t *cache)
+{
+    CopyFromP01x(dst, src, src_pitch, width, height, 6, cache);
+}
+
+void CopyFromP016(picture_t *dst, uint8_t *src[2], size_t src_pitch[2],
+                  unsigned width, unsigned height,
+                  copy_cache_t *cache)
+{
+    CopyFromP01x(dst, src, src_pitch, width, height, 0, cache);
+}
+
+#ifdef COPY_TEST
+/*****************************************************************************
+ * Benchmark and check of the code paths against the C code
+ * Usage: chroma_copy_test [iterations]
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+
+static const struct {
+    const char *name;
+    unsigned   required;
+    unsigned   mask;
+} copy_paths[] = {
+    { "C",    0, 0 },
 #ifdef CAN_COMPILE_SSE2
-    unsigned cpu = vlc_CPU();
-    if (vlc_CPU_SSE2())
-        return SSE_CopyFromYv12(dst, src, src_pitch, width, height,
-                                cache, cpu);
-#else
-    (void) cache;
+    { "SSE",  VLC_CPU_SSE2, ~(VLC_CPU_AVX | VLC_CPU_AVX2) },
+    { "AVX2", VLC_CPU_AVX2, ~0u },
 #endif
+};
+
+static const struct {
+    const char   *name;
+    vlc_fourcc_t src;
+    vlc_fourcc_t dst;
+    unsigned     bytes; /* per sample */
+    void (*copy)(picture_t *, uint8_t **, size_t *, unsigned, unsigned,
+                 copy_cache_t *);
+} copy_formats[] = {
+    { "NV12", VLC_CODEC_NV12, VLC_CODEC_YV12,     1, CopyFromNv12 },
+    { "YV12", VLC_CODEC_YV12, VLC_CODEC_YV12,     1, CopyFromYv12 },
+    { "P010", VLC_CODEC_P010, VLC_CODEC_I420_10L, 2, CopyFromP010 },
+    { "P016", VLC_CODEC_P010, VLC_CODEC_I420_10L, 2, CopyFromP016 },
+};
+
+static const struct {
+    unsigned width, height;
+} copy_sizes[] = {
+    { 1366,  768 },
+    { 1920, 1080 },
+    { 3840, 2160 },
+};
+
+/* Source planes, with the layout of a GPU surface */
+typedef struct {
+    uint8_t *planes[3];
+    size_t  pitches[3];
+    size_t  bytes;
+} surface_t;
+
+static void SurfaceInit(surface_t *s, vlc_fourcc_t chroma, unsigned bytes,
+                        unsigned width, unsigned height)
+{
+    const unsigned count = chroma == VLC_CODEC_YV12 ? 3 : 2;
+
+    s->bytes = 0;
+    for (unsigned i = 0; i < 3; i++) {
+        s->planes[i] = NULL;
+        s->pitches[i] = 0;
+        if (i >= count)
+            continue;
+
+        /* Semi-planar chroma lines are as large as luma lines */
+        const unsigned d = (i > 0) ? 2 : 1;
+        const unsigned w = (count == 2) ? width : (width + d - 1) / d;
+        const unsigned h = (height + d - 1) / d;
+
+        s->pitches[i] = (w * bytes + 63) & ~63;
+        s->planes[i] = vlc_memalign(64, s->pitches[i] * h);
+        assert(s->planes[i] != NULL);
+        for (size_t j = 0; j < s->pitches[i] * h; j++)
+            s->planes[i][j] = rand();
+        s->bytes += (size_t)w * bytes * h;
+    }
+}
+
+static void SurfaceClean(surface_t *s)
+{
+    for (unsigned i = 0; i < 3; i++)
+        vlc_free(s->planes[i]);
+}
+
+static bool PictureEqual(const picture_t *a, const picture_t *b)
+{
+    for (int i = 0; i < a->i_planes; i++)
+        for (int y = 0; y < a->p[i].i_visible_lines; y++)
+            if (memcmp(&a->p[i].p_pixels[y * a->p[i].i_pitch],
+                       &b->p[i].p_pixels[y * b->p[i].i_pitch],
+                       a->p[i].i_visible_pitch))
+                return false;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const unsigned iterations = (argc > 1) ? atoi(argv[1]) : 10;
+    int ret = 0;
+
+    for (unsigned s = 0; s < ARRAY_SIZE(copy_sizes); s++)
+    for (unsigned f = 0; f < ARRAY_SIZE(copy_formats); f++) {
+        const unsigned width = copy_sizes[s].width;
+        const unsigned height = copy_sizes[s].height;
+        surface_t surface;
+        video_format_t fmt;
+        copy_cache_t cache;
+
+        SurfaceInit(&surface, copy_formats[f].src, copy_formats[f].bytes,
+                    width, height);
+        video_format_Setup(&fmt, copy_formats[f].dst, width, height,
+                           width, height, 1, 1);
+        picture_t *ref = picture_NewFromFormat(&fmt);
+        picture_t *pic = picture_NewFromFormat(&fmt);
+        assert(ref != NULL && pic != NULL);
+        if (CopyInitCache(&cache, width))
+            abort();
 
-     CopyPlane(dst->p[0].p_pixels, dst->p[0].i_pitch,
-               src[0], src_pitch[0], width, height);
-     CopyPlane(dst->p[1].p_pixels, dst->p[1].i_pitch,
-               src[1], src_pitch[1], width / 2, height / 2);
-     CopyPlane(dst->p[2].p_pixels, dst->p[2].i_pitch,
-               src[2], src_pitch[2], width / 2, height / 2);
+        /* Reference, with the C code on a single thread */
+        copy_cpu_mask = 0;
+        cache.tiles = 1;
+        copy_formats[f].copy(ref, surface.planes, surface.pitches,
+                             width, height, &cache);
+
+        for (unsigned p = 0; p < ARRAY_SIZE(copy_paths); p++)
+        for (unsigned tiles = 1; tiles <= COPY_MAX_TILES; tiles *= COPY_MAX_TILES) {
+            if ((vlc_CPU() & copy_paths[p].required)
+                                            != copy_paths[p].required)
+                continue;
+            copy_cpu_mask = copy_paths[p].mask;
+            cache.tiles = tiles;
+
+            for (int i = 0; i < pic->i_planes; i++)
+                memset(pic->p[i].p_pixels, 0,
+                       pic->p[i].i_pitch * pic->p[i].i_lines);
+            copy_formats[f].copy(pic, surface.planes, surface.pitches,
+                                 width, height, &cache);
+            const bool equal = PictureEqual(ref, pic);
+
+            mtime_t start = mdate();
+            for (unsigned i = 0; i < iterations; i++)
+                copy_formats[f].copy(pic, surface.planes, surface.pitches,
+                                     width, height, &cache);
+            mtime_t elapsed = mdate() - start;
+
+            /* Each byte is read once and written once */
+            printf("%s %4ux%-4u %-4s %u tile%s: %6.2f GB/s%s\n",
+                   copy_formats[f].name, width, height,
+                   copy_paths[p].name, tiles, tiles > 1 ? "s" : " ",
+                   elapsed > 0 ? 2. * surface.bytes * iterations
+                                 / elapsed / 1000. : 0.,
+                   equal ? "" : " MISMATCH");
+            if (!equal)
+                ret = 1;
+        }
+
+        CopyCleanCache(&cache);
+        picture_Release(pic);
+        picture_Release(ref);
+        SurfaceClean(&surface);
+    }
+    return ret;
 }
+#endif
@@ -1,5 +1,5 @@
 /*****************************************************************************
- * copy.h: Fast YV12/NV12 copy
+ * copy.h: Fast YV12/NV12/P010 copy
  *****************************************************************************
  * Copyright (C) 2009 Laurent Aimar
  * $Id$
@@ -29,6 +29,8 @@ typedef struct {
     uint8_t *buffer;
     size_t  size;
 # endif
+    unsigned tiles; /* maximum number of threads copying a large picture */
+    struct vlc_threadpool *pool;
 } copy_cache_t;
 
 int  CopyInitCache(copy_cache_t *cache, unsigned width);
@@ -41,4 +43,13 @@ void CopyFromYv12(picture_t *dst, uint8_t *src[3], size_t src_pitch[3],
                   unsigned width, unsigned height,
                   copy_cache_t *cache);
 
+/* P010 to I420 10-bits */
+void CopyFromP010(picture_t *dst, uint8_t *src[2], size_t src_pitch[2],
+                  unsigned width, unsigned height,
+                  copy_cache_t *cache);
+/* P016 to planar 4:2:0 16-bits */
+void CopyFromP016(picture_t *dst, uint8_t *src[2], size_t src_pitch[2],
+                  unsigned width, unsigned height,
+                  copy_cache_t *cache);
+
 #endif
@@ -0,0 +1,460 @@
+/*****************************************************************************
+ * yuvscale.c : fused YUV conversion, cropping and scaling
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_plugin.h>
+#include <vlc_filter.h>
+
+/*****************************************************************************
+ * Module descriptor
+ *****************************************************************************/
+static int  Open ( vlc_object_t * );
+static void Close( vlc_object_t * );
+
+vlc_module_begin ()
+    set_description( N_("Fused YUV conversion and bilinear scaling") )
+    set_shortname( N_("YUV scaler") )
+    /* Below swscale; conversions without scaling are left to the converters */
+    set_capability( "video filter2", 130 )
+    set_callbacks( Open, Close )
+vlc_module_end ()
+
+/*****************************************************************************
+ * Local prototypes
+ *****************************************************************************/
+static picture_t *Filter( filter_t *, picture_t * );
+
+/* Sampling positions along one axis, in 1/256 of a source sample */
+typedef struct
+{
+    unsigned i_src;     /* number of source samples */
+    unsigned i_dst;     /* number of destination samples */
+    unsigned *pi_index; /* first source sample for each destination sample */
+    uint8_t  *pi_frac;  /* weight of the next source sample */
+} axis_t;
+
+/* Scaling of one source plane */
+typedef struct
+{
+    axis_t   x, y;
+    unsigned i_plane;   /* source plane */
+    unsigned i_step;    /* distance between samples, in bytes */
+    unsigned i_offset;  /* offset of the first sample, in bytes */
+    unsigned i_x, i_y;  /* crop offset, in source samples */
+} plane_scaler_t;
+
+struct filter_sys_t
+{
+    plane_scaler_t luma;
+    plane_scaler_t chroma[2]; /* U and V */
+    bool b_rgb;
+    bool b_swap_uvo;
+    unsigned i_rshift, i_gshift, i_bshift;
+
+    /* Line caches and RGB rows of the slices */
+    uint16_t *p_lines;
+    size_t i_lines;
+    uint8_t *p_rgb_rows;
+};
+
+static bool IsSupportedInput( vlc_fourcc_t i_chroma )
+{
+    switch( i_chroma )
+    {
+        case VLC_CODEC_I420:
+        case VLC_CODEC_J420:
+        case VLC_CODEC_YV12:
+        case VLC_CODEC_NV12:
+        case VLC_CODEC_NV21:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool IsSupportedOutput( vlc_fourcc_t i_chroma )
+{
+    switch( i_chroma )
+    {
+        case VLC_CODEC_I420:
+        case VLC_CODEC_J420:
+        case VLC_CODEC_YV12:
+        case VLC_CODEC_RGB32:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Computes the source positions of destination samples, with the samples
+ * centers aligned (as most scalers do).
+ */
+static int AxisInit( axis_t *p_axis, unsigned i_src, unsigned i_dst )
+{
+    p_axis->i_src = i_src;
+    p_axis->i_dst = i_dst;
+    p_axis->pi_index = malloc( i_dst * sizeof(*p_axis->pi_index) );
+    p_axis->pi_frac = malloc( i_dst );
+    if( !p_axis->pi_index || !p_axis->pi_frac )
+        return VLC_ENOMEM;
+
+    for( unsigned i = 0; i < i_dst; i++ )
+    {
+        int64_t i_pos = ((int64_t)(2 * i + 1) * i_src * 256) / (2 * i_dst)
+                      - 128;
+        if( i_pos < 0 )
+            i_pos = 0;
+        if( i_pos > (int64_t)(i_src - 1) * 256 )
+            i_pos = (int64_t)(i_src - 1) * 256;
+        p_axis->pi_index[i] = i_pos >> 8;
+        p_axis->pi_frac[i] = i_pos & 0xff;
+    }
+    return VLC_SUCCESS;
+}
+
+static void AxisClean( axis_t *p_axis )
+{
+    free( p_axis->pi_index );
+    free( p_axis->pi_frac );
+}
+
+static int ScalerInit( plane_scaler_t *p_scaler, unsigned i_plane,
+                       unsigned i_step, unsigned i_offset,
+                       unsigned i_x, unsigned i_y,
+                       unsigned i_src_width, unsigned i_src_height,
+                       unsigned i_dst_width, unsigned i_dst_height )
+{
+    p_scaler->i_plane = i_plane;
+    p_scaler->i_step = i_step;
+    p_scaler->i_offset = i_offset;
+    p_scaler->i_x = i_x;
+    p_scaler->i_y = i_y;
+    if( AxisInit( &p_scaler->x, i_src_width, i_dst_width )
+     || AxisInit( &p_scaler->y, i_src_height, i_dst_height ) )
+        return VLC_ENOMEM;
+    return VLC_SUCCESS;
+}
+
+static void ScalerClean( plane_scaler_t *p_scaler )
+{
+    AxisClean( &p_scaler->x );
+    AxisClean( &p_scaler->y );
+}
+
+/*****************************************************************************
+ * Open
+ *****************************************************************************/
+static int Open( vlc_object_t *p_this )
+{
+    filter_t *p_filter = (filter_t *)p_this;
+    const video_format_t *p_fmti = &p_filter->fmt_in.video;
+    video_format_t *p_fmto = &p_filter->fmt_out.video;
+
+    if( !IsSupportedInput( p_fmti->i_chroma )
+     || !IsSupportedOutput( p_fmto->i_chroma )
+     || p_fmti->orientation != p_fmto->orientation )
+        return VLC_EGENERIC;
+    /* Plain conversions are left to the converters */
+    if( p_fmti->i_visible_width == p_fmto->i_visible_width
+     && p_fmti->i_visible_height == p_fmto->i_visible_height )
+        return VLC_EGENERIC;
+    if( p_fmti->i_visible_width < 2 || p_fmti->i_visible_height < 2
+     || p_fmto->i_visible_width < 2 || p_fmto->i_visible_height < 2 )
+        return VLC_EGENERIC;
+
+    filter_sys_t *p_sys = calloc( 1, sizeof(*p_sys) );
+    if( !p_sys )
+        return VLC_ENOMEM;
+
+    const bool b_nv = p_fmti->i_chroma == VLC_CODEC_NV12
+                   || p_fmti->i_chroma == VLC_CODEC_NV21;
+    const bool b_swap_uvi = p_fmti->i_chroma == VLC_CODEC_YV12
+                         || p_fmti->i_chroma == VLC_CODEC_NV21;
+    const unsigned i_src_w = p_fmti->i_visible_width;
+    const unsigned i_src_h = p_fmti->i_visible_height;
+    const unsigned i_dst_w = p_fmto->i_visible_width;
+    const unsigned i_dst_h = p_fmto->i_visible_height;
+
+    p_sys->b_rgb = p_fmto->i_chroma == VLC_CODEC_RGB32;
+    p_sys->b_swap_uvo = p_fmto->i_chroma == VLC_CODEC_YV12;
+
+    /* RGB output needs chroma at full resolution */
+    const unsigned i_chroma_w = p_sys->b_rgb ? i_dst_w : (i_dst_w + 1) / 2;
+    const unsigned i_chroma_h = p_sys->b_rgb ? i_dst_h : (i_dst_h + 1) / 2;
+
+    int i_ret = ScalerInit( &p_sys->luma, 0, 1, 0,
+                            p_fmti->i_x_offset, p_fmti->i_y_offset,
+                            i_src_w, i_src_h, i_dst_w, i_dst_h );
+    for( unsigned i = 0; i < 2 && i_ret == VLC_SUCCESS; i++ )
+    {
+        const unsigned i_comp = b_swap_uvi ? 1 - i : i;
+
+        if( b_nv )
+            i_ret = ScalerInit( &p_sys->chroma[i], 1, 2, i_comp,
+                                p_fmti->i_x_offset / 2, p_fmti->i_y_offset / 2,
+                                (i_src_w + 1) / 2, (i_src_h + 1) / 2,
+                                i_chroma_w, i_chroma_h );
+        else
+            i_ret = ScalerInit( &p_sys->chroma[i], 1 + i_comp, 1, 0,
+                                p_fmti->i_x_offset / 2, p_fmti->i_y_offset / 2,
+                                (i_src_w + 1) / 2, (i_src_h + 1) / 2,
+                                i_chroma_w, i_chroma_h );
+    }
+    if( i_ret == VLC_SUCCESS )
+    {
+        const unsigned i_slices = filter_GetSliceCount( p_filter, i_dst_h );
+
+        p_sys->i_lines = 2 * (p_sys->luma.x.i_dst + p_sys->chroma[0].x.i_dst
+                              + p_sys->chroma[1].x.i_dst);
+        p_sys->p_lines = malloc( i_slices * p_sys->i_lines
+                                 * sizeof(*p_sys->p_lines) );
+        if( p_sys->b_rgb )
+            p_sys->p_rgb_rows = malloc( i_slices * 3 * i_dst_w );
+        if( !p_sys->p_lines || (p_sys->b_rgb && !p_sys->p_rgb_rows) )
+            i_ret = VLC_ENOMEM;
+    }
+    if( i_ret != VLC_SUCCESS )
+    {
+        p_filter->p_sys = p_sys;
+        Close( p_this );
+        return i_ret;
+    }
+
+    if( p_sys->b_rgb )
+    {
+        video_format_FixRgb( p_fmto );
+        p_sys->i_rshift = p_fmto->i_lrshift;
+        p_sys->i_gshift = p_fmto->i_lgshift;
+        p_sys->i_bshift = p_fmto->i_lbshift;
+    }
+
+    msg_Dbg( p_filter, "%4.4s %ux%u -> %4.4s %ux%u in one pass",
+             (const char *)&p_fmti->i_chroma, i_src_w, i_src_h,
+             (const char *)&p_fmto->i_chroma, i_dst_w, i_dst_h );
+
+    p_filter->p_sys = p_sys;
+    p_filter->pf_video_filter = Filter;
+    return VLC_SUCCESS;
+}
+
+static void Close( vlc_object_t *p_this )
+{
+    filter_t *p_filter = (filter_t *)p_this;
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    ScalerClean( &p_sys->luma );
+    ScalerClean( &p_sys->chroma[0] );
+    ScalerClean( &p_sys->chroma[1] );
+    free( p_sys->p_rgb_rows );
+    free( p_sys->p_lines );
+    free( p_sys );
+}
+
+/*****************************************************************************
+ * Scaling
+ *****************************************************************************
+ * Each destination line is interpolated from two horizontally scaled source
+ * lines. The two last scaled lines are kept, so that each source line is
+ * read and scaled once per slice while it is still in cache.
+ *****************************************************************************/
+typedef struct
+{
+    uint16_t *p_line[2]; /* horizontally scaled lines, 8 bits fraction */
+    int       i_line[2]; /* source line numbers, or -1 */
+} line_cache_t;
+
+static void ScaleLine( const plane_scaler_t *p_scaler, const picture_t *p_src,
+                       unsigned i_line, uint16_t *p_dst )
+{
+    const plane_t *p = &p_src->p[p_scaler->i_plane];
+    const uint8_t *p_in = &p->p_pixels[(p_scaler->i_y + i_line) * p->i_pitch
+                          + p_scaler->i_x * p_scaler->i_step
+                          + p_scaler->i_offset];
+    const unsigned i_step = p_scaler->i_step;
+    const unsigned i_last = p_scaler->x.i_src - 1;
+
+    for( unsigned x = 0; x < p_scaler->x.i_dst; x++ )
+    {
+        const unsigned i_index = p_scaler->x.pi_index[x];
+        const unsigned i_frac = p_scaler->x.pi_frac[x];
+        const unsigned a = p_in[i_index * i_step];
+        const unsigned b = p_in[__MIN(i_index + 1, i_last) * i_step];
+
+        p_dst[x] = a * (256 - i_frac) + b * i_frac;
+    }
+}
+
+static const uint16_t *GetLine( const plane_scaler_t *p_scaler,
+                                const picture_t *p_src,
+                                line_cache_t *p_cache, unsigned i_line )
+{
+    for( unsigned i = 0; i < 2; i++ )
+        if( p_cache->i_line[i] == (int)i_line )
+            return p_cache->p_line[i];
+
+    /* Replace the line that is not the previous one */
+    const unsigned i = p_cache->i_line[0] < p_cache->i_line[1] ? 0 : 1;
+    ScaleLine( p_scaler, p_src, i_line, p_cache->p_line[i] );
+    p_cache->i_line[i] = i_line;
+    return p_cache->p_line[i];
+}
+
+/* Computes the destination line y of a plane, as 8 bits samples */
+static void ScaleRow( const plane_scaler_t *p_scaler, const picture_t *p_src,
+                      line_cache_t *p_cache, unsigned y, uint8_t *p_dst )
+{
+    const unsigned i_index = p_scaler->y.pi_index[y];
+    const unsigned i_frac = p_scaler->y.pi_frac[y];
+    const unsigned i_next = __MIN(i_index + 1, p_scaler->y.i_src - 1);
+
+    const uint16_t *p_a = GetLine( p_scaler, p_src, p_cache, i_index );
+    const uint16_t *p_b = GetLine( p_scaler, p_src, p_cache, i_next );
+
+    for( unsigned x = 0; x < p_scaler->x.i_dst; x++ )
+        p_dst[x] = (p_a[x] * (256 - i_frac) + p_b[x] * i_frac + 32768) >> 16;
+}
+
+/* Same YUV to RGB conversion as the blending and the OSD code */
+static inline uint32_t YUVToRGB( const filter_sys_t *p_sys,
+                                 int y, int u, int v )
+{
+#define SCALEBITS 10
+#define ONE_HALF  (1 << (SCALEBITS - 1))
+#define FIX(x)    ((int) ((x) * (1<<SCALEBITS) + 0.5))
+    const int cb = u - 128;
+    const int cr = v - 128;
+    const int l = (y - 16) * FIX(255.0/219.0);
+    const int r = (l + FIX(1.40200*255.0/224.0) * cr + ONE_HALF) >> SCALEBITS;
+    const int g = (l - FIX(0.34414*255.0/224.0) * cb
+                     - FIX(0.71414*255.0/224.0) * cr + ONE_HALF) >> SCALEBITS;
+    const int b = (l + FIX(1.77200*255.0/224.0) * cb + ONE_HALF) >> SCALEBITS;
+#undef FIX
+#undef ONE_HALF
+#undef SCALEBITS
+    return ((uint32_t)VLC_CLIP( r, 0, 255 ) << p_sys->i_rshift)
+         | ((uint32_t)VLC_CLIP( g, 0, 255 ) << p_sys->i_gshift)
+         | ((uint32_t)VLC_CLIP( b, 0, 255 ) << p_sys->i_bshift);
+}
+
+typedef struct
+{
+    const picture_t *p_src;
+    picture_t *p_dst;
+    const video_format_t *p_fmt;
+} scale_slice_t;
+
+static uint8_t *DstLine( const scale_slice_t *p_slice, unsigned i_plane,
+                         unsigned y, unsigned i_div, unsigned i_bytes )
+{
+    const plane_t *p = &p_slice->p_dst->p[i_plane];
+    const video_format_t *p_fmt = p_slice->p_fmt;
+
+    return &p->p_pixels[(p_fmt->i_y_offset / i_div + y) * p->i_pitch
+                        + p_fmt->i_x_offset / i_div * i_bytes];
+}
+
+static void Slice( filter_t *p_filter, void *p_opaque, unsigned i_slice,
+                   unsigned i_start, unsigned i_end )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    const scale_slice_t *p_slice = p_opaque;
+    const plane_scaler_t *p_scalers[3] = {
+        &p_sys->luma, &p_sys->chroma[0], &p_sys->chroma[1],
+    };
+    line_cache_t caches[3];
+
+    uint16_t *p_next = &p_sys->p_lines[i_slice * p_sys->i_lines];
+    for( unsigned i = 0; i < 3; i++ )
+        for( unsigned j = 0; j < 2; j++ )
+        {
+            caches[i].p_line[j] = p_next;
+            caches[i].i_line[j] = -1;
+            p_next += p_scalers[i]->x.i_dst;
+        }
+
+    if( p_sys->b_rgb )
+    {
+        const unsigned i_width = p_sys->luma.x.i_dst;
+        uint8_t *p_y = &p_sys->p_rgb_rows[i_slice * 3 * i_width];
+        uint8_t *p_u = p_y + i_width;
+        uint8_t *p_v = p_y + 2 * i_width;
+
+        for( unsigned y = i_start; y < i_end; y++ )
+        {
+            uint32_t *p_out = (uint32_t *)DstLine( p_slice, 0, y, 1, 4 );
+
+            ScaleRow( p_scalers[0], p_slice->p_src, &caches[0], y, p_y );
+            ScaleRow( p_scalers[1], p_slice->p_src, &caches[1], y, p_u );
+            ScaleRow( p_scalers[2], p_slice->p_src, &caches[2], y, p_v );
+            for( unsigned x = 0; x < i_width; x++ )
+                p_out[x] = YUVToRGB( p_sys, p_y[x], p_u[x], p_v[x] );
+        }
+    }
+    else
+    {
+        for( unsigned y = i_start; y < i_end; y++ )
+            ScaleRow( p_scalers[0], p_slice->p_src, &caches[0], y,
+                      DstLine( p_slice, 0, y, 1, 1 ) );
+
+        /* Chroma lines matching the slice, without overlap */
+        for( unsigned y = (i_start + 1) / 2; y < (i_end + 1) / 2; y++ )
+            for( unsigned i = 0; i < 2; i++ )
+            {
+                const unsigned i_plane = 1 + (p_sys->b_swap_uvo ? 1 - i : i);
+                ScaleRow( p_scalers[1 + i], p_slice->p_src, &caches[1 + i], y,
+                          DstLine( p_slice, i_plane, y, 2, 1 ) );
+            }
+    }
+}
+
+/*****************************************************************************
+ * Filter
+ *****************************************************************************/
+static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
+{
+    picture_t *p_outpic = filter_NewPicture( p_filter );
+    if( !p_outpic )
+    {
+        picture_Release( p_pic );
+        return NULL;
+    }
+
+    scale_slice_t slice = {
+        .p_src = p_pic,
+        .p_dst = p_outpic,
+        .p_fmt = &p_filter->fmt_out.video,
+    };
+    filter_RunSlices( p_filter, p_filter->p_sys->luma.y.i_dst, Slice, &slice );
+
+    picture_CopyProperties( p_outpic, p_pic );
+    picture_Release( p_pic );
+    return p_outpic;
+}
@@ -126,9 +126,21 @@ struct filter_sys_t
     double     f_gamma;
     bool       b_brightness_threshold;
     int        (* pf_process_sat_hue)( picture_t *, picture_t *, int, int, int,
-                                       int, int );
+                                       int, int, unsigned, unsigned );
     int        (* pf_process_sat_hue_clip)( picture_t *, picture_t *, int, int,
-                                            int, int, int );
+                                            int, int, int, unsigned, unsigned );
+};
+
+/* Parameters of a picture, shared by its slices */
+struct adjust_slice
+{
+    picture_t *p_pic;
+    picture_t *p_outpic;
+    const int *pi_luma;
+    int        i_y_offset; /* packed YUV only */
+    int        (* pf_process_sat_hue)( picture_t *, picture_t *, int, int, int,
+                                       int, int, unsigned, unsigned );
+    int        i_sin, i_cos, i_sat, i_x, i_y;
 };
 
 /*****************************************************************************
@@ -220,6 +232,70 @@ static void Destroy( vlc_object_t *p_this )
     free( p_sys );
 }
 
+/*****************************************************************************
+ * Process the lines [i_start, i_end) of a Planar YUV picture
+ *****************************************************************************/
+static void SlicePlanar( filter_t *p_filter, void *p_opaque, unsigned i_slice,
+                         unsigned i_start, unsigned i_end )
+{
+    const struct adjust_slice *p_slice = p_opaque;
+    const plane_t *p_in = &p_slice->p_pic->p[Y_PLANE];
+    const plane_t *p_out = &p_slice->p_outpic->p[Y_PLANE];
+    const int *pi_luma = p_slice->pi_luma;
+    unsigned i_uv_start, i_uv_end;
+
+    VLC_UNUSED(p_filter); VLC_UNUSED(i_slice);
+
+    for( unsigned i_line = i_start; i_line < i_end; i_line++ )
+    {
+        const uint8_t *p_src = p_in->p_pixels + i_line * p_in->i_pitch;
+        uint8_t *p_dst = p_out->p_pixels + i_line * p_out->i_pitch;
+
+        for( int i = 0; i < p_in->i_visible_pitch; i++ )
+            p_dst[i] = pi_luma[ p_src[i] ];
+    }
+
+    plane_SliceLines( p_slice->p_pic, U_PLANE, i_start, i_end,
+                      &i_uv_start, &i_uv_end );
+    /* Currently no errors are implemented in the function, if any are added
+     * check them here */
+    p_slice->pf_process_sat_hue( p_slice->p_pic, p_slice->p_outpic,
+                                 p_slice->i_sin, p_slice->i_cos,
+                                 p_slice->i_sat, p_slice->i_x, p_slice->i_y,
+                                 i_uv_start, i_uv_end );
+}
+
+/*****************************************************************************
+ * Process the lines [i_start, i_end) of a Packed YUV picture
+ *****************************************************************************/
+static void SlicePacked( filter_t *p_filter, void *p_opaque, unsigned i_slice,
+                         unsigned i_start, unsigned i_end )
+{
+    const struct adjust_slice *p_slice = p_opaque;
+    const plane_t *p_in = p_slice->p_pic->p;
+    const plane_t *p_out = p_slice->p_outpic->p;
+    const int *pi_luma = p_slice->pi_luma;
+
+    VLC_UNUSED(p_filter); VLC_UNUSED(i_slice);
+
+    for( unsigned i_line = i_start; i_line < i_end; i_line++ )
+    {
+        const uint8_t *p_src = p_in->p_pixels + i_line * p_in->i_pitch
+                             + p_slice->i_y_offset;
+        uint8_t *p_dst = p_out->p_pixels + i_line * p_out->i_pitch
+                       + p_slice->i_y_offset;
+
+        for( int i = 0; i < p_in->i_visible_pitch; i += 2 )
+            p_dst[i] = pi_luma[ p_src[i] ];
+    }
+
+    /* The chroma was checked by the caller, this cannot fail */
+    p_slice->pf_process_sat_hue( p_slice->p_pic, p_slice->p_outpic,
+                                 p_slice->i_sin, p_slice->i_cos,
+                                 p_slice->i_sat, p_slice->i_x, p_slice->i_y,
+                                 i_start, i_end );
+}
+
 /*****************************************************************************
  * Run the filter on a Planar YUV picture
  *****************************************************************************/
@@ -229,8 +305,6 @@ static picture_t *FilterPlanar( filter_t *p_filter, picture_t *p_pic )
     int pi_gamma[256];
 
     picture_t *p_outpic;
-    uint8_t *p_in, *p_in_end, *p_line_end;
-    uint8_t *p_out;
 
     bool b_thres;
     double  f_hue;
@@ -300,43 +374,7 @@ static picture_t *FilterPlanar( filter_t *p_filter, picture_t *p_pic )
     }
 
     /*
-     * Do the Y plane
-     */
-
-    p_in = p_pic->p[Y_PLANE].p_pixels;
-    p_in_end = p_in + p_pic->p[Y_PLANE].i_visible_lines
-                      * p_pic->p[Y_PLANE].i_pitch - 8;
-
-    p_out = p_outpic->p[Y_PLANE].p_pixels;
-
-    for( ; p_in < p_in_end ; )
-    {
-        p_line_end = p_in + p_pic->p[Y_PLANE].i_visible_pitch - 8;
-
-        for( ; p_in < p_line_end ; )
-        {
-            /* Do 8 pixels at a time */
-            *p_out++ = pi_luma[ *p_in++ ]; *p_out++ = pi_luma[ *p_in++ ];
-            *p_out++ = pi_luma[ *p_in++ ]; *p_out++ = pi_luma[ *p_in++ ];
-            *p_out++ = pi_luma[ *p_in++ ]; *p_out++ = pi_luma[ *p_in++ ];
-            *p_out++ = pi_luma[ *p_in++ ]; *p_out++ = pi_luma[ *p_in++ ];
-        }
-
-        p_line_end += 8;
-
-        for( ; p_in < p_line_end ; )
-        {
-            *p_out++ = pi_luma[ *p_in++ ];
-        }
-
-        p_in += p_pic->p[Y_PLANE].i_pitch
-              - p_pic->p[Y_PLANE].i_visible_pitch;
-        p_out += p_outpic->p[Y_PLANE].i_pitch
-               - p_outpic->p[Y_PLANE].i_visible_pitch;
-    }
-
-    /*
-     * Do the U and V planes
+     * Do the Y plane and the U and V planes, by slices
      */
 
     i_sin = sin(f_hue) * 256;
@@ -345,20 +383,14 @@ static picture_t *FilterPlanar( filter_t *p_filter, picture_t *p_pic )
     i_x = ( cos(f_hue) + sin(f_hue) ) * 32768;
     i_y = ( cos(f_hue) - sin(f_hue) ) * 32768;
 
-    if ( i_sat > 256 )
-    {
-        /* Currently no errors are implemented in the function, if any are added
-         * check them here */
-        p_sys->pf_process_sat_hue_clip( p_pic, p_outpic, i_sin, i_cos, i_sat,
-                                        i_x, i_y );
-    }
-    else
-    {
-        /* Currently no errors are implemented in the function, if any are added
-         * check them here */
-        p_sys->pf_process_sat_hue( p_pic, p_outpic, i_sin, i_cos, i_sat,
-                                        i_x, i_y );
-    }
+    struct adjust_slice slice = {
+        .p_pic = p_pic, .p_outpic = p_outpic, .pi_luma = pi_luma,
+        .pf_process_sat_hue = ( i_sat > 256 ) ? p_sys->pf_process_sat_hue_clip
+                                              : p_sys->pf_process_sat_hue,
+        .i_sin = i_sin, .i_cos = i_cos, .i_sat = i_sat, .i_x = i_x, .i_y = i_y,
+    };
+    filter_RunSlices( p_filter, p_pic->p[Y_PLANE].i_visible_lines,
+                      SlicePlanar, &slice );
 
     return CopyInfoAndRelease( p_outpic, p_pic );
 }
@@ -372,12 +404,8 @@ static picture_t *FilterPacked( filter_t *p_filter, picture_t *p_pic )
     int pi_gamma[256];
 
     picture_t *p_outpic;
-    uint8_t *p_in, *p_in_end, *p_line_end;
-    uint8_t *p_out;
     int i_y_offset, i_u_offset, i_v_offset;
 
-    int i_pitch, i_visible_pitch;
-
     bool b_thres;
     double  f_hue;
     double  f_gamma;
@@ -389,9 +417,6 @@ static picture_t *FilterPacked( filter_t *p_filter, picture_t *p_pic )
 
     if( !p_pic ) return NULL;
 
-    i_pitch = p_pic->p->i_pitch;
-    i_visible_pitch = p_pic->p->i_visible_pitch;
-
     if( GetPackedYuvOffsets( p_pic->format.i_chroma, &i_y_offset,
                              &i_u_offset, &i_v_offset ) != VLC_SUCCESS )
     {
@@ -461,44 +486,7 @@ static picture_t *FilterPacked( filter_t *p_filter, picture_t *p_pic )
     }
 
     /*
-     * Do the Y plane
-     */
-
-    p_in = p_pic->p->p_pixels + i_y_offset;
-    p_in_end = p_in + p_pic->p->i_visible_lines * p_pic->p->i_pitch - 8 * 4;
-
-    p_out = p_outpic->p->p_pixels + i_y_offset;
-
-    for( ; p_in < p_in_end ; )
-    {
-        p_line_end = p_in + i_visible_pitch - 8 * 4;
-
-        for( ; p_in < p_line_end ; )
-        {
-            /* Do 8 pixels at a time */
-            *p_out = pi_luma[ *p_in ]; p_in += 2; p_out += 2;
-            *p_out = pi_luma[ *p_in ]; p_in += 2; p_out += 2;
-            *p_out = pi_luma[ *p_in ]; p_in += 2; p_out += 2;
-            *p_out = pi_luma[ *p_in ]; p_in += 2; p_out += 2;
-            *p_out = pi_luma[ *p_in ]; p_in += 2; p_out += 2;
-            *p_out = pi_luma[ *p_in ]; p_in += 2; p_out += 2;
-            *p_out = pi_luma[ *p_in ]; p_in += 2; p_out += 2;
-            *p_out = pi_luma[ *p_in ]; p_in += 2; p_out += 2;
-        }
-
-        p_line_end += 8 * 4;
-
-        for( ; p_in < p_line_end ; )
-        {
-            *p_out = pi_luma[ *p_in ]; p_in += 2; p_out += 2;
-        }
-
-        p_in += i_pitch - p_pic->p->i_visible_pitch;
-        p_out += i_pitch - p_outpic->p->i_visible_pitch;
-    }
-
-    /*
-     * Do the U and V planes
+     * Do the Y plane and the U and V planes, by slices
      */
 
     i_sin = sin(f_hue) * 256;
@@ -507,32 +495,15 @@ static picture_t *FilterPacked( filter_t *p_filter, picture_t *p_pic )
     i_x = ( cos(f_hue) + sin(f_hue) ) * 32768;
     i_y = ( cos(f_hue) - sin(f_hue) ) * 32768;
 
-    if ( i_sat > 256 )
-    {
-        if ( p_sys->pf_process_sat_hue_clip( p_pic, p_outpic, i_sin, i_cos, i_sat,
-                                             i_x, i_y ) != VLC_SUCCESS )
-        {
-            /* Currently only one error can happen in the function, but if there
-             * will be more of them, this message must go away */
-            msg_Warn( p_filter, "Unsupported input chroma (%4.4s)",
-                      (char*)&(p_pic->format.i_chroma) );
-            picture_Release( p_pic );
-            return NULL;
-        }
-    }
-    else
-    {
-        if ( p_sys->pf_process_sat_hue( p_pic, p_outpic, i_sin, i_cos, i_sat,
-                                        i_x, i_y ) != VLC_SUCCESS )
-        {
-            /* Currently only one error can happen in the function, but if there
-             * will be more of them, this message must go away */
-            msg_Warn( p_filter, "Unsupported input chroma (%4.4s)",
-                      (char*)&(p_pic->format.i_chroma) );
-            picture_Release( p_pic );
-            return NULL;
-        }
-    }
+    struct adjust_slice slice = {
+        .p_pic = p_pic, .p_outpic = p_outpic, .pi_luma = pi_luma,
+        .i_y_offset = i_y_offset,
+        .pf_process_sat_hue = ( i_sat > 256 ) ? p_sys->pf_process_sat_hue_clip
+                                              : p_sys->pf_process_sat_hue,
+        .i_sin = i_sin, .i_cos = i_cos, .i_sat = i_sat, .i_x = i_x, .i_y = i_y,
+    };
+    filter_RunSlices( p_filter, p_pic->p->i_visible_lines,
+                      SlicePacked, &slice );
 
     return CopyInfoAndRelease( p_outpic, p_pic );
 }
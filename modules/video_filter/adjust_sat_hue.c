@@ -71,23 +71,24 @@
  *****************************************************************************/
 
 int planar_sat_hue_clip_C( picture_t * p_pic, picture_t * p_outpic, int i_sin, int i_cos,
-                         int i_sat, int i_x, int i_y )
+                         int i_sat, int i_x, int i_y, unsigned i_start, unsigned i_end )
 {
-    uint8_t *p_in, *p_in_v, *p_in_end, *p_line_end;
+    uint8_t *p_in, *p_in_v, *p_line_end;
     uint8_t *p_out, *p_out_v;
 
-    p_in = p_pic->p[U_PLANE].p_pixels;
-    p_in_v = p_pic->p[V_PLANE].p_pixels;
-    p_in_end = p_in + p_pic->p[U_PLANE].i_visible_lines
-                      * p_pic->p[U_PLANE].i_pitch - 8;
-
-    p_out = p_outpic->p[U_PLANE].p_pixels;
-    p_out_v = p_outpic->p[V_PLANE].p_pixels;
-
     uint8_t i_u, i_v;
 
-    for( ; p_in < p_in_end ; )
+    for( unsigned i_line = i_start; i_line < i_end; i_line++ )
     {
+        p_in = p_pic->p[U_PLANE].p_pixels
+             + i_line * p_pic->p[U_PLANE].i_pitch;
+        p_in_v = p_pic->p[V_PLANE].p_pixels
+               + i_line * p_pic->p[V_PLANE].i_pitch;
+        p_out = p_outpic->p[U_PLANE].p_pixels
+              + i_line * p_outpic->p[U_PLANE].i_pitch;
+        p_out_v = p_outpic->p[V_PLANE].p_pixels
+                + i_line * p_outpic->p[V_PLANE].i_pitch;
+
         p_line_end = p_in + p_pic->p[U_PLANE].i_visible_pitch - 8;
 
         for( ; p_in < p_line_end ; )
@@ -102,38 +103,30 @@ int planar_sat_hue_clip_C( picture_t * p_pic, picture_t * p_outpic, int i_sin, i
         {
             PLANAR_WRITE_UV_CLIP();
         }
-
-        p_in += p_pic->p[U_PLANE].i_pitch
-                - p_pic->p[U_PLANE].i_visible_pitch;
-        p_in_v += p_pic->p[V_PLANE].i_pitch
-                - p_pic->p[V_PLANE].i_visible_pitch;
-        p_out += p_outpic->p[U_PLANE].i_pitch
-                - p_outpic->p[U_PLANE].i_visible_pitch;
-        p_out_v += p_outpic->p[V_PLANE].i_pitch
-                    - p_outpic->p[V_PLANE].i_visible_pitch;
     }
 
     return VLC_SUCCESS;
 }
 
 int planar_sat_hue_C( picture_t * p_pic, picture_t * p_outpic, int i_sin, int i_cos,
-                         int i_sat, int i_x, int i_y )
+                         int i_sat, int i_x, int i_y, unsigned i_start, unsigned i_end )
 {
-    uint8_t *p_in, *p_in_v, *p_in_end, *p_line_end;
+    uint8_t *p_in, *p_in_v, *p_line_end;
     uint8_t *p_out, *p_out_v;
 
-    p_in = p_pic->p[U_PLANE].p_pixels;
-    p_in_v = p_pic->p[V_PLANE].p_pixels;
-    p_in_end = p_in + p_pic->p[U_PLANE].i_visible_lines
-                      * p_pic->p[U_PLANE].i_pitch - 8;
-
-    p_out = p_outpic->p[U_PLANE].p_pixels;
-    p_out_v = p_outpic->p[V_PLANE].p_pixels;
-
     uint8_t i_u, i_v;
 
-    for( ; p_in < p_in_end ; )
+    for( unsigned i_line = i_start; i_line < i_end; i_line++ )
     {
+        p_in = p_pic->p[U_PLANE].p_pixels
+             + i_line * p_pic->p[U_PLANE].i_pitch;
+        p_in_v = p_pic->p[V_PLANE].p_pixels
+               + i_line * p_pic->p[V_PLANE].i_pitch;
+        p_out = p_outpic->p[U_PLANE].p_pixels
+              + i_line * p_outpic->p[U_PLANE].i_pitch;
+        p_out_v = p_outpic->p[V_PLANE].p_pixels
+                + i_line * p_outpic->p[V_PLANE].i_pitch;
+
         p_line_end = p_in + p_pic->p[U_PLANE].i_visible_pitch - 8;
 
         for( ; p_in < p_line_end ; )
@@ -148,50 +141,40 @@ int planar_sat_hue_C( picture_t * p_pic, picture_t * p_outpic, int i_sin, int i_
         {
             PLANAR_WRITE_UV();
         }
-
-        p_in += p_pic->p[U_PLANE].i_pitch
-                - p_pic->p[U_PLANE].i_visible_pitch;
-        p_in_v += p_pic->p[V_PLANE].i_pitch
-                - p_pic->p[V_PLANE].i_visible_pitch;
-        p_out += p_outpic->p[U_PLANE].i_pitch
-                - p_outpic->p[U_PLANE].i_visible_pitch;
-        p_out_v += p_outpic->p[V_PLANE].i_pitch
-                    - p_outpic->p[V_PLANE].i_visible_pitch;
     }
 
     return VLC_SUCCESS;
 }
 
 int packed_sat_hue_clip_C( picture_t * p_pic, picture_t * p_outpic, int i_sin, int i_cos,
-                         int i_sat, int i_x, int i_y )
+                         int i_sat, int i_x, int i_y, unsigned i_start, unsigned i_end )
 {
-    uint8_t *p_in, *p_in_v, *p_in_end, *p_line_end;
+    uint8_t *p_in, *p_in_v, *p_line_end;
     uint8_t *p_out, *p_out_v;
 
     int i_y_offset, i_u_offset, i_v_offset;
-    int i_visible_lines, i_pitch, i_visible_pitch;
+    int i_pitch, i_visible_pitch;
 
 
     if ( GetPackedYuvOffsets( p_pic->format.i_chroma, &i_y_offset,
                               &i_u_offset, &i_v_offset ) != VLC_SUCCESS )
         return VLC_EGENERIC;
 
-    i_visible_lines = p_pic->p->i_visible_lines;
     i_pitch = p_pic->p->i_pitch;
     i_visible_pitch = p_pic->p->i_visible_pitch;
 
-    p_in = p_pic->p->p_pixels + i_u_offset;
-    p_in_v = p_pic->p->p_pixels + i_v_offset;
-    p_in_end = p_in + i_visible_lines * i_pitch - 8 * 4;
-
-    p_out = p_outpic->p->p_pixels + i_u_offset;
-    p_out_v = p_outpic->p->p_pixels + i_v_offset;
-
     uint8_t i_u, i_v;
 
-    for( ; p_in < p_in_end ; )
+    for( unsigned i_line = i_start; i_line < i_end; i_line++ )
     {
-            p_line_end = p_in + i_visible_pitch - 8 * 4;
+        p_in = p_pic->p->p_pixels + i_line * i_pitch + i_u_offset;
+        p_in_v = p_pic->p->p_pixels + i_line * i_pitch + i_v_offset;
+        p_out = p_outpic->p->p_pixels + i_line * p_outpic->p->i_pitch
+              + i_u_offset;
+        p_out_v = p_outpic->p->p_pixels + i_line * p_outpic->p->i_pitch
+                + i_v_offset;
+
+        p_line_end = p_in + i_visible_pitch - 8 * 4;
 
         for( ; p_in < p_line_end ; )
         {
@@ -205,46 +188,40 @@ int packed_sat_hue_clip_C( picture_t * p_pic, picture_t * p_outpic, int i_sin, i
         {
             PACKED_WRITE_UV_CLIP();
         }
-
-            p_in += i_pitch - i_visible_pitch;
-            p_in_v += i_pitch - i_visible_pitch;
-            p_out += i_pitch - i_visible_pitch;
-            p_out_v += i_pitch - i_visible_pitch;
     }
 
     return VLC_SUCCESS;
 }
 
-int packed_sat_hue_C( picture_t * p_pic, picture_t * p_outpic, int i_sin,
-                      int i_cos, int i_sat, int i_x, int i_y )
+int packed_sat_hue_C( picture_t * p_pic, picture_t * p_outpic, int i_sin, int i_cos,
+                         int i_sat, int i_x, int i_y, unsigned i_start, unsigned i_end )
 {
-    uint8_t *p_in, *p_in_v, *p_in_end, *p_line_end;
+    uint8_t *p_in, *p_in_v, *p_line_end;
     uint8_t *p_out, *p_out_v;
 
     int i_y_offset, i_u_offset, i_v_offset;
-    int i_visible_lines, i_pitch, i_visible_pitch;
+    int i_pitch, i_visible_pitch;
 
 
     if ( GetPackedYuvOffsets( p_pic->format.i_chroma, &i_y_offset,
                               &i_u_offset, &i_v_offset ) != VLC_SUCCESS )
         return VLC_EGENERIC;
 
-    i_visible_lines = p_pic->p->i_visible_lines;
     i_pitch = p_pic->p->i_pitch;
     i_visible_pitch = p_pic->p->i_visible_pitch;
 
-    p_in = p_pic->p->p_pixels + i_u_offset;
-    p_in_v = p_pic->p->p_pixels + i_v_offset;
-    p_in_end = p_in + i_visible_lines * i_pitch - 8 * 4;
-
-    p_out = p_outpic->p->p_pixels + i_u_offset;
-    p_out_v = p_outpic->p->p_pixels + i_v_offset;
-
     uint8_t i_u, i_v;
 
-    for( ; p_in < p_in_end ; )
+    for( unsigned i_line = i_start; i_line < i_end; i_line++ )
     {
-            p_line_end = p_in + i_visible_pitch - 8 * 4;
+        p_in = p_pic->p->p_pixels + i_line * i_pitch + i_u_offset;
+        p_in_v = p_pic->p->p_pixels + i_line * i_pitch + i_v_offset;
+        p_out = p_outpic->p->p_pixels + i_line * p_outpic->p->i_pitch
+              + i_u_offset;
+        p_out_v = p_outpic->p->p_pixels + i_line * p_outpic->p->i_pitch
+                + i_v_offset;
+
+        p_line_end = p_in + i_visible_pitch - 8 * 4;
 
         for( ; p_in < p_line_end ; )
         {
@@ -258,11 +235,6 @@ int packed_sat_hue_C( picture_t * p_pic, picture_t * p_outpic, int i_sin,
         {
             PACKED_WRITE_UV();
         }
-
-            p_in += i_pitch - i_visible_pitch;
-            p_in_v += i_pitch - i_visible_pitch;
-            p_out += i_pitch - i_visible_pitch;
-            p_out_v += i_pitch - i_visible_pitch;
     }
 
     return VLC_SUCCESS;
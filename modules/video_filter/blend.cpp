@@ -40,10 +40,15 @@
 static int  Open (vlc_object_t *);
 static void Close(vlc_object_t *);
 
+#define SIMD_TEXT N_("Use SIMD blending")
+#define SIMD_LONGTEXT N_("Use the vector instructions of the CPU to blend " \
+    "the most common formats. Disable this to benchmark the generic code.")
+
 vlc_module_begin()
     set_description(N_("Video pictures blending"))
     set_capability("video blending", 100)
     set_callbacks(Open, Close)
+    add_bool("blend-simd", true, SIMD_TEXT, SIMD_LONGTEXT, true)
 vlc_module_end()
 
 static inline unsigned div255(unsigned v)
@@ -615,6 +620,611 @@ static const struct {
 #undef YUV
 };
 
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (VLC_GCC_VERSION(4, 9) || defined(__clang__))
+/*****************************************************************************
+ * SIMD blending
+ *
+ * The hot combinations are blended line by line: the source pixels are
+ * first expanded to separate Y, U, V and A arrays (by chunks), then merged
+ * into the destination planes many pixels at a time. The results are the
+ * same as the generic code above.
+ *****************************************************************************/
+#define BLEND_SIMD 1
+#include <immintrin.h>
+#include <vlc_cpu.h>
+
+#define BLEND_SSE2 __attribute__ ((__target__ ("sse2")))
+#define BLEND_AVX2 __attribute__ ((__target__ ("avx2")))
+
+/* Number of pixels expanded at once, even to keep the chroma parity */
+#define BLEND_CHUNK 256
+
+struct CLineYUVA {
+    const uint8_t *i, *j, *k, *a;
+};
+
+/* Scalar code, for the ends of the lines */
+struct CKernelC {
+    /* dst[n] with src[n] and a[n] */
+    static void mergeFull(uint8_t *dst, const uint8_t *src, const uint8_t *a,
+                          unsigned count, unsigned alpha)
+    {
+        for (unsigned n = 0; n < count; n++)
+            ::merge(&dst[n], src[n], div255(alpha * a[n]));
+    }
+    /* dst[n] with src[2n] and a[2n] */
+    static void mergeSub(uint8_t *dst, const uint8_t *src, const uint8_t *a,
+                         unsigned count, unsigned alpha)
+    {
+        for (unsigned n = 0; n < count; n++)
+            ::merge(&dst[n], src[2 * n], div255(alpha * a[2 * n]));
+    }
+    /* dst[2n] with u[2n] and dst[2n+1] with v[2n], both with a[2n] */
+    static void mergeSubPacked(uint8_t *dst, const uint8_t *u, const uint8_t *v,
+                               const uint8_t *a, unsigned count, unsigned alpha)
+    {
+        for (unsigned n = 0; n < count; n++) {
+            unsigned f = div255(alpha * a[2 * n]);
+            ::merge(&dst[2 * n + 0], u[2 * n], f);
+            ::merge(&dst[2 * n + 1], v[2 * n], f);
+        }
+    }
+    /* RGBA source onto RGBX (or BGRX if swap_rb) destination */
+    template <bool swap_rb>
+    static void mergeRGBX(uint8_t *dst, const uint8_t *src,
+                          unsigned count, unsigned alpha)
+    {
+        for (unsigned n = 0; n < count; n++, dst += 4, src += 4) {
+            unsigned f = div255(alpha * src[3]);
+            ::merge(&dst[swap_rb ? 2 : 0], src[0], f);
+            ::merge(&dst[1],               src[1], f);
+            ::merge(&dst[swap_rb ? 0 : 2], src[2], f);
+        }
+    }
+    static void rgbaToYuva(uint8_t *y, uint8_t *u, uint8_t *v, uint8_t *a,
+                           const uint8_t *src, unsigned count)
+    {
+        for (unsigned n = 0; n < count; n++, src += 4) {
+            rgb_to_yuv(&y[n], &u[n], &v[n], src[0], src[1], src[2]);
+            a[n] = src[3];
+        }
+    }
+};
+
+struct CKernelSSE2 {
+    BLEND_SSE2 static inline __m128i div255(__m128i v)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+        return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_srli_epi16(v, 8), v), one), 8);
+    }
+    /* div255((255 - f) * d + s * f) on 16 bits words */
+    BLEND_SSE2 static inline __m128i merge(__m128i d, __m128i s, __m128i f)
+    {
+        const __m128i max = _mm_set1_epi16(255);
+        return div255(_mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(max, f)),
+                                    _mm_mullo_epi16(s, f)));
+    }
+    BLEND_SSE2 static void mergeFull(uint8_t *dst, const uint8_t *src, const uint8_t *a,
+                                     unsigned count, unsigned alpha)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i va = _mm_set1_epi16(alpha);
+        unsigned n = 0;
+
+        for (; n + 16 <= count; n += 16) {
+            __m128i d = _mm_loadu_si128((const __m128i *)&dst[n]);
+            __m128i s = _mm_loadu_si128((const __m128i *)&src[n]);
+            __m128i f = _mm_loadu_si128((const __m128i *)&a[n]);
+            __m128i flo = div255(_mm_mullo_epi16(_mm_unpacklo_epi8(f, zero), va));
+            __m128i fhi = div255(_mm_mullo_epi16(_mm_unpackhi_epi8(f, zero), va));
+            __m128i lo = merge(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), flo);
+            __m128i hi = merge(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), fhi);
+            _mm_storeu_si128((__m128i *)&dst[n], _mm_packus_epi16(lo, hi));
+        }
+        CKernelC::mergeFull(&dst[n], &src[n], &a[n], count - n, alpha);
+    }
+    BLEND_SSE2 static void mergeSub(uint8_t *dst, const uint8_t *src, const uint8_t *a,
+                                    unsigned count, unsigned alpha)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i even = _mm_set1_epi16(0xff);
+        const __m128i va = _mm_set1_epi16(alpha);
+        unsigned n = 0;
+
+        /* 16 source bytes are read for 8 output pixels */
+        for (; n + 9 <= count; n += 8) {
+            __m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&dst[n]), zero);
+            __m128i s = _mm_and_si128(_mm_loadu_si128((const __m128i *)&src[2 * n]), even);
+            __m128i f = _mm_and_si128(_mm_loadu_si128((const __m128i *)&a[2 * n]), even);
+            __m128i r = merge(d, s, div255(_mm_mullo_epi16(f, va)));
+            _mm_storel_epi64((__m128i *)&dst[n], _mm_packus_epi16(r, r));
+        }
+        CKernelC::mergeSub(&dst[n], &src[2 * n], &a[2 * n], count - n, alpha);
+    }
+    BLEND_SSE2 static void mergeSubPacked(uint8_t *dst, const uint8_t *u, const uint8_t *v,
+                                          const uint8_t *a, unsigned count, unsigned alpha)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i even = _mm_set1_epi16(0xff);
+        const __m128i va = _mm_set1_epi16(alpha);
+        unsigned n = 0;
+
+        for (; n + 9 <= count; n += 8) {
+            __m128i d = _mm_loadu_si128((const __m128i *)&dst[2 * n]);
+            __m128i su = _mm_and_si128(_mm_loadu_si128((const __m128i *)&u[2 * n]), even);
+            __m128i sv = _mm_and_si128(_mm_loadu_si128((const __m128i *)&v[2 * n]), even);
+            __m128i f = _mm_and_si128(_mm_loadu_si128((const __m128i *)&a[2 * n]), even);
+            f = div255(_mm_mullo_epi16(f, va));
+            __m128i lo = merge(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi16(su, sv),
+                               _mm_unpacklo_epi16(f, f));
+            __m128i hi = merge(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi16(su, sv),
+                               _mm_unpackhi_epi16(f, f));
+            _mm_storeu_si128((__m128i *)&dst[2 * n], _mm_packus_epi16(lo, hi));
+        }
+        CKernelC::mergeSubPacked(&dst[2 * n], &u[2 * n], &v[2 * n], &a[2 * n],
+                                 count - n, alpha);
+    }
+    /* Merges 2 RGBA pixels onto 2 RGBX pixels, as 16 bits words */
+    template <bool swap_rb>
+    BLEND_SSE2 static inline __m128i mergeRGBX2(__m128i d, __m128i s, __m128i va)
+    {
+        /* Only the color components are written */
+        const __m128i color = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+        __m128i f = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)),
+                                        _MM_SHUFFLE(3, 3, 3, 3));
+        f = div255(_mm_mullo_epi16(f, va));
+        if (swap_rb)
+            s = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 0, 1, 2)),
+                                    _MM_SHUFFLE(3, 0, 1, 2));
+        __m128i r = merge(d, s, f);
+        return _mm_or_si128(_mm_and_si128(color, r), _mm_andnot_si128(color, d));
+    }
+    template <bool swap_rb>
+    BLEND_SSE2 static void mergeRGBX(uint8_t *dst, const uint8_t *src,
+                                     unsigned count, unsigned alpha)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i va = _mm_set1_epi16(alpha);
+        unsigned n = 0;
+
+        for (; n + 4 <= count; n += 4) {
+            __m128i d = _mm_loadu_si128((const __m128i *)&dst[4 * n]);
+            __m128i s = _mm_loadu_si128((const __m128i *)&src[4 * n]);
+            __m128i lo = mergeRGBX2<swap_rb>(_mm_unpacklo_epi8(d, zero),
+                                             _mm_unpacklo_epi8(s, zero), va);
+            __m128i hi = mergeRGBX2<swap_rb>(_mm_unpackhi_epi8(d, zero),
+                                             _mm_unpackhi_epi8(s, zero), va);
+            _mm_storeu_si128((__m128i *)&dst[4 * n], _mm_packus_epi16(lo, hi));
+        }
+        CKernelC::mergeRGBX<swap_rb>(&dst[4 * n], &src[4 * n], count - n, alpha);
+    }
+    BLEND_SSE2 static void rgbaToYuva(uint8_t *y, uint8_t *u, uint8_t *v, uint8_t *a,
+                                      const uint8_t *src, unsigned count)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i byte = _mm_set1_epi32(0xff);
+        const __m128i round = _mm_set1_epi16(128);
+        unsigned n = 0;
+
+        for (; n + 8 <= count; n += 8) {
+            __m128i p0 = _mm_loadu_si128((const __m128i *)&src[4 * n]);
+            __m128i p1 = _mm_loadu_si128((const __m128i *)&src[4 * n + 16]);
+            __m128i r = _mm_packs_epi32(_mm_and_si128(p0, byte), _mm_and_si128(p1, byte));
+            __m128i g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), byte),
+                                        _mm_and_si128(_mm_srli_epi32(p1, 8), byte));
+            __m128i b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), byte),
+                                        _mm_and_si128(_mm_srli_epi32(p1, 16), byte));
+            __m128i f = _mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24));
+
+            /* Same arithmetic as rgb_to_yuv(), which fits in 16 bits */
+            __m128i vy = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+                                                     _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+                                       _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)),
+                                                     round));
+            vy = _mm_add_epi16(_mm_srli_epi16(vy, 8), _mm_set1_epi16(16));
+            __m128i vu = _mm_sub_epi16(_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)),
+                                                     round),
+                                       _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(38)),
+                                                     _mm_mullo_epi16(g, _mm_set1_epi16(74))));
+            vu = _mm_add_epi16(_mm_srai_epi16(vu, 8), round);
+            __m128i vv = _mm_sub_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)),
+                                                     round),
+                                       _mm_add_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(94)),
+                                                     _mm_mullo_epi16(b, _mm_set1_epi16(18))));
+            vv = _mm_add_epi16(_mm_srai_epi16(vv, 8), round);
+
+            _mm_storel_epi64((__m128i *)&y[n], _mm_packus_epi16(vy, zero));
+            _mm_storel_epi64((__m128i *)&u[n], _mm_packus_epi16(vu, zero));
+            _mm_storel_epi64((__m128i *)&v[n], _mm_packus_epi16(vv, zero));
+            _mm_storel_epi64((__m128i *)&a[n], _mm_packus_epi16(f, zero));
+        }
+        CKernelC::rgbaToYuva(&y[n], &u[n], &v[n], &a[n], &src[4 * n], count - n);
+    }
+};
+
+struct CKernelAVX2 {
+    BLEND_AVX2 static inline __m256i div255(__m256i v)
+    {
+        const __m256i one = _mm256_set1_epi16(1);
+        return _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_srli_epi16(v, 8), v), one), 8);
+    }
+    BLEND_AVX2 static inline __m256i merge(__m256i d, __m256i s, __m256i f)
+    {
+        const __m256i max = _mm256_set1_epi16(255);
+        return div255(_mm256_add_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(max, f)),
+                                       _mm256_mullo_epi16(s, f)));
+    }
+    /* Packs 2 vectors of 16 bits words to bytes, in order */
+    BLEND_AVX2 static inline __m256i pack(__m256i lo, __m256i hi)
+    {
+        return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+    }
+    BLEND_AVX2 static inline __m256i load16(const uint8_t *p)
+    {
+        return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+    }
+    BLEND_AVX2 static void mergeFull(uint8_t *dst, const uint8_t *src, const uint8_t *a,
+                                     unsigned count, unsigned alpha)
+    {
+        const __m256i va = _mm256_set1_epi16(alpha);
+        unsigned n = 0;
+
+        for (; n + 32 <= count; n += 32) {
+            __m256i flo = div255(_mm256_mullo_epi16(load16(&a[n]), va));
+            __m256i fhi = div255(_mm256_mullo_epi16(load16(&a[n + 16]), va));
+            __m256i lo = merge(load16(&dst[n]), load16(&src[n]), flo);
+            __m256i hi = merge(load16(&dst[n + 16]), load16(&src[n + 16]), fhi);
+            _mm256_storeu_si256((__m256i *)&dst[n], pack(lo, hi));
+        }
+        CKernelSSE2::mergeFull(&dst[n], &src[n], &a[n], count - n, alpha);
+    }
+    BLEND_AVX2 static void mergeSub(uint8_t *dst, const uint8_t *src, const uint8_t *a,
+                                    unsigned count, unsigned alpha)
+    {
+        const __m256i even = _mm256_set1_epi16(0xff);
+        const __m256i va = _mm256_set1_epi16(alpha);
+        unsigned n = 0;
+
+        /* 32 source bytes are read for 16 output pixels */
+        for (; n + 17 <= count; n += 16) {
+            __m256i s = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&src[2 * n]), even);
+            __m256i f = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&a[2 * n]), even);
+            __m256i r = merge(load16(&dst[n]), s, div255(_mm256_mullo_epi16(f, va)));
+            _mm_storeu_si128((__m128i *)&dst[n], _mm256_castsi256_si128(pack(r, r)));
+        }
+        CKernelSSE2::mergeSub(&dst[n], &src[2 * n], &a[2 * n], count - n, alpha);
+    }
+    BLEND_AVX2 static void mergeSubPacked(uint8_t *dst, const uint8_t *u, const uint8_t *v,
+                                          const uint8_t *a, unsigned count, unsigned alpha)
+    {
+        const __m256i even = _mm256_set1_epi16(0xff);
+        const __m256i va = _mm256_set1_epi16(alpha);
+        unsigned n = 0;
+
+        for (; n + 17 <= count; n += 16) {
+            __m256i su = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&u[2 * n]), even);
+            __m256i sv = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&v[2 * n]), even);
+            __m256i f = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)&a[2 * n]), even);
+            f = div255(_mm256_mullo_epi16(f, va));
+
+            /* Interleaving works within 128 bits lanes, put them back in order */
+            __m256i uvlo = _mm256_unpacklo_epi16(su, sv), uvhi = _mm256_unpackhi_epi16(su, sv);
+            __m256i fflo = _mm256_unpacklo_epi16(f, f), ffhi = _mm256_unpackhi_epi16(f, f);
+            __m256i lo = merge(load16(&dst[2 * n]),
+                               _mm256_permute2x128_si256(uvlo, uvhi, 0x20),
+                               _mm256_permute2x128_si256(fflo, ffhi, 0x20));
+            __m256i hi = merge(load16(&dst[2 * n + 16]),
+                               _mm256_permute2x128_si256(uvlo, uvhi, 0x31),
+                               _mm256_permute2x128_si256(fflo, ffhi, 0x31));
+            _mm256_storeu_si256((__m256i *)&dst[2 * n], pack(lo, hi));
+        }
+        CKernelSSE2::mergeSubPacked(&dst[2 * n], &u[2 * n], &v[2 * n], &a[2 * n],
+                                    count - n, alpha);
+    }
+    template <bool swap_rb>
+    BLEND_AVX2 static inline __m256i mergeRGBX4(__m256i d, __m256i s, __m256i va)
+    {
+        const __m256i color = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1,
+                                               0, -1, -1, -1, 0, -1, -1, -1);
+        __m256i f = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)),
+                                           _MM_SHUFFLE(3, 3, 3, 3));
+        f = div255(_mm256_mullo_epi16(f, va));
+        if (swap_rb)
+            s = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 0, 1, 2)),
+                                       _MM_SHUFFLE(3, 0, 1, 2));
+        __m256i r = merge(d, s, f);
+        return _mm256_or_si256(_mm256_and_si256(color, r), _mm256_andnot_si256(color, d));
+    }
+    template <bool swap_rb>
+    BLEND_AVX2 static void mergeRGBX(uint8_t *dst, const uint8_t *src,
+                                     unsigned count, unsigned alpha)
+    {
+        const __m256i va = _mm256_set1_epi16(alpha);
+        unsigned n = 0;
+
+        for (; n + 8 <= count; n += 8) {
+            __m256i lo = mergeRGBX4<swap_rb>(load16(&dst[4 * n]), load16(&src[4 * n]), va);
+            __m256i hi = mergeRGBX4<swap_rb>(load16(&dst[4 * n + 16]), load16(&src[4 * n + 16]), va);
+            _mm256_storeu_si256((__m256i *)&dst[4 * n], pack(lo, hi));
+        }
+        CKernelSSE2::mergeRGBX<swap_rb>(&dst[4 * n], &src[4 * n], count - n, alpha);
+    }
+    static void rgbaToYuva(uint8_t *y, uint8_t *u, uint8_t *v, uint8_t *a,
+                           const uint8_t *src, unsigned count)
+    {
+        CKernelSSE2::rgbaToYuva(y, u, v, a, src, count);
+    }
+};
+
+/* Sources, expanded to CLineYUVA */
+template <class TKernel>
+class CSourceYUVA : public CPicture {
+public:
+    CSourceYUVA(const CPicture &cfg) : CPicture(cfg)
+    {
+        for (unsigned i = 0; i < 4; i++)
+            data[i] = CPicture::getLine<1>(i);
+    }
+    void get(CLineYUVA *line, unsigned dx, unsigned, uint8_t (*)[BLEND_CHUNK]) const
+    {
+        line->i = &data[0][x + dx];
+        line->j = &data[1][x + dx];
+        line->k = &data[2][x + dx];
+        line->a = &data[3][x + dx];
+    }
+    void nextLine()
+    {
+        y++;
+        for (unsigned i = 0; i < 4; i++)
+            data[i] += picture->p[i].i_pitch;
+    }
+private:
+    const uint8_t *data[4];
+};
+
+template <class TKernel>
+class CSourceRGBA : public CPicture {
+public:
+    CSourceRGBA(const CPicture &cfg) : CPicture(cfg)
+    {
+        data = CPicture::getLine<1>(0);
+    }
+    void get(CLineYUVA *line, unsigned dx, unsigned count,
+             uint8_t (*scratch)[BLEND_CHUNK]) const
+    {
+        TKernel::rgbaToYuva(scratch[0], scratch[1], scratch[2], scratch[3],
+                            &data[(x + dx) * 4], count);
+        line->i = scratch[0];
+        line->j = scratch[1];
+        line->k = scratch[2];
+        line->a = scratch[3];
+    }
+    void nextLine()
+    {
+        y++;
+        data += picture->p[0].i_pitch;
+    }
+private:
+    const uint8_t *data;
+};
+
+template <class TKernel>
+class CSourceYUVP : public CPicture {
+public:
+    CSourceYUVP(const CPicture &cfg) : CPicture(cfg)
+    {
+        palette = fmt->p_palette;
+        data = CPicture::getLine<1>(0);
+    }
+    void get(CLineYUVA *line, unsigned dx, unsigned count,
+             uint8_t (*scratch)[BLEND_CHUNK]) const
+    {
+        const uint8_t *src = &data[x + dx];
+        for (unsigned n = 0; n < count; n++) {
+            const uint8_t *entry = palette->palette[src[n]];
+            scratch[0][n] = entry[0];
+            scratch[1][n] = entry[1];
+            scratch[2][n] = entry[2];
+            scratch[3][n] = entry[3];
+        }
+        line->i = scratch[0];
+        line->j = scratch[1];
+        line->k = scratch[2];
+        line->a = scratch[3];
+    }
+    void nextLine()
+    {
+        y++;
+        data += picture->p[0].i_pitch;
+    }
+private:
+    const video_palette_t *palette;
+    const uint8_t *data;
+};
+
+/* 4:2:0 destinations */
+template <class TKernel, bool swap_uv>
+class CDestI420 : public CPicture {
+public:
+    CDestI420(const CPicture &cfg) : CPicture(cfg)
+    {
+        data[0] = CPicture::getLine<1>(0);
+        data[1] = CPicture::getLine<2>(swap_uv ? 2 : 1);
+        data[2] = CPicture::getLine<2>(swap_uv ? 1 : 2);
+    }
+    void merge(const CLineYUVA &line, unsigned dx, unsigned count, unsigned alpha)
+    {
+        TKernel::mergeFull(&data[0][x + dx], line.i, line.a, count, alpha);
+
+        /* Chroma is merged from the source pixels on even columns and lines */
+        const unsigned first = (x + dx) % 2;
+        if ((y % 2) != 0 || count <= first)
+            return;
+        const unsigned chroma = (count - first + 1) / 2;
+        TKernel::mergeSub(&data[1][(x + dx + first) / 2], &line.j[first],
+                          &line.a[first], chroma, alpha);
+        TKernel::mergeSub(&data[2][(x + dx + first) / 2], &line.k[first],
+                          &line.a[first], chroma, alpha);
+    }
+    void nextLine()
+    {
+        y++;
+        data[0] += picture->p[0].i_pitch;
+        if ((y % 2) == 0) {
+            data[1] += picture->p[swap_uv ? 2 : 1].i_pitch;
+            data[2] += picture->p[swap_uv ? 1 : 2].i_pitch;
+        }
+    }
+private:
+    uint8_t *data[3];
+};
+
+template <class TKernel, bool swap_uv>
+class CDestNV12 : public CPicture {
+public:
+    CDestNV12(const CPicture &cfg) : CPicture(cfg)
+    {
+        data[0] = CPicture::getLine<1>(0);
+        data[1] = CPicture::getLine<2>(1);
+    }
+    void merge(const CLineYUVA &line, unsigned dx, unsigned count, unsigned alpha)
+    {
+        TKernel::mergeFull(&data[0][x + dx], line.i, line.a, count, alpha);
+
+        const unsigned first = (x + dx) % 2;
+        if ((y % 2) != 0 || count <= first)
+            return;
+        TKernel::mergeSubPacked(&data[1][(x + dx + first) / 2 * 2],
+                                &(swap_uv ? line.k : line.j)[first],
+                                &(swap_uv ? line.j : line.k)[first],
+                                &line.a[first], (count - first + 1) / 2, alpha);
+    }
+    void nextLine()
+    {
+        y++;
+        data[0] += picture->p[0].i_pitch;
+        if ((y % 2) == 0)
+            data[1] += picture->p[1].i_pitch;
+    }
+private:
+    uint8_t *data[2];
+};
+
+template <class TDst, class TSrc>
+void BlendSIMD(const CPicture &dst_data, const CPicture &src_data,
+               unsigned width, unsigned height, int alpha)
+{
+    TSrc src(src_data);
+    TDst dst(dst_data);
+    uint8_t scratch[4][BLEND_CHUNK];
+
+    for (unsigned y = 0; y < height; y++) {
+        for (unsigned x = 0; x < width; x += BLEND_CHUNK) {
+            const unsigned count = __MIN(width - x, BLEND_CHUNK);
+            CLineYUVA line;
+
+            src.get(&line, x, count, scratch);
+            dst.merge(line, x, count, alpha);
+        }
+        src.nextLine();
+        dst.nextLine();
+    }
+}
+
+/* 32 bits RGB destination from RGBA */
+class CPicturePacked32 : public CPicture {
+public:
+    CPicturePacked32(const CPicture &cfg) : CPicture(cfg)
+    {
+        data = CPicture::getLine<1>(0);
+    }
+    uint8_t *getPointer(unsigned dx) const
+    {
+        return &data[(x + dx) * 4];
+    }
+    void nextLine()
+    {
+        y++;
+        data += picture->p[0].i_pitch;
+    }
+private:
+    uint8_t *data;
+};
+
+template <class TKernel, bool swap_rb>
+void BlendRGBX(const CPicture &dst_data, const CPicture &src_data,
+               unsigned width, unsigned height, int alpha)
+{
+    CPicturePacked32 src(src_data);
+    CPicturePacked32 dst(dst_data);
+
+    for (unsigned y = 0; y < height; y++) {
+        TKernel::template mergeRGBX<swap_rb>(dst.getPointer(0), src.getPointer(0),
+                                             width, alpha);
+        src.nextLine();
+        dst.nextLine();
+    }
+}
+
+static const struct {
+    vlc_fourcc_t     dst;
+    vlc_fourcc_t     src;
+    blend_function_t sse2;
+    blend_function_t avx2;
+} blends_simd[] = {
+#define SIMD(dst_csp, dst_picture, swap, src_csp, src_picture) \
+    { dst_csp, src_csp, \
+      BlendSIMD<dst_picture<CKernelSSE2, swap>, src_picture<CKernelSSE2> >, \
+      BlendSIMD<dst_picture<CKernelAVX2, swap>, src_picture<CKernelAVX2> > }
+#define YUV420(csp, picture, swap) \
+    SIMD(csp, picture, swap, VLC_CODEC_YUVA, CSourceYUVA), \
+    SIMD(csp, picture, swap, VLC_CODEC_RGBA, CSourceRGBA), \
+    SIMD(csp, picture, swap, VLC_CODEC_YUVP, CSourceYUVP)
+
+    YUV420(VLC_CODEC_I420, CDestI420, false),
+    YUV420(VLC_CODEC_J420, CDestI420, false),
+    YUV420(VLC_CODEC_YV12, CDestI420, true),
+    YUV420(VLC_CODEC_NV12, CDestNV12, false),
+    YUV420(VLC_CODEC_NV21, CDestNV12, true),
+
+#undef YUV420
+#undef SIMD
+};
+
+/**
+ * Returns a SIMD blending function matching the formats and the CPU, if any.
+ */
+static blend_function_t GetBlendSIMD(const video_format_t *dst_fmt,
+                                     const video_format_t *src_fmt)
+{
+    const vlc_fourcc_t dst = dst_fmt->i_chroma;
+    const vlc_fourcc_t src = src_fmt->i_chroma;
+    const bool avx2 = vlc_CPU_AVX2();
+
+    if (!vlc_CPU_SSE2())
+        return NULL;
+
+    if (dst == VLC_CODEC_RGB32 && src == VLC_CODEC_RGBA) {
+        video_format_t fmt = *dst_fmt;
+        video_format_FixRgb(&fmt);
+
+        /* Only the byte orders with the color components first */
+        if (fmt.i_lrshift == 16 && fmt.i_lgshift == 8 && fmt.i_lbshift == 0)
+            return avx2 ? BlendRGBX<CKernelAVX2, true> : BlendRGBX<CKernelSSE2, true>;
+        if (fmt.i_lrshift == 0 && fmt.i_lgshift == 8 && fmt.i_lbshift == 16)
+            return avx2 ? BlendRGBX<CKernelAVX2, false> : BlendRGBX<CKernelSSE2, false>;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < sizeof(blends_simd) / sizeof(*blends_simd); i++) {
+        if (blends_simd[i].src == src && blends_simd[i].dst == dst)
+            return avx2 ? blends_simd[i].avx2 : blends_simd[i].sse2;
+    }
+    return NULL;
+}
+#endif /* SIMD */
+
 struct filter_sys_t {
     filter_sys_t() : blend(NULL)
     {
@@ -663,6 +1273,14 @@ static int Open(vlc_object_t *object)
     const vlc_fourcc_t dst = filter->fmt_out.video.i_chroma;
 
     filter_sys_t *sys = new filter_sys_t();
+#ifdef BLEND_SIMD
+    if (var_InheritBool(filter, "blend-simd"))
+        sys->blend = GetBlendSIMD(&filter->fmt_out.video, &filter->fmt_in.video);
+    if (sys->blend)
+        msg_Dbg(filter, "using SIMD blending (chroma: %4.4s -> %4.4s)",
+                (char *)&src, (char *)&dst);
+    else
+#endif
     for (size_t i = 0; i < sizeof(blends) / sizeof(*blends); i++) {
         if (blends[i].src == src && blends[i].dst == dst)
             sys->blend = blends[i].blend;
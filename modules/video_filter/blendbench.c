@@ -1,7 +1,7 @@
 /*****************************************************************************
  * blendbench.c : blending benchmark plugin for vlc
  *****************************************************************************
- * Copyright (C) 2007 VLC authors and VideoLAN
+ * Copyright (C) 2007-2016 VLC authors and VideoLAN
  * $Id$
  *
  * Author: Søren Bøg <avacore@videolan.org>
@@ -68,6 +68,19 @@ static picture_t *Filter( filter_t *, picture_t * );
 #define BLEND_CHROMA_LONGTEXT N_("Chroma which the blend image will be loaded" \
                                  " in")
 
+#define WIDTH_TEXT N_("Width of the generated images")
+#define HEIGHT_TEXT N_("Height of the generated images")
+#define SIZE_LONGTEXT N_("Images are generated with this size when no file " \
+                         "is given, so that results are reproducible")
+
+#define COMPARE_TEXT N_("Compare with the generic code")
+#define COMPARE_LONGTEXT N_("Run the blend with and without the SIMD " \
+                            "routines, and check that the results match")
+
+#define ALL_TEXT N_("Benchmark the common chromas")
+#define ALL_LONGTEXT N_("Benchmark the chroma combinations used for " \
+                        "subtitles and OSD, on generated images")
+
 #define CFG_PREFIX "blendbench-"
 
 vlc_module_begin ()
@@ -82,6 +95,13 @@ vlc_module_begin ()
               LOOPS_LONGTEXT, false )
     add_integer_with_range( CFG_PREFIX "alpha", 128, 0, 255, ALPHA_TEXT,
               ALPHA_LONGTEXT, false )
+    add_bool( CFG_PREFIX "compare", true, COMPARE_TEXT, COMPARE_LONGTEXT,
+              false )
+    add_bool( CFG_PREFIX "all", false, ALL_TEXT, ALL_LONGTEXT, false )
+    add_integer_with_range( CFG_PREFIX "width", 1920, 16, 8192, WIDTH_TEXT,
+              SIZE_LONGTEXT, true )
+    add_integer_with_range( CFG_PREFIX "height", 1080, 16, 8192, HEIGHT_TEXT,
+              SIZE_LONGTEXT, true )
 
     set_section( N_("Base image"), NULL )
     add_loadfile( CFG_PREFIX "base-image", NULL, BASE_IMAGE_TEXT,
@@ -99,8 +119,22 @@ vlc_module_begin ()
 vlc_module_end ()
 
 static const char *const ppsz_filter_options[] = {
-    "loops", "alpha", "base-image", "base-chroma", "blend-image",
-    "blend-chroma", NULL
+    "loops", "alpha", "compare", "all", "width", "height",
+    "base-image", "base-chroma", "blend-image", "blend-chroma", NULL
+};
+
+/* Combinations benchmarked by blendbench-all */
+static const struct
+{
+    vlc_fourcc_t i_base;
+    vlc_fourcc_t i_blend;
+} p_combinations[] = {
+    { VLC_CODEC_I420,  VLC_CODEC_YUVA },
+    { VLC_CODEC_NV12,  VLC_CODEC_YUVA },
+    { VLC_CODEC_I420,  VLC_CODEC_RGBA },
+    { VLC_CODEC_RGB32, VLC_CODEC_RGBA },
+    { VLC_CODEC_I420,  VLC_CODEC_YUVP },
+    { VLC_CODEC_NV12,  VLC_CODEC_YUVP },
 };
 
 /*****************************************************************************
@@ -109,7 +143,10 @@ static const char *const ppsz_filter_options[] = {
 struct filter_sys_t
 {
     bool b_done;
+    bool b_compare, b_all;
     int i_loops, i_alpha;
+    int i_width, i_height;
+    video_palette_t palette;
 
     picture_t *p_base_image;
     picture_t *p_blend_image;
@@ -118,6 +155,42 @@ struct filter_sys_t
     vlc_fourcc_t i_blend_chroma;
 };
 
+/* Fills a picture with pseudo-random pixels, always the same for a seed.
+ * The palette of YUVP pictures is stored in p_sys. */
+static picture_t *blendbench_NewImage( filter_sys_t *p_sys,
+                                       vlc_fourcc_t i_chroma, uint32_t i_seed )
+{
+    picture_t *p_pic = picture_New( i_chroma, p_sys->i_width,
+                                    p_sys->i_height, 1, 1 );
+    if( p_pic == NULL )
+        return NULL;
+
+    for( int i = 0; i < p_pic->i_planes; i++ )
+    {
+        plane_t *p = &p_pic->p[i];
+
+        for( int y = 0; y < p->i_lines; y++ )
+            for( int x = 0; x < p->i_pitch; x++ )
+            {
+                i_seed = i_seed * 1103515245 + 12345;
+                p->p_pixels[y * p->i_pitch + x] = i_seed >> 16;
+            }
+    }
+
+    if( i_chroma == VLC_CODEC_YUVP )
+    {
+        p_sys->palette.i_entries = VIDEO_PALETTE_COLORS_MAX;
+        for( int i = 0; i < VIDEO_PALETTE_COLORS_MAX; i++ )
+            for( int j = 0; j < 4; j++ )
+            {
+                i_seed = i_seed * 1103515245 + 12345;
+                p_sys->palette.palette[i][j] = i_seed >> 16;
+            }
+        p_pic->format.p_palette = &p_sys->palette;
+    }
+    return p_pic;
+}
+
 static int blendbench_LoadImage( vlc_object_t *p_this, picture_t **pp_pic,
                                  vlc_fourcc_t i_chroma, char *psz_file, const char *psz_name )
 {
@@ -174,13 +247,29 @@ static int Create( vlc_object_t *p_this )
                                                   CFG_PREFIX "loops" );
     p_sys->i_alpha = var_CreateGetIntegerCommand( p_filter,
                                                   CFG_PREFIX "alpha" );
+    p_sys->b_compare = var_CreateGetBool( p_filter, CFG_PREFIX "compare" );
+    p_sys->b_all = var_CreateGetBool( p_filter, CFG_PREFIX "all" );
+    p_sys->i_width = var_CreateGetInteger( p_filter, CFG_PREFIX "width" );
+    p_sys->i_height = var_CreateGetInteger( p_filter, CFG_PREFIX "height" );
+    p_sys->p_base_image = NULL;
+    p_sys->p_blend_image = NULL;
+
+    /* Images are generated for each combination in Filter() */
+    if( p_sys->b_all )
+        return VLC_SUCCESS;
 
     psz_temp = var_CreateGetStringCommand( p_filter, CFG_PREFIX "base-chroma" );
     p_sys->i_base_chroma = VLC_FOURCC( psz_temp[0], psz_temp[1],
                                        psz_temp[2], psz_temp[3] );
     psz_cmd = var_CreateGetStringCommand( p_filter, CFG_PREFIX "base-image" );
-    i_ret = blendbench_LoadImage( p_this, &p_sys->p_base_image,
-                                  p_sys->i_base_chroma, psz_cmd, "Base" );
+    if( psz_cmd != NULL && *psz_cmd )
+        i_ret = blendbench_LoadImage( p_this, &p_sys->p_base_image,
+                                      p_sys->i_base_chroma, psz_cmd, "Base" );
+    else if( (p_sys->p_base_image = blendbench_NewImage( p_sys,
+                                        p_sys->i_base_chroma, 1 )) != NULL )
+        i_ret = VLC_SUCCESS;
+    else
+        i_ret = VLC_ENOMEM;
     free( psz_temp );
     free( psz_cmd );
     if( i_ret != VLC_SUCCESS )
@@ -194,10 +283,22 @@ static int Create( vlc_object_t *p_this )
     p_sys->i_blend_chroma = VLC_FOURCC( psz_temp[0], psz_temp[1],
                                         psz_temp[2], psz_temp[3] );
     psz_cmd = var_CreateGetStringCommand( p_filter, CFG_PREFIX "blend-image" );
-    blendbench_LoadImage( p_this, &p_sys->p_blend_image, p_sys->i_blend_chroma,
-                          psz_cmd, "Blend" );
+    if( psz_cmd != NULL && *psz_cmd )
+        i_ret = blendbench_LoadImage( p_this, &p_sys->p_blend_image,
+                                      p_sys->i_blend_chroma, psz_cmd, "Blend" );
+    else if( (p_sys->p_blend_image = blendbench_NewImage( p_sys,
+                                        p_sys->i_blend_chroma, 2 )) != NULL )
+        i_ret = VLC_SUCCESS;
+    else
+        i_ret = VLC_ENOMEM;
     free( psz_temp );
     free( psz_cmd );
+    if( i_ret != VLC_SUCCESS )
+    {
+        picture_Release( p_sys->p_base_image );
+        free( p_sys );
+        return i_ret;
+    }
 
     return VLC_SUCCESS;
 }
@@ -210,57 +311,153 @@ static void Destroy( vlc_object_t *p_this )
     filter_t *p_filter = (filter_t *)p_this;
     filter_sys_t *p_sys = p_filter->p_sys;
 
-    picture_Release( p_sys->p_base_image );
-    picture_Release( p_sys->p_blend_image );
+    if( p_sys->p_base_image != NULL )
+        picture_Release( p_sys->p_base_image );
+    if( p_sys->p_blend_image != NULL )
+        picture_Release( p_sys->p_blend_image );
+    free( p_sys );
 }
 
 /*****************************************************************************
- * Render: displays previously rendered output
+ * Benchmark: blends the images onto a copy of the base image
+ *****************************************************************************
+ * Returns the time spent, or -1 on error. The blended copy is returned in
+ * *pp_result.
  *****************************************************************************/
-static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
+static mtime_t blendbench_Run( filter_t *p_filter, picture_t *p_base,
+                               picture_t *p_blend, bool b_simd,
+                               picture_t **pp_result )
 {
     filter_sys_t *p_sys = p_filter->p_sys;
-    filter_t *p_blend;
+    filter_t *p_blend_filter;
 
-    if( p_sys->b_done )
-        return p_pic;
+    picture_t *p_dst = picture_NewFromFormat( &p_base->format );
+    if( !p_dst )
+        return -1;
+    picture_Copy( p_dst, p_base );
 
-    p_blend = vlc_object_create( p_filter, sizeof(filter_t) );
-    if( !p_blend )
+    p_blend_filter = vlc_object_create( p_filter, sizeof(filter_t) );
+    if( !p_blend_filter )
     {
-        picture_Release( p_pic );
-        return NULL;
+        picture_Release( p_dst );
+        return -1;
     }
-    p_blend->fmt_out.video = p_sys->p_base_image->format;
-    p_blend->fmt_in.video = p_sys->p_blend_image->format;
-    p_blend->p_module = module_need( p_blend, "video blending", NULL, false );
-    if( !p_blend->p_module )
+    var_Create( p_blend_filter, "blend-simd", VLC_VAR_BOOL );
+    var_SetBool( p_blend_filter, "blend-simd", b_simd );
+    p_blend_filter->fmt_out.video = p_base->format;
+    p_blend_filter->fmt_in.video = p_blend->format;
+    p_blend_filter->p_module = module_need( p_blend_filter, "video blending",
+                                            NULL, false );
+    if( !p_blend_filter->p_module )
     {
-        picture_Release( p_pic );
-        vlc_object_release( p_blend );
-        return NULL;
+        picture_Release( p_dst );
+        vlc_object_release( p_blend_filter );
+        return -1;
     }
 
     mtime_t time = mdate();
     for( int i_iter = 0; i_iter < p_sys->i_loops; ++i_iter )
     {
-        p_blend->pf_video_blend( p_blend,
-                                 p_sys->p_base_image, p_sys->p_blend_image,
-                                 0, 0, p_sys->i_alpha );
+        p_blend_filter->pf_video_blend( p_blend_filter, p_dst, p_blend,
+                                        0, 0, p_sys->i_alpha );
     }
     time = mdate() - time;
 
-    msg_Info( p_filter, "Blended %d images in %f sec", p_sys->i_loops,
-              time / 1000000.0f );
-    msg_Info( p_filter, "Speed is: %f images/second, %f pixels/second",
-              (float) p_sys->i_loops / time * 1000000,
-              (float) p_sys->i_loops / time * 1000000 *
-                  p_sys->p_blend_image->p[Y_PLANE].i_visible_pitch *
-                  p_sys->p_blend_image->p[Y_PLANE].i_visible_lines );
+    module_unneed( p_blend_filter, p_blend_filter->p_module );
+    vlc_object_release( p_blend_filter );
+
+    *pp_result = p_dst;
+    return time > 0 ? time : 1;
+}
+
+static bool blendbench_Equal( const picture_t *p_a, const picture_t *p_b )
+{
+    for( int i = 0; i < p_a->i_planes; i++ )
+    {
+        const plane_t *a = &p_a->p[i], *b = &p_b->p[i];
+
+        for( int y = 0; y < a->i_visible_lines; y++ )
+            if( memcmp( &a->p_pixels[y * a->i_pitch],
+                        &b->p_pixels[y * b->i_pitch], a->i_visible_pitch ) )
+                return false;
+    }
+    return true;
+}
+
+static void blendbench_Compare( filter_t *p_filter, picture_t *p_base,
+                                picture_t *p_blend )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    const vlc_fourcc_t i_base = p_base->format.i_chroma;
+    const vlc_fourcc_t i_blend = p_blend->format.i_chroma;
+    const double f_pixels = (double)p_sys->i_loops
+        * p_blend->format.i_visible_width * p_blend->format.i_visible_height;
+    picture_t *p_simd, *p_generic = NULL;
+
+    mtime_t i_simd = blendbench_Run( p_filter, p_base, p_blend, true,
+                                     &p_simd );
+    if( i_simd < 0 )
+    {
+        msg_Err( p_filter, "cannot blend %4.4s onto %4.4s",
+                 (const char *)&i_blend, (const char *)&i_base );
+        return;
+    }
+    msg_Info( p_filter, "%4.4s -> %4.4s: %d blends in %f sec, "
+              "%.1f Mpixels/s", (const char *)&i_blend,
+              (const char *)&i_base, p_sys->i_loops, i_simd / 1000000.0,
+              f_pixels / i_simd );
 
-    module_unneed( p_blend, p_blend->p_module );
+    if( p_sys->b_compare )
+    {
+        mtime_t i_generic = blendbench_Run( p_filter, p_base, p_blend, false,
+                                            &p_generic );
+        if( i_generic > 0 )
+        {
+            msg_Info( p_filter, "%4.4s -> %4.4s: generic code %.1f Mpixels/s,"
+                      " speed up x%.2f", (const char *)&i_blend,
+                      (const char *)&i_base, f_pixels / i_generic,
+                      (double)i_generic / i_simd );
+            if( !blendbench_Equal( p_simd, p_generic ) )
+                msg_Err( p_filter, "%4.4s -> %4.4s: results differ",
+                         (const char *)&i_blend, (const char *)&i_base );
+            picture_Release( p_generic );
+        }
+    }
+    picture_Release( p_simd );
+}
 
-    vlc_object_release( p_blend );
+/*****************************************************************************
+ * Render: displays previously rendered output
+ *****************************************************************************/
+static picture_t *Filter( filter_t *p_filter, picture_t *p_pic )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    if( p_sys->b_done )
+        return p_pic;
+
+    if( !p_sys->b_all )
+    {
+        blendbench_Compare( p_filter, p_sys->p_base_image,
+                            p_sys->p_blend_image );
+        p_sys->b_done = true;
+        return p_pic;
+    }
+
+    for( size_t i = 0; i < sizeof(p_combinations) / sizeof(p_combinations[0]); i++ )
+    {
+        picture_t *p_base = blendbench_NewImage( p_sys,
+                                        p_combinations[i].i_base, 1 );
+        picture_t *p_blend = blendbench_NewImage( p_sys,
+                                        p_combinations[i].i_blend, 2 );
+
+        if( p_base != NULL && p_blend != NULL )
+            blendbench_Compare( p_filter, p_base, p_blend );
+        if( p_base != NULL )
+            picture_Release( p_base );
+        if( p_blend != NULL )
+            picture_Release( p_blend );
+    }
 
     p_sys->b_done = true;
     return p_pic;
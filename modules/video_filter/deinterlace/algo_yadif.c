@@ -47,6 +47,82 @@
    Necessary preprocessor macros are defined in common.h. */
 #include "yadif.h"
 
+/* Parameters of a field, shared by its slices */
+struct yadif_slice
+{
+    picture_t *p_dst;
+    picture_t *p_prev, *p_cur, *p_next;
+    int i_field;
+    int i_parity;
+    void (*pf_filter)(uint8_t *dst, uint8_t *prev, uint8_t *cur, uint8_t *next,
+                      int w, int prefs, int mrefs, int parity, int mode);
+};
+
+/* Renders the line y of a plane into the dst line */
+static void YadifLine( const struct yadif_slice *p_slice, int n,
+                       uint8_t *p_line, int y )
+{
+    const plane_t *prevp = &p_slice->p_prev->p[n];
+    const plane_t *curp  = &p_slice->p_cur->p[n];
+    const plane_t *nextp = &p_slice->p_next->p[n];
+    const plane_t *dstp  = &p_slice->p_dst->p[n];
+
+    if( (y % 2) == p_slice->i_field  ||  p_slice->i_parity == 2 )
+    {
+        memcpy( p_line, &curp->p_pixels[y * curp->i_pitch],
+                dstp->i_visible_pitch );
+    }
+    else
+    {
+        int mode;
+        /* Spatial checks only when enough data */
+        mode = (y >= 2 && y < dstp->i_visible_lines - 2) ? 0 : 2;
+
+        assert( prevp->i_pitch == curp->i_pitch && curp->i_pitch == nextp->i_pitch );
+        p_slice->pf_filter( p_line,
+                            &prevp->p_pixels[y * prevp->i_pitch],
+                            &curp->p_pixels[y * curp->i_pitch],
+                            &nextp->p_pixels[y * nextp->i_pitch],
+                            dstp->i_visible_pitch,
+                            y < dstp->i_visible_lines - 2  ? curp->i_pitch : -curp->i_pitch,
+                            y  - 1  ?  -curp->i_pitch : curp->i_pitch,
+                            p_slice->i_parity,
+                            mode );
+    }
+}
+
+/* Renders the lines [i_start, i_end) of the first plane, and the matching
+ * lines of the other planes */
+static void YadifSlice( filter_t *p_filter, void *p_opaque, unsigned i_slice,
+                        unsigned i_start, unsigned i_end )
+{
+    const struct yadif_slice *p_slice = p_opaque;
+    picture_t *p_dst = p_slice->p_dst;
+    const unsigned i_lines = p_dst->p[0].i_visible_lines;
+
+    VLC_UNUSED(p_filter); VLC_UNUSED(i_slice);
+
+    for( int n = 0; n < p_dst->i_planes; n++ )
+    {
+        plane_t *dstp = &p_dst->p[n];
+        int y0 = (uint64_t)i_start * dstp->i_visible_lines / i_lines;
+        int y1 = (uint64_t)i_end * dstp->i_visible_lines / i_lines;
+
+        for( int y = y0; y < y1; y++ )
+        {
+            /* We duplicate the first and last lines */
+            int y_src = VLC_CLIP( y, 1, dstp->i_visible_lines - 2 );
+
+            YadifLine( p_slice, n, &dstp->p_pixels[y * dstp->i_pitch], y_src );
+        }
+    }
+#if defined(HAVE_YADIF_MMX)
+    /* Leave MMX mode, the worker thread may use the FPU next */
+    if( p_slice->pf_filter == yadif_filter_line_mmx )
+        __asm__ __volatile__( "emms" :: );
+#endif
+}
+
 int RenderYadif( filter_t *p_filter, picture_t *p_dst, picture_t *p_src,
                  int i_order, int i_field )
 {
@@ -128,49 +204,15 @@ int RenderYadif( filter_t *p_filter, picture_t *p_dst, picture_t *p_src,
         if( p_sys->chroma->pixel_size == 2 )
             filter = yadif_filter_line_c_16bit;
 
-        for( int n = 0; n < p_dst->i_planes; n++ )
-        {
-            const plane_t *prevp = &p_prev->p[n];
-            const plane_t *curp  = &p_cur->p[n];
-            const plane_t *nextp = &p_next->p[n];
-            plane_t *dstp        = &p_dst->p[n];
-
-            for( int y = 1; y < dstp->i_visible_lines - 1; y++ )
-            {
-                if( (y % 2) == i_field  ||  yadif_parity == 2 )
-                {
-                    memcpy( &dstp->p_pixels[y * dstp->i_pitch],
-                                &curp->p_pixels[y * curp->i_pitch], dstp->i_visible_pitch );
-                }
-                else
-                {
-                    int mode;
-                    /* Spatial checks only when enough data */
-                    mode = (y >= 2 && y < dstp->i_visible_lines - 2) ? 0 : 2;
-
-                    assert( prevp->i_pitch == curp->i_pitch && curp->i_pitch == nextp->i_pitch );
-                    filter( &dstp->p_pixels[y * dstp->i_pitch],
-                            &prevp->p_pixels[y * prevp->i_pitch],
-                            &curp->p_pixels[y * curp->i_pitch],
-                            &nextp->p_pixels[y * nextp->i_pitch],
-                            dstp->i_visible_pitch,
-                            y < dstp->i_visible_lines - 2  ? curp->i_pitch : -curp->i_pitch,
-                            y  - 1  ?  -curp->i_pitch : curp->i_pitch,
-                            yadif_parity,
-                            mode );
-                }
-
-                /* We duplicate the first and last lines */
-                if( y == 1 )
-                    memcpy(&dstp->p_pixels[(y-1) * dstp->i_pitch],
-                               &dstp->p_pixels[ y    * dstp->i_pitch],
-                               dstp->i_pitch);
-                else if( y == dstp->i_visible_lines - 2 )
-                    memcpy(&dstp->p_pixels[(y+1) * dstp->i_pitch],
-                               &dstp->p_pixels[ y    * dstp->i_pitch],
-                               dstp->i_pitch);
-            }
-        }
+        struct yadif_slice slice = {
+            .p_dst = p_dst,
+            .p_prev = p_prev, .p_cur = p_cur, .p_next = p_next,
+            .i_field = i_field,
+            .i_parity = yadif_parity,
+            .pf_filter = filter,
+        };
+        filter_RunSlices( p_filter, p_dst->p[0].i_visible_lines,
+                          YadifSlice, &slice );
 
         p_sys->i_frame_offset = 1; /* p_cur will be rendered at next frame, too */
 
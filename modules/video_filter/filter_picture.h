@@ -142,6 +142,21 @@ static inline void rgb_to_yuv( uint8_t *y, uint8_t *u, uint8_t *v,
     *v =   ( ( 112 * r -  94 * g -  18 * b + 128 ) >> 8 ) + 128 ;
 }
 
+/**
+ * Converts a slice from filter_RunSlices(), counted in lines of the first
+ * plane, to the matching lines of another plane of the picture.
+ */
+static inline void plane_SliceLines( const picture_t *p_pic, int i_plane,
+                                     unsigned i_start, unsigned i_end,
+                                     unsigned *pi_start, unsigned *pi_end )
+{
+    const unsigned i_lines = p_pic->p[0].i_visible_lines;
+    const unsigned i_plane_lines = p_pic->p[i_plane].i_visible_lines;
+
+    *pi_start = (uint64_t)i_start * i_plane_lines / i_lines;
+    *pi_end = (uint64_t)i_end * i_plane_lines / i_lines;
+}
+
 /*****************************************************************************
  *
  *****************************************************************************/
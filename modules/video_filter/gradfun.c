@@ -106,6 +106,8 @@ struct filter_sys_t {
     int              radius;
     const vlc_chroma_description_t *chroma;
     struct vf_priv_s cfg;
+    uint16_t         *scratch;      /* buffers of the slices */
+    size_t           scratch_size;  /* elements per slice */
 };
 
 static int Open(vlc_object_t *object)
@@ -123,18 +125,28 @@ static int Open(vlc_object_t *object)
     if (!sys)
         return VLC_ENOMEM;
 
+    /* One buffer per slice, 16 bytes aligned as scratch_size is a
+     * multiple of 8 */
+    sys->scratch_size = filter_plane_buf_size(filter->fmt_in.video.i_width,
+                                              RADIUS_MAX);
+    sys->scratch = vlc_memalign(16, filter_GetSliceCount(filter,
+                                                         filter->fmt_in.video.i_height)
+                                    * sys->scratch_size * sizeof(*sys->scratch));
+    if (!sys->scratch) {
+        free(sys);
+        return VLC_ENOMEM;
+    }
+
     vlc_mutex_init(&sys->lock);
     sys->chroma   = chroma;
     sys->strength = var_CreateGetFloatCommand(filter,   CFG_PREFIX "strength");
     sys->radius   = var_CreateGetIntegerCommand(filter, CFG_PREFIX "radius");
     var_AddCallback(filter, CFG_PREFIX "strength", Callback, NULL);
     var_AddCallback(filter, CFG_PREFIX "radius",   Callback, NULL);
-    sys->cfg.buf = NULL;
 
     struct vf_priv_s *cfg = &sys->cfg;
     cfg->thresh      = 0.0;
     cfg->radius      = 0;
-    cfg->buf         = NULL;
 
 #if HAVE_SSE2 && HAVE_6REGS
     if (vlc_CPU_SSE2())
@@ -166,11 +178,52 @@ static void Close(vlc_object_t *object)
 
     var_DelCallback(filter, CFG_PREFIX "radius",   Callback, NULL);
     var_DelCallback(filter, CFG_PREFIX "strength", Callback, NULL);
-    vlc_free(sys->cfg.buf);
     vlc_mutex_destroy(&sys->lock);
+    vlc_free(sys->scratch);
     free(sys);
 }
 
+struct gradfun_slice {
+    picture_t *src;
+    picture_t *dst;
+};
+
+/* Filters the lines [y0, y1) of the first plane, and the matching lines of
+ * the other planes */
+static void Slice(filter_t *filter, void *opaque, unsigned index,
+                  unsigned y0, unsigned y1)
+{
+    filter_sys_t *sys = filter->p_sys;
+    const struct gradfun_slice *slice = opaque;
+    const video_format_t *fmt = &filter->fmt_in.video;
+    const vlc_chroma_description_t *chroma = sys->chroma;
+    struct vf_priv_s *cfg = &sys->cfg;
+
+    uint16_t *scratch = &sys->scratch[index * sys->scratch_size];
+
+    for (int i = 0; i < slice->dst->i_planes; i++) {
+        const plane_t *srcp = &slice->src->p[i];
+        plane_t       *dstp = &slice->dst->p[i];
+
+        int w = fmt->i_width  * chroma->p[i].w.num / chroma->p[i].w.den;
+        int h = fmt->i_height * chroma->p[i].h.num / chroma->p[i].h.den;
+        int r = (cfg->radius  * chroma->p[i].w.num / chroma->p[i].w.den +
+                 cfg->radius  * chroma->p[i].h.num / chroma->p[i].h.den) / 2;
+        r = VLC_CLIP((r + 1) & ~1, RADIUS_MIN, RADIUS_MAX);
+        int ys = (uint64_t)y0 * h / fmt->i_height;
+        int ye = (uint64_t)y1 * h / fmt->i_height;
+
+        if (__MIN(w, h) > 2 * r) {
+            filter_plane(cfg, scratch, dstp->p_pixels, srcp->p_pixels,
+                         w, h, dstp->i_pitch, srcp->i_pitch, r, ys, ye);
+        } else {
+            for (int y = ys; y < ye; y++)
+                memcpy(&dstp->p_pixels[y * dstp->i_pitch],
+                       &srcp->p_pixels[y * srcp->i_pitch], dstp->i_visible_pitch);
+        }
+    }
+}
+
 static picture_t *Filter(filter_t *filter, picture_t *src)
 {
     filter_sys_t *sys = filter->p_sys;
@@ -186,33 +239,13 @@ static picture_t *Filter(filter_t *filter, picture_t *src)
     int   radius   = VLC_CLIP((sys->radius + 1) & ~1, RADIUS_MIN, RADIUS_MAX);
     vlc_mutex_unlock(&sys->lock);
 
-    const video_format_t *fmt = &filter->fmt_in.video;
     struct vf_priv_s *cfg = &sys->cfg;
 
     cfg->thresh = (1 << 15) / strength;
-    if (cfg->radius != radius) {
-        cfg->radius = radius;
-        cfg->buf    = vlc_memalign(16,
-                                   (((fmt->i_width + 15) & ~15) * (cfg->radius + 1) / 2 + 32) * sizeof(*cfg->buf));
-    }
-
-    for (int i = 0; i < dst->i_planes; i++) {
-        const plane_t *srcp = &src->p[i];
-        plane_t       *dstp = &dst->p[i];
+    cfg->radius = radius;
 
-        const vlc_chroma_description_t *chroma = sys->chroma;
-        int w = fmt->i_width  * chroma->p[i].w.num / chroma->p[i].w.den;
-        int h = fmt->i_height * chroma->p[i].h.num / chroma->p[i].h.den;
-        int r = (cfg->radius  * chroma->p[i].w.num / chroma->p[i].w.den +
-                 cfg->radius  * chroma->p[i].h.num / chroma->p[i].h.den) / 2;
-        r = VLC_CLIP((r + 1) & ~1, RADIUS_MIN, RADIUS_MAX);
-        if (__MIN(w, h) > 2 * r && cfg->buf) {
-            filter_plane(cfg, dstp->p_pixels, srcp->p_pixels,
-                         w, h, dstp->i_pitch, srcp->i_pitch, r);
-        } else {
-            plane_CopyPixels(dstp, srcp);
-        }
-    }
+    struct gradfun_slice slice = { .src = src, .dst = dst };
+    filter_RunSlices(filter, filter->fmt_in.video.i_height, Slice, &slice);
 
     picture_CopyProperties(dst, src);
     picture_Release(src);
@@ -31,7 +31,6 @@
 struct vf_priv_s {
     int thresh;
     int radius;
-    uint16_t *buf;
     void (*filter_line)(uint8_t *dst, uint8_t *src, uint16_t *dc,
                         int width, int thresh, const uint16_t *dithers);
     void (*blur_line)(uint16_t *dc, uint16_t *buf, uint16_t *buf1,
@@ -223,26 +222,52 @@ static void blur_line_sse2(uint16_t *dc, uint16_t *buf, uint16_t *buf1,
 }
 #endif // HAVE_6REGS && HAVE_SSE2
 
-static void filter_plane(struct vf_priv_s *ctx, uint8_t *dst, uint8_t *src,
-                         int width, int height, int dstride, int sstride, int r)
+/* Scratch memory of filter_plane(), in elements */
+static size_t filter_plane_buf_size(int width, int r)
+{
+    int bstride = ((width+15)&~15)/2;
+    return 32 + (r+2)*bstride;
+}
+
+/* Filters the lines [y0, y1) of a plane. The vertical blur only depends on
+ * the r/2 line pairs around each line, so that slices of a plane can be
+ * filtered independently, with their own buffer: each slice first warms
+ * the blur up from the line pairs preceding it. */
+static void filter_plane(struct vf_priv_s *ctx, uint16_t *scratch,
+                         uint8_t *dst, uint8_t *src,
+                         int width, int height, int dstride, int sstride, int r,
+                         int y0, int y1)
 {
     int bstride = ((width+15)&~15)/2;
-    int y;
     uint32_t dc_factor = (1<<21)/(r*r);
-    uint16_t *dc = ctx->buf+16;
-    uint16_t *buf = ctx->buf+bstride+32;
+    uint16_t *dc = scratch+16;
+    uint16_t *zero = dc+bstride+16;
+    uint16_t *buf = zero+bstride;
     int thresh = ctx->thresh;
+    /* The blur is updated every other line, from line r to ylast */
+    int ylast = (height-r-1) & ~1;
+    int k = -1; /* last blurred line pair */
 
     memset(dc, 0, (bstride+16)*sizeof(*buf));
-    for (y=0; y<r; y++)
-        ctx->blur_line(dc, buf+y*bstride, buf+(y-1)*bstride, src+2*y*sstride, sstride, width/2);
-    for (;;) {
-        if (y < height-r) {
-            int mod = ((y+r)/2)%r;
-            uint16_t *buf0 = buf+mod*bstride;
-            uint16_t *buf1 = buf+(mod?mod-1:r-1)*bstride;
+    memset(zero, 0, bstride*sizeof(*buf));
+
+    for (int y = y0; y < y1; y++) {
+        int yb = VLC_CLIP(y & ~1, r, ylast);
+        int kb = (yb+r)/2;
+
+        if (k < 0) {
+            /* Warm up: running sums of the r line pairs before kb */
+            for (k = kb-r; k < kb; k++)
+                ctx->blur_line(dc, buf+(k%r)*bstride,
+                               k > kb-r ? buf+((k-1)%r)*bstride : zero,
+                               src+2*k*sstride, sstride, width/2);
+            k--;
+        }
+        while (k < kb) {
             int x, v;
-            ctx->blur_line(dc, buf0, buf1, src+(y+r)*sstride, sstride, width/2);
+            k++;
+            ctx->blur_line(dc, buf+(k%r)*bstride, buf+((k-1)%r)*bstride,
+                           src+2*k*sstride, sstride, width/2);
             for (x=v=0; x<r; x++)
                 v += dc[x];
             for (; x<width/2; x++) {
@@ -254,14 +279,6 @@ static void filter_plane(struct vf_priv_s *ctx, uint8_t *dst, uint8_t *src,
             for (x=-r/2; x<0; x++)
                 dc[x] = dc[0];
         }
-        if (y == r) {
-            for (y=0; y<r; y++)
-                ctx->filter_line(dst+y*dstride, src+y*sstride, dc-r/2, width, thresh, dither[y&7]);
-        }
         ctx->filter_line(dst+y*dstride, src+y*sstride, dc-r/2, width, thresh, dither[y&7]);
-        if (++y >= height) break;
-        ctx->filter_line(dst+y*dstride, src+y*sstride, dc-r/2, width, thresh, dither[y&7]);
-        if (++y >= height) break;
     }
 }
-
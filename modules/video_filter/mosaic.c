@@ -37,10 +37,13 @@
 
 #include <vlc_filter.h>
 #include <vlc_image.h>
+#include <vlc_threadpool.h>
 
 #include "mosaic.h"
 
 #define BLANK_DELAY INT64_C(1000000)
+#define STATS_PERIOD INT64_C(10000000)
+#define CANVAS_COUNT 3
 
 /*****************************************************************************
  * Local prototypes
@@ -52,6 +55,23 @@ static subpicture_t *Filter ( filter_t *, mtime_t );
 static int MosaicCallback   ( vlc_object_t *, char const *, vlc_value_t,
                               vlc_value_t, void * );
 
+/*****************************************************************************
+ * mosaic_tile_t : element of the persistent canvas
+ *****************************************************************************/
+typedef struct
+{
+    image_handler_t *p_image; /* Not shared: tiles are scaled concurrently */
+    picture_t *p_source;      /* Last bridged picture scaled */
+    picture_t *p_scaled;      /* Scaled YUVA picture */
+    picture_t *p_new;         /* Bridged picture to scale */
+    video_format_t fmt_out;   /* Size to scale to */
+
+    int i_x, i_y;             /* Position in the canvas */
+    int i_alpha;              /* Its transparency, times the mosaic one */
+    bool b_visible;
+    unsigned i_gen;           /* Generation of its last scaled picture */
+} mosaic_tile_t;
+
 /*****************************************************************************
  * filter_sys_t : filter descriptor
  *****************************************************************************/
@@ -79,6 +99,17 @@ struct filter_sys_t
     int i_offsets_length;
 
     mtime_t i_delay;
+
+    /* Persistent canvas */
+    bool b_canvas;
+    picture_t *pp_canvas[CANVAS_COUNT]; /* Also held by the SPU shown */
+    unsigned pi_canvas_gen[CANVAS_COUNT]; /* Generation each is drawn at */
+    unsigned i_gen;           /* Generation of the current composition */
+    unsigned i_layout_gen;    /* Generation of the last layout change */
+    mosaic_tile_t *p_tiles;   /* Indexed like the bridged ES */
+    int i_tiles;
+    vlc_threadpool_t *p_pool;
+    mtime_t i_next_stats;
 };
 
 /*****************************************************************************
@@ -157,6 +188,18 @@ struct filter_sys_t
         "according to this value (in milliseconds). For high " \
         "values you will need to raise caching at input.")
 
+#define CANVAS_TEXT N_("Persistent canvas")
+#define CANVAS_LONGTEXT N_( \
+        "Compose the elements in a single picture kept from one frame to " \
+        "the next. Only the elements with a new picture are scaled again, " \
+        "in parallel. Positions are relative to the top left corner of the " \
+        "mosaic, which is aligned as a whole." )
+
+#define THREADS_TEXT N_("Threads")
+#define THREADS_LONGTEXT N_( \
+        "Number of threads scaling the elements of the persistent canvas " \
+        "(0 for the number of CPUs)." )
+
 enum
 {
     position_auto = 0, position_fixed = 1, position_offsets = 2
@@ -223,13 +266,18 @@ vlc_module_begin ()
 
     add_integer( CFG_PREFIX "delay", 0, DELAY_TEXT, DELAY_LONGTEXT,
                  false )
+
+    add_bool( CFG_PREFIX "canvas", false, CANVAS_TEXT, CANVAS_LONGTEXT,
+              true )
+    add_integer_with_range( CFG_PREFIX "threads", 0, 0, 64,
+                            THREADS_TEXT, THREADS_LONGTEXT, true )
 vlc_module_end ()
 
 static const char *const ppsz_filter_options[] = {
     "alpha", "height", "width", "align", "xoffset", "yoffset",
     "borderw", "borderh", "position", "rows", "cols",
     "keep-aspect-ratio", "keep-picture", "order", "offsets",
-    "delay", NULL
+    "delay", "canvas", "threads", NULL
 };
 
 /*****************************************************************************
@@ -367,6 +415,22 @@ static int CreateFilter( vlc_object_t *p_this )
     free( psz_offsets );
     var_AddCallback( p_filter, CFG_PREFIX "offsets", MosaicCallback, p_sys );
 
+    p_sys->b_canvas = var_CreateGetBool( p_filter, CFG_PREFIX "canvas" );
+    for( int i = 0; i < CANVAS_COUNT; i++ )
+        p_sys->pp_canvas[i] = NULL;
+    p_sys->i_gen = p_sys->i_layout_gen = 0;
+    p_sys->p_tiles = NULL;
+    p_sys->i_tiles = 0;
+    p_sys->p_pool = NULL;
+    p_sys->i_next_stats = 0;
+    if( p_sys->b_canvas )
+    {
+        unsigned i_threads = var_CreateGetInteger( p_filter,
+                                                   CFG_PREFIX "threads" );
+        if( i_threads != 1 )
+            p_sys->p_pool = vlc_threadpool_create( i_threads );
+    }
+
     vlc_mutex_unlock( &p_sys->lock );
 
     return VLC_SUCCESS;
@@ -421,10 +485,561 @@ static void DestroyFilter( vlc_object_t *p_this )
         p_sys->i_offsets_length = 0;
     }
 
+    if( p_sys->p_pool )
+        vlc_threadpool_destroy( p_sys->p_pool );
+    for( int i = 0; i < p_sys->i_tiles; i++ )
+    {
+        mosaic_tile_t *p_tile = &p_sys->p_tiles[i];
+
+        if( p_tile->p_image )
+            image_HandlerDelete( p_tile->p_image );
+        if( p_tile->p_source )
+            picture_Release( p_tile->p_source );
+        if( p_tile->p_scaled )
+            picture_Release( p_tile->p_scaled );
+    }
+    free( p_sys->p_tiles );
+    for( int i = 0; i < CANVAS_COUNT; i++ )
+        if( p_sys->pp_canvas[i] )
+            picture_Release( p_sys->pp_canvas[i] );
+
     vlc_mutex_destroy( &p_sys->lock );
     free( p_sys );
 }
 
+/*****************************************************************************
+ * mosaic_Dequeue: skip the late pictures of a bridged ES
+ *****************************************************************************/
+static picture_t *mosaic_Dequeue( filter_t *p_filter, bridged_es_t *p_es,
+                                  mtime_t date )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    while ( p_es->p_picture != NULL
+             && p_es->p_picture->date + p_sys->i_delay < date )
+    {
+        if ( p_es->p_picture->p_next != NULL )
+        {
+            picture_t *p_next = p_es->p_picture->p_next;
+            picture_Release( p_es->p_picture );
+            p_es->p_picture = p_next;
+            p_es->i_dropped++;
+        }
+        else if ( p_es->p_picture->date + p_sys->i_delay + BLANK_DELAY <
+                    date )
+        {
+            /* Display blank */
+            picture_Release( p_es->p_picture );
+            p_es->p_picture = NULL;
+            p_es->pp_last = &p_es->p_picture;
+            break;
+        }
+        else
+        {
+            msg_Dbg( p_filter, "too late picture for %s (%"PRId64 ")",
+                     p_es->psz_id,
+                     date - p_es->p_picture->date - p_sys->i_delay );
+            break;
+        }
+    }
+    return p_es->p_picture;
+}
+
+/*****************************************************************************
+ * mosaic_GetIndex: index of a bridged ES in the mosaic
+ *****************************************************************************/
+static int mosaic_GetIndex( filter_sys_t *p_sys, const bridged_es_t *p_es,
+                            int *pi_real_index, int *pi_greatest_used )
+{
+    if ( p_sys->i_order_length == 0 )
+        return ++*pi_real_index;
+
+    for ( int i = 0; i < p_sys->i_order_length; i++ )
+        if ( strcmp( p_es->psz_id, p_sys->ppsz_order[i] ) == 0 )
+            return *pi_real_index = i;
+
+    return *pi_real_index = ++*pi_greatest_used;
+}
+
+/*****************************************************************************
+ * mosaic_GetSize: size of a scaled picture
+ *****************************************************************************/
+static void mosaic_GetSize( filter_sys_t *p_sys, const video_format_t *p_in,
+                            unsigned col_inner_width,
+                            unsigned row_inner_height,
+                            video_format_t *p_out )
+{
+    p_out->i_width = col_inner_width;
+    p_out->i_height = row_inner_height;
+
+    if( p_sys->b_ar ) /* keep aspect ratio */
+    {
+        if( (float)p_out->i_width / (float)p_out->i_height
+              > (float)p_in->i_width / (float)p_in->i_height )
+        {
+            p_out->i_width = ( p_out->i_height * p_in->i_width )
+                                 / p_in->i_height;
+        }
+        else
+        {
+            p_out->i_height = ( p_out->i_width * p_in->i_height )
+                                / p_in->i_width;
+        }
+    }
+
+    p_out->i_visible_width = p_out->i_width;
+    p_out->i_visible_height = p_out->i_height;
+}
+
+/*****************************************************************************
+ * mosaic_GetPosition: position of a picture in the background video
+ *****************************************************************************/
+static void mosaic_GetPosition( filter_sys_t *p_sys, const bridged_es_t *p_es,
+                                int i_real_index, const video_format_t *p_fmt,
+                                unsigned col_inner_width,
+                                unsigned row_inner_height,
+                                int *pi_x, int *pi_y )
+{
+    int i_row = ( i_real_index / p_sys->i_cols ) % p_sys->i_rows;
+    int i_col = i_real_index % p_sys->i_cols ;
+
+    if( p_es->i_x >= 0 && p_es->i_y >= 0 )
+    {
+        *pi_x = p_es->i_x;
+        *pi_y = p_es->i_y;
+        return;
+    }
+
+    if( p_sys->i_position == position_offsets )
+    {
+        *pi_x = p_sys->pi_x_offsets[i_real_index];
+        *pi_y = p_sys->pi_y_offsets[i_real_index];
+        return;
+    }
+
+    if( p_fmt->i_width > col_inner_width ||
+        p_sys->b_ar || p_sys->b_keep )
+    {
+        /* we don't have to center the video since it takes the
+        whole rectangle area or it's larger than the rectangle */
+        *pi_x = p_sys->i_xoffset
+                    + i_col * ( p_sys->i_width / p_sys->i_cols )
+                    + ( i_col * p_sys->i_borderw ) / p_sys->i_cols;
+    }
+    else
+    {
+        /* center the video in the dedicated rectangle */
+        *pi_x = p_sys->i_xoffset
+                + i_col * ( p_sys->i_width / p_sys->i_cols )
+                + ( i_col * p_sys->i_borderw ) / p_sys->i_cols
+                + ( col_inner_width - p_fmt->i_width ) / 2;
+    }
+
+    if( p_fmt->i_height > row_inner_height
+        || p_sys->b_ar || p_sys->b_keep )
+    {
+        /* we don't have to center the video since it takes the
+        whole rectangle area or it's taller than the rectangle */
+        *pi_y = p_sys->i_yoffset
+                + i_row * ( p_sys->i_height / p_sys->i_rows )
+                + ( i_row * p_sys->i_borderh ) / p_sys->i_rows;
+    }
+    else
+    {
+        /* center the video in the dedicated rectangle */
+        *pi_y = p_sys->i_yoffset
+                + i_row * ( p_sys->i_height / p_sys->i_rows )
+                + ( i_row * p_sys->i_borderh ) / p_sys->i_rows
+                + ( row_inner_height - p_fmt->i_height ) / 2;
+    }
+}
+
+/*****************************************************************************
+ * Persistent canvas
+ *****************************************************************************/
+static void ScaleTile( void *p_data )
+{
+    mosaic_tile_t *p_tile = p_data;
+    picture_t *p_new = p_tile->p_new;
+    video_format_t fmt_in;
+
+    memset( &fmt_in, 0, sizeof( fmt_in ) );
+    fmt_in.i_chroma = p_new->format.i_chroma;
+    fmt_in.i_width = p_new->format.i_width;
+    fmt_in.i_height = p_new->format.i_height;
+
+    picture_t *p_scaled = image_Convert( p_tile->p_image, p_new, &fmt_in,
+                                         &p_tile->fmt_out );
+    if( p_tile->p_scaled )
+        picture_Release( p_tile->p_scaled );
+    p_tile->p_scaled = p_scaled;
+    if( p_tile->p_source )
+        picture_Release( p_tile->p_source );
+    /* Keep the source picture, so that it cannot be mistaken for a new one */
+    p_tile->p_source = p_scaled ? p_new : NULL;
+    if( !p_scaled )
+        picture_Release( p_new );
+    p_tile->p_new = NULL;
+}
+
+/* Clears the area [i_x0, i_x1) x [i_y0, i_y1) to transparent black */
+static void ClearArea( picture_t *p_canvas, int i_x0, int i_y0,
+                       int i_x1, int i_y1 )
+{
+    static const uint8_t pi_black[4] = { 0x10, 0x80, 0x80, 0x00 };
+
+    /* YUVA planes all have the same size */
+    for( int i = 0; i < p_canvas->i_planes; i++ )
+    {
+        plane_t *p_out = &p_canvas->p[i];
+
+        for( int y = i_y0; y < i_y1; y++ )
+            memset( &p_out->p_pixels[y * p_out->i_pitch + i_x0], pi_black[i],
+                    i_x1 - i_x0 );
+    }
+}
+
+/* Blends the part of a tile within [i_x0, i_x1) x [i_y0, i_y1) over the
+ * canvas, so that the canvas then blends over the video as the tiles
+ * would one after the other */
+static void BlendTile( picture_t *p_canvas, const mosaic_tile_t *p_tile,
+                       int i_x0, int i_y0, int i_x1, int i_y1 )
+{
+    const picture_t *p_src = p_tile->p_scaled;
+
+    i_x0 = __MAX( i_x0, p_tile->i_x );
+    i_y0 = __MAX( i_y0, p_tile->i_y );
+    i_x1 = __MIN( i_x1, p_tile->i_x + (int)p_src->format.i_visible_width );
+    i_y1 = __MIN( i_y1, p_tile->i_y + (int)p_src->format.i_visible_height );
+    if( i_x0 >= i_x1 || i_y0 >= i_y1 )
+        return;
+
+    for( int y = i_y0; y < i_y1; y++ )
+    {
+        const uint8_t *pp_in[4];
+        uint8_t *pp_out[4];
+        int i_width = i_x1 - i_x0;
+
+        for( int i = 0; i < 4; i++ )
+        {
+            pp_in[i] = &p_src->p[i].p_pixels[( y - p_tile->i_y )
+                       * p_src->p[i].i_pitch + i_x0 - p_tile->i_x];
+            pp_out[i] = &p_canvas->p[i].p_pixels[y * p_canvas->p[i].i_pitch
+                                                 + i_x0];
+        }
+
+        /* Opaque lines, the usual case, are copied */
+        int x = 0;
+        if( p_tile->i_alpha == 255 )
+            while( x < i_width && pp_in[A_PLANE][x] == 255 )
+                x++;
+        if( x == i_width )
+        {
+            for( int i = 0; i < 4; i++ )
+                memcpy( pp_out[i], pp_in[i], i_width );
+            continue;
+        }
+
+        for( x = 0; x < i_width; x++ )
+        {
+            unsigned i_alpha = pp_in[A_PLANE][x] * p_tile->i_alpha / 255;
+            unsigned i_under = pp_out[A_PLANE][x];
+
+            if( i_alpha == 0 )
+                continue;
+            if( i_alpha == 255 || i_under == 0 )
+            {
+                for( int i = 0; i < A_PLANE; i++ )
+                    pp_out[i][x] = pp_in[i][x];
+                pp_out[A_PLANE][x] = i_alpha;
+                continue;
+            }
+
+            /* Porter-Duff over, with straight alpha */
+            unsigned i_src = i_alpha * 255;
+            unsigned i_dst = i_under * ( 255 - i_alpha );
+            unsigned i_sum = i_src + i_dst;
+
+            for( int i = 0; i < A_PLANE; i++ )
+                pp_out[i][x] = ( pp_in[i][x] * i_src + pp_out[i][x] * i_dst
+                                 + i_sum / 2 ) / i_sum;
+            pp_out[A_PLANE][x] = ( i_sum + 127 ) / 255;
+        }
+    }
+}
+
+/* Composes the visible tiles within [i_x0, i_x1) x [i_y0, i_y1) */
+static void ComposeArea( filter_sys_t *p_sys, picture_t *p_canvas,
+                         int i_x0, int i_y0, int i_x1, int i_y1 )
+{
+    i_x0 = __MAX( i_x0, 0 );
+    i_y0 = __MAX( i_y0, 0 );
+    i_x1 = __MIN( i_x1, (int)p_canvas->format.i_visible_width );
+    i_y1 = __MIN( i_y1, (int)p_canvas->format.i_visible_height );
+    if( i_x0 >= i_x1 || i_y0 >= i_y1 )
+        return;
+
+    ClearArea( p_canvas, i_x0, i_y0, i_x1, i_y1 );
+    for( int i = 0; i < p_sys->i_tiles; i++ )
+    {
+        const mosaic_tile_t *p_tile = &p_sys->p_tiles[i];
+
+        if( p_tile->b_visible && p_tile->p_scaled != NULL )
+            BlendTile( p_canvas, p_tile, i_x0, i_y0, i_x1, i_y1 );
+    }
+}
+
+/* Returns a canvas no SPU holds anymore, preferably the most recent one */
+static picture_t *GetCanvas( filter_sys_t *p_sys, unsigned *pi_gen )
+{
+    int i_best = -1;
+
+    for( int i = 0; i < CANVAS_COUNT; i++ )
+    {
+        picture_t *p_canvas = p_sys->pp_canvas[i];
+
+        if( p_canvas != NULL
+         && ( p_canvas->format.i_width != (unsigned)p_sys->i_width
+           || p_canvas->format.i_height != (unsigned)p_sys->i_height ) )
+        {
+            picture_Release( p_canvas );
+            p_sys->pp_canvas[i] = p_canvas = NULL;
+        }
+        if( p_canvas != NULL && picture_IsReferenced( p_canvas ) )
+            continue;
+        if( i_best < 0
+         || ( p_canvas != NULL
+           && ( p_sys->pp_canvas[i_best] == NULL
+             || p_sys->pi_canvas_gen[i] > p_sys->pi_canvas_gen[i_best] ) ) )
+            i_best = i;
+    }
+
+    if( i_best < 0 )
+    {
+        /* All are still shown: the oldest is left to its SPU */
+        i_best = 0;
+        for( int i = 1; i < CANVAS_COUNT; i++ )
+            if( p_sys->pi_canvas_gen[i] < p_sys->pi_canvas_gen[i_best] )
+                i_best = i;
+        picture_Release( p_sys->pp_canvas[i_best] );
+        p_sys->pp_canvas[i_best] = NULL;
+    }
+
+    if( p_sys->pp_canvas[i_best] == NULL )
+    {
+        p_sys->pp_canvas[i_best] = picture_New( VLC_CODEC_YUVA,
+                                                p_sys->i_width,
+                                                p_sys->i_height, 1, 1 );
+        p_sys->pi_canvas_gen[i_best] = 0;
+    }
+    *pi_gen = p_sys->pi_canvas_gen[i_best];
+    p_sys->pi_canvas_gen[i_best] = p_sys->i_gen;
+    return p_sys->pp_canvas[i_best];
+}
+
+/* Called with both locks, returns with the mosaic lock released */
+static void FilterCanvas( filter_t *p_filter, subpicture_t *p_spu,
+                          bridge_t *p_bridge, mtime_t date,
+                          unsigned col_inner_width,
+                          unsigned row_inner_height )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    int i_real_index = 0;
+    int i_greatest_real_index_used = p_sys->i_order_length - 1;
+    bool b_redraw = false;
+    unsigned i_jobs = 0;
+
+    if( p_sys->i_width <= 0 || p_sys->i_height <= 0 )
+    {
+        vlc_global_unlock( VLC_MOSAIC_MUTEX );
+        return;
+    }
+
+    p_sys->i_gen++;
+    unsigned i_canvas_gen;
+    picture_t *p_canvas = GetCanvas( p_sys, &i_canvas_gen );
+
+    if( p_sys->i_tiles < p_bridge->i_es_num )
+    {
+        p_sys->p_tiles = xrealloc( p_sys->p_tiles,
+                                   p_bridge->i_es_num * sizeof(mosaic_tile_t) );
+        memset( &p_sys->p_tiles[p_sys->i_tiles], 0,
+                ( p_bridge->i_es_num - p_sys->i_tiles ) *
+                sizeof(mosaic_tile_t) );
+        p_sys->i_tiles = p_bridge->i_es_num;
+    }
+
+    for( int i_index = 0; i_index < p_bridge->i_es_num; i_index++ )
+    {
+        bridged_es_t *p_es = p_bridge->pp_es[i_index];
+        mosaic_tile_t *p_tile = &p_sys->p_tiles[i_index];
+        picture_t *p_picture = NULL;
+        video_format_t fmt_out;
+
+        if( !p_es->b_empty )
+            p_picture = mosaic_Dequeue( p_filter, p_es, date );
+
+        if( p_picture == NULL || p_canvas == NULL )
+        {
+            /* Gone: clear its area, and let go of its pictures */
+            if( p_tile->b_visible )
+                b_redraw = true;
+            p_tile->b_visible = false;
+            if( p_tile->p_source )
+                picture_Release( p_tile->p_source );
+            if( p_tile->p_scaled )
+                picture_Release( p_tile->p_scaled );
+            p_tile->p_source = p_tile->p_scaled = NULL;
+            continue;
+        }
+
+        int i_index_real = mosaic_GetIndex( p_sys, p_es, &i_real_index,
+                                            &i_greatest_real_index_used );
+
+        memset( &fmt_out, 0, sizeof( fmt_out ) );
+        fmt_out.i_chroma = VLC_CODEC_YUVA;
+        if( p_sys->b_keep )
+        {
+            fmt_out.i_width = fmt_out.i_visible_width =
+                p_picture->format.i_width;
+            fmt_out.i_height = fmt_out.i_visible_height =
+                p_picture->format.i_height;
+        }
+        else
+            mosaic_GetSize( p_sys, &p_picture->format, col_inner_width,
+                            row_inner_height, &fmt_out );
+
+        int i_x, i_y;
+        mosaic_GetPosition( p_sys, p_es, i_index_real, &fmt_out,
+                            col_inner_width, row_inner_height, &i_x, &i_y );
+        i_x -= p_sys->i_xoffset;
+        i_y -= p_sys->i_yoffset;
+
+        bool b_resized = fmt_out.i_width != p_tile->fmt_out.i_width
+                      || fmt_out.i_height != p_tile->fmt_out.i_height;
+
+        /* The SPU is opaque: the mosaic transparency goes to each tile */
+        int i_alpha = p_es->i_alpha * p_sys->i_alpha / 255;
+
+        if( !p_tile->b_visible || b_resized || i_x != p_tile->i_x
+         || i_y != p_tile->i_y || i_alpha != p_tile->i_alpha )
+            b_redraw = true;
+
+        p_tile->fmt_out = fmt_out;
+        p_tile->i_x = i_x;
+        p_tile->i_y = i_y;
+        p_tile->i_alpha = i_alpha;
+        p_tile->b_visible = true;
+
+        if( p_picture == p_tile->p_source && !b_resized )
+            continue; /* Nothing new */
+
+        if( p_picture != p_tile->p_source )
+        {
+            p_es->i_shown++;
+            p_es->i_latency = date - p_picture->date;
+            if( p_es->i_latency > p_es->i_latency_max )
+                p_es->i_latency_max = p_es->i_latency;
+        }
+
+        if( p_tile->p_image == NULL )
+            p_tile->p_image = image_HandlerCreate( p_filter );
+        if( p_tile->p_image == NULL )
+            continue;
+        p_tile->p_new = picture_Hold( p_picture );
+        p_tile->i_gen = p_sys->i_gen;
+        i_jobs++;
+    }
+
+    if( date >= p_sys->i_next_stats )
+    {
+        for( int i_index = 0; i_index < p_bridge->i_es_num; i_index++ )
+        {
+            const bridged_es_t *p_es = p_bridge->pp_es[i_index];
+
+            if( !p_es->b_empty )
+                msg_Dbg( p_filter, "tile %s: %u pictures shown, %u dropped, "
+                         "latency %"PRId64" us (maximum %"PRId64" us)",
+                         p_es->psz_id, p_es->i_shown, p_es->i_dropped,
+                         p_es->i_latency, p_es->i_latency_max );
+        }
+        p_sys->i_next_stats = date + STATS_PERIOD;
+    }
+
+    /* The bridges can push pictures while the tiles are scaled */
+    vlc_global_unlock( VLC_MOSAIC_MUTEX );
+
+    if( p_canvas == NULL )
+        return;
+    if( b_redraw )
+        p_sys->i_layout_gen = p_sys->i_gen;
+
+    /* Scale the new pictures, the calling thread takes the first one */
+    vlc_taskgroup_t *p_group = NULL;
+    mosaic_tile_t *p_first = NULL;
+
+    if( i_jobs > 1 && p_sys->p_pool != NULL )
+        p_group = vlc_taskgroup_create( p_sys->p_pool,
+                                        VLC_TASK_PRIORITY_NORMAL );
+
+    for( int i = 0; i < p_sys->i_tiles; i++ )
+    {
+        mosaic_tile_t *p_tile = &p_sys->p_tiles[i];
+
+        if( p_tile->p_new == NULL )
+            continue;
+        if( p_first == NULL )
+            p_first = p_tile;
+        else if( p_group == NULL
+              || vlc_taskgroup_submit( p_group, ScaleTile, p_tile ) )
+            ScaleTile( p_tile );
+    }
+    if( p_first != NULL )
+        ScaleTile( p_first );
+    if( p_group != NULL )
+        vlc_taskgroup_destroy( p_group );
+
+    for( int i = 0; i < p_sys->i_tiles; i++ )
+        if( p_sys->p_tiles[i].i_gen == p_sys->i_gen
+         && p_sys->p_tiles[i].p_scaled == NULL )
+            msg_Warn( p_filter,
+                      "image resizing and chroma conversion failed" );
+
+    /* Bring the canvas up to date: redraw it after a layout change, else
+     * only the areas of the tiles scaled since it was last drawn */
+    if( i_canvas_gen == 0 || i_canvas_gen < p_sys->i_layout_gen )
+        ComposeArea( p_sys, p_canvas, 0, 0, p_sys->i_width, p_sys->i_height );
+    else
+        for( int i = 0; i < p_sys->i_tiles; i++ )
+        {
+            const mosaic_tile_t *p_tile = &p_sys->p_tiles[i];
+
+            if( p_tile->b_visible && p_tile->i_gen > i_canvas_gen )
+                ComposeArea( p_sys, p_canvas, p_tile->i_x, p_tile->i_y,
+                             p_tile->i_x + (int)p_tile->fmt_out.i_width,
+                             p_tile->i_y + (int)p_tile->fmt_out.i_height );
+        }
+
+    /* The SPU holds the canvas, which is not drawn again until released.
+     * No picture is allocated for text regions. */
+    video_format_t fmt = p_canvas->format;
+    fmt.i_chroma = VLC_CODEC_TEXT;
+    subpicture_region_t *p_region = subpicture_region_New( &fmt );
+    if( p_region == NULL )
+    {
+        msg_Err( p_filter, "cannot allocate SPU region" );
+        return;
+    }
+    p_region->fmt.i_chroma = VLC_CODEC_YUVA;
+    p_region->p_picture = picture_Hold( p_canvas );
+    p_region->i_x = p_sys->i_xoffset;
+    p_region->i_y = p_sys->i_yoffset;
+    p_region->i_align = p_sys->i_align;
+    p_region->i_alpha = 255;
+    p_spu->i_alpha = 255;
+    p_spu->p_region = p_region;
+}
+
 /*****************************************************************************
  * Filter
  *****************************************************************************/
@@ -433,7 +1048,7 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
     filter_sys_t *p_sys = p_filter->p_sys;
     bridge_t *p_bridge;
 
-    int i_index, i_real_index, i_row, i_col;
+    int i_index, i_real_index;
     int i_greatest_real_index_used = p_sys->i_order_length - 1;
 
     unsigned int col_inner_width, row_inner_height;
@@ -520,6 +1135,14 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
     row_inner_height = ( ( p_sys->i_height - ( p_sys->i_rows - 1 )
                        * p_sys->i_borderh ) / p_sys->i_rows );
 
+    if( p_sys->b_canvas )
+    {
+        FilterCanvas( p_filter, p_spu, p_bridge, date,
+                      col_inner_width, row_inner_height );
+        vlc_mutex_unlock( &p_sys->lock );
+        return p_spu;
+    }
+
     i_real_index = 0;
 
     for ( i_index = 0; i_index < p_bridge->i_es_num; i_index++ )
@@ -527,6 +1150,7 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
         bridged_es_t *p_es = p_bridge->pp_es[i_index];
         video_format_t fmt_in, fmt_out;
         picture_t *p_converted;
+        int i_index_real;
 
         memset( &fmt_in, 0, sizeof( video_format_t ) );
         memset( &fmt_out, 0, sizeof( video_format_t ) );
@@ -534,57 +1158,11 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
         if ( p_es->b_empty )
             continue;
 
-        while ( p_es->p_picture != NULL
-                 && p_es->p_picture->date + p_sys->i_delay < date )
-        {
-            if ( p_es->p_picture->p_next != NULL )
-            {
-                picture_t *p_next = p_es->p_picture->p_next;
-                picture_Release( p_es->p_picture );
-                p_es->p_picture = p_next;
-            }
-            else if ( p_es->p_picture->date + p_sys->i_delay + BLANK_DELAY <
-                        date )
-            {
-                /* Display blank */
-                picture_Release( p_es->p_picture );
-                p_es->p_picture = NULL;
-                p_es->pp_last = &p_es->p_picture;
-                break;
-            }
-            else
-            {
-                msg_Dbg( p_filter, "too late picture for %s (%"PRId64 ")",
-                         p_es->psz_id,
-                         date - p_es->p_picture->date - p_sys->i_delay );
-                break;
-            }
-        }
-
-        if ( p_es->p_picture == NULL )
+        if ( mosaic_Dequeue( p_filter, p_es, date ) == NULL )
             continue;
 
-        if ( p_sys->i_order_length == 0 )
-        {
-            i_real_index++;
-        }
-        else
-        {
-            int i;
-            for ( i = 0; i <= p_sys->i_order_length; i++ )
-            {
-                if ( i == p_sys->i_order_length ) break;
-                if ( strcmp( p_es->psz_id, p_sys->ppsz_order[i] ) == 0 )
-                {
-                    i_real_index = i;
-                    break;
-                }
-            }
-            if ( i == p_sys->i_order_length )
-                i_real_index = ++i_greatest_real_index_used;
-        }
-        i_row = ( i_real_index / p_sys->i_cols ) % p_sys->i_rows;
-        i_col = i_real_index % p_sys->i_cols ;
+        i_index_real = mosaic_GetIndex( p_sys, p_es, &i_real_index,
+                                        &i_greatest_real_index_used );
 
         if ( !p_sys->b_keep )
         {
@@ -598,26 +1176,8 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
                 fmt_out.i_chroma = VLC_CODEC_YUVA;
             else
                 fmt_out.i_chroma = VLC_CODEC_I420;
-            fmt_out.i_width = col_inner_width;
-            fmt_out.i_height = row_inner_height;
-
-            if( p_sys->b_ar ) /* keep aspect ratio */
-            {
-                if( (float)fmt_out.i_width / (float)fmt_out.i_height
-                      > (float)fmt_in.i_width / (float)fmt_in.i_height )
-                {
-                    fmt_out.i_width = ( fmt_out.i_height * fmt_in.i_width )
-                                         / fmt_in.i_height;
-                }
-                else
-                {
-                    fmt_out.i_height = ( fmt_out.i_width * fmt_in.i_height )
-                                        / fmt_in.i_width;
-                }
-             }
-
-            fmt_out.i_visible_width = fmt_out.i_width;
-            fmt_out.i_visible_height = fmt_out.i_height;
+            mosaic_GetSize( p_sys, &fmt_in, col_inner_width,
+                            row_inner_height, &fmt_out );
 
             p_converted = image_Convert( p_sys->p_image, p_es->p_picture,
                                          &fmt_in, &fmt_out );
@@ -654,54 +1214,9 @@ static subpicture_t *Filter( filter_t *p_filter, mtime_t date )
             return NULL;
         }
 
-        if( p_es->i_x >= 0 && p_es->i_y >= 0 )
-        {
-            p_region->i_x = p_es->i_x;
-            p_region->i_y = p_es->i_y;
-        }
-        else if( p_sys->i_position == position_offsets )
-        {
-            p_region->i_x = p_sys->pi_x_offsets[i_real_index];
-            p_region->i_y = p_sys->pi_y_offsets[i_real_index];
-        }
-        else
-        {
-            if( fmt_out.i_width > col_inner_width ||
-                p_sys->b_ar || p_sys->b_keep )
-            {
-                /* we don't have to center the video since it takes the
-                whole rectangle area or it's larger than the rectangle */
-                p_region->i_x = p_sys->i_xoffset
-                            + i_col * ( p_sys->i_width / p_sys->i_cols )
-                            + ( i_col * p_sys->i_borderw ) / p_sys->i_cols;
-            }
-            else
-            {
-                /* center the video in the dedicated rectangle */
-                p_region->i_x = p_sys->i_xoffset
-                        + i_col * ( p_sys->i_width / p_sys->i_cols )
-                        + ( i_col * p_sys->i_borderw ) / p_sys->i_cols
-                        + ( col_inner_width - fmt_out.i_width ) / 2;
-            }
-
-            if( fmt_out.i_height > row_inner_height
-                || p_sys->b_ar || p_sys->b_keep )
-            {
-                /* we don't have to center the video since it takes the
-                whole rectangle area or it's taller than the rectangle */
-                p_region->i_y = p_sys->i_yoffset
-                        + i_row * ( p_sys->i_height / p_sys->i_rows )
-                        + ( i_row * p_sys->i_borderh ) / p_sys->i_rows;
-            }
-            else
-            {
-                /* center the video in the dedicated rectangle */
-                p_region->i_y = p_sys->i_yoffset
-                        + i_row * ( p_sys->i_height / p_sys->i_rows )
-                        + ( i_row * p_sys->i_borderh ) / p_sys->i_rows
-                        + ( row_inner_height - fmt_out.i_height ) / 2;
-            }
-        }
+        mosaic_GetPosition( p_sys, p_es, i_index_real, &fmt_out,
+                            col_inner_width, row_inner_height,
+                            &p_region->i_x, &p_region->i_y );
         p_region->i_align = p_sys->i_align;
         p_region->i_alpha = p_es->i_alpha;
 
@@ -33,6 +33,12 @@ typedef struct bridged_es_t
     int i_alpha;
     int i_x;
     int i_y;
+
+    /* Statistics, updated by the mosaic under VLC_MOSAIC_MUTEX */
+    unsigned i_shown;       /* pictures composed (persistent canvas only) */
+    unsigned i_dropped;     /* pictures skipped as too late */
+    mtime_t i_latency;      /* composition date minus picture date */
+    mtime_t i_latency_max;
 } bridged_es_t;
 
 typedef struct bridge_t
@@ -0,0 +1,322 @@
+/*****************************************************************************
+ * display.c: shared memory video output
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+
+#include <vlc_common.h>
+#include <vlc_plugin.h>
+#include <vlc_vout_display.h>
+#include <vlc_picture_pool.h>
+
+#include "ring.h"
+
+/*****************************************************************************
+ * Module descriptor
+ *****************************************************************************/
+#define NAME_TEXT N_("Shared memory name")
+#define NAME_LONGTEXT N_("Name of the POSIX shared memory object the " \
+    "pictures are written to. Other local processes can map it to read " \
+    "the pictures without copies.")
+
+#define SLOTS_TEXT N_("Pictures")
+#define SLOTS_LONGTEXT N_("Maximum number of pictures in the shared memory. " \
+    "Readers can hold pictures that long without stalling the decoder.")
+
+#define CHROMA_TEXT N_("Chroma")
+#define CHROMA_LONGTEXT N_("Chroma of the shared pictures as a 4-character " \
+    "string, eg. \"RV32\". The source chroma is used by default.")
+
+#define SHARED_TEXT N_("Readable by other users")
+#define SHARED_LONGTEXT N_("Allow processes of other users to read the " \
+    "pictures. Only processes of the same user can by default.")
+
+static int  Open (vlc_object_t *);
+static void Close(vlc_object_t *);
+
+vlc_module_begin()
+    set_description(N_("Shared memory video output"))
+    set_shortname(N_("Shared memory"))
+
+    set_category(CAT_VIDEO)
+    set_subcategory(SUBCAT_VIDEO_VOUT)
+    set_capability("vout display", 0)
+
+    add_string("shmring-name", "/vlc-frames", NAME_TEXT, NAME_LONGTEXT, false)
+    add_integer_with_range("shmring-slots", 8, 2, SHMRING_MAX_SLOTS,
+                           SLOTS_TEXT, SLOTS_LONGTEXT, true)
+    add_string("shmring-chroma", NULL, CHROMA_TEXT, CHROMA_LONGTEXT, true)
+    add_bool("shmring-shared", false, SHARED_TEXT, SHARED_LONGTEXT, true)
+
+    set_callbacks(Open, Close)
+vlc_module_end()
+
+/*****************************************************************************
+ * Local prototypes
+ *****************************************************************************/
+struct picture_sys_t {
+    vout_display_sys_t *sys;
+    unsigned slot;
+};
+
+struct vout_display_sys_t {
+    shmring_t      *ring;
+    picture_pool_t *pool;
+    char           *name;
+    unsigned        slots;
+    mode_t          mode;
+};
+
+static picture_pool_t *Pool  (vout_display_t *, unsigned);
+static void           Display(vout_display_t *, picture_t *, subpicture_t *);
+static int            Control(vout_display_t *, int, va_list);
+
+static int            Lock(picture_t *);
+
+/*****************************************************************************
+ * Open: allocates video thread
+ *****************************************************************************/
+static int Open(vlc_object_t *object)
+{
+    vout_display_t *vd = (vout_display_t *)object;
+    vout_display_sys_t *sys = malloc(sizeof(*sys));
+    if (unlikely(!sys))
+        return VLC_ENOMEM;
+
+    sys->name = var_InheritString(vd, "shmring-name");
+    if (sys->name == NULL || sys->name[0] != '/') {
+        msg_Err(vd, "shared memory name must start with a slash");
+        free(sys->name);
+        free(sys);
+        return VLC_EGENERIC;
+    }
+    sys->slots = var_InheritInteger(vd, "shmring-slots");
+    sys->mode = var_InheritBool(vd, "shmring-shared") ? 0644 : 0600;
+    sys->ring = NULL;
+    sys->pool = NULL;
+
+    /* Define the video format */
+    video_format_t fmt;
+    video_format_ApplyRotation(&fmt, &vd->fmt);
+
+    char *chroma = var_InheritString(vd, "shmring-chroma");
+    if (chroma != NULL) {
+        fmt.i_chroma = vlc_fourcc_GetCodecFromString(VIDEO_ES, chroma);
+        if (!fmt.i_chroma)
+            msg_Warn(vd, "invalid chroma %s", chroma);
+        free(chroma);
+    }
+
+    /* Readers need pixels in memory, not opaque surfaces */
+    const vlc_chroma_description_t *desc =
+        vlc_fourcc_GetChromaDescription(fmt.i_chroma);
+    if (desc == NULL || desc->plane_count == 0)
+        fmt.i_chroma = VLC_CODEC_I420;
+
+    fmt.i_x_offset = fmt.i_y_offset = 0;
+    fmt.i_visible_width = fmt.i_width;
+    fmt.i_visible_height = fmt.i_height;
+
+    switch (fmt.i_chroma)
+    {
+    case VLC_CODEC_RGB15:
+        fmt.i_rmask = 0x001f;
+        fmt.i_gmask = 0x03e0;
+        fmt.i_bmask = 0x7c00;
+        break;
+    case VLC_CODEC_RGB16:
+        fmt.i_rmask = 0x001f;
+        fmt.i_gmask = 0x07e0;
+        fmt.i_bmask = 0xf800;
+        break;
+    case VLC_CODEC_RGB24:
+    case VLC_CODEC_RGB32:
+        fmt.i_rmask = 0xff0000;
+        fmt.i_gmask = 0x00ff00;
+        fmt.i_bmask = 0x0000ff;
+        break;
+    default:
+        fmt.i_rmask = 0;
+        fmt.i_gmask = 0;
+        fmt.i_bmask = 0;
+        break;
+    }
+
+    /* */
+    vout_display_info_t info = vd->info;
+    info.has_hide_mouse = true;
+
+    /* */
+    vd->sys     = sys;
+    vd->fmt     = fmt;
+    vd->info    = info;
+    vd->pool    = Pool;
+    vd->prepare = NULL;
+    vd->display = Display;
+    vd->control = Control;
+    vd->manage  = NULL;
+
+    /* */
+    vout_display_SendEventFullscreen(vd, false);
+    vout_display_SendEventDisplaySize(vd, fmt.i_width, fmt.i_height, false);
+    return VLC_SUCCESS;
+}
+
+static void Close(vlc_object_t *object)
+{
+    vout_display_t *vd = (vout_display_t *)object;
+    vout_display_sys_t *sys = vd->sys;
+
+    if (sys->pool)
+        picture_pool_Delete(sys->pool);
+    if (sys->ring)
+        shmring_destroy(sys->ring);
+    free(sys->name);
+    free(sys);
+}
+
+/* Each picture of the pool lives in a slot of the ring, for good: decoders
+ * and filters write into the shared memory directly. */
+static picture_pool_t *Pool(vout_display_t *vd, unsigned count)
+{
+    vout_display_sys_t *sys = vd->sys;
+
+    if (sys->pool)
+        return sys->pool;
+
+    if (count > sys->slots)
+        count = sys->slots;
+
+    /* Get the layout of the planes */
+    picture_t *layout = picture_NewFromFormat(&vd->fmt);
+    if (unlikely(layout == NULL))
+        return NULL;
+
+    shmring_format_t fmt = {
+        .chroma = vd->fmt.i_chroma,
+        .width = vd->fmt.i_width,
+        .height = vd->fmt.i_height,
+        .sar_num = vd->fmt.i_sar_num,
+        .sar_den = vd->fmt.i_sar_den,
+        .plane_count = layout->i_planes,
+    };
+    for (int i = 0; i < layout->i_planes; i++) {
+        fmt.planes[i].pitch = layout->p[i].i_pitch;
+        fmt.planes[i].lines = layout->p[i].i_lines;
+    }
+    picture_Release(layout);
+
+    sys->ring = shmring_create(sys->name, sys->mode, &fmt, count);
+    if (sys->ring == NULL) {
+        msg_Err(vd, "cannot create shared memory %s: %s", sys->name,
+                vlc_strerror_c(errno));
+        return NULL;
+    }
+
+    picture_t *pictures[count];
+
+    for (unsigned i = 0; i < count; i++) {
+        picture_sys_t *picsys = malloc(sizeof (*picsys));
+        if (unlikely(picsys == NULL))
+        {
+            count = i;
+            break;
+        }
+        picsys->sys = sys;
+        picsys->slot = i;
+
+        picture_resource_t rsc = { .p_sys = picsys };
+
+        for (unsigned j = 0; j < fmt.plane_count; j++) {
+            rsc.p[j].p_pixels = shmring_pixels(sys->ring, i, j);
+            rsc.p[j].i_lines  = fmt.planes[j].lines;
+            rsc.p[j].i_pitch  = fmt.planes[j].pitch;
+        }
+
+        pictures[i] = picture_NewFromResource(&vd->fmt, &rsc);
+        if (!pictures[i]) {
+            free(rsc.p_sys);
+            count = i;
+            break;
+        }
+    }
+
+    /* */
+    picture_pool_configuration_t pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.picture_count = count;
+    pool.picture       = pictures;
+    pool.lock          = Lock;
+    sys->pool = picture_pool_NewExtended(&pool);
+    if (!sys->pool) {
+        for (unsigned i = 0; i < count; i++)
+            picture_Release(pictures[i]);
+        shmring_destroy(sys->ring);
+        sys->ring = NULL;
+    }
+
+    return sys->pool;
+}
+
+static void Display(vout_display_t *vd, picture_t *picture, subpicture_t *subpicture)
+{
+    vout_display_sys_t *sys = vd->sys;
+
+    /* The picture date is the system time at which it is due, mdate() being
+     * CLOCK_MONOTONIC, so that readers can pace their rendering on it */
+    shmring_publish(sys->ring, picture->p_sys->slot, picture->date);
+    picture_Release(picture);
+    VLC_UNUSED(subpicture);
+}
+
+static int Control(vout_display_t *vd, int query, va_list args)
+{
+    switch (query) {
+    case VOUT_DISPLAY_CHANGE_FULLSCREEN:
+    case VOUT_DISPLAY_CHANGE_DISPLAY_SIZE: {
+        const vout_display_cfg_t *cfg = va_arg(args, const vout_display_cfg_t *);
+        if (cfg->display.width  != vd->fmt.i_width ||
+            cfg->display.height != vd->fmt.i_height)
+            return VLC_EGENERIC;
+        if (cfg->is_fullscreen)
+            return VLC_EGENERIC;
+        return VLC_SUCCESS;
+    }
+    default:
+        return VLC_EGENERIC;
+    }
+}
+
+/* The slot is not available while readers use it (or did not read it yet):
+ * the pool skips the picture, and the decoder waits if all are busy. */
+static int Lock(picture_t *picture)
+{
+    picture_sys_t *picsys = picture->p_sys;
+
+    return shmring_reuse(picsys->sys->ring, picsys->slot) ? VLC_SUCCESS
+                                                           : VLC_EGENERIC;
+}
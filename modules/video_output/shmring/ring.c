@@ -0,0 +1,421 @@
+/*****************************************************************************
+ * ring.c: shared memory ring of video frames
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+# include <linux/futex.h>
+# include <sys/syscall.h>
+#endif
+
+#include "ring.h"
+
+struct shmring
+{
+    struct shmring_header *hdr;
+    size_t size;
+    char *name;    /* writer only */
+    int reader;    /* index of the reader entry, or -1 for the writer */
+};
+
+#define load_acquire(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+/* The slot handover needs sequential consistency between the writer
+ * clearing the sequence number then checking the held masks, and the readers
+ * setting their held mask then checking the sequence number. */
+#define load_seq_cst(p)     __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define store_seq_cst(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+
+#define ALIGN(x, a) (((x) + (a) - 1) & ~((uint64_t)(a) - 1))
+
+static int64_t Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * INT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
+static void Wake(struct shmring_header *hdr)
+{
+#ifdef __linux__
+    syscall(SYS_futex, &hdr->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+    (void) hdr;
+#endif
+}
+
+/* Waits until the futex value changes or the deadline (if any) */
+static void Wait(struct shmring_header *hdr, uint32_t value, int64_t deadline)
+{
+    int64_t delay = 1000;
+
+    if (deadline >= 0) {
+        delay = deadline - Now();
+        if (delay <= 0)
+            return;
+    }
+#ifdef __linux__
+    struct timespec ts = { delay / 1000000, (delay % 1000000) * 1000 };
+
+    syscall(SYS_futex, &hdr->futex, FUTEX_WAIT, value,
+            (deadline >= 0) ? &ts : NULL, NULL, 0);
+#else
+    /* Poll without the futex */
+    struct timespec ts = { 0, (delay < 1000 ? delay : 1000) * 1000 };
+
+    (void) hdr; (void) value;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/*** Writer ***/
+
+shmring_t *shmring_create(const char *name, mode_t mode,
+                          const shmring_format_t *fmt, unsigned slots)
+{
+    if (slots == 0 || slots > SHMRING_MAX_SLOTS
+     || fmt->plane_count == 0 || fmt->plane_count > SHMRING_MAX_PLANES) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    shmring_t *ring = malloc(sizeof (*ring));
+    if (ring == NULL)
+        return NULL;
+    ring->name = strdup(name);
+    ring->reader = -1;
+    if (ring->name == NULL)
+        goto error;
+
+    /* Planes and slots are aligned for SIMD and pages respectively */
+    uint64_t slot_size = 0;
+    for (unsigned i = 0; i < fmt->plane_count; i++)
+        slot_size += ALIGN((uint64_t)fmt->planes[i].pitch
+                           * fmt->planes[i].lines, 64);
+    slot_size = ALIGN(slot_size, 4096);
+
+    const uint64_t data_offset = ALIGN(sizeof (struct shmring_header), 4096);
+    ring->size = data_offset + slot_size * slots;
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, mode);
+    if (fd == -1)
+        goto error;
+    if (ftruncate(fd, ring->size)) {
+        close(fd);
+        shm_unlink(name);
+        goto error;
+    }
+    ring->hdr = mmap(NULL, ring->size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    close(fd);
+    if (ring->hdr == MAP_FAILED) {
+        shm_unlink(name);
+        goto error;
+    }
+
+    /* The new object is zeroed */
+    struct shmring_header *hdr = ring->hdr;
+    hdr->version = SHMRING_VERSION;
+    hdr->size = ring->size;
+    hdr->data_offset = data_offset;
+    hdr->slot_size = slot_size;
+    hdr->slot_count = slots;
+    hdr->chroma = fmt->chroma;
+    hdr->width = fmt->width;
+    hdr->height = fmt->height;
+    hdr->sar_num = fmt->sar_num;
+    hdr->sar_den = fmt->sar_den;
+    hdr->plane_count = fmt->plane_count;
+
+    uint64_t offset = 0;
+    for (unsigned i = 0; i < fmt->plane_count; i++) {
+        hdr->planes[i].offset = offset;
+        hdr->planes[i].pitch = fmt->planes[i].pitch;
+        hdr->planes[i].lines = fmt->planes[i].lines;
+        offset += ALIGN((uint64_t)fmt->planes[i].pitch
+                        * fmt->planes[i].lines, 64);
+    }
+    store_release(&hdr->magic, SHMRING_MAGIC);
+    return ring;
+
+error:
+    free(ring->name);
+    free(ring);
+    return NULL;
+}
+
+void shmring_destroy(shmring_t *ring)
+{
+    __atomic_or_fetch(&ring->hdr->flags, SHMRING_CLOSED, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&ring->hdr->futex, 1, __ATOMIC_RELEASE);
+    Wake(ring->hdr);
+
+    shm_unlink(ring->name);
+    munmap(ring->hdr, ring->size);
+    free(ring->name);
+    free(ring);
+}
+
+uint8_t *shmring_pixels(shmring_t *ring, unsigned slot, unsigned plane)
+{
+    const struct shmring_header *hdr = ring->hdr;
+
+    return (uint8_t *)hdr + hdr->data_offset + slot * hdr->slot_size
+         + hdr->planes[plane].offset;
+}
+
+/* Frees the entry of a reader process that exited without closing */
+static bool ReapReader(struct shmring_reader *reader)
+{
+    uint32_t pid = load_acquire(&reader->pid);
+
+    if (pid == 0)
+        return true;
+    if (kill(pid, 0) == 0 || errno != ESRCH)
+        return false;
+
+    store_release(&reader->held, 0);
+    __atomic_compare_exchange_n(&reader->pid, &pid, 0, false,
+                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    return true;
+}
+
+bool shmring_reuse(shmring_t *ring, unsigned slot)
+{
+    struct shmring_header *hdr = ring->hdr;
+    struct shmring_slot *s = &hdr->slots[slot];
+    const uint64_t seq = s->seq; /* only the writer modifies it */
+    const uint64_t bit = UINT64_C(1) << slot;
+
+    /* Backpressure from the in-order readers */
+    if (seq != 0)
+        for (unsigned i = 0; i < SHMRING_MAX_READERS; i++) {
+            struct shmring_reader *reader = &hdr->readers[i];
+
+            if (load_acquire(&reader->pid) == 0
+             || (load_acquire(&reader->flags) & SHMRING_LOSSY)
+             || load_acquire(&reader->seq) >= seq)
+                continue;
+            if (!ReapReader(reader))
+                return false;
+        }
+
+    store_seq_cst(&s->seq, 0);
+
+    for (unsigned i = 0; i < SHMRING_MAX_READERS; i++) {
+        struct shmring_reader *reader = &hdr->readers[i];
+
+        if ((load_seq_cst(&reader->held) & bit) && !ReapReader(reader)) {
+            /* Still being read, let the readers have it back */
+            store_release(&s->seq, seq);
+            return false;
+        }
+    }
+    return true;
+}
+
+void shmring_publish(shmring_t *ring, unsigned slot, int64_t deadline)
+{
+    struct shmring_header *hdr = ring->hdr;
+    struct shmring_slot *s = &hdr->slots[slot];
+    const uint64_t seq = hdr->write_seq + 1;
+
+    s->deadline = deadline;
+    s->date = Now();
+    store_release(&s->seq, seq);
+    store_release(&hdr->write_seq, seq);
+    store_release(&hdr->futex, (uint32_t)seq);
+    Wake(hdr);
+}
+
+/*** Reader ***/
+
+shmring_t *shmring_open(const char *name, unsigned flags)
+{
+    shmring_t *ring = malloc(sizeof (*ring));
+    if (ring == NULL)
+        return NULL;
+    ring->name = NULL;
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1)
+        goto error;
+
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof (struct shmring_header)) {
+        close(fd);
+        errno = EPROTO;
+        goto error;
+    }
+    ring->size = st.st_size;
+    ring->hdr = mmap(NULL, ring->size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    close(fd);
+    if (ring->hdr == MAP_FAILED)
+        goto error;
+
+    struct shmring_header *hdr = ring->hdr;
+    if (load_acquire(&hdr->magic) != SHMRING_MAGIC
+     || hdr->version != SHMRING_VERSION || hdr->size > ring->size
+     || hdr->slot_count > SHMRING_MAX_SLOTS) {
+        munmap(hdr, ring->size);
+        errno = EPROTO;
+        goto error;
+    }
+
+    /* Register */
+    const uint32_t pid = getpid();
+    for (ring->reader = 0; ring->reader < SHMRING_MAX_READERS; ring->reader++) {
+        struct shmring_reader *reader = &hdr->readers[ring->reader];
+        uint32_t expected = 0;
+
+        if (__atomic_compare_exchange_n(&reader->pid, &expected, pid, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            store_release(&reader->held, 0);
+            store_release(&reader->flags, flags);
+            store_release(&reader->seq, load_acquire(&hdr->write_seq));
+            return ring;
+        }
+    }
+    munmap(hdr, ring->size);
+    errno = EBUSY;
+error:
+    free(ring);
+    return NULL;
+}
+
+void shmring_close(shmring_t *ring)
+{
+    struct shmring_reader *reader = &ring->hdr->readers[ring->reader];
+
+    store_release(&reader->held, 0);
+    store_release(&reader->pid, 0);
+    munmap(ring->hdr, ring->size);
+    free(ring);
+}
+
+void shmring_get_format(const shmring_t *ring, shmring_format_t *fmt)
+{
+    const struct shmring_header *hdr = ring->hdr;
+
+    memset(fmt, 0, sizeof (*fmt));
+    fmt->chroma = hdr->chroma;
+    fmt->width = hdr->width;
+    fmt->height = hdr->height;
+    fmt->sar_num = hdr->sar_num;
+    fmt->sar_den = hdr->sar_den;
+    fmt->plane_count = hdr->plane_count;
+    for (unsigned i = 0; i < hdr->plane_count; i++) {
+        fmt->planes[i].pitch = hdr->planes[i].pitch;
+        fmt->planes[i].lines = hdr->planes[i].lines;
+    }
+}
+
+/* Holds the slot containing a given frame, if any */
+static bool Hold(shmring_t *ring, uint64_t seq, shmring_frame_t *frame)
+{
+    struct shmring_header *hdr = ring->hdr;
+    struct shmring_reader *reader = &hdr->readers[ring->reader];
+
+    for (unsigned i = 0; i < hdr->slot_count; i++) {
+        struct shmring_slot *s = &hdr->slots[i];
+        const uint64_t bit = UINT64_C(1) << i;
+
+        if (load_acquire(&s->seq) != seq)
+            continue;
+
+        __atomic_or_fetch(&reader->held, bit, __ATOMIC_SEQ_CST);
+        if (load_seq_cst(&s->seq) != seq) {
+            /* Taken back by the writer meanwhile */
+            __atomic_and_fetch(&reader->held, ~bit, __ATOMIC_RELEASE);
+            return false;
+        }
+
+        frame->slot = i;
+        frame->seq = seq;
+        frame->deadline = s->deadline;
+        frame->date = s->date;
+        for (unsigned j = 0; j < SHMRING_MAX_PLANES; j++)
+            frame->pixels[j] = (j < hdr->plane_count)
+                ? (const uint8_t *)hdr + hdr->data_offset
+                  + i * hdr->slot_size + hdr->planes[j].offset
+                : NULL;
+        return true;
+    }
+    return false;
+}
+
+int shmring_acquire(shmring_t *ring, shmring_frame_t *frame, int timeout)
+{
+    struct shmring_header *hdr = ring->hdr;
+    struct shmring_reader *reader = &hdr->readers[ring->reader];
+    const bool lossy = (reader->flags & SHMRING_LOSSY) != 0;
+    const int64_t deadline = (timeout >= 0) ? Now() + timeout * INT64_C(1000)
+                                            : -1;
+
+    for (;;) {
+        const uint32_t futex = load_acquire(&hdr->futex);
+        const uint64_t last = load_acquire(&hdr->write_seq);
+        const uint64_t seq = reader->seq;
+
+        if (last > seq) {
+            const uint64_t next = lossy ? last : seq + 1;
+
+            if (Hold(ring, next, frame)) {
+                store_release(&reader->seq, next);
+                return 0;
+            }
+            if (!lossy && !Hold(ring, next, frame)) {
+                /* Only if the entry was reclaimed while we were stopped:
+                 * skip to the frames still available */
+                store_release(&reader->seq, next);
+            }
+            continue;
+        }
+
+        if (load_acquire(&hdr->flags) & SHMRING_CLOSED)
+            return EPIPE;
+        if (deadline >= 0 && Now() >= deadline)
+            return EAGAIN;
+        Wait(hdr, futex, deadline);
+    }
+}
+
+void shmring_release(shmring_t *ring, const shmring_frame_t *frame)
+{
+    struct shmring_reader *reader = &ring->hdr->readers[ring->reader];
+
+    __atomic_and_fetch(&reader->held, ~(UINT64_C(1) << frame->slot),
+                       __ATOMIC_RELEASE);
+}
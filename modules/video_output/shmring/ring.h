@@ -0,0 +1,211 @@
+/**
+ * @file ring.h
+ * @brief Shared memory ring of video frames
+ */
+/*****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_SHMRING_H
+#define VLC_SHMRING_H 1
+
+/*
+ * The ring is a POSIX shared memory object made of a header and of fixed
+ * size frame slots. One process writes frames directly into the slots, and
+ * any number of local processes map the object to read them, without copies.
+ *
+ * Slots are handed over without locks:
+ *  - the writer publishes a slot by giving it the next sequence number,
+ *  - a reader holds a slot by setting the slot bit in its own mask of held
+ *    slots, then checks that the sequence number did not change,
+ *  - the writer only reuses a slot after clearing its sequence number and
+ *    checking that no reader holds it.
+ * Entries of readers that died are reclaimed by the writer.
+ *
+ * Readers registered without SHMRING_LOSSY read all frames in order: the
+ * writer does not reuse a slot that such a reader has not read yet, which
+ * holds the writer back (backpressure). Lossy readers always get the latest
+ * frame, and never hold the writer back.
+ *
+ * This file and ring.c only depend on POSIX and on the GCC atomic built-ins,
+ * so that they can be built into the reading applications as is.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHMRING_MAGIC       0x474e5253 /* "SRNG" */
+#define SHMRING_VERSION     1
+#define SHMRING_MAX_PLANES  4
+#define SHMRING_MAX_SLOTS   64
+#define SHMRING_MAX_READERS 16
+
+/* Header flags */
+#define SHMRING_CLOSED 0x1 /**< the writer is gone */
+
+/* Reader flags */
+#define SHMRING_LOSSY  0x1 /**< skip frames instead of holding the writer */
+
+struct shmring_plane
+{
+    uint32_t offset; /**< from the start of the slot */
+    uint32_t pitch;
+    uint32_t lines;
+    uint32_t reserved;
+};
+
+struct shmring_slot
+{
+    uint64_t seq;    /**< sequence number of the frame, zero if invalid */
+    int64_t  deadline; /**< display deadline (CLOCK_MONOTONIC), in microseconds */
+    int64_t  date;     /**< publication time (CLOCK_MONOTONIC), in microseconds */
+};
+
+struct shmring_reader
+{
+    uint32_t pid;    /**< zero if the entry is free */
+    uint32_t flags;
+    uint64_t seq;    /**< sequence number of the last frame read */
+    uint64_t held;   /**< mask of the slots being read */
+};
+
+struct shmring_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t futex;       /**< low bits of write_seq, to wait for frames */
+    uint64_t write_seq;   /**< sequence number of the last published frame */
+    uint64_t size;        /**< size of the whole object */
+    uint64_t data_offset; /**< offset of the first slot */
+    uint64_t slot_size;
+    uint32_t slot_count;
+
+    /* Frame format */
+    uint32_t chroma;      /**< VLC four character code */
+    uint32_t width;
+    uint32_t height;
+    uint32_t sar_num;
+    uint32_t sar_den;
+    uint32_t plane_count;
+    struct shmring_plane planes[SHMRING_MAX_PLANES];
+
+    struct shmring_reader readers[SHMRING_MAX_READERS];
+    struct shmring_slot slots[SHMRING_MAX_SLOTS];
+};
+
+typedef struct shmring shmring_t;
+
+/** Frame format, as set by the writer */
+typedef struct
+{
+    uint32_t chroma;
+    unsigned width, height;
+    unsigned sar_num, sar_den;
+    unsigned plane_count;
+    struct {
+        size_t   pitch;
+        unsigned lines;
+    } planes[SHMRING_MAX_PLANES];
+} shmring_format_t;
+
+/** Frame held by a reader */
+typedef struct
+{
+    unsigned       slot;
+    uint64_t       seq;
+    int64_t        deadline;
+    int64_t        date;
+    const uint8_t *pixels[SHMRING_MAX_PLANES];
+} shmring_frame_t;
+
+/*
+ * Writer
+ */
+
+/**
+ * Creates a ring, replacing any object with the same name.
+ * @param name POSIX shared memory object name, starting with a slash
+ * @return the ring, or NULL on error (errno is set)
+ */
+shmring_t *shmring_create(const char *name, mode_t mode,
+                          const shmring_format_t *fmt, unsigned slots);
+
+/**
+ * Marks the ring as closed for the readers, and removes its name.
+ */
+void shmring_destroy(shmring_t *);
+
+/**
+ * @return the pixels of the plane of a slot
+ */
+uint8_t *shmring_pixels(shmring_t *, unsigned slot, unsigned plane);
+
+/**
+ * Takes a slot back for writing.
+ *
+ * Readers cannot get the slot anymore once this succeeds.
+ * @return true if the slot can be written, false if it is being read or
+ * not read yet by an in-order reader
+ */
+bool shmring_reuse(shmring_t *, unsigned slot);
+
+/**
+ * Publishes a written slot to the readers, and wakes them up.
+ * @param deadline wall clock time (CLOCK_MONOTONIC, in microseconds) at
+ * which the frame is due on screen; this is not the stream timestamp
+ */
+void shmring_publish(shmring_t *, unsigned slot, int64_t deadline);
+
+/*
+ * Reader
+ */
+
+/**
+ * Maps an existing ring and registers as a reader.
+ * @param flags SHMRING_LOSSY or zero
+ * @return the ring, or NULL on error (errno is set)
+ */
+shmring_t *shmring_open(const char *name, unsigned flags);
+
+/**
+ * Unregisters and unmaps the ring. Held frames are released.
+ */
+void shmring_close(shmring_t *);
+
+/**
+ * @return the frame format of a ring
+ */
+void shmring_get_format(const shmring_t *, shmring_format_t *);
+
+/**
+ * Gets the next frame, and holds its slot until shmring_release().
+ *
+ * @param timeout maximum wait in milliseconds, zero to poll, negative to
+ *                wait forever
+ * @return 0 on success, EAGAIN if no frame came in time, EPIPE if the
+ * writer closed the ring
+ */
+int shmring_acquire(shmring_t *, shmring_frame_t *, int timeout);
+
+/**
+ * Releases a frame obtained by shmring_acquire().
+ */
+void shmring_release(shmring_t *, const shmring_frame_t *);
+
+#endif
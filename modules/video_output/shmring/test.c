@@ -0,0 +1,169 @@
+/*****************************************************************************
+ * test.c: shared memory ring test
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ring.h"
+
+#define FRAMES 2000
+#define SLOTS  4
+#define WIDTH  256
+#define HEIGHT 16
+
+static char name[32];
+
+static void Pause(long us)
+{
+    struct timespec ts = { 0, us * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static bool Check(const shmring_frame_t *frame)
+{
+    for (unsigned i = 0; i < WIDTH * HEIGHT; i++)
+        if (frame->pixels[0][i] != (uint8_t)frame->deadline)
+            return false;
+    return true;
+}
+
+static void *Reader(void *data)
+{
+    shmring_t *ring = data;
+    shmring_frame_t frame;
+    uint64_t last = 0;
+    unsigned count = 0;
+    int val;
+
+    while ((val = shmring_acquire(ring, &frame, -1)) == 0) {
+        assert(frame.seq > last);
+        assert((int64_t)frame.seq == frame.deadline);
+        assert(Check(&frame));
+        if ((count++ % 64) == 0)
+            Pause(2000); /* hold the frame a while */
+        last = frame.seq;
+        shmring_release(ring, &frame);
+    }
+    assert(val == EPIPE);
+    return (void *)(uintptr_t)count;
+}
+
+static void Write(shmring_t *ring, unsigned slot, int64_t deadline)
+{
+    memset(shmring_pixels(ring, slot, 0), (uint8_t)deadline, WIDTH * HEIGHT);
+    shmring_publish(ring, slot, deadline);
+}
+
+int main(void)
+{
+    shmring_format_t fmt = {
+        .chroma = 0x30384f47, /* GREY */
+        .width = WIDTH, .height = HEIGHT, .sar_num = 1, .sar_den = 1,
+        .plane_count = 1,
+        .planes = { { WIDTH, HEIGHT } },
+    };
+    shmring_frame_t frame;
+
+    snprintf(name, sizeof (name), "/vlc-shmring-test-%u",
+             (unsigned)getpid());
+
+    shmring_t *ring = shmring_create(name, 0600, &fmt, SLOTS);
+    if (ring == NULL) {
+        perror("shmring_create");
+        return 77; /* no shared memory (sandbox?): skip */
+    }
+
+    /* Format */
+    shmring_t *in_order = shmring_open(name, 0);
+    assert(in_order != NULL);
+    shmring_get_format(in_order, &fmt);
+    assert(fmt.width == WIDTH && fmt.height == HEIGHT);
+    assert(fmt.plane_count == 1 && fmt.planes[0].pitch == WIDTH);
+    assert(shmring_acquire(in_order, &frame, 0) == EAGAIN);
+
+    /* Backpressure */
+    for (unsigned i = 0; i < SLOTS; i++) {
+        assert(shmring_reuse(ring, i));
+        Write(ring, i, i + 1);
+    }
+    for (unsigned i = 0; i < SLOTS; i++)
+        assert(!shmring_reuse(ring, i)); /* not read yet */
+
+    assert(shmring_acquire(in_order, &frame, 0) == 0);
+    assert(frame.seq == 1 && frame.deadline == 1 && frame.slot == 0);
+    assert(Check(&frame));
+    assert(!shmring_reuse(ring, 0)); /* being read */
+    shmring_release(in_order, &frame);
+    assert(shmring_reuse(ring, 0));
+    assert(!shmring_reuse(ring, 1));
+
+    /* Lossy readers get the latest frame, and do not hold the writer */
+    shmring_t *lossy = shmring_open(name, SHMRING_LOSSY);
+    assert(lossy != NULL);
+    Write(ring, 0, SLOTS + 1);
+    assert(shmring_acquire(lossy, &frame, 0) == 0);
+    assert(frame.seq == SLOTS + 1 && frame.slot == 0);
+    shmring_release(lossy, &frame);
+
+    /* Drain the in-order reader */
+    for (unsigned i = 2; i <= SLOTS + 1; i++) {
+        assert(shmring_acquire(in_order, &frame, 0) == 0);
+        assert(frame.seq == i && Check(&frame));
+        shmring_release(in_order, &frame);
+    }
+    assert(shmring_acquire(in_order, &frame, 10) == EAGAIN);
+
+    /* Concurrent readers */
+    pthread_t th[2];
+    assert(pthread_create(&th[0], NULL, Reader, in_order) == 0);
+    assert(pthread_create(&th[1], NULL, Reader, lossy) == 0);
+
+    for (int64_t seq = SLOTS + 2; seq <= FRAMES; seq++) {
+        unsigned slot = seq % SLOTS;
+
+        while (!shmring_reuse(ring, slot))
+            Pause(100);
+        Write(ring, slot, seq);
+    }
+    shmring_destroy(ring);
+
+    void *count;
+    pthread_join(th[0], &count);
+    assert((uintptr_t)count == FRAMES - SLOTS - 1); /* no frame lost */
+    pthread_join(th[1], &count);
+    printf("lossy reader got %u frames of %u\n", (unsigned)(uintptr_t)count,
+           FRAMES - SLOTS - 1);
+    assert((uintptr_t)count > 0);
+
+    shmring_close(lossy);
+    shmring_close(in_order);
+    assert(shmring_open(name, 0) == NULL && errno == ENOENT);
+    return 0;
+}
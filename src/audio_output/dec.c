@@ -100,6 +100,7 @@ error:
     owner->sync.end = VLC_TS_INVALID;
     owner->sync.resamp_type = AOUT_RESAMPLING_NONE;
     owner->sync.discontinuity = true;
+    owner->sync.has_drift = false;
     aout_OutputUnlock (p_aout);
 
     atomic_init (&owner->buffers_lost, 0);
@@ -240,6 +241,8 @@ static void aout_DecSynchronize (audio_output_t *aout, mtime_t dec_pts,
     if (aout_OutputTimeGet (aout, &drift) != 0)
         return; /* nothing can be done if timing is unknown */
     drift += mdate () - dec_pts;
+    owner->sync.drift = drift;
+    owner->sync.has_drift = true;
 
     /* Late audio output.
      * This can happen due to insufficient caching, scheduling jitter
@@ -398,6 +401,27 @@ int aout_DecGetResetLost (audio_output_t *aout)
     return atomic_exchange(&owner->buffers_lost, 0);
 }
 
+/**
+ * Gets the drift between the actual and intended playback times, as last
+ * measured by aout_DecPlay().
+ * \return 0 on success, -1 if the drift was not measured since last call
+ */
+int aout_DecGetResetDrift (audio_output_t *aout, mtime_t *drift)
+{
+    aout_owner_t *owner = aout_owner (aout);
+    int ret = -1;
+
+    aout_OutputLock (aout);
+    if (owner->sync.has_drift)
+    {
+        *drift = owner->sync.drift;
+        owner->sync.has_drift = false;
+        ret = 0;
+    }
+    aout_OutputUnlock (aout);
+    return ret;
+}
+
 void aout_DecChangePause (audio_output_t *aout, bool paused, mtime_t date)
 {
     aout_owner_t *owner = aout_owner (aout);
@@ -1252,6 +1252,13 @@ static void DecoderPlayAudio(decoder_t *p_dec, block_t *p_audio,
 			if (!aout_DecPlay(p_aout, p_audio, i_rate))
 				*pi_played_sum += 1;
 			*pi_lost_sum += aout_DecGetResetLost(p_aout);
+
+			input_thread_t *p_input = p_owner->p_input;
+			mtime_t i_drift;
+			if (p_input != NULL && p_input->p->counters.p_aout_drift != NULL
+					&& !aout_DecGetResetDrift(p_aout, &i_drift))
+				stats_HistogramRecord(p_input->p->counters.p_aout_drift,
+						llabs(i_drift));
 		} else {
 			msg_Dbg(p_dec, "discarded audio buffer");
 			*pi_lost_sum += 1;
@@ -1263,6 +1270,24 @@ static void DecoderPlayAudio(decoder_t *p_dec, block_t *p_audio,
 	vlc_mutex_unlock(&p_owner->lock);
 }
 
+/**
+ * Decodes audio, recording the decoding time if statistics are enabled.
+ */
+static block_t *DecoderDecodeAudioTimed(decoder_t *p_dec, block_t **pp_block) {
+	input_thread_t *p_input = p_dec->p_owner->p_input;
+	stats_histogram_t *p_histogram =
+			p_input != NULL ? p_input->p->counters.p_decode_audio_time : NULL;
+
+	if (p_histogram == NULL)
+		return p_dec->pf_decode_audio(p_dec, pp_block);
+
+	mtime_t i_start = mdate();
+	block_t *p_aout_buf = p_dec->pf_decode_audio(p_dec, pp_block);
+	if (p_aout_buf != NULL)
+		stats_HistogramRecord(p_histogram, mdate() - i_start);
+	return p_aout_buf;
+}
+
 static void DecoderDecodeAudio(decoder_t *p_dec, block_t *p_block) {
 	decoder_owner_sys_t *p_owner = p_dec->p_owner;
 	block_t *p_aout_buf;
@@ -1274,7 +1299,7 @@ static void DecoderDecodeAudio(decoder_t *p_dec, block_t *p_block) {
 		/* Play a NULL block to output buffered frames */
 		DecoderPlayAudio(p_dec, NULL, &i_played, &i_lost);
 	} else
-		while ((p_aout_buf = p_dec->pf_decode_audio(p_dec, &p_block))) {
+		while ((p_aout_buf = DecoderDecodeAudioTimed(p_dec, &p_block))) {
 			if (DecoderIsExitRequested(p_dec)) {
 				/* It prevent freezing VLC in case of broken decoder */
 				block_Release(p_aout_buf);
@@ -1305,11 +1330,9 @@ static void DecoderDecodeAudio(decoder_t *p_dec, block_t *p_block) {
 	input_thread_t *p_input = p_owner->p_input;
 
 	if (p_input != NULL && (i_decoded > 0 || i_lost > 0 || i_played > 0)) {
-		vlc_mutex_lock(&p_input->p->counters.counters_lock);
-		stats_Update(p_input->p->counters.p_lost_abuffers, i_lost, NULL);
-		stats_Update(p_input->p->counters.p_played_abuffers, i_played, NULL);
-		stats_Update(p_input->p->counters.p_decoded_audio, i_decoded, NULL);
-		vlc_mutex_unlock(&p_input->p->counters.counters_lock);
+		stats_Update(p_input->p->counters.p_lost_abuffers, i_lost);
+		stats_Update(p_input->p->counters.p_played_abuffers, i_played);
+		stats_Update(p_input->p->counters.p_decoded_audio, i_decoded);
 	}
 }
 static void DecoderGetCc(decoder_t *p_dec, decoder_t *p_dec_cc) {
@@ -1354,7 +1377,7 @@ static void DecoderGetCc(decoder_t *p_dec, decoder_t *p_dec_cc) {
 }
 
 static void DecoderPlayVideo(decoder_t *p_dec, picture_t *p_picture,
-		int *pi_played_sum, int *pi_lost_sum) {
+		int *pi_played_sum, int *pi_late_sum, int *pi_lost_sum) {
 	decoder_owner_sys_t *p_owner = p_dec->p_owner;
 	vout_thread_t *p_vout = p_owner->p_vout;
 
@@ -1411,21 +1434,43 @@ static void DecoderPlayVideo(decoder_t *p_dec, picture_t *p_picture,
 		vout_ReleasePicture(p_vout, p_picture);
 	}
 	int i_tmp_display;
+	int i_tmp_late;
 	int i_tmp_lost;
-	vout_GetResetStatistic(p_vout, &i_tmp_display, &i_tmp_lost);
+	vout_GetResetStatistic(p_vout, &i_tmp_display, &i_tmp_late, &i_tmp_lost);
 
 	*pi_played_sum += i_tmp_display;
+	*pi_late_sum += i_tmp_late;
 	*pi_lost_sum += i_tmp_lost;
 }
 
+/**
+ * Decodes video, recording the decoding time if statistics are enabled.
+ */
+static picture_t *DecoderDecodeVideoTimed(decoder_t *p_dec,
+		block_t **pp_block) {
+	input_thread_t *p_input = p_dec->p_owner->p_input;
+	stats_histogram_t *p_histogram =
+			p_input != NULL ? p_input->p->counters.p_decode_video_time : NULL;
+
+	if (p_histogram == NULL)
+		return p_dec->pf_decode_video(p_dec, pp_block);
+
+	mtime_t i_start = mdate();
+	picture_t *p_pic = p_dec->pf_decode_video(p_dec, pp_block);
+	if (p_pic != NULL)
+		stats_HistogramRecord(p_histogram, mdate() - i_start);
+	return p_pic;
+}
+
 static void DecoderDecodeVideo(decoder_t *p_dec, block_t *p_block) {
 	decoder_owner_sys_t *p_owner = p_dec->p_owner;
 	picture_t *p_pic;
 	int i_lost = 0;
+	int i_late = 0;
 	int i_decoded = 0;
 	int i_displayed = 0;
 
-	while ((p_pic = p_dec->pf_decode_video(p_dec, &p_block))) {
+	while ((p_pic = DecoderDecodeVideoTimed(p_dec, &p_block))) {
 		vout_thread_t *p_vout = p_owner->p_vout;
 		if (DecoderIsExitRequested(p_dec)) {
 			/* It prevent freezing VLC in case of broken decoder */
@@ -1455,19 +1500,17 @@ static void DecoderDecodeVideo(decoder_t *p_dec, block_t *p_block) {
 				&& (!p_owner->p_packetizer || !p_owner->p_packetizer->pf_get_cc))
 			DecoderGetCc(p_dec, p_dec);
 
-		DecoderPlayVideo(p_dec, p_pic, &i_displayed, &i_lost);
+		DecoderPlayVideo(p_dec, p_pic, &i_displayed, &i_late, &i_lost);
 	}
 
 	/* Update ugly stat */
 	input_thread_t *p_input = p_owner->p_input;
 
 	if (p_input != NULL && (i_decoded > 0 || i_lost > 0 || i_displayed > 0)) {
-		vlc_mutex_lock(&p_input->p->counters.counters_lock);
-		stats_Update(p_input->p->counters.p_decoded_video, i_decoded, NULL);
-		stats_Update(p_input->p->counters.p_lost_pictures, i_lost, NULL);
-		stats_Update(p_input->p->counters.p_displayed_pictures, i_displayed,
-				NULL);
-		vlc_mutex_unlock(&p_input->p->counters.counters_lock);
+		stats_Update(p_input->p->counters.p_decoded_video, i_decoded);
+		stats_Update(p_input->p->counters.p_late_pictures, i_late);
+		stats_Update(p_input->p->counters.p_lost_pictures, i_lost);
+		stats_Update(p_input->p->counters.p_displayed_pictures, i_displayed);
 	}
 }
 
@@ -1713,11 +1756,8 @@ static void DecoderProcessSpu(decoder_t *p_dec, block_t *p_block, bool b_flush)
 	subpicture_t *p_spu;
 
 	while ((p_spu = p_dec->pf_decode_sub(p_dec, p_block ? &p_block : NULL))) {
-		if (p_input != NULL) {
-			vlc_mutex_lock(&p_input->p->counters.counters_lock);
-			stats_Update(p_input->p->counters.p_decoded_sub, 1, NULL);
-			vlc_mutex_unlock(&p_input->p->counters.counters_lock);
-		}
+		if (p_input != NULL)
+			stats_Update(p_input->p->counters.p_decoded_sub, 1);
 
 		p_vout = input_resource_HoldVout(p_owner->p_resource);
 		if (p_vout && p_owner->p_spu_vout == p_vout) {
@@ -189,18 +189,43 @@ int input_Preparse( vlc_object_t *p_parent, input_item_t *p_item )
     input_thread_t *p_input;
 
     /* Allocate descriptor */
-    p_input = Create( p_parent, p_item, NULL, true, NULL );
+    p_input = input_CreatePreparser( p_parent, p_item );
     if( !p_input )
         return VLC_EGENERIC;
 
-    if( !Init( p_input ) )
-        End( p_input );
+    input_RunPreparser( p_input );
 
     vlc_object_release( p_input );
 
     return VLC_SUCCESS;
 }
 
+/**
+ * Create an input to preparse the item with input_RunPreparser().
+ *
+ * Until it is released, ObjectKillChildrens() on the input aborts the
+ * preparsing from another thread.
+ */
+input_thread_t *input_CreatePreparser( vlc_object_t *p_parent,
+                                       input_item_t *p_item )
+{
+    return Create( p_parent, p_item, NULL, true, NULL );
+}
+
+/**
+ * Preparse the item of an input created by input_CreatePreparser().
+ * This function is blocking.
+ *
+ * \return VLC_SUCCESS if the item could be opened, or VLC_EGENERIC
+ */
+int input_RunPreparser( input_thread_t *p_input )
+{
+    if( Init( p_input ) )
+        return VLC_EGENERIC;
+    End( p_input );
+    return VLC_SUCCESS;
+}
+
 /**
  * Start a input_thread_t created by input_Create.
  *
@@ -462,7 +487,6 @@ static input_thread_t *Create( vlc_object_t *p_parent, input_item_t *p_item,
 
     /* */
     memset( &p_input->p->counters, 0, sizeof( p_input->p->counters ) );
-    vlc_mutex_init( &p_input->p->counters.counters_lock );
 
     p_input->p->p_es_out_display = input_EsOutNew( p_input, p_input->p->i_rate );
     p_input->p->p_es_out = NULL;
@@ -494,8 +518,6 @@ static void Destructor( input_thread_t * p_input )
 
     vlc_gc_decref( p_input->p->p_item );
 
-    vlc_mutex_destroy( &p_input->p->counters.counters_lock );
-
     for( int i = 0; i < p_input->p->i_control; i++ )
     {
         input_control_t *p_ctrl = &p_input->p->control[i];
@@ -823,28 +845,30 @@ static void InitStatistics( input_thread_t * p_input )
     if( p_input->b_preparsing ) return;
 
     /* Prepare statistics */
-#define INIT_COUNTER( c, compute ) p_input->p->counters.p_##c = \
- stats_CounterCreate( STATS_##compute);
+#define INIT_COUNTER( c ) p_input->p->counters.p_##c = stats_CounterCreate();
+#define INIT_HISTOGRAM( h ) p_input->p->counters.p_##h = stats_HistogramCreate();
     if( libvlc_stats( p_input ) )
     {
-        INIT_COUNTER( read_bytes, COUNTER );
-        INIT_COUNTER( read_packets, COUNTER );
-        INIT_COUNTER( demux_read, COUNTER );
-        INIT_COUNTER( input_bitrate, DERIVATIVE );
-        INIT_COUNTER( demux_bitrate, DERIVATIVE );
-        INIT_COUNTER( demux_corrupted, COUNTER );
-        INIT_COUNTER( demux_discontinuity, COUNTER );
-        INIT_COUNTER( played_abuffers, COUNTER );
-        INIT_COUNTER( lost_abuffers, COUNTER );
-        INIT_COUNTER( displayed_pictures, COUNTER );
-        INIT_COUNTER( lost_pictures, COUNTER );
-        INIT_COUNTER( decoded_audio, COUNTER );
-        INIT_COUNTER( decoded_video, COUNTER );
-        INIT_COUNTER( decoded_sub, COUNTER );
-        p_input->p->counters.p_sout_send_bitrate = NULL;
+        INIT_COUNTER( read_bytes );
+        INIT_COUNTER( read_packets );
+        INIT_COUNTER( demux_read );
+        INIT_COUNTER( demux_corrupted );
+        INIT_COUNTER( demux_discontinuity );
+        INIT_COUNTER( played_abuffers );
+        INIT_COUNTER( lost_abuffers );
+        INIT_COUNTER( displayed_pictures );
+        INIT_COUNTER( late_pictures );
+        INIT_COUNTER( lost_pictures );
+        INIT_COUNTER( decoded_audio );
+        INIT_COUNTER( decoded_video );
+        INIT_COUNTER( decoded_sub );
+        INIT_HISTOGRAM( decode_audio_time );
+        INIT_HISTOGRAM( decode_video_time );
+        INIT_HISTOGRAM( aout_drift );
         p_input->p->counters.p_sout_sent_packets = NULL;
         p_input->p->counters.p_sout_sent_bytes = NULL;
     }
+#undef INIT_HISTOGRAM
 }
 
 #ifdef ENABLE_SOUT
@@ -868,9 +892,8 @@ static int InitSout( input_thread_t * p_input )
         }
         if( libvlc_stats( p_input ) )
         {
-            INIT_COUNTER( sout_sent_packets, COUNTER );
-            INIT_COUNTER( sout_sent_bytes, COUNTER );
-            INIT_COUNTER( sout_send_bitrate, DERIVATIVE );
+            INIT_COUNTER( sout_sent_packets );
+            INIT_COUNTER( sout_sent_bytes );
         }
     }
     else
@@ -1305,27 +1328,31 @@ error:
 #define EXIT_COUNTER( c ) do { if( p_input->p->counters.p_##c ) \
                                    stats_CounterClean( p_input->p->counters.p_##c );\
                                p_input->p->counters.p_##c = NULL; } while(0)
+#define EXIT_HISTOGRAM( h ) do { stats_HistogramClean( p_input->p->counters.p_##h );\
+                                 p_input->p->counters.p_##h = NULL; } while(0)
         EXIT_COUNTER( read_bytes );
         EXIT_COUNTER( read_packets );
         EXIT_COUNTER( demux_read );
-        EXIT_COUNTER( input_bitrate );
-        EXIT_COUNTER( demux_bitrate );
         EXIT_COUNTER( demux_corrupted );
         EXIT_COUNTER( demux_discontinuity );
         EXIT_COUNTER( played_abuffers );
         EXIT_COUNTER( lost_abuffers );
         EXIT_COUNTER( displayed_pictures );
+        EXIT_COUNTER( late_pictures );
         EXIT_COUNTER( lost_pictures );
         EXIT_COUNTER( decoded_audio );
         EXIT_COUNTER( decoded_video );
         EXIT_COUNTER( decoded_sub );
+        EXIT_HISTOGRAM( decode_audio_time );
+        EXIT_HISTOGRAM( decode_video_time );
+        EXIT_HISTOGRAM( aout_drift );
 
         if( p_input->p->p_sout )
         {
             EXIT_COUNTER( sout_sent_packets );
             EXIT_COUNTER( sout_sent_bytes );
-            EXIT_COUNTER( sout_send_bitrate );
         }
+#undef EXIT_HISTOGRAM
 #undef EXIT_COUNTER
     }
 
@@ -1372,6 +1399,7 @@ static void End( input_thread_t * p_input )
     if( !p_input->b_preparsing )
     {
 #define CL_CO( c ) stats_CounterClean( p_input->p->counters.p_##c ); p_input->p->counters.p_##c = NULL;
+#define CL_HI( h ) stats_HistogramClean( p_input->p->counters.p_##h ); p_input->p->counters.p_##h = NULL;
         if( libvlc_stats( p_input ) )
         {
             /* make sure we are up to date */
@@ -1379,17 +1407,19 @@ static void End( input_thread_t * p_input )
             CL_CO( read_bytes );
             CL_CO( read_packets );
             CL_CO( demux_read );
-            CL_CO( input_bitrate );
-            CL_CO( demux_bitrate );
             CL_CO( demux_corrupted );
             CL_CO( demux_discontinuity );
             CL_CO( played_abuffers );
             CL_CO( lost_abuffers );
             CL_CO( displayed_pictures );
+            CL_CO( late_pictures );
             CL_CO( lost_pictures );
             CL_CO( decoded_audio) ;
             CL_CO( decoded_video );
             CL_CO( decoded_sub) ;
+            CL_HI( decode_audio_time );
+            CL_HI( decode_video_time );
+            CL_HI( aout_drift );
         }
 
         /* Close optional stream output instance */
@@ -1397,8 +1427,8 @@ static void End( input_thread_t * p_input )
         {
             CL_CO( sout_sent_packets );
             CL_CO( sout_sent_bytes );
-            CL_CO( sout_send_bitrate );
         }
+#undef CL_HI
 #undef CL_CO
     }
 
@@ -3080,10 +3110,9 @@ void input_UpdateStatistic( input_thread_t *p_input,
 {
     assert( p_input->p->i_state != INIT_S );
 
-    vlc_mutex_lock( &p_input->p->counters.counters_lock);
     switch( i_type )
     {
-#define I(c) stats_Update( p_input->p->counters.c, i_delta, NULL )
+#define I(c) stats_Update( p_input->p->counters.c, i_delta )
     case INPUT_STATISTIC_DECODED_VIDEO:
         I(p_decoded_video);
         break;
@@ -3096,20 +3125,14 @@ void input_UpdateStatistic( input_thread_t *p_input,
     case INPUT_STATISTIC_SENT_PACKET:
         I(p_sout_sent_packets);
         break;
-#undef I
     case INPUT_STATISTIC_SENT_BYTE:
-    {
-        uint64_t bytes;
-
-        stats_Update( p_input->p->counters.p_sout_sent_bytes, i_delta, &bytes );
-        stats_Update( p_input->p->counters.p_sout_send_bitrate, bytes, NULL );
+        I(p_sout_sent_bytes);
         break;
-    }
+#undef I
     default:
         msg_Err( p_input, "Invalid statistic type %d (internal error)", i_type );
         break;
     }
-    vlc_mutex_unlock( &p_input->p->counters.counters_lock);
 }
 
 /**/
@@ -133,13 +133,11 @@ struct input_thread_private_t
     input_resource_t *p_resource;
     input_resource_t *p_resource_private;
 
-    /* Stats counters */
+    /* Stats counters (NULL if the statistics are disabled) */
     struct {
         counter_t *p_read_packets;
         counter_t *p_read_bytes;
-        counter_t *p_input_bitrate;
         counter_t *p_demux_read;
-        counter_t *p_demux_bitrate;
         counter_t *p_demux_corrupted;
         counter_t *p_demux_discontinuity;
         counter_t *p_decoded_audio;
@@ -147,12 +145,22 @@ struct input_thread_private_t
         counter_t *p_decoded_sub;
         counter_t *p_sout_sent_packets;
         counter_t *p_sout_sent_bytes;
-        counter_t *p_sout_send_bitrate;
         counter_t *p_played_abuffers;
         counter_t *p_lost_abuffers;
         counter_t *p_displayed_pictures;
+        counter_t *p_late_pictures;
         counter_t *p_lost_pictures;
-        vlc_mutex_t counters_lock;
+        stats_histogram_t *p_decode_audio_time;
+        stats_histogram_t *p_decode_video_time;
+        stats_histogram_t *p_aout_drift;
+
+        /* Totals at the last computation of the rates */
+        struct {
+            mtime_t  date;
+            uint64_t read_bytes;
+            uint64_t demux_read;
+            uint64_t sent_bytes;
+        } last;
     } counters;
 
     /* Buffer of pending actions */
@@ -25,44 +25,102 @@
 # include "config.h"
 #endif
 
+#include <limits.h>
+
 #include <vlc_common.h>
 #include "input/input_internal.h"
 
 /**
  * Create a statistics counter
- * \param i_compute_type the aggregation type. One of STATS_LAST (always
- * keep the last value), STATS_COUNTER (increment by the passed value),
- * STATS_MAX (keep the maximum passed value), STATS_MIN, or STATS_DERIVATIVE
- * (keep a time derivative of the value)
  */
-counter_t * stats_CounterCreate( int i_compute_type )
+counter_t * stats_CounterCreate( void )
 {
-    counter_t *p_counter = (counter_t*) malloc( sizeof( counter_t ) ) ;
+    counter_t *p_counter = malloc( sizeof( counter_t ) ) ;
 
     if( !p_counter ) return NULL;
-    p_counter->i_compute_type = i_compute_type;
-    p_counter->i_samples = 0;
-    p_counter->pp_samples = NULL;
+    atomic_init( &p_counter->value, 0 );
+    return p_counter;
+}
 
-    p_counter->last_update = 0;
+void stats_CounterClean( counter_t *p_c )
+{
+    free( p_c );
+}
 
-    return p_counter;
+struct stats_histogram_t
+{
+    atomic_uint_least64_t sum;
+    atomic_uint buckets[INPUT_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * Create a statistics histogram
+ */
+stats_histogram_t *stats_HistogramCreate( void )
+{
+    stats_histogram_t *p_histogram = malloc( sizeof( *p_histogram ) );
+
+    if( !p_histogram ) return NULL;
+    atomic_init( &p_histogram->sum, 0 );
+    for( unsigned i = 0; i < INPUT_HISTOGRAM_BUCKETS; i++ )
+        atomic_init( &p_histogram->buckets[i], 0 );
+    return p_histogram;
+}
+
+void stats_HistogramClean( stats_histogram_t *p_histogram )
+{
+    free( p_histogram );
 }
 
-static inline int64_t stats_GetTotal(const counter_t *counter)
+/**
+ * Add a value to a histogram
+ * \param i_value duration in microseconds
+ */
+void stats_HistogramRecord( stats_histogram_t *p_histogram, mtime_t i_value )
 {
-    if (counter == NULL || counter->i_samples == 0)
-        return 0;
-    return counter->pp_samples[0]->value;
+    unsigned i_bucket = 0;
+
+    if( p_histogram == NULL )
+        return;
+
+    if( i_value > UINT_MAX )
+        i_bucket = INPUT_HISTOGRAM_BUCKETS - 1;
+    else if( i_value > 0 )
+    {
+        i_bucket = sizeof( unsigned ) * 8 - clz( i_value );
+        if( i_bucket >= INPUT_HISTOGRAM_BUCKETS )
+            i_bucket = INPUT_HISTOGRAM_BUCKETS - 1;
+    }
+    else
+        i_value = 0;
+
+    atomic_fetch_add_explicit( &p_histogram->buckets[i_bucket], 1,
+                               memory_order_relaxed );
+    atomic_fetch_add_explicit( &p_histogram->sum, i_value,
+                               memory_order_relaxed );
 }
 
-static inline float stats_GetRate(const counter_t *counter)
+/**
+ * Read a histogram
+ * The values being recorded meanwhile may or may not be included, and may be
+ * included in the sum but not in the buckets, or the other way round.
+ */
+static void stats_HistogramRead( stats_histogram_t *p_histogram,
+                                 input_histogram_t *p_out )
 {
-    if (counter == NULL || counter->i_samples < 2)
-        return 0.;
+    memset( p_out, 0, sizeof( *p_out ) );
+    if( p_histogram == NULL )
+        return;
 
-    return (counter->pp_samples[0]->value - counter->pp_samples[1]->value)
-        / (float)(counter->pp_samples[0]->date - counter->pp_samples[1]->date);
+    p_out->i_sum = atomic_load_explicit( &p_histogram->sum,
+                                         memory_order_relaxed );
+    for( unsigned i = 0; i < INPUT_HISTOGRAM_BUCKETS; i++ )
+    {
+        p_out->pi_buckets[i] =
+            atomic_load_explicit( &p_histogram->buckets[i],
+                                  memory_order_relaxed );
+        p_out->i_count += p_out->pi_buckets[i];
+    }
 }
 
 input_stats_t *stats_NewInputStats( input_thread_t *p_input )
@@ -78,45 +136,76 @@ input_stats_t *stats_NewInputStats( input_thread_t *p_input )
     return p_stats;
 }
 
+static float stats_GetRate( uint64_t i_new, uint64_t i_old, mtime_t i_delay )
+{
+    return (i_new - i_old) / (float)i_delay;
+}
+
 void stats_ComputeInputStats(input_thread_t *input, input_stats_t *st)
 {
     if (!libvlc_stats(input))
         return;
 
-    vlc_mutex_lock(&input->p->counters.counters_lock);
+    uint64_t read_bytes = stats_GetTotal(input->p->counters.p_read_bytes);
+    uint64_t demux_read = stats_GetTotal(input->p->counters.p_demux_read);
+    uint64_t sent_bytes = stats_GetTotal(input->p->counters.p_sout_sent_bytes);
+    mtime_t now = mdate();
+    mtime_t delay = now - input->p->counters.last.date;
+
     vlc_mutex_lock(&st->lock);
 
     /* Input */
     st->i_read_packets = stats_GetTotal(input->p->counters.p_read_packets);
-    st->i_read_bytes = stats_GetTotal(input->p->counters.p_read_bytes);
-    st->f_input_bitrate = stats_GetRate(input->p->counters.p_input_bitrate);
-    st->i_demux_read_bytes = stats_GetTotal(input->p->counters.p_demux_read);
-    st->f_demux_bitrate = stats_GetRate(input->p->counters.p_demux_bitrate);
+    st->i_read_bytes = read_bytes;
+    st->i_demux_read_bytes = demux_read;
     st->i_demux_corrupted = stats_GetTotal(input->p->counters.p_demux_corrupted);
     st->i_demux_discontinuity = stats_GetTotal(input->p->counters.p_demux_discontinuity);
 
     /* Decoders */
     st->i_decoded_video = stats_GetTotal(input->p->counters.p_decoded_video);
     st->i_decoded_audio = stats_GetTotal(input->p->counters.p_decoded_audio);
+    stats_HistogramRead(input->p->counters.p_decode_video_time,
+                        &st->decode_video_time);
+    stats_HistogramRead(input->p->counters.p_decode_audio_time,
+                        &st->decode_audio_time);
 
     /* Sout */
-    if (input->p->counters.p_sout_send_bitrate)
+    if (input->p->counters.p_sout_sent_bytes)
     {
         st->i_sent_packets = stats_GetTotal(input->p->counters.p_sout_sent_packets);
-        st->i_sent_bytes = stats_GetTotal(input->p->counters.p_sout_sent_bytes);
-        st->f_send_bitrate = stats_GetRate(input->p->counters.p_sout_send_bitrate);
+        st->i_sent_bytes = sent_bytes;
     }
 
     /* Aout */
     st->i_played_abuffers = stats_GetTotal(input->p->counters.p_played_abuffers);
     st->i_lost_abuffers = stats_GetTotal(input->p->counters.p_lost_abuffers);
+    stats_HistogramRead(input->p->counters.p_aout_drift, &st->aout_drift);
 
     /* Vouts */
     st->i_displayed_pictures = stats_GetTotal(input->p->counters.p_displayed_pictures);
+    st->i_late_pictures = stats_GetTotal(input->p->counters.p_late_pictures);
     st->i_lost_pictures = stats_GetTotal(input->p->counters.p_lost_pictures);
 
+    /* Rates, over one second at least */
+    if (delay >= CLOCK_FREQ)
+    {
+        if (input->p->counters.last.date != 0)
+        {
+            st->f_input_bitrate = stats_GetRate(read_bytes,
+                                    input->p->counters.last.read_bytes, delay);
+            st->f_demux_bitrate = stats_GetRate(demux_read,
+                                    input->p->counters.last.demux_read, delay);
+            if (input->p->counters.p_sout_sent_bytes)
+                st->f_send_bitrate = stats_GetRate(sent_bytes,
+                                    input->p->counters.last.sent_bytes, delay);
+        }
+        input->p->counters.last.date = now;
+        input->p->counters.last.read_bytes = read_bytes;
+        input->p->counters.last.demux_read = demux_read;
+        input->p->counters.last.sent_bytes = sent_bytes;
+    }
+
     vlc_mutex_unlock(&st->lock);
-    vlc_mutex_unlock(&input->p->counters.counters_lock);
 }
 
 void stats_ReinitInputStats( input_stats_t *p_stats )
@@ -127,82 +216,14 @@ void stats_ReinitInputStats( input_stats_t *p_stats )
     p_stats->i_demux_read_packets = p_stats->i_demux_read_bytes =
     p_stats->f_demux_bitrate = p_stats->f_average_demux_bitrate =
     p_stats->i_demux_corrupted = p_stats->i_demux_discontinuity =
-    p_stats->i_displayed_pictures = p_stats->i_lost_pictures =
+    p_stats->i_displayed_pictures = p_stats->i_late_pictures =
+    p_stats->i_lost_pictures =
     p_stats->i_played_abuffers = p_stats->i_lost_abuffers =
     p_stats->i_decoded_video = p_stats->i_decoded_audio =
     p_stats->i_sent_bytes = p_stats->i_sent_packets = p_stats->f_send_bitrate
      = 0;
+    memset( &p_stats->decode_audio_time, 0, sizeof( input_histogram_t ) );
+    memset( &p_stats->decode_video_time, 0, sizeof( input_histogram_t ) );
+    memset( &p_stats->aout_drift, 0, sizeof( input_histogram_t ) );
     vlc_mutex_unlock( &p_stats->lock );
 }
-
-void stats_CounterClean( counter_t *p_c )
-{
-    if( p_c )
-    {
-        int i = p_c->i_samples - 1 ;
-        while( i >= 0 )
-        {
-            counter_sample_t *p_s = p_c->pp_samples[i];
-            REMOVE_ELEM( p_c->pp_samples, p_c->i_samples, i );
-            free( p_s );
-            i--;
-        }
-        free( p_c );
-    }
-}
-
-
-/** Update a counter element with new values
- * \param p_counter the counter to update
- * \param val the vlc_value union containing the new value to aggregate. For
- * more information on how data is aggregated, \see stats_Create
- * \param val_new a pointer that will be filled with new data
- */
-void stats_Update( counter_t *p_counter, uint64_t val, uint64_t *new_val )
-{
-    if( !p_counter )
-        return;
-
-    switch( p_counter->i_compute_type )
-    {
-    case STATS_DERIVATIVE:
-    {
-        counter_sample_t *p_new, *p_old;
-        mtime_t now = mdate();
-        if( now - p_counter->last_update < CLOCK_FREQ )
-            return;
-        p_counter->last_update = now;
-        /* Insert the new one at the beginning */
-        p_new = (counter_sample_t*)malloc( sizeof( counter_sample_t ) );
-        p_new->value = val;
-        p_new->date = p_counter->last_update;
-        INSERT_ELEM( p_counter->pp_samples, p_counter->i_samples,
-                     0, p_new );
-
-        if( p_counter->i_samples == 3 )
-        {
-            p_old = p_counter->pp_samples[2];
-            REMOVE_ELEM( p_counter->pp_samples, p_counter->i_samples, 2 );
-            free( p_old );
-        }
-        break;
-    }
-    case STATS_COUNTER:
-        if( p_counter->i_samples == 0 )
-        {
-            counter_sample_t *p_new = (counter_sample_t*)malloc(
-                                               sizeof( counter_sample_t ) );
-            p_new->value = 0;
-
-            INSERT_ELEM( p_counter->pp_samples, p_counter->i_samples,
-                         p_counter->i_samples, p_new );
-        }
-        if( p_counter->i_samples == 1 )
-        {
-            p_counter->pp_samples[0]->value += val;
-            if( new_val )
-                *new_val = p_counter->pp_samples[0]->value;
-        }
-        break;
-    }
-}
@@ -1670,13 +1670,8 @@ static int AReadStream( stream_t *s, void *p_read, unsigned int i_read )
         i_read = p_access->pf_read( p_access, p_read, i_read );
         if( p_input )
         {
-            uint64_t total;
-
-            vlc_mutex_lock( &p_input->p->counters.counters_lock );
-            stats_Update( p_input->p->counters.p_read_bytes, i_read, &total );
-            stats_Update( p_input->p->counters.p_input_bitrate, total, NULL );
-            stats_Update( p_input->p->counters.p_read_packets, 1, NULL );
-            vlc_mutex_unlock( &p_input->p->counters.counters_lock );
+            stats_Update( p_input->p->counters.p_read_bytes, i_read );
+            stats_Update( p_input->p->counters.p_read_packets, 1 );
         }
         return i_read;
     }
@@ -1708,13 +1703,8 @@ static int AReadStream( stream_t *s, void *p_read, unsigned int i_read )
     /* Update read bytes in input */
     if( p_input )
     {
-        uint64_t total;
-
-        vlc_mutex_lock( &p_input->p->counters.counters_lock );
-        stats_Update( p_input->p->counters.p_read_bytes, i_read, &total );
-        stats_Update( p_input->p->counters.p_input_bitrate, total, NULL );
-        stats_Update( p_input->p->counters.p_read_packets, 1, NULL );
-        vlc_mutex_unlock( &p_input->p->counters.counters_lock );
+        stats_Update( p_input->p->counters.p_read_bytes, i_read );
+        stats_Update( p_input->p->counters.p_read_packets, 1 );
     }
     return i_read;
 }
@@ -1731,17 +1721,10 @@ static block_t *AReadBlock( stream_t *s, bool *pb_eof )
     {
         p_block = p_access->pf_block( p_access );
         if( pb_eof ) *pb_eof = p_access->info.b_eof;
-        if( p_input && p_block && libvlc_stats (p_access) )
+        if( p_input && p_block )
         {
-            uint64_t total;
-
-            vlc_mutex_lock( &p_input->p->counters.counters_lock );
-            stats_Update( p_input->p->counters.p_read_bytes,
-                          p_block->i_buffer, &total );
-            stats_Update( p_input->p->counters.p_input_bitrate,
-                          total, NULL );
-            stats_Update( p_input->p->counters.p_read_packets, 1, NULL );
-            vlc_mutex_unlock( &p_input->p->counters.counters_lock );
+            stats_Update( p_input->p->counters.p_read_bytes, p_block->i_buffer );
+            stats_Update( p_input->p->counters.p_read_packets, 1 );
         }
         return p_block;
     }
@@ -1774,14 +1757,8 @@ static block_t *AReadBlock( stream_t *s, bool *pb_eof )
     {
         if( p_input )
         {
-            uint64_t total;
-
-            vlc_mutex_lock( &p_input->p->counters.counters_lock );
-            stats_Update( p_input->p->counters.p_read_bytes,
-                          p_block->i_buffer, &total );
-            stats_Update( p_input->p->counters.p_input_bitrate, total, NULL );
-            stats_Update( p_input->p->counters.p_read_packets, 1 , NULL);
-            vlc_mutex_unlock( &p_input->p->counters.counters_lock );
+            stats_Update( p_input->p->counters.p_read_bytes, p_block->i_buffer );
+            stats_Update( p_input->p->counters.p_read_packets, 1 );
         }
     }
     return p_block;
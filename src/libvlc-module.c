@@ -384,6 +384,11 @@ static const char *const ppsz_pos_descriptions[] =
     "picture quality, for instance deinterlacing, or distort " \
     "the video.")
 
+#define VIDEO_FILTER_THREADS_TEXT N_("Video filter threads")
+#define VIDEO_FILTER_THREADS_LONGTEXT N_( \
+    "Number of threads the video filters supporting it can split " \
+    "pictures across. 0 uses one thread per CPU, 1 disables threading.")
+
 #define SNAP_PATH_TEXT N_("Video snapshot directory (or filename)")
 #define SNAP_PATH_LONGTEXT N_( \
     "Directory where the video snapshots will be stored.")
@@ -1113,6 +1118,21 @@ static const char *const ppsz_prefres[] = {
     "Automatically preparse files added to the playlist " \
     "(to retrieve some metadata)." )
 
+#define PREPARSE_THREADS_TEXT N_( "Preparser threads" )
+#define PREPARSE_THREADS_LONGTEXT N_( \
+    "Number of files that are preparsed at the same time, by the playlist " \
+    "and by the applications together. 0 uses one thread per CPU." )
+
+#define PREPARSE_TIMEOUT_TEXT N_( "Preparsing timeout" )
+#define PREPARSE_TIMEOUT_LONGTEXT N_( \
+    "Maximum time in milliseconds spent preparsing one file, " \
+    "or 0 for no limit." )
+
+#define PREPARSE_CACHE_TEXT N_( "Preparsing cache size" )
+#define PREPARSE_CACHE_LONGTEXT N_( \
+    "Maximum number of local files whose preparsing results are kept " \
+    "from one session to the next, or 0 to disable the cache." )
+
 #define METADATA_NETWORK_TEXT N_( "Allow metadata network access" )
 
 #define SD_TEXT N_( "Services discovery modules")
@@ -1609,6 +1629,8 @@ vlc_module_begin ()
     set_subcategory( SUBCAT_VIDEO_VFILTER )
     add_module_list_cat( "video-filter", SUBCAT_VIDEO_VFILTER, NULL,
                 VIDEO_FILTER_TEXT, VIDEO_FILTER_LONGTEXT, false )
+    add_integer_with_range( "filter-threads", 0, 0, 64,
+                VIDEO_FILTER_THREADS_TEXT, VIDEO_FILTER_THREADS_LONGTEXT, true )
     add_module_list( "video-splitter", "video splitter", NULL,
                      VIDEO_SPLITTER_TEXT, VIDEO_SPLITTER_LONGTEXT, false )
     add_obsolete_string( "vout-filter" ) /* since 2.0.0 */
@@ -2027,6 +2049,15 @@ vlc_module_begin ()
 
     add_bool( "auto-preparse", true, PREPARSE_TEXT,
               PREPARSE_LONGTEXT, false )
+    add_integer_with_range( "preparse-threads", 0, 0, 32,
+                            PREPARSE_THREADS_TEXT, PREPARSE_THREADS_LONGTEXT,
+                            true )
+    add_integer_with_range( "preparse-timeout", 0, 0, 600000,
+                            PREPARSE_TIMEOUT_TEXT, PREPARSE_TIMEOUT_LONGTEXT,
+                            true )
+    add_integer_with_range( "preparse-cache-size", 100000, 0, 10000000,
+                            PREPARSE_CACHE_TEXT, PREPARSE_CACHE_LONGTEXT,
+                            true )
 
     add_obsolete_integer( "album-art" )
     add_bool( "metadata-network-access", false, METADATA_NETWORK_TEXT,
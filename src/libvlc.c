@@ -43,6 +43,7 @@
 #include "modules/modules.h"
 #include "config/configuration.h"
 #include "playlist/preparser.h"
+#include "playlist/metacache.h"
 
 #include <stdio.h>                                              /* sprintf() */
 #include <string.h>
@@ -65,6 +66,7 @@
 #include <vlc_cpu.h>
 #include <vlc_url.h>
 #include <vlc_modules.h>
+#include <vlc_threadpool.h>
 
 #include "libvlc.h"
 #include "playlist/playlist_internal.h"
@@ -102,6 +104,9 @@ libvlc_int_t * libvlc_InternalCreate( void )
     priv->playlist = NULL;
     priv->p_dialog_provider = NULL;
     priv->p_vlm = NULL;
+    priv->filter_pool = NULL;
+    priv->preparse_pool = NULL;
+    priv->preparse_cache = NULL;
 
     vlc_ExitInit( &priv->exit );
 
@@ -356,10 +361,32 @@ dbus_out:
     priv->actions = vlc_InitActions( p_libvlc );
 
     /*
-     * Meta data handling
+     * Meta data handling, with workers and results cache shared with the
+     * playlist preparser
      */
+    priv->preparse_pool = vlc_threadpool_create(
+                            var_InheritInteger( p_libvlc, "preparse-threads" ) );
+
+    unsigned i_cache = var_InheritInteger( p_libvlc, "preparse-cache-size" );
+    char *psz_cachedir = config_GetUserDir( VLC_CACHE_DIR );
+    char *psz_cache;
+    if( i_cache > 0 && psz_cachedir != NULL
+     && asprintf( &psz_cache, "%s" DIR_SEP "preparse.dat", psz_cachedir ) != -1 )
+    {
+        priv->preparse_cache = playlist_metacache_New( VLC_OBJECT(p_libvlc),
+                                                       psz_cache, i_cache );
+        free( psz_cache );
+    }
+    free( psz_cachedir );
     priv->parser = playlist_preparser_New(VLC_OBJECT(p_libvlc));
 
+    /*
+     * Video filter slice workers (started on demand)
+     */
+    unsigned filter_threads = var_InheritInteger( p_libvlc, "filter-threads" );
+    if( filter_threads != 1 )
+        priv->filter_pool = vlc_threadpool_create( filter_threads );
+
     /* Create a variable for showing the fullscreen interface */
     var_Create( p_libvlc, "intf-toggle-fscontrol", VLC_VAR_BOOL );
     var_SetBool( p_libvlc, "intf-toggle-fscontrol", true );
@@ -544,9 +571,17 @@ void libvlc_InternalCleanup( libvlc_int_t *p_libvlc )
 
     if (priv->parser != NULL)
         playlist_preparser_Delete(priv->parser);
+    /* The playlist preparser is gone too, with the interfaces */
+    if (priv->preparse_pool != NULL)
+        vlc_threadpool_destroy(priv->preparse_pool);
+    if (priv->preparse_cache != NULL)
+        playlist_metacache_Delete(priv->preparse_cache);
 
     vlc_DeinitActions( p_libvlc, priv->actions );
 
+    if( priv->filter_pool != NULL )
+        vlc_threadpool_destroy( priv->filter_pool );
+
     /* Save the configuration */
     if( !var_InheritBool( p_libvlc, "ignore-config" ) )
         config_AutoSaveConfigFile( VLC_OBJECT(p_libvlc) );
@@ -631,6 +666,21 @@ int libvlc_MetaRequest(libvlc_int_t *libvlc, input_item_t *item,
     return VLC_SUCCESS;
 }
 
+/**
+ * Gets the statistics of the meta data extraction requests.
+ */
+int libvlc_MetaRequestStats(libvlc_int_t *libvlc,
+                            input_preparser_stats_t *stats)
+{
+    libvlc_priv_t *priv = libvlc_priv(libvlc);
+
+    if (unlikely(priv->parser == NULL))
+        return VLC_ENOMEM;
+
+    playlist_preparser_GetStats(priv->parser, stats);
+    return VLC_SUCCESS;
+}
+
 /**
  * Requests retrieving/downloading art for an input item.
  * The retrieval is performed asynchronously.
@@ -25,6 +25,8 @@
 #ifndef LIBVLC_LIBVLC_H
 # define LIBVLC_LIBVLC_H 1
 
+# include <vlc_atomic.h>
+
 extern const char psz_vlc_changeset[];
 
 typedef struct variable_t variable_t;
@@ -165,6 +167,9 @@ typedef struct libvlc_priv_t
     struct playlist_t *playlist; ///< Playlist for interfaces
     struct playlist_preparser_t *parser; ///< Input item meta data handler
     struct vlc_actions *actions; ///< Hotkeys handler
+    struct vlc_threadpool *filter_pool; ///< Video filter slice workers
+    struct vlc_threadpool *preparse_pool; ///< Workers of the preparsers
+    struct playlist_metacache_t *preparse_cache; ///< Preparsing results
 
     /* Objects tree */
     vlc_mutex_t        structure_lock;
@@ -192,27 +197,24 @@ void var_OptionParse (vlc_object_t *, const char *, bool trusted);
 /*
  * Stats stuff
  */
-enum
-{
-    STATS_COUNTER,
-    STATS_DERIVATIVE,
-};
-
-typedef struct counter_sample_t
-{
-    uint64_t value;
-    mtime_t  date;
-} counter_sample_t;
-
+/**
+ * Statistics counter.
+ *
+ * Counters are updated without locking by the threads doing the work, with
+ * relaxed atomic additions: they are only summed and turned into rates when
+ * the statistics are read.
+ */
 typedef struct counter_t
 {
-    int                 i_compute_type;
-    int                 i_samples;
-    counter_sample_t ** pp_samples;
-
-    mtime_t             last_update;
+    atomic_uint_least64_t value;
 } counter_t;
 
+/**
+ * Statistics histogram of durations (see input_histogram_t), updated the same
+ * way as counters.
+ */
+typedef struct stats_histogram_t stats_histogram_t;
+
 enum
 {
     STATS_INPUT_BITRATE,
@@ -236,10 +238,30 @@ enum
     STATS_LOST_PICTURES,
 };
 
-counter_t * stats_CounterCreate (int);
-void stats_Update (counter_t *, uint64_t, uint64_t *);
+counter_t * stats_CounterCreate (void);
 void stats_CounterClean (counter_t * );
 
+/**
+ * Adds a value to a counter, if the statistics are enabled (counter is not
+ * NULL).
+ */
+static inline void stats_Update (counter_t *counter, uint64_t val)
+{
+    if (counter != NULL)
+        atomic_fetch_add_explicit (&counter->value, val, memory_order_relaxed);
+}
+
+static inline uint64_t stats_GetTotal (counter_t *counter)
+{
+    if (counter == NULL)
+        return 0;
+    return atomic_load_explicit (&counter->value, memory_order_relaxed);
+}
+
+stats_histogram_t *stats_HistogramCreate (void);
+void stats_HistogramRecord (stats_histogram_t *, mtime_t);
+void stats_HistogramClean (stats_histogram_t *);
+
 void stats_ComputeInputStats(input_thread_t*, input_stats_t*);
 void stats_ReinitInputStats(input_stats_t *);
 
@@ -29,6 +29,7 @@
 #include <libvlc.h>
 #include <vlc_filter.h>
 #include <vlc_modules.h>
+#include <vlc_threadpool.h>
 
 filter_t *filter_NewBlend( vlc_object_t *p_this,
                            const video_format_t *p_dst_chroma )
@@ -111,6 +112,79 @@ void filter_DeleteBlend( filter_t *p_blend )
     vlc_object_release( p_blend );
 }
 
+/* Slices smaller than this are not worth a thread */
+#define FILTER_SLICE_MIN_LINES 16
+#define FILTER_SLICES_MAX      64
+
+struct filter_slice
+{
+    filter_t       *p_filter;
+    filter_slice_cb pf_slice;
+    void           *p_opaque;
+    unsigned        i_slice;
+    unsigned        i_start, i_end;
+};
+
+static void filter_RunSlice( void *data )
+{
+    struct filter_slice *p_slice = data;
+
+    p_slice->pf_slice( p_slice->p_filter, p_slice->p_opaque, p_slice->i_slice,
+                       p_slice->i_start, p_slice->i_end );
+}
+
+unsigned filter_GetSliceCount( filter_t *p_filter, unsigned i_lines )
+{
+    vlc_threadpool_t *p_pool = libvlc_priv( p_filter->p_libvlc )->filter_pool;
+    unsigned i_count = 1;
+
+    if( p_pool != NULL )
+    {
+        i_count = vlc_threadpool_size( p_pool );
+        if( i_count > i_lines / FILTER_SLICE_MIN_LINES )
+            i_count = i_lines / FILTER_SLICE_MIN_LINES;
+        if( i_count > FILTER_SLICES_MAX )
+            i_count = FILTER_SLICES_MAX;
+        if( i_count == 0 )
+            i_count = 1;
+    }
+    return i_count;
+}
+
+void filter_RunSlices( filter_t *p_filter, unsigned i_lines,
+                       filter_slice_cb pf_slice, void *p_opaque )
+{
+    vlc_threadpool_t *p_pool = libvlc_priv( p_filter->p_libvlc )->filter_pool;
+    unsigned i_count = filter_GetSliceCount( p_filter, i_lines );
+
+    vlc_taskgroup_t *p_group = NULL;
+    if( i_count > 1 )
+        p_group = vlc_taskgroup_create( p_pool, VLC_TASK_PRIORITY_NORMAL );
+    if( p_group == NULL )
+    {
+        pf_slice( p_filter, p_opaque, 0, 0, i_lines );
+        return;
+    }
+
+    struct filter_slice p_slices[i_count];
+    for( unsigned i = 0; i < i_count; i++ )
+    {
+        p_slices[i].p_filter = p_filter;
+        p_slices[i].pf_slice = pf_slice;
+        p_slices[i].p_opaque = p_opaque;
+        p_slices[i].i_slice = i;
+        p_slices[i].i_start = (uint64_t)i_lines * i / i_count;
+        p_slices[i].i_end = (uint64_t)i_lines * (i + 1) / i_count;
+    }
+
+    /* The calling thread processes the first slice itself */
+    for( unsigned i = 1; i < i_count; i++ )
+        if( vlc_taskgroup_submit( p_group, filter_RunSlice, &p_slices[i] ) )
+            filter_RunSlice( &p_slices[i] );
+    filter_RunSlice( &p_slices[0] );
+    vlc_taskgroup_destroy( p_group );
+}
+
 /* */
 #include <vlc_video_splitter.h>
 
@@ -866,6 +866,8 @@ static const staticentry_t p_list_video[] = {
         A("NV24"),
     B(VLC_CODEC_NV42, "Biplanar 4:4:4 Y/VU"),
         A("NV42"),
+    B(VLC_CODEC_P010, "Biplanar 4:2:0 Y/UV 10-bit LE"),
+        A("P010"),
 
     B(VLC_CODEC_I420_9L, "Planar 4:2:0 YUV 9-bit LE"),
         A("I09L"),
@@ -1905,6 +1907,7 @@ static const vlc_fourcc_t p_list_YUV[] = {
     VLC_CODEC_YUV_PLANAR_420_16,
     VLC_CODEC_YUV_PLANAR_422_16,
     VLC_CODEC_YUV_PLANAR_444_16,
+    VLC_CODEC_P010,
     VLC_CODEC_VDPAU_VIDEO_420,
     VLC_CODEC_VDPAU_VIDEO_422,
     VLC_CODEC_VDPAU_VIDEO_444,
@@ -2071,6 +2074,7 @@ static const struct
 
     { { VLC_CODEC_I420_10L,
         VLC_CODEC_I420_10B },                  PLANAR_16(3, 2, 2, 10) },
+    { { VLC_CODEC_P010 },                      PLANAR_16(2, 1, 2, 10) },
     { { VLC_CODEC_I420_9L,
         VLC_CODEC_I420_9B },                   PLANAR_16(3, 2, 2,  9) },
     { { VLC_CODEC_I422_10L,
@@ -0,0 +1,501 @@
+/*****************************************************************************
+ * threadpool.c: work-stealing thread pool
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_threadpool.h>
+
+struct vlc_task
+{
+    struct vlc_task *next; /* in a shared queue */
+    void           (*func)(void *);
+    void            *data;
+    vlc_taskgroup_t *group;
+};
+
+/*
+ * Each worker has a double-ended queue: the owner pushes and pops at the
+ * bottom (most recent task first, which is hot in cache), other workers
+ * steal from the top (oldest task first, usually the largest piece of work).
+ */
+struct vlc_deque
+{
+    vlc_mutex_t       lock;
+    struct vlc_task **tasks;
+    size_t            size; /* capacity, a power of two */
+    size_t            top, bottom;
+};
+
+struct vlc_worker
+{
+    vlc_threadpool_t *pool;
+    vlc_thread_t      thread;
+    struct vlc_deque  deque;
+    unsigned          index;
+};
+
+struct vlc_taskqueue
+{
+    struct vlc_task  *first;
+    struct vlc_task **lastp;
+};
+
+struct vlc_threadpool
+{
+    vlc_mutex_t lock;
+    vlc_cond_t  wait; /* idle workers */
+    struct vlc_taskqueue queues[VLC_TASK_PRIORITY_HIGH + 1];
+    unsigned    pending; /* queued tasks, in shared queues and deques */
+    unsigned    idle; /* workers waiting for tasks */
+    unsigned    started;
+    unsigned    max;
+    bool        closing;
+    struct vlc_worker workers[];
+};
+
+struct vlc_taskgroup
+{
+    vlc_threadpool_t *pool;
+    vlc_mutex_t       lock;
+    vlc_cond_t        wait;
+    unsigned          pending; /* queued or running tasks */
+    int               priority;
+};
+
+/* Worker running on the calling thread, if any */
+static vlc_mutex_t worker_key_lock = VLC_STATIC_MUTEX;
+static vlc_threadvar_t worker_key;
+static unsigned worker_key_refs = 0;
+
+static int vlc_deque_push(struct vlc_deque *dq, struct vlc_task *task)
+{
+    vlc_mutex_lock(&dq->lock);
+    if (dq->bottom - dq->top == dq->size)
+    {   /* Full: double the capacity */
+        size_t size = dq->size ? (2 * dq->size) : 16;
+        struct vlc_task **tab = malloc(size * sizeof (*tab));
+
+        if (unlikely(tab == NULL))
+        {
+            vlc_mutex_unlock(&dq->lock);
+            return ENOMEM;
+        }
+        for (size_t i = dq->top; i != dq->bottom; i++)
+            tab[i & (size - 1)] = dq->tasks[i & (dq->size - 1)];
+        free(dq->tasks);
+        dq->tasks = tab;
+        dq->size = size;
+    }
+    dq->tasks[dq->bottom++ & (dq->size - 1)] = task;
+    vlc_mutex_unlock(&dq->lock);
+    return 0;
+}
+
+static struct vlc_task *vlc_deque_pop(struct vlc_deque *dq)
+{
+    struct vlc_task *task = NULL;
+
+    vlc_mutex_lock(&dq->lock);
+    if (dq->bottom != dq->top)
+        task = dq->tasks[--dq->bottom & (dq->size - 1)];
+    vlc_mutex_unlock(&dq->lock);
+    return task;
+}
+
+static struct vlc_task *vlc_deque_steal(struct vlc_deque *dq)
+{
+    struct vlc_task *task = NULL;
+
+    vlc_mutex_lock(&dq->lock);
+    if (dq->bottom != dq->top)
+        task = dq->tasks[dq->top++ & (dq->size - 1)];
+    vlc_mutex_unlock(&dq->lock);
+    return task;
+}
+
+static struct vlc_task *vlc_taskqueue_pop(struct vlc_taskqueue *q)
+{
+    struct vlc_task *task = q->first;
+
+    if (task != NULL)
+    {
+        q->first = task->next;
+        if (q->first == NULL)
+            q->lastp = &q->first;
+    }
+    return task;
+}
+
+/**
+ * Takes the next task to run, without waiting.
+ * High priority tasks come first, then the worker own tasks, then tasks
+ * stolen from other workers, then normal and low priority shared tasks.
+ */
+static struct vlc_task *vlc_threadpool_next(vlc_threadpool_t *pool,
+                                            struct vlc_worker *self)
+{
+    struct vlc_task *task;
+    unsigned started;
+
+    vlc_mutex_lock(&pool->lock);
+    if (pool->pending == 0)
+    {
+        vlc_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+    task = vlc_taskqueue_pop(&pool->queues[VLC_TASK_PRIORITY_HIGH]);
+    if (task != NULL)
+        goto out;
+    started = pool->started;
+    vlc_mutex_unlock(&pool->lock);
+
+    task = vlc_deque_pop(&self->deque);
+    for (unsigned i = 1; task == NULL && i < started; i++)
+        task = vlc_deque_steal(&pool->workers[(self->index + i) % started].deque);
+
+    vlc_mutex_lock(&pool->lock);
+    if (task == NULL)
+        task = vlc_taskqueue_pop(&pool->queues[VLC_TASK_PRIORITY_NORMAL]);
+    if (task == NULL)
+        task = vlc_taskqueue_pop(&pool->queues[VLC_TASK_PRIORITY_LOW]);
+out:
+    if (task != NULL)
+        pool->pending--;
+    vlc_mutex_unlock(&pool->lock);
+    return task;
+}
+
+static void vlc_task_run(struct vlc_task *task)
+{
+    vlc_taskgroup_t *group = task->group;
+
+    task->func(task->data);
+    free(task);
+
+    if (group != NULL)
+    {
+        vlc_mutex_lock(&group->lock);
+        assert(group->pending > 0);
+        if (--group->pending == 0)
+            vlc_cond_broadcast(&group->wait);
+        vlc_mutex_unlock(&group->lock);
+    }
+}
+
+static void *vlc_worker_thread(void *data)
+{
+    struct vlc_worker *self = data;
+    vlc_threadpool_t *pool = self->pool;
+
+    vlc_threadvar_set(worker_key, self);
+
+    for (;;)
+    {
+        struct vlc_task *task = vlc_threadpool_next(pool, self);
+
+        if (task != NULL)
+        {
+            vlc_task_run(task);
+            continue;
+        }
+
+        vlc_mutex_lock(&pool->lock);
+        while (pool->pending == 0 && !pool->closing)
+        {
+            pool->idle++;
+            vlc_cond_wait(&pool->wait, &pool->lock);
+            pool->idle--;
+        }
+        if (pool->pending == 0)
+        {   /* Closing and nothing left to do */
+            vlc_mutex_unlock(&pool->lock);
+            break;
+        }
+        vlc_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+/* Starts one more worker, called with the pool lock */
+static bool vlc_threadpool_spawn(vlc_threadpool_t *pool)
+{
+    struct vlc_worker *w = &pool->workers[pool->started];
+
+    assert(pool->started < pool->max);
+    if (vlc_clone(&w->thread, vlc_worker_thread, w,
+                  VLC_THREAD_PRIORITY_INPUT))
+        return false;
+    pool->started++;
+    return true;
+}
+
+static int vlc_threadpool_push(vlc_threadpool_t *pool, int priority,
+                               struct vlc_task *task)
+{
+    struct vlc_worker *self = vlc_threadvar_get(worker_key);
+
+    assert(priority >= VLC_TASK_PRIORITY_LOW
+        && priority <= VLC_TASK_PRIORITY_HIGH);
+
+    /* Subtasks of a worker stay local, unless their priority differs */
+    bool local = self != NULL && self->pool == pool
+              && priority == VLC_TASK_PRIORITY_NORMAL;
+
+    vlc_mutex_lock(&pool->lock);
+    if (pool->started == 0 && !vlc_threadpool_spawn(pool))
+    {
+        vlc_mutex_unlock(&pool->lock);
+        return ENOMEM;
+    }
+
+    if (local)
+    {
+        if (vlc_deque_push(&self->deque, task))
+        {
+            vlc_mutex_unlock(&pool->lock);
+            return ENOMEM;
+        }
+    }
+    else
+    {
+        struct vlc_taskqueue *q = &pool->queues[priority];
+
+        task->next = NULL;
+        *q->lastp = task;
+        q->lastp = &task->next;
+    }
+    pool->pending++;
+
+    if (pool->idle > 0)
+        vlc_cond_signal(&pool->wait);
+    /* Start another worker if the running ones are all busy. This also
+     * keeps tasks flowing if some of them block. */
+    if (pool->idle < pool->pending && pool->started < pool->max
+     && !pool->closing)
+        vlc_threadpool_spawn(pool);
+        /* On failure, the task will be run by one of the running workers */
+    vlc_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+static struct vlc_task *vlc_task_new(void (*func)(void *), void *data,
+                                     vlc_taskgroup_t *group)
+{
+    struct vlc_task *task = malloc(sizeof (*task));
+
+    if (likely(task != NULL))
+    {
+        assert(func != NULL);
+        task->func = func;
+        task->data = data;
+        task->group = group;
+    }
+    return task;
+}
+
+vlc_threadpool_t *vlc_threadpool_create(unsigned max_workers)
+{
+    if (max_workers == 0)
+        max_workers = vlc_GetCPUCount();
+    if (max_workers == 0)
+        max_workers = 1;
+
+    vlc_threadpool_t *pool = malloc(sizeof (*pool)
+                                    + max_workers * sizeof (pool->workers[0]));
+    if (unlikely(pool == NULL))
+        return NULL;
+
+    vlc_mutex_lock(&worker_key_lock);
+    if (worker_key_refs == 0
+     && vlc_threadvar_create(&worker_key, NULL))
+    {
+        vlc_mutex_unlock(&worker_key_lock);
+        free(pool);
+        return NULL;
+    }
+    worker_key_refs++;
+    vlc_mutex_unlock(&worker_key_lock);
+
+    vlc_mutex_init(&pool->lock);
+    vlc_cond_init(&pool->wait);
+    for (unsigned i = 0; i <= VLC_TASK_PRIORITY_HIGH; i++)
+    {
+        pool->queues[i].first = NULL;
+        pool->queues[i].lastp = &pool->queues[i].first;
+    }
+    pool->pending = 0;
+    pool->idle = 0;
+    pool->started = 0;
+    pool->max = max_workers;
+    pool->closing = false;
+
+    for (unsigned i = 0; i < max_workers; i++)
+    {
+        struct vlc_worker *w = &pool->workers[i];
+
+        w->pool = pool;
+        w->index = i;
+        vlc_mutex_init(&w->deque.lock);
+        w->deque.tasks = NULL;
+        w->deque.size = 0; /* allocated on first push */
+        w->deque.top = w->deque.bottom = 0;
+    }
+    return pool;
+}
+
+void vlc_threadpool_destroy(vlc_threadpool_t *pool)
+{
+    assert(vlc_threadvar_get(worker_key) == NULL
+        || ((struct vlc_worker *)vlc_threadvar_get(worker_key))->pool != pool);
+
+    unsigned started;
+
+    vlc_mutex_lock(&pool->lock);
+    pool->closing = true;
+    vlc_cond_broadcast(&pool->wait);
+    /* No new workers are started once closing is set, but the running ones
+     * can still queue tasks: they exit once everything has run. */
+    started = pool->started;
+    vlc_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < started; i++)
+        vlc_join(pool->workers[i].thread, NULL);
+    assert(pool->pending == 0);
+
+    for (unsigned i = 0; i < pool->max; i++)
+    {
+        struct vlc_worker *w = &pool->workers[i];
+
+        free(w->deque.tasks);
+        vlc_mutex_destroy(&w->deque.lock);
+    }
+    vlc_cond_destroy(&pool->wait);
+    vlc_mutex_destroy(&pool->lock);
+    free(pool);
+
+    vlc_mutex_lock(&worker_key_lock);
+    if (--worker_key_refs == 0)
+        vlc_threadvar_delete(&worker_key);
+    vlc_mutex_unlock(&worker_key_lock);
+}
+
+unsigned vlc_threadpool_size(const vlc_threadpool_t *pool)
+{
+    return pool->max;
+}
+
+int vlc_threadpool_submit(vlc_threadpool_t *pool, int priority,
+                          void (*func)(void *), void *data)
+{
+    struct vlc_task *task = vlc_task_new(func, data, NULL);
+
+    if (unlikely(task == NULL))
+        return ENOMEM;
+
+    int ret = vlc_threadpool_push(pool, priority, task);
+    if (ret)
+        free(task);
+    return ret;
+}
+
+vlc_taskgroup_t *vlc_taskgroup_create(vlc_threadpool_t *pool, int priority)
+{
+    vlc_taskgroup_t *group = malloc(sizeof (*group));
+
+    if (likely(group != NULL))
+    {
+        group->pool = pool;
+        vlc_mutex_init(&group->lock);
+        vlc_cond_init(&group->wait);
+        group->pending = 0;
+        group->priority = priority;
+    }
+    return group;
+}
+
+int vlc_taskgroup_submit(vlc_taskgroup_t *group, void (*func)(void *),
+                         void *data)
+{
+    struct vlc_task *task = vlc_task_new(func, data, group);
+
+    if (unlikely(task == NULL))
+        return ENOMEM;
+
+    vlc_mutex_lock(&group->lock);
+    group->pending++;
+    vlc_mutex_unlock(&group->lock);
+
+    int ret = vlc_threadpool_push(group->pool, group->priority, task);
+    vlc_mutex_lock(&group->lock);
+    if (ret)
+    {
+        free(task);
+        group->pending--;
+    }
+    /* Wake up workers helping in vlc_taskgroup_wait() */
+    vlc_cond_broadcast(&group->wait);
+    vlc_mutex_unlock(&group->lock);
+    return ret;
+}
+
+void vlc_taskgroup_wait(vlc_taskgroup_t *group)
+{
+    struct vlc_worker *self = vlc_threadvar_get(worker_key);
+
+    if (self != NULL && self->pool != group->pool)
+        self = NULL;
+
+    vlc_mutex_lock(&group->lock);
+    while (group->pending > 0)
+    {
+        if (self != NULL)
+        {   /* Run tasks rather than block a worker */
+            vlc_mutex_unlock(&group->lock);
+
+            struct vlc_task *task = vlc_threadpool_next(group->pool, self);
+            if (task != NULL)
+                vlc_task_run(task);
+
+            vlc_mutex_lock(&group->lock);
+            if (task != NULL)
+                continue;
+            if (group->pending == 0)
+                break;
+            /* Remaining tasks are running on other threads */
+        }
+        vlc_cond_wait(&group->wait, &group->lock);
+    }
+    vlc_mutex_unlock(&group->lock);
+}
+
+void vlc_taskgroup_destroy(vlc_taskgroup_t *group)
+{
+    vlc_taskgroup_wait(group);
+    vlc_cond_destroy(&group->wait);
+    vlc_mutex_destroy(&group->lock);
+    free(group);
+}
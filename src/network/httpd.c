@@ -40,6 +40,8 @@
 #include <vlc_url.h>
 #include <vlc_mime.h>
 #include <vlc_block.h>
+#include <vlc_fs.h>
+#include <vlc_atomic.h>
 #include "../libvlc.h"
 
 #include <string.h>
@@ -54,6 +56,10 @@
 #   include <winsock2.h>
 #else
 #   include <sys/socket.h>
+#   include <sys/uio.h>
+#endif
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
 #endif
 
 #if defined(_WIN32)
@@ -63,6 +69,23 @@
 #define HTTPD_CL_BUFSIZE 10000
 #endif
 
+/* Largest number of stream chunks queued at once for a client */
+#define HTTPD_CL_CHUNKS 64
+
+/* Stream data, shared by all the clients and sent without copies */
+typedef struct httpd_chunk_t httpd_chunk_t;
+struct httpd_chunk_t
+{
+    httpd_chunk_t *p_next; /* protected by the stream lock */
+    bool        b_dropped; /* out of the stream window, ditto */
+    atomic_uint refs;
+    int64_t     i_pos;     /* absolute position of the first byte */
+    size_t      i_data;
+    uint8_t     *p_data;
+    block_t     *p_block;  /* owner of p_data if not NULL */
+    uint8_t     p_buf[];
+};
+
 static void httpd_ClientClean(httpd_client_t *cl);
 static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data);
 
@@ -83,6 +106,13 @@ struct httpd_host_t
     vlc_mutex_t lock;
     vlc_cond_t  wait;
 
+    /* wakes the thread up when stream data is available */
+    int         wakefd[2];
+    atomic_bool b_wakeup;
+#ifdef HAVE_SYS_EPOLL_H
+    int         epfd;
+#endif
+
     /* all registered url (becarefull that 2 httpd_url_t could point at the same url)
      * This will slow down the url research but make my live easier
      * All url will have their cb trigger, but only the first one can answer
@@ -158,6 +188,15 @@ struct httpd_client_t
     int     i_buffer;
     uint8_t *p_buffer;
 
+    /* stream data queued for sending */
+    httpd_chunk_t *p_chunk; /* last queued chunk */
+    httpd_chunk_t *chunks[HTTPD_CL_CHUNKS];
+    size_t  i_chunk_offset; /* bytes of the first chunk already sent */
+    unsigned i_chunks;
+#ifdef HAVE_SYS_EPOLL_H
+    short   i_poll_events; /* events the client is registered for */
+#endif
+
     /*
      * If waiting for a keyframe, this is the position (in bytes) of the
      * last keyframe the stream saw before this client connected.
@@ -611,9 +650,11 @@ struct httpd_stream_t
     bool        b_has_keyframes;
     int64_t     i_last_keyframe_seen_pos;
 
-    /* circular buffer */
-    int         i_buffer_size;      /* buffer size, can't be reallocated smaller */
-    uint8_t     *p_buffer;          /* buffer */
+    /* window of the last chunks */
+    size_t         i_buffer_size;   /* maximum window size */
+    size_t         i_buffer;        /* current window size */
+    httpd_chunk_t *p_first;
+    httpd_chunk_t *p_last;
     int64_t     i_buffer_pos;       /* absolute position from begining */
     int64_t     i_buffer_last_pos;  /* a new connection will start with that */
 
@@ -622,6 +663,65 @@ struct httpd_stream_t
     httpd_header * p_http_headers;
 };
 
+static httpd_chunk_t *httpd_ChunkHold(httpd_chunk_t *chunk)
+{
+    atomic_fetch_add(&chunk->refs, 1);
+    return chunk;
+}
+
+static void httpd_ChunkRelease(httpd_chunk_t *chunk)
+{
+    if (atomic_fetch_sub(&chunk->refs, 1) == 1) {
+        if (chunk->p_block != NULL)
+            block_Release(chunk->p_block);
+        free(chunk);
+    }
+}
+
+/* Queues an answer body block for sending, without copying its data */
+static void httpd_ClientQueueBlock(httpd_client_t *cl, block_t *p_block)
+{
+    httpd_chunk_t *chunk;
+
+    if (p_block->i_buffer == 0
+     || (chunk = malloc(sizeof (*chunk))) == NULL) {
+        block_Release(p_block);
+        return;
+    }
+
+    chunk->p_next = NULL;
+    chunk->b_dropped = false;
+    atomic_init(&chunk->refs, 1);
+    chunk->i_pos = 0;
+    chunk->i_data = p_block->i_buffer;
+    chunk->p_data = p_block->p_buffer;
+    chunk->p_block = p_block;
+
+    assert(cl->i_chunks == 0);
+    cl->i_chunk_offset = 0;
+    cl->chunks[cl->i_chunks++] = chunk;
+}
+
+/* Finds the chunk starting at the given position, stream lock held */
+static httpd_chunk_t *httpd_StreamChunkAt(httpd_stream_t *stream,
+                                          const httpd_client_t *cl,
+                                          int64_t i_pos)
+{
+    httpd_chunk_t *chunk = cl->p_chunk;
+
+    /* Usual case: the chunk following the ones already queued */
+    if (chunk != NULL && !chunk->b_dropped
+     && chunk->i_pos + (int64_t)chunk->i_data == i_pos)
+        return chunk->p_next;
+    if (stream->p_last != NULL && stream->p_last->i_pos == i_pos)
+        return stream->p_last;
+
+    for (chunk = stream->p_first; chunk != NULL; chunk = chunk->p_next)
+        if (chunk->i_pos == i_pos)
+            return chunk;
+    return NULL;
+}
+
 static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
                                  httpd_client_t *cl, httpd_message_t *answer,
                                  const httpd_message_t *query)
@@ -632,46 +732,53 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
         return VLC_SUCCESS;
 
     if (answer->i_body_offset > 0) {
-        int     i_pos;
+        httpd_chunk_t *chunk;
 
-        if (answer->i_body_offset >= stream->i_buffer_pos)
+        vlc_mutex_lock(&stream->lock);
+        if (answer->i_body_offset >= stream->i_buffer_pos) {
+            vlc_mutex_unlock(&stream->lock);
             return VLC_EGENERIC;    /* wait, no data available */
+        }
 
         if (cl->i_keyframe_wait_to_pass >= 0) {
-            if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass)
+            if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass) {
                 /* still waiting for the next keyframe */
+                vlc_mutex_unlock(&stream->lock);
                 return VLC_EGENERIC;
+            }
 
             /* seek to the new keyframe */
             answer->i_body_offset = stream->i_last_keyframe_seen_pos;
             cl->i_keyframe_wait_to_pass = -1;
         }
 
-        if (answer->i_body_offset + stream->i_buffer_size < stream->i_buffer_pos)
-            answer->i_body_offset = stream->i_buffer_last_pos; /* this client isn't fast enough */
-
-        i_pos   = answer->i_body_offset % stream->i_buffer_size;
-        int64_t i_write = stream->i_buffer_pos - answer->i_body_offset;
-
-        if (i_write > HTTPD_CL_BUFSIZE)
-            i_write = HTTPD_CL_BUFSIZE;
-        else if (i_write <= 0)
-            return VLC_EGENERIC;    /* wait, no data available */
+        chunk = httpd_StreamChunkAt(stream, cl, answer->i_body_offset);
+        if (chunk == NULL) {
+            /* this client isn't fast enough */
+            chunk = stream->p_last;
+            answer->i_body_offset = chunk->i_pos;
+        }
 
-        /* Don't go past the end of the circular buffer */
-        i_write = __MIN(i_write, stream->i_buffer_size - i_pos);
+        /* Queue references to the shared chunks, no copies */
+        assert(cl->i_chunks == 0);
+        cl->i_chunk_offset = 0;
+        if (cl->p_chunk != NULL)
+            httpd_ChunkRelease(cl->p_chunk);
+        do {
+            cl->chunks[cl->i_chunks++] = httpd_ChunkHold(chunk);
+            cl->p_chunk = chunk;
+            chunk = chunk->p_next;
+        } while (chunk != NULL && cl->i_chunks < HTTPD_CL_CHUNKS);
+        httpd_ChunkHold(cl->p_chunk);
+
+        answer->i_body_offset = cl->p_chunk->i_pos + cl->p_chunk->i_data;
+        vlc_mutex_unlock(&stream->lock);
 
         /* using HTTPD_MSG_ANSWER -> data available */
         answer->i_proto  = HTTPD_PROTO_HTTP;
         answer->i_version= 0;
         answer->i_type   = HTTPD_MSG_ANSWER;
 
-        answer->i_body = i_write;
-        answer->p_body = xmalloc(i_write);
-        memcpy(answer->p_body, &stream->p_buffer[i_pos], i_write);
-
-        answer->i_body_offset += i_write;
-
         return VLC_SUCCESS;
     } else {
         answer->i_proto  = HTTPD_PROTO_HTTP;
@@ -766,7 +873,9 @@ httpd_stream_t *httpd_StreamNew(httpd_host_t *host,
     stream->i_header = 0;
     stream->p_header = NULL;
     stream->i_buffer_size = 5000000;    /* 5 Mo per stream */
-    stream->p_buffer = xmalloc(stream->i_buffer_size);
+    stream->i_buffer = 0;
+    stream->p_first = NULL;
+    stream->p_last = NULL;
     /* We set to 1 to make life simpler
      * (this way i_body_offset can never be 0) */
     stream->i_buffer_pos = 1;
@@ -804,25 +913,42 @@ int httpd_StreamHeader(httpd_stream_t *stream, uint8_t *p_data, int i_data)
 
 static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data)
 {
-    int i_pos = stream->i_buffer_pos % stream->i_buffer_size;
-    int i_count = i_data;
-    while (i_count > 0) {
-        int i_copy = __MIN(i_count, stream->i_buffer_size - i_pos);
+    httpd_chunk_t *chunk = xmalloc(sizeof (*chunk) + i_data);
+
+    chunk->p_next = NULL;
+    chunk->b_dropped = false;
+    atomic_init(&chunk->refs, 1);
+    chunk->i_pos = stream->i_buffer_pos;
+    chunk->i_data = i_data;
+    chunk->p_data = chunk->p_buf;
+    chunk->p_block = NULL;
+    memcpy(chunk->p_data, p_data, i_data);
+
+    if (stream->p_last != NULL)
+        stream->p_last->p_next = chunk;
+    else
+        stream->p_first = chunk;
+    stream->p_last = chunk;
+    stream->i_buffer += i_data;
+    stream->i_buffer_pos += i_data;
 
-        /* Ok, we can't go past the end of our buffer */
-        memcpy(&stream->p_buffer[i_pos], p_data, i_copy);
+    /* Drop the oldest chunks; clients still sending them hold a reference */
+    while (stream->i_buffer > stream->i_buffer_size
+        && stream->p_first != stream->p_last) {
+        httpd_chunk_t *first = stream->p_first;
 
-        i_pos = (i_pos + i_copy) % stream->i_buffer_size;
-        i_count -= i_copy;
-        p_data  += i_copy;
+        stream->p_first = first->p_next;
+        stream->i_buffer -= first->i_data;
+        first->b_dropped = true;
+        httpd_ChunkRelease(first);
     }
-
-    stream->i_buffer_pos += i_data;
 }
 
+static void httpd_HostWakeUp(httpd_host_t *);
+
 int httpd_StreamSend(httpd_stream_t *stream, const block_t *p_block)
 {
-    if (!p_block || !p_block->p_buffer)
+    if (!p_block || !p_block->p_buffer || p_block->i_buffer == 0)
         return VLC_SUCCESS;
 
     vlc_mutex_lock(&stream->lock);
@@ -838,6 +964,9 @@ int httpd_StreamSend(httpd_stream_t *stream, const block_t *p_block)
     httpd_AppendData(stream, p_block->p_buffer, p_block->i_buffer);
 
     vlc_mutex_unlock(&stream->lock);
+
+    /* Let the waiting clients know */
+    httpd_HostWakeUp(stream->url->host);
     return VLC_SUCCESS;
 }
 
@@ -852,7 +981,12 @@ void httpd_StreamDelete(httpd_stream_t *stream)
     vlc_mutex_destroy(&stream->lock);
     free(stream->psz_mime);
     free(stream->p_header);
-    free(stream->p_buffer);
+    while (stream->p_first != NULL) {
+        httpd_chunk_t *chunk = stream->p_first;
+
+        stream->p_first = chunk->p_next;
+        httpd_ChunkRelease(chunk);
+    }
     free(stream);
 }
 
@@ -983,6 +1117,11 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
     vlc_mutex_init(&host->lock);
     vlc_cond_init(&host->wait);
     host->i_ref = 1;
+    host->wakefd[0] = host->wakefd[1] = -1;
+    atomic_init(&host->b_wakeup, false);
+#ifdef HAVE_SYS_EPOLL_H
+    host->epfd = -1;
+#endif
 
     host->fds = net_ListenTCP(p_this, url.psz_host, port);
     if (!host->fds) {
@@ -991,6 +1130,29 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
     }
     for (host->nfd = 0; host->fds[host->nfd] != -1; host->nfd++);
 
+    /* Without a wake up pipe, waiting clients are polled */
+    if (vlc_pipe(host->wakefd))
+        host->wakefd[0] = host->wakefd[1] = -1;
+
+#ifdef HAVE_SYS_EPOLL_H
+    host->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (host->epfd == -1) {
+        msg_Err(p_this, "cannot create HTTP event queue: %s",
+                vlc_strerror_c(errno));
+        goto error;
+    }
+    /* Listening sockets are tagged with their index, clients with their
+     * pointer, which is never that small */
+    for (unsigned i = 0; i < host->nfd; i++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = i };
+        epoll_ctl(host->epfd, EPOLL_CTL_ADD, host->fds[i], &ev);
+    }
+    if (host->wakefd[0] != -1) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = host->nfd };
+        epoll_ctl(host->epfd, EPOLL_CTL_ADD, host->wakefd[0], &ev);
+    }
+#endif
+
     if (vlc_object_waitpipe(VLC_OBJECT(host)) == -1) {
         msg_Err(host, "signaling pipe error: %s", vlc_strerror_c(errno));
         goto error;
@@ -1022,7 +1184,16 @@ error:
     vlc_mutex_unlock(&httpd.mutex);
 
     if (host) {
-        net_ListenClose(host->fds);
+#ifdef HAVE_SYS_EPOLL_H
+        if (host->epfd != -1)
+            close(host->epfd);
+#endif
+        if (host->wakefd[0] != -1) {
+            close(host->wakefd[1]);
+            close(host->wakefd[0]);
+        }
+        if (host->fds)
+            net_ListenClose(host->fds);
         vlc_cond_destroy(&host->wait);
         vlc_mutex_destroy(&host->lock);
         vlc_object_release(host);
@@ -1072,6 +1243,13 @@ void httpd_HostDelete(httpd_host_t *host)
     }
 
     vlc_tls_Delete(host->p_tls);
+#ifdef HAVE_SYS_EPOLL_H
+    close(host->epfd);
+#endif
+    if (host->wakefd[0] != -1) {
+        close(host->wakefd[1]);
+        close(host->wakefd[0]);
+    }
     net_ListenClose(host->fds);
     vlc_cond_destroy(&host->wait);
     vlc_mutex_destroy(&host->lock);
@@ -1147,10 +1325,11 @@ void httpd_UrlDelete(httpd_url_t *url)
 
         /* TODO complete it */
         msg_Warn(host, "force closing connections");
+        /* The host thread may hold an event for this client: only close
+         * it here and let the thread free it */
         httpd_ClientClean(client);
-        TAB_REMOVE(host->i_client, host->client, client);
-        free(client);
-        i--;
+        client->url = NULL;
+        client->i_state = HTTPD_CLIENT_DEAD;
     }
     free(url);
     vlc_mutex_unlock(&host->lock);
@@ -1174,6 +1353,7 @@ static void httpd_MsgInit(httpd_message_t *msg)
     msg->i_body_offset = 0;
     msg->i_body        = 0;
     msg->p_body        = NULL;
+    msg->p_body_block  = NULL;
 }
 
 static void httpd_MsgClean(httpd_message_t *msg)
@@ -1186,6 +1366,8 @@ static void httpd_MsgClean(httpd_message_t *msg)
     }
     free(msg->p_headers);
     free(msg->p_body);
+    if (msg->p_body_block != NULL)
+        block_Release(msg->p_body_block);
     httpd_MsgInit(msg);
 }
 
@@ -1235,6 +1417,12 @@ static void httpd_ClientInit(httpd_client_t *cl, mtime_t now)
     cl->p_buffer = xmalloc(cl->i_buffer_size);
     cl->i_keyframe_wait_to_pass = -1;
     cl->b_stream_mode = false;
+    cl->p_chunk = NULL;
+    cl->i_chunks = 0;
+    cl->i_chunk_offset = 0;
+#ifdef HAVE_SYS_EPOLL_H
+    cl->i_poll_events = 0;
+#endif
 
     httpd_MsgInit(&cl->query);
     httpd_MsgInit(&cl->answer);
@@ -1264,6 +1452,14 @@ static void httpd_ClientClean(httpd_client_t *cl)
 
     free(cl->p_buffer);
     cl->p_buffer = NULL;
+
+    for (unsigned i = 0; i < cl->i_chunks; i++)
+        httpd_ChunkRelease(cl->chunks[i]);
+    cl->i_chunks = 0;
+    if (cl->p_chunk != NULL) {
+        httpd_ChunkRelease(cl->p_chunk);
+        cl->p_chunk = NULL;
+    }
 }
 
 static httpd_client_t *httpd_ClientNew(int fd, vlc_tls_t *p_tls, mtime_t now)
@@ -1313,6 +1509,46 @@ ssize_t httpd_NetSend (httpd_client_t *cl, const uint8_t *p, size_t i_len)
 }
 
 
+/* Sends the queued stream chunks, straight from the shared buffers */
+static ssize_t httpd_ClientSendChunks(httpd_client_t *cl)
+{
+    ssize_t val;
+
+#ifndef _WIN32
+    if (cl->p_tls == NULL) {
+        struct iovec iov[HTTPD_CL_CHUNKS];
+
+        for (unsigned i = 0; i < cl->i_chunks; i++) {
+            iov[i].iov_base = cl->chunks[i]->p_data;
+            iov[i].iov_len = cl->chunks[i]->i_data;
+        }
+        iov[0].iov_base = (uint8_t *)iov[0].iov_base + cl->i_chunk_offset;
+        iov[0].iov_len -= cl->i_chunk_offset;
+
+        do
+            val = writev(cl->fd, iov, cl->i_chunks);
+        while (val == -1 && errno == EINTR);
+    } else
+#endif
+        val = httpd_NetSend(cl, cl->chunks[0]->p_data + cl->i_chunk_offset,
+                            cl->chunks[0]->i_data - cl->i_chunk_offset);
+    if (val <= 0)
+        return val;
+
+    /* Release the chunks sent completely */
+    size_t i_sent = val + cl->i_chunk_offset;
+    unsigned i_done = 0;
+
+    while (i_done < cl->i_chunks && i_sent >= cl->chunks[i_done]->i_data) {
+        i_sent -= cl->chunks[i_done]->i_data;
+        httpd_ChunkRelease(cl->chunks[i_done++]);
+    }
+    cl->i_chunks -= i_done;
+    memmove(cl->chunks, cl->chunks + i_done, cl->i_chunks * sizeof (cl->chunks[0]));
+    cl->i_chunk_offset = i_sent;
+    return val;
+}
+
 static const struct
 {
     const char name[16];
@@ -1620,7 +1856,7 @@ static void httpd_ClientRecv(httpd_client_t *cl)
 
 static void httpd_ClientSend(httpd_client_t *cl)
 {
-    int i_len;
+    ssize_t i_len;
 
     if (cl->i_buffer < 0) {
         /* We need to create the header */
@@ -1653,12 +1889,18 @@ static void httpd_ClientSend(httpd_client_t *cl)
         cl->i_buffer_size = (uint8_t*)p - cl->p_buffer;
     }
 
-    i_len = httpd_NetSend(cl, &cl->p_buffer[cl->i_buffer],
-                           cl->i_buffer_size - cl->i_buffer);
-    if (i_len >= 0) {
-        cl->i_buffer += i_len;
+    if (cl->i_buffer < cl->i_buffer_size) {
+        i_len = httpd_NetSend(cl, &cl->p_buffer[cl->i_buffer],
+                               cl->i_buffer_size - cl->i_buffer);
+        if (i_len > 0)
+            cl->i_buffer += i_len;
+    } else if (cl->i_chunks > 0)
+        i_len = httpd_ClientSendChunks(cl);
+    else
+        i_len = 0;
 
-        if (cl->i_buffer >= cl->i_buffer_size) {
+    if (i_len >= 0) {
+        if (cl->i_buffer >= cl->i_buffer_size && cl->i_chunks == 0) {
             if (cl->answer.i_body == 0  && cl->answer.i_body_offset > 0) {
                 /* catch more body data */
                 int     i_msg = cl->query.i_type;
@@ -1680,7 +1922,11 @@ static void httpd_ClientSend(httpd_client_t *cl)
 
                 cl->answer.i_body = 0;
                 cl->answer.p_body = NULL;
-            } else /* send finished */
+            } else if (cl->answer.p_body_block != NULL) {
+                /* send the body block, straight from its buffer */
+                httpd_ClientQueueBlock(cl, cl->answer.p_body_block);
+                cl->answer.p_body_block = NULL;
+            } else if (cl->i_chunks == 0) /* send finished */
                 cl->i_state = HTTPD_CLIENT_SEND_DONE;
         }
     } else {
@@ -1746,15 +1992,97 @@ auth_failed:
     return false;
 }
 
+/* Returns the socket events the client is waiting for */
+static short httpd_ClientEvents(const httpd_client_t *cl)
+{
+    switch (cl->i_state) {
+        case HTTPD_CLIENT_RECEIVING:
+        case HTTPD_CLIENT_TLS_HS_IN:
+            return POLLIN;
+
+        case HTTPD_CLIENT_SENDING:
+        case HTTPD_CLIENT_TLS_HS_OUT:
+            return POLLOUT;
+    }
+    return 0;
+}
+
+static void httpd_HostWakeUp(httpd_host_t *host)
+{
+    /* Only one byte is pending at a time */
+    if (host->wakefd[1] != -1 && !atomic_exchange(&host->b_wakeup, true)
+     && write(host->wakefd[1], &(char){ 0 }, 1) < 0)
+        atomic_store(&host->b_wakeup, false);
+}
+
+static void httpd_ClientAccept(httpd_host_t *host, int fd, mtime_t now)
+{
+    httpd_client_t *cl;
+
+    fd = vlc_accept (fd, NULL, NULL, true);
+    if (fd == -1)
+        return;
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
+            &(int){ 1 }, sizeof(int));
+
+    vlc_tls_t *p_tls;
+
+    if (host->p_tls)
+        p_tls = vlc_tls_SessionCreate(host->p_tls, fd, NULL);
+    else
+        p_tls = NULL;
+
+    cl = httpd_ClientNew(fd, p_tls, now);
+    if (unlikely(cl == NULL)) {
+        if (p_tls)
+            vlc_tls_SessionDelete(p_tls);
+        net_Close(fd);
+        return;
+    }
+
+#ifdef HAVE_SYS_EPOLL_H
+    /* The events are selected on the next loop */
+    struct epoll_event ev = { .events = 0, .data.u64 = (uintptr_t)cl };
+    epoll_ctl(host->epfd, EPOLL_CTL_ADD, fd, &ev);
+#endif
+    TAB_APPEND(host->i_client, host->client, cl);
+}
+
+static void httpd_ClientProcess(httpd_client_t *cl, mtime_t now)
+{
+    cl->i_activity_date = now;
+
+    switch (cl->i_state) {
+        case HTTPD_CLIENT_RECEIVING: httpd_ClientRecv(cl); break;
+        case HTTPD_CLIENT_SENDING:   httpd_ClientSend(cl); break;
+        case HTTPD_CLIENT_TLS_HS_IN:
+        case HTTPD_CLIENT_TLS_HS_OUT: httpd_ClientTlsHandshake(cl); break;
+    }
+}
+
 static void httpdLoop(httpd_host_t *host)
 {
-    struct pollfd ufd[host->nfd + host->i_client];
+#ifdef HAVE_SYS_EPOLL_H
+    /* Clients stay registered: only changes of events are reported to
+     * the kernel, and only active sockets are returned */
+    struct epoll_event ev[64];
+#else
+    struct pollfd ufd[host->nfd + 1 + host->i_client];
     unsigned nfd;
+
     for (nfd = 0; nfd < host->nfd; nfd++) {
         ufd[nfd].fd = host->fds[nfd];
         ufd[nfd].events = POLLIN;
         ufd[nfd].revents = 0;
     }
+    if (host->wakefd[0] != -1) {
+        ufd[nfd].fd = host->wakefd[0];
+        ufd[nfd].events = POLLIN;
+        ufd[nfd].revents = 0;
+        nfd++;
+    }
+    const unsigned nfd_clients = nfd;
+#endif
 
     /* add all socket that should be read/write and close dead connection */
     while (host->i_url <= 0) {
@@ -1781,23 +2109,7 @@ static void httpdLoop(httpd_host_t *host)
             continue;
         }
 
-        struct pollfd *pufd = ufd + nfd;
-        assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
-
-        pufd->fd = cl->fd;
-        pufd->events = pufd->revents = 0;
-
         switch (cl->i_state) {
-            case HTTPD_CLIENT_RECEIVING:
-            case HTTPD_CLIENT_TLS_HS_IN:
-                pufd->events = POLLIN;
-                break;
-
-            case HTTPD_CLIENT_SENDING:
-            case HTTPD_CLIENT_TLS_HS_OUT:
-                pufd->events = POLLOUT;
-                break;
-
             case HTTPD_CLIENT_RECEIVE_DONE: {
                 httpd_message_t *answer = &cl->answer;
                 httpd_message_t *query  = &cl->query;
@@ -2004,16 +2316,43 @@ static void httpdLoop(httpd_host_t *host)
                 }
         }
 
-        if (pufd->events != 0)
-            nfd++;
-        else
+        short events = httpd_ClientEvents(cl);
+#ifdef HAVE_SYS_EPOLL_H
+        if (events != cl->i_poll_events) {
+            struct epoll_event ev = {
+                .events = ((events & POLLIN) ? EPOLLIN : 0)
+                        | ((events & POLLOUT) ? EPOLLOUT : 0),
+                .data.u64 = (uintptr_t)cl,
+            };
+
+            epoll_ctl(host->epfd, EPOLL_CTL_MOD, cl->fd, &ev);
+            cl->i_poll_events = events;
+        }
+#else
+        if (events != 0) {
+            struct pollfd *pufd = ufd + nfd++;
+            assert (pufd < ufd + (sizeof (ufd) / sizeof (ufd[0])));
+
+            pufd->fd = cl->fd;
+            pufd->events = events;
+            pufd->revents = 0;
+        }
+#endif
+        /* Waiting clients are woken up by the stream, if possible */
+        if (events == 0 && (cl->i_state != HTTPD_CLIENT_WAITING
+                         || host->wakefd[0] == -1))
             b_low_delay = true;
     }
     vlc_mutex_unlock(&host->lock);
     vlc_restorecancel(canc);
 
     /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
+#ifdef HAVE_SYS_EPOLL_H
+    int ret = epoll_wait(host->epfd, ev, sizeof (ev) / sizeof (ev[0]),
+                         b_low_delay ? 20 : -1);
+#else
     int ret = poll(ufd, nfd, b_low_delay ? 20 : -1);
+#endif
 
     canc = vlc_savecancel();
     vlc_mutex_lock(&host->lock);
@@ -2029,9 +2368,48 @@ static void httpdLoop(httpd_host_t *host)
             return;
     }
 
-    /* Handle client sockets */
     now = mdate();
-    nfd = host->nfd;
+#ifdef HAVE_SYS_EPOLL_H
+    for (int i = 0; i < ret; i++) {
+        if (ev[i].data.u64 < host->nfd) {
+            /* Listening socket: accept new connection */
+            httpd_ClientAccept(host, host->fds[ev[i].data.u64], now);
+        } else if (ev[i].data.u64 == host->nfd) {
+            /* Wake up: waiting clients are served by the next loop */
+            char buf[16];
+
+            atomic_store(&host->b_wakeup, false);
+            if (read(host->wakefd[0], buf, sizeof (buf)) < 0)
+                msg_Err(host, "wake up error: %s", vlc_strerror_c(errno));
+        } else {
+            httpd_client_t *cl = (httpd_client_t *)(uintptr_t)ev[i].data.u64;
+
+            if (ev[i].events & (EPOLLHUP | EPOLLERR)) {
+                /* Hang-ups are reported even without any selected events,
+                 * e.g. while waiting for stream data: drop the client now */
+                epoll_ctl(host->epfd, EPOLL_CTL_DEL, cl->fd, NULL);
+                cl->i_poll_events = 0;
+                cl->i_state = HTTPD_CLIENT_DEAD;
+                continue;
+            }
+
+            /* Clients of deleted URLs are left for the next loop */
+            if (cl->i_state != HTTPD_CLIENT_DEAD)
+                httpd_ClientProcess(cl, now);
+        }
+    }
+#else
+    /* Handle the wake up pipe */
+    if (host->wakefd[0] != -1 && ufd[host->nfd].revents != 0) {
+        char buf[16];
+
+        atomic_store(&host->b_wakeup, false);
+        if (read(host->wakefd[0], buf, sizeof (buf)) < 0)
+            msg_Err(host, "wake up error: %s", vlc_strerror_c(errno));
+    }
+
+    /* Handle client sockets */
+    nfd = nfd_clients;
 
     for (int i_client = 0; i_client < host->i_client; i_client++) {
         httpd_client_t *cl = host->client[i_client];
@@ -2045,44 +2423,19 @@ static void httpdLoop(httpd_host_t *host)
         if (pufd->revents == 0)
             continue; // no event received
 
-        cl->i_activity_date = now;
-
-        switch (cl->i_state) {
-            case HTTPD_CLIENT_RECEIVING: httpd_ClientRecv(cl); break;
-            case HTTPD_CLIENT_SENDING:   httpd_ClientSend(cl); break;
-            case HTTPD_CLIENT_TLS_HS_IN:
-            case HTTPD_CLIENT_TLS_HS_OUT: httpd_ClientTlsHandshake(cl); break;
-        }
+        httpd_ClientProcess(cl, now);
     }
 
     /* Handle server sockets (accept new connections) */
     for (nfd = 0; nfd < host->nfd; nfd++) {
-        httpd_client_t *cl;
-        int fd = ufd[nfd].fd;
-
-        assert (fd == host->fds[nfd]);
+        assert (ufd[nfd].fd == host->fds[nfd]);
 
         if (ufd[nfd].revents == 0)
             continue;
 
-        /* */
-        fd = vlc_accept (fd, NULL, NULL, true);
-        if (fd == -1)
-            continue;
-        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
-                &(int){ 1 }, sizeof(int));
-
-        vlc_tls_t *p_tls;
-
-        if (host->p_tls)
-            p_tls = vlc_tls_SessionCreate(host->p_tls, fd, NULL);
-        else
-            p_tls = NULL;
-
-        cl = httpd_ClientNew(fd, p_tls, now);
-
-        TAB_APPEND(host->i_client, host->client, cl);
+        httpd_ClientAccept(host, ufd[nfd].fd, now);
     }
+#endif
 
     vlc_restorecancel(canc);
 }
@@ -225,6 +225,10 @@ playlist_t *playlist_Create( vlc_object_t *p_parent )
     ARRAY_INIT( pl_priv(p_playlist)->items_to_delete );
     ARRAY_INIT( p_playlist->current );
 
+    p->p_index = playlist_index_New();
+    if( unlikely(p->p_index == NULL) )
+        abort();
+
     p_playlist->i_current_index = 0;
     pl_priv(p_playlist)->b_reset_currently_playing = true;
 
@@ -364,6 +368,7 @@ void playlist_Destroy( playlist_t *p_playlist )
         free( p_del );
     FOREACH_END();
     ARRAY_RESET( p_sys->items_to_delete );
+    playlist_index_Delete( p_sys->p_index );
 
     ARRAY_RESET( p_playlist->items );
     ARRAY_RESET( p_playlist->current );
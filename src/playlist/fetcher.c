@@ -123,7 +123,7 @@ void playlist_fetcher_Push( playlist_fetcher_t *p_fetcher, input_item_t *p_item,
     vlc_gc_incref( p_item );
     p_entry->p_item = p_item;
     p_entry->p_next = NULL;
-    p_entry->i_options = i_options;
+    p_entry->i_options = i_options & META_REQUEST_OPTION_SCOPE_ANY;
     vlc_mutex_lock( &p_fetcher->lock );
     /* Append last */
     if ( p_fetcher->p_waiting_head[PASS1_LOCAL] )
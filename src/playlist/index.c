@@ -0,0 +1,678 @@
+/*****************************************************************************
+ * index.c: playlist item indexes
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+
+#include <vlc_common.h>
+#include <vlc_charset.h>
+#include <vlc_meta.h>
+#include <vlc_playlist.h>
+
+#include "../libvlc.h"
+#include "index.h"
+
+/*****************************************************************************
+ * Structures/definitions
+ *****************************************************************************/
+
+/* Playlist item of an input item. The tables are open-addressed, with
+ * linear probing, and at most half full. */
+typedef struct
+{
+    playlist_item_t *item;                                /* NULL if free */
+    uint32_t         slot;                       /* in the trigram index */
+} index_entry_t;
+
+/* Slots of the items with a trigram, in increasing order */
+typedef struct
+{
+    uint32_t  key;
+    uint32_t  count;
+    uint32_t  size;
+    uint32_t *slots;                                      /* NULL if free */
+} index_posting_t;
+
+struct playlist_index_t
+{
+    index_entry_t   *entries;
+    size_t           i_entries, i_entries_mask;
+
+    /* Items of the trigram index. Slots are not reused: removed and changed
+     * items leave dead slots, which are compacted when they outnumber the
+     * others, so that the postings stay sorted. */
+    playlist_item_t **slots;                              /* NULL if dead */
+    uint32_t         i_slots, i_slots_size, i_slots_dead;
+    index_posting_t *postings;
+    size_t           i_postings, i_postings_mask;
+
+    bool             b_broken; /**< out of memory: no more indexing */
+
+    vlc_mutex_t      lock; /**< protects the changed items */
+    playlist_item_t **changed;
+    size_t           i_changed, i_changed_mask;
+    bool             b_changed_lost;
+};
+
+#define INDEX_MIN_TABLE 64
+
+static size_t Hash( uint64_t v )
+{
+    v = (v ^ (v >> 33)) * UINT64_C(0xff51afd7ed558ccd);
+    v = (v ^ (v >> 33)) * UINT64_C(0xc4ceb9fe1a85ec53);
+    return v ^ (v >> 33);
+}
+
+#define HashPointer( p ) Hash( (uintptr_t)(p) )
+
+/*****************************************************************************
+ * Input item to playlist items
+ *****************************************************************************/
+static bool EntryGrow( playlist_index_t *p_index )
+{
+    size_t i_size = __MAX( INDEX_MIN_TABLE, 2 * (p_index->i_entries_mask + 1) );
+    index_entry_t *p_entries = calloc( i_size, sizeof( *p_entries ) );
+    if( unlikely(p_entries == NULL) )
+        return false;
+
+    for( size_t i = 0; p_index->entries && i <= p_index->i_entries_mask; i++ )
+    {
+        if( p_index->entries[i].item == NULL )
+            continue;
+
+        size_t j = HashPointer( p_index->entries[i].item->p_input );
+        while( p_entries[j & (i_size - 1)].item != NULL )
+            j++;
+        p_entries[j & (i_size - 1)] = p_index->entries[i];
+    }
+    free( p_index->entries );
+    p_index->entries = p_entries;
+    p_index->i_entries_mask = i_size - 1;
+    return true;
+}
+
+static bool EntryAdd( playlist_index_t *p_index, playlist_item_t *p_item,
+                      uint32_t i_slot )
+{
+    if( 2 * (p_index->i_entries + 1) > p_index->i_entries_mask + 1
+     && !EntryGrow( p_index ) )
+        return false;
+
+    size_t i = HashPointer( p_item->p_input ) & p_index->i_entries_mask;
+    while( p_index->entries[i].item != NULL )
+        i = (i + 1) & p_index->i_entries_mask;
+    p_index->entries[i].item = p_item;
+    p_index->entries[i].slot = i_slot;
+    p_index->i_entries++;
+    return true;
+}
+
+/* Returns the entry of exactly that playlist item */
+static index_entry_t *EntryGet( playlist_index_t *p_index,
+                                const playlist_item_t *p_item )
+{
+    if( p_index->entries == NULL )
+        return NULL;
+
+    size_t i = HashPointer( p_item->p_input ) & p_index->i_entries_mask;
+    while( p_index->entries[i].item != NULL )
+    {
+        if( p_index->entries[i].item == p_item )
+            return &p_index->entries[i];
+        i = (i + 1) & p_index->i_entries_mask;
+    }
+    return NULL;
+}
+
+/* Moves back the next entries of the probe sequence, instead of leaving a
+ * tombstone */
+static void EntryRemove( playlist_index_t *p_index, index_entry_t *p_entry )
+{
+    const size_t mask = p_index->i_entries_mask;
+    size_t i = p_entry - p_index->entries, j = i;
+
+    for( ;; )
+    {
+        j = (j + 1) & mask;
+        if( p_index->entries[j].item == NULL )
+            break;
+
+        size_t k = HashPointer( p_index->entries[j].item->p_input ) & mask;
+        /* The entry stays if its home is (cyclically) in ]i, j] */
+        if( i <= j ? (i < k && k <= j) : (i < k || k <= j) )
+            continue;
+        p_index->entries[i] = p_index->entries[j];
+        i = j;
+    }
+    p_index->entries[i].item = NULL;
+    p_index->i_entries--;
+}
+
+/*****************************************************************************
+ * Trigrams
+ *****************************************************************************/
+typedef struct
+{
+    uint32_t *keys;
+    size_t    i_count, i_size;
+} trigrams_t;
+
+/* Adds the trigrams of the lower case characters of a string. Like
+ * vlc_strcasestr(), this stops at the first invalid sequence. */
+static bool TrigramsAdd( trigrams_t *p_tri, const char *psz )
+{
+    uint64_t window = 0;
+    unsigned i_chars = 0;
+    uint32_t cp;
+    ssize_t s;
+
+    while( (s = vlc_towc( psz, &cp )) > 0 )
+    {
+        psz += s;
+        window = ((window << 21) | (towlower( cp ) & 0x1fffff))
+               & ((UINT64_C(1) << 63) - 1);
+        if( ++i_chars < 3 )
+            continue;
+
+        if( p_tri->i_count == p_tri->i_size )
+        {
+            size_t i_size = __MAX( 32, 2 * p_tri->i_size );
+            uint32_t *p_keys = realloc( p_tri->keys,
+                                        i_size * sizeof( *p_keys ) );
+            if( unlikely(p_keys == NULL) )
+                return false;
+            p_tri->keys = p_keys;
+            p_tri->i_size = i_size;
+        }
+        p_tri->keys[p_tri->i_count++] = Hash( window );
+    }
+    return true;
+}
+
+static int CompareKey( const void *a, const void *b )
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void TrigramsUnique( trigrams_t *p_tri )
+{
+    size_t j = 0;
+
+    qsort( p_tri->keys, p_tri->i_count, sizeof( uint32_t ), CompareKey );
+    for( size_t i = 0; i < p_tri->i_count; i++ )
+        if( j == 0 || p_tri->keys[i] != p_tri->keys[j - 1] )
+            p_tri->keys[j++] = p_tri->keys[i];
+    p_tri->i_count = j;
+}
+
+/* The strings of the live search: title (or name), album and artist */
+static bool TrigramsOfItem( trigrams_t *p_tri, input_item_t *p_input )
+{
+    bool b_ok = true;
+
+    vlc_mutex_lock( &p_input->lock );
+    if( p_input->p_meta )
+    {
+        const char *psz_title = vlc_meta_Get( p_input->p_meta, vlc_meta_Title );
+        if( !psz_title )
+            psz_title = p_input->psz_name;
+        const char *psz_album = vlc_meta_Get( p_input->p_meta, vlc_meta_Album );
+        const char *psz_artist = vlc_meta_Get( p_input->p_meta, vlc_meta_Artist );
+
+        if( psz_title )
+            b_ok = TrigramsAdd( p_tri, psz_title );
+        if( b_ok && psz_album )
+            b_ok = TrigramsAdd( p_tri, psz_album );
+        if( b_ok && psz_artist )
+            b_ok = TrigramsAdd( p_tri, psz_artist );
+    }
+    else if( p_input->psz_name )
+        b_ok = TrigramsAdd( p_tri, p_input->psz_name );
+    vlc_mutex_unlock( &p_input->lock );
+
+    if( b_ok )
+        TrigramsUnique( p_tri );
+    return b_ok;
+}
+
+/*****************************************************************************
+ * Trigram index
+ *****************************************************************************/
+static index_posting_t *PostingFind( playlist_index_t *p_index, uint32_t key )
+{
+    if( p_index->postings == NULL )
+        return NULL;
+
+    size_t i = Hash( key ) & p_index->i_postings_mask;
+    while( p_index->postings[i].slots != NULL )
+    {
+        if( p_index->postings[i].key == key )
+            return &p_index->postings[i];
+        i = (i + 1) & p_index->i_postings_mask;
+    }
+    return NULL;
+}
+
+static bool PostingGrow( playlist_index_t *p_index )
+{
+    size_t i_size = __MAX( INDEX_MIN_TABLE,
+                           2 * (p_index->i_postings_mask + 1) );
+    index_posting_t *p_postings = calloc( i_size, sizeof( *p_postings ) );
+    if( unlikely(p_postings == NULL) )
+        return false;
+
+    for( size_t i = 0; p_index->postings && i <= p_index->i_postings_mask; i++ )
+    {
+        if( p_index->postings[i].slots == NULL )
+            continue;
+
+        size_t j = Hash( p_index->postings[i].key );
+        while( p_postings[j & (i_size - 1)].slots != NULL )
+            j++;
+        p_postings[j & (i_size - 1)] = p_index->postings[i];
+    }
+    free( p_index->postings );
+    p_index->postings = p_postings;
+    p_index->i_postings_mask = i_size - 1;
+    return true;
+}
+
+static bool PostingAdd( playlist_index_t *p_index, uint32_t key,
+                        uint32_t i_slot )
+{
+    index_posting_t *p_posting = PostingFind( p_index, key );
+
+    if( p_posting == NULL )
+    {
+        if( 2 * (p_index->i_postings + 1) > p_index->i_postings_mask + 1
+         && !PostingGrow( p_index ) )
+            return false;
+
+        uint32_t *p_slots = malloc( 4 * sizeof( *p_slots ) );
+        if( unlikely(p_slots == NULL) )
+            return false;
+
+        size_t i = Hash( key ) & p_index->i_postings_mask;
+        while( p_index->postings[i].slots != NULL )
+            i = (i + 1) & p_index->i_postings_mask;
+        p_posting = &p_index->postings[i];
+        p_posting->key = key;
+        p_posting->count = 0;
+        p_posting->size = 4;
+        p_posting->slots = p_slots;
+        p_index->i_postings++;
+    }
+    else if( p_posting->count == p_posting->size )
+    {
+        uint32_t *p_slots = realloc( p_posting->slots, 2 * p_posting->size
+                                                       * sizeof( *p_slots ) );
+        if( unlikely(p_slots == NULL) )
+            return false;
+        p_posting->slots = p_slots;
+        p_posting->size *= 2;
+    }
+
+    assert( p_posting->count == 0
+         || p_posting->slots[p_posting->count - 1] < i_slot );
+    p_posting->slots[p_posting->count++] = i_slot;
+    return true;
+}
+
+/* Gives the item a new slot, with its current trigrams */
+static bool SlotAdd( playlist_index_t *p_index, playlist_item_t *p_item,
+                     uint32_t *pi_slot )
+{
+    if( p_index->i_slots == p_index->i_slots_size )
+    {
+        if( p_index->i_slots_size >= UINT32_MAX / 2 )
+            return false;
+
+        uint32_t i_size = __MAX( INDEX_MIN_TABLE, 2 * p_index->i_slots_size );
+        playlist_item_t **pp_slots = realloc( p_index->slots,
+                                              i_size * sizeof( *pp_slots ) );
+        if( unlikely(pp_slots == NULL) )
+            return false;
+        p_index->slots = pp_slots;
+        p_index->i_slots_size = i_size;
+    }
+
+    trigrams_t tri = { NULL, 0, 0 };
+    uint32_t i_slot = p_index->i_slots;
+    bool b_ok = TrigramsOfItem( &tri, p_item->p_input );
+
+    for( size_t i = 0; b_ok && i < tri.i_count; i++ )
+        b_ok = PostingAdd( p_index, tri.keys[i], i_slot );
+    free( tri.keys );
+
+    /* A partly indexed item would be missed by searches */
+    if( !b_ok )
+        return false;
+
+    p_index->slots[p_index->i_slots++] = p_item;
+    *pi_slot = i_slot;
+    return true;
+}
+
+/* Renumbers the live slots, in the same order */
+static void SlotCompact( playlist_index_t *p_index )
+{
+    uint32_t *p_map = malloc( p_index->i_slots * sizeof( *p_map ) );
+    if( unlikely(p_map == NULL) )
+        return; /* next time */
+
+    uint32_t n = 0;
+    for( uint32_t i = 0; i < p_index->i_slots; i++ )
+    {
+        p_map[i] = n;
+        if( p_index->slots[i] != NULL )
+            p_index->slots[n++] = p_index->slots[i];
+        else
+            p_map[i] = UINT32_MAX;
+    }
+
+    for( size_t i = 0; p_index->postings && i <= p_index->i_postings_mask; i++ )
+    {
+        index_posting_t *p_posting = &p_index->postings[i];
+        uint32_t j = 0;
+
+        if( p_posting->slots == NULL )
+            continue;
+        for( uint32_t k = 0; k < p_posting->count; k++ )
+            if( p_map[p_posting->slots[k]] != UINT32_MAX )
+                p_posting->slots[j++] = p_map[p_posting->slots[k]];
+        p_posting->count = j;
+    }
+
+    for( size_t i = 0; p_index->entries && i <= p_index->i_entries_mask; i++ )
+        if( p_index->entries[i].item != NULL )
+            p_index->entries[i].slot = p_map[p_index->entries[i].slot];
+
+    free( p_map );
+    p_index->i_slots = n;
+    p_index->i_slots_dead = 0;
+}
+
+static void SlotRemove( playlist_index_t *p_index, uint32_t i_slot )
+{
+    assert( p_index->slots[i_slot] != NULL );
+    p_index->slots[i_slot] = NULL;
+    p_index->i_slots_dead++;
+
+    if( p_index->i_slots_dead > INDEX_MIN_TABLE
+     && 2 * p_index->i_slots_dead > p_index->i_slots )
+        SlotCompact( p_index );
+}
+
+/* Indexes the trigrams of the items whose name or meta data changed */
+static void ProcessChanged( playlist_index_t *p_index )
+{
+    vlc_mutex_lock( &p_index->lock );
+    playlist_item_t **pp_changed = p_index->changed;
+    size_t i_size = pp_changed ? p_index->i_changed_mask + 1 : 0;
+    if( p_index->b_changed_lost )
+        p_index->b_broken = true;
+    p_index->changed = NULL;
+    p_index->i_changed = 0;
+    p_index->i_changed_mask = 0;
+    vlc_mutex_unlock( &p_index->lock );
+
+    for( size_t i = 0; i < i_size && !p_index->b_broken; i++ )
+    {
+        if( pp_changed[i] == NULL )
+            continue;
+
+        /* The item may have been removed since */
+        index_entry_t *p_entry = EntryGet( p_index, pp_changed[i] );
+        if( p_entry == NULL )
+            continue;
+
+        uint32_t i_slot;
+        if( SlotAdd( p_index, pp_changed[i], &i_slot ) )
+        {
+            /* SlotRemove() may renumber the slots of the entries */
+            uint32_t i_old = p_entry->slot;
+            p_entry->slot = i_slot;
+            SlotRemove( p_index, i_old );
+        }
+        else
+            p_index->b_broken = true;
+    }
+    free( pp_changed );
+}
+
+/*****************************************************************************
+ * Public functions
+ *****************************************************************************/
+playlist_index_t *playlist_index_New( void )
+{
+    playlist_index_t *p_index = calloc( 1, sizeof( *p_index ) );
+    if( unlikely(p_index == NULL) )
+        return NULL;
+
+    vlc_mutex_init( &p_index->lock );
+    return p_index;
+}
+
+void playlist_index_Delete( playlist_index_t *p_index )
+{
+    for( size_t i = 0; p_index->postings && i <= p_index->i_postings_mask; i++ )
+        free( p_index->postings[i].slots );
+    free( p_index->postings );
+    free( p_index->slots );
+    free( p_index->entries );
+    free( p_index->changed );
+    vlc_mutex_destroy( &p_index->lock );
+    free( p_index );
+}
+
+void playlist_index_Add( playlist_index_t *p_index, playlist_item_t *p_item )
+{
+    uint32_t i_slot;
+
+    if( p_index->b_broken )
+        return;
+    if( !SlotAdd( p_index, p_item, &i_slot ) )
+        p_index->b_broken = true;
+    else if( !EntryAdd( p_index, p_item, i_slot ) )
+    {
+        SlotRemove( p_index, i_slot );
+        p_index->b_broken = true;
+    }
+}
+
+void playlist_index_Remove( playlist_index_t *p_index, playlist_item_t *p_item )
+{
+    if( p_index->b_broken )
+        return;
+
+    index_entry_t *p_entry = EntryGet( p_index, p_item );
+    if( p_entry == NULL )
+        return;
+
+    uint32_t i_slot = p_entry->slot;
+    EntryRemove( p_index, p_entry );
+    SlotRemove( p_index, i_slot );
+}
+
+void playlist_index_Changed( playlist_index_t *p_index,
+                             playlist_item_t *p_item )
+{
+    vlc_mutex_lock( &p_index->lock );
+    if( 2 * (p_index->i_changed + 1) > p_index->i_changed_mask + 1 )
+    {
+        size_t i_old = p_index->changed ? p_index->i_changed_mask + 1 : 0;
+        size_t i_size = __MAX( INDEX_MIN_TABLE, 2 * i_old );
+        playlist_item_t **pp_changed = calloc( i_size, sizeof( *pp_changed ) );
+
+        if( unlikely(pp_changed == NULL) )
+        {
+            p_index->b_changed_lost = true; /* no longer up to date */
+            vlc_mutex_unlock( &p_index->lock );
+            return;
+        }
+        for( size_t i = 0; i < i_old; i++ )
+        {
+            if( p_index->changed[i] == NULL )
+                continue;
+
+            size_t j = HashPointer( p_index->changed[i] );
+            while( pp_changed[j & (i_size - 1)] != NULL )
+                j++;
+            pp_changed[j & (i_size - 1)] = p_index->changed[i];
+        }
+        free( p_index->changed );
+        p_index->changed = pp_changed;
+        p_index->i_changed_mask = i_size - 1;
+    }
+
+    size_t i = HashPointer( p_item ) & p_index->i_changed_mask;
+    while( p_index->changed[i] != NULL && p_index->changed[i] != p_item )
+        i = (i + 1) & p_index->i_changed_mask;
+    if( p_index->changed[i] == NULL )
+    {
+        p_index->changed[i] = p_item;
+        p_index->i_changed++;
+    }
+    vlc_mutex_unlock( &p_index->lock );
+}
+
+playlist_item_t *playlist_index_Find( playlist_index_t *p_index,
+                                      const input_item_t *p_input,
+                                      bool *found )
+{
+    *found = !p_index->b_broken;
+    if( p_index->b_broken || p_index->entries == NULL )
+        return NULL;
+
+    size_t i = HashPointer( p_input ) & p_index->i_entries_mask;
+    while( p_index->entries[i].item != NULL )
+    {
+        if( p_index->entries[i].item->p_input == p_input )
+            return p_index->entries[i].item;
+        i = (i + 1) & p_index->i_entries_mask;
+    }
+    return NULL;
+}
+
+static int ComparePostingSize( const void *a, const void *b )
+{
+    const index_posting_t *x = *(const index_posting_t **)a;
+    const index_posting_t *y = *(const index_posting_t **)b;
+    return (x->count > y->count) - (x->count < y->count);
+}
+
+static bool PostingHas( const index_posting_t *p_posting, uint32_t i_slot )
+{
+    size_t lo = 0, hi = p_posting->count;
+
+    while( lo < hi )
+    {
+        size_t mid = (lo + hi) / 2;
+        if( p_posting->slots[mid] < i_slot )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < p_posting->count && p_posting->slots[lo] == i_slot;
+}
+
+ssize_t playlist_index_Search( playlist_index_t *p_index, const char *psz,
+                               playlist_item_t ***candidates )
+{
+    ProcessChanged( p_index );
+    if( p_index->b_broken )
+        return -1;
+
+    /* An invalid search string matches nothing, but let the caller tell */
+    for( const char *psz_cur = psz; *psz_cur != '\0'; )
+    {
+        uint32_t cp;
+        ssize_t s = vlc_towc( psz_cur, &cp );
+        if( s <= 0 )
+            return -1;
+        psz_cur += s;
+    }
+
+    trigrams_t tri = { NULL, 0, 0 };
+    if( !TrigramsAdd( &tri, psz ) || tri.i_count == 0 )
+    {
+        free( tri.keys );
+        return -1;
+    }
+    TrigramsUnique( &tri );
+
+    index_posting_t **pp_postings = malloc( tri.i_count
+                                            * sizeof( *pp_postings ) );
+    if( unlikely(pp_postings == NULL) )
+    {
+        free( tri.keys );
+        return -1;
+    }
+
+    playlist_item_t **pp_items = NULL;
+    ssize_t i_count = 0;
+    for( size_t i = 0; i < tri.i_count; i++ )
+    {
+        pp_postings[i] = PostingFind( p_index, tri.keys[i] );
+        if( pp_postings[i] == NULL || pp_postings[i]->count == 0 )
+            goto out; /* no item has that trigram */
+    }
+    qsort( pp_postings, tri.i_count, sizeof( *pp_postings ),
+           ComparePostingSize );
+
+    /* Intersect the shortest posting with the others */
+    const index_posting_t *p_first = pp_postings[0];
+    pp_items = malloc( p_first->count * sizeof( *pp_items ) );
+    if( unlikely(pp_items == NULL) )
+    {
+        i_count = -1;
+        goto out;
+    }
+
+    for( uint32_t i = 0; i < p_first->count; i++ )
+    {
+        uint32_t i_slot = p_first->slots[i];
+        size_t j = 1;
+
+        if( p_index->slots[i_slot] == NULL )
+            continue;
+        while( j < tri.i_count && PostingHas( pp_postings[j], i_slot ) )
+            j++;
+        if( j == tri.i_count )
+            pp_items[i_count++] = p_index->slots[i_slot];
+    }
+out:
+    if( i_count <= 0 )
+    {
+        free( pp_items );
+        pp_items = NULL;
+    }
+    *candidates = pp_items;
+    free( pp_postings );
+    free( tri.keys );
+    return i_count;
+}
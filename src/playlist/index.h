@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * index.h: playlist item indexes
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef _PLAYLIST_INDEX_H
+#define _PLAYLIST_INDEX_H 1
+
+#include <vlc_playlist.h>
+
+/**
+ * Index opaque structure.
+ *
+ * The index finds the playlist items of an input item with a hash table, and
+ * the candidates of a live search with the trigrams (sequences of three
+ * lower case characters) of the title, album and artist of the items.
+ *
+ * All functions but playlist_index_Changed() must be called with the
+ * playlist lock held.
+ */
+typedef struct playlist_index_t playlist_index_t;
+
+/**
+ * This function creates an empty index.
+ */
+playlist_index_t *playlist_index_New( void );
+
+/**
+ * This function destroys the index. It does not release the items.
+ */
+void playlist_index_Delete( playlist_index_t * );
+
+/**
+ * This function adds a playlist item, as it is added to the playlist.
+ *
+ * The item stays indexed until it is removed, even if the index runs out of
+ * memory: the lookups then fall back to linear searches.
+ */
+void playlist_index_Add( playlist_index_t *, playlist_item_t * );
+
+/**
+ * This function removes a playlist item, as it is removed from the playlist.
+ */
+void playlist_index_Remove( playlist_index_t *, playlist_item_t * );
+
+/**
+ * This function queues a playlist item whose name or meta data changed, to
+ * be indexed again before the next search.
+ *
+ * It can be called from any thread, with or without the playlist lock.
+ */
+void playlist_index_Changed( playlist_index_t *, playlist_item_t * );
+
+/**
+ * This function finds a playlist item of an input item.
+ *
+ * \param found set to false if the index cannot tell (out of memory)
+ * \return the item (if several items have the input, any of them), or NULL
+ */
+playlist_item_t *playlist_index_Find( playlist_index_t *,
+                                      const input_item_t *, bool *found );
+
+/**
+ * This function finds the playlist items that may match a live search.
+ *
+ * All the items that match the search are in the candidates, but some
+ * candidates may not match.
+ *
+ * \param candidates the candidates, to be freed, if the function succeeds
+ * \return the number of candidates, or -1 if the index cannot help (search
+ * string of less than three characters, out of memory)
+ */
+ssize_t playlist_index_Search( playlist_index_t *, const char *,
+                               playlist_item_t ***candidates );
+
+#endif
@@ -176,7 +176,11 @@ static void input_item_changed( const vlc_event_t * p_event,
                                 void * user_data )
 {
     playlist_item_t *p_item = user_data;
-    VLC_UNUSED( p_event );
+
+    /* The live search looks at the name and meta data */
+    if( p_event->type == vlc_InputItemMetaChanged
+     || p_event->type == vlc_InputItemNameChanged )
+        playlist_index_Changed( pl_priv(p_item->p_playlist)->p_index, p_item );
     var_SetAddress( p_item->p_playlist, "item-change", p_item->p_input );
 }
 
@@ -781,6 +785,7 @@ static void AddItem( playlist_t *p_playlist, playlist_item_t *p_item,
     PL_ASSERT_LOCKED;
     ARRAY_APPEND(p_playlist->items, p_item);
     ARRAY_APPEND(p_playlist->all_items, p_item);
+    playlist_index_Add( pl_priv(p_playlist)->p_index, p_item );
 
     if( i_pos == PLAYLIST_END )
         playlist_NodeAppend( p_playlist, p_item, p_node );
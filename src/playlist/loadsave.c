@@ -163,10 +163,15 @@ int playlist_MLLoad( playlist_t *p_playlist )
         return VLC_EGENERIC;
 
     PL_LOCK;
+    /* The index is keyed by input item */
+    playlist_index_Remove( pl_priv(p_playlist)->p_index,
+                           p_playlist->p_media_library );
     if( p_playlist->p_media_library->p_input )
         vlc_gc_decref( p_playlist->p_media_library->p_input );
 
     p_playlist->p_media_library->p_input = p_input;
+    playlist_index_Add( pl_priv(p_playlist)->p_index,
+                        p_playlist->p_media_library );
 
     vlc_event_attach( &p_input->event_manager, vlc_InputItemSubItemTreeAdded,
                         input_item_subitem_tree_added, p_playlist );
@@ -0,0 +1,889 @@
+/*****************************************************************************
+ * metacache.c: preparsing results cache
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vlc_common.h>
+#include <vlc_arrays.h>
+#include <vlc_charset.h>
+#include <vlc_es.h>
+#include <vlc_fs.h>
+#include <vlc_meta.h>
+#include <vlc_url.h>
+
+#include "metacache.h"
+#include "input/item.h"
+
+/*****************************************************************************
+ * Structures/definitions
+ *****************************************************************************/
+/* Magic and version of the file: bump the version whenever the entries
+ * change, the old files are then ignored. */
+#define METACACHE_STRING "metacache "PACKAGE_NAME
+#define METACACHE_VERSION 1
+
+#define METACACHE_MAX_ES 256
+#define METACACHE_MAX_STRING 16384
+
+/* Changes are written this long after the first one */
+#define METACACHE_SAVE_DELAY (30 * CLOCK_FREQ)
+
+typedef struct
+{
+    uint64_t      i_size;     /**< file size */
+    int64_t       i_mtime;    /**< file modification time */
+    uint64_t      i_used;     /**< cache clock at the last use */
+    mtime_t       i_duration;
+    int           i_es;
+    es_format_t **es;
+    vlc_meta_t   *p_meta;
+} metacache_entry_t;
+
+struct playlist_metacache_t
+{
+    vlc_object_t    *obj;
+    char            *psz_path;
+    unsigned         i_max;
+
+    vlc_mutex_t      lock;
+    vlc_dictionary_t entries; /* by URI */
+    unsigned         i_count;
+    uint64_t         i_clock; /* counts the uses, for the eviction */
+    bool             b_loaded;
+    bool             b_dirty;
+
+    vlc_timer_t      save_timer;
+    bool             b_timer;
+    bool             b_save_pending;
+};
+
+/*****************************************************************************
+ * Entries
+ *****************************************************************************/
+/* Only keeps what the interfaces show of the streams */
+static void FormatCopy( es_format_t *p_dst, const es_format_t *p_src )
+{
+    es_format_Init( p_dst, p_src->i_cat, p_src->i_codec );
+    p_dst->i_original_fourcc = p_src->i_original_fourcc;
+    p_dst->i_id = p_src->i_id;
+    p_dst->i_group = p_src->i_group;
+    p_dst->i_priority = p_src->i_priority;
+    if( p_src->psz_language != NULL )
+        p_dst->psz_language = strdup( p_src->psz_language );
+    if( p_src->psz_description != NULL )
+        p_dst->psz_description = strdup( p_src->psz_description );
+
+    p_dst->audio.i_format = p_src->audio.i_format;
+    p_dst->audio.i_rate = p_src->audio.i_rate;
+    p_dst->audio.i_physical_channels = p_src->audio.i_physical_channels;
+    p_dst->audio.i_original_channels = p_src->audio.i_original_channels;
+    p_dst->audio.i_bitspersample = p_src->audio.i_bitspersample;
+    p_dst->audio.i_blockalign = p_src->audio.i_blockalign;
+    p_dst->audio.i_channels = p_src->audio.i_channels;
+
+    p_dst->video.i_chroma = p_src->video.i_chroma;
+    p_dst->video.i_width = p_src->video.i_width;
+    p_dst->video.i_height = p_src->video.i_height;
+    p_dst->video.i_visible_width = p_src->video.i_visible_width;
+    p_dst->video.i_visible_height = p_src->video.i_visible_height;
+    p_dst->video.i_sar_num = p_src->video.i_sar_num;
+    p_dst->video.i_sar_den = p_src->video.i_sar_den;
+    p_dst->video.i_frame_rate = p_src->video.i_frame_rate;
+    p_dst->video.i_frame_rate_base = p_src->video.i_frame_rate_base;
+    p_dst->video.orientation = p_src->video.orientation;
+
+    if( p_src->subs.psz_encoding != NULL )
+        p_dst->subs.psz_encoding = strdup( p_src->subs.psz_encoding );
+
+    p_dst->i_bitrate = p_src->i_bitrate;
+    p_dst->i_profile = p_src->i_profile;
+    p_dst->i_level = p_src->i_level;
+}
+
+static void EntryDelete( metacache_entry_t *p_entry )
+{
+    for( int i = 0; i < p_entry->i_es; i++ )
+    {
+        es_format_Clean( p_entry->es[i] );
+        free( p_entry->es[i] );
+    }
+    free( p_entry->es );
+    if( p_entry->p_meta != NULL )
+        vlc_meta_Delete( p_entry->p_meta );
+    free( p_entry );
+}
+
+static void EntryFree( void *data, void *obj )
+{
+    VLC_UNUSED(obj);
+    EntryDelete( data );
+}
+
+static metacache_entry_t *EntryNew( mtime_t i_duration, int i_es,
+                                    es_format_t *const *es,
+                                    const vlc_meta_t *p_meta )
+{
+    metacache_entry_t *p_entry = calloc( 1, sizeof(*p_entry) );
+    if( unlikely(p_entry == NULL) )
+        return NULL;
+
+    p_entry->i_duration = i_duration;
+    p_entry->p_meta = vlc_meta_New();
+    if( i_es > 0 )
+        p_entry->es = malloc( i_es * sizeof(*p_entry->es) );
+    if( unlikely(p_entry->p_meta == NULL || (i_es > 0 && p_entry->es == NULL)) )
+    {
+        EntryDelete( p_entry );
+        return NULL;
+    }
+
+    for( int i = 0; i < i_es; i++ )
+    {
+        es_format_t *p_fmt = malloc( sizeof(*p_fmt) );
+        if( unlikely(p_fmt == NULL) )
+        {
+            EntryDelete( p_entry );
+            return NULL;
+        }
+        FormatCopy( p_fmt, es[i] );
+        p_entry->es[p_entry->i_es++] = p_fmt;
+    }
+    if( p_meta != NULL )
+        vlc_meta_Merge( p_entry->p_meta, p_meta );
+    return p_entry;
+}
+
+/* Identifies a local file by its size and modification time */
+static int FileIdentity( const char *psz_uri, uint64_t *pi_size,
+                         int64_t *pi_mtime )
+{
+    char *psz_path = make_path( psz_uri );
+    if( psz_path == NULL )
+        return VLC_EGENERIC;
+
+    struct stat st;
+    int i_ret = vlc_stat( psz_path, &st );
+    free( psz_path );
+    if( i_ret || !S_ISREG( st.st_mode ) )
+        return VLC_EGENERIC;
+
+    *pi_size = st.st_size;
+    *pi_mtime = st.st_mtime;
+    return VLC_SUCCESS;
+}
+
+/* Schedules the saving of the changes, lock held */
+static void Changed( playlist_metacache_t *p_cache )
+{
+    p_cache->b_dirty = true;
+    if( p_cache->b_timer && !p_cache->b_save_pending )
+    {
+        p_cache->b_save_pending = true;
+        vlc_timer_schedule( p_cache->save_timer, false,
+                            METACACHE_SAVE_DELAY, 0 );
+    }
+}
+
+static void Remove( playlist_metacache_t *p_cache, const char *psz_uri )
+{
+    if( vlc_dictionary_value_for_key( &p_cache->entries, psz_uri )
+        == kVLCDictionaryNotFound )
+        return;
+    vlc_dictionary_remove_value_for_key( &p_cache->entries, psz_uri,
+                                         EntryFree, NULL );
+    p_cache->i_count--;
+    Changed( p_cache );
+}
+
+typedef struct
+{
+    const char              *psz_uri;
+    const metacache_entry_t *p_entry;
+} metacache_ref_t;
+
+static int CompareUse( const void *a, const void *b )
+{
+    const metacache_ref_t *ra = a, *rb = b;
+
+    if( ra->p_entry->i_used != rb->p_entry->i_used )
+        return ra->p_entry->i_used < rb->p_entry->i_used ? -1 : 1;
+    return 0;
+}
+
+/* Lists the entries, least recently used first */
+static metacache_ref_t *List( playlist_metacache_t *p_cache )
+{
+    metacache_ref_t *p_refs = malloc( p_cache->i_count * sizeof(*p_refs) );
+    if( unlikely(p_refs == NULL) )
+        return NULL;
+
+    unsigned n = 0;
+    for( int i = 0; i < p_cache->entries.i_size; i++ )
+        for( vlc_dictionary_entry_t *p_dict = p_cache->entries.p_entries[i];
+             p_dict != NULL; p_dict = p_dict->p_next )
+        {
+            p_refs[n].psz_uri = p_dict->psz_key;
+            p_refs[n].p_entry = p_dict->p_value;
+            n++;
+        }
+    qsort( p_refs, n, sizeof(*p_refs), CompareUse );
+    return p_refs;
+}
+
+/* Evicts the least recently used entries down to i_max entries */
+static void Evict( playlist_metacache_t *p_cache )
+{
+    if( p_cache->i_count <= p_cache->i_max )
+        return;
+
+    metacache_ref_t *p_refs = List( p_cache );
+    if( unlikely(p_refs == NULL) )
+        return;
+
+    unsigned i_evict = p_cache->i_count - p_cache->i_max;
+    /* Remove() frees the keys: copy them first */
+    char **ppsz_uris = malloc( i_evict * sizeof(*ppsz_uris) );
+    if( likely(ppsz_uris != NULL) )
+    {
+        for( unsigned i = 0; i < i_evict; i++ )
+            ppsz_uris[i] = strdup( p_refs[i].psz_uri );
+        for( unsigned i = 0; i < i_evict; i++ )
+        {
+            if( likely(ppsz_uris[i] != NULL) )
+                Remove( p_cache, ppsz_uris[i] );
+            free( ppsz_uris[i] );
+        }
+        free( ppsz_uris );
+    }
+    free( p_refs );
+}
+
+/*****************************************************************************
+ * File
+ *****************************************************************************/
+#define LOAD_IMMEDIATE(a) \
+    if (fread (&(a), sizeof (char), sizeof (a), file) != sizeof (a)) \
+        goto error
+
+static int LoadString( char **p, FILE *file )
+{
+    char *psz = NULL;
+    uint16_t size;
+
+    LOAD_IMMEDIATE( size );
+    if( size > METACACHE_MAX_STRING )
+    {
+error:
+        return -1;
+    }
+
+    if( size > 0 )
+    {
+        psz = malloc( size + 1 );
+        if( unlikely(psz == NULL) )
+            goto error;
+        if( fread( psz, 1, size, file ) != size )
+        {
+            free( psz );
+            goto error;
+        }
+        psz[size] = '\0';
+        if( IsUTF8( psz ) == NULL )
+        {
+            free( psz );
+            goto error;
+        }
+    }
+    *p = psz;
+    return 0;
+}
+
+#define LOAD_STRING(a) \
+    if (LoadString (&(a), file)) goto error
+
+static int LoadFormat( es_format_t *p_fmt, FILE *file )
+{
+    int i_cat;
+
+    LOAD_IMMEDIATE( i_cat );
+    if( i_cat < 0 || i_cat >= ES_CATEGORY_COUNT )
+        return -1;
+    es_format_Init( p_fmt, i_cat, 0 );
+    LOAD_IMMEDIATE( p_fmt->i_codec );
+    LOAD_IMMEDIATE( p_fmt->i_original_fourcc );
+    LOAD_IMMEDIATE( p_fmt->i_id );
+    LOAD_IMMEDIATE( p_fmt->i_group );
+    LOAD_IMMEDIATE( p_fmt->i_priority );
+    LOAD_STRING( p_fmt->psz_language );
+    LOAD_STRING( p_fmt->psz_description );
+
+    LOAD_IMMEDIATE( p_fmt->audio.i_format );
+    LOAD_IMMEDIATE( p_fmt->audio.i_rate );
+    LOAD_IMMEDIATE( p_fmt->audio.i_physical_channels );
+    LOAD_IMMEDIATE( p_fmt->audio.i_original_channels );
+    LOAD_IMMEDIATE( p_fmt->audio.i_bitspersample );
+    LOAD_IMMEDIATE( p_fmt->audio.i_blockalign );
+    LOAD_IMMEDIATE( p_fmt->audio.i_channels );
+
+    LOAD_IMMEDIATE( p_fmt->video.i_chroma );
+    LOAD_IMMEDIATE( p_fmt->video.i_width );
+    LOAD_IMMEDIATE( p_fmt->video.i_height );
+    LOAD_IMMEDIATE( p_fmt->video.i_visible_width );
+    LOAD_IMMEDIATE( p_fmt->video.i_visible_height );
+    LOAD_IMMEDIATE( p_fmt->video.i_sar_num );
+    LOAD_IMMEDIATE( p_fmt->video.i_sar_den );
+    LOAD_IMMEDIATE( p_fmt->video.i_frame_rate );
+    LOAD_IMMEDIATE( p_fmt->video.i_frame_rate_base );
+    LOAD_IMMEDIATE( p_fmt->video.orientation );
+
+    LOAD_STRING( p_fmt->subs.psz_encoding );
+
+    LOAD_IMMEDIATE( p_fmt->i_bitrate );
+    LOAD_IMMEDIATE( p_fmt->i_profile );
+    LOAD_IMMEDIATE( p_fmt->i_level );
+    return 0;
+error:
+    return -1;
+}
+
+static metacache_entry_t *LoadEntry( FILE *file, char **ppsz_uri )
+{
+    metacache_entry_t *p_entry = EntryNew( -1, 0, NULL, NULL );
+    char *psz_uri = NULL, *psz_name = NULL, *psz_value = NULL;
+    uint16_t i_es, i_extra;
+    uint8_t i_meta;
+
+    if( unlikely(p_entry == NULL) )
+        return NULL;
+
+    LOAD_STRING( psz_uri );
+    if( psz_uri == NULL )
+        goto error;
+    LOAD_IMMEDIATE( p_entry->i_size );
+    LOAD_IMMEDIATE( p_entry->i_mtime );
+    LOAD_IMMEDIATE( p_entry->i_used );
+    LOAD_IMMEDIATE( p_entry->i_duration );
+
+    LOAD_IMMEDIATE( i_es );
+    if( i_es == 0 || i_es > METACACHE_MAX_ES )
+        goto error;
+    p_entry->es = malloc( i_es * sizeof(*p_entry->es) );
+    if( unlikely(p_entry->es == NULL) )
+        goto error;
+    for( unsigned i = 0; i < i_es; i++ )
+    {
+        es_format_t *p_fmt = malloc( sizeof(*p_fmt) );
+        if( unlikely(p_fmt == NULL) )
+            goto error;
+        if( LoadFormat( p_fmt, file ) )
+        {
+            es_format_Clean( p_fmt );
+            free( p_fmt );
+            goto error;
+        }
+        p_entry->es[p_entry->i_es++] = p_fmt;
+    }
+
+    LOAD_IMMEDIATE( i_meta );
+    for( unsigned i = 0; i < i_meta; i++ )
+    {
+        uint8_t i_type;
+
+        LOAD_IMMEDIATE( i_type );
+        if( i_type >= VLC_META_TYPE_COUNT )
+            goto error;
+        LOAD_STRING( psz_value );
+        vlc_meta_Set( p_entry->p_meta, i_type, psz_value );
+        free( psz_value );
+        psz_value = NULL;
+    }
+
+    LOAD_IMMEDIATE( i_extra );
+    for( unsigned i = 0; i < i_extra; i++ )
+    {
+        LOAD_STRING( psz_name );
+        LOAD_STRING( psz_value );
+        if( psz_name != NULL && psz_value != NULL )
+            vlc_meta_AddExtra( p_entry->p_meta, psz_name, psz_value );
+        free( psz_name );
+        free( psz_value );
+        psz_name = psz_value = NULL;
+    }
+
+    *ppsz_uri = psz_uri;
+    return p_entry;
+error:
+    free( psz_name );
+    free( psz_value );
+    free( psz_uri );
+    EntryDelete( p_entry );
+    return NULL;
+}
+
+/* Reads the file, on the first use */
+static void Load( playlist_metacache_t *p_cache )
+{
+    char p_cachestring[sizeof(METACACHE_STRING) - 1];
+    uint32_t i_version, i_count;
+
+    if( p_cache->b_loaded )
+        return;
+    p_cache->b_loaded = true;
+
+    FILE *file = vlc_fopen( p_cache->psz_path, "rb" );
+    if( file == NULL )
+    {
+        if( errno != ENOENT )
+            msg_Warn( p_cache->obj, "cannot read %s: %s", p_cache->psz_path,
+                      vlc_strerror_c(errno) );
+        return;
+    }
+
+    if( fread( p_cachestring, 1, sizeof(p_cachestring), file )
+            != sizeof(p_cachestring)
+     || memcmp( p_cachestring, METACACHE_STRING, sizeof(p_cachestring) ) )
+        goto error;
+    LOAD_IMMEDIATE( i_version );
+    if( i_version != METACACHE_VERSION )
+        goto error;
+    LOAD_IMMEDIATE( i_count );
+    LOAD_IMMEDIATE( p_cache->i_clock );
+
+    vlc_dictionary_init( &p_cache->entries, __MIN(i_count, 1 << 20) );
+    for( uint32_t i = 0; i < i_count; i++ )
+    {
+        char *psz_uri;
+        metacache_entry_t *p_entry = LoadEntry( file, &psz_uri );
+        if( p_entry == NULL )
+        {
+            /* Keeps what could be read */
+            msg_Warn( p_cache->obj, "%s is truncated or corrupted",
+                      p_cache->psz_path );
+            break;
+        }
+        Remove( p_cache, psz_uri );
+        vlc_dictionary_insert( &p_cache->entries, psz_uri, p_entry );
+        p_cache->i_count++;
+        free( psz_uri );
+    }
+    p_cache->b_dirty = false;
+    msg_Dbg( p_cache->obj, "loaded %u preparsed items from %s",
+             p_cache->i_count, p_cache->psz_path );
+    fclose( file );
+    return;
+error:
+    msg_Warn( p_cache->obj, "ignoring %s (older version or corrupted)",
+              p_cache->psz_path );
+    fclose( file );
+}
+
+#define SAVE_IMMEDIATE( a ) \
+    if (fwrite (&(a), sizeof(a), 1, file) != 1) \
+        goto error
+
+static int SaveString( FILE *file, const char *str )
+{
+    uint16_t size = (str != NULL) ? strlen( str ) : 0;
+
+    SAVE_IMMEDIATE( size );
+    if( size != 0 && fwrite( str, 1, size, file ) != size )
+    {
+error:
+        return -1;
+    }
+    return 0;
+}
+
+#define SAVE_STRING( a ) \
+    if (SaveString (file, (a))) \
+        goto error
+
+static int SaveFormat( FILE *file, const es_format_t *p_fmt )
+{
+    SAVE_IMMEDIATE( p_fmt->i_cat );
+    SAVE_IMMEDIATE( p_fmt->i_codec );
+    SAVE_IMMEDIATE( p_fmt->i_original_fourcc );
+    SAVE_IMMEDIATE( p_fmt->i_id );
+    SAVE_IMMEDIATE( p_fmt->i_group );
+    SAVE_IMMEDIATE( p_fmt->i_priority );
+    SAVE_STRING( p_fmt->psz_language );
+    SAVE_STRING( p_fmt->psz_description );
+
+    SAVE_IMMEDIATE( p_fmt->audio.i_format );
+    SAVE_IMMEDIATE( p_fmt->audio.i_rate );
+    SAVE_IMMEDIATE( p_fmt->audio.i_physical_channels );
+    SAVE_IMMEDIATE( p_fmt->audio.i_original_channels );
+    SAVE_IMMEDIATE( p_fmt->audio.i_bitspersample );
+    SAVE_IMMEDIATE( p_fmt->audio.i_blockalign );
+    SAVE_IMMEDIATE( p_fmt->audio.i_channels );
+
+    SAVE_IMMEDIATE( p_fmt->video.i_chroma );
+    SAVE_IMMEDIATE( p_fmt->video.i_width );
+    SAVE_IMMEDIATE( p_fmt->video.i_height );
+    SAVE_IMMEDIATE( p_fmt->video.i_visible_width );
+    SAVE_IMMEDIATE( p_fmt->video.i_visible_height );
+    SAVE_IMMEDIATE( p_fmt->video.i_sar_num );
+    SAVE_IMMEDIATE( p_fmt->video.i_sar_den );
+    SAVE_IMMEDIATE( p_fmt->video.i_frame_rate );
+    SAVE_IMMEDIATE( p_fmt->video.i_frame_rate_base );
+    SAVE_IMMEDIATE( p_fmt->video.orientation );
+
+    SAVE_STRING( p_fmt->subs.psz_encoding );
+
+    SAVE_IMMEDIATE( p_fmt->i_bitrate );
+    SAVE_IMMEDIATE( p_fmt->i_profile );
+    SAVE_IMMEDIATE( p_fmt->i_level );
+    return 0;
+error:
+    return -1;
+}
+
+/* Strings that do not fit are not saved */
+static bool Fits( const char *psz )
+{
+    return psz != NULL && strlen( psz ) <= METACACHE_MAX_STRING;
+}
+
+static int SaveEntry( FILE *file, const char *psz_uri,
+                      const metacache_entry_t *p_entry )
+{
+    uint16_t i_es = p_entry->i_es;
+    uint8_t i_meta = 0;
+    uint16_t i_extra = 0;
+
+    SAVE_STRING( psz_uri );
+    SAVE_IMMEDIATE( p_entry->i_size );
+    SAVE_IMMEDIATE( p_entry->i_mtime );
+    SAVE_IMMEDIATE( p_entry->i_used );
+    SAVE_IMMEDIATE( p_entry->i_duration );
+
+    SAVE_IMMEDIATE( i_es );
+    for( int i = 0; i < p_entry->i_es; i++ )
+        if( SaveFormat( file, p_entry->es[i] ) )
+            goto error;
+
+    for( int i = 0; i < VLC_META_TYPE_COUNT; i++ )
+        if( Fits( vlc_meta_Get( p_entry->p_meta, i ) ) )
+            i_meta++;
+    SAVE_IMMEDIATE( i_meta );
+    for( int i = 0; i < VLC_META_TYPE_COUNT; i++ )
+    {
+        const char *psz_value = vlc_meta_Get( p_entry->p_meta, i );
+        uint8_t i_type = i;
+
+        if( !Fits( psz_value ) )
+            continue;
+        SAVE_IMMEDIATE( i_type );
+        SAVE_STRING( psz_value );
+    }
+
+    char **ppsz_names = vlc_meta_CopyExtraNames( p_entry->p_meta );
+    int i_ret = -1;
+    for( int i = 0; ppsz_names != NULL && ppsz_names[i] != NULL; i++ )
+        if( i_extra < UINT16_MAX && Fits( ppsz_names[i] )
+         && Fits( vlc_meta_GetExtra( p_entry->p_meta, ppsz_names[i] ) ) )
+            i_extra++;
+    if( fwrite( &i_extra, sizeof(i_extra), 1, file ) != 1 )
+        goto out;
+    for( int i = 0; i_extra > 0; i++ )
+    {
+        const char *psz_value =
+            vlc_meta_GetExtra( p_entry->p_meta, ppsz_names[i] );
+
+        if( !Fits( ppsz_names[i] ) || !Fits( psz_value ) )
+            continue;
+        if( SaveString( file, ppsz_names[i] )
+         || SaveString( file, psz_value ) )
+            goto out;
+        i_extra--;
+    }
+    i_ret = 0;
+out:
+    for( int i = 0; ppsz_names != NULL && ppsz_names[i] != NULL; i++ )
+        free( ppsz_names[i] );
+    free( ppsz_names );
+    return i_ret;
+error:
+    return -1;
+}
+
+static int SaveBank( FILE *file, playlist_metacache_t *p_cache )
+{
+    uint32_t i_version = METACACHE_VERSION;
+    uint32_t i_count = p_cache->i_count;
+    metacache_ref_t *p_refs = List( p_cache );
+
+    if( unlikely(p_refs == NULL && i_count > 0) )
+        return -1;
+
+    if( fputs( METACACHE_STRING, file ) == EOF )
+        goto error;
+    SAVE_IMMEDIATE( i_version );
+    SAVE_IMMEDIATE( i_count );
+    SAVE_IMMEDIATE( p_cache->i_clock );
+
+    for( uint32_t i = 0; i < i_count; i++ )
+        if( SaveEntry( file, p_refs[i].psz_uri, p_refs[i].p_entry ) )
+            goto error;
+
+    if( fflush( file ) ) /* flush to check for errors */
+        goto error;
+    free( p_refs );
+    return 0;
+error:
+    free( p_refs );
+    return -1;
+}
+
+static void Save( playlist_metacache_t *p_cache )
+{
+    char *psz_tmpname;
+
+    Evict( p_cache );
+
+    if( asprintf( &psz_tmpname, "%s.%"PRIu32, p_cache->psz_path,
+                  (uint32_t)getpid() ) == -1 )
+        return;
+
+    /* The cache directory may not exist yet */
+    char *psz_dir = strdup( p_cache->psz_path );
+    if( psz_dir != NULL )
+    {
+        char *psz_sep = strrchr( psz_dir, DIR_SEP_CHAR );
+        if( psz_sep != NULL && psz_sep != psz_dir )
+        {
+            *psz_sep = '\0';
+            vlc_mkdir( psz_dir, 0700 );
+        }
+        free( psz_dir );
+    }
+
+    FILE *file = vlc_fopen( psz_tmpname, "wb" );
+    if( file == NULL )
+    {
+        msg_Warn( p_cache->obj, "cannot create %s: %s", psz_tmpname,
+                  vlc_strerror_c(errno) );
+        goto out;
+    }
+
+    if( SaveBank( file, p_cache ) )
+    {
+        msg_Warn( p_cache->obj, "cannot write %s: %s", psz_tmpname,
+                  vlc_strerror_c(errno) );
+        clearerr( file );
+        fclose( file );
+        vlc_unlink( psz_tmpname );
+        goto out;
+    }
+
+#if !defined( _WIN32 ) && !defined( __OS2__ )
+    vlc_rename( psz_tmpname, p_cache->psz_path ); /* atomically replace */
+    fclose( file );
+#else
+    vlc_unlink( p_cache->psz_path );
+    fclose( file );
+    vlc_rename( psz_tmpname, p_cache->psz_path );
+#endif
+    p_cache->b_dirty = false;
+    msg_Dbg( p_cache->obj, "saved %u preparsed items to %s",
+             p_cache->i_count, p_cache->psz_path );
+out:
+    free( psz_tmpname );
+}
+
+static void SaveTimer( void *data )
+{
+    playlist_metacache_t *p_cache = data;
+
+    vlc_mutex_lock( &p_cache->lock );
+    p_cache->b_save_pending = false;
+    if( p_cache->b_dirty )
+        Save( p_cache );
+    vlc_mutex_unlock( &p_cache->lock );
+}
+
+/*****************************************************************************
+ * Public functions
+ *****************************************************************************/
+playlist_metacache_t *playlist_metacache_New( vlc_object_t *obj,
+                                              const char *psz_path,
+                                              unsigned i_max )
+{
+    playlist_metacache_t *p_cache = malloc( sizeof(*p_cache) );
+    if( unlikely(p_cache == NULL) )
+        return NULL;
+
+    p_cache->psz_path = strdup( psz_path );
+    if( unlikely(p_cache->psz_path == NULL) )
+    {
+        free( p_cache );
+        return NULL;
+    }
+    p_cache->obj = obj;
+    p_cache->i_max = i_max;
+    vlc_mutex_init( &p_cache->lock );
+    vlc_dictionary_init( &p_cache->entries, 0 );
+    p_cache->i_count = 0;
+    p_cache->i_clock = 0;
+    p_cache->b_loaded = false;
+    p_cache->b_dirty = false;
+    p_cache->b_save_pending = false;
+    p_cache->b_timer = !vlc_timer_create( &p_cache->save_timer, SaveTimer,
+                                          p_cache );
+    return p_cache;
+}
+
+void playlist_metacache_Delete( playlist_metacache_t *p_cache )
+{
+    if( p_cache->b_timer )
+        vlc_timer_destroy( p_cache->save_timer );
+    if( p_cache->b_dirty )
+        Save( p_cache );
+
+    vlc_dictionary_clear( &p_cache->entries, EntryFree, NULL );
+    vlc_mutex_destroy( &p_cache->lock );
+    free( p_cache->psz_path );
+    free( p_cache );
+}
+
+int playlist_metacache_Get( playlist_metacache_t *p_cache,
+                            input_item_t *p_item )
+{
+    uint64_t i_size;
+    int64_t i_mtime;
+    char *psz_uri = input_item_GetURI( p_item );
+
+    if( psz_uri == NULL || FileIdentity( psz_uri, &i_size, &i_mtime ) )
+    {
+        free( psz_uri );
+        return VLC_EGENERIC;
+    }
+
+    metacache_entry_t *p_copy = NULL;
+
+    vlc_mutex_lock( &p_cache->lock );
+    Load( p_cache );
+    metacache_entry_t *p_entry =
+        vlc_dictionary_value_for_key( &p_cache->entries, psz_uri );
+    if( p_entry != kVLCDictionaryNotFound )
+    {
+        if( p_entry->i_size == i_size && p_entry->i_mtime == i_mtime )
+        {
+            p_entry->i_used = ++p_cache->i_clock;
+            Changed( p_cache );
+            p_copy = EntryNew( p_entry->i_duration, p_entry->i_es,
+                               p_entry->es, p_entry->p_meta );
+        }
+        else /* the file changed */
+            Remove( p_cache, psz_uri );
+    }
+    vlc_mutex_unlock( &p_cache->lock );
+    free( psz_uri );
+
+    if( p_copy == NULL )
+        return VLC_EGENERIC;
+
+    input_item_SetDuration( p_item, p_copy->i_duration );
+    for( int i = 0; i < p_copy->i_es; i++ )
+        input_item_UpdateTracksInfo( p_item, p_copy->es[i] );
+    for( int i = 0; i < VLC_META_TYPE_COUNT; i++ )
+    {
+        const char *psz_value = vlc_meta_Get( p_copy->p_meta, i );
+        if( psz_value != NULL )
+            input_item_SetMeta( p_item, i, psz_value );
+    }
+    if( vlc_meta_GetExtraCount( p_copy->p_meta ) > 0 )
+    {
+        vlc_mutex_lock( &p_item->lock );
+        if( p_item->p_meta == NULL )
+            p_item->p_meta = vlc_meta_New();
+        vlc_meta_Merge( p_item->p_meta, p_copy->p_meta );
+        vlc_mutex_unlock( &p_item->lock );
+    }
+    EntryDelete( p_copy );
+    return VLC_SUCCESS;
+}
+
+void playlist_metacache_Save( playlist_metacache_t *p_cache )
+{
+    vlc_mutex_lock( &p_cache->lock );
+    if( p_cache->b_dirty )
+        Save( p_cache );
+    vlc_mutex_unlock( &p_cache->lock );
+}
+
+void playlist_metacache_Put( playlist_metacache_t *p_cache,
+                             input_item_t *p_item )
+{
+    uint64_t i_size;
+    int64_t i_mtime;
+    char *psz_uri = input_item_GetURI( p_item );
+
+    if( psz_uri == NULL || FileIdentity( psz_uri, &i_size, &i_mtime ) )
+    {
+        free( psz_uri );
+        return;
+    }
+
+    /* Items without streams may be playlists or broken files: let them be
+     * preparsed again */
+    metacache_entry_t *p_entry = NULL;
+    vlc_mutex_lock( &p_item->lock );
+    if( p_item->i_es > 0 && p_item->i_es <= METACACHE_MAX_ES )
+        p_entry = EntryNew( p_item->i_duration, p_item->i_es, p_item->es,
+                            p_item->p_meta );
+    vlc_mutex_unlock( &p_item->lock );
+    if( p_entry == NULL )
+    {
+        free( psz_uri );
+        return;
+    }
+    p_entry->i_size = i_size;
+    p_entry->i_mtime = i_mtime;
+
+    /* Attachments are only available while the file is open */
+    const char *psz_arturl = vlc_meta_Get( p_entry->p_meta,
+                                           vlc_meta_ArtworkURL );
+    if( psz_arturl != NULL && !strncmp( psz_arturl, "attachment://", 13 ) )
+        vlc_meta_Set( p_entry->p_meta, vlc_meta_ArtworkURL, NULL );
+
+    vlc_mutex_lock( &p_cache->lock );
+    Load( p_cache );
+    Remove( p_cache, psz_uri );
+    p_entry->i_used = ++p_cache->i_clock;
+    vlc_dictionary_insert( &p_cache->entries, psz_uri, p_entry );
+    p_cache->i_count++;
+    Changed( p_cache );
+    /* Evict by batches, not at every new entry */
+    if( p_cache->i_count > p_cache->i_max + p_cache->i_max / 8 )
+        Evict( p_cache );
+    vlc_mutex_unlock( &p_cache->lock );
+    free( psz_uri );
+}
@@ -0,0 +1,78 @@
+/*****************************************************************************
+ * metacache.h: preparsing results cache
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef _PLAYLIST_METACACHE_H
+#define _PLAYLIST_METACACHE_H 1
+
+#include <vlc_input_item.h>
+
+/**
+ * Meta cache opaque structure.
+ *
+ * The meta cache keeps the duration, the elementary stream formats and the
+ * meta data of the preparsed local files, by URI, in a file. An entry is
+ * only valid as long as the size and the modification time of the file do
+ * not change. The least recently used entries are evicted when the cache is
+ * full. Changes are written back to the file some time after they are made,
+ * and when the cache is destroyed.
+ *
+ * There is one cache per libvlc instance, shared by its preparsers.
+ *
+ * All functions are thread-safe.
+ */
+typedef struct playlist_metacache_t playlist_metacache_t;
+
+/**
+ * This function creates the cache of a file. The file is only read when the
+ * cache is first used.
+ *
+ * \param psz_path the file, created if needed
+ * \param i_max the maximum number of entries
+ */
+playlist_metacache_t *playlist_metacache_New( vlc_object_t *,
+                                              const char *psz_path,
+                                              unsigned i_max );
+
+/**
+ * This function saves the cache if it changed, and destroys it.
+ */
+void playlist_metacache_Delete( playlist_metacache_t * );
+
+/**
+ * This function saves the cache now if it changed.
+ */
+void playlist_metacache_Save( playlist_metacache_t * );
+
+/**
+ * This function fills an item with the cached results of its preparsing,
+ * if it has any.
+ *
+ * \return VLC_SUCCESS if the item was filled, or VLC_EGENERIC
+ */
+int playlist_metacache_Get( playlist_metacache_t *, input_item_t * );
+
+/**
+ * This function stores the results of the preparsing of an item.
+ *
+ * Only local files with at least one elementary stream are stored.
+ */
+void playlist_metacache_Put( playlist_metacache_t *, input_item_t * );
+
+#endif
@@ -38,6 +38,7 @@
 #include <assert.h>
 
 #include "art.h"
+#include "index.h"
 #include "preparser.h"
 
 typedef struct vlc_sd_internal_t vlc_sd_internal_t;
@@ -52,6 +53,7 @@ typedef struct playlist_private_t
 
     playlist_item_array_t items_to_delete; /**< Array of items and nodes to
             delete... At the very end. This sucks. */
+    playlist_index_t     *p_index; /**< Items by input and search index */
 
     vlc_sd_internal_t   **pp_sds;
     int                   i_sds;   /**< Number of service discovery modules */
@@ -21,52 +21,274 @@
  * along with this program; if not, write to the Free Software Foundation,
  * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
+
 #ifdef HAVE_CONFIG_H
 # include "config.h"
 #endif
 
+#include <assert.h>
+
 #include <vlc_common.h>
+#include <vlc_threadpool.h>
 
+#include "libvlc.h"
 #include "fetcher.h"
+#include "metacache.h"
 #include "preparser.h"
 #include "input/input_interface.h"
+#include "input/item.h"
 
 /*****************************************************************************
  * Structures/definitions
  *****************************************************************************/
+enum
+{
+    QUEUE_NORMAL,
+    QUEUE_PRIORITY,
+    QUEUE_COUNT
+};
+
+typedef struct preparser_entry_t preparser_entry_t;
+
+struct preparser_entry_t
+{
+    input_item_t      *p_item;
+    int                i_queue;
+    preparser_entry_t *p_prev;
+    preparser_entry_t *p_next;
+    preparser_entry_t *p_hash_next;
+};
+
+typedef struct
+{
+    playlist_preparser_t *owner;
+    bool            b_live;
+    input_item_t   *p_item;  /**< item being processed, or NULL */
+    input_thread_t *p_input; /**< input preparsing the item, or NULL */
+    mtime_t         i_deadline;
+    bool            b_cancel;
+    bool            b_timeout;
+    bool            b_timer;
+    vlc_timer_t     timer;
+} preparser_worker_t;
+
 struct playlist_preparser_t
 {
     vlc_object_t        *object;
+    vlc_threadpool_t    *p_pool;
     playlist_fetcher_t  *p_fetcher;
+    playlist_metacache_t *p_cache; /**< shared by the preparsers */
 
     vlc_mutex_t     lock;
     vlc_cond_t      wait;
-    bool            b_live;
-    input_item_t  **pp_waiting;
-    int             i_waiting;
+    struct
+    {
+        preparser_entry_t *p_head;
+        preparser_entry_t *p_tail;
+    } queues[QUEUE_COUNT];
+    unsigned        i_waiting;
+    preparser_entry_t **pp_hash; /* waiting entries by item */
+    size_t          i_hash_mask;
+
+    preparser_worker_t *p_workers;
+    unsigned        i_workers;
+    unsigned        i_live;    /**< workers queued in the pool or started */
+    unsigned        i_started; /**< workers taking requests */
+    unsigned        i_running;
+    mtime_t         i_timeout;
+    bool            b_closing;
+    bool            b_orphan;  /**< freed by the last worker */
+
+    /* Statistics */
+    uint64_t        i_done;
+    uint64_t        i_timeouts;
+    uint64_t        i_cancelled;
+    mtime_t         i_rate_date;
+    uint64_t        i_rate_done;
+    float           f_rate;
 };
 
-static void *Thread( void * );
+#define PREPARSER_MIN_HASH 64
+
+static void Thread( void * );
+static void Timeout( void * );
+
+/*****************************************************************************
+ * Waiting entries
+ *****************************************************************************/
+static size_t HashItem( const input_item_t *p_item )
+{
+    return ((uint64_t)(uintptr_t)p_item * UINT64_C(0x9E3779B97F4A7C15)) >> 32;
+}
+
+static preparser_entry_t *EntryFind( playlist_preparser_t *p_preparser,
+                                     const input_item_t *p_item )
+{
+    if( p_preparser->pp_hash == NULL )
+        return NULL;
+
+    preparser_entry_t *p_entry =
+        p_preparser->pp_hash[HashItem( p_item ) & p_preparser->i_hash_mask];
+    while( p_entry != NULL && p_entry->p_item != p_item )
+        p_entry = p_entry->p_hash_next;
+    return p_entry;
+}
+
+static void HashInsert( playlist_preparser_t *p_preparser,
+                        preparser_entry_t *p_entry )
+{
+    preparser_entry_t **pp_bucket =
+        &p_preparser->pp_hash[HashItem( p_entry->p_item )
+                              & p_preparser->i_hash_mask];
+    p_entry->p_hash_next = *pp_bucket;
+    *pp_bucket = p_entry;
+}
+
+/* Keeps the hash chains short. If that fails, they just get longer. */
+static bool HashGrow( playlist_preparser_t *p_preparser )
+{
+    size_t i_old = p_preparser->pp_hash ? p_preparser->i_hash_mask + 1 : 0;
+    if( p_preparser->i_waiting < i_old )
+        return true;
+
+    size_t i_size = __MAX( PREPARSER_MIN_HASH, 2 * i_old );
+    preparser_entry_t **pp_hash = calloc( i_size, sizeof( *pp_hash ) );
+    if( unlikely(pp_hash == NULL) )
+        return p_preparser->pp_hash != NULL;
+
+    free( p_preparser->pp_hash );
+    p_preparser->pp_hash = pp_hash;
+    p_preparser->i_hash_mask = i_size - 1;
+    for( int i = 0; i < QUEUE_COUNT; i++ )
+        for( preparser_entry_t *p_entry = p_preparser->queues[i].p_head;
+             p_entry != NULL; p_entry = p_entry->p_next )
+            HashInsert( p_preparser, p_entry );
+    return true;
+}
+
+static void QueueInsert( playlist_preparser_t *p_preparser,
+                         preparser_entry_t *p_entry, int i_queue )
+{
+    p_entry->i_queue = i_queue;
+    if( i_queue == QUEUE_PRIORITY )
+    {
+        /* Latest first: the items that were visible or about to play a
+         * while ago matter less than the current ones. */
+        p_entry->p_prev = NULL;
+        p_entry->p_next = p_preparser->queues[i_queue].p_head;
+        if( p_entry->p_next != NULL )
+            p_entry->p_next->p_prev = p_entry;
+        else
+            p_preparser->queues[i_queue].p_tail = p_entry;
+        p_preparser->queues[i_queue].p_head = p_entry;
+    }
+    else
+    {
+        p_entry->p_next = NULL;
+        p_entry->p_prev = p_preparser->queues[i_queue].p_tail;
+        if( p_entry->p_prev != NULL )
+            p_entry->p_prev->p_next = p_entry;
+        else
+            p_preparser->queues[i_queue].p_head = p_entry;
+        p_preparser->queues[i_queue].p_tail = p_entry;
+    }
+}
+
+static void QueueRemove( playlist_preparser_t *p_preparser,
+                         preparser_entry_t *p_entry )
+{
+    int i_queue = p_entry->i_queue;
+
+    if( p_entry->p_prev != NULL )
+        p_entry->p_prev->p_next = p_entry->p_next;
+    else
+        p_preparser->queues[i_queue].p_head = p_entry->p_next;
+    if( p_entry->p_next != NULL )
+        p_entry->p_next->p_prev = p_entry->p_prev;
+    else
+        p_preparser->queues[i_queue].p_tail = p_entry->p_prev;
+}
+
+static void EntryRemove( playlist_preparser_t *p_preparser,
+                         preparser_entry_t *p_entry )
+{
+    preparser_entry_t **pp_link =
+        &p_preparser->pp_hash[HashItem( p_entry->p_item )
+                              & p_preparser->i_hash_mask];
+    while( *pp_link != p_entry )
+        pp_link = &(*pp_link)->p_hash_next;
+    *pp_link = p_entry->p_hash_next;
+
+    QueueRemove( p_preparser, p_entry );
+    p_preparser->i_waiting--;
+}
 
 /*****************************************************************************
  * Public functions
  *****************************************************************************/
 playlist_preparser_t *playlist_preparser_New( vlc_object_t *parent )
 {
+    /* The workers of all the preparsers of the instance come from the
+     * same pool, which is sized by "preparse-threads" */
+    vlc_threadpool_t *p_pool = libvlc_priv( parent->p_libvlc )->preparse_pool;
+    if( p_pool == NULL )
+        return NULL;
+
     playlist_preparser_t *p_preparser = malloc( sizeof(*p_preparser) );
     if( !p_preparser )
         return NULL;
 
+    unsigned i_workers = vlc_threadpool_size( p_pool );
+
+    p_preparser->p_workers = calloc( i_workers,
+                                     sizeof(*p_preparser->p_workers) );
+    if( unlikely(p_preparser->p_workers == NULL) )
+    {
+        free( p_preparser );
+        return NULL;
+    }
+    p_preparser->i_workers = i_workers;
+    for( unsigned i = 0; i < i_workers; i++ )
+    {
+        preparser_worker_t *p_worker = &p_preparser->p_workers[i];
+
+        p_worker->owner = p_preparser;
+        p_worker->b_timer = !vlc_timer_create( &p_worker->timer, Timeout,
+                                               p_worker );
+    }
+
     p_preparser->object = parent;
+    p_preparser->p_pool = p_pool;
     p_preparser->p_fetcher = playlist_fetcher_New( parent );
     if( unlikely(p_preparser->p_fetcher == NULL) )
         msg_Err( parent, "cannot create fetcher" );
 
+    p_preparser->p_cache = libvlc_priv( parent->p_libvlc )->preparse_cache;
+
     vlc_mutex_init( &p_preparser->lock );
     vlc_cond_init( &p_preparser->wait );
-    p_preparser->b_live = false;
+    for( int i = 0; i < QUEUE_COUNT; i++ )
+    {
+        p_preparser->queues[i].p_head = NULL;
+        p_preparser->queues[i].p_tail = NULL;
+    }
     p_preparser->i_waiting = 0;
-    p_preparser->pp_waiting = NULL;
+    p_preparser->pp_hash = NULL;
+    p_preparser->i_hash_mask = 0;
+    p_preparser->i_live = 0;
+    p_preparser->i_started = 0;
+    p_preparser->i_running = 0;
+    p_preparser->b_closing = false;
+    p_preparser->b_orphan = false;
+    p_preparser->i_timeout = var_InheritInteger( parent, "preparse-timeout" )
+                             * (CLOCK_FREQ / 1000);
+
+    p_preparser->i_done = 0;
+    p_preparser->i_timeouts = 0;
+    p_preparser->i_cancelled = 0;
+    p_preparser->i_rate_date = mdate();
+    p_preparser->i_rate_done = 0;
+    p_preparser->f_rate = 0.f;
 
     return p_preparser;
 }
@@ -74,23 +296,87 @@ playlist_preparser_t *playlist_preparser_New( vlc_object_t *parent )
 void playlist_preparser_Push( playlist_preparser_t *p_preparser, input_item_t *p_item,
                               input_item_meta_request_option_t i_options )
 {
-    vlc_gc_incref( p_item );
-    VLC_UNUSED( i_options );
+    int i_queue = (i_options & META_REQUEST_OPTION_PRIORITY) ? QUEUE_PRIORITY
+                                                             : QUEUE_NORMAL;
 
     vlc_mutex_lock( &p_preparser->lock );
-    INSERT_ELEM( p_preparser->pp_waiting, p_preparser->i_waiting,
-                 p_preparser->i_waiting, p_item );
-    if( !p_preparser->b_live )
+    preparser_entry_t *p_entry = EntryFind( p_preparser, p_item );
+    if( p_entry != NULL )
+    {
+        /* Already waiting */
+        if( i_queue == QUEUE_PRIORITY )
+        {
+            QueueRemove( p_preparser, p_entry );
+            QueueInsert( p_preparser, p_entry, QUEUE_PRIORITY );
+        }
+        vlc_mutex_unlock( &p_preparser->lock );
+        return;
+    }
+
+    p_entry = malloc( sizeof(*p_entry) );
+    if( unlikely(p_entry == NULL) || !HashGrow( p_preparser ) )
     {
-        if( vlc_clone_detach( NULL, Thread, p_preparser,
-                              VLC_THREAD_PRIORITY_LOW ) )
-            msg_Warn( p_preparser->object, "cannot spawn pre-parser thread" );
+        vlc_mutex_unlock( &p_preparser->lock );
+        free( p_entry );
+        return;
+    }
+
+    vlc_gc_incref( p_item );
+    p_entry->p_item = p_item;
+    QueueInsert( p_preparser, p_entry, i_queue );
+    HashInsert( p_preparser, p_entry );
+    p_preparser->i_waiting++;
+
+    /* Start another worker if the others are all busy */
+    if( p_preparser->i_live < p_preparser->i_workers
+     && p_preparser->i_live - p_preparser->i_running < p_preparser->i_waiting )
+    {
+        preparser_worker_t *p_worker = p_preparser->p_workers;
+        while( p_worker->b_live )
+            p_worker++;
+
+        if( vlc_threadpool_submit( p_preparser->p_pool, VLC_TASK_PRIORITY_LOW,
+                                   Thread, p_worker ) )
+            msg_Warn( p_preparser->object, "cannot queue pre-parser worker" );
         else
-            p_preparser->b_live = true;
+        {
+            p_worker->b_live = true;
+            p_preparser->i_live++;
+        }
     }
     vlc_mutex_unlock( &p_preparser->lock );
 }
 
+void playlist_preparser_Cancel( playlist_preparser_t *p_preparser,
+                                input_item_t *p_item )
+{
+    vlc_mutex_lock( &p_preparser->lock );
+    preparser_entry_t *p_entry = EntryFind( p_preparser, p_item );
+    if( p_entry != NULL )
+    {
+        EntryRemove( p_preparser, p_entry );
+        p_preparser->i_cancelled++;
+    }
+
+    for( unsigned i = 0; i < p_preparser->i_workers; i++ )
+    {
+        preparser_worker_t *p_worker = &p_preparser->p_workers[i];
+
+        if( !p_worker->b_live || p_worker->p_item != p_item )
+            continue;
+        p_worker->b_cancel = true;
+        if( p_worker->p_input != NULL )
+            ObjectKillChildrens( VLC_OBJECT(p_worker->p_input) );
+    }
+    vlc_mutex_unlock( &p_preparser->lock );
+
+    if( p_entry != NULL )
+    {
+        vlc_gc_decref( p_item );
+        free( p_entry );
+    }
+}
+
 void playlist_preparser_fetcher_Push( playlist_preparser_t *p_preparser,
              input_item_t *p_item, input_item_meta_request_option_t i_options )
 {
@@ -98,37 +384,123 @@ void playlist_preparser_fetcher_Push( playlist_preparser_t *p_preparser,
         playlist_fetcher_Push( p_preparser->p_fetcher, p_item, i_options );
 }
 
+/* Completed requests per second, over the last second or more */
+static void UpdateRate( playlist_preparser_t *p_preparser, mtime_t i_now )
+{
+    if( i_now - p_preparser->i_rate_date < CLOCK_FREQ )
+        return;
+
+    p_preparser->f_rate = (float)(p_preparser->i_done - p_preparser->i_rate_done)
+                        * CLOCK_FREQ / (i_now - p_preparser->i_rate_date);
+    p_preparser->i_rate_date = i_now;
+    p_preparser->i_rate_done = p_preparser->i_done;
+}
+
+void playlist_preparser_GetStats( playlist_preparser_t *p_preparser,
+                                  input_preparser_stats_t *p_stats )
+{
+    vlc_mutex_lock( &p_preparser->lock );
+    UpdateRate( p_preparser, mdate() );
+    p_stats->i_pending = p_preparser->i_waiting;
+    p_stats->i_running = p_preparser->i_running;
+    p_stats->i_done = p_preparser->i_done;
+    p_stats->i_timeouts = p_preparser->i_timeouts;
+    p_stats->i_cancelled = p_preparser->i_cancelled;
+    p_stats->f_rate = p_preparser->f_rate;
+    vlc_mutex_unlock( &p_preparser->lock );
+}
+
+static void Destroy( playlist_preparser_t *p_preparser )
+{
+    for( unsigned i = 0; i < p_preparser->i_workers; i++ )
+        if( p_preparser->p_workers[i].b_timer )
+            vlc_timer_destroy( p_preparser->p_workers[i].timer );
+    free( p_preparser->p_workers );
+    free( p_preparser->pp_hash );
+    vlc_cond_destroy( &p_preparser->wait );
+    vlc_mutex_destroy( &p_preparser->lock );
+    free( p_preparser );
+}
+
 void playlist_preparser_Delete( playlist_preparser_t *p_preparser )
 {
     vlc_mutex_lock( &p_preparser->lock );
+    p_preparser->b_closing = true;
     /* Remove pending item to speed up preparser thread exit */
-    while( p_preparser->i_waiting > 0 )
+    for( int i = 0; i < QUEUE_COUNT; i++ )
     {
-        vlc_gc_decref( p_preparser->pp_waiting[0] );
-        REMOVE_ELEM( p_preparser->pp_waiting, p_preparser->i_waiting, 0 );
+        preparser_entry_t *p_entry = p_preparser->queues[i].p_head;
+        while( p_entry != NULL )
+        {
+            preparser_entry_t *p_next = p_entry->p_next;
+
+            vlc_gc_decref( p_entry->p_item );
+            free( p_entry );
+            p_entry = p_next;
+        }
+        p_preparser->queues[i].p_head = NULL;
+        p_preparser->queues[i].p_tail = NULL;
     }
+    p_preparser->i_waiting = 0;
 
-    while( p_preparser->b_live )
+    /* Interrupt the running ones */
+    for( unsigned i = 0; i < p_preparser->i_workers; i++ )
+    {
+        preparser_worker_t *p_worker = &p_preparser->p_workers[i];
+
+        p_worker->b_cancel = true;
+        if( p_worker->p_input != NULL )
+            ObjectKillChildrens( VLC_OBJECT(p_worker->p_input) );
+    }
+
+    while( p_preparser->i_started > 0 )
         vlc_cond_wait( &p_preparser->wait, &p_preparser->lock );
-    vlc_mutex_unlock( &p_preparser->lock );
 
-    /* Destroy the item preparser */
-    vlc_cond_destroy( &p_preparser->wait );
-    vlc_mutex_destroy( &p_preparser->lock );
+    /* Workers still queued in the shared pool, behind the requests of
+     * another preparser, will not take any request: the last one frees the
+     * preparser, instead of waiting for them here. */
+    bool b_orphan = p_preparser->i_live > 0;
+    p_preparser->b_orphan = b_orphan;
+    vlc_mutex_unlock( &p_preparser->lock );
 
     if( p_preparser->p_fetcher != NULL )
         playlist_fetcher_Delete( p_preparser->p_fetcher );
-    free( p_preparser );
+
+    if( !b_orphan )
+        Destroy( p_preparser );
 }
 
 /*****************************************************************************
  * Privates functions
  *****************************************************************************/
+/**
+ * This function interrupts a preparsing that takes too long.
+ */
+static void Timeout( void *data )
+{
+    preparser_worker_t *p_worker = data;
+    playlist_preparser_t *p_preparser = p_worker->owner;
+
+    vlc_mutex_lock( &p_preparser->lock );
+    /* The timer may fire late, when the worker is on the next item */
+    if( p_worker->p_input != NULL && mdate() >= p_worker->i_deadline )
+    {
+        p_worker->b_timeout = true;
+        ObjectKillChildrens( VLC_OBJECT(p_worker->p_input) );
+    }
+    vlc_mutex_unlock( &p_preparser->lock );
+}
+
 /**
  * This function preparses an item when needed.
+ *
+ * \return false if the preparsing was cancelled
  */
-static void Preparse( vlc_object_t *obj, input_item_t *p_item )
+static bool Preparse( preparser_worker_t *p_worker, input_item_t *p_item )
 {
+    playlist_preparser_t *p_preparser = p_worker->owner;
+    vlc_object_t *obj = p_preparser->object;
+
     vlc_mutex_lock( &p_item->lock );
     int i_type = p_item->i_type;
     vlc_mutex_unlock( &p_item->lock );
@@ -136,17 +508,68 @@ static void Preparse( vlc_object_t *obj, input_item_t *p_item )
     if( i_type != ITEM_TYPE_FILE )
     {
         input_item_SetPreparsed( p_item, true );
-        return;
+        return true;
     }
 
     /* Do not preparse if it is already done (like by playing it) */
-    if( !input_item_IsPreparsed( p_item ) )
+    if( input_item_IsPreparsed( p_item ) )
+        return true;
+
+    /* Nor if it was done in a previous session */
+    if( p_preparser->p_cache != NULL
+     && playlist_metacache_Get( p_preparser->p_cache, p_item ) == VLC_SUCCESS )
     {
-        input_Preparse( obj, p_item );
         input_item_SetPreparsed( p_item, true );
-
         var_SetAddress( obj, "item-change", p_item );
+        return true;
     }
+
+    input_thread_t *p_input = input_CreatePreparser( obj, p_item );
+    if( p_input != NULL )
+    {
+        bool b_timer = p_worker->b_timer && p_preparser->i_timeout > 0;
+        bool b_cancel, b_timeout;
+        int i_ret = VLC_EGENERIC;
+
+        vlc_mutex_lock( &p_preparser->lock );
+        p_worker->p_input = p_input;
+        p_worker->i_deadline = mdate() + p_preparser->i_timeout;
+        b_cancel = p_worker->b_cancel;
+        vlc_mutex_unlock( &p_preparser->lock );
+
+        /* Kill again every now and then, in case the input was not done
+         * creating its children */
+        if( b_timer )
+            vlc_timer_schedule( p_worker->timer, false,
+                                p_preparser->i_timeout, CLOCK_FREQ / 4 );
+        if( !b_cancel )
+            i_ret = input_RunPreparser( p_input );
+        if( b_timer )
+            vlc_timer_schedule( p_worker->timer, false, 0, 0 );
+
+        vlc_mutex_lock( &p_preparser->lock );
+        p_worker->p_input = NULL;
+        b_cancel = p_worker->b_cancel;
+        b_timeout = p_worker->b_timeout;
+        vlc_mutex_unlock( &p_preparser->lock );
+        vlc_object_release( p_input );
+
+        if( b_cancel )
+            return false;
+        if( b_timeout )
+        {
+            char *psz_uri = input_item_GetURI( p_item );
+            msg_Warn( obj, "preparsing %s timed out",
+                      psz_uri ? psz_uri : "(null)" );
+            free( psz_uri );
+        }
+        else if( i_ret == VLC_SUCCESS && p_preparser->p_cache != NULL )
+            playlist_metacache_Put( p_preparser->p_cache, p_item );
+    }
+    input_item_SetPreparsed( p_item, true );
+
+    var_SetAddress( obj, "item-change", p_item );
+    return true;
 }
 
 /**
@@ -193,38 +616,74 @@ static void Art( playlist_preparser_t *p_preparser, input_item_t *p_item )
 /**
  * This function does the preparsing and issues the art fetching requests
  */
-static void *Thread( void *data )
+static void Thread( void *data )
 {
-    playlist_preparser_t *p_preparser = data;
-    vlc_object_t *obj = p_preparser->object;
+    preparser_worker_t *p_worker = data;
+    playlist_preparser_t *p_preparser = p_worker->owner;
+
+    vlc_mutex_lock( &p_preparser->lock );
+    if( !p_preparser->b_closing )
+        p_preparser->i_started++;
+    else
+        goto out;
 
     for( ;; )
     {
-        input_item_t *p_current;
+        preparser_entry_t *p_entry = p_preparser->queues[QUEUE_PRIORITY].p_head;
+        if( p_entry == NULL )
+            p_entry = p_preparser->queues[QUEUE_NORMAL].p_head;
+        if( p_entry == NULL )
+            break;
 
-        /* */
-        vlc_mutex_lock( &p_preparser->lock );
-        if( p_preparser->i_waiting > 0 )
+        input_item_t *p_current = p_entry->p_item;
+        EntryRemove( p_preparser, p_entry );
+        free( p_entry );
+
+        /* Nobody but us holds the item anymore: drop the request */
+        if( atomic_load( &item_owner(p_current)->refs ) == 1 )
         {
-            p_current = p_preparser->pp_waiting[0];
-            REMOVE_ELEM( p_preparser->pp_waiting, p_preparser->i_waiting, 0 );
+            p_preparser->i_cancelled++;
+            vlc_mutex_unlock( &p_preparser->lock );
+            vlc_gc_decref( p_current );
+            vlc_mutex_lock( &p_preparser->lock );
+            continue;
         }
+
+        p_worker->p_item = p_current;
+        p_worker->b_cancel = false;
+        p_worker->b_timeout = false;
+        p_preparser->i_running++;
+        vlc_mutex_unlock( &p_preparser->lock );
+
+        if( Preparse( p_worker, p_current ) )
+            Art( p_preparser, p_current );
+
+        vlc_mutex_lock( &p_preparser->lock );
+        p_worker->p_item = NULL;
+        p_preparser->i_running--;
+        if( p_worker->b_cancel )
+            p_preparser->i_cancelled++;
         else
         {
-            p_current = NULL;
-            p_preparser->b_live = false;
-            vlc_cond_signal( &p_preparser->wait );
+            p_preparser->i_done++;
+            if( p_worker->b_timeout )
+                p_preparser->i_timeouts++;
+            UpdateRate( p_preparser, mdate() );
         }
         vlc_mutex_unlock( &p_preparser->lock );
 
-        if( !p_current )
-            break;
+        vlc_gc_decref( p_current );
+        vlc_mutex_lock( &p_preparser->lock );
+    }
+    p_preparser->i_started--;
+    vlc_cond_signal( &p_preparser->wait );
+out:
+    p_worker->b_live = false;
+    p_preparser->i_live--;
 
-        Preparse( obj, p_current );
+    bool b_destroy = p_preparser->b_orphan && p_preparser->i_live == 0;
+    vlc_mutex_unlock( &p_preparser->lock );
 
-        Art( p_preparser, p_current );
-        vlc_gc_decref(p_current);
-    }
-    return NULL;
+    if( b_destroy )
+        Destroy( p_preparser );
 }
-
@@ -36,7 +36,11 @@
 typedef struct playlist_preparser_t playlist_preparser_t;
 
 /**
- * This function creates the preparser object and thread.
+ * This function creates the preparser object.
+ *
+ * Items are preparsed by the workers of the preparser pool of the libvlc
+ * instance, shared by all the preparsers, and each item is given up after
+ * "preparse-timeout" if it is not zero.
  */
 playlist_preparser_t *playlist_preparser_New( vlc_object_t * );
 
@@ -44,18 +48,32 @@ playlist_preparser_t *playlist_preparser_New( vlc_object_t * );
  * This function enqueues the provided item to be preparsed.
  *
  * The input item is retained until the preparsing is done or until the
- * preparser object is deleted.
+ * preparser object is deleted. An item already waiting is not queued twice,
+ * but META_REQUEST_OPTION_PRIORITY moves it ahead of the others.
  */
 void playlist_preparser_Push( playlist_preparser_t *, input_item_t *,
                               input_item_meta_request_option_t );
 
+/**
+ * This function cancels the preparsing of an item, whether it is waiting or
+ * being preparsed. The item is not marked as preparsed.
+ */
+void playlist_preparser_Cancel( playlist_preparser_t *, input_item_t * );
+
+/**
+ * This function gets the preparser statistics.
+ */
+void playlist_preparser_GetStats( playlist_preparser_t *,
+                                  input_preparser_stats_t * );
+
 void playlist_preparser_fetcher_Push( playlist_preparser_t *, input_item_t *,
                                       input_item_meta_request_option_t );
 
 /**
- * This function destroys the preparser object and thread.
+ * This function destroys the preparser object and waits for its threads.
  *
- * All pending input items will be released.
+ * All pending input items will be released, and the running preparsings
+ * are interrupted.
  */
 void playlist_preparser_Delete( playlist_preparser_t * );
 
@@ -69,7 +69,14 @@ playlist_item_t* playlist_ItemGetByInput( playlist_t * p_playlist,
     {
         return get_current_status_item( p_playlist );
     }
-    /** \todo Check if this is always incremental and whether we can bsearch */
+
+    bool b_found;
+    playlist_item_t *p_found =
+        playlist_index_Find( pl_priv(p_playlist)->p_index, p_item, &b_found );
+    if( b_found )
+        return p_found;
+
+    /* The index ran out of memory */
     for( i =  0 ; i < p_playlist->all_items.i_size; i++ )
     {
         if( ARRAY_VAL(p_playlist->all_items, i)->p_input == p_item )
@@ -101,6 +108,99 @@ static void playlist_LiveSearchClean( playlist_item_t *p_root )
 }
 
 
+/**
+ * Check whether an item matches the search argument
+ * @param p_item: the item
+ * @param psz_string: the string to search
+ * @return true if the item matches
+ */
+static bool playlist_LiveSearchMatch( playlist_item_t *p_item,
+                                      const char *psz_string )
+{
+    bool b_enable;
+
+    vlc_mutex_lock( &p_item->p_input->lock );
+    // Do we have some meta ?
+    if( p_item->p_input->p_meta )
+    {
+        // Use Title or fall back to psz_name
+        const char *psz_title = vlc_meta_Get( p_item->p_input->p_meta, vlc_meta_Title );
+        if( !psz_title )
+            psz_title = p_item->p_input->psz_name;
+        const char *psz_album = vlc_meta_Get( p_item->p_input->p_meta, vlc_meta_Album );
+        const char *psz_artist = vlc_meta_Get( p_item->p_input->p_meta, vlc_meta_Artist );
+        b_enable = ( psz_title && vlc_strcasestr( psz_title, psz_string ) ) ||
+                   ( psz_album && vlc_strcasestr( psz_album, psz_string ) ) ||
+                   ( psz_artist && vlc_strcasestr( psz_artist, psz_string ) );
+    }
+    else
+        b_enable = p_item->p_input->psz_name && vlc_strcasestr( p_item->p_input->psz_name, psz_string );
+    vlc_mutex_unlock( &p_item->p_input->lock );
+    return b_enable;
+}
+
+/**
+ * Disable all items in the playlist
+ * @param p_root: the current root item
+ * @param b_recursive: whether to disable the children of the children
+ */
+static void playlist_LiveSearchDisable( playlist_item_t *p_root,
+                                        bool b_recursive )
+{
+    for( int i = 0; i < p_root->i_children; i++ )
+    {
+        playlist_item_t *p_item = p_root->pp_children[i];
+        if( b_recursive && p_item->i_children >= 0 )
+            playlist_LiveSearchDisable( p_item, true );
+        p_item->i_flags |= PLAYLIST_DBL_FLAG;
+    }
+}
+
+/**
+ * Enable the items matching the search argument, among the index candidates
+ * @param p_playlist: the playlist
+ * @param p_root: the current root item
+ * @param psz_string: the string to search
+ * @return false if the index cannot help
+ */
+static bool playlist_LiveSearchIndexed( playlist_t *p_playlist,
+                                        playlist_item_t *p_root,
+                                        const char *psz_string,
+                                        bool b_recursive )
+{
+    playlist_item_t **pp_candidates;
+    ssize_t i_candidates = playlist_index_Search( pl_priv(p_playlist)->p_index,
+                                                  psz_string, &pp_candidates );
+    if( i_candidates < 0 )
+        return false;
+
+    playlist_LiveSearchDisable( p_root, b_recursive );
+
+    for( ssize_t i = 0; i < i_candidates; i++ )
+    {
+        playlist_item_t *p_item = pp_candidates[i];
+        playlist_item_t *p_parent = p_item->p_parent;
+
+        /* Is the candidate within the searched tree? */
+        if( b_recursive )
+            while( p_parent != NULL && p_parent != p_root )
+                p_parent = p_parent->p_parent;
+        if( p_parent != p_root
+         || !playlist_LiveSearchMatch( p_item, psz_string ) )
+            continue;
+
+        /* Enable the item and the nodes leading to it */
+        for( ; p_item != p_root; p_item = p_item->p_parent )
+        {
+            if( !(p_item->i_flags & PLAYLIST_DBL_FLAG) )
+                break; /* already enabled by another match */
+            p_item->i_flags &= ~PLAYLIST_DBL_FLAG;
+        }
+    }
+    free( pp_candidates );
+    return true;
+}
+
 /**
  * Enable/Disable items in the playlist according to the search argument
  * @param p_root: the current root item
@@ -124,25 +224,7 @@ static bool playlist_LiveSearchUpdateInternal( playlist_item_t *p_root,
         }
 
         if( !b_enable )
-        {
-            vlc_mutex_lock( &p_item->p_input->lock );
-            // Do we have some meta ?
-            if( p_item->p_input->p_meta )
-            {
-                // Use Title or fall back to psz_name
-                const char *psz_title = vlc_meta_Get( p_item->p_input->p_meta, vlc_meta_Title );
-                if( !psz_title )
-                    psz_title = p_item->p_input->psz_name;
-                const char *psz_album = vlc_meta_Get( p_item->p_input->p_meta, vlc_meta_Album );
-                const char *psz_artist = vlc_meta_Get( p_item->p_input->p_meta, vlc_meta_Artist );
-                b_enable = ( psz_title && vlc_strcasestr( psz_title, psz_string ) ) ||
-                           ( psz_album && vlc_strcasestr( psz_album, psz_string ) ) ||
-                           ( psz_artist && vlc_strcasestr( psz_artist, psz_string ) );
-            }
-            else
-                b_enable = p_item->p_input->psz_name && vlc_strcasestr( p_item->p_input->psz_name, psz_string );
-            vlc_mutex_unlock( &p_item->p_input->lock );
-        }
+            b_enable = playlist_LiveSearchMatch( p_item, psz_string );
 
         if( b_enable )
             p_item->i_flags &= ~PLAYLIST_DBL_FLAG;
@@ -169,7 +251,12 @@ int playlist_LiveSearchUpdate( playlist_t *p_playlist, playlist_item_t *p_root,
     PL_ASSERT_LOCKED;
     pl_priv(p_playlist)->b_reset_currently_playing = true;
     if( *psz_string )
-        playlist_LiveSearchUpdateInternal( p_root, psz_string, b_recursive );
+    {
+        if( !playlist_LiveSearchIndexed( p_playlist, p_root, psz_string,
+                                         b_recursive ) )
+            playlist_LiveSearchUpdateInternal( p_root, psz_string,
+                                               b_recursive );
+    }
     else
         playlist_LiveSearchClean( p_root );
     vlc_cond_signal( &pl_priv(p_playlist)->signal );
@@ -207,6 +207,17 @@ static int PlayItem( playlist_t *p_playlist, playlist_item_t *p_item )
 
     p_sys->status.i_status = PLAYLIST_RUNNING;
 
+    /* Preparse the next item before the others, so that it is ready */
+    int i_next = p_playlist->i_current_index + 1;
+    if( p_sys->p_preparser != NULL && i_next > 0
+     && i_next < p_playlist->current.i_size )
+    {
+        input_item_t *p_next = ARRAY_VAL( p_playlist->current, i_next )->p_input;
+        if( !input_item_IsPreparsed( p_next ) )
+            playlist_preparser_Push( p_sys->p_preparser, p_next,
+                                     META_REQUEST_OPTION_PRIORITY );
+    }
+
     assert( p_sys->p_input == NULL );
 
     input_thread_t *p_input_thread = input_Create( p_playlist, p_input, NULL, p_sys->p_input_resource );
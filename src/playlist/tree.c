@@ -78,6 +78,7 @@ playlist_item_t * playlist_NodeCreate( playlist_t *p_playlist,
     p_item->i_children = 0;
 
     ARRAY_APPEND(p_playlist->all_items, p_item);
+    playlist_index_Add( pl_priv(p_playlist)->p_index, p_item );
 
     if( p_parent != NULL )
         playlist_NodeInsert( p_playlist, p_item, p_parent,
@@ -159,6 +160,18 @@ int playlist_NodeDelete( playlist_t *p_playlist, playlist_item_t *p_root,
     ARRAY_BSEARCH( p_playlist->all_items, ->i_id, int, p_root->i_id, i );
     if( i != -1 )
         ARRAY_REMOVE( p_playlist->all_items, i );
+    playlist_index_Remove( pl_priv(p_playlist)->p_index, p_root );
+
+    /* Nobody will see the meta data of the item anymore */
+    if( pl_priv(p_playlist)->p_preparser != NULL )
+    {
+        bool b_found;
+        if( playlist_index_Find( pl_priv(p_playlist)->p_index,
+                                 p_root->p_input, &b_found ) == NULL
+         && b_found )
+            playlist_preparser_Cancel( pl_priv(p_playlist)->p_preparser,
+                                       p_root->p_input );
+    }
 
     if( p_root->i_children == -1 ) {
         ARRAY_BSEARCH( p_playlist->items,->i_id, int, p_root->i_id, i );
@@ -1,5 +1,5 @@
 /*****************************************************************************
- * timer.c: simple threaded timer
+ * timer.c: timers on a shared timing wheel
  *****************************************************************************
  * Copyright (C) 2009-2012 Rémi Denis-Courmont
  *
@@ -29,62 +29,103 @@
 #include <vlc_common.h>
 #include <vlc_atomic.h>
 
+#include <vlc_threadpool.h>
+
 /*
  * POSIX timers are essentially unusable from a library: there provide no safe
  * way to ensure that a timer has no pending/ongoing iteration. Furthermore,
  * they typically require one thread per timer plus one thread per iteration,
  * which is inefficient and overkill (unless you need multiple iteration
  * of the same timer concurrently).
- * Thus, this is a generic manual implementation of timers using a thread.
+ * Thus, this is a generic manual implementation of timers: all armed timers
+ * are kept in a hashed timing wheel serviced by a single thread, which hands
+ * expired timers over to a shared thread pool.
  */
 
+#define TIMER_TICK  (CLOCK_FREQ / 1000)
+#define TIMER_SLOTS 256
+
+/* Timer callbacks may block (network fetches, screen captures...) so the pool
+ * is not limited to the CPU count. Its threads are only started as needed. */
+#define TIMER_WORKERS 32
+
 struct vlc_timer
 {
-    vlc_thread_t thread;
-    vlc_cond_t   reschedule;
-    vlc_mutex_t  lock;
+    struct vlc_timer  *next; /* in the wheel slot */
+    struct vlc_timer **prev; /* NULL if not in the wheel */
     void       (*func) (void *);
     void        *data;
     mtime_t      value, interval;
     atomic_uint  overruns;
+    bool         running; /* queued or running on the pool */
+    bool         late; /* expired while running */
 };
 
-VLC_NORETURN
-static void *vlc_timer_thread (void *data)
+static vlc_mutex_t setup_lock = VLC_STATIC_MUTEX;
+
+static struct
 {
-    struct vlc_timer *timer = data;
+    vlc_mutex_t       lock;
+    vlc_cond_t        reschedule;
+    vlc_cond_t        idle; /* a timer iteration completed */
+    vlc_thread_t      thread;
+    vlc_threadpool_t *pool;
+    unsigned          users;
+    uint64_t          tick; /* first tick not completely processed */
+    struct vlc_timer *slots[TIMER_SLOTS];
+} wheel = { .lock = VLC_STATIC_MUTEX, .users = 0 };
 
-    vlc_mutex_lock (&timer->lock);
-    mutex_cleanup_push (&timer->lock);
+static uint64_t vlc_timer_tick (mtime_t date)
+{
+    return date / TIMER_TICK;
+}
 
-    for (;;)
-    {
-        while (timer->value == 0)
-            vlc_cond_wait (&timer->reschedule, &timer->lock);
+static void vlc_timer_link (struct vlc_timer *timer)
+{
+    uint64_t tick = vlc_timer_tick (timer->value);
 
-        if (vlc_cond_timedwait (&timer->reschedule, &timer->lock,
-                                timer->value) == 0)
-            continue;
-        if (timer->interval == 0)
-            timer->value = 0; /* disarm */
-        vlc_mutex_unlock (&timer->lock);
+    /* Past timers go to the current slot which is processed next */
+    if (tick < wheel.tick)
+        tick = wheel.tick;
 
-        int canc = vlc_savecancel ();
-        timer->func (timer->data);
-        vlc_restorecancel (canc);
+    struct vlc_timer **slot = &wheel.slots[tick % TIMER_SLOTS];
+
+    assert (timer->prev == NULL);
+    timer->next = *slot;
+    if (timer->next != NULL)
+        timer->next->prev = &timer->next;
+    timer->prev = slot;
+    *slot = timer;
+}
+
+static void vlc_timer_unlink (struct vlc_timer *timer)
+{
+    if (timer->prev == NULL)
+        return;
+    *timer->prev = timer->next;
+    if (timer->next != NULL)
+        timer->next->prev = timer->prev;
+    timer->prev = NULL;
+}
 
-        mtime_t now = mdate ();
-        unsigned misses;
+static void vlc_timer_run (void *);
 
-        vlc_mutex_lock (&timer->lock);
-        if (timer->interval == 0)
-            continue;
+/* Starts one iteration of an expired timer, called with the wheel lock */
+static void vlc_timer_start (struct vlc_timer *timer, mtime_t now)
+{
+    assert (!timer->running && timer->value != 0);
+
+    if (timer->interval == 0)
+        timer->value = 0; /* disarm */
+    else
+    {
+        unsigned misses = (now - timer->value) / timer->interval;
 
-        misses = (now - timer->value) / timer->interval;
         timer->value += timer->interval;
-        /* Try to compensate for one miss (mwait() will return immediately)
-         * but no more. Otherwise, we might busy loop, after extended periods
-         * without scheduling (suspend, SIGSTOP, RT preemption, ...). */
+        /* Try to compensate for one miss (the wheel will expire the timer
+         * again immediately) but no more. Otherwise, we might busy loop, after
+         * extended periods without scheduling (suspend, SIGSTOP, RT
+         * preemption, ...). */
         if (misses > 1)
         {
             misses--;
@@ -92,12 +133,166 @@ static void *vlc_timer_thread (void *data)
             atomic_fetch_add_explicit (&timer->overruns, misses,
                                        memory_order_relaxed);
         }
+        vlc_timer_link (timer);
+    }
+
+    if (vlc_threadpool_submit (wheel.pool, VLC_TASK_PRIORITY_HIGH,
+                               vlc_timer_run, timer) == 0)
+        timer->running = true;
+    else
+        atomic_fetch_add_explicit (&timer->overruns, 1, memory_order_relaxed);
+}
+
+static void vlc_timer_expire (struct vlc_timer *timer, mtime_t now)
+{
+    vlc_timer_unlink (timer);
+
+    if (timer->running)
+    {   /* Iterations are serialized: start it when the current one ends */
+        timer->late = true;
+        return;
+    }
+    vlc_timer_start (timer, now);
+}
+
+static void vlc_timer_run (void *data)
+{
+    struct vlc_timer *timer = data;
+
+    int canc = vlc_savecancel ();
+    timer->func (timer->data);
+    vlc_restorecancel (canc);
+
+    vlc_mutex_lock (&wheel.lock);
+    timer->running = false;
+    if (timer->late)
+    {
+        timer->late = false;
+        if (timer->value != 0)
+        {
+            vlc_timer_start (timer, mdate ());
+            vlc_cond_signal (&wheel.reschedule);
+        }
+    }
+    vlc_cond_broadcast (&wheel.idle);
+    vlc_mutex_unlock (&wheel.lock);
+}
+
+/**
+ * Expires due timers, called with the wheel lock.
+ * @return the earliest deadline of the remaining timers, or the time to
+ * check the wheel again if none is due within one turn.
+ */
+static mtime_t vlc_timer_wheel_process (mtime_t now)
+{
+    uint64_t now_tick = vlc_timer_tick (now);
+
+    /* Scan the elapsed slots, at most one turn after a long sleep */
+    for (uint64_t tick = wheel.tick;
+         tick <= now_tick && tick < wheel.tick + TIMER_SLOTS; tick++)
+    {
+        struct vlc_timer *timer = wheel.slots[tick % TIMER_SLOTS];
+
+        while (timer != NULL)
+        {
+            struct vlc_timer *next = timer->next;
+
+            if (timer->value <= now)
+                vlc_timer_expire (timer, now);
+            timer = next;
+        }
+    }
+    /* Timers of the current tick may not be due yet, keep it */
+    wheel.tick = now_tick;
+
+    /* Find the next non-empty tick */
+    for (uint64_t tick = wheel.tick; tick < wheel.tick + TIMER_SLOTS; tick++)
+    {
+        mtime_t deadline = INT64_MAX;
+
+        for (struct vlc_timer *timer = wheel.slots[tick % TIMER_SLOTS];
+             timer != NULL; timer = timer->next)
+            if (vlc_timer_tick (timer->value) <= tick
+             && timer->value < deadline)
+                deadline = timer->value;
+
+        if (deadline != INT64_MAX)
+            return deadline;
+    }
+    return (wheel.tick + TIMER_SLOTS) * TIMER_TICK;
+}
+
+VLC_NORETURN
+static void *vlc_timer_thread (void *data)
+{
+    (void) data;
+
+    vlc_mutex_lock (&wheel.lock);
+    mutex_cleanup_push (&wheel.lock);
+
+    for (;;)
+    {
+        int canc = vlc_savecancel ();
+        mtime_t deadline = vlc_timer_wheel_process (mdate ());
+        vlc_restorecancel (canc);
+
+        vlc_cond_timedwait (&wheel.reschedule, &wheel.lock, deadline);
     }
 
     vlc_cleanup_pop ();
     assert (0);
 }
 
+static int vlc_timer_wheel_hold (void)
+{
+    int ret = 0;
+
+    vlc_mutex_lock (&setup_lock);
+    if (wheel.users == 0)
+    {
+        wheel.pool = vlc_threadpool_create (TIMER_WORKERS);
+        if (unlikely(wheel.pool == NULL))
+        {
+            ret = ENOMEM;
+            goto out;
+        }
+        vlc_cond_init (&wheel.reschedule);
+        vlc_cond_init (&wheel.idle);
+        for (unsigned i = 0; i < TIMER_SLOTS; i++)
+            wheel.slots[i] = NULL;
+        wheel.tick = vlc_timer_tick (mdate ());
+
+        if (vlc_clone (&wheel.thread, vlc_timer_thread, NULL,
+                       VLC_THREAD_PRIORITY_INPUT))
+        {
+            vlc_cond_destroy (&wheel.idle);
+            vlc_cond_destroy (&wheel.reschedule);
+            vlc_threadpool_destroy (wheel.pool);
+            ret = ENOMEM;
+            goto out;
+        }
+    }
+    wheel.users++;
+out:
+    vlc_mutex_unlock (&setup_lock);
+    return ret;
+}
+
+static void vlc_timer_wheel_release (void)
+{
+    vlc_mutex_lock (&setup_lock);
+    assert (wheel.users > 0);
+    if (--wheel.users == 0)
+    {
+        vlc_cancel (wheel.thread);
+        vlc_join (wheel.thread, NULL);
+        vlc_threadpool_destroy (wheel.pool);
+        vlc_cond_destroy (&wheel.idle);
+        vlc_cond_destroy (&wheel.reschedule);
+    }
+    vlc_mutex_unlock (&setup_lock);
+}
+
 /**
  * Initializes an asynchronous timer.
  * @warning Asynchronous timers are processed from an unspecified thread.
@@ -115,23 +310,21 @@ int vlc_timer_create (vlc_timer_t *id, void (*func) (void *), void *data)
 
     if (unlikely(timer == NULL))
         return ENOMEM;
-    vlc_mutex_init (&timer->lock);
-    vlc_cond_init (&timer->reschedule);
+    if (vlc_timer_wheel_hold ())
+    {
+        free (timer);
+        return ENOMEM;
+    }
     assert (func);
+    timer->next = NULL;
+    timer->prev = NULL;
     timer->func = func;
     timer->data = data;
     timer->value = 0;
     timer->interval = 0;
     atomic_init(&timer->overruns, 0);
-
-    if (vlc_clone (&timer->thread, vlc_timer_thread, timer,
-                   VLC_THREAD_PRIORITY_INPUT))
-    {
-        vlc_cond_destroy (&timer->reschedule);
-        vlc_mutex_destroy (&timer->lock);
-        free (timer);
-        return ENOMEM;
-    }
+    timer->running = false;
+    timer->late = false;
 
     *id = timer;
     return 0;
@@ -148,11 +341,16 @@ int vlc_timer_create (vlc_timer_t *id, void (*func) (void *), void *data)
  */
 void vlc_timer_destroy (vlc_timer_t timer)
 {
-    vlc_cancel (timer->thread);
-    vlc_join (timer->thread, NULL);
-    vlc_cond_destroy (&timer->reschedule);
-    vlc_mutex_destroy (&timer->lock);
+    vlc_mutex_lock (&wheel.lock);
+    vlc_timer_unlink (timer);
+    timer->value = 0;
+    timer->late = false;
+    while (timer->running)
+        vlc_cond_wait (&wheel.idle, &wheel.lock);
+    vlc_mutex_unlock (&wheel.lock);
+
     free (timer);
+    vlc_timer_wheel_release ();
 }
 
 /**
@@ -178,11 +376,17 @@ void vlc_timer_schedule (vlc_timer_t timer, bool absolute,
     if (!absolute && value != 0)
         value += mdate();
 
-    vlc_mutex_lock (&timer->lock);
+    vlc_mutex_lock (&wheel.lock);
+    vlc_timer_unlink (timer);
     timer->value = value;
     timer->interval = interval;
-    vlc_cond_signal (&timer->reschedule);
-    vlc_mutex_unlock (&timer->lock);
+    timer->late = false;
+    if (value != 0)
+    {
+        vlc_timer_link (timer);
+        vlc_cond_signal (&wheel.reschedule);
+    }
+    vlc_mutex_unlock (&wheel.lock);
 }
 
 /**
@@ -0,0 +1,147 @@
+/*****************************************************************************
+ * threadpool.c: Test for thread pool API
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_atomic.h>
+#include <vlc_threadpool.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#undef NDEBUG
+#include <assert.h>
+
+static atomic_uint counter;
+
+static void count (void *data)
+{
+    (void) data;
+    atomic_fetch_add (&counter, 1);
+}
+
+/* Recursive sum over a range, splitting it in nested groups */
+struct range
+{
+    vlc_threadpool_t *pool;
+    unsigned begin, end;
+    uint64_t sum;
+};
+
+static void sum (void *data)
+{
+    struct range *r = data;
+
+    if (r->end - r->begin <= 16)
+    {
+        r->sum = 0;
+        for (unsigned i = r->begin; i < r->end; i++)
+            r->sum += i;
+        return;
+    }
+
+    unsigned middle = (r->begin + r->end) / 2;
+    struct range left = { r->pool, r->begin, middle, 0 };
+    struct range right = { r->pool, middle, r->end, 0 };
+    vlc_taskgroup_t *group = vlc_taskgroup_create (r->pool,
+                                                   VLC_TASK_PRIORITY_NORMAL);
+    assert (group != NULL);
+    assert (vlc_taskgroup_submit (group, sum, &left) == 0);
+    assert (vlc_taskgroup_submit (group, sum, &right) == 0);
+    vlc_taskgroup_destroy (group);
+    r->sum = left.sum + right.sum;
+}
+
+/* Priority ordering, with a single worker */
+static vlc_sem_t gate;
+static vlc_mutex_t order_lock;
+static char order[4];
+static unsigned order_len;
+
+static void block (void *data)
+{
+    (void) data;
+    vlc_sem_wait (&gate);
+}
+
+static void record (void *data)
+{
+    vlc_mutex_lock (&order_lock);
+    order[order_len++] = *(const char *)data;
+    vlc_mutex_unlock (&order_lock);
+}
+
+int main (void)
+{
+    vlc_threadpool_t *pool = vlc_threadpool_create (0);
+    assert (pool != NULL);
+    printf ("%u workers\n", vlc_threadpool_size (pool));
+
+    /* Plain tasks, all run before destruction */
+    atomic_init (&counter, 0);
+    for (unsigned i = 0; i < 1000; i++)
+        assert (vlc_threadpool_submit (pool, i % 3, count, NULL) == 0);
+
+    /* Nested groups, waited for from workers */
+    struct range r = { pool, 0, 100000, 0 };
+    vlc_taskgroup_t *group = vlc_taskgroup_create (pool,
+                                                   VLC_TASK_PRIORITY_NORMAL);
+    assert (group != NULL);
+    assert (vlc_taskgroup_submit (group, sum, &r) == 0);
+    vlc_taskgroup_wait (group);
+    printf ("Sum = %"PRIu64"\n", r.sum);
+    assert (r.sum == UINT64_C(99999) * 100000 / 2);
+
+    for (unsigned i = 0; i < 100; i++)
+        assert (vlc_taskgroup_submit (group, count, NULL) == 0);
+    vlc_taskgroup_destroy (group);
+
+    vlc_threadpool_destroy (pool);
+    printf ("Count = %u\n", atomic_load (&counter));
+    assert (atomic_load (&counter) == 1100);
+
+    /* Higher priorities first */
+    pool = vlc_threadpool_create (1);
+    assert (pool != NULL);
+    vlc_sem_init (&gate, 0);
+    vlc_mutex_init (&order_lock);
+    order_len = 0;
+
+    assert (vlc_threadpool_submit (pool, VLC_TASK_PRIORITY_NORMAL,
+                                   block, NULL) == 0);
+    assert (vlc_threadpool_submit (pool, VLC_TASK_PRIORITY_LOW,
+                                   record, "l") == 0);
+    assert (vlc_threadpool_submit (pool, VLC_TASK_PRIORITY_NORMAL,
+                                   record, "n") == 0);
+    assert (vlc_threadpool_submit (pool, VLC_TASK_PRIORITY_HIGH,
+                                   record, "h") == 0);
+    vlc_sem_post (&gate);
+    vlc_threadpool_destroy (pool);
+    order[order_len] = '\0';
+    printf ("Order = %s\n", order);
+    assert (!strcmp (order, "hnl"));
+
+    vlc_mutex_destroy (&order_lock);
+    vlc_sem_destroy (&gate);
+    return 0;
+}
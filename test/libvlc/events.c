@@ -0,0 +1,669 @@
+/*****************************************************************************
+ * events.c: libvlc event manager test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Checks the order, the coalescing and the removal of the asynchronous
+ * events, and the removal of the synchronous listeners. With VLC_TEST_BENCH
+ * set, also sends media player events from many event managers at once and
+ * reports the events sent per second.
+ * Usage: test_libvlc_events [managers] [events per manager] */
+
+#include "test.h"
+
+#include "../../lib/event.c"
+#include "../../lib/event_async.c"
+
+#include <vlc_atomic.h>
+
+static libvlc_instance_t *vlc;
+
+static libvlc_event_manager_t *NewManager (void)
+{
+    static int obj;
+    libvlc_event_manager_t *em = libvlc_event_manager_new (&obj, vlc);
+
+    assert (em != NULL);
+    libvlc_event_manager_register_event_type (em, libvlc_MediaPlayerTimeChanged);
+    libvlc_event_manager_register_event_type (em, libvlc_MediaPlayerPositionChanged);
+    libvlc_event_manager_register_event_type (em, libvlc_MediaPlayerTitleChanged);
+    return em;
+}
+
+static void SendTime (libvlc_event_manager_t *em, int64_t time)
+{
+    libvlc_event_t event;
+
+    event.type = libvlc_MediaPlayerTimeChanged;
+    event.u.media_player_time_changed.new_time = time;
+    libvlc_event_send (em, &event);
+}
+
+static void SendPosition (libvlc_event_manager_t *em, float position)
+{
+    libvlc_event_t event;
+
+    event.type = libvlc_MediaPlayerPositionChanged;
+    event.u.media_player_position_changed.new_position = position;
+    libvlc_event_send (em, &event);
+}
+
+static void SendTitle (libvlc_event_manager_t *em, int title)
+{
+    libvlc_event_t event;
+
+    event.type = libvlc_MediaPlayerTitleChanged;
+    event.u.media_player_title_changed.new_title = title;
+    libvlc_event_send (em, &event);
+}
+
+/*
+ * Order and coalescing
+ */
+#define ORDER_COUNT 20000
+
+struct order
+{
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    int64_t last_time;
+    unsigned times;
+    int last_title;
+    unsigned batches;
+    unsigned batched;
+    bool sent;
+};
+
+/* Holds the listeners until all the events are queued */
+static void WaitSent (struct order *o)
+{
+    while (!o->sent)
+        vlc_cond_wait (&o->wait, &o->lock);
+}
+
+static void OnTime (const libvlc_event_t *event, void *data)
+{
+    struct order *o = data;
+    int64_t time = event->u.media_player_time_changed.new_time;
+
+    vlc_mutex_lock (&o->lock);
+    WaitSent (o);
+    assert (time > o->last_time);
+    o->last_time = time;
+    o->times++;
+    vlc_cond_signal (&o->wait);
+    vlc_mutex_unlock (&o->lock);
+}
+
+static void OnTitle (const libvlc_event_t *event, void *data)
+{
+    struct order *o = data;
+    int title = event->u.media_player_title_changed.new_title;
+
+    vlc_mutex_lock (&o->lock);
+    WaitSent (o);
+    assert (title == o->last_title + 1); /* never dropped */
+    o->last_title = title;
+    vlc_cond_signal (&o->wait);
+    vlc_mutex_unlock (&o->lock);
+}
+
+static void OnTimes (const libvlc_event_t *events, unsigned count, void *data)
+{
+    struct order *o = data;
+
+    vlc_mutex_lock (&o->lock);
+    WaitSent (o);
+    for (unsigned i = 0; i < count; i++)
+    {
+        int64_t time = events[i].u.media_player_time_changed.new_time;
+
+        assert (events[i].type == libvlc_MediaPlayerTimeChanged);
+        assert (time > o->last_time);
+        o->last_time = time;
+    }
+    assert (count == 1); /* coalesced */
+    o->times += count;
+    o->batches++;
+    vlc_cond_signal (&o->wait);
+    vlc_mutex_unlock (&o->lock);
+}
+
+static void OnTitles (const libvlc_event_t *events, unsigned count, void *data)
+{
+    struct order *o = data;
+
+    vlc_mutex_lock (&o->lock);
+    WaitSent (o);
+    for (unsigned i = 0; i < count; i++)
+    {
+        assert (events[i].u.media_player_title_changed.new_title
+                == o->last_title + 1);
+        o->last_title++;
+    }
+    o->batched += count;
+    o->batches++;
+    vlc_cond_signal (&o->wait);
+    vlc_mutex_unlock (&o->lock);
+}
+
+static void test_order (bool batch)
+{
+    libvlc_event_manager_t *em = NewManager ();
+    struct order o = { .last_time = -1 };
+
+    log ("Checking the order of the %s events\n",
+         batch ? "batched" : "asynchronous");
+    vlc_mutex_init (&o.lock);
+    vlc_cond_init (&o.wait);
+    if (batch)
+    {
+        assert (!libvlc_event_attach_batch (em, libvlc_MediaPlayerTimeChanged,
+                                            OnTimes, &o));
+        assert (!libvlc_event_attach_batch (em, libvlc_MediaPlayerTitleChanged,
+                                            OnTitles, &o));
+    }
+    else
+    {
+        libvlc_event_attach_async (em, libvlc_MediaPlayerTimeChanged,
+                                   OnTime, &o);
+        libvlc_event_attach_async (em, libvlc_MediaPlayerTitleChanged,
+                                   OnTitle, &o);
+    }
+
+    /* Many more events than the ring takes */
+    for (int i = 0; i < ORDER_COUNT; i++)
+    {
+        SendTime (em, i);
+        SendTitle (em, i + 1);
+    }
+
+    vlc_mutex_lock (&o.lock);
+    o.sent = true;
+    vlc_cond_broadcast (&o.wait);
+    while (o.last_title < ORDER_COUNT || o.last_time < ORDER_COUNT - 1)
+        vlc_cond_wait (&o.wait, &o.lock);
+    vlc_mutex_unlock (&o.lock);
+    log ("%u time events of %u delivered\n", o.times, ORDER_COUNT);
+    if (batch)
+        log ("%u title events in %u batches\n", o.batched, o.batches);
+    assert (o.times < ORDER_COUNT);
+
+    if (batch)
+    {
+        libvlc_event_detach_batch (em, libvlc_MediaPlayerTimeChanged,
+                                   OnTimes, &o);
+        libvlc_event_detach_batch (em, libvlc_MediaPlayerTitleChanged,
+                                   OnTitles, &o);
+    }
+    else
+    {
+        libvlc_event_detach (em, libvlc_MediaPlayerTimeChanged, OnTime, &o);
+        libvlc_event_detach (em, libvlc_MediaPlayerTitleChanged, OnTitle, &o);
+    }
+    libvlc_event_manager_release (em);
+    vlc_cond_destroy (&o.wait);
+    vlc_mutex_destroy (&o.lock);
+}
+
+/*
+ * Removal
+ */
+struct removal
+{
+    libvlc_event_manager_t *em;
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    unsigned calls;
+    atomic_bool detached;
+    atomic_bool stop;
+    atomic_uint sent;
+};
+
+static void OnRemovedTime (const libvlc_event_t *event, void *data)
+{
+    struct removal *r = data;
+
+    (void) event;
+    assert (!atomic_load (&r->detached));
+    vlc_mutex_lock (&r->lock);
+    r->calls++;
+    vlc_cond_signal (&r->wait);
+    vlc_mutex_unlock (&r->lock);
+}
+
+static void *SendRemoval (void *data)
+{
+    struct removal *r = data;
+
+    while (!atomic_load (&r->stop))
+        SendTime (r->em, atomic_fetch_add (&r->sent, 1));
+    return NULL;
+}
+
+static void test_removal (void)
+{
+    struct removal r;
+    vlc_thread_t th;
+
+    log ("Checking the removal of the asynchronous listeners\n");
+    r.em = NewManager ();
+    vlc_mutex_init (&r.lock);
+    vlc_cond_init (&r.wait);
+    r.calls = 0;
+    atomic_init (&r.detached, false);
+    atomic_init (&r.stop, false);
+    atomic_init (&r.sent, 0);
+    assert (!vlc_clone (&th, SendRemoval, &r, VLC_THREAD_PRIORITY_LOW));
+
+    for (unsigned i = 0; i < 100; i++)
+    {
+        atomic_store (&r.detached, false);
+        libvlc_event_attach_async (r.em, libvlc_MediaPlayerTimeChanged,
+                                   OnRemovedTime, &r);
+
+        vlc_mutex_lock (&r.lock);
+        r.calls = 0;
+        while (r.calls < 10)
+            vlc_cond_wait (&r.wait, &r.lock);
+        vlc_mutex_unlock (&r.lock);
+
+        libvlc_event_detach (r.em, libvlc_MediaPlayerTimeChanged,
+                             OnRemovedTime, &r);
+        atomic_store (&r.detached, true);
+
+        /* Queue more events without the listener */
+        unsigned sent = atomic_load (&r.sent);
+        while (atomic_load (&r.sent) - sent < 1000);
+    }
+
+    atomic_store (&r.stop, true);
+    vlc_join (th, NULL);
+    libvlc_event_manager_release (r.em);
+    vlc_cond_destroy (&r.wait);
+    vlc_mutex_destroy (&r.lock);
+}
+
+/*
+ * Removal of the synchronous listeners
+ */
+#define SYNC_SENDERS 4
+
+struct sync_removal
+{
+    libvlc_event_manager_t *em;
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    unsigned calls;
+    unsigned sent;
+    atomic_bool detached;
+    atomic_bool stop;
+    unsigned self_calls;
+    unsigned later_calls;
+};
+
+static void OnSyncTime (const libvlc_event_t *event, void *data)
+{
+    struct sync_removal *r = data;
+
+    (void) event;
+    assert (!atomic_load (&r->detached));
+    vlc_mutex_lock (&r->lock);
+    r->calls++;
+    vlc_cond_signal (&r->wait);
+    vlc_mutex_unlock (&r->lock);
+}
+
+/* Stays attached, to count the events sent */
+static void OnSentTime (const libvlc_event_t *event, void *data)
+{
+    struct sync_removal *r = data;
+
+    (void) event;
+    vlc_mutex_lock (&r->lock);
+    r->sent++;
+    vlc_cond_signal (&r->wait);
+    vlc_mutex_unlock (&r->lock);
+}
+
+static void *SendSyncRemoval (void *data)
+{
+    struct sync_removal *r = data;
+
+    for (int64_t time = 0; !atomic_load (&r->stop); time++)
+        SendTime (r->em, time);
+    return NULL;
+}
+
+static void OnLaterTitle (const libvlc_event_t *event, void *data)
+{
+    struct sync_removal *r = data;
+
+    (void) event;
+    r->later_calls++;
+}
+
+/* Removes itself and the next listener */
+static void OnSelfTitle (const libvlc_event_t *event, void *data)
+{
+    struct sync_removal *r = data;
+
+    (void) event;
+    r->self_calls++;
+    libvlc_event_detach (r->em, libvlc_MediaPlayerTitleChanged,
+                         OnSelfTitle, r);
+    libvlc_event_detach (r->em, libvlc_MediaPlayerTitleChanged,
+                         OnLaterTitle, r);
+}
+
+static void test_sync_removal (void)
+{
+    struct sync_removal r;
+    vlc_thread_t th[SYNC_SENDERS];
+
+    log ("Checking the removal of the synchronous listeners\n");
+    r.em = NewManager ();
+    vlc_mutex_init (&r.lock);
+    vlc_cond_init (&r.wait);
+    r.calls = r.sent = 0;
+    atomic_init (&r.detached, false);
+    atomic_init (&r.stop, false);
+    r.self_calls = r.later_calls = 0;
+
+    /* From a callback: the removed listeners are not called anymore */
+    libvlc_event_attach (r.em, libvlc_MediaPlayerTitleChanged,
+                         OnSelfTitle, &r);
+    libvlc_event_attach (r.em, libvlc_MediaPlayerTitleChanged,
+                         OnLaterTitle, &r);
+    SendTitle (r.em, 1);
+    SendTitle (r.em, 2);
+    assert (r.self_calls == 1 && r.later_calls == 0);
+
+    /* From another thread: no callback once detached */
+    libvlc_event_attach (r.em, libvlc_MediaPlayerTimeChanged,
+                         OnSentTime, &r);
+    for (unsigned i = 0; i < SYNC_SENDERS; i++)
+        assert (!vlc_clone (&th[i], SendSyncRemoval, &r,
+                            VLC_THREAD_PRIORITY_LOW));
+
+    for (unsigned i = 0; i < 100; i++)
+    {
+        atomic_store (&r.detached, false);
+        libvlc_event_attach (r.em, libvlc_MediaPlayerTimeChanged,
+                             OnSyncTime, &r);
+
+        vlc_mutex_lock (&r.lock);
+        r.calls = 0;
+        while (r.calls < 10)
+            vlc_cond_wait (&r.wait, &r.lock);
+        vlc_mutex_unlock (&r.lock);
+
+        libvlc_event_detach (r.em, libvlc_MediaPlayerTimeChanged,
+                             OnSyncTime, &r);
+        atomic_store (&r.detached, true);
+
+        /* Send more events without the listener */
+        vlc_mutex_lock (&r.lock);
+        r.sent = 0;
+        while (r.sent < 10)
+            vlc_cond_wait (&r.wait, &r.lock);
+        vlc_mutex_unlock (&r.lock);
+    }
+
+    atomic_store (&r.stop, true);
+    for (unsigned i = 0; i < SYNC_SENDERS; i++)
+        vlc_join (th[i], NULL);
+    libvlc_event_manager_release (r.em);
+    vlc_cond_destroy (&r.wait);
+    vlc_mutex_destroy (&r.lock);
+}
+
+/*
+ * Attach during a callback
+ */
+struct blocked_attach
+{
+    libvlc_event_manager_t *em;
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    bool entered;
+    bool released;
+    unsigned titles;
+};
+
+/* Blocks the sending thread until released by the main thread */
+static void OnBlockedPosition (const libvlc_event_t *event, void *data)
+{
+    struct blocked_attach *b = data;
+
+    (void) event;
+    vlc_mutex_lock (&b->lock);
+    b->entered = true;
+    vlc_cond_signal (&b->wait);
+    while (!b->released)
+        vlc_cond_wait (&b->wait, &b->lock);
+    vlc_mutex_unlock (&b->lock);
+}
+
+static void OnAttachedTitle (const libvlc_event_t *event, void *data)
+{
+    struct blocked_attach *b = data;
+
+    (void) event;
+    b->titles++;
+}
+
+static void *SendBlocked (void *data)
+{
+    struct blocked_attach *b = data;
+
+    SendPosition (b->em, 0.5f);
+    return NULL;
+}
+
+static void test_blocked_attach (void)
+{
+    struct blocked_attach b;
+    vlc_thread_t th;
+
+    log ("Checking the addition of listeners during a callback\n");
+    b.em = NewManager ();
+    vlc_mutex_init (&b.lock);
+    vlc_cond_init (&b.wait);
+    b.entered = b.released = false;
+    b.titles = 0;
+
+    libvlc_event_attach (b.em, libvlc_MediaPlayerPositionChanged,
+                         OnBlockedPosition, &b);
+    assert (!vlc_clone (&th, SendBlocked, &b, VLC_THREAD_PRIORITY_LOW));
+
+    vlc_mutex_lock (&b.lock);
+    while (!b.entered)
+        vlc_cond_wait (&b.wait, &b.lock);
+    vlc_mutex_unlock (&b.lock);
+
+    /* The callback waits for this thread: attach must not wait for it */
+    for (int i = 0; i < 16; i++)
+        libvlc_event_attach (b.em, libvlc_MediaPlayerTitleChanged,
+                             OnAttachedTitle, &b);
+    SendTitle (b.em, 1);
+    assert (b.titles == 16);
+
+    vlc_mutex_lock (&b.lock);
+    b.released = true;
+    vlc_cond_signal (&b.wait);
+    vlc_mutex_unlock (&b.lock);
+    vlc_join (th, NULL);
+
+    libvlc_event_manager_release (b.em);
+    vlc_cond_destroy (&b.wait);
+    vlc_mutex_destroy (&b.lock);
+}
+
+/*
+ * Benchmark
+ */
+enum bench_mode
+{
+    BENCH_NONE,
+    BENCH_SYNC,
+    BENCH_ASYNC,
+    BENCH_BATCH,
+};
+
+static const char *const bench_names[] = {
+    "no listener", "synchronous", "asynchronous", "batched",
+};
+
+struct bench
+{
+    libvlc_event_manager_t *em;
+    unsigned count;
+    atomic_uint *received;
+};
+
+static void OnBench (const libvlc_event_t *event, void *data)
+{
+    struct bench *b = data;
+
+    (void) event;
+    atomic_fetch_add_explicit (b->received, 1, memory_order_relaxed);
+}
+
+static void OnBenchBatch (const libvlc_event_t *events, unsigned count,
+                          void *data)
+{
+    struct bench *b = data;
+
+    (void) events;
+    atomic_fetch_add_explicit (b->received, count, memory_order_relaxed);
+}
+
+static void *SendBench (void *data)
+{
+    struct bench *b = data;
+
+    for (unsigned i = 0; i < b->count; i++)
+    {
+        SendTime (b->em, i);
+        SendPosition (b->em, i / (float)b->count);
+    }
+    return NULL;
+}
+
+static void Bench (enum bench_mode mode, unsigned managers, unsigned count)
+{
+    struct bench *benches = calloc (managers, sizeof (*benches));
+    vlc_thread_t *threads = calloc (managers, sizeof (*threads));
+    atomic_uint received;
+
+    assert (benches != NULL && threads != NULL);
+    atomic_init (&received, 0);
+    for (unsigned i = 0; i < managers; i++)
+    {
+        struct bench *b = &benches[i];
+
+        b->em = NewManager ();
+        b->count = count;
+        b->received = &received;
+        for (int t = libvlc_MediaPlayerTimeChanged;
+             t <= libvlc_MediaPlayerPositionChanged; t++)
+            switch (mode)
+            {
+                case BENCH_NONE:
+                    break;
+                case BENCH_SYNC:
+                    libvlc_event_attach (b->em, t, OnBench, b);
+                    break;
+                case BENCH_ASYNC:
+                    libvlc_event_attach_async (b->em, t, OnBench, b);
+                    break;
+                case BENCH_BATCH:
+                    libvlc_event_attach_batch (b->em, t, OnBenchBatch, b);
+                    break;
+            }
+    }
+
+    mtime_t start = mdate ();
+    for (unsigned i = 0; i < managers; i++)
+        assert (!vlc_clone (&threads[i], SendBench, &benches[i],
+                            VLC_THREAD_PRIORITY_LOW));
+    for (unsigned i = 0; i < managers; i++)
+        vlc_join (threads[i], NULL);
+    mtime_t elapsed = mdate () - start;
+
+    for (unsigned i = 0; i < managers; i++)
+    {
+        struct bench *b = &benches[i];
+
+        for (int t = libvlc_MediaPlayerTimeChanged;
+             t <= libvlc_MediaPlayerPositionChanged; t++)
+            switch (mode)
+            {
+                case BENCH_NONE:
+                    break;
+                case BENCH_SYNC:
+                case BENCH_ASYNC:
+                    libvlc_event_detach (b->em, t, OnBench, b);
+                    break;
+                case BENCH_BATCH:
+                    libvlc_event_detach_batch (b->em, t, OnBenchBatch, b);
+                    break;
+            }
+        libvlc_event_manager_release (b->em);
+    }
+
+    uint64_t sent = 2 * (uint64_t)managers * count;
+    log ("%s: %.0f events/s sent, %u of %"PRIu64" delivered\n",
+         bench_names[mode], sent * (double)CLOCK_FREQ / elapsed,
+         atomic_load (&received), sent);
+    free (threads);
+    free (benches);
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned managers = (argc > 1) ? strtoul (argv[1], NULL, 0) : 32;
+    unsigned count = (argc > 2) ? strtoul (argv[2], NULL, 0) : 20000;
+    const char *args[] = {
+        "--ignore-config",
+        "-I",
+        "dummy",
+    };
+
+    test_init ();
+
+    vlc = libvlc_new (sizeof (args) / sizeof (args[0]), args);
+    assert (vlc != NULL);
+
+    test_order (false);
+    test_order (true);
+    test_removal ();
+    test_sync_removal ();
+    test_blocked_attach ();
+
+    if (test_bench ())
+    {
+        log ("Sending from %u event managers at once\n", managers);
+        for (unsigned mode = BENCH_NONE; mode <= BENCH_BATCH; mode++)
+            Bench (mode, managers, count);
+    }
+
+    libvlc_release (vlc);
+    return 0;
+}
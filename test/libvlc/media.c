@@ -73,11 +73,69 @@ static void test_media_preparsed(const char** argv, int argc)
     libvlc_release (vlc);
 }
 
+static void test_media_parse_stats(const char** argv, int argc)
+{
+    enum { COUNT = 16 };
+    libvlc_media_t *media[COUNT];
+    libvlc_media_parse_stats_t stats;
+
+    log ("Testing parse statistics\n");
+
+    libvlc_instance_t *vlc = libvlc_new (argc, argv);
+    assert (vlc != NULL);
+
+    assert (libvlc_media_parse_get_stats (vlc, &stats) == 0);
+    assert (stats.i_pending == 0 && stats.i_running == 0);
+    assert (stats.i_done == 0);
+
+    for (unsigned i = 0; i < COUNT; i++)
+    {
+        media[i] = libvlc_media_new_path (vlc, SRCDIR"/samples/image.jpg");
+        assert (media[i] != NULL);
+        libvlc_media_parse_async (media[i]);
+    }
+    libvlc_media_parse_prioritize (media[COUNT - 1]);
+
+    for (unsigned i = 0; i < COUNT; i++)
+        while (!libvlc_media_is_parsed (media[i]))
+            usleep (10000);
+
+    /* Parsed media are counted just after the event */
+    do
+        assert (libvlc_media_parse_get_stats (vlc, &stats) == 0);
+    while (stats.i_running > 0 && usleep (10000) == 0);
+    assert (stats.i_pending == 0);
+    assert (stats.i_done == COUNT && stats.i_cancelled == 0);
+    log ("%u media parsed, %u timed out\n", (unsigned)stats.i_done,
+         (unsigned)stats.i_timeouts);
+
+    /* Media released before being parsed are dropped */
+    for (unsigned i = 0; i < COUNT; i++)
+    {
+        libvlc_media_release (media[i]);
+        media[i] = libvlc_media_new_path (vlc, SRCDIR"/samples/empty.voc");
+        assert (media[i] != NULL);
+        libvlc_media_parse_async (media[i]);
+        libvlc_media_release (media[i]);
+    }
+
+    do
+        assert (libvlc_media_parse_get_stats (vlc, &stats) == 0);
+    while ((stats.i_pending > 0 || stats.i_running > 0)
+        && usleep (10000) == 0);
+    assert (stats.i_done + stats.i_cancelled == 2 * COUNT);
+    log ("%u of %u released media were not parsed\n",
+         (unsigned)stats.i_cancelled, COUNT);
+
+    libvlc_release (vlc);
+}
+
 int main (void)
 {
     test_init();
 
     test_media_preparsed (test_defaults_args, test_defaults_nargs);
+    test_media_parse_stats (test_defaults_args, test_defaults_nargs);
 
     return 0;
 }
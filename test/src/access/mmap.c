@@ -0,0 +1,221 @@
+/*****************************************************************************
+ * mmap.c: memory-mapped file input test
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Reads a generated file, then a block device, through the mmap access and
+ * checks the data and the size against those read with the file
+ * descriptor. The block device is the given one, or else the first readable
+ * one, if any.
+ * Usage: test_src_access_mmap [block device] */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_access.h>
+#include <vlc_block.h>
+#include <vlc_modules.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WINDOW_KIB 256
+
+static int Control (access_t *access, int query, ...)
+{
+    va_list args;
+    int ret;
+
+    va_start (args, query);
+    ret = access->pf_control (access, query, args);
+    va_end (args);
+    return ret;
+}
+
+static access_t *Open (vlc_object_t *obj, const char *path)
+{
+    access_t *access = vlc_object_create (obj, sizeof (*access));
+    assert (access != NULL);
+
+    var_Create (access, "file-mmap", VLC_VAR_BOOL);
+    var_SetBool (access, "file-mmap", true);
+    var_Create (access, "file-mmap-window", VLC_VAR_INTEGER);
+    var_SetInteger (access, "file-mmap-window", WINDOW_KIB);
+
+    access->p_input = NULL;
+    access->psz_access = strdup ("file");
+    access->psz_location = strdup (path);
+    access->psz_filepath = strdup (path);
+    access->psz_demux = strdup ("");
+    access->pf_read = NULL;
+    access->pf_block = NULL;
+    access->pf_seek = NULL;
+    access->pf_control = NULL;
+    access->p_sys = NULL;
+    access_InitFields (access);
+
+    access->p_module = module_need (access, "access", "mmap", true);
+    assert (access->p_module != NULL);
+    return access;
+}
+
+static void Close (access_t *access)
+{
+    module_unneed (access, access->p_module);
+    free (access->psz_access);
+    free (access->psz_location);
+    free (access->psz_filepath);
+    free (access->psz_demux);
+    vlc_object_release (access);
+}
+
+/* Reads up to len bytes from offset through the access, and checks them */
+static uint64_t Check (access_t *access, int fd, uint64_t offset, size_t len)
+{
+    uint8_t *ref = malloc (len);
+    uint64_t done = 0;
+
+    assert (ref != NULL);
+    assert (access->pf_seek (access, offset) == VLC_SUCCESS);
+    while (done < len)
+    {
+        block_t *block = access->pf_block (access);
+        if (block == NULL)
+        {
+            assert (access->info.b_eof);
+            break;
+        }
+
+        size_t n = __MIN (block->i_buffer, len - done);
+        assert (pread (fd, ref, n, offset + done) == (ssize_t)n);
+        assert (!memcmp (block->p_buffer, ref, n));
+        done += n;
+        block_Release (block);
+    }
+    free (ref);
+    return done;
+}
+
+static void Run (vlc_object_t *obj, const char *path)
+{
+    int fd = open (path, O_RDONLY);
+    assert (fd != -1);
+
+    off_t size = lseek (fd, 0, SEEK_END);
+    assert (size > 0);
+
+    access_t *access = Open (obj, path);
+    uint64_t access_size;
+    assert (Control (access, ACCESS_GET_SIZE, &access_size) == VLC_SUCCESS);
+    assert (access_size == (uint64_t)size);
+
+    /* The start, the middle, and the end until EOF */
+    size_t len = 3 * WINDOW_KIB * 1024 + 1234;
+    assert (Check (access, fd, 0, len) == __MIN (len, (uint64_t)size));
+    Check (access, fd, size / 2 + 17, len);
+    if ((uint64_t)size > len)
+        assert (Check (access, fd, size - len, len + 1) == len);
+
+    Close (access);
+    close (fd);
+}
+
+/* Finds a block device that can be read, as a privileged user */
+static char *FindBlockDevice (void)
+{
+    DIR *dir = opendir ("/sys/block");
+    struct dirent *ent;
+    char *path = NULL;
+
+    if (dir == NULL)
+        return NULL;
+    while (path == NULL && (ent = readdir (dir)) != NULL)
+    {
+        struct stat st;
+
+        if (ent->d_name[0] == '.'
+         || asprintf (&path, "/dev/%s", ent->d_name) == -1)
+        {
+            path = NULL;
+            continue;
+        }
+
+        int fd = open (path, O_RDONLY);
+        if (fd == -1 || fstat (fd, &st) || !S_ISBLK (st.st_mode)
+         || lseek (fd, 0, SEEK_END) <= 0)
+        {
+            free (path);
+            path = NULL;
+        }
+        if (fd != -1)
+            close (fd);
+    }
+    closedir (dir);
+    return path;
+}
+
+int main (int argc, char *argv[])
+{
+    const char *args[] = {
+        "--ignore-config",
+        "-I",
+        "dummy",
+    };
+
+    test_init ();
+
+    libvlc_instance_t *vlc = libvlc_new (sizeof (args) / sizeof (args[0]),
+                                         args);
+    assert (vlc != NULL);
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    log ("Reading a regular file\n");
+    char file[] = "/tmp/vlc-test-mmap-XXXXXX";
+    int fd = mkstemp (file);
+    assert (fd != -1);
+    for (unsigned i = 0; i < 5 * WINDOW_KIB; i++)
+    {
+        uint8_t buf[1024 + 3];
+
+        for (size_t j = 0; j < sizeof (buf); j++)
+            buf[j] = i * 7 + j;
+        assert (write (fd, buf, sizeof (buf)) == sizeof (buf));
+    }
+    close (fd);
+    Run (obj, file);
+    unlink (file);
+
+    char *device = (argc > 1) ? strdup (argv[1]) : FindBlockDevice ();
+    if (device != NULL)
+    {
+        log ("Reading the block device %s\n", device);
+        Run (obj, device);
+        free (device);
+    }
+    else
+        log ("No readable block device: skipped\n");
+
+    libvlc_release (vlc);
+    return 0;
+}
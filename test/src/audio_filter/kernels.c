@@ -0,0 +1,200 @@
+/*****************************************************************************
+ * kernels.c: audio sample kernels test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Checks that the SSE2 and AVX2 kernels give the same results as the C ones.
+ * With VLC_TEST_BENCH set, also reports the samples per second of each.
+ * Usage: test_src_audio_filter_kernels [runs] */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "../../../modules/audio_filter/kernels.h"
+
+/* Odd sizes to go through the tails */
+#define SAMPLES (48000 * 2 + 13)
+#define FRAMES  (48000 + 7)
+#define TAPS    13
+
+static float   f_in[SAMPLES * 8], f_ref[SAMPLES], f_out[SAMPLES];
+static int16_t s16_in[SAMPLES], s16_ref[SAMPLES], s16_out[SAMPLES];
+static int32_t s32_in[SAMPLES], s32_ref[SAMPLES], s32_out[SAMPLES];
+
+/* 7.1 to stereo */
+static const float matrix[2 * 8] = {
+    1.f, 0.f, .25f, 0.f, .25f, 0.f, .7071f, 0.f,
+    0.f, 1.f, 0.f, .25f, 0.f, .25f, .7071f, 0.f,
+};
+
+static unsigned runs;
+static bool bench;
+static volatile float sink;
+
+static void Fill (void)
+{
+    srand (42);
+    for (size_t i = 0; i < SAMPLES * 8; i++)
+        f_in[i] = (rand () / (float)RAND_MAX) * 2.5f - 1.25f; /* some clip */
+    /* Ties and limits */
+    f_in[0] = 1.f;
+    f_in[1] = -1.f;
+    f_in[2] = 0.5f / 32768.f;
+    f_in[3] = -1.5f / 32768.f;
+    f_in[4] = 0.5f / 2147483648.f * 256.f + 0.5f / 2147483648.f;
+    f_in[5] = 2.f;
+    f_in[6] = -2.f;
+    for (size_t i = 0; i < SAMPLES; i++)
+    {
+        s16_in[i] = rand ();
+        s32_in[i] = rand () * 2654435761u;
+    }
+    s16_in[0] = INT16_MIN;
+    s16_in[1] = INT16_MAX;
+    s32_in[0] = INT32_MIN;
+    s32_in[1] = INT32_MAX;
+}
+
+/* Dot products are only the same to the rounding errors */
+static void CheckDot (float dot)
+{
+    double ref = 0., mag = 0.;
+
+    for (size_t i = 0; i < SAMPLES; i++)
+    {
+        ref += (double)f_in[i] * f_in[SAMPLES + i];
+        mag += fabs ((double)f_in[i] * f_in[SAMPLES + i]);
+    }
+    assert (fabs (dot - ref) <= 1e-5 * mag);
+}
+
+/* Optimized builds (-ffast-math) may reorder the C sums */
+static void CheckClose (const float *out, const float *ref, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        assert (fabsf (out[i] - ref[i]) <= 1e-6f * (1.f + fabsf (ref[i])));
+}
+
+/* Filter outputs are sums of up to 117 products */
+static void CheckFir (const float *out, const float *ref, unsigned channels)
+{
+    for (unsigned c = 0; c < channels; c++)
+        assert (fabsf (out[c] - ref[c]) <= 1e-5f * (1.f + fabsf (ref[c])));
+}
+
+#define BENCH(name, samples, ...) \
+    do { \
+        mtime_t start = mdate (); \
+        for (unsigned r = 0; r < runs; r++) \
+            __VA_ARGS__; \
+        mtime_t elapsed = mdate () - start; \
+        if (bench) \
+            printf ("%-5s %-14s %8.1f Msamples/s\n", level, name, \
+                    (double)(samples) * runs / (elapsed ? elapsed : 1)); \
+    } while (0)
+
+#define RUN(prefix) \
+    do { \
+        const char *level = #prefix; \
+        BENCH ("S16toFl32", SAMPLES, prefix##S16toFl32 (f_out, s16_in, SAMPLES)); \
+        C_S16toFl32 (f_ref, s16_in, SAMPLES); \
+        assert (!memcmp (f_out, f_ref, sizeof (f_ref))); \
+        BENCH ("Fl32toS16", SAMPLES, prefix##Fl32toS16 (s16_out, f_in, SAMPLES)); \
+        C_Fl32toS16 (s16_ref, f_in, SAMPLES); \
+        assert (!memcmp (s16_out, s16_ref, sizeof (s16_ref))); \
+        BENCH ("S32toFl32", SAMPLES, prefix##S32toFl32 (f_out, s32_in, SAMPLES)); \
+        C_S32toFl32 (f_ref, s32_in, SAMPLES); \
+        assert (!memcmp (f_out, f_ref, sizeof (f_ref))); \
+        BENCH ("Fl32toS32", SAMPLES, prefix##Fl32toS32 (s32_out, f_in, SAMPLES)); \
+        C_Fl32toS32 (s32_ref, f_in, SAMPLES); \
+        assert (!memcmp (s32_out, s32_ref, sizeof (s32_ref))); \
+        memcpy (f_out, f_in, sizeof (f_out)); \
+        BENCH ("GainFl32", SAMPLES, prefix##GainFl32 (f_out, SAMPLES, .999f)); \
+        memcpy (f_out, f_in, sizeof (f_out)); \
+        prefix##GainFl32 (f_out, SAMPLES, .3f); \
+        memcpy (f_ref, f_in, sizeof (f_ref)); \
+        C_GainFl32 (f_ref, SAMPLES, .3f); \
+        assert (!memcmp (f_out, f_ref, sizeof (f_ref))); \
+        memcpy (s16_out, s16_in, sizeof (s16_out)); \
+        BENCH ("GainS16", SAMPLES, prefix##GainS16 (s16_out, SAMPLES, 255)); \
+        memcpy (s16_out, s16_in, sizeof (s16_out)); \
+        prefix##GainS16 (s16_out, SAMPLES, 700); \
+        memcpy (s16_ref, s16_in, sizeof (s16_ref)); \
+        C_GainS16 (s16_ref, SAMPLES, 700); \
+        assert (!memcmp (s16_out, s16_ref, sizeof (s16_ref))); \
+        BENCH ("DotFl32", SAMPLES, \
+               sink = prefix##DotFl32 (f_in, f_in + SAMPLES, SAMPLES)); \
+        CheckDot (prefix##DotFl32 (f_in, f_in + SAMPLES, SAMPLES)); \
+        for (unsigned ch = 1; ch <= 2; ch++) \
+        { \
+            BENCH (ch == 1 ? "Downmix 7.1/1" : "Downmix 7.1/2", FRAMES * 8, \
+                   prefix##DownmixFl32 (f_out, f_in, FRAMES, 8, ch, matrix)); \
+            C_DownmixFl32 (f_ref, f_in, FRAMES, 8, ch, matrix); \
+            CheckClose (f_out, f_ref, FRAMES * ch); \
+        } \
+        BENCH ("Fir 12 taps/2", FRAMES * 24, \
+               for (size_t i = 0; i < FRAMES; i++) \
+                   prefix##FirFl32 (f_out, f_in + 2 * i, f_in + SAMPLES, \
+                                    f_in + 2 * SAMPLES, .3f, 24, 2)); \
+        for (unsigned ch = 1; ch <= AUDIO_KERNELS_MAX_CHANNELS; ch++) \
+        { \
+            prefix##FirFl32 (f_out, f_in, f_in + SAMPLES, f_in + 2 * SAMPLES, \
+                             .3f, TAPS * ch, ch); \
+            C_FirFl32 (f_ref, f_in, f_in + SAMPLES, f_in + 2 * SAMPLES, \
+                       .3f, TAPS * ch, ch); \
+            CheckFir (f_out, f_ref, ch); \
+        } \
+    } while (0)
+
+int main (int argc, char *argv[])
+{
+    bench = getenv ("VLC_TEST_BENCH") != NULL;
+    runs = (argc > 1) ? atoi (argv[1]) : bench ? 100 : 1;
+
+    Fill ();
+
+    /* In place conversions, as done by the converters */
+    memcpy (f_out, f_in, sizeof (f_out));
+    audio_Fl32toS16 ((int16_t *)f_out, f_out, SAMPLES);
+    C_Fl32toS16 (s16_ref, f_in, SAMPLES);
+    assert (!memcmp (f_out, s16_ref, sizeof (s16_ref)));
+    memcpy (f_out, f_in, sizeof (f_out));
+    audio_Fl32toS32 ((int32_t *)f_out, f_out, SAMPLES);
+    C_Fl32toS32 (s32_ref, f_in, SAMPLES);
+    assert (!memcmp (f_out, s32_ref, sizeof (s32_ref)));
+
+    RUN (C_);
+#ifdef AUDIO_KERNELS_SIMD
+    if (vlc_CPU_SSE2 ())
+        RUN (SSE2_);
+    if (vlc_CPU_AVX2 ())
+        RUN (AVX2_);
+#endif
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*****************************************************************************
+ * resampler.c: band-limited resampler test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Resamples a 1 kHz stereo sine with the band-limited resampler, with and
+ * without the polyphase filter bank, and checks the THD+N of the output
+ * against the bound of each. With VLC_TEST_BENCH set, also reports the CPU
+ * time it takes per second of audio, on more audio by default. The "drift"
+ * conversion changes the input rate by a few Hz every block, like the audio
+ * output does to compensate for clock drift.
+ * Usage: test_src_audio_filter_resampler [seconds] */
+
+#include <math.h> /* before the log() macro */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_aout.h>
+#include <vlc_block.h>
+#include <vlc_filter.h>
+#include <vlc_modules.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define CHANNELS     2
+#define BLOCK_FRAMES 1024
+#define FREQUENCY    1000
+
+static const struct
+{
+    const char *desc;
+    unsigned in_rate;
+    unsigned out_rate;
+    bool drift;
+} bench_conversions[] = {
+    { "44.1->48",  44100, 48000, false },
+    { "48->44.1",  48000, 44100, false },
+    { "96->48",    96000, 48000, false },
+    { "48 drift",  48000, 48000, true },
+};
+
+/* The measured THD+N are about -55 dB and -92 dB */
+static const struct
+{
+    const char *desc;
+    const char *arg;
+    double max_thdn; /* dB */
+} bench_modes[] = {
+    { "legacy",    "--no-bandlimited-polyphase", -50. },
+    { "polyphase", "--bandlimited-polyphase",    -85. },
+};
+
+/* Residual of the best fit of the sine, relative to the sine, in dB. The
+ * sine is fitted every 10 ms, so that the slow phase changes of the drift
+ * compensation are not counted as noise. */
+static double THDN (const float *buf, size_t frames, unsigned rate,
+                    double *gain)
+{
+    const double w = 2. * M_PI * FREQUENCY / rate;
+    const size_t window = rate / 100; /* a whole number of periods */
+    double signal = 0., noise = 0.;
+
+    for (size_t pos = 0; pos + window <= frames; pos += window)
+    {
+        double a = 0., b = 0.;
+
+        for (size_t i = pos; i < pos + window; i++)
+        {
+            a += buf[i * CHANNELS] * sin (w * i);
+            b += buf[i * CHANNELS] * cos (w * i);
+        }
+        a *= 2. / window;
+        b *= 2. / window;
+
+        for (size_t i = pos; i < pos + window; i++)
+        {
+            double r = buf[i * CHANNELS] - a * sin (w * i) - b * cos (w * i);
+            noise += r * r;
+        }
+        signal += (a * a + b * b) / 2. * window;
+    }
+    *gain = sqrt (signal / frames * 2.) / .5;
+    return 10. * log10 (noise / signal);
+}
+
+/* Input rate of the block at pos */
+static unsigned Rate (unsigned rate, bool drift, size_t pos)
+{
+    if (!drift)
+        return rate;
+    /* +/- 0.5% at most, like the audio output, and never the output rate */
+    return rate + 1 + lround (rate / 200. * sin (pos / (double)rate));
+}
+
+static void Run (vlc_object_t *obj, const char *desc, unsigned in_rate,
+                 unsigned out_rate, bool drift, unsigned seconds,
+                 double max_thdn)
+{
+    filter_t *filter = vlc_object_create (obj, sizeof (*filter));
+    assert (filter != NULL);
+
+    es_format_Init (&filter->fmt_in, AUDIO_ES, VLC_CODEC_FL32);
+    filter->fmt_in.audio.i_format = VLC_CODEC_FL32;
+    filter->fmt_in.audio.i_rate = in_rate;
+    filter->fmt_in.audio.i_physical_channels =
+    filter->fmt_in.audio.i_original_channels = AOUT_CHANS_STEREO;
+    aout_FormatPrepare (&filter->fmt_in.audio);
+    filter->fmt_out = filter->fmt_in;
+    filter->fmt_out.audio.i_rate = out_rate;
+
+    filter->fmt_in.audio.i_rate = Rate (in_rate, drift, 0);
+    filter->p_module = module_need (filter, "audio resampler", "bandlimited",
+                                    true);
+    assert (filter->p_module != NULL);
+
+    size_t frames = seconds * in_rate / BLOCK_FRAMES * BLOCK_FRAMES;
+    size_t out_max = 2 * seconds * out_rate + BLOCK_FRAMES;
+    float *in = malloc (frames * CHANNELS * sizeof (float));
+    float *out = malloc (out_max * CHANNELS * sizeof (float));
+    assert (in != NULL && out != NULL);
+
+    double phase = 0.;
+    for (size_t i = 0; i < frames; i++)
+    {
+        for (unsigned c = 0; c < CHANNELS; c++)
+            in[i * CHANNELS + c] = .5f * sin (phase);
+        phase += 2. * M_PI * FREQUENCY
+               / Rate (in_rate, drift, i / BLOCK_FRAMES * BLOCK_FRAMES);
+    }
+
+    size_t out_frames = 0;
+    clock_t start = clock ();
+    for (size_t pos = 0; pos < frames; pos += BLOCK_FRAMES)
+    {
+        block_t *block = block_Alloc (BLOCK_FRAMES * CHANNELS * sizeof (float));
+        assert (block != NULL);
+        memcpy (block->p_buffer, in + pos * CHANNELS, block->i_buffer);
+        block->i_nb_samples = BLOCK_FRAMES;
+        block->i_pts = block->i_dts = VLC_TS_0 + pos * CLOCK_FREQ / in_rate;
+
+        filter->fmt_in.audio.i_rate = Rate (in_rate, drift, pos);
+        block = filter->pf_audio_filter (filter, block);
+        if (block != NULL)
+        {
+            size_t n = __MIN (block->i_nb_samples, out_max - out_frames);
+            memcpy (out + out_frames * CHANNELS, block->p_buffer,
+                    n * CHANNELS * sizeof (float));
+            out_frames += n;
+            block_Release (block);
+        }
+    }
+    double cpu = (clock () - start) / (double)CLOCKS_PER_SEC;
+
+    /* Skip the first 100 ms */
+    double gain;
+    size_t skip = out_rate / 10;
+    assert (out_frames > 2 * skip);
+    double thdn = THDN (out + skip * CHANNELS, out_frames - skip, out_rate,
+                        &gain);
+
+    if (test_bench ())
+        log ("  %-9s: %6.2f ms per second of audio, THD+N %7.2f dB, "
+             "gain %.3f\n", desc, 1000. * cpu * out_rate / out_frames,
+             thdn, gain);
+    assert (thdn < max_thdn);
+
+    free (in);
+    free (out);
+    module_unneed (filter, filter->p_module);
+    vlc_object_release (filter);
+}
+
+int main (int argc, char *argv[])
+{
+    test_init ();
+
+    unsigned seconds = (argc > 1) ? atoi (argv[1]) : test_bench () ? 10 : 2;
+
+    for (unsigned i = 0; i < sizeof (bench_modes) / sizeof (bench_modes[0]); i++)
+    {
+        const char *args[] = {
+            "--ignore-config",
+            "-I",
+            "dummy",
+            bench_modes[i].arg,
+        };
+
+        libvlc_instance_t *vlc = libvlc_new (sizeof (args) / sizeof (args[0]),
+                                             args);
+        assert (vlc != NULL);
+
+        if (test_bench ())
+            log ("%s:\n", bench_modes[i].desc);
+        for (unsigned j = 0;
+             j < sizeof (bench_conversions) / sizeof (bench_conversions[0]);
+             j++)
+            Run (VLC_OBJECT(vlc->p_libvlc_int), bench_conversions[j].desc,
+                 bench_conversions[j].in_rate, bench_conversions[j].out_rate,
+                 bench_conversions[j].drift, seconds,
+                 bench_modes[i].max_thdn);
+
+        libvlc_release (vlc);
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+/*****************************************************************************
+ * scaletempo.c: scaletempo test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Runs the scaletempo filter on 48 kHz 5.1 audio at rates from 0.5 to 4,
+ * with each overlap search method, and checks that the direct and FFT
+ * searches pick the same overlaps, hence the same output. With
+ * VLC_TEST_BENCH set, also reports the CPU time it takes per second of
+ * played audio, on more audio by default.
+ * Usage: test_src_audio_filter_scaletempo [seconds] */
+
+#include <math.h> /* before the log() macro */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_aout.h>
+#include <vlc_block.h>
+#include <vlc_filter.h>
+#include <vlc_modules.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define RATE         48000
+#define CHANNELS     6
+#define BLOCK_FRAMES 1024
+
+static const float bench_rates[] = { .5f, .75f, 1.25f, 1.5f, 2.f, 3.f, 4.f };
+
+/* In pairs with the same output */
+static const struct
+{
+    const char *desc;
+    int mode;
+    bool wsola;
+} bench_modes[] = {
+    { "direct",       1, false },
+    { "fft",          2, false },
+    { "direct+wsola", 1, true },
+    { "fft+wsola",    2, true },
+};
+
+static void Fill (float *buf, size_t frames)
+{
+    srand (42);
+    for (size_t i = 0; i < frames; i++)
+        for (unsigned c = 0; c < CHANNELS; c++)
+            *(buf++) = .4f * sinf (i * (.01f + c * .003f))
+                     + .2f * sinf (i * .0007f * (c + 1))
+                     + .1f * (rand () / (float)RAND_MAX - .5f);
+}
+
+/* Returns the number of output samples, written to out */
+static size_t Run (vlc_object_t *obj, unsigned m, float rate,
+                   const float *samples, size_t frames, float *out)
+{
+    filter_t *filter = vlc_object_create (obj, sizeof (*filter));
+    assert (filter != NULL);
+
+    var_Create (filter, "scaletempo-search-mode", VLC_VAR_INTEGER);
+    var_SetInteger (filter, "scaletempo-search-mode", bench_modes[m].mode);
+    var_Create (filter, "scaletempo-wsola", VLC_VAR_BOOL);
+    var_SetBool (filter, "scaletempo-wsola", bench_modes[m].wsola);
+
+    es_format_Init (&filter->fmt_in, AUDIO_ES, VLC_CODEC_FL32);
+    filter->fmt_in.audio.i_format = VLC_CODEC_FL32;
+    filter->fmt_in.audio.i_rate = RATE;
+    filter->fmt_in.audio.i_physical_channels =
+    filter->fmt_in.audio.i_original_channels = AOUT_CHANS_5_1;
+    aout_FormatPrepare (&filter->fmt_in.audio);
+    filter->fmt_out = filter->fmt_in;
+
+    filter->p_module = module_need (filter, "audio filter", "scaletempo", true);
+    assert (filter->p_module != NULL);
+
+    /* Like the audio output does to change the playback rate */
+    filter->fmt_in.audio.i_rate = lroundf (RATE * rate);
+
+    size_t out_samples = 0;
+    clock_t start = clock ();
+    for (size_t pos = 0; pos + BLOCK_FRAMES <= frames; pos += BLOCK_FRAMES)
+    {
+        block_t *block = block_Alloc (BLOCK_FRAMES * CHANNELS * sizeof (float));
+        assert (block != NULL);
+        memcpy (block->p_buffer, samples + pos * CHANNELS, block->i_buffer);
+        block->i_nb_samples = BLOCK_FRAMES;
+        block->i_pts = block->i_dts = VLC_TS_0 + pos * CLOCK_FREQ / RATE;
+
+        block = filter->pf_audio_filter (filter, block);
+        if (block != NULL)
+        {
+            memcpy (out + out_samples, block->p_buffer, block->i_buffer);
+            out_samples += block->i_nb_samples * CHANNELS;
+            block_Release (block);
+        }
+    }
+    double cpu = (clock () - start) / (double)CLOCKS_PER_SEC;
+
+    if (test_bench ())
+        log ("%-12s %.2fx: %6.2f ms per second of audio\n",
+             bench_modes[m].desc, rate, out_samples
+             ? 1000. * cpu * RATE * CHANNELS / out_samples : 0.);
+
+    module_unneed (filter, filter->p_module);
+    vlc_object_release (filter);
+    return out_samples;
+}
+
+int main (int argc, char *argv[])
+{
+    test_init ();
+
+    unsigned seconds = (argc > 1) ? atoi (argv[1]) : test_bench () ? 10 : 2;
+    size_t frames = seconds * RATE;
+    float *samples = malloc (frames * CHANNELS * sizeof (float));
+    assert (samples != NULL);
+    Fill (samples, frames);
+
+    /* Twice as long at half speed, with a second of margin */
+    size_t max = (2 * frames + RATE) * CHANNELS;
+    float *out[2] = { malloc (max * sizeof (float)),
+                      malloc (max * sizeof (float)) };
+    assert (out[0] != NULL && out[1] != NULL);
+
+    const char *args[] = {
+        "--ignore-config",
+        "-I",
+        "dummy",
+    };
+
+    libvlc_instance_t *vlc = libvlc_new (sizeof (args) / sizeof (args[0]),
+                                         args);
+    assert (vlc != NULL);
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    for (unsigned i = 0; i < sizeof (bench_modes) / sizeof (bench_modes[0]); i += 2)
+        for (unsigned j = 0; j < sizeof (bench_rates) / sizeof (bench_rates[0]); j++)
+        {
+            size_t n = Run (obj, i, bench_rates[j], samples, frames, out[0]);
+            assert (n > 0);
+            assert (Run (obj, i + 1, bench_rates[j], samples, frames,
+                         out[1]) == n);
+            assert (!memcmp (out[0], out[1], n * sizeof (float)));
+        }
+
+    libvlc_release (vlc);
+    free (out[1]);
+    free (out[0]);
+    free (samples);
+    return 0;
+}
@@ -0,0 +1,332 @@
+/*****************************************************************************
+ * subtitle.c: text subtitle demux test
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Generates SubRip, MicroDVD and ASS files, and checks that the streaming
+ * mode of the subtitle demux sends the same subtitles as the loading mode,
+ * from the start and after random seeks. With VLC_TEST_BENCH set, also
+ * reports the open and seek times of both modes, with larger files by
+ * default. The files must be larger than the 1 MiB streaming threshold.
+ * Usage: test_src_demux_subtitle [subtitles] */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_modules.h>
+#include <vlc_url.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct
+{
+    mtime_t  pts, length;
+    uint32_t hash;
+} record_t;
+
+struct es_out_sys_t
+{
+    record_t *records;
+    size_t    count, max;
+};
+
+static bool Equal (const es_out_sys_t *a, const es_out_sys_t *b)
+{
+    if (a->count != b->count)
+        return false;
+    for (size_t i = 0; i < a->count; i++)
+        if (a->records[i].pts != b->records[i].pts
+         || a->records[i].length != b->records[i].length
+         || a->records[i].hash != b->records[i].hash)
+            return false;
+    return true;
+}
+
+static es_out_id_t *EsOutAdd (es_out_t *out, const es_format_t *fmt)
+{
+    (void) fmt;
+    return (es_out_id_t *)out;
+}
+
+static int EsOutSend (es_out_t *out, es_out_id_t *id, block_t *block)
+{
+    es_out_sys_t *sys = out->p_sys;
+    uint32_t hash = 2166136261u;
+
+    (void) id;
+    for (size_t i = 0; i < block->i_buffer; i++)
+        hash = (hash ^ block->p_buffer[i]) * 16777619u;
+
+    if (sys->count >= sys->max)
+    {
+        sys->max = 2 * sys->max + 1024;
+        sys->records = realloc (sys->records,
+                                sys->max * sizeof (*sys->records));
+        assert (sys->records != NULL);
+    }
+    sys->records[sys->count++] = (record_t){ block->i_pts, block->i_length,
+                                             hash };
+    block_Release (block);
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel (es_out_t *out, es_out_id_t *id)
+{
+    (void) out; (void) id;
+}
+
+static int EsOutControl (es_out_t *out, int query, va_list args)
+{
+    (void) out; (void) query; (void) args;
+    return VLC_EGENERIC;
+}
+
+static int Control (demux_t *demux, int query, ...)
+{
+    va_list args;
+    int ret;
+
+    va_start (args, query);
+    ret = demux->pf_control (demux, query, args);
+    va_end (args);
+    return ret;
+}
+
+static demux_t *Open (vlc_object_t *obj, const char *path, int threshold,
+                      es_out_t *out, clock_t *cpu)
+{
+    var_SetInteger (obj, "sub-streaming-threshold", threshold);
+
+    demux_t *demux = vlc_object_create (obj, sizeof (*demux));
+    assert (demux != NULL);
+
+    char *url = vlc_path2uri (path, NULL);
+    assert (url != NULL);
+    demux->psz_access = strdup ("file");
+    demux->psz_demux = strdup ("subtitle");
+    demux->psz_location = strdup (path);
+    demux->psz_file = demux->psz_location;
+    demux->out = out;
+    demux->b_force = true;
+    demux->s = stream_UrlNew (obj, url);
+    assert (demux->s != NULL);
+    free (url);
+
+    clock_t start = clock ();
+    demux->p_module = module_need (demux, "demux", "subtitle", true);
+    *cpu = clock () - start;
+    assert (demux->p_module != NULL);
+    return demux;
+}
+
+static void Close (demux_t *demux)
+{
+    module_unneed (demux, demux->p_module);
+    stream_Delete (demux->s);
+    free (demux->psz_access);
+    free (demux->psz_demux);
+    free (demux->psz_location);
+    vlc_object_release (demux);
+}
+
+/* Sends the subtitles until the given time */
+static void DemuxUntil (demux_t *demux, mtime_t time)
+{
+    Control (demux, DEMUX_SET_NEXT_DEMUX_TIME, time);
+    while (demux->pf_demux (demux) > 0)
+    {
+        mtime_t current;
+
+        if (Control (demux, DEMUX_GET_TIME, &current) || current >= time)
+            break;
+        Control (demux, DEMUX_SET_NEXT_DEMUX_TIME, time);
+    }
+}
+
+static void Run (vlc_object_t *obj, const char *desc, const char *path)
+{
+    es_out_sys_t sys[2] = { { NULL, 0, 0 }, { NULL, 0, 0 } };
+    es_out_t out[2];
+    demux_t *demux[2];
+    clock_t open_cpu[2], seek_cpu[2] = { 0, 0 };
+
+    log ("%s\n", desc);
+    for (int i = 0; i < 2; i++)
+    {
+        out[i] = (es_out_t){ EsOutAdd, EsOutSend, EsOutDel, EsOutControl,
+                             NULL, &sys[i] };
+        /* Loading mode, and streaming mode from 1 MiB */
+        demux[i] = Open (obj, path, i, &out[i], &open_cpu[i]);
+    }
+
+    /* Random seeks before the streaming index is complete, and the
+     * subtitles of the next 10 seconds */
+    mtime_t length;
+    assert (Control (demux[0], DEMUX_GET_LENGTH, &length) == VLC_SUCCESS);
+    srand (42);
+    for (unsigned n = 0; n < 100; n++)
+    {
+        mtime_t time = (double)rand () * length / RAND_MAX;
+
+        for (int i = 0; i < 2; i++)
+        {
+            sys[i].count = 0;
+
+            clock_t start = clock ();
+            int ret = Control (demux[i], DEMUX_SET_TIME, time);
+            seek_cpu[i] += clock () - start;
+            if (ret == VLC_SUCCESS)
+                DemuxUntil (demux[i], time + 10 * CLOCK_FREQ);
+        }
+        assert (Equal (&sys[0], &sys[1]));
+    }
+
+    /* Whole file */
+    for (int i = 0; i < 2; i++)
+    {
+        sys[i].count = 0;
+        assert (Control (demux[i], DEMUX_SET_TIME, (mtime_t)0)
+                == VLC_SUCCESS);
+        DemuxUntil (demux[i], INT64_MAX / 2);
+    }
+    assert (sys[0].count > 0 && Equal (&sys[0], &sys[1]));
+    log (" %zu subtitles\n", sys[0].count);
+
+    /* Positions are byte offsets in streaming mode */
+    assert (Control (demux[1], DEMUX_SET_POSITION, .5) == VLC_SUCCESS);
+    double pos;
+    assert (Control (demux[1], DEMUX_GET_POSITION, &pos) == VLC_SUCCESS);
+    assert (pos >= .5 && pos <= 1.);
+    /* That of the next subtitle, not of the parser */
+    assert (Control (demux[1], DEMUX_SET_POSITION, pos) == VLC_SUCCESS);
+    double again;
+    assert (Control (demux[1], DEMUX_GET_POSITION, &again) == VLC_SUCCESS);
+    assert (again == pos);
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (test_bench ())
+            log (" %-9s open %7.1f ms, seek %7.3f ms\n",
+                 i ? "streaming" : "loading",
+                 1000. * open_cpu[i] / CLOCKS_PER_SEC,
+                 1000. * seek_cpu[i] / CLOCKS_PER_SEC / 100);
+        Close (demux[i]);
+        free (sys[i].records);
+    }
+}
+
+/* 2 lines subtitles every 2 seconds, lasting 1.5 second */
+static void WriteSubRip (FILE *file, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned start = 2000 * i + rand () % 400, stop = start + 1500;
+
+        fprintf (file, "%u\n%02u:%02u:%02u,%03u --> %02u:%02u:%02u,%03u\n"
+                 "Subtitle %u\nline %x\n\n", i + 1,
+                 start / 3600000, start / 60000 % 60, start / 1000 % 60,
+                 start % 1000, stop / 3600000, stop / 60000 % 60,
+                 stop / 1000 % 60, stop % 1000, i, (unsigned)rand ());
+    }
+}
+
+static void WriteMicroDvd (FILE *file, unsigned count)
+{
+    fprintf (file, "{1}{1}23.976\n");
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned start = 48 * i + 2 + rand () % 10;
+
+        fprintf (file, "{%u}{%u}Subtitle %u|line %x\n", start, start + 36,
+                 i, (unsigned)rand ());
+    }
+}
+
+static void WriteASS (FILE *file, unsigned count)
+{
+    fprintf (file, "[Script Info]\nScriptType: v4.00+\n\n[V4+ Styles]\n"
+             "Format: Name, Fontname, Fontsize\nStyle: Default,Arial,20\n\n"
+             "[Events]\nFormat: Layer, Start, End, Style, Name, MarginL, "
+             "MarginR, MarginV, Effect, Text\n");
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned start = 200 * i + rand () % 40, stop = start + 150;
+
+        fprintf (file, "Dialogue: 0,%u:%02u:%02u.%02u,%u:%02u:%02u.%02u,"
+                 "Default,,0000,0000,0000,,Subtitle %u\\Nline %x\n",
+                 start / 360000, start / 6000 % 60, start / 100 % 60,
+                 start % 100, stop / 360000, stop / 6000 % 60,
+                 stop / 100 % 60, stop % 100, i, (unsigned)rand ());
+    }
+}
+
+static const struct
+{
+    const char *desc;
+    void (*write) (FILE *, unsigned);
+} formats[] = {
+    { "SubRip", WriteSubRip },
+    { "MicroDVD", WriteMicroDvd },
+    { "ASS", WriteASS },
+};
+
+int main (int argc, char *argv[])
+{
+    unsigned count = (argc > 1) ? atoi (argv[1])
+                                : test_bench () ? 100000 : 40000;
+    const char *args[] = {
+        "--ignore-config",
+        "-I",
+        "dummy",
+    };
+
+    test_init ();
+
+    libvlc_instance_t *vlc = libvlc_new (sizeof (args) / sizeof (args[0]),
+                                         args);
+    assert (vlc != NULL);
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    var_Create (obj, "sub-streaming-threshold", VLC_VAR_INTEGER);
+    var_Create (obj, "spu-delay", VLC_VAR_TIME);
+
+    for (size_t i = 0; i < sizeof (formats) / sizeof (formats[0]); i++)
+    {
+        char path[] = "/tmp/vlc-test-subtitle-XXXXXX";
+        int fd = mkstemp (path);
+        assert (fd != -1);
+
+        FILE *file = fdopen (fd, "w");
+        assert (file != NULL);
+        srand (i);
+        formats[i].write (file, count);
+        fclose (file);
+
+        Run (obj, formats[i].desc, path);
+        unlink (path);
+    }
+
+    libvlc_release (vlc);
+    return 0;
+}
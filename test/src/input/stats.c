@@ -0,0 +1,173 @@
+/*****************************************************************************
+ * stats.c: input statistics counters and histograms test
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Checks the histogram buckets, and that no update is lost when several
+ * threads update the same counters and histograms. With VLC_TEST_BENCH set,
+ * also compares the time the updates take with updates serialized by a
+ * mutex.
+ * Usage: test_src_input_stats [updates per thread] */
+
+#include "../../libvlc/test.h"
+
+#include <vlc_common.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../../src/input/stats.c"
+
+#define THREADS 4
+
+static unsigned updates = 1000000;
+static counter_t *counter;
+static stats_histogram_t *histogram;
+static vlc_mutex_t lock;
+static uint64_t locked_total;
+
+static void test_buckets(void)
+{
+    static const struct
+    {
+        mtime_t value;
+        unsigned bucket;
+    } values[] = {
+        { -5, 0 }, { 0, 0 }, { 1, 1 }, { 2, 2 }, { 3, 2 }, { 4, 3 },
+        { 1023, 10 }, { 1024, 11 }, { (1 << 22) - 1, 22 }, { 1 << 22, 23 },
+        { 1 << 30, 23 }, { INT64_C(1) << 40, 23 },
+    };
+    uint64_t expected[INPUT_HISTOGRAM_BUCKETS] = { 0 };
+    uint64_t sum = 0;
+    input_histogram_t out;
+
+    log("Testing histogram buckets\n");
+
+    stats_histogram_t *h = stats_HistogramCreate();
+    assert(h != NULL);
+
+    stats_HistogramRead(h, &out);
+    assert(out.i_count == 0 && out.i_sum == 0);
+
+    for (size_t i = 0; i < sizeof (values) / sizeof (values[0]); i++)
+    {
+        stats_HistogramRecord(h, values[i].value);
+        expected[values[i].bucket]++;
+        if (values[i].value > 0)
+            sum += values[i].value;
+    }
+
+    stats_HistogramRead(h, &out);
+    assert(out.i_count == sizeof (values) / sizeof (values[0]));
+    assert(out.i_sum == sum);
+    for (unsigned i = 0; i < INPUT_HISTOGRAM_BUCKETS; i++)
+        assert(out.pi_buckets[i] == expected[i]);
+
+    stats_HistogramClean(h);
+
+    /* Disabled statistics */
+    stats_HistogramRecord(NULL, 1);
+    stats_Update(NULL, 1);
+    assert(stats_GetTotal(NULL) == 0);
+    stats_HistogramRead(NULL, &out);
+    assert(out.i_count == 0);
+}
+
+static void *Update(void *data)
+{
+    (void) data;
+    for (unsigned i = 0; i < updates; i++)
+    {
+        stats_Update(counter, 3);
+        stats_HistogramRecord(histogram, i & 1023);
+    }
+    return NULL;
+}
+
+static void *UpdateLocked(void *data)
+{
+    (void) data;
+    for (unsigned i = 0; i < updates; i++)
+    {
+        vlc_mutex_lock(&lock);
+        locked_total += 3;
+        vlc_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+static mtime_t Run(void *(*entry)(void *))
+{
+    vlc_thread_t th[THREADS];
+    mtime_t start = mdate();
+
+    for (unsigned i = 0; i < THREADS; i++)
+        assert(vlc_clone(&th[i], entry, NULL, VLC_THREAD_PRIORITY_LOW) == 0);
+    for (unsigned i = 0; i < THREADS; i++)
+        vlc_join(th[i], NULL);
+    return mdate() - start;
+}
+
+static void test_threads(void)
+{
+    input_histogram_t out;
+
+    log("Testing %u threads with %u updates each\n", THREADS, updates);
+
+    counter = stats_CounterCreate();
+    histogram = stats_HistogramCreate();
+    assert(counter != NULL && histogram != NULL);
+
+    mtime_t atomic_time = Run(Update);
+
+    assert(stats_GetTotal(counter) == (uint64_t)THREADS * updates * 3);
+    stats_HistogramRead(histogram, &out);
+    assert(out.i_count == (uint64_t)THREADS * updates);
+
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < updates; i++)
+        sum += i & 1023;
+    assert(out.i_sum == THREADS * sum);
+
+    stats_HistogramClean(histogram);
+    stats_CounterClean(counter);
+
+    if (!test_bench())
+        return;
+
+    vlc_mutex_init(&lock);
+    mtime_t locked_time = Run(UpdateLocked);
+    assert(locked_total == (uint64_t)THREADS * updates * 3);
+    vlc_mutex_destroy(&lock);
+
+    log("atomic counter and histogram: %"PRId64" ms, "
+        "locked counter: %"PRId64" ms\n",
+        atomic_time / 1000, locked_time / 1000);
+}
+
+int main(int argc, char *argv[])
+{
+    test_init();
+
+    if (argc > 1)
+        updates = strtoul(argv[1], NULL, 0);
+
+    test_buckets();
+    test_threads();
+    return 0;
+}
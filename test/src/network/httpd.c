@@ -0,0 +1,220 @@
+/*****************************************************************************
+ * httpd.c: HTTP server load generator
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Feeds an HTTP stream and reads it back from many local clients, then
+ * resets the clients while they wait for data and checks that the server
+ * goes idle. With VLC_TEST_BENCH set, reports the throughput and the CPU
+ * time used by the process.
+ * Usage: test_src_network_httpd [clients] [seconds] */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_httpd.h>
+#include <vlc_block.h>
+#include <vlc_network.h>
+
+#include <string.h>
+#include <poll.h>
+#include <sys/resource.h>
+
+#define BENCH_PORT    18554
+#define BENCH_URL     "/bench"
+#define BENCH_BLOCK   (7 * 188)
+#define BENCH_RATE    1000 /* blocks per second */
+
+static const char *bench_args[] = {
+    "--ignore-config",
+    "-I",
+    "dummy",
+    "--http-host=127.0.0.1",
+    "--http-port=18554",
+};
+
+struct bench_clients
+{
+    int     *fds;
+    unsigned count;
+    volatile bool stop;
+    uint64_t bytes;
+};
+
+static void *Reader (void *data)
+{
+    struct bench_clients *clients = data;
+    struct pollfd ufd[clients->count];
+    uint8_t buf[65536];
+
+    for (unsigned i = 0; i < clients->count; i++)
+    {
+        ufd[i].fd = clients->fds[i];
+        ufd[i].events = POLLIN;
+    }
+
+    while (!clients->stop)
+    {
+        if (poll (ufd, clients->count, 100) <= 0)
+            continue;
+
+        for (unsigned i = 0; i < clients->count; i++)
+        {
+            if (ufd[i].revents == 0)
+                continue;
+
+            ssize_t val = recv (ufd[i].fd, buf, sizeof (buf), MSG_DONTWAIT);
+            if (val > 0)
+                clients->bytes += val;
+            else if (val == 0)
+                ufd[i].fd = -1; /* closed by the server */
+        }
+    }
+    return NULL;
+}
+
+static int Connect (void)
+{
+    static const char request[] = "GET " BENCH_URL " HTTP/1.1\r\n"
+                                  "Host: 127.0.0.1\r\n\r\n";
+    struct sockaddr_in addr;
+    int fd = socket (AF_INET, SOCK_STREAM, 0);
+
+    assert (fd != -1);
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons (BENCH_PORT);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+    if (connect (fd, (struct sockaddr *)&addr, sizeof (addr))
+     || send (fd, request, sizeof (request) - 1, 0) < 0)
+    {
+        close (fd);
+        return -1;
+    }
+    return fd;
+}
+
+static double CpuTime (void)
+{
+    struct rusage ru;
+
+    getrusage (RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+         + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+int main (int argc, char *argv[])
+{
+    test_init ();
+
+    bool bench = test_bench ();
+    unsigned count = (argc > 1) ? atoi (argv[1]) : bench ? 200 : 20;
+    unsigned seconds = (argc > 2) ? atoi (argv[2]) : bench ? 3 : 1;
+
+    libvlc_instance_t *vlc = libvlc_new (sizeof (bench_args) / sizeof (bench_args[0]),
+                                         bench_args);
+    assert (vlc != NULL);
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    httpd_host_t *host = vlc_http_HostNew (obj);
+    assert (host != NULL);
+    httpd_stream_t *stream = httpd_StreamNew (host, BENCH_URL, "video/MP2T",
+                                              NULL, NULL);
+    assert (stream != NULL);
+
+    struct bench_clients clients = {
+        .fds = malloc (count * sizeof (int)), .count = 0,
+        .stop = false, .bytes = 0,
+    };
+    assert (clients.fds != NULL);
+    while (clients.count < count)
+    {
+        int fd = Connect ();
+        if (fd == -1)
+            break;
+        clients.fds[clients.count++] = fd;
+    }
+    assert (clients.count > 0);
+    if (bench)
+        log ("%u clients connected\n", clients.count);
+
+    vlc_thread_t reader;
+    if (vlc_clone (&reader, Reader, &clients, VLC_THREAD_PRIORITY_LOW))
+        abort ();
+
+    block_t *block = block_Alloc (BENCH_BLOCK);
+    assert (block != NULL);
+    memset (block->p_buffer, 0x47, BENCH_BLOCK);
+
+    double cpu = CpuTime ();
+    mtime_t start = mdate ();
+    mtime_t deadline = start;
+
+    for (unsigned i = 0; i < seconds * BENCH_RATE; i++)
+    {
+        httpd_StreamSend (stream, block);
+        deadline += CLOCK_FREQ / BENCH_RATE;
+        mwait (deadline);
+    }
+
+    mtime_t elapsed = mdate () - start;
+    cpu = CpuTime () - cpu;
+    clients.stop = true;
+    vlc_join (reader, NULL);
+
+    uint64_t sent = (uint64_t)seconds * BENCH_RATE * BENCH_BLOCK;
+    assert (clients.bytes > 0);
+    if (bench)
+    {
+        log ("sent %"PRIu64" bytes to %u clients in %"PRId64" ms\n",
+             sent, clients.count, elapsed / 1000);
+        log ("received %"PRIu64" bytes (%.1f%% of the stream per client)\n",
+             clients.bytes, 100. * clients.bytes / (sent * clients.count));
+        log ("CPU time, clients included: %.3f s (%.1f%% of one core)\n",
+             cpu, 100. * cpu * CLOCK_FREQ / elapsed);
+    }
+
+    /* Reset the clients while the server waits for stream data: the
+     * hang-ups must not keep the server thread busy */
+    for (unsigned i = 0; i < clients.count; i++)
+    {
+        struct linger l = { .l_onoff = 1, .l_linger = 0 };
+
+        setsockopt (clients.fds[i], SOL_SOCKET, SO_LINGER, &l, sizeof (l));
+        close (clients.fds[i]);
+    }
+
+    msleep (CLOCK_FREQ / 10);
+    cpu = CpuTime ();
+    start = mdate ();
+    msleep (CLOCK_FREQ / 2);
+    cpu = CpuTime () - cpu;
+    elapsed = mdate () - start;
+    if (bench)
+        log ("CPU time after the resets: %.3f s\n", cpu);
+    assert (cpu * CLOCK_FREQ < elapsed / 2);
+
+    free (clients.fds);
+    block_Release (block);
+    httpd_StreamDelete (stream);
+    httpd_HostDelete (host);
+    libvlc_release (vlc);
+    return 0;
+}
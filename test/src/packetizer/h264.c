@@ -0,0 +1,433 @@
+/*****************************************************************************
+ * h264.c: H.264 packetizer test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Packetizes a generated 25 fps, 50 Mbit/s H.264 stream, in Annex B format
+ * split as the TS demux does (one block per frame) and at random sizes, and
+ * in avcC format, and checks the access units against the expected ones.
+ * With VLC_TEST_BENCH set, also reports the CPU time and the memory
+ * allocations per frame, of 10 seconds of stream by default.
+ * Usage: test_src_packetizer_h264 [frames] */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_codec.h>
+#include <vlc_modules.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAME_SIZE (50000000 / 8 / 25)
+#define GOP_SIZE   25
+
+/* Allocation counter, with the glibc allocator */
+static unsigned long allocs;
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t);
+extern void *__libc_calloc (size_t, size_t);
+extern void *__libc_realloc (void *, size_t);
+
+void *malloc (size_t size)
+{
+    allocs++;
+    return __libc_malloc (size);
+}
+
+void *calloc (size_t n, size_t size)
+{
+    allocs++;
+    return __libc_calloc (n, size);
+}
+
+void *realloc (void *ptr, size_t size)
+{
+    allocs++;
+    return __libc_realloc (ptr, size);
+}
+#endif
+
+typedef struct
+{
+    uint8_t *data;
+    size_t   size, max;
+} buffer_t;
+
+static void Append (buffer_t *b, const void *data, size_t size)
+{
+    if (b->size + size > b->max)
+    {
+        b->max = 2 * (b->size + size);
+        b->data = realloc (b->data, b->max);
+        assert (b->data != NULL);
+    }
+    memcpy (b->data + b->size, data, size);
+    b->size += size;
+}
+
+/* RBSP writer */
+typedef struct
+{
+    uint8_t buf[64];
+    unsigned bits;
+} bits_t;
+
+static void PutBits (bits_t *w, uint32_t value, unsigned n)
+{
+    while (n-- > 0)
+    {
+        if ((value >> n) & 1)
+            w->buf[w->bits / 8] |= 0x80 >> (w->bits % 8);
+        w->bits++;
+    }
+}
+
+static void PutUE (bits_t *w, uint32_t value)
+{
+    unsigned n = 0;
+
+    value++;
+    while ((value >> n) > 1)
+        n++;
+    PutBits (w, 0, n);
+    PutBits (w, value, n + 1);
+}
+
+static size_t PutTrailing (bits_t *w)
+{
+    PutBits (w, 1, 1);
+    while (w->bits % 8)
+        PutBits (w, 0, 1);
+    return w->bits / 8;
+}
+
+/* Appends a NAL with emulation prevention bytes, after a 3 or 4 bytes start
+ * code or a 4 bytes size */
+enum { ANNEXB3, ANNEXB4, AVCC };
+
+static void PutNAL (buffer_t *b, int mode, uint8_t header,
+                    const uint8_t *rbsp, size_t size)
+{
+    static const uint8_t startcode[4] = { 0, 0, 0, 1 };
+    size_t start = b->size;
+    unsigned zeros = 0;
+
+    if (mode == ANNEXB3)
+        Append (b, startcode + 1, 3);
+    else
+        Append (b, startcode, 4);
+    Append (b, &header, 1);
+    for (size_t i = 0; i < size; i++)
+    {
+        if (zeros >= 2 && rbsp[i] <= 3)
+        {
+            Append (b, "\x03", 1);
+            zeros = 0;
+        }
+        Append (b, &rbsp[i], 1);
+        zeros = rbsp[i] ? 0 : zeros + 1;
+    }
+
+    if (mode == AVCC)
+    {
+        uint32_t len = b->size - start - 4;
+        b->data[start] = len >> 24;
+        b->data[start + 1] = len >> 16;
+        b->data[start + 2] = len >> 8;
+        b->data[start + 3] = len;
+    }
+}
+
+typedef struct
+{
+    buffer_t input;        /**< elementary stream */
+    size_t  *input_ends;   /**< end of each frame in the input */
+    buffer_t expected;     /**< access units with 4 bytes start codes */
+    size_t  *expected_ends;
+    uint32_t *flags;
+    uint8_t  extra[128];   /**< avcC */
+    size_t   extra_size;
+    unsigned frames;
+} sample_t;
+
+/* 1920x1088 main profile, with IDR, P and non-reference B frames, each with
+ * an access unit delimiter, a SEI and the given number of slices */
+static void Generate (sample_t *st, unsigned frames, unsigned slices, bool avcc)
+{
+    uint8_t sps[32], pps[32];
+    size_t sps_size, pps_size;
+    bits_t w;
+
+    memset (st, 0, sizeof (*st));
+    st->frames = frames;
+    st->input_ends = malloc (frames * sizeof (size_t));
+    st->expected_ends = malloc (frames * sizeof (size_t));
+    st->flags = malloc (frames * sizeof (uint32_t));
+    assert (st->input_ends && st->expected_ends && st->flags);
+
+    memset (&w, 0, sizeof (w));
+    PutBits (&w, 77, 8); /* profile */
+    PutBits (&w, 0, 8);
+    PutBits (&w, 40, 8); /* level */
+    PutUE (&w, 0); /* sps_id */
+    PutUE (&w, 0); /* log2_max_frame_num - 4 */
+    PutUE (&w, 0); /* pic_order_cnt_type */
+    PutUE (&w, 2); /* log2_max_pic_order_cnt_lsb - 4 */
+    PutUE (&w, 1); /* num_ref_frames */
+    PutBits (&w, 0, 1);
+    PutUE (&w, 119);
+    PutUE (&w, 67);
+    PutBits (&w, 1, 1); /* frame_mbs_only */
+    PutBits (&w, 1, 1);
+    PutBits (&w, 0, 1);
+    PutBits (&w, 0, 1); /* vui */
+    sps_size = PutTrailing (&w);
+    memcpy (sps, w.buf, sps_size);
+
+    memset (&w, 0, sizeof (w));
+    PutUE (&w, 0); /* pps_id */
+    PutUE (&w, 0); /* sps_id */
+    PutBits (&w, 0, 2);
+    PutUE (&w, 0);
+    PutUE (&w, 0);
+    PutUE (&w, 0);
+    pps_size = PutTrailing (&w);
+    memcpy (pps, w.buf, pps_size);
+
+    if (avcc)
+    {
+        uint8_t *p = st->extra;
+
+        *p++ = 1; *p++ = 77; *p++ = 0; *p++ = 40; *p++ = 0xff; *p++ = 0xe1;
+        *p++ = 0; *p++ = sps_size + 1; *p++ = 0x67;
+        memcpy (p, sps, sps_size);
+        p += sps_size;
+        *p++ = 1;
+        *p++ = 0; *p++ = pps_size + 1; *p++ = 0x68;
+        memcpy (p, pps, pps_size);
+        p += pps_size;
+        st->extra_size = p - st->extra;
+    }
+
+    const size_t slice_size = FRAME_SIZE / slices;
+    uint8_t *payload = malloc (slice_size);
+    assert (payload != NULL);
+
+    for (unsigned f = 0; f < frames; f++)
+    {
+        const bool idr = (f % GOP_SIZE) == 0;
+        const bool b = !idr && (f % 3) == 1;
+        const int mode = avcc ? AVCC : (rand () & 1) ? ANNEXB3 : ANNEXB4;
+        static const uint8_t aud = 0xf0;
+        uint8_t sei[24] = { 5, 20 }; /* user data unregistered */
+
+        for (unsigned i = 2; i < 22; i++)
+            sei[i] = rand ();
+        sei[22] = 0x80;
+
+        PutNAL (&st->input, mode, 0x09, &aud, 1);
+        PutNAL (&st->expected, ANNEXB4, 0x09, &aud, 1);
+        if (idr)
+        {
+            if (!avcc)
+            {
+                PutNAL (&st->input, ANNEXB4, 0x67, sps, sps_size);
+                PutNAL (&st->input, mode, 0x68, pps, pps_size);
+            }
+            PutNAL (&st->expected, ANNEXB4, 0x67, sps, sps_size);
+            PutNAL (&st->expected, ANNEXB4, 0x68, pps, pps_size);
+        }
+        PutNAL (&st->input, mode, 0x06, sei, 23);
+        PutNAL (&st->expected, ANNEXB4, 0x06, sei, 23);
+
+        for (unsigned s = 0; s < slices; s++)
+        {
+            const uint8_t header = idr ? 0x65 : b ? 0x01 : 0x41;
+
+            memset (&w, 0, sizeof (w));
+            PutUE (&w, s * 8160 / slices); /* first_mb_in_slice */
+            PutUE (&w, idr ? 7 : b ? 6 : 5); /* slice_type */
+            PutUE (&w, 0); /* pps_id */
+            PutBits (&w, f, 4); /* frame_num */
+            if (idr)
+                PutUE (&w, (f / GOP_SIZE) & 1); /* idr_pic_id */
+            PutBits (&w, 2 * f, 6); /* pic_order_cnt_lsb */
+
+            size_t header_size = (w.bits + 7) / 8;
+            memcpy (payload, w.buf, header_size);
+            for (size_t i = header_size; i < slice_size - 1; i++)
+            {
+                int r = rand ();
+                payload[i] = (r & 0x700) ? r : 0;
+            }
+            payload[slice_size - 1] = 0x80;
+
+            PutNAL (&st->input, mode, header, payload, slice_size);
+            PutNAL (&st->expected, ANNEXB4, header, payload, slice_size);
+            if (!avcc && (rand () % 4) == 0) /* trailing_zero_8bits */
+                Append (&st->input, "\0\0", 1 + rand () % 2);
+        }
+        st->input_ends[f] = st->input.size;
+        st->expected_ends[f] = st->expected.size;
+        st->flags[f] = idr ? BLOCK_FLAG_TYPE_I
+                     : b ? BLOCK_FLAG_TYPE_B : BLOCK_FLAG_TYPE_P;
+    }
+    free (payload);
+}
+
+static void Clean (sample_t *st)
+{
+    free (st->input.data);
+    free (st->input_ends);
+    free (st->expected.data);
+    free (st->expected_ends);
+    free (st->flags);
+}
+
+static void Check (const sample_t *st, unsigned f, const block_t *au)
+{
+    size_t start = f ? st->expected_ends[f - 1] : 0;
+
+    assert (au->i_buffer == st->expected_ends[f] - start);
+    assert (!memcmp (au->p_buffer, st->expected.data + start, au->i_buffer));
+    assert (au->i_dts == VLC_TS_0 + f * CLOCK_FREQ / 25);
+    assert (au->i_pts == au->i_dts + 2 * CLOCK_FREQ / 25);
+    assert ((au->i_flags & BLOCK_FLAG_TYPE_MASK) == st->flags[f]);
+    assert (!(au->i_flags & BLOCK_FLAG_PREROLL));
+}
+
+/* Packetizes the stream, with one block per frame or blocks of random
+ * sizes */
+static void Run (vlc_object_t *obj, const char *desc, const sample_t *st,
+                 bool avcc, bool random_blocks)
+{
+    decoder_t *dec = vlc_object_create (obj, sizeof (*dec));
+    assert (dec != NULL);
+
+    es_format_Init (&dec->fmt_in, VIDEO_ES, VLC_CODEC_H264);
+    if (avcc)
+    {
+        dec->fmt_in.i_original_fourcc = VLC_FOURCC('a', 'v', 'c', '1');
+        dec->fmt_in.i_extra = st->extra_size;
+        dec->fmt_in.p_extra = malloc (st->extra_size);
+        assert (dec->fmt_in.p_extra != NULL);
+        memcpy (dec->fmt_in.p_extra, st->extra, st->extra_size);
+    }
+    es_format_Init (&dec->fmt_out, VIDEO_ES, 0);
+
+    dec->p_module = module_need (dec, "packetizer", "h264", true);
+    assert (dec->p_module != NULL);
+
+    unsigned frames = 0, f = 0;
+    unsigned long allocations = 0;
+    clock_t cpu = 0;
+
+    srand (7);
+    for (size_t pos = 0; pos < st->input.size;)
+    {
+        size_t size = st->input_ends[f] - pos;
+        bool first = pos == (f ? st->input_ends[f - 1] : 0);
+
+        if (random_blocks && size > 1)
+            size = 1 + rand () % __MIN(size, 8192);
+
+        block_t *block = block_Alloc (size);
+        assert (block != NULL);
+        memcpy (block->p_buffer, st->input.data + pos, size);
+        block->i_dts = block->i_pts = VLC_TS_INVALID;
+        if (first)
+        {   /* Like a PES header */
+            block->i_dts = VLC_TS_0 + f * CLOCK_FREQ / 25;
+            block->i_pts = block->i_dts + 2 * CLOCK_FREQ / 25;
+        }
+        pos += size;
+        if (pos == st->input_ends[f])
+            f++;
+
+        for (;;)
+        {
+            unsigned long count = allocs;
+            clock_t start = clock ();
+            block_t *au = dec->pf_packetize (dec, &block);
+            cpu += clock () - start;
+            allocations += allocs - count;
+
+            if (au == NULL)
+                break;
+            assert (au->p_next == NULL);
+            Check (st, frames++, au);
+            block_Release (au);
+        }
+    }
+
+    /* The last access unit ends with the next one */
+    assert (frames == st->frames - 1);
+    if (test_bench ())
+        log ("%-24s %7.1f us, %5.1f allocations per frame\n", desc,
+             1e6 * cpu / CLOCKS_PER_SEC / frames,
+             (double)allocations / frames);
+
+    module_unneed (dec, dec->p_module);
+    es_format_Clean (&dec->fmt_in);
+    es_format_Clean (&dec->fmt_out);
+    vlc_object_release (dec);
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned frames = (argc > 1) ? atoi (argv[1]) : test_bench () ? 250 : 50;
+    const char *args[] = {
+        "--ignore-config",
+        "-I",
+        "dummy",
+    };
+
+    test_init ();
+
+    libvlc_instance_t *vlc = libvlc_new (sizeof (args) / sizeof (args[0]),
+                                         args);
+    assert (vlc != NULL);
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+#ifndef __GLIBC__
+    if (test_bench ())
+        log ("allocations are not counted\n");
+#endif
+    for (unsigned slices = 1; slices <= 8; slices *= 8)
+    {
+        sample_t st;
+
+        log ("%u frames, %u slice(s) per frame\n", frames, slices);
+        srand (slices);
+        Generate (&st, frames, slices, false);
+        Run (obj, "Annex B, frame blocks", &st, false, false);
+        Run (obj, "Annex B, random blocks", &st, false, true);
+        Clean (&st);
+
+        Generate (&st, frames, slices, true);
+        Run (obj, "avcC", &st, true, false);
+        Clean (&st);
+    }
+
+    libvlc_release (vlc);
+    return 0;
+}
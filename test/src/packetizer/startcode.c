@@ -0,0 +1,288 @@
+/*****************************************************************************
+ * startcode.c: start code search test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Checks the vectorized 00 00 01 searches against a byte per byte one, and
+ * the bytestream search with and without them across block boundaries.
+ * Then reports the MB/s of each on elementary streams: the given files, or
+ * with VLC_TEST_BENCH set, a generated intra-only-like stream.
+ * Usage: test_src_packetizer_startcode [elementary stream files] */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_block_helper.h>
+
+#include "../../../modules/packetizer/startcode_helper.h"
+
+#define STREAM_SIZE (32 << 20)
+
+static const uint8_t startcode[3] = { 0x00, 0x00, 0x01 };
+
+static const struct
+{
+    const char *name;
+    block_startcode_helper_t find;
+} finders[] = {
+    { "C", startcode_FindAnnexB_C },
+#ifdef STARTCODE_HELPER_SIMD
+# if defined(__i386__) || defined(__x86_64__)
+    { "SSE2", startcode_FindAnnexB_SSE2 },
+    { "AVX2", startcode_FindAnnexB_AVX2 },
+# else
+    { "NEON", startcode_FindAnnexB_NEON },
+# endif
+#endif
+    { "auto", startcode_FindAnnexB },
+};
+#define FINDERS (sizeof (finders) / sizeof (finders[0]))
+
+static bool Supported(const char *name)
+{
+#if defined(STARTCODE_HELPER_SIMD) && (defined(__i386__) || defined(__x86_64__))
+    if (!strcmp(name, "SSE2"))
+        return vlc_CPU_SSE2();
+    if (!strcmp(name, "AVX2"))
+        return vlc_CPU_AVX2();
+#endif
+    (void) name;
+    return true;
+}
+
+/* Mostly zeroes and ones, to have many partial and overlapping matches */
+static void FillDense(uint8_t *buf, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        unsigned r = rand() % 8;
+        buf[i] = r < 5 ? 0 : r < 7 ? 1 : rand();
+    }
+}
+
+/* Entropy-coded like payload with emulation prevention, and a start code
+ * every slice_size bytes */
+static void FillStream(uint8_t *buf, size_t size, size_t slice_size)
+{
+    unsigned zeros = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        uint8_t b = rand();
+
+        if (i % slice_size < 3)
+            b = startcode[i % slice_size];
+        else if (zeros >= 2 && b <= 3)
+            b = 3;
+        zeros = b ? 0 : zeros + 1;
+        buf[i] = b;
+    }
+}
+
+static void test_finders(void)
+{
+    enum { SIZE = 4096 };
+    uint8_t *buf = malloc(SIZE);
+    assert(buf != NULL);
+
+    printf("Testing the searches on buffers\n");
+    srand(42);
+    for (unsigned run = 0; run < 64; run++)
+    {
+        if (run & 1)
+            FillDense(buf, SIZE);
+        else
+            FillStream(buf, SIZE, 1 + rand() % 200);
+
+        for (size_t start = 0; start < 80; start++)
+            for (size_t end = start; end <= SIZE; end += end < 200 ? 1 : 97)
+            {
+                const uint8_t *ref = startcode_FindAnnexB_Bytes(buf + start,
+                                                                buf + end);
+
+                for (unsigned f = 0; f < FINDERS; f++)
+                    if (Supported(finders[f].name))
+                        assert(finders[f].find(buf + start, buf + end) == ref);
+            }
+    }
+    free(buf);
+}
+
+/* Finds all the start codes of a stream split in blocks */
+static size_t FindAll(const uint8_t *data, size_t size, size_t block_size,
+                      block_startcode_helper_t helper, size_t *offsets,
+                      size_t max)
+{
+    block_bytestream_t bs;
+    block_t *chain = NULL, **last = &chain;
+    size_t count = 0, base = 0, offset = 0;
+
+    for (size_t pos = 0; pos < size; )
+    {
+        size_t len = block_size ? block_size : 1 + rand() % 300;
+        if (len > size - pos)
+            len = size - pos;
+
+        block_t *block = block_Alloc(len);
+        assert(block != NULL);
+        memcpy(block->p_buffer, data + pos, len);
+        block_ChainLastAppend(&last, block);
+        pos += len;
+    }
+    block_BytestreamInit(&bs);
+    block_BytestreamPush(&bs, chain);
+
+    /* Drop the data before each start code like the packetizers do */
+    while (!block_FindStartcodeFromOffsetHelper(&bs, &offset, startcode, 3,
+                                                helper))
+    {
+        if (offsets != NULL)
+        {
+            assert(count < max);
+            offsets[count] = base + offset;
+        }
+        count++;
+        block_SkipBytes(&bs, offset);
+        block_BytestreamFlush(&bs);
+        base += offset;
+        offset = 1;
+    }
+    block_BytestreamRelease(&bs);
+    return count;
+}
+
+static void test_chains(void)
+{
+    enum { SIZE = 65536, MAX = SIZE / 3 };
+    uint8_t *buf = malloc(SIZE);
+    size_t *ref = malloc(MAX * sizeof (*ref));
+    size_t *out = malloc(MAX * sizeof (*out));
+    assert(buf != NULL && ref != NULL && out != NULL);
+
+    printf("Testing the searches across blocks\n");
+    for (unsigned run = 0; run < 16; run++)
+    {
+        if (run & 1)
+            FillDense(buf, SIZE);
+        else
+            FillStream(buf, SIZE, 1 + rand() % 500);
+
+        size_t count = 0;
+        for (const uint8_t *p = buf;
+             (p = startcode_FindAnnexB_Bytes(p, buf + SIZE)) != NULL; p++)
+            ref[count++] = p - buf;
+
+        /* Random block sizes, and 1 to 4 bytes blocks */
+        for (size_t block_size = 0; block_size <= 4; block_size++)
+        {
+            assert(FindAll(buf, SIZE, block_size, NULL, out, MAX) == count);
+            assert(!memcmp(out, ref, count * sizeof (*ref)));
+            assert(FindAll(buf, SIZE, block_size, startcode_FindAnnexB,
+                           out, MAX) == count);
+            assert(!memcmp(out, ref, count * sizeof (*ref)));
+        }
+    }
+    free(out);
+    free(ref);
+    free(buf);
+}
+
+static void Bench(const char *name, const uint8_t *data, size_t size)
+{
+    size_t count = 0;
+
+    printf("%s: %zu bytes\n", name, size);
+    for (unsigned f = 0; f < FINDERS; f++)
+    {
+        if (!Supported(finders[f].name))
+            continue;
+
+        mtime_t start = mdate();
+        count = 0;
+        for (const uint8_t *p = data;
+             (p = finders[f].find(p, data + size)) != NULL; p++)
+            count++;
+        mtime_t elapsed = mdate() - start;
+        printf("  %-6s %8.1f MB/s\n", finders[f].name,
+               (double)size / (elapsed ? elapsed : 1));
+    }
+
+    /* Through the bytestream, with the blocks of a TS demuxer */
+    mtime_t start = mdate();
+    assert(FindAll(data, size, 7 * 188, NULL, NULL, 0) == count);
+    mtime_t elapsed = mdate() - start;
+    printf("  %-20s %8.1f MB/s\n", "blocks, byte per byte",
+           (double)size / (elapsed ? elapsed : 1));
+
+    start = mdate();
+    assert(FindAll(data, size, 7 * 188, startcode_FindAnnexB, NULL, 0)
+           == count);
+    elapsed = mdate() - start;
+    printf("  %-20s %8.1f MB/s\n", "blocks, helper",
+           (double)size / (elapsed ? elapsed : 1));
+    printf("  %zu start codes\n", count);
+}
+
+static void BenchFile(const char *path)
+{
+    FILE *stream = fopen(path, "rb");
+    if (stream == NULL)
+    {
+        perror(path);
+        return;
+    }
+
+    uint8_t *data = malloc(STREAM_SIZE);
+    assert(data != NULL);
+    size_t size = fread(data, 1, STREAM_SIZE, stream);
+    fclose(stream);
+    Bench(path, data, size);
+    free(data);
+}
+
+int main(int argc, char *argv[])
+{
+    test_finders();
+    test_chains();
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+            BenchFile(argv[i]);
+        return 0;
+    }
+
+    if (getenv("VLC_TEST_BENCH") == NULL)
+        return 0;
+
+    uint8_t *data = malloc(STREAM_SIZE);
+    assert(data != NULL);
+    FillStream(data, STREAM_SIZE, 150000); /* ~ 1 slice per 1080p frame */
+    Bench("generated intra stream", data, STREAM_SIZE);
+    free(data);
+    return 0;
+}
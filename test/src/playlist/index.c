@@ -0,0 +1,272 @@
+/*****************************************************************************
+ * index.c: playlist index test
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Checks that the index finds the items of input items, and that its live
+ * search candidates include all the items that match, against a linear
+ * search. With VLC_TEST_BENCH set, also compares the time both take.
+ * Usage: test_src_playlist_index [items] */
+
+#include "../../libvlc/test.h"
+
+#include <vlc_common.h>
+#include <vlc_charset.h>
+#include <vlc_input_item.h>
+#include <vlc_meta.h>
+#include <vlc_playlist.h>
+
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../../src/playlist/index.c"
+
+static const char *const words[] = {
+    "love", "night", "dance", "blue", "Héros", "river", "ÉTÉ", "fire",
+    "Straße", "moon", "rain", "city", "gold", "dream", "Ökonomie", "song",
+};
+#define WORDS (sizeof (words) / sizeof (words[0]))
+
+static const char *const searches[] = {
+    "lov", "love", "NIGHT", "héro", "HÉROS", "été", "STRASSE", "straße",
+    "moon rai", "ity g", "ökon", "xyz", "song 1", "e 7", "ream s",
+};
+
+static unsigned rnd = 1;
+
+static unsigned Rand (void)
+{
+    rnd = rnd * 1103515245 + 12345;
+    return (rnd >> 16) & 0x7fff;
+}
+
+static input_item_t *NewInput (unsigned i)
+{
+    char name[128];
+
+    snprintf (name, sizeof (name), "%s %s %u", words[Rand () % WORDS],
+              words[Rand () % WORDS], i);
+
+    input_item_t *input = input_item_NewWithType ("file:///dev/null", name,
+                                                  0, NULL, 0, -1,
+                                                  ITEM_TYPE_FILE);
+    assert (input != NULL);
+    if (i % 3 == 0)
+    {
+        input_item_SetArtist (input, words[Rand () % WORDS]);
+        input_item_SetAlbum (input, words[Rand () % WORDS]);
+    }
+    if (i % 5 == 0)
+        input_item_SetTitle (input, words[Rand () % WORDS]);
+    return input;
+}
+
+/* Same as the playlist live search */
+static bool Match (playlist_item_t *item, const char *str)
+{
+    input_item_t *input = item->p_input;
+    bool match;
+
+    vlc_mutex_lock (&input->lock);
+    if (input->p_meta != NULL)
+    {
+        const char *title = vlc_meta_Get (input->p_meta, vlc_meta_Title);
+        const char *album = vlc_meta_Get (input->p_meta, vlc_meta_Album);
+        const char *artist = vlc_meta_Get (input->p_meta, vlc_meta_Artist);
+
+        if (title == NULL)
+            title = input->psz_name;
+        match = (title != NULL && vlc_strcasestr (title, str) != NULL)
+             || (album != NULL && vlc_strcasestr (album, str) != NULL)
+             || (artist != NULL && vlc_strcasestr (artist, str) != NULL);
+    }
+    else
+        match = input->psz_name != NULL
+             && vlc_strcasestr (input->psz_name, str) != NULL;
+    vlc_mutex_unlock (&input->lock);
+    return match;
+}
+
+static bool Has (playlist_item_t **cands, ssize_t n, playlist_item_t *item)
+{
+    for (ssize_t i = 0; i < n; i++)
+        if (cands[i] == item)
+            return true;
+    return false;
+}
+
+/* Checks the candidates against a linear search, and returns the matches */
+static size_t Check (playlist_index_t *index, playlist_item_t *items,
+                     unsigned count, const char *str)
+{
+    playlist_item_t **cands;
+    ssize_t n = playlist_index_Search (index, str, &cands);
+    size_t matches = 0;
+
+    assert (n >= 0);
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (items[i].p_input == NULL) /* removed */
+        {
+            assert (!Has (cands, n, &items[i]));
+            continue;
+        }
+        if (Match (&items[i], str))
+        {
+            assert (Has (cands, n, &items[i]));
+            matches++;
+        }
+    }
+    free (cands);
+    return matches;
+}
+
+static double Elapsed (const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec)
+         + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void Bench (playlist_index_t *index, playlist_item_t *items,
+                   unsigned count)
+{
+    struct timespec start;
+    size_t sum = 0;
+    double linear, indexed;
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    for (size_t s = 0; s < ARRAY_SIZE(searches); s++)
+        for (unsigned i = 0; i < count; i++)
+            if (items[i].p_input != NULL)
+                sum += Match (&items[i], searches[s]);
+    linear = Elapsed (&start);
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    for (size_t s = 0; s < ARRAY_SIZE(searches); s++)
+    {
+        playlist_item_t **cands;
+        ssize_t n = playlist_index_Search (index, searches[s], &cands);
+
+        for (ssize_t i = 0; i < n; i++)
+            sum -= Match (cands[i], searches[s]);
+        free (cands);
+    }
+    indexed = Elapsed (&start);
+    assert (sum == 0);
+
+    log ("%u items, %zu searches: linear %.2f ms, indexed %.2f ms\n", count,
+         ARRAY_SIZE(searches), linear * 1e3, indexed * 1e3);
+}
+
+static void test_index (unsigned count)
+{
+    playlist_index_t *index = playlist_index_New ();
+    playlist_item_t *items = calloc (count, sizeof (*items));
+    assert (index != NULL && items != NULL);
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        items[i].p_input = NewInput (i);
+        items[i].i_id = i;
+        playlist_index_Add (index, &items[i]);
+    }
+
+    /* Input items */
+    bool found;
+    for (unsigned i = 0; i < count; i++)
+    {
+        assert (playlist_index_Find (index, items[i].p_input, &found)
+                == &items[i]);
+        assert (found);
+    }
+    input_item_t *other = NewInput (count);
+    assert (playlist_index_Find (index, other, &found) == NULL && found);
+
+    /* Live search */
+    log ("Checking the search candidates\n");
+    for (size_t s = 0; s < ARRAY_SIZE(searches); s++)
+    {
+        size_t matches = Check (index, items, count, searches[s]);
+        log ("\"%s\": %zu matches\n", searches[s], matches);
+    }
+
+    playlist_item_t **cands;
+    assert (playlist_index_Search (index, "lo", &cands) == -1); /* too short */
+
+    /* Changes */
+    log ("Checking changes\n");
+    input_item_SetName (items[1].p_input, "Zyzzyva");
+    playlist_index_Changed (index, &items[1]);
+    input_item_SetArtist (items[2].p_input, "Qwertz");
+    playlist_index_Changed (index, &items[2]);
+    assert (Check (index, items, count, "zyzz") == 1);
+    assert (Check (index, items, count, "wert") == 1);
+    assert (Check (index, items, count, "night 1") > 0);
+
+    /* Removal, also with pending changes */
+    log ("Checking removal\n");
+    for (unsigned i = 0; i < count; i += 2)
+    {
+        if (i % 4 == 0)
+            playlist_index_Changed (index, &items[i]);
+        playlist_index_Remove (index, &items[i]);
+        assert (playlist_index_Find (index, items[i].p_input, &found) == NULL);
+        input_item_Release (items[i].p_input);
+        items[i].p_input = NULL;
+    }
+    for (size_t s = 0; s < ARRAY_SIZE(searches); s++)
+        Check (index, items, count, searches[s]);
+    assert (Check (index, items, count, "zyzz") == 1);
+
+    /* Items with the same input item */
+    playlist_item_t twin = items[1];
+    playlist_index_Add (index, &twin);
+    playlist_index_Remove (index, &items[1]);
+    assert (playlist_index_Find (index, twin.p_input, &found) == &twin);
+    playlist_index_Add (index, &items[1]);
+    playlist_index_Remove (index, &twin);
+    assert (playlist_index_Find (index, twin.p_input, &found) == &items[1]);
+
+    if (test_bench ())
+        Bench (index, items, count);
+
+    input_item_Release (other);
+    for (unsigned i = 0; i < count; i++)
+        if (items[i].p_input != NULL)
+            input_item_Release (items[i].p_input);
+    playlist_index_Delete (index);
+    free (items);
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned count = (argc > 1) ? strtoul (argv[1], NULL, 0) : 20000;
+
+    test_init ();
+    setlocale (LC_CTYPE, ""); /* like the VLC program, for towlower() */
+
+    /* The index works on the playlist item structures alone. */
+    log ("Testing the playlist index\n");
+    test_index (count);
+    return 0;
+}
@@ -0,0 +1,266 @@
+/*****************************************************************************
+ * metacache.c: preparsing results cache test
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Stores items in the cache, reads them back from another cache of the same
+ * file, and checks that changed files, old versions, corrupted files and
+ * evicted entries are not used. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_input_item.h>
+#include <vlc_meta.h>
+#include <vlc_url.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../../../src/playlist/metacache.c"
+
+/* Not exported by libvlccore: same as src/input/item.c */
+void input_item_UpdateTracksInfo (input_item_t *item, const es_format_t *fmt)
+{
+    es_format_t *copy = malloc (sizeof (*copy));
+    assert (copy != NULL);
+    es_format_Copy (copy, fmt);
+    vlc_mutex_lock (&item->lock);
+    TAB_APPEND (item->i_es, item->es, copy);
+    vlc_mutex_unlock (&item->lock);
+}
+
+static char dir[] = "/tmp/vlc-metacache-XXXXXX";
+static char cache_path[64];
+
+static void WriteFile (unsigned i, const char *data)
+{
+    char path[64];
+
+    snprintf (path, sizeof (path), "%s/%u.ogg", dir, i);
+    FILE *file = fopen (path, "ab");
+    assert (file != NULL);
+    fputs (data, file);
+    fclose (file);
+}
+
+static input_item_t *NewItem (unsigned i)
+{
+    char path[64];
+
+    snprintf (path, sizeof (path), "%s/%u.ogg", dir, i);
+    char *uri = vlc_path2uri (path, NULL);
+    assert (uri != NULL);
+    input_item_t *item = input_item_NewWithType (uri, path, 0, NULL, 0, -1,
+                                                 ITEM_TYPE_FILE);
+    assert (item != NULL);
+    free (uri);
+    return item;
+}
+
+/* Fills an item like a preparsing would */
+static input_item_t *PreparsedItem (unsigned i)
+{
+    input_item_t *item = NewItem (i);
+    es_format_t fmt;
+
+    es_format_Init (&fmt, AUDIO_ES, VLC_CODEC_VORBIS);
+    fmt.i_id = 0;
+    fmt.audio.i_rate = 44100;
+    fmt.audio.i_channels = 2;
+    fmt.psz_language = strdup ("fra");
+    input_item_UpdateTracksInfo (item, &fmt);
+    es_format_Clean (&fmt);
+
+    es_format_Init (&fmt, VIDEO_ES, VLC_CODEC_THEORA);
+    fmt.i_id = 1;
+    fmt.video.i_width = 1280;
+    fmt.video.i_height = 720;
+    fmt.i_extra = 4;
+    fmt.p_extra = strdup ("xxx");
+    input_item_UpdateTracksInfo (item, &fmt);
+    es_format_Clean (&fmt);
+
+    input_item_SetDuration (item, (i + 1) * CLOCK_FREQ);
+    input_item_SetTitle (item, "Title");
+    input_item_SetArtist (item, "Artiste été");
+    input_item_SetArtURL (item, "attachment://cover.jpg");
+    vlc_mutex_lock (&item->lock);
+    vlc_meta_AddExtra (item->p_meta, "REPLAYGAIN_TRACK_GAIN", "-3.5 dB");
+    vlc_mutex_unlock (&item->lock);
+    return item;
+}
+
+static bool Cached (playlist_metacache_t *cache, unsigned i)
+{
+    input_item_t *item = NewItem (i);
+    bool cached = playlist_metacache_Get (cache, item) == VLC_SUCCESS;
+
+    if (cached)
+    {
+        assert (input_item_GetDuration (item) == (i + 1) * CLOCK_FREQ);
+        assert (item->i_es == 2);
+        assert (item->es[0]->i_cat == AUDIO_ES);
+        assert (item->es[0]->i_codec == VLC_CODEC_VORBIS);
+        assert (item->es[0]->audio.i_rate == 44100);
+        assert (item->es[0]->audio.i_channels == 2);
+        assert (!strcmp (item->es[0]->psz_language, "fra"));
+        assert (item->es[1]->i_cat == VIDEO_ES);
+        assert (item->es[1]->video.i_width == 1280);
+        assert (item->es[1]->video.i_height == 720);
+        assert (item->es[1]->i_extra == 0);
+
+        char *title = input_item_GetTitle (item);
+        char *artist = input_item_GetArtist (item);
+        char *art = input_item_GetArtURL (item);
+        assert (title != NULL && !strcmp (title, "Title"));
+        assert (artist != NULL && !strcmp (artist, "Artiste été"));
+        assert (art == NULL); /* attachments are not cached */
+        free (title);
+        free (artist);
+
+        vlc_mutex_lock (&item->lock);
+        const char *gain = vlc_meta_GetExtra (item->p_meta,
+                                              "REPLAYGAIN_TRACK_GAIN");
+        assert (gain != NULL && !strcmp (gain, "-3.5 dB"));
+        vlc_mutex_unlock (&item->lock);
+    }
+    vlc_gc_decref (item);
+    return cached;
+}
+
+static void Put (playlist_metacache_t *cache, unsigned i)
+{
+    input_item_t *item = PreparsedItem (i);
+    playlist_metacache_Put (cache, item);
+    vlc_gc_decref (item);
+}
+
+static void test_metacache (vlc_object_t *obj)
+{
+    playlist_metacache_t *cache;
+
+    assert (mkdtemp (dir) != NULL);
+    snprintf (cache_path, sizeof (cache_path), "%s/cache/preparse.dat", dir);
+    for (unsigned i = 0; i < 8; i++)
+        WriteFile (i, "OggS");
+
+    log ("Storing and reading back\n");
+    cache = playlist_metacache_New (obj, cache_path, 4);
+    assert (cache != NULL);
+    Put (cache, 0);
+    Put (cache, 1);
+    assert (Cached (cache, 0) && Cached (cache, 1) && !Cached (cache, 2));
+
+    /* Only local files with streams */
+    input_item_t *item = NewItem (2);
+    playlist_metacache_Put (cache, item);
+    vlc_gc_decref (item);
+    assert (!Cached (cache, 2));
+    item = input_item_New ("http://example.com/3.ogg", NULL);
+    playlist_metacache_Put (cache, item);
+    assert (playlist_metacache_Get (cache, item) != VLC_SUCCESS);
+    vlc_gc_decref (item);
+    playlist_metacache_Delete (cache);
+
+    log ("Reading another session\n");
+    cache = playlist_metacache_New (obj, cache_path, 4);
+    assert (Cached (cache, 0) && Cached (cache, 1));
+
+    log ("Checking changed files\n");
+    WriteFile (1, "more data");
+    assert (!Cached (cache, 1));
+    WriteFile (1, ""); /* the entry is gone, not just stale */
+    assert (!Cached (cache, 1));
+
+    log ("Checking the eviction\n");
+    Put (cache, 1);
+    Put (cache, 2);
+    Put (cache, 3);
+    assert (Cached (cache, 0)); /* most recently used */
+    Put (cache, 4);
+    Put (cache, 5);
+    playlist_metacache_Delete (cache);
+    cache = playlist_metacache_New (obj, cache_path, 4);
+    assert (Cached (cache, 0) && !Cached (cache, 1) && !Cached (cache, 2));
+    assert (Cached (cache, 3) && Cached (cache, 4) && Cached (cache, 5));
+    playlist_metacache_Delete (cache);
+
+    log ("Checking a truncated file\n");
+    struct stat st;
+    assert (stat (cache_path, &st) == 0);
+    assert (truncate (cache_path, st.st_size - 10) == 0);
+    cache = playlist_metacache_New (obj, cache_path, 4);
+    unsigned count = 0;
+    for (unsigned i = 0; i < 6; i++)
+        count += Cached (cache, i);
+    assert (count == 3);
+    playlist_metacache_Delete (cache);
+
+    log ("Checking the version\n");
+    FILE *file = fopen (cache_path, "r+b");
+    assert (file != NULL);
+    uint32_t version = METACACHE_VERSION + 1;
+    fseek (file, strlen (METACACHE_STRING), SEEK_SET);
+    fwrite (&version, sizeof (version), 1, file);
+    fclose (file);
+    cache = playlist_metacache_New (obj, cache_path, 4);
+    for (unsigned i = 0; i < 6; i++)
+        assert (!Cached (cache, i));
+
+    log ("Saving while in use\n");
+    Put (cache, 6);
+    playlist_metacache_Save (cache);
+    playlist_metacache_t *other = playlist_metacache_New (obj, cache_path, 4);
+    assert (Cached (other, 6));
+    playlist_metacache_Delete (other);
+    playlist_metacache_Delete (cache);
+
+    for (unsigned i = 0; i < 8; i++)
+    {
+        char path[64];
+        snprintf (path, sizeof (path), "%s/%u.ogg", dir, i);
+        unlink (path);
+    }
+    unlink (cache_path);
+    snprintf (cache_path, sizeof (cache_path), "%s/cache", dir);
+    rmdir (cache_path);
+    rmdir (dir);
+}
+
+int main (void)
+{
+    const char *args[] = {
+        "--ignore-config",
+        "-I",
+        "dummy",
+    };
+
+    test_init ();
+
+    libvlc_instance_t *vlc = libvlc_new (sizeof (args) / sizeof (args[0]),
+                                         args);
+    assert (vlc != NULL);
+
+    log ("Testing the preparsing results cache\n");
+    test_metacache (VLC_OBJECT(vlc->p_libvlc_int));
+
+    libvlc_release (vlc);
+    return 0;
+}
@@ -0,0 +1,324 @@
+/*****************************************************************************
+ * rtpsend.c: RTP sink transmission test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Checks the order and the bounds of the sink backlog on a datagram socket
+ * pair, and the broken connections. With VLC_TEST_BENCH set, also sends
+ * packets to N loopback UDP sinks one send() at a time, in batches, and in
+ * batches from several threads, and reports the packet rates.
+ * Usage: test_src_stream_out_rtpsend [sinks] [packets] */
+
+#include "../../libvlc/test.h"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "../../../modules/stream_out/rtpsend.c"
+
+#define PACKET_SIZE (12 + 7 * 188)
+
+static block_t *NewPacket(unsigned seq)
+{
+    block_t *p = block_Alloc(PACKET_SIZE);
+    assert(p != NULL);
+    memset(p->p_buffer, 0, PACKET_SIZE);
+    p->p_buffer[0] = 0x80;
+    SetDWBE(p->p_buffer + 4, seq);
+    return p;
+}
+
+static void SetNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+/* Receives the pending packets, checking that they are in order if next is
+ * not NULL */
+static unsigned Drain(int fd, unsigned *next)
+{
+    uint8_t buf[PACKET_SIZE];
+    unsigned count = 0;
+    ssize_t len;
+
+    while ((len = recv(fd, buf, sizeof (buf), MSG_DONTWAIT)) >= 0)
+    {
+        assert(len == PACKET_SIZE);
+        if (next != NULL)
+        {
+            unsigned seq = GetDWBE(buf + 4);
+            assert(seq >= *next);
+            *next = seq + 1;
+        }
+        count++;
+    }
+    return count;
+}
+
+static void SendPacketsTo(rtp_sink_t *sink, unsigned first, unsigned count)
+{
+    block_t *pktv[RTP_BATCH_MAX];
+
+    while (count > 0)
+    {
+        unsigned pktc = count < RTP_BATCH_MAX ? count : RTP_BATCH_MAX;
+
+        for (unsigned i = 0; i < pktc; i++)
+            pktv[i] = NewPacket(first + i);
+        assert(rtp_sink_Send(sink, pktv, pktc) == VLC_SUCCESS);
+        for (unsigned i = 0; i < pktc; i++)
+            block_Release(pktv[i]);
+        first += pktc;
+        count -= pktc;
+    }
+}
+
+static void test_backlog(unsigned count)
+{
+    int fds[2];
+    unsigned next = 0, received = 0;
+
+    log("Testing the backlog with %u packets\n", count);
+    assert(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == 0);
+    SetNonBlocking(fds[0]);
+
+    rtp_sink_t sink = { .rtp_fd = fds[0] };
+
+    /* Fills the socket, then the backlog */
+    SendPacketsTo(&sink, 0, count);
+    assert(sink.backlog_count <= RTP_BACKLOG_MAX);
+
+    unsigned queued = sink.backlog_count;
+    while (sink.backlog_count > 0)
+    {
+        received += Drain(fds[1], &next);
+        assert(rtp_sink_Send(&sink, NULL, 0) == VLC_SUCCESS);
+    }
+    received += Drain(fds[1], &next);
+
+    /* Nothing is lost up to the backlog size, the oldest packets are
+     * dropped beyond */
+    assert(next == count);
+    if (count <= RTP_BACKLOG_MAX)
+        assert(received == count);
+    else
+        assert(received >= RTP_BACKLOG_MAX);
+    log(" %u packets queued, %u received\n", queued, received);
+
+    rtp_sink_Clean(&sink);
+    close(fds[1]);
+    close(fds[0]);
+}
+
+static void test_broken(void)
+{
+    int fds[2];
+    block_t *p = NewPacket(0);
+
+    log("Testing a broken connection\n");
+    signal(SIGPIPE, SIG_IGN);
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    close(fds[1]);
+
+    rtp_sink_t sink = { .rtp_fd = fds[0] };
+    assert(rtp_sink_Send(&sink, &p, 1) == VLC_EGENERIC);
+    rtp_sink_Clean(&sink);
+    close(fds[0]);
+    block_Release(p);
+}
+
+/*** Benchmark ***/
+static unsigned sinkc = 64;
+static unsigned packets = 20000;
+static rtp_sink_t *sinkv;
+static int *receivers;
+
+/* Sender threads, handed each batch like in the RTP stream output */
+static vlc_mutex_t lock;
+static vlc_cond_t wait_batch, wait_done;
+static unsigned batch_seq, batch_pending, shardc;
+static block_t *batchv[RTP_BATCH_MAX];
+
+static void SendShard(unsigned index)
+{
+    for (unsigned i = index; i < sinkc; i += shardc)
+        rtp_sink_Send(&sinkv[i], batchv, RTP_BATCH_MAX);
+}
+
+static void *Shard(void *data)
+{
+    unsigned index = (uintptr_t)data, seq = 0;
+
+    for (;;)
+    {
+        vlc_mutex_lock(&lock);
+        while (batch_seq == seq)
+            vlc_cond_wait(&wait_batch, &lock);
+        seq = batch_seq;
+        vlc_mutex_unlock(&lock);
+
+        if (seq == UINT_MAX)
+            break;
+        SendShard(index);
+
+        vlc_mutex_lock(&lock);
+        if (--batch_pending == 0)
+            vlc_cond_signal(&wait_done);
+        vlc_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+/* Sends every packet to every sink, one system call per packet and sink
+ * (threads == 0), or in batches shared among threads */
+static void Bench(const char *desc, unsigned threads)
+{
+    vlc_thread_t th[threads ? threads : 1];
+
+    for (unsigned i = 0; i < RTP_BATCH_MAX; i++)
+        batchv[i] = NewPacket(i);
+    shardc = threads;
+    batch_seq = 0;
+    for (unsigned i = 1; i < threads; i++)
+        assert(vlc_clone(&th[i], Shard, (void *)(uintptr_t)i,
+                         VLC_THREAD_PRIORITY_LOW) == 0);
+
+    mtime_t start = mdate();
+    for (unsigned done = 0; done < packets; done += RTP_BATCH_MAX)
+    {
+        if (threads == 0)
+        {
+            for (unsigned i = 0; i < RTP_BATCH_MAX; i++)
+                for (unsigned j = 0; j < sinkc; j++)
+                    send(sinkv[j].rtp_fd, batchv[i]->p_buffer,
+                         batchv[i]->i_buffer, 0);
+            continue;
+        }
+
+        vlc_mutex_lock(&lock);
+        batch_seq++;
+        batch_pending = threads - 1;
+        vlc_cond_broadcast(&wait_batch);
+        vlc_mutex_unlock(&lock);
+
+        SendShard(0);
+
+        vlc_mutex_lock(&lock);
+        while (batch_pending > 0)
+            vlc_cond_wait(&wait_done, &lock);
+        vlc_mutex_unlock(&lock);
+    }
+    mtime_t elapsed = mdate() - start;
+
+    vlc_mutex_lock(&lock);
+    batch_seq = UINT_MAX;
+    vlc_cond_broadcast(&wait_batch);
+    vlc_mutex_unlock(&lock);
+    for (unsigned i = 1; i < threads; i++)
+        vlc_join(th[i], NULL);
+
+    for (unsigned i = 0; i < RTP_BATCH_MAX; i++)
+        block_Release(batchv[i]);
+    for (unsigned i = 0; i < sinkc; i++)
+    {
+        rtp_sink_Clean(&sinkv[i]);
+        Drain(receivers[i], NULL);
+    }
+
+    log(" %-24s %8.0f kpackets/s\n", desc,
+        (double)packets * sinkc * 1000 / (elapsed ? elapsed : 1));
+}
+
+static void bench_sinks(void)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+
+    log("Sending %u packets to %u loopback sinks\n", packets, sinkc);
+    vlc_mutex_init(&lock);
+    vlc_cond_init(&wait_batch);
+    vlc_cond_init(&wait_done);
+    sinkv = calloc(sinkc, sizeof (*sinkv));
+    receivers = calloc(sinkc, sizeof (*receivers));
+    assert(sinkv != NULL && receivers != NULL);
+
+    for (unsigned i = 0; i < sinkc; i++)
+    {
+        socklen_t len = sizeof (addr);
+
+        receivers[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        assert(receivers[i] != -1);
+        addr.sin_port = 0;
+        assert(bind(receivers[i], (struct sockaddr *)&addr, len) == 0);
+        assert(getsockname(receivers[i], (struct sockaddr *)&addr,
+                           &len) == 0);
+
+        sinkv[i].rtp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        assert(sinkv[i].rtp_fd != -1);
+        assert(connect(sinkv[i].rtp_fd, (struct sockaddr *)&addr,
+                       len) == 0);
+        SetNonBlocking(sinkv[i].rtp_fd);
+    }
+
+    Bench("send() per packet", 0);
+    Bench("batches", 1);
+    Bench("batches, 2 threads", 2);
+    Bench("batches, 4 threads", 4);
+
+    for (unsigned i = 0; i < sinkc; i++)
+    {
+        close(sinkv[i].rtp_fd);
+        close(receivers[i]);
+    }
+    free(receivers);
+    free(sinkv);
+    vlc_cond_destroy(&wait_done);
+    vlc_cond_destroy(&wait_batch);
+    vlc_mutex_destroy(&lock);
+}
+
+int main(int argc, char *argv[])
+{
+    test_init();
+
+    if (argc > 1)
+        sinkc = strtoul(argv[1], NULL, 0);
+    if (argc > 2)
+        packets = strtoul(argv[2], NULL, 0);
+
+    test_backlog(10);
+    test_backlog(RTP_BACKLOG_MAX);
+    test_backlog(4 * RTP_BACKLOG_MAX);
+    test_broken();
+    if (test_bench())
+        bench_sinks();
+    return 0;
+}
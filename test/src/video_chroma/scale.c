@@ -0,0 +1,223 @@
+/*****************************************************************************
+ * scale.c: fused chroma conversion and scaling test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Converts and scales cropped 1080p pictures, either in one pass with the
+ * yuvscale module or in two steps through an intermediate picture, and
+ * checks that yuvscale leaves the plain conversions to the converters. With
+ * VLC_TEST_BENCH set, reports the frame rate and the bytes touched per frame
+ * of each, with more frames by default.
+ * Usage: test_src_video_chroma_scale [filter threads] [frames] */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_filter.h>
+#include <vlc_picture.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static const struct
+{
+    vlc_fourcc_t in, out;
+    unsigned width, height; /* output size */
+} bench_cases[] = {
+    { VLC_CODEC_NV12, VLC_CODEC_RGB32, 1280,  720 },
+    { VLC_CODEC_NV12, VLC_CODEC_I420,   960,  540 },
+    { VLC_CODEC_I420, VLC_CODEC_RGB32, 1280,  720 },
+    { VLC_CODEC_I420, VLC_CODEC_I420,  2560, 1440 },
+};
+
+/* Input pictures are 1920x1088, cropped to 1920x1080 */
+#define IN_WIDTH  1920
+#define IN_HEIGHT 1088
+#define IN_CROP   1080
+
+static void Format (es_format_t *fmt, vlc_fourcc_t chroma,
+                    unsigned width, unsigned height, unsigned visible_height)
+{
+    es_format_Init (fmt, VIDEO_ES, chroma);
+    video_format_Setup (&fmt->video, chroma, width, height,
+                        width, visible_height, 1, 1);
+    fmt->video.i_frame_rate = 25;
+    fmt->video.i_frame_rate_base = 1;
+}
+
+static uint64_t Bytes (const video_format_t *fmt)
+{
+    const vlc_chroma_description_t *dsc =
+        vlc_fourcc_GetChromaDescription (fmt->i_chroma);
+    uint64_t bytes = 0;
+
+    for (unsigned i = 0; i < dsc->plane_count; i++)
+        bytes += (uint64_t)fmt->i_visible_width * dsc->p[i].w.num / dsc->p[i].w.den
+               * fmt->i_visible_height * dsc->p[i].h.num / dsc->p[i].h.den
+               * dsc->pixel_size;
+    return bytes;
+}
+
+static void Fill (picture_t *pic)
+{
+    for (int i = 0; i < pic->i_planes; i++)
+    {
+        plane_t *p = &pic->p[i];
+
+        for (int y = 0; y < p->i_lines; y++)
+            for (int x = 0; x < p->i_pitch; x++)
+                p->p_pixels[y * p->i_pitch + x] = (x + 3 * y) * 5;
+    }
+}
+
+/* Each filter reads its input picture and writes its output picture */
+static uint64_t ChainBytes (const es_format_t *in, const es_format_t *mid,
+                            const es_format_t *out)
+{
+    if (mid == NULL)
+        return Bytes (&in->video) + Bytes (&out->video);
+    return Bytes (&in->video) + 2 * Bytes (&mid->video) + Bytes (&out->video);
+}
+
+static void Run (vlc_object_t *obj, const char *desc, const es_format_t *in,
+                 const es_format_t *mid, const es_format_t *out,
+                 unsigned frames)
+{
+    filter_chain_t *chain = filter_chain_New (obj, "video filter2", false,
+                                              NULL, NULL, NULL);
+    assert (chain != NULL);
+    filter_chain_Reset (chain, in, out);
+
+    bool ok;
+    if (mid == NULL)
+        ok = filter_chain_AppendFilter (chain, "yuvscale", NULL,
+                                        NULL, out) != NULL;
+    else
+        ok = filter_chain_AppendFilter (chain, NULL, NULL, NULL, mid) != NULL
+          && filter_chain_AppendFilter (chain, NULL, NULL, mid, out) != NULL;
+    if (!ok)
+    {
+        log ("%-10s: cannot build the chain\n", desc);
+        assert (mid != NULL);
+        goto out;
+    }
+
+    picture_t *src = picture_NewFromFormat (&in->video);
+    assert (src != NULL);
+    Fill (src);
+
+    mtime_t start = mdate ();
+    for (unsigned i = 0; i < frames; i++)
+    {
+        picture_Hold (src);
+        picture_t *pic = filter_chain_VideoFilter (chain, src);
+        if (pic != NULL)
+            picture_Release (pic);
+    }
+    mtime_t elapsed = mdate () - start;
+
+    if (test_bench ())
+        log ("%-10s %4.4s %ux%u -> %4.4s %ux%u: %7.1f fps, %6.2f MB/frame\n",
+             desc, (const char *)&in->video.i_chroma,
+             in->video.i_visible_width, in->video.i_visible_height,
+             (const char *)&out->video.i_chroma,
+             out->video.i_visible_width, out->video.i_visible_height,
+             frames * (double)CLOCK_FREQ / elapsed,
+             ChainBytes (in, mid, out) / 1e6);
+    picture_Release (src);
+out:
+    filter_chain_Delete (chain);
+}
+
+/* Conversions without scaling are not for yuvscale */
+static void CheckNoScaling (vlc_object_t *obj, vlc_fourcc_t in_chroma,
+                            vlc_fourcc_t out_chroma)
+{
+    es_format_t in, out;
+
+    Format (&in, in_chroma, IN_WIDTH, IN_HEIGHT, IN_CROP);
+    Format (&out, out_chroma, IN_WIDTH, IN_CROP, IN_CROP);
+
+    filter_chain_t *chain = filter_chain_New (obj, "video filter2", false,
+                                              NULL, NULL, NULL);
+    assert (chain != NULL);
+    filter_chain_Reset (chain, &in, &out);
+    assert (filter_chain_AppendFilter (chain, "yuvscale", NULL,
+                                       NULL, &out) == NULL);
+    filter_chain_Delete (chain);
+    es_format_Clean (&out);
+    es_format_Clean (&in);
+}
+
+int main (int argc, char *argv[])
+{
+    char threads[32];
+    unsigned frames = (argc > 2) ? atoi (argv[2]) : test_bench () ? 100 : 2;
+
+    snprintf (threads, sizeof (threads), "--filter-threads=%s",
+              (argc > 1) ? argv[1] : "0");
+
+    const char *args[] = {
+        "--ignore-config",
+        "-I",
+        "dummy",
+        threads,
+    };
+
+    test_init ();
+
+    libvlc_instance_t *vlc = libvlc_new (sizeof (args) / sizeof (args[0]),
+                                         args);
+    assert (vlc != NULL);
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    CheckNoScaling (obj, VLC_CODEC_I420, VLC_CODEC_RGB32);
+    CheckNoScaling (obj, VLC_CODEC_NV12, VLC_CODEC_I420);
+
+    if (test_bench ())
+        log ("%s, %u frames per run\n", threads, frames);
+    for (unsigned i = 0; i < sizeof (bench_cases) / sizeof (bench_cases[0]); i++)
+    {
+        es_format_t in, mid, out;
+
+        Format (&in, bench_cases[i].in, IN_WIDTH, IN_HEIGHT, IN_CROP);
+        Format (&out, bench_cases[i].out, bench_cases[i].width,
+                bench_cases[i].height, bench_cases[i].height);
+        /* Conversion at the input size, then scaling */
+        Format (&mid, bench_cases[i].out, IN_WIDTH, IN_CROP, IN_CROP);
+        if (bench_cases[i].in == bench_cases[i].out
+         || Bytes (&out.video) < Bytes (&mid.video))
+        {   /* Scaling first, then conversion */
+            es_format_Clean (&mid);
+            Format (&mid, bench_cases[i].in, bench_cases[i].width,
+                    bench_cases[i].height, bench_cases[i].height);
+        }
+
+        Run (obj, "fused", &in, NULL, &out, frames);
+        if (bench_cases[i].in != bench_cases[i].out)
+            Run (obj, "two steps", &in, &mid, &out, frames);
+
+        es_format_Clean (&mid);
+        es_format_Clean (&out);
+        es_format_Clean (&in);
+    }
+
+    libvlc_release (vlc);
+    return 0;
+}
@@ -0,0 +1,262 @@
+/*****************************************************************************
+ * filters.c: sliced video filters test and benchmark
+ *****************************************************************************
+ * Copyright (C) 2016 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Runs the sliced video filters with and without slicing, and checks that
+ * they output the same pictures. When benchmarking, it also reports the
+ * frame rate of each filter on 1080p and 2160p I420 pictures.
+ * Usage: test_src_video_filter_filters [filter threads] [frames] */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_filter.h>
+#include <vlc_picture.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *bench_filters[] = {
+    "adjust{contrast=1.2,brightness=1.1,hue=20,saturation=1.3}",
+    "sharpen{sigma=0.5}",
+    "gradfun",
+    /* Strong enough for the spatial recursion to reach across slices */
+    "hqdn3d{luma-spat=254,chroma-spat=254}",
+    "deinterlace{mode=yadif}",
+};
+
+static const struct
+{
+    unsigned width, height;
+} bench_sizes[] = {
+    { 1920, 1080 },
+    { 3840, 2160 },
+};
+
+/* Smooth gradients, for gradfun, with some noise, for hqdn3d and sharpen,
+ * changing from one picture to the next, for the temporal filters */
+static void Fill (picture_t *pic, unsigned seed)
+{
+    uint32_t rand = seed * 2654435761u + 1;
+
+    for (int i = 0; i < pic->i_planes; i++)
+    {
+        plane_t *p = &pic->p[i];
+
+        for (int y = 0; y < p->i_visible_lines; y++)
+            for (int x = 0; x < p->i_visible_pitch; x++)
+            {
+                rand = rand * 1103515245 + 12345;
+                p->p_pixels[y * p->i_pitch + x] =
+                    (x + 2 * y) / 8 + 5 * seed + i * 40 + ((rand >> 16) & 7);
+            }
+    }
+    pic->b_progressive = false;
+    pic->b_top_field_first = true;
+    pic->i_nb_fields = 2;
+    pic->date = VLC_TS_0 + seed * CLOCK_FREQ / 25;
+}
+
+static filter_chain_t *NewChain (vlc_object_t *obj, const char *name,
+                                 es_format_t *fmt)
+{
+    filter_chain_t *chain = filter_chain_New (obj, "video filter2", false,
+                                              NULL, NULL, NULL);
+    assert (chain != NULL);
+    filter_chain_Reset (chain, fmt, fmt);
+
+    if (filter_chain_AppendFromString (chain, name) < 0)
+    {
+        log ("%s: cannot load filter\n", name);
+        filter_chain_Delete (chain);
+        return NULL;
+    }
+    return chain;
+}
+
+static void ReleaseAll (picture_t *pic)
+{
+    while (pic != NULL)
+    {
+        picture_t *next = pic->p_next;
+        picture_Release (pic);
+        pic = next;
+    }
+}
+
+static void AssertEqual (const picture_t *a, const picture_t *b)
+{
+    assert (a->i_planes == b->i_planes);
+    for (int i = 0; i < a->i_planes; i++)
+    {
+        const plane_t *pa = &a->p[i], *pb = &b->p[i];
+
+        assert (pa->i_visible_lines == pb->i_visible_lines);
+        assert (pa->i_visible_pitch == pb->i_visible_pitch);
+        for (int y = 0; y < pa->i_visible_lines; y++)
+            assert (!memcmp (&pa->p_pixels[y * pa->i_pitch],
+                             &pb->p_pixels[y * pb->i_pitch],
+                             pa->i_visible_pitch));
+    }
+}
+
+/* Checks that the filter outputs the same pictures on both instances */
+static void Check (vlc_object_t *serial, vlc_object_t *sliced,
+                   const char *name, unsigned width, unsigned height,
+                   unsigned frames)
+{
+    es_format_t fmt;
+
+    es_format_Init (&fmt, VIDEO_ES, VLC_CODEC_I420);
+    video_format_Setup (&fmt.video, VLC_CODEC_I420, width, height,
+                        width, height, 1, 1);
+    fmt.video.i_frame_rate = 25;
+    fmt.video.i_frame_rate_base = 1;
+
+    filter_chain_t *chains[2] = {
+        NewChain (serial, name, &fmt),
+        NewChain (sliced, name, &fmt),
+    };
+    assert (chains[0] != NULL && chains[1] != NULL);
+
+    unsigned outputs = 0;
+    for (unsigned i = 0; i < frames; i++)
+    {
+        picture_t *out[2];
+
+        for (unsigned j = 0; j < 2; j++)
+        {
+            picture_t *pic = picture_NewFromFormat (&fmt.video);
+            assert (pic != NULL);
+            Fill (pic, i);
+            out[j] = filter_chain_VideoFilter (chains[j], pic);
+        }
+
+        for (picture_t *a = out[0], *b = out[1]; a != NULL || b != NULL;
+             a = a->p_next, b = b->p_next)
+        {
+            assert (a != NULL && b != NULL);
+            AssertEqual (a, b);
+            outputs++;
+        }
+        ReleaseAll (out[0]);
+        ReleaseAll (out[1]);
+    }
+    assert (outputs > 0);
+    log ("%-60s %4ux%-4u same %u pictures\n", name, width, height, outputs);
+
+    filter_chain_Delete (chains[1]);
+    filter_chain_Delete (chains[0]);
+    es_format_Clean (&fmt);
+}
+
+static void Bench (vlc_object_t *obj, const char *name,
+                   unsigned width, unsigned height, unsigned frames)
+{
+    es_format_t fmt;
+
+    es_format_Init (&fmt, VIDEO_ES, VLC_CODEC_I420);
+    video_format_Setup (&fmt.video, VLC_CODEC_I420, width, height,
+                        width, height, 1, 1);
+    fmt.video.i_frame_rate = 25;
+    fmt.video.i_frame_rate_base = 1;
+
+    filter_chain_t *chain = NewChain (obj, name, &fmt);
+    if (chain == NULL)
+        goto out;
+
+    picture_t *src = picture_NewFromFormat (&fmt.video);
+    assert (src != NULL);
+    Fill (src, 0);
+
+    mtime_t start = mdate ();
+    for (unsigned i = 0; i < frames; i++)
+    {
+        picture_t *pic = picture_NewFromFormat (&fmt.video);
+        assert (pic != NULL);
+        picture_Copy (pic, src);
+        pic->date = VLC_TS_0 + i * CLOCK_FREQ / 25;
+
+        ReleaseAll (filter_chain_VideoFilter (chain, pic));
+    }
+    mtime_t elapsed = mdate () - start;
+
+    log ("%-60s %4ux%-4u %7.1f fps\n", name, width, height,
+         frames * (double)CLOCK_FREQ / elapsed);
+    picture_Release (src);
+    filter_chain_Delete (chain);
+out:
+    es_format_Clean (&fmt);
+}
+
+static libvlc_instance_t *New (const char *threads)
+{
+    const char *args[] = {
+        "--ignore-config",
+        "-I",
+        "dummy",
+        threads,
+    };
+
+    libvlc_instance_t *vlc = libvlc_new (sizeof (args) / sizeof (args[0]),
+                                         args);
+    assert (vlc != NULL);
+    return vlc;
+}
+
+int main (int argc, char *argv[])
+{
+    char threads[32];
+
+    test_init ();
+
+    /* An odd number of slices, so that their boundaries are not aligned on
+     * the chroma lines */
+    libvlc_instance_t *serial = New ("--filter-threads=1");
+    libvlc_instance_t *sliced = New ("--filter-threads=7");
+
+    log ("Comparing 7 slices with no slicing\n");
+    for (unsigned j = 0; j < sizeof (bench_filters) / sizeof (bench_filters[0]); j++)
+        Check (VLC_OBJECT(serial->p_libvlc_int),
+               VLC_OBJECT(sliced->p_libvlc_int), bench_filters[j],
+               720, 576, 4);
+
+    libvlc_release (sliced);
+    libvlc_release (serial);
+
+    if (!test_bench ())
+        return 0;
+
+    unsigned frames = (argc > 2) ? atoi (argv[2]) : 50;
+    snprintf (threads, sizeof (threads), "--filter-threads=%s",
+              (argc > 1) ? argv[1] : "0");
+
+    libvlc_instance_t *vlc = New (threads);
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    log ("%s, %u frames per run\n", threads, frames);
+    for (unsigned i = 0; i < sizeof (bench_sizes) / sizeof (bench_sizes[0]); i++)
+        for (unsigned j = 0; j < sizeof (bench_filters) / sizeof (bench_filters[0]); j++)
+            Bench (obj, bench_filters[j], bench_sizes[i].width,
+                   bench_sizes[i].height, frames);
+
+    libvlc_release (vlc);
+    return 0;
+}